@@ -16,7 +16,7 @@
 //					Store the AST (Abstract Syntax Tree) for the function prototypes in the database, so we don't have to parse each one when
 //					generating a Detour
 //
-// VERSION:		1.1
+// VERSION:		1.2
 //
 // AUTHOR:		Brian Catlin
 //
@@ -24,6 +24,9 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.2		2026-10-17	Brian Catlin
+//			Pass /COMPACT to the code generator
+//
 //	1.1		2020-03-08	Brian Catlin
 //			General cleanup before release
 //
@@ -1090,7 +1093,7 @@ namespace FDI.AutoGen
 				// Generate the source file containing the Detours
 				//
 
-				Code_Gen.create_detours (Parsed_command.output, Parsed_command.file_names, ref api_list, ref headers);
+				Code_Gen.create_detours (Parsed_command.output, Parsed_command.file_names, ref api_list, ref headers, Parsed_command.compact);
 				}
 
 			}   // End process_files
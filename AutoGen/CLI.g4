@@ -19,6 +19,7 @@ input_files :
 
 qualifier :
 				all_qual
+			|	compact_qual
 			|	database_qual
 			|   exclude_dlls_qual
 			|   exports_qual
@@ -36,6 +37,10 @@ all_qual :
 				qual_char ALL
 				;
 
+compact_qual :
+				qual_char COMPACT
+				;
+
 database_qual :
 				qual_char DATABASE assignment_char file
 				;
@@ -111,6 +116,7 @@ assignment_char :
 //
 
 ALL :           A (L (L)? )?;
+COMPACT :		C O M (P (A (C (T)? )? )? )? ;
 DATABASE :		D (A (T (A (B (A (S (E)? )? )? )? )? )? )? ;
 EXCLUDE_DLLS :  E X C (L (U (D (E ('_' (D (L (L (S)? )? )? )? )? )? )? )? )? ;
 EXPORTS :       E X P (O (R (T (S)? )? )? )? ;
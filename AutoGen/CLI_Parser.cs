@@ -13,7 +13,7 @@
 //					It would be nice to have positional qualifiers, i.e. they affect a particular input file. Right now, all qualifiers are global
 //					and affect all input files
 //
-// VERSION:		1.1
+// VERSION:		1.2
 //
 // AUTHOR:		Brian Catlin
 //
@@ -21,6 +21,9 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.2		2026-10-17	Brian Catlin
+//			Added /COMPACT, which generates table-driven intercept thunks instead of an expanded intercept for each API
+//
 //	1.1		2020-03-09	Brian Catlin
 //			Fix bug introduced by the FILE_NAME grammar rule that caused qualifiers starting with a hyphen ('-') to not be recognized
 //			As a result, file names containing a hyphen must now be double-quoted, e.g. /INCLUDE_DLLS="api-ms-win-core-string-*.dll" 
@@ -110,7 +113,7 @@ namespace FDI.AutoGen
 			// /HELP shouldn't be specified with any other qualifiers or input files
 			//
 
-			if (parsed_command.help && (parsed_command.all || parsed_command.exclude_dlls.Count != 0 || parsed_command.exports || parsed_command.file_names.Count != 0 
+			if (parsed_command.help && (parsed_command.all || parsed_command.compact || parsed_command.exclude_dlls.Count != 0 || parsed_command.exports || parsed_command.file_names.Count != 0 
 				|| parsed_command.imports || parsed_command.output.Length != 0 || parsed_command.recurse))
 				{
 				throw new ArgumentException ("/HELP is not valid with any other qualifiers or input file(s)");
@@ -298,6 +301,7 @@ namespace FDI.AutoGen
 				{
 				Console.WriteLine ($"Command line: {Command}");
 				Console.WriteLine ($"All:\t\t{parsed_command.all}");
+				Console.WriteLine ($"Compact:\t{parsed_command.compact}");
 				Console.WriteLine ($"Database:\t{parsed_command.database}");
 				Console.WriteLine ($"Exclude_dlls:\t{string.Join (", ", parsed_command.exclude_dlls)}");
 				Console.WriteLine ($"Exports:\t{parsed_command.exports}");
@@ -437,6 +441,15 @@ QUALIFIERS
 	Do not skip CRTL DLLs. Normally, all routines in the various C Run-Time
 	Libraries are not Detourable.
 
+/COMPACT
+	Instead of generating a complete Detour routine for each API, generate a
+	small table entry for each API (its argument count and types) and route
+	every Detour through a few shared, table-driven routines (see Thunk.h). The
+	generated code is much smaller, which matters when thousands of APIs are
+	traced. Each API's pre-call event holds its arguments as an array of raw
+	values, and its post-call event holds only the return value and the last
+	error status; output parameters and buffer snapshots are not recorded.
+
 /DATABASE=file.accdb
 	Path to the Access database used to remember API definitions. The default is
 	Win32API.accdb in the current directory. If only a path is specified, then 
@@ -574,6 +587,19 @@ section DEFAULT PATHS. The output file will be taskmgr.cpp in the current direct
 				parsed_command_line.all = true;
 				}   // End ExitAll_qual
 
+			/// <summary>
+			/// If /COMPACT was specified, then record that
+			/// </summary>
+			/// <param name="Context">ANTLR parser context. Not used</param>
+			public override void
+			ExitCompact_qual 
+				(
+				[NotNull] CLIParser.Compact_qualContext	Context
+				)
+				{
+				parsed_command_line.compact = true;
+				}   // End ExitCompact_qual
+
 			/// <summary>
 			/// If /DATABASE=filename was specified, then save the file name
 			/// </summary>
@@ -866,6 +892,7 @@ section DEFAULT PATHS. The output file will be taskmgr.cpp in the current direct
 	public class Command_Line_Options
 		{
 		public bool				all { get; set; }
+		public bool				compact { get; set; }
 		public string			database { get; set; }
 		public List <string>	exclude_dlls { get; set; }
 		public bool				exports { get; set; }
@@ -885,6 +912,7 @@ section DEFAULT PATHS. The output file will be taskmgr.cpp in the current direct
 		public Command_Line_Options ()
 			{
 			all = false;
+			compact = false;
 			database = "";
 			exclude_dlls = new List <string> ();
 			exports = false;
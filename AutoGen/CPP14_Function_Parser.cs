@@ -8,7 +8,7 @@
 //					There are some bugs in the C grammar that forced some workarounds and ultimately the switch to using the C++ grammar. Of course,
 //					it would be better to fix the grammar (https://github.com/antlr/grammars-v4/issues/1565) but I wasn't given the time to do so
 //
-// VERSION:		1.1
+// VERSION:		1.3
 //
 // AUTHOR:		Brian Catlin
 //
@@ -16,6 +16,12 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.3		2026-10-17	Brian Catlin
+//			Keep the parameters whose types the thunk record of an API holds (/COMPACT)
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Keep each parameter's SAL annotation, its position, and how its buffer is captured
+//
 //	1.1		2020-03-08	Brian Catlin
 //			General cleanup before release
 //
@@ -266,6 +272,7 @@ namespace FDI.AutoGen
 
 			if (in_params_list)
 				{
+				cur_parameter.sal = text;
 
 				//
 				// Look for _Inout_ or _Out_ in the SAL string. If we find one, then mark this as an output parameter
@@ -810,6 +817,9 @@ namespace FDI.AutoGen
 		public List <string>	specifiers { get; set; }
 		public List <Api_Param>	parameters { get; set; }
 		public List <Api_Param>	output_parameters { get; set; }	// Workaround for StringTemplate bug #126
+		public List <Api_Param>	pre_data { get; set; }			// Parameters whose buffers are captured before the call
+		public List <Api_Param>	post_data { get; set; }			// Parameters whose buffers are captured after the call
+		public List <Api_Param>	thunk_parameters { get; set; }	// Parameters whose types the thunk record holds (/COMPACT)
 		public uint				id { get; set; }
 		public bool				ret_void { get; set; }
 		public bool				ret_pointer { get; set; }
@@ -817,6 +827,8 @@ namespace FDI.AutoGen
 		public bool				ret_scalar { get; set; }
 		public string			header { get; set; }
 		public bool				has_outputs { get; set; }
+		public bool				has_pre_data { get; set; }
+		public bool				has_post_data { get; set; }
 		public int				ret_type_idx { get; set; }
 
 		public Api ()
@@ -839,6 +851,12 @@ namespace FDI.AutoGen
 		public bool				is_scalar { get; set; }
 		public bool				is_enum { get; set; }
 		public bool				is_custom { get; set; }
+		public string			sal { get; set; }				// SAL annotation, without whitespace
+		public uint				position { get; set; }			// Index in the parameter list
+		public bool				capture_pre { get; set; }		// Capture the buffer before the call
+		public bool				capture_post { get; set; }		// Capture the buffer after the call
+		public string			capture_size { get; set; }		// C++ expression for the size of the buffer
+		public string			capture_max { get; set; }		// C++ expression for the most bytes to capture
 
 		public Api_Param ()
 			{
@@ -858,6 +876,12 @@ namespace FDI.AutoGen
 			is_input = false;
 			is_output = false;
 			is_pointer = false;
+			sal = string.Empty;
+			position = 0;
+			capture_pre = false;
+			capture_post = false;
+			capture_size = string.Empty;
+			capture_max = string.Empty;
 			}   // End clear
 
 		}   // End class Api_Param
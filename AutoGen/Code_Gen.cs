@@ -7,7 +7,7 @@
 //
 //				This code probably isn't as efficient as it could be, and it would probably benefit greatly by the use of asynch-await
 //
-// VERSION:		1.1
+// VERSION:		1.4
 //
 // AUTHOR:		Brian Catlin
 //
@@ -15,6 +15,18 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.4		2026-10-17	Brian Catlin
+//			With /COMPACT, generate the tables that the table-driven thunks (see TraceAPI\Thunk.h) read, instead of an intercept
+//			for each API
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Capture the contents of buffer parameters, as described by the rules in capture_rules or by the parameter's
+//			_In_reads_bytes_ SAL annotation
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Create the lists of output parameters before generating the pointers to the real APIs, which now include the schema of
+//			each API
+//
 //	1.1		2020-04-19	Brian Catlin
 //			General cleanup before release
 //			Improve heuristics that determine parameter type and return type from function signatures. This removes warning and errors from nearly
@@ -33,6 +45,7 @@ using System;
 using System.Collections.Generic;
 using System.IO;
 using System.Linq;
+using System.Text.RegularExpressions;
 
 //
 // Third-party NuGet namespaces
@@ -261,6 +274,35 @@ namespace FDI.AutoGen
 			"WPARAM"
 			};
 
+		//
+		// Rules for capturing the contents of buffer parameters. The size is a C++ expression in the intercept, which can use the API's
+		// parameters and, after the call, ret_value; the bytes captured are at most the rule's maximum, and at most the CaptureBufferBytes
+		// registry parameter. An input parameter annotated _In_reads_bytes_ (size) that is not listed here is captured before the call,
+		// up to default_capture_max bytes
+		//
+
+		public static readonly List <Capture_Rule> capture_rules = new List <Capture_Rule> ()
+			{
+			new Capture_Rule ("FindFirstFileA", "lpFindFileData", true, "ret_value != INVALID_HANDLE_VALUE ? sizeof (*lpFindFileData) : 0",
+				"sizeof (WIN32_FIND_DATAA)"),
+			new Capture_Rule ("FindFirstFileW", "lpFindFileData", true, "ret_value != INVALID_HANDLE_VALUE ? sizeof (*lpFindFileData) : 0",
+				"sizeof (WIN32_FIND_DATAW)"),
+			new Capture_Rule ("FindNextFileA", "lpFindFileData", true, "ret_value ? sizeof (*lpFindFileData) : 0", "sizeof (WIN32_FIND_DATAA)"),
+			new Capture_Rule ("FindNextFileW", "lpFindFileData", true, "ret_value ? sizeof (*lpFindFileData) : 0", "sizeof (WIN32_FIND_DATAW)"),
+			new Capture_Rule ("GetFileAttributesExA", "lpFileInformation", true,
+				"ret_value && fInfoLevelId == GetFileExInfoStandard ? sizeof (WIN32_FILE_ATTRIBUTE_DATA) : 0", "sizeof (WIN32_FILE_ATTRIBUTE_DATA)"),
+			new Capture_Rule ("GetFileAttributesExW", "lpFileInformation", true,
+				"ret_value && fInfoLevelId == GetFileExInfoStandard ? sizeof (WIN32_FILE_ATTRIBUTE_DATA) : 0", "sizeof (WIN32_FILE_ATTRIBUTE_DATA)"),
+			new Capture_Rule ("GetFileInformationByHandle", "lpFileInformation", true, "ret_value ? sizeof (*lpFileInformation) : 0",
+				"sizeof (BY_HANDLE_FILE_INFORMATION)"),
+			new Capture_Rule ("ReadFile", "lpBuffer", true, "ret_value && lpNumberOfBytesRead != nullptr ? *lpNumberOfBytesRead : 0", "256"),
+			new Capture_Rule ("WriteFile", "lpBuffer", false, "nNumberOfBytesToWrite", "256")
+			};
+
+		public static readonly string default_capture_max = "256";
+
+		static readonly Regex sal_reads_bytes = new Regex (@"_In_reads_bytes_(opt_)?\((?<size>[A-Za-z_][A-Za-z0-9_]*)\)");
+
 		//
 		// Placing the templates in this string removes the dependency on the Detours.stg file. This string and the .STG file should be identical,
 		// except that the double-quotes in the .STG file had to be doubled to work in a C# file
@@ -286,7 +328,7 @@ api_list (apis) ::=
 // Template for the beginning of file
 //
 
-file_header(version, date, exe_name, apis_to_detour, headers, command_line) ::= 
+file_header(version, date, exe_name, apis_to_detour, headers, command_line, compact) ::= 
 <<
 //
 //	WARNING: This file was generated by AutoGen version <version> on <date>
@@ -307,7 +349,7 @@ file_header(version, date, exe_name, apis_to_detour, headers, command_line) ::=
 //				The following APIs are intercepted and logged:
 //					<api_list (apis_to_detour)>
 //
-// VERSION:		1.1
+// VERSION:		1.11
 //
 // AUTHOR:		Brian Catlin
 //
@@ -315,6 +357,42 @@ file_header(version, date, exe_name, apis_to_detour, headers, command_line) ::=
 //
 // MODIFICATION HISTORY:
 //
+//	1.11	2026-10-17	Brian Catlin
+//			Add all the threads of the process, not only the calling thread, to each Detours transaction, because
+//			staged attach and the control channel attach and detach APIs while the program is running
+//
+//	1.10	2026-10-17	Brian Catlin
+//			In capture mode, store the ID of the caller's stack (see StackTable.h) in the pre-call record
+//
+//	1.9		2026-10-17	Brian Catlin
+//			With /COMPACT, point each Detour at a table-driven thunk (see Thunk.h) instead of generating an intercept for each
+//			API, and generate the tables that the thunks read (TA_thunk_real and TA_thunk_info) and TA_thunk_trace
+//
+//	1.8		2026-10-17	Brian Catlin
+//			Replace the lists of ATTACH and DETACH lines with a table of the Detours (TA_detours), indexed by API number, so
+//			that staged attach (see Attach.h) can attach and detach any list of APIs
+//
+//	1.7		2026-10-17	Brian Catlin
+//			Capture the first bytes of the buffer parameters that have a capture rule (see capture_rules in Code_Gen.cs): copied into
+//			the ring in capture mode, and passed to TraceLoggingBinary otherwise
+//
+//	1.6		2026-10-17	Brian Catlin
+//			Apply the API's sampling and rate limiting policy (see Policy.h) before building any event
+//
+//	1.5		2026-10-17	Brian Catlin
+//			In statistics mode (see Stats.h), time the real API and count the call instead of writing events
+//
+//	1.4		2026-10-17	Brian Catlin
+//			Identify each capture record by API number, and generate the schema (TA_api_schema) that the capture file sink writes
+//			at the start of a trace file
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Guard each intercept with Intercept::enter, so that nested calls and disabled APIs go straight to the real API
+//
+//	1.2		2026-10-17	Brian Catlin
+//			In capture mode (see Capture.h), write the pre-call and post-call entries to the calling thread's ring buffer instead of
+//			calling TraceLoggingWrite
+//
 //	1.1		2020-04-19	Brian Catlin
 //			Support new heuristics that detect parameter data type with appropriate TraceLoggingXxx macro invocations in the trace_input_params and
 //			trace_output_params string templates
@@ -337,9 +415,11 @@ file_header(version, date, exe_name, apis_to_detour, headers, command_line) ::=
 #include \<ntstatus.h>
 #include \<TraceLoggingProvider.h>
 #include \<evntprov.h>
+#include \<TlHelp32.h>
 
 #include \<string>
 #include \<list>
+#include \<vector>
 
 <if (headers)>
 //
@@ -356,6 +436,14 @@ file_header(version, date, exe_name, apis_to_detour, headers, command_line) ::=
 #include ""detours.h""
 
 #include ""TraceAPI.h""
+#include ""Capture.h""
+#include ""Intercept.h""
+#include ""Stats.h""
+#include ""Policy.h""
+#include ""StackTable.h""
+<if (compact)>
+#include ""Thunk.h""
+<endif>
 #include ""..\Global\Utils.h""
 #include ""..\Global\WPP_Tracing.h""
 #include ""Version.h""
@@ -376,8 +464,8 @@ using namespace FDI;
 // MACROS:
 //
 
-#define ATTACH(x)       det_attach (&(PVOID&) real_##x, my_##x, #x)
-#define DETACH(x)       det_detach (&(PVOID&) real_##x, my_##x, #x)
+#define DETOUR(x)       {&(PVOID&) real_##x, (PVOID) my_##x, #x}
+#define THUNK(x, n)     {&TA_thunk_real [n], (PVOID) Thunk::entry_of\<n> (&x), #x}
 
 //
 // DEFINITIONS:
@@ -427,12 +515,22 @@ my_<api.func_name>
 
 //
 // Template for pointers to the real API (with a 'real_' suffix) and a forward declaration to our Detoured
-// API (with a 'my_' suffix)
+// API (with a 'my_' suffix). With /COMPACT, a table of the real APIs and the records that the thunks read instead
 //
 
-real_api_list (list) ::=
+real_api_list (list, compact) ::=
 <<
 
+<if (compact)>
+//
+// The real APIs, indexed by API number. Detours changes each one to point at the trampoline
+//
+
+void	*TA_thunk_real [] =
+	{
+<list:{l|	(PVOID) <l.func_name>}; separator = "",\n"">
+	};
+<else>
 //
 // Pointers to the real APIs
 //
@@ -442,65 +540,188 @@ extern ""C""
 <list:{l|<real_api_decl(l)>}; separator = ""\n\n"">
 
 }	// extern ""C""
+<endif>
+
+//
+// Parameters of each intercepted API: the pre-call parameters, then the post-call return value, last error status, and
+// output parameters, in the order that the intercept captures them
+//
+
+<list:{l|<api_schema (l)>}; separator = ""\n\n"">
+
+//
+// Schema of the intercepted APIs, indexed by the API number that each intercept passes to Intercept::enter and
+// Capture::begin_record
+//
+
+extern const TA_API_SCHEMA	TA_api_schema [] =
+	{
+<list:{l|	{""<l.func_name>"", TA_<l.func_name>_params\}}; separator = "",\n"">
+	};
+
+extern const ULONG	TA_api_count = ARRAYSIZE (TA_api_schema);
+<if (compact)>
+
+//
+// Arguments of each intercepted API, indexed by API number, which the thunks read (see Thunk.h)
+//
+
+extern const TA_THUNK_INFO	TA_thunk_info [] =
+	{
+<list:{l|<thunk_info (l, i0)>}; separator = "",\n"">
+	};
+<endif>
 
 //
 // FORWARD ROUTINES:
 //
 
 NTSTATUS 
-attach_detours										// Intercept the APIs
+attach_detours										// Intercept a list of APIs
 	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
 	);
 
 NTSTATUS
-detach_detours										// Stop intercepting the APIs
+detach_detours										// Stop intercepting a list of APIs
 	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
 	);
 
+<if (!compact)>
 //
 // Forward declarations of generated routines
 //
 
 <list:{l|<my_api_decl(l)>}; separator = ""\n\n"">
+<endif>
 
 >>
 
 //
-// Generate a ATTACH line for an API
+// Template the table of Detours, and the attach_detours and detach_detours routines
 //
 
-attach (name) ::=
+support_routines (exename, api_list, compact) ::=
 <<
-	ATTACH (<name>);
->>
 
 //
-// Generate a DETACH line for an API
+// The Detours, indexed by API number. Detours changes each real_ pointer (with /COMPACT, each TA_thunk_real entry)
+// to point at the trampoline
 //
 
-detach (name) ::=
-<<
-	DETACH (<name>);
->>
+static const TA_DETOUR	TA_detours [] =
+	{
+<if (compact)>
+<api_list:{a|	THUNK (<a.func_name>, <i0>)}; separator = "",\n"">
+<else>
+<api_list:{a|	DETOUR (<a.func_name>)}; separator = "",\n"">
+<endif>
+	};
+
+
+static void
+update_threads										// Add the process's threads to a Detours transaction
+	(
+	_Inout_	std::vector\<HANDLE>&	Threads			// Handles of the threads, for close_threads
+	)
 
 //
-// Template the attach_detours and detach_detours routines
+// DESCRIPTION:		Add every thread of the process other than the calling one to the transaction, so that Detours suspends
+//					them and moves any instruction pointer that is in the code being patched. The worker thread of staged
+//					attach and the control channel's thread run transactions while the program's threads are running
+//
+// ASSUMPTIONS:		User mode. A Detours transaction has been begun
+//
+// SIDE EFFECTS:	The threads are suspended until the transaction is committed
+//
+// RETURN VALUES:	None
 //
 
-support_routines (exename, api_list) ::=
-<<
+{
+HANDLE			snapshot;
+HANDLE			thread;
+THREADENTRY32	entry;
+DWORD			process_id = GetCurrentProcessId ();
+DWORD			thread_id = GetCurrentThreadId ();
+BOOL			more;
 
 
-NTSTATUS 
-attach_detours										// Intercept the APIs
+	DetourUpdateThread (GetCurrentThread ());
+
+	if ((snapshot = CreateToolhelp32Snapshot (TH32CS_SNAPTHREAD, 0)) == INVALID_HANDLE_VALUE)
+		{
+		TRACE_WARN (TRACEAPI, ""Error taking a snapshot of the threads, error = %lu"", GetLastError ());
+		return;
+		}
+
+	entry.dwSize = sizeof (entry);
+
+	for (more = Thread32First (snapshot, &entry); more; more = Thread32Next (snapshot, &entry))
+		{
+		//
+		// Skip the threads of other processes, and this one. A thread that has exited since the snapshot cannot be opened
+		//
+
+		if (entry.th32OwnerProcessID != process_id || entry.th32ThreadID == thread_id)
+			{
+			continue;
+			}
+
+		if ((thread = OpenThread (THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT, FALSE, entry.th32ThreadID)) == NULL)
+			{
+			continue;
+			}
+
+		Threads.push_back (thread);
+		DetourUpdateThread (thread);
+		}
+
+	CloseHandle (snapshot);
+}							// End update_threads
+
+
+static void
+close_threads										// Close the handles of the threads added to a Detours transaction
 	(
+	_Inout_	std::vector\<HANDLE>&	Threads			// Handles from update_threads
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Close the handles, after the transaction has been committed and Detours has resumed the threads
 //
 // ASSUMPTIONS:		User mode
 //
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:	None
+//
+
+{
+	for (HANDLE thread : Threads)
+		{
+		CloseHandle (thread);
+		}
+
+	Threads.clear ();
+}							// End close_threads
+
+
+NTSTATUS 
+attach_detours										// Intercept a list of APIs
+	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
+	)
+
+//
+// DESCRIPTION:		Attach the Detours of the APIs, in one Detours transaction. Staged attach (see Attach.h) calls this for the
+//					core set of APIs, and for each later batch
+//
+// ASSUMPTIONS:		User mode. Not called by two threads at once
+//
 // SIDE EFFECTS:
 //
 // RETURN VALUES:
@@ -509,30 +730,45 @@ attach_detours										// Intercept the APIs
 
 {
 NTSTATUS	status;
+DETOUR_COMMIT_STATS	stats;
+std::vector\<HANDLE>	threads;
+uint32_t	i;
 
 
 	TRACE_ENTER ();
 
 	//
 	// Tell Detours that we're starting a transaction to update the list of detours
+	// as a bulk commit, which changes the page protection once per range of pages
+	// rather than once per detour
+	// and suspends all the other threads of the process
 	//
 
+	DetourSetBulkCommit (TRUE);
 	DetourTransactionBegin ();
-	DetourUpdateThread (GetCurrentThread ());
+	update_threads (threads);
 
 	//
-	// List all the Detours to install
-	//
-	// NOTE: This list MUST match the list in detach_detours
+	// Attach the Detours of the listed APIs
 	//
 
-<api_list:{a|<attach (a.func_name)>}; separator = ""\n"">
+	for (i = 0; i \< Count; i++)
+		{
+		det_attach (TA_detours [Apis [i]].real_api, TA_detours [Apis [i]].my_api, TA_detours [Apis [i]].name);
+		}
 
 	//
 	// Tell Detours that we're done updating detours
 	//
 
 	status = DetourTransactionCommit ();
+	close_threads (threads);
+
+	if (DetourGetCommitStats (&stats))
+		{
+		TRACE_INFO (TRACEAPI, ""Attach: %lu detours, %lu page ranges, %lu protection calls, %lu usec, status = %d"",
+			stats.cOperations, stats.cRanges, stats.cProtectCalls, stats.cMicroseconds, status);
+		}
 
 	TRACE_EXIT ();
 	return status;
@@ -540,14 +776,17 @@ NTSTATUS	status;
 
 
 NTSTATUS
-detach_detours										// Stop intercepting the APIs
+detach_detours										// Stop intercepting a list of APIs
 	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Detach the Detours of the APIs, in one Detours transaction. The list is the APIs that staged attach
+//					attached (Attach::attached)
 //
-// ASSUMPTIONS:		User mode
+// ASSUMPTIONS:		User mode. Staged attach has been stopped
 //
 // SIDE EFFECTS:
 //
@@ -557,34 +796,128 @@ detach_detours										// Stop intercepting the APIs
 
 {
 NTSTATUS	status;
+DETOUR_COMMIT_STATS	stats;
+std::vector\<HANDLE>	threads;
+uint32_t	i;
 
 
 	TRACE_ENTER ();
 
 	//
-	// Tell Detours that we're starting a transaction to update the list of detours
+	// Tell Detours that we're starting a transaction to update the list of detours,
+	// which suspends all the other threads of the process
 	//
 
+	DetourSetBulkCommit (TRUE);
 	DetourTransactionBegin ();
-	DetourUpdateThread (GetCurrentThread ());
+	update_threads (threads);
 
 	//
-	// List all the detours to remove
-	//
-	// NOTE: This list MUST match the list in attach_detours
+	// Remove the Detours of the listed APIs
 	//
 
-<api_list:{a|<detach (a.func_name)>}; separator = ""\n"">
+	for (i = 0; i \< Count; i++)
+		{
+		det_detach (TA_detours [Apis [i]].real_api, TA_detours [Apis [i]].my_api, TA_detours [Apis [i]].name);
+		}
 
 	//
 	// Tell Detours that we're done updating detours
 	//
 
 	status = DetourTransactionCommit ();
+	close_threads (threads);
+
+	if (DetourGetCommitStats (&stats))
+		{
+		TRACE_INFO (TRACEAPI, ""Detach: %lu detours, %lu page ranges, %lu protection calls, %lu usec, status = %d"",
+			stats.cOperations, stats.cRanges, stats.cProtectCalls, stats.cMicroseconds, status);
+		}
 
 	TRACE_EXIT ();
 	return status;
 }							// End detach_detours
+<if (compact)>
+
+
+void
+TA_thunk_trace										// Write an event of an API to ETW
+	(
+	_In_	uint8_t			Kind,					// TA_REC_PRE or TA_REC_POST
+	_In_	uint32_t		Api,					// API number
+	_In_	const uint64_t	*Values,				// Arguments, or the return value and last error status
+	_In_	uint32_t		Count					// Number of values
+	)
+
+//
+// DESCRIPTION:		Called by the thunks (see Thunk.h) when capture mode is off. The pre-call event holds the arguments as an
+//					array of raw values, and the first string argument as text; the post-call event holds the return value and
+//					the last error status
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:
+//
+// RETURN VALUES:
+//
+//
+
+{
+const TA_THUNK_INFO	*info = &TA_thunk_info [Api];
+PCWSTR		wide_text = nullptr;
+PCSTR		ansi_text = nullptr;
+uint32_t	i;
+
+
+	if (Kind == TA_REC_PRE)
+		{
+
+		//
+		// The first string argument is also written as text, as the expanded intercepts write every string argument
+		//
+
+		for (i = 0; i \< Count && i \< TA_THUNK_MAX_ARGS; i++)
+			{
+			if (info->arg_types [i] == TA_PT_WSTRZ)
+				{
+				wide_text = (PCWSTR) Values [i];
+				break;
+				}
+
+			if (info->arg_types [i] == TA_PT_ASCIZ)
+				{
+				ansi_text = (PCSTR) Values [i];
+				break;
+				}
+			}
+
+		TraceLoggingWrite (TA_tlg, ""API-Trace-PRECALL"", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString (TA_api_schema [Api].name, ""API""),
+			TraceLoggingHexUInt64Array (Values, (UINT16) Count, ""Arguments""),
+			TraceLoggingWideString (wide_text, ""Text""),
+			TraceLoggingString (ansi_text, ""ANSI text"")
+			);
+		}
+	else if (Count != 0)
+		{
+		TraceLoggingWrite (TA_tlg, ""API-Trace-POSTCALL"", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString (TA_api_schema [Api].name, ""API""),
+			TraceLoggingHexUInt64 (Values [0], ""Return value""),
+			TraceLoggingUInt32 ((UINT32) Values [1], ""Last error status"")
+			);
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, ""API-Trace-POSTCALL"", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString (TA_api_schema [Api].name, ""API"")
+			);
+		}
+
+}							// End TA_thunk_trace
+<endif>
 
 
 >>
@@ -595,7 +928,7 @@ NTSTATUS	status;
 
 generate_routines (api_list) ::=
 <<
-<api_list:{a|<detour (a)>}; separator = ""\n\n"">
+<api_list:{a|<detour (a, i0)>}; separator = ""\n\n"">
 >>
 
 //
@@ -606,17 +939,17 @@ trace_input_params (parameters) ::=
 <<
 <parameters:{p|
 <if (p.is_wstrz && !p.is_output)>
-		TraceLoggingWideString (<p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingWideString (<p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_asciz && !p.is_output)>
-		TraceLoggingString (<p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingString (<p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_output || p.is_pointer)>
-		TraceLoggingPointer ((LPCVOID) <p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingPointer ((LPCVOID) <p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_input && p.is_scalar)>
-		TraceLoggingValue (<p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingValue (<p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_input && p.is_enum)>
-		TraceLoggingValue ((UINT32) <p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingValue ((UINT32) <p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_input && p.is_custom)>
-		TraceLoggingBinary (&<p.param_name>, sizeof (<p.param_name>), ""<p.param_name>"")<\\>
+			TraceLoggingBinary (&<p.param_name>, sizeof (<p.param_name>), ""<p.param_name>"")<\\>
 <endif>
 }; separator = "","">
 >>
@@ -629,27 +962,178 @@ trace_output_params (parameters) ::=
 <<
 <parameters:{p|<if (p.is_output)>
 <if (p.is_wstrz)>
-		TraceLoggingWideString (<p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingWideString (<p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_asciz)>
-		TraceLoggingString (<p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingString (<p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_scalar && !p.is_pointer)>
-		TraceLoggingValue (<p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingValue (<p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_enum)>
-		TraceLoggingValue ((UINT32) <p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingValue ((UINT32) <p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_pointer && (!p.is_asciz && !p.is_wstrz && !p.is_scalar && !p.is_enum))>
-		TraceLoggingPointer (<p.param_name>, ""<p.param_name>"")<\\>
+			TraceLoggingPointer (<p.param_name>, ""<p.param_name>"")<\\>
 <elseif (p.is_custom)>
-		TraceLoggingBinary (&<p.param_name>, sizeof (<p.param_name>), ""<p.param_name>"")<\\>
+			TraceLoggingBinary (&<p.param_name>, sizeof (<p.param_name>), ""<p.param_name>"")<\\>
 <endif>
 <endif>
 }; separator = "","">
 >>
 
+//
+// Generate Capture lines for input parameters. Every parameter is stored as a raw value, and the first string is also
+// stored as text
+//
+
+capture_input_params (parameters) ::=
+<<
+<parameters:{p|
+<if ((p.is_wstrz || p.is_asciz) && !p.is_output)>
+			Capture::add_arg (rec, <p.param_name>);
+			Capture::set_text (rec, <p.param_name>);<\\>
+<else>
+			Capture::add_arg (rec, <p.param_name>);<\\>
+<endif>
+}; separator = ""\n"">
+>>
+
+//
+// Generate Capture lines for output parameters
+//
+
+capture_output_params (parameters) ::=
+<<
+<parameters:{p|<if (p.is_output)>
+<if (p.is_wstrz || p.is_asciz)>
+			Capture::add_arg (rec, <p.param_name>);
+			Capture::set_text (rec, <p.param_name>);<\\>
+<else>
+			Capture::add_arg (rec, <p.param_name>);<\\>
+<endif>
+<endif>
+}; separator = ""\n"">
+>>
+
+//
+// Generate Capture lines that copy the buffers of parameters with a capture rule. The parameter is numbered by its position
+// in the parameter list
+//
+
+capture_data (parameters) ::=
+<<
+<parameters:{p|			Capture::add_data (rec, <p.position>, <p.param_name>, <p.capture_size>, <p.capture_max>);}; separator = ""\n"">
+>>
+
+//
+// Generate TraceLogging lines for the buffers of parameters with a capture rule. TraceLogging reads the bytes where they are
+//
+
+trace_data (parameters) ::=
+<<
+<parameters:{p|			TraceLoggingBinary (<p.param_name>, Capture::data_length (<p.param_name>, <p.capture_size>, <p.capture_max>), ""<p.param_name> data"")}; separator = "",\n"">
+>>
+
+//
+// Generate the schema of an API. Each parameter is classified the same way that trace_input_params and
+// trace_output_params classify it
+//
+
+api_schema (api) ::=
+<<
+static const TA_PARAM_SCHEMA	TA_<api.func_name>_params [] =
+	{
+<if (api.parameters)>
+<schema_input_params (api.parameters)>
+<endif>
+	{nullptr, TA_PT_END},
+<if (api.ret_pointer)>
+	{""Return value"", TA_PT_POINTER},
+	{""Last error status"", TA_PT_SCALAR},
+<elseif (api.ret_scalar)>
+	{""Return value"", TA_PT_SCALAR},
+	{""Last error status"", TA_PT_SCALAR},
+<elseif (api.ret_custom)>
+	{""Return value"", TA_PT_CUSTOM},
+	{""Last error status"", TA_PT_SCALAR},
+<endif>
+<if (api.has_outputs)>
+<schema_output_params (api.output_parameters)>
+<endif>
+	{nullptr, TA_PT_END}
+	};
+>>
+
+//
+// Generate schema entries for input parameters
+//
+
+schema_input_params (parameters) ::=
+<<
+<parameters:{p|
+<if (p.is_wstrz && !p.is_output)>
+	{""<p.param_name>"", TA_PT_WSTRZ\},<\\>
+<elseif (p.is_asciz && !p.is_output)>
+	{""<p.param_name>"", TA_PT_ASCIZ\},<\\>
+<elseif (p.is_output || p.is_pointer)>
+	{""<p.param_name>"", TA_PT_POINTER\},<\\>
+<elseif (p.is_input && p.is_scalar)>
+	{""<p.param_name>"", TA_PT_SCALAR\},<\\>
+<elseif (p.is_input && p.is_enum)>
+	{""<p.param_name>"", TA_PT_ENUM\},<\\>
+<elseif (p.is_input && p.is_custom)>
+	{""<p.param_name>"", TA_PT_CUSTOM\},<\\>
+<else>
+	{""<p.param_name>"", TA_PT_POINTER\},<\\>
+<endif>
+}; separator = ""\n"">
+>>
+
+//
+// Generate the record that the thunks read for an API (see Thunk.h). The return value and the parameters are classified
+// the same way that api_schema classifies them
+//
+
+thunk_info (api, index) ::=
+<<
+	{<index>, <length (api.parameters)>, <if (api.ret_pointer)>TA_PT_POINTER<elseif (api.ret_scalar)>TA_PT_SCALAR<elseif (api.ret_custom)>TA_PT_CUSTOM<else>TA_PT_END<endif>, {<thunk_arg_types (api.thunk_parameters)>}}
+>>
+
+//
+// Generate the types of the parameters in a thunk record
+//
+
+thunk_arg_types (parameters) ::=
+<<
+<parameters:{p|<if (p.is_wstrz && !p.is_output)>TA_PT_WSTRZ<elseif (p.is_asciz && !p.is_output)>TA_PT_ASCIZ<elseif (p.is_output || p.is_pointer)>TA_PT_POINTER<elseif (p.is_input && p.is_scalar)>TA_PT_SCALAR<elseif (p.is_input && p.is_enum)>TA_PT_ENUM<elseif (p.is_input && p.is_custom)>TA_PT_CUSTOM<else>TA_PT_POINTER<endif>}; separator = "", "">
+>>
+
+//
+// Generate schema entries for output parameters
+//
+
+schema_output_params (parameters) ::=
+<<
+<parameters:{p|<if (p.is_output)>
+<if (p.is_wstrz)>
+	{""<p.param_name>"", TA_PT_WSTRZ\},<\\>
+<elseif (p.is_asciz)>
+	{""<p.param_name>"", TA_PT_ASCIZ\},<\\>
+<elseif (p.is_scalar && !p.is_pointer)>
+	{""<p.param_name>"", TA_PT_SCALAR\},<\\>
+<elseif (p.is_enum)>
+	{""<p.param_name>"", TA_PT_ENUM\},<\\>
+<elseif (p.is_custom)>
+	{""<p.param_name>"", TA_PT_CUSTOM\},<\\>
+<else>
+	{""<p.param_name>"", TA_PT_POINTER\},<\\>
+<endif>
+<endif>
+}; separator = ""\n"">
+>>
+
 //
 // Template for a Detours routine. It has the same function signature as the real routine
 //
 
-detour (api) ::=
+detour (api, index) ::=
 <<
 <if (api.specifiers)>
 <api.specifiers:{s|<s>}; separator = ""\n"">
@@ -666,17 +1150,78 @@ my_<api.func_name>
 NTSTATUS	status;
 <api.ret_type>		ret_value;
 <endif>
+TA_RECORD	*rec;
+ULONGLONG	begin;
+
+
+	//
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
+	//
+
+	if (!Intercept::enter (<index>))
+		{
+		<if (!api.ret_void)>return <endif>real_<api.func_name> (<api.parameters:{p|<p.param_name>}; separator = "", "">);
+<if (api.ret_void)>
+		return;
+<endif>
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
 
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		<if (!api.ret_void)>ret_value = <endif>real_<api.func_name> (<api.parameters:{p|<p.param_name>}; separator = "", "">);
+		Stats::call_end (<index>, begin);
+		Intercept::leave ();
+		return<if (!api.ret_void)> ret_value;<else>;<endif>
+		}
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
 	//
 
-	TraceLoggingWrite (TA_tlg, ""API-Trace-PRECALL"", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString (""<api.func_name>"", ""API"")<if (api.parameters)>,<endif>
-<trace_input_params (api.parameters)>
-		);
+	if (!Policy::admit (<index><api.parameters:{p|, <p.param_name>}>))
+		{
+		<if (!api.ret_void)>ret_value = <endif>real_<api.func_name> (<api.parameters:{p|<p.param_name>}; separator = "", "">);
+		Intercept::leave ();
+		return<if (!api.ret_void)> ret_value;<else>;<endif>
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, <index>)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+<if (api.parameters)>
+<capture_input_params (api.parameters)>
+<endif>
+<if (api.has_pre_data)>
+<capture_data (api.pre_data)>
+<endif>
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, ""API-Trace-PRECALL"", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString (""<api.func_name>"", ""API"")<if (api.parameters)>,<endif>
+<trace_input_params (api.parameters)><if (api.has_pre_data)>,<endif>
+<if (api.has_pre_data)>
+<trace_data (api.pre_data)>
+<endif>
+			);
+		}
 
 	//
 	// Call the real API
@@ -693,26 +1238,50 @@ NTSTATUS	status;
 	status = GetLastError ();
 <endif>
 
-	TraceLoggingWrite (TA_tlg, ""API-Trace-POSTCALL"", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString (""<api.func_name>"", ""API"")<\\>
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, <index>)) != nullptr)
+			{
+<if (!api.ret_void)>
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+<endif>
+<if (api.has_outputs)>
+<capture_output_params (api.output_parameters)>
+<endif>
+<if (api.has_post_data)>
+<capture_data (api.post_data)>
+<endif>
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, ""API-Trace-POSTCALL"", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString (""<api.func_name>"", ""API"")<\\>
 <if (api.ret_pointer)><\\>
 ,
-		TraceLoggingPointer ((PVOID) ret_value, ""Return value""),
-		TraceLoggingUInt32 (status, ""Last error status"")<if (api.has_outputs)>,<endif>
+			TraceLoggingPointer ((PVOID) ret_value, ""Return value""),
+			TraceLoggingUInt32 (status, ""Last error status"")<if (api.has_outputs || api.has_post_data)>,<endif>
 <elseif (api.ret_scalar)><\\>
 ,
-		TraceLoggingValue (ret_value, ""Return value""),
-		TraceLoggingUInt32 (status, ""Last error status"")<if (api.has_outputs)>,<endif>
+			TraceLoggingValue (ret_value, ""Return value""),
+			TraceLoggingUInt32 (status, ""Last error status"")<if (api.has_outputs || api.has_post_data)>,<endif>
 <elseif (api.ret_custom)><\\>
 ,
-		TraceLoggingBinary (&ret_value, sizeof (ret_value), ""Return value""),
-		TraceLoggingUInt32 (status, ""Last error status"")<if (api.has_outputs)>,<endif>
+			TraceLoggingBinary (&ret_value, sizeof (ret_value), ""Return value""),
+			TraceLoggingUInt32 (status, ""Last error status"")<if (api.has_outputs || api.has_post_data)>,<endif>
 <elseif (api.ret_void)><\\>
 <endif>
-<trace_output_params (api.output_parameters)>
-		);
+<trace_output_params (api.output_parameters)><if (api.has_outputs && api.has_post_data)>,<endif>
+<if (api.has_post_data)>
+<trace_data (api.post_data)>
+<endif>
+			);
+		}
 
+	Intercept::leave ();
 	return<if (!api.ret_void)> ret_value;<else>;<endif>
 }							// End my_<api.func_name>
 >>
@@ -720,6 +1289,12 @@ NTSTATUS	status;
 ";
 		#endregion
 
+		//
+		// The most parameters whose types a thunk record holds (TA_THUNK_MAX_ARGS in TraceAPI\Thunk.h)
+		//
+
+		const int thunk_max_args = 12;
+
 		/// <summary>
 		/// This routine is responsible for generating the output C++ source file
 		/// </summary>
@@ -727,13 +1302,15 @@ NTSTATUS	status;
 		/// <param name="Files">List of EXE/DLL file names the code was generated for</param>
 		/// <param name="Api_list">List of APIs to Detour</param>
 		/// <param name="Headers">List of header files containing the definitions of the APIs being Detoured</param>
+		/// <param name="Compact">Generate the tables for the table-driven thunks instead of an intercept for each API</param>
 		public static void
 		create_detours 
 			(
 			string					Output_file,
 			List <string>			Files,
 			ref List <Api>			Api_list,
-			ref List <string>		Headers
+			ref List <string>		Headers,
+			bool					Compact
 			)
 			{
 			string			file_names = string.Join (", ", Files);
@@ -772,14 +1349,61 @@ NTSTATUS	status;
 
 			file_hdr.Add ("command_line", Environment.CommandLine);
 
+			file_hdr.Add ("compact", Compact);
+
 			File.AppendAllText (Output_file, file_hdr.Render (line_width));
 
+			//
+			// For each API, create a list of output-only parameters that are not just pointers (these will be part of the list of input parameters). This is
+			// to get around StringTemplate bug that I found, where it doesn't handle lists with separators properly (it leaves a hanging separator at the end
+			// of a list). The lists are also used by the schema generated with the pointers to the real APIs
+			//
+
+			foreach (var api in Api_list)
+				{
+				api.output_parameters = (from p in api.parameters
+												where p.is_output && !p.is_pointer
+												select p).ToList ();
+
+				if (api.output_parameters.Count == 0)
+					{
+					api.has_outputs = false;
+					}
+
+				//
+				// Likewise, the parameters whose buffers are captured before and after the call
+				//
+
+				api.pre_data = (from p in api.parameters
+									where p.capture_pre
+									select p).ToList ();
+				api.post_data = (from p in api.parameters
+									where p.capture_post
+									select p).ToList ();
+				api.has_pre_data = api.pre_data.Count != 0;
+				api.has_post_data = api.post_data.Count != 0;
+
+				//
+				// The thunks record only the arguments, the return value and the last error status, so the schema must not list
+				// output parameters or buffers. Their records hold the types of the first parameters
+				//
+
+				if (Compact)
+					{
+					api.has_outputs = false;
+					api.has_pre_data = false;
+					api.has_post_data = false;
+					api.thunk_parameters = api.parameters.Take (thunk_max_args).ToList ();
+					}
+				}
+
 			//
 			// Generate the pointers to the real APIs
 			//
 
 			Template real_api_list = group.GetInstanceOf ("real_api_list");
 			real_api_list.Add ("list", Api_list);
+			real_api_list.Add ("compact", Compact);
 
 			File.AppendAllText (Output_file, real_api_list.Render (line_width));
 
@@ -790,32 +1414,19 @@ NTSTATUS	status;
 			Template support_routines = group.GetInstanceOf ("support_routines");
 			support_routines.Add ("exename", file_names);
 			support_routines.Add ("api_list", Api_list);
+			support_routines.Add ("compact", Compact);
 
 			File.AppendAllText (Output_file, support_routines.Render (line_width));
 
 			//
-			// For each API, create a list of output-only parameters that are not just pointers (these will be part of the list of input parameters). This is
-			// to get around StringTemplate bug that I found, where it doesn't handle lists with separators properly (it leaves a hanging separator at the end
-			// of a list)
+			// Generate the Detours routines. With /COMPACT, the thunks in Thunk.h take their place
 			//
 
-			foreach (var api in Api_list)
+			if (Compact)
 				{
-				api.output_parameters = (from p in api.parameters
-												where p.is_output && !p.is_pointer
-												select p).ToList ();
-
-				if (api.output_parameters.Count == 0)
-					{
-					api.has_outputs = false;
-					}
-
+				return;
 				}
 
-			//
-			// Generate the Detours routines
-			//
-
 			Template generate_routines = group.GetInstanceOf ("generate_routines");
 			generate_routines.Add ("api_list", Api_list);
 
@@ -890,10 +1501,14 @@ NTSTATUS	status;
 					// Apply some heuristics to each of the parameters to determine how to display the parameters in the log
 					//
 
+					uint position = 0;
+
 					foreach (Api_Param p in api.parameters)
 						{
 						string param_type;
 
+						p.position = position++;
+
 						//
 						// Get the parameter type without any trailing "*"
 						//
@@ -1079,6 +1694,7 @@ NTSTATUS	status;
 							api.has_outputs = true;
 							}
 
+						set_capture_rule (api, p);
 						}   // End foreach parameter
 
 					}
@@ -1092,7 +1708,67 @@ NTSTATUS	status;
 			Api_list.Sort ((a, b) => (a.func_name.CompareTo (b.func_name)));
 			}   // End convert_for_string_template
 
+		/// <summary>
+		/// Decide whether the contents of a parameter's buffer are captured, and how many bytes. A rule in capture_rules comes first; otherwise
+		/// an _In_reads_bytes_ annotation whose size is another parameter of the API is used. Other annotations are not, because their sizes
+		/// may dereference pointers that are not valid, or are not valid until the call succeeds
+		/// </summary>
+		/// <param name="Api">API the parameter belongs to</param>
+		/// <param name="Param">Parameter</param>
+		static void
+		set_capture_rule
+			(
+			Api				Api,
+			Api_Param		Param
+			)
+			{
+			var rule = capture_rules.Find (r => r.api.Equals (Api.func_name) && r.param.Equals (Param.param_name));
+
+			if (rule != null)
+				{
+				Param.capture_pre = !rule.after_call;
+				Param.capture_post = rule.after_call;
+				Param.capture_size = rule.size;
+				Param.capture_max = rule.max;
+				Console.WriteLine ($"Capturing {Api.func_name} {Param.param_name}: {rule.size}, at most {rule.max} bytes");
+				return;
+				}
+
+			var match = sal_reads_bytes.Match (Param.sal);
+
+			if (match.Success && Api.parameters.Exists (p => p.param_name.Equals (match.Groups ["size"].Value)))
+				{
+				Param.capture_pre = true;
+				Param.capture_size = match.Groups ["size"].Value;
+				Param.capture_max = default_capture_max;
+				Console.WriteLine ($"Capturing {Api.func_name} {Param.param_name}: {Param.capture_size}, at most {Param.capture_max} bytes");
+				}
+
+			}   // End set_capture_rule
+
 		}   // End class Code_Gen
 
+	/// <summary>
+	/// A rule for capturing the contents of a buffer parameter
+	/// </summary>
+	public class Capture_Rule
+		{
+		public string	api { get; set; }				// API name
+		public string	param { get; set; }				// Parameter name
+		public bool		after_call { get; set; }		// Capture after the call (the API fills the buffer), not before
+		public string	size { get; set; }				// C++ expression for the size of the buffer
+		public string	max { get; set; }				// C++ expression for the most bytes to capture
+
+		public Capture_Rule (string Api, string Param, bool After_call, string Size, string Max)
+			{
+			api = Api;
+			param = Param;
+			after_call = After_call;
+			size = Size;
+			max = Max;
+			}   // End constructor Capture_Rule
+
+		}   // End class Capture_Rule
+
 	}	// End namespace FDI.AutoGen
 
@@ -0,0 +1,573 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: bulkperf.cpp (bulkperf - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Exercises the bulk commit protection planner (src/protect.cpp) against
+//  a simulated address space of loaded images.  Each image has a read-only
+//  header, an executable .text, a read-only .rdata, a writable .data and
+//  a read-only .rsrc, and the page protections live in a table, so the
+//  planner can be checked and timed without VirtualProtect.
+//
+//  A commit is made both ways: one protection change per target at attach
+//  and one per target at commit (as Detours did), and once in bulk.  The
+//  -c option instead plans random spans across every section and checks
+//  that exactly the target pages change and are restored.
+//
+//  The fake calls cost nanoseconds where VirtualQuery and VirtualProtect
+//  cost a microsecond or more, so the last column adds a charge (-k) for
+//  each call to the measured time.
+//
+//  Builds with GNU make (libdisol.a) on Linux.
+//
+
+#include <disol.h>
+#include <protect.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+const ULONG PAGE_SIZE_4K    = 0x1000;
+const ULONG MODULE_STRIDE   = 0x01000000;       // Address space per image.
+const ULONG_PTR SPACE_BASE  = 0x10000000;       // First image.
+
+static BOOL s_fVerbose = FALSE;
+static ULONG s_nCallNs = 1000;                  // Charge for each system call.
+
+struct SECTION
+{
+    const char *    pszName;
+    ULONG           cPages;
+    DWORD           dwPerm;
+};
+
+// Roughly the layout of kernel32.dll.
+static SECTION s_rSections[] = {
+    { "header",     1,      PAGE_READONLY },
+    { ".text",      128,    PAGE_EXECUTE_READ },
+    { ".rdata",     48,     PAGE_READONLY },
+    { ".data",      8,      PAGE_READWRITE },
+    { ".rsrc",      8,      PAGE_READONLY },
+};
+
+////////////////////////////////////////////////////////// Fake Page Table.
+//
+//  Stands in for VirtualQuery and VirtualProtect.  Pages belong to an
+//  allocation (an image) or are free; a query never crosses an allocation
+//  and a protection change must stay within one, as on Windows.
+//
+struct FAKE_VM
+{
+    ULONG_PTR           nBase;
+    ULONG               cbPage;
+    std::vector<DWORD>  rdwPerm;
+    std::vector<ULONG>  rnAlloc;        // 0 if free.
+    ULONGLONG           cQuery;
+    ULONGLONG           cProtect;
+};
+
+static BOOL FakePages(FAKE_VM *pVm, PBYTE pbBase, SIZE_T cbSize, size_t *pnLo, size_t *pnHi)
+{
+    ULONG_PTR nAddr = (ULONG_PTR)pbBase;
+    if (cbSize == 0 || nAddr < pVm->nBase) {
+        return FALSE;
+    }
+    size_t nLo = (nAddr - pVm->nBase) / pVm->cbPage;
+    size_t nHi = (nAddr + cbSize - 1 - pVm->nBase) / pVm->cbPage + 1;
+    if (nHi > pVm->rnAlloc.size() || pVm->rnAlloc[nLo] == 0) {
+        return FALSE;
+    }
+    *pnLo = nLo;
+    *pnHi = nHi;
+    return TRUE;
+}
+
+static BOOL FakeQuery(PVOID pvContext,
+                      PBYTE pbAddress,
+                      PBYTE *ppbBase,
+                      SIZE_T *pcbSize,
+                      DWORD *pdwPerm)
+{
+    FAKE_VM *pVm = (FAKE_VM *)pvContext;
+    size_t nLo;
+    size_t nHi;
+
+    pVm->cQuery++;
+    if (!FakePages(pVm, pbAddress, 1, &nLo, &nHi)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    while (nHi < pVm->rnAlloc.size() &&
+           pVm->rnAlloc[nHi] == pVm->rnAlloc[nLo] &&
+           pVm->rdwPerm[nHi] == pVm->rdwPerm[nLo]) {
+        nHi++;
+    }
+    *ppbBase = (PBYTE)(pVm->nBase + nLo * pVm->cbPage);
+    *pcbSize = (nHi - nLo) * pVm->cbPage;
+    *pdwPerm = pVm->rdwPerm[nLo];
+    return TRUE;
+}
+
+static BOOL FakeProtect(PVOID pvContext,
+                        PBYTE pbBase,
+                        SIZE_T cbSize,
+                        DWORD dwPerm,
+                        DWORD *pdwOldPerm)
+{
+    FAKE_VM *pVm = (FAKE_VM *)pvContext;
+    size_t nLo;
+    size_t nHi;
+
+    pVm->cProtect++;
+    if (!FakePages(pVm, pbBase, cbSize, &nLo, &nHi)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    for (size_t n = nLo; n < nHi; n++) {
+        if (pVm->rnAlloc[n] != pVm->rnAlloc[nLo]) {
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return FALSE;
+        }
+    }
+    *pdwOldPerm = pVm->rdwPerm[nLo];
+    for (size_t n = nLo; n < nHi; n++) {
+        pVm->rdwPerm[n] = dwPerm;
+    }
+    return TRUE;
+}
+
+static ULONG ModulePages()
+{
+    ULONG cPages = 0;
+    for (ULONG s = 0; s < ARRAYSIZE(s_rSections); s++) {
+        cPages += s_rSections[s].cPages;
+    }
+    return cPages;
+}
+
+static PBYTE SectionBase(ULONG nModule, ULONG nSection)
+{
+    ULONG_PTR nAddr = SPACE_BASE + (ULONG_PTR)nModule * MODULE_STRIDE;
+    for (ULONG s = 0; s < nSection; s++) {
+        nAddr += (ULONG_PTR)s_rSections[s].cPages * PAGE_SIZE_4K;
+    }
+    return (PBYTE)nAddr;
+}
+
+static VOID MakeVm(FAKE_VM *pVm, ULONG nModules)
+{
+    pVm->nBase = SPACE_BASE;
+    pVm->cbPage = PAGE_SIZE_4K;
+    pVm->rdwPerm.assign((size_t)nModules * (MODULE_STRIDE / PAGE_SIZE_4K), 0);
+    pVm->rnAlloc.assign(pVm->rdwPerm.size(), 0);
+    pVm->cQuery = 0;
+    pVm->cProtect = 0;
+
+    for (ULONG m = 0; m < nModules; m++) {
+        size_t n = (size_t)m * (MODULE_STRIDE / PAGE_SIZE_4K);
+        for (ULONG s = 0; s < ARRAYSIZE(s_rSections); s++) {
+            for (ULONG p = 0; p < s_rSections[s].cPages; p++, n++) {
+                pVm->rdwPerm[n] = s_rSections[s].dwPerm;
+                pVm->rnAlloc[n] = m + 1;
+            }
+        }
+    }
+}
+
+static VOID InitPlan(DETOUR_PROTECT_PLAN *pPlan,
+                     FAKE_VM *pVm,
+                     std::vector<DETOUR_PROTECT_RANGE>& rRanges,
+                     size_t cSpans)
+{
+    rRanges.resize(cSpans * 2);
+    memset(pPlan, 0, sizeof(*pPlan));
+    pPlan->Backend.pfQuery = FakeQuery;
+    pPlan->Backend.pfProtect = FakeProtect;
+    pPlan->Backend.pvContext = pVm;
+    pPlan->Backend.cbPage = pVm->cbPage;
+    pPlan->pRanges = rRanges.data();
+    pPlan->cMaxRanges = (ULONG)rRanges.size();
+}
+
+/////////////////////////////////////////////////////////////// Checking.
+//
+static BOOL SpansTouchPage(const std::vector<DETOUR_PROTECT_SPAN>& rSpans,
+                           const FAKE_VM *pVm,
+                           size_t nPage)
+{
+    ULONG_PTR nLo = pVm->nBase + nPage * pVm->cbPage;
+    ULONG_PTR nHi = nLo + pVm->cbPage;
+    for (size_t n = 0; n < rSpans.size(); n++) {
+        ULONG_PTR nBeg = (ULONG_PTR)rSpans[n].pbTarget;
+        ULONG_PTR nEnd = nBeg + rSpans[n].cbTarget;
+        if (nBeg < nHi && nEnd > nLo) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Plan, apply and restore one set of spans, checking every page.
+static BOOL CheckOne(FAKE_VM *pVm,
+                     const FAKE_VM *pOriginal,
+                     std::vector<DETOUR_PROTECT_SPAN>& rSpans,
+                     ULONG nIteration)
+{
+    std::vector<DETOUR_PROTECT_RANGE> rRanges;
+    DETOUR_PROTECT_PLAN plan;
+    InitPlan(&plan, pVm, rRanges, rSpans.size());
+
+    LONG error = detour_protect_plan(&plan, rSpans.data(), (ULONG)rSpans.size());
+    if (error != NO_ERROR) {
+        printf("bulkperf: check %u: plan failed (%d).\n", nIteration, (int)error);
+        return FALSE;
+    }
+
+    // Ranges are sorted and disjoint.
+    for (ULONG r = 0; r < plan.cRanges; r++) {
+        const DETOUR_PROTECT_RANGE& range = plan.pRanges[r];
+        size_t nLo;
+        size_t nHi;
+        if (!FakePages(pVm, range.pbBase, range.cbSize, &nLo, &nHi) ||
+            ((ULONG_PTR)range.pbBase & (pVm->cbPage - 1)) != 0 ||
+            (range.cbSize & (pVm->cbPage - 1)) != 0 ||
+            (r > 0 && plan.pRanges[r - 1].pbBase + plan.pRanges[r - 1].cbSize > range.pbBase)) {
+            printf("bulkperf: check %u: range %u is misplaced.\n", nIteration, r);
+            return FALSE;
+        }
+    }
+
+    error = detour_protect_apply(&plan, PAGE_EXECUTE_READWRITE);
+    if (error != NO_ERROR) {
+        printf("bulkperf: check %u: apply failed (%d).\n", nIteration, (int)error);
+        return FALSE;
+    }
+
+    // Each range had one protection, so that restoring it is exact.
+    for (ULONG r = 0; r < plan.cRanges; r++) {
+        const DETOUR_PROTECT_RANGE& range = plan.pRanges[r];
+        size_t nLo;
+        size_t nHi;
+        FakePages(pVm, range.pbBase, range.cbSize, &nLo, &nHi);
+        for (size_t n = nLo; n < nHi; n++) {
+            if (pOriginal->rdwPerm[n] != range.dwPerm || pOriginal->rnAlloc[n] != pOriginal->rnAlloc[nLo]) {
+                printf("bulkperf: check %u: range %u is not uniform.\n", nIteration, r);
+                return FALSE;
+            }
+        }
+    }
+
+    // Exactly the target pages are writable.
+    for (size_t n = 0; n < pVm->rdwPerm.size(); n++) {
+        if (pOriginal->rnAlloc[n] == 0) {
+            continue;
+        }
+        DWORD dwWant = SpansTouchPage(rSpans, pVm, n) ? PAGE_EXECUTE_READWRITE : pOriginal->rdwPerm[n];
+        if (pVm->rdwPerm[n] != dwWant) {
+            printf("bulkperf: check %u: page %p is %02x, expected %02x.\n",
+                   nIteration, (PBYTE)(pVm->nBase + n * pVm->cbPage),
+                   pVm->rdwPerm[n], dwWant);
+            return FALSE;
+        }
+    }
+
+    detour_protect_restore(&plan);
+    if (pVm->rdwPerm != pOriginal->rdwPerm) {
+        printf("bulkperf: check %u: protections not restored.\n", nIteration);
+        return FALSE;
+    }
+    if (plan.cProtectCalls != 2 * plan.cRanges) {
+        printf("bulkperf: check %u: %u protection calls for %u ranges.\n",
+               nIteration, plan.cProtectCalls, plan.cRanges);
+        return FALSE;
+    }
+    if (s_fVerbose) {
+        printf("check %5u: %3u spans, %3u ranges, %3u queries\n",
+               nIteration, (ULONG)rSpans.size(), plan.cRanges, plan.cQueryCalls);
+    }
+    return TRUE;
+}
+
+// Random spans anywhere in the images, including ones that cross from one
+// section into the next and ones longer than a page.
+static BOOL Check(ULONG nModules, ULONG nIterations)
+{
+    FAKE_VM original;
+    MakeVm(&original, nModules);
+    FAKE_VM vm = original;
+    ULONG cbModule = ModulePages() * PAGE_SIZE_4K;
+
+    srand(1);
+    ULONGLONG cSpans = 0;
+    for (ULONG i = 0; i < nIterations; i++) {
+        std::vector<DETOUR_PROTECT_SPAN> rSpans((ULONG)rand() % 64 + 1);
+        for (size_t n = 0; n < rSpans.size(); n++) {
+            ULONG cb = ((ULONG)rand() % 16 == 0)
+                ? (ULONG)rand() % (3 * PAGE_SIZE_4K) + 1
+                : (ULONG)rand() % 40 + 1;
+            ULONG ob = (ULONG)rand() % (cbModule - cb);
+            rSpans[n].pbTarget = SectionBase((ULONG)rand() % nModules, 0) + ob;
+            rSpans[n].cbTarget = cb;
+        }
+        cSpans += rSpans.size();
+
+        if (!CheckOne(&vm, &original, rSpans, i)) {
+            return FALSE;
+        }
+    }
+    printf("bulkperf: %u checks of %llu spans passed.\n",
+           nIterations, (unsigned long long)cSpans);
+    return TRUE;
+}
+
+/////////////////////////////////////////////////////////////////// Workload.
+//
+static VOID MakeTargets(std::vector<DETOUR_PROTECT_SPAN>& rTargets, ULONG nTargets, ULONG nModules)
+{
+    // Function entries are 16-byte aligned and distinct; DetourAttach moves
+    // 5 to 16 bytes of each.
+    ULONG cbText = s_rSections[1].cPages * PAGE_SIZE_4K;
+    std::vector<ULONG_PTR> rnEntries;
+
+    srand(1);
+    while (rnEntries.size() < nTargets) {
+        while (rnEntries.size() < nTargets) {
+            ULONG nModule = (ULONG)rand() % nModules;
+            ULONG ob = ((ULONG)rand() * 16) % (cbText - 16);
+            rnEntries.push_back((ULONG_PTR)SectionBase(nModule, 1) + ob);
+        }
+        std::sort(rnEntries.begin(), rnEntries.end());
+        rnEntries.erase(std::unique(rnEntries.begin(), rnEntries.end()), rnEntries.end());
+    }
+
+    // Attach in a random order, as generated code does.
+    for (size_t n = rnEntries.size() - 1; n > 0; n--) {
+        std::swap(rnEntries[n], rnEntries[(size_t)rand() % (n + 1)]);
+    }
+
+    rTargets.resize(nTargets);
+    for (ULONG n = 0; n < nTargets; n++) {
+        rTargets[n].pbTarget = (PBYTE)rnEntries[n];
+        rTargets[n].cbTarget = 5 + (ULONG)rand() % 12;
+    }
+}
+
+struct RESULT
+{
+    ULONGLONG   cQuery;
+    ULONGLONG   cProtect;
+    ULONG       cRanges;
+    double      dSeconds;
+};
+
+// One protection change per target at attach, one per target at commit.
+static BOOL CommitPerOperation(FAKE_VM *pVm,
+                               const std::vector<DETOUR_PROTECT_SPAN>& rTargets,
+                               std::vector<DWORD>& rdwOld)
+{
+    for (size_t n = 0; n < rTargets.size(); n++) {
+        if (!FakeProtect(pVm, rTargets[n].pbTarget, rTargets[n].cbTarget,
+                         PAGE_EXECUTE_READWRITE, &rdwOld[n])) {
+            return FALSE;
+        }
+    }
+    // The pending list is LIFO, so the first change is undone last.
+    for (size_t n = rTargets.size(); n-- > 0;) {
+        DWORD dwOld;
+        FakeProtect(pVm, rTargets[n].pbTarget, rTargets[n].cbTarget, rdwOld[n], &dwOld);
+    }
+    return TRUE;
+}
+
+static BOOL CommitBulk(FAKE_VM *pVm,
+                       const std::vector<DETOUR_PROTECT_SPAN>& rTargets,
+                       std::vector<DETOUR_PROTECT_SPAN>& rSpans,
+                       std::vector<DETOUR_PROTECT_RANGE>& rRanges,
+                       ULONG *pcRanges)
+{
+    DETOUR_PROTECT_PLAN plan;
+    rSpans = rTargets;
+    InitPlan(&plan, pVm, rRanges, rSpans.size());
+
+    if (detour_protect_plan(&plan, rSpans.data(), (ULONG)rSpans.size()) != NO_ERROR ||
+        detour_protect_apply(&plan, PAGE_EXECUTE_READWRITE) != NO_ERROR) {
+        return FALSE;
+    }
+    detour_protect_restore(&plan);
+    *pcRanges = plan.cRanges;
+    return TRUE;
+}
+
+static BOOL Measure(BOOL fBulk,
+                    const std::vector<DETOUR_PROTECT_SPAN>& rTargets,
+                    ULONG nModules,
+                    ULONG nRounds,
+                    RESULT *pResult)
+{
+    FAKE_VM original;
+    MakeVm(&original, nModules);
+    FAKE_VM vm = original;
+
+    std::vector<DWORD> rdwOld(rTargets.size());
+    std::vector<DETOUR_PROTECT_SPAN> rSpans;
+    std::vector<DETOUR_PROTECT_RANGE> rRanges;
+
+    memset(pResult, 0, sizeof(*pResult));
+    auto tStart = std::chrono::steady_clock::now();
+    for (ULONG r = 0; r < nRounds; r++) {
+        BOOL fOk = fBulk
+            ? CommitBulk(&vm, rTargets, rSpans, rRanges, &pResult->cRanges)
+            : CommitPerOperation(&vm, rTargets, rdwOld);
+        if (!fOk) {
+            printf("bulkperf: %s commit failed.\n", fBulk ? "bulk" : "per-op");
+            return FALSE;
+        }
+    }
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - tStart;
+
+    if (vm.rdwPerm != original.rdwPerm) {
+        printf("bulkperf: %s commit did not restore the protections.\n",
+               fBulk ? "bulk" : "per-op");
+        return FALSE;
+    }
+    pResult->cQuery = vm.cQuery / nRounds;
+    pResult->cProtect = vm.cProtect / nRounds;
+    pResult->dSeconds = d.count() / nRounds;
+    return TRUE;
+}
+
+static VOID PrintResult(const char *pszName, ULONG nTargets, const RESULT *pResult)
+{
+    double dCharged = pResult->dSeconds
+        + (double)(pResult->cQuery + pResult->cProtect) * s_nCallNs * 1e-9;
+
+    printf("%-6s %8u %8u %8llu %8llu %10.1f %8.1f %10.1f\n",
+           pszName,
+           nTargets,
+           pResult->cRanges,
+           (unsigned long long)pResult->cQuery,
+           (unsigned long long)pResult->cProtect,
+           pResult->dSeconds * 1e6,
+           pResult->dSeconds * 1e9 / (double)nTargets,
+           dCharged * 1e6);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    bulkperf [options]\n"
+           "Options:\n"
+           "    -n:count       Targets to attach (default 1600, about all of kernel32).\n"
+           "    -m:count       Images the targets are spread over (default 1).\n"
+           "    -r:count       Timed commits of each kind (default 100).\n"
+           "    -c:count       Check random spans instead of timing.\n"
+           "    -k:ns          Charge for each query or protection call (default 1000).\n"
+           "    -v             Verbose; show the image layout and each check.\n"
+           "    -?             This help screen.\n");
+}
+
+int main(int argc, char **argv)
+{
+    ULONG nTargets = 1600;
+    ULONG nModules = 1;
+    ULONG nRounds = 100;
+    ULONG nChecks = 0;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (argv[arg][0] == '-') {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case 'c':
+              case 'C':
+                nChecks = strtoul(argp, NULL, 0);
+                break;
+              case 'k':
+              case 'K':
+                s_nCallNs = strtoul(argp, NULL, 0);
+                break;
+              case 'm':
+              case 'M':
+                nModules = strtoul(argp, NULL, 0);
+                break;
+              case 'n':
+              case 'N':
+                nTargets = strtoul(argp, NULL, 0);
+                break;
+              case 'r':
+              case 'R':
+                nRounds = strtoul(argp, NULL, 0);
+                break;
+              case 'v':
+              case 'V':
+                s_fVerbose = TRUE;
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("bulkperf: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+        }
+        else {
+            printf("bulkperf: Unknown argument: %s\n", argv[arg]);
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    ULONG cMaxTargets = nModules * (s_rSections[1].cPages * PAGE_SIZE_4K / 16 - 1);
+    if (nTargets == 0 || nModules == 0 || nModules > 64 || nRounds == 0 || nTargets > cMaxTargets) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (s_fVerbose) {
+        for (ULONG s = 0; s < ARRAYSIZE(s_rSections); s++) {
+            printf("%-8s %p %4u pages [%02x]\n",
+                   s_rSections[s].pszName, SectionBase(0, s),
+                   s_rSections[s].cPages, s_rSections[s].dwPerm);
+        }
+    }
+
+    if (nChecks != 0) {
+        return Check(nModules, nChecks) ? 0 : 2;
+    }
+
+    std::vector<DETOUR_PROTECT_SPAN> rTargets;
+    MakeTargets(rTargets, nTargets, nModules);
+
+    RESULT perop;
+    RESULT bulk;
+    if (!Measure(FALSE, rTargets, nModules, nRounds, &perop) ||
+        !Measure(TRUE, rTargets, nModules, nRounds, &bulk)) {
+        return 2;
+    }
+
+    printf("%-6s %8s %8s %8s %8s %10s %8s %10s\n",
+           "commit", "targets", "ranges", "queries", "protects", "us/commit", "ns/op", "charged us");
+    PrintResult("per-op", nTargets, &perop);
+    PrintResult("bulk", nTargets, &bulk);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////// End of File.
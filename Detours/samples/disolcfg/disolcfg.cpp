@@ -0,0 +1,566 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: disolcfg.cpp (disolcfg.exe - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Builds the control-flow graph of every known function in PE files and
+//  checks whether each entry point can be patched with DetourIsPatchSafe##x.
+//  Functions are found from the entry point, the export table and, for x64
+//  and ARM64, the exception directory (.pdata).  The images are mapped from
+//  disk, so any host can analyze any supported machine type, and each copy
+//  is named with DetourSetCodeModule##x so that indirect jump slots are
+//  read only from it.
+//
+//  Before the files, the x86 and x64 graphs are checked on branches in the
+//  last 64 bytes of the code.  With no files, only the checks are run.
+//
+//  Builds with nmake on Windows and with GNU make (libdisol.a) on Linux.
+//
+
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include <disol.h>
+#else
+#define DETOURS_INTERNAL
+#include <detours.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+typedef BOOL (WINAPI *PF_BUILD_FUNCTION_GRAPH)(PVOID pCode,
+                                               ULONG cbCode,
+                                               PDETOUR_BASIC_BLOCK pBlocks,
+                                               ULONG cMaxBlocks,
+                                               PDETOUR_FUNCTION_GRAPH pGraph);
+
+typedef BOOL (WINAPI *PF_IS_PATCH_SAFE)(PVOID pCode,
+                                        ULONG cbCode,
+                                        ULONG cbPatch,
+                                        ULONG *pcbCopied);
+
+typedef BOOL (WINAPI *PF_SET_CODE_MODULE)(HMODULE hModule,
+                                          BOOL fLimitReferencesToModule);
+
+struct ARCH
+{
+    WORD                    wMachine;
+    const char *            pszName;
+    ULONG                   cbPatch;        // Size of the jump DetourAttach writes.
+    ULONG                   cbPdataEntry;   // Size of a RUNTIME_FUNCTION, or 0.
+    PF_BUILD_FUNCTION_GRAPH pfBuild;
+    PF_IS_PATCH_SAFE        pfIsPatchSafe;
+    PF_SET_CODE_MODULE      pfSetCodeModule;
+};
+
+static const ARCH s_rArchs[] = {
+    { 0x014c, "x86",   5,  0,  DetourBuildFunctionGraphX86,   DetourIsPatchSafeX86,
+      DetourSetCodeModuleX86   },
+    { 0x8664, "x64",   5,  12, DetourBuildFunctionGraphX64,   DetourIsPatchSafeX64,
+      DetourSetCodeModuleX64   },
+    { 0xaa64, "arm64", 12, 8,  DetourBuildFunctionGraphARM64, DetourIsPatchSafeARM64,
+      DetourSetCodeModuleARM64 },
+};
+
+struct SECTION
+{
+    ULONG   nRva;
+    ULONG   cbVirtual;
+    BOOL    fCode;
+};
+
+struct IMAGE
+{
+    const ARCH *            pArch;
+    std::vector<BYTE>       rbImage;        // Sections at their virtual addresses.
+    std::vector<SECTION>    rSections;
+    std::vector<ULONG>      rnFunctions;    // RVAs of function entry points.
+};
+
+struct TOTALS
+{
+    ULONGLONG   nFunctions;
+    ULONGLONG   nBlocks;
+    ULONGLONG   nInstructions;
+    ULONGLONG   nSafe;
+    ULONGLONG   nUnsafe;        // A branch or the function end is inside the patch.
+    ULONGLONG   nUnknown;       // Some path could not be followed.
+    ULONGLONG   nDynamic;
+    double      dSeconds;
+};
+
+static BOOL s_fVerbose = FALSE;
+static ULONG s_cbPatch = 0;
+
+//////////////////////////////////////////////////////////////// PE Parsing.
+//
+//  The headers are read by offset so that no Win32 structure definitions
+//  are needed on other hosts.
+//
+static BOOL ReadField(const std::vector<BYTE>& rbFile, ULONG nOffset, PVOID pv, ULONG cb)
+{
+    if ((ULONGLONG)nOffset + cb > rbFile.size()) {
+        return FALSE;
+    }
+    memcpy(pv, &rbFile[nOffset], cb);
+    return TRUE;
+}
+
+static BOOL LoadFile(const char *pszFile, std::vector<BYTE>& rbFile)
+{
+    FILE *pFile = fopen(pszFile, "rb");
+    if (pFile == NULL) {
+        return FALSE;
+    }
+
+    BYTE rbBuffer[65536];
+    size_t cbRead;
+    while ((cbRead = fread(rbBuffer, 1, sizeof(rbBuffer), pFile)) > 0) {
+        rbFile.insert(rbFile.end(), rbBuffer, rbBuffer + cbRead);
+    }
+    fclose(pFile);
+    return TRUE;
+}
+
+static void AddFunction(IMAGE& image, ULONG nRva)
+{
+    for (size_t n = 0; n < image.rSections.size(); n++) {
+        const SECTION& section = image.rSections[n];
+        if (section.fCode && nRva >= section.nRva && nRva < section.nRva + section.cbVirtual) {
+            image.rnFunctions.push_back(nRva);
+            return;
+        }
+    }
+}
+
+static BOOL MapImage(const char *pszFile, IMAGE& image)
+{
+    std::vector<BYTE> rbFile;
+    WORD wMagic = 0;
+    LONG nNtHeader = 0;
+    DWORD dwSignature = 0;
+    WORD wMachine = 0;
+    WORD nSections = 0;
+    WORD cbOptionalHeader = 0;
+    WORD wOptionalMagic = 0;
+    DWORD nEntry = 0;
+    DWORD cbImage = 0;
+    DWORD cbHeaders = 0;
+
+    if (!LoadFile(pszFile, rbFile)) {
+        printf("disolcfg: Could not read %s.\n", pszFile);
+        return FALSE;
+    }
+
+    if (!ReadField(rbFile, 0x00, &wMagic, sizeof(wMagic)) || wMagic != 0x5a4d ||
+        !ReadField(rbFile, 0x3c, &nNtHeader, sizeof(nNtHeader)) || nNtHeader < 0 ||
+        !ReadField(rbFile, nNtHeader, &dwSignature, sizeof(dwSignature)) ||
+        dwSignature != 0x00004550) {
+
+        printf("disolcfg: %s is not a PE file.\n", pszFile);
+        return FALSE;
+    }
+    ReadField(rbFile, nNtHeader + 4, &wMachine, sizeof(wMachine));
+    ReadField(rbFile, nNtHeader + 6, &nSections, sizeof(nSections));
+    ReadField(rbFile, nNtHeader + 20, &cbOptionalHeader, sizeof(cbOptionalHeader));
+
+    ULONG nOptional = nNtHeader + 24;
+    ReadField(rbFile, nOptional, &wOptionalMagic, sizeof(wOptionalMagic));
+    ReadField(rbFile, nOptional + 16, &nEntry, sizeof(nEntry));
+    ReadField(rbFile, nOptional + 56, &cbImage, sizeof(cbImage));
+    ReadField(rbFile, nOptional + 60, &cbHeaders, sizeof(cbHeaders));
+
+    image.pArch = NULL;
+    for (ULONG n = 0; n < ARRAYSIZE(s_rArchs); n++) {
+        if (s_rArchs[n].wMachine == wMachine) {
+            image.pArch = &s_rArchs[n];
+            break;
+        }
+    }
+    if (image.pArch == NULL) {
+        printf("disolcfg: %s has unsupported machine 0x%04x.\n", pszFile, wMachine);
+        return FALSE;
+    }
+    // DetourSetCodeModule reads the headers of the mapped copy.
+    if (cbImage == 0 || cbImage > 0x40000000 ||
+        (ULONGLONG)nOptional + cbOptionalHeader > cbHeaders ||
+        cbHeaders > cbImage || cbHeaders > rbFile.size()) {
+        printf("disolcfg: %s has bad image headers.\n", pszFile);
+        return FALSE;
+    }
+
+    image.rbImage.assign(cbImage, 0);
+    memcpy(&image.rbImage[0], &rbFile[0], cbHeaders);
+
+    ULONG nSection = nOptional + cbOptionalHeader;
+    for (ULONG n = 0; n < nSections; n++, nSection += 40) {
+        SECTION section;
+        DWORD cbRaw = 0;
+        DWORD nRaw = 0;
+        DWORD dwCharacteristics = 0;
+
+        if (!ReadField(rbFile, nSection + 8, &section.cbVirtual, sizeof(section.cbVirtual)) ||
+            !ReadField(rbFile, nSection + 12, &section.nRva, sizeof(section.nRva)) ||
+            !ReadField(rbFile, nSection + 16, &cbRaw, sizeof(cbRaw)) ||
+            !ReadField(rbFile, nSection + 20, &nRaw, sizeof(nRaw)) ||
+            !ReadField(rbFile, nSection + 36, &dwCharacteristics, sizeof(dwCharacteristics))) {
+            break;
+        }
+        if (section.cbVirtual == 0) {
+            section.cbVirtual = cbRaw;
+        }
+        if (section.nRva >= cbImage) {
+            continue;
+        }
+        if (section.cbVirtual > cbImage - section.nRva) {
+            section.cbVirtual = cbImage - section.nRva;
+        }
+        // IMAGE_SCN_CNT_CODE or IMAGE_SCN_MEM_EXECUTE.
+        section.fCode = (dwCharacteristics & 0x20000020) != 0;
+        image.rSections.push_back(section);
+
+        ULONG cbCopy = std::min(cbRaw, section.cbVirtual);
+        if (nRaw < rbFile.size()) {
+            cbCopy = (ULONG)std::min<size_t>(cbCopy, rbFile.size() - nRaw);
+            memcpy(&image.rbImage[section.nRva], &rbFile[nRaw], cbCopy);
+        }
+    }
+
+    // Data directories: export is [0], exception is [3].
+    ULONG nDirectories = nOptional + ((wOptionalMagic == 0x20b) ? 112 : 96);
+    DWORD nExportRva = 0;
+    DWORD cbExport = 0;
+    DWORD nPdataRva = 0;
+    DWORD cbPdata = 0;
+    ReadField(rbFile, nDirectories + 0, &nExportRva, sizeof(nExportRva));
+    ReadField(rbFile, nDirectories + 4, &cbExport, sizeof(cbExport));
+    ReadField(rbFile, nDirectories + 24, &nPdataRva, sizeof(nPdataRva));
+    ReadField(rbFile, nDirectories + 28, &cbPdata, sizeof(cbPdata));
+
+    if (nEntry != 0) {
+        AddFunction(image, nEntry);
+    }
+
+    if (nExportRva != 0 && (ULONGLONG)nExportRva + 40 <= cbImage) {
+        DWORD nFunctions = 0;
+        DWORD nFunctionsRva = 0;
+        ReadField(image.rbImage, nExportRva + 20, &nFunctions, sizeof(nFunctions));
+        ReadField(image.rbImage, nExportRva + 28, &nFunctionsRva, sizeof(nFunctionsRva));
+
+        for (DWORD n = 0; n < nFunctions; n++) {
+            DWORD nRva = 0;
+            if (!ReadField(image.rbImage, nFunctionsRva + n * 4, &nRva, sizeof(nRva))) {
+                break;
+            }
+            // Skip forwarders, which point into the export directory.
+            if (nRva != 0 && (nRva < nExportRva || nRva >= nExportRva + cbExport)) {
+                AddFunction(image, nRva);
+            }
+        }
+    }
+
+    if (image.pArch->cbPdataEntry != 0 && nPdataRva != 0) {
+        for (ULONG n = 0; n + image.pArch->cbPdataEntry <= cbPdata; n += image.pArch->cbPdataEntry) {
+            DWORD nRva = 0;
+            if (!ReadField(image.rbImage, nPdataRva + n, &nRva, sizeof(nRva))) {
+                break;
+            }
+            AddFunction(image, nRva);
+        }
+    }
+
+    std::sort(image.rnFunctions.begin(), image.rnFunctions.end());
+    image.rnFunctions.erase(std::unique(image.rnFunctions.begin(), image.rnFunctions.end()),
+                            image.rnFunctions.end());
+    return TRUE;
+}
+
+static ULONG CodeWindow(const IMAGE& image, ULONG nRva)
+{
+    for (size_t n = 0; n < image.rSections.size(); n++) {
+        const SECTION& section = image.rSections[n];
+        if (nRva >= section.nRva && nRva < section.nRva + section.cbVirtual) {
+            return section.nRva + section.cbVirtual - nRva;
+        }
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////// Analysis.
+//
+static void AnalyzeImage(const char *pszFile, const IMAGE& image, ULONG nIterations,
+                         TOTALS *pTotals)
+{
+    static DETOUR_BASIC_BLOCK s_rBlocks[4096];
+    const ARCH *pArch = image.pArch;
+    ULONG cbPatch = s_cbPatch ? s_cbPatch : pArch->cbPatch;
+    PBYTE pbImage = (PBYTE)&image.rbImage[0];
+
+    pArch->pfSetCodeModule((HMODULE)pbImage, TRUE);
+
+    auto tStart = std::chrono::steady_clock::now();
+    for (ULONG i = 0; i < nIterations; i++) {
+        BOOL fReport = (i == 0);
+
+        for (size_t n = 0; n < image.rnFunctions.size(); n++) {
+            ULONG nRva = image.rnFunctions[n];
+            ULONG cbCode = CodeWindow(image, nRva);
+            DETOUR_FUNCTION_GRAPH graph;
+            ULONG cbCopied = 0;
+
+            if (!pArch->pfBuild(pbImage + nRva, cbCode,
+                                s_rBlocks, ARRAYSIZE(s_rBlocks), &graph)) {
+                continue;
+            }
+            BOOL fSafe = pArch->pfIsPatchSafe(pbImage + nRva, cbCode, cbPatch, &cbCopied);
+            DWORD dwError = fSafe ? 0 : GetLastError();
+
+            if (!fReport) {
+                continue;
+            }
+            pTotals->nFunctions++;
+            pTotals->nBlocks += graph.cBlocks;
+            pTotals->nInstructions += graph.cInstructions;
+            if (fSafe) {
+                pTotals->nSafe++;
+            }
+            else if (dwError == ERROR_INVALID_BLOCK) {
+                pTotals->nUnsafe++;
+            }
+            else {
+                pTotals->nUnknown++;
+            }
+            if (graph.fFlags & DETOUR_GRAPH_DYNAMIC) {
+                pTotals->nDynamic++;
+            }
+
+            if (s_fVerbose) {
+                printf("  %-6s %08x %6u blocks %7u insts %7u bytes flags=%x copy=%-2u %s\n",
+                       pArch->pszName, nRva, graph.cBlocks, graph.cInstructions,
+                       graph.cbExtent, graph.fFlags, cbCopied,
+                       fSafe ? "safe" :
+                       (dwError == ERROR_INVALID_BLOCK) ? "unsafe" : "unknown");
+            }
+        }
+    }
+    std::chrono::duration<double> dElapsed = std::chrono::steady_clock::now() - tStart;
+    pTotals->dSeconds += dElapsed.count() / nIterations;
+
+    if (s_fVerbose) {
+        printf("  %s: %u functions\n", pszFile, (ULONG)image.rnFunctions.size());
+    }
+}
+
+//////////////////////////////////////////////////////////////// Tail Checks.
+//
+//  The last 64 bytes of the code are decoded from a zero-padded copy.  A
+//  jump there to another tail instruction must land on it, whether its
+//  target is relative (jmp rel32) or absolute (x64 jmpabs), and a
+//  jmp [slot] there must end in a dynamic block, since its slot would be
+//  located relative to the copy.  The code lives in a minimal image, and is
+//  checked with slot reads limited to the image and again unlimited.
+//
+#define CHECK_IMAGE     512             // Bytes in the check image.
+#define CHECK_SLOT      0x100           // Offset of the memory-indirect slot.
+#define CHECK_CODE      0x110           // Offset of the code.
+
+static BYTE s_rbCheck[CHECK_IMAGE];
+
+static void InitCheckImage(PBYTE pbValue)
+{
+    LONG nNtHeader = 0x40;
+    WORD cbOptionalHeader = 0xf0;
+    DWORD cbImage = CHECK_IMAGE;
+
+    memset(s_rbCheck, 0, CHECK_CODE);
+    memset(s_rbCheck + CHECK_CODE, 0x90, CHECK_IMAGE - CHECK_CODE);    // NOPs.
+    s_rbCheck[0] = 'M';
+    s_rbCheck[1] = 'Z';
+    memcpy(s_rbCheck + 0x3c, &nNtHeader, sizeof(nNtHeader));
+    memcpy(s_rbCheck + nNtHeader, "PE\0\0", 4);
+    memcpy(s_rbCheck + nNtHeader + 20, &cbOptionalHeader, sizeof(cbOptionalHeader));
+    memcpy(s_rbCheck + nNtHeader + 0x50, &cbImage, sizeof(cbImage));
+    memcpy(s_rbCheck + CHECK_SLOT, &pbValue, sizeof(pbValue));
+}
+
+static const DETOUR_BASIC_BLOCK *FindBlock(const DETOUR_BASIC_BLOCK *pBlocks, ULONG cBlocks,
+                                           ULONG nOffset)
+{
+    for (ULONG n = 0; n < cBlocks; n++) {
+        if (nOffset >= pBlocks[n].nOffset && nOffset < pBlocks[n].nOffset + pBlocks[n].cbBlock) {
+            return &pBlocks[n];
+        }
+    }
+    return NULL;
+}
+
+static BOOL CheckTail(const ARCH *pArch, BOOL fLimit)
+{
+    DETOUR_BASIC_BLOCK rBlocks[16];
+    DETOUR_FUNCTION_GRAPH graph;
+    BOOL fX64 = (pArch->wMachine == 0x8664);
+    PBYTE pbSlot = s_rbCheck + CHECK_SLOT;
+    PBYTE pbCode = s_rbCheck + CHECK_CODE;
+    ULONG cbCode = CHECK_IMAGE - CHECK_CODE;
+    ULONG nJump = cbCode - 40;          // jmpabs on x64, jmp rel32 on x86.
+    ULONG nIndirect = cbCode - 6;       // jmp [slot].
+    LONG lSlot = fX64
+        ? (LONG)(pbSlot - (pbCode + nIndirect + 6))
+        : (LONG)(ULONG)(ULONG_PTR)pbSlot;
+
+    InitCheckImage(pbCode);
+
+    if (fX64) {
+        PBYTE pbIndirect = pbCode + nIndirect;
+        pbCode[nJump] = 0xd5;
+        pbCode[nJump + 1] = 0x00;
+        pbCode[nJump + 2] = 0xa1;
+        memcpy(pbCode + nJump + 3, &pbIndirect, sizeof(pbIndirect));
+    }
+    else {
+        LONG lRelative = (LONG)(nIndirect - (nJump + 5));
+        pbCode[nJump] = 0xe9;
+        memcpy(pbCode + nJump + 1, &lRelative, sizeof(lRelative));
+    }
+    pbCode[nIndirect] = 0xff;
+    pbCode[nIndirect + 1] = 0x25;
+    memcpy(pbCode + nIndirect + 2, &lSlot, sizeof(lSlot));
+
+    pArch->pfSetCodeModule(fLimit ? (HMODULE)s_rbCheck : NULL, fLimit);
+    if (!pArch->pfBuild(pbCode, cbCode, rBlocks, ARRAYSIZE(rBlocks), &graph) ||
+        graph.cBlocks > ARRAYSIZE(rBlocks)) {
+        printf("disolcfg: %s check graph could not be built.\n", pArch->pszName);
+        return FALSE;
+    }
+
+    const DETOUR_BASIC_BLOCK *pJump = FindBlock(rBlocks, graph.cBlocks, nJump);
+    const DETOUR_BASIC_BLOCK *pIndirect = FindBlock(rBlocks, graph.cBlocks, nIndirect);
+    if (pJump == NULL || !(pJump->fFlags & DETOUR_BLOCK_BRANCH) || pJump->nTarget != nIndirect) {
+        printf("disolcfg: %s tail jump at +%u does not reach +%u.\n",
+               pArch->pszName, nJump, nIndirect);
+        return FALSE;
+    }
+    if (pIndirect == NULL || !(pIndirect->fFlags & DETOUR_BLOCK_DYNAMIC) ||
+        (graph.fFlags & DETOUR_GRAPH_EXTERNAL)) {
+        printf("disolcfg: %s tail jmp [slot] at +%u is not dynamic (flags=%x).\n",
+               pArch->pszName, nIndirect, graph.fFlags);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    disolcfg [options] [pefiles...]\n"
+           "Options:\n"
+           "    -n:count       Analyze each file count times for timing (default 1).\n"
+           "    -p:bytes       Patch size to check (default: DetourAttach's jump).\n"
+           "    -v             Verbose; list every function.\n"
+           "    -?             This help screen.\n");
+}
+
+static BOOL IsOption(const char *pszArg)
+{
+#ifdef DETOURS_OFFLINE_PORTABLE
+    return pszArg[0] == '-';    // '/' starts a path.
+#else
+    return pszArg[0] == '-' || pszArg[0] == '/';
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    ULONG nIterations = 1;
+    ULONG nFiles = 0;
+    TOTALS totals[ARRAYSIZE(s_rArchs)];
+
+    memset(totals, 0, sizeof(totals));
+
+    // The limited pass runs last; AnalyzeImage names each image it maps.
+    for (int pass = 0; pass < 2; pass++) {
+        if (!CheckTail(&s_rArchs[0], pass == 1) || !CheckTail(&s_rArchs[1], pass == 1)) {
+            return 2;
+        }
+    }
+    printf("disolcfg: tail checks passed.\n");
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (IsOption(argv[arg])) {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case 'n':
+              case 'N':
+                nIterations = strtoul(argp, NULL, 0);
+                if (nIterations == 0) {
+                    nIterations = 1;
+                }
+                break;
+              case 'p':
+              case 'P':
+                s_cbPatch = strtoul(argp, NULL, 0);
+                break;
+              case 'v':
+              case 'V':
+                s_fVerbose = TRUE;
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("disolcfg: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+            continue;
+        }
+
+        IMAGE image;
+        if (MapImage(argv[arg], image)) {
+            AnalyzeImage(argv[arg], image, nIterations,
+                         &totals[image.pArch - s_rArchs]);
+            nFiles++;
+        }
+    }
+
+    if (nFiles == 0) {
+        return 0;
+    }
+
+    printf("%-6s %9s %9s %11s %8s %8s %8s %8s %12s\n",
+           "arch", "functions", "blocks", "insts", "safe", "unsafe", "unknown", "dynamic",
+           "functions/s");
+    for (ULONG n = 0; n < ARRAYSIZE(s_rArchs); n++) {
+        const TOTALS& t = totals[n];
+        if (t.nFunctions == 0) {
+            continue;
+        }
+        printf("%-6s %9llu %9llu %11llu %8llu %8llu %8llu %8llu %12.0f\n",
+               s_rArchs[n].pszName,
+               (unsigned long long)t.nFunctions, (unsigned long long)t.nBlocks,
+               (unsigned long long)t.nInstructions, (unsigned long long)t.nSafe,
+               (unsigned long long)t.nUnsafe, (unsigned long long)t.nUnknown,
+               (unsigned long long)t.nDynamic,
+               t.nFunctions / (t.dSeconds > 0 ? t.dSeconds : 1e-9));
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////// End of File.
@@ -0,0 +1,640 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: disolexp.cpp (disolexp.exe - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Pre-flight check of every export of a PE file: how many bytes
+//  DetourAttachEx would move to the trampoline and whether the prologue can
+//  be detoured.  The exports are walked as DetourEnumerateExports does, then
+//  sharded across a pool of threads that analyze each prologue with the
+//  offline disassembler.  The report is CSV or a compact binary file.
+//  Each mapped copy is named with DetourSetCodeModule##x before the threads
+//  start, so indirect jump slots are read only from it.
+//
+//  Builds with nmake on Windows and with GNU make (libdisol.a) on Linux.
+//
+
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include <disol.h>
+#else
+#define DETOURS_INTERNAL
+#include <detours.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+typedef BOOL (WINAPI *PF_BUILD_FUNCTION_GRAPH)(PVOID pCode,
+                                               ULONG cbCode,
+                                               PDETOUR_BASIC_BLOCK pBlocks,
+                                               ULONG cMaxBlocks,
+                                               PDETOUR_FUNCTION_GRAPH pGraph);
+
+typedef BOOL (WINAPI *PF_IS_PATCH_SAFE)(PVOID pCode,
+                                        ULONG cbCode,
+                                        ULONG cbPatch,
+                                        ULONG *pcbCopied);
+
+typedef ULONG (WINAPI *PF_DECODE_INSTRUCTIONS)(PVOID pCode,
+                                               ULONG cbCode,
+                                               PDETOUR_INSTRUCTION pInstructions,
+                                               ULONG cMaxInstructions,
+                                               ULONG *pcbDecoded);
+
+typedef BOOL (WINAPI *PF_SET_CODE_MODULE)(HMODULE hModule,
+                                          BOOL fLimitReferencesToModule);
+
+struct ARCH
+{
+    WORD                    wMachine;
+    const char *            pszName;
+    ULONG                   cbPatch;        // Size of the jump DetourAttach writes.
+    PF_BUILD_FUNCTION_GRAPH pfBuild;
+    PF_IS_PATCH_SAFE        pfIsPatchSafe;
+    PF_DECODE_INSTRUCTIONS  pfDecode;
+    PF_SET_CODE_MODULE      pfSetCodeModule;
+};
+
+static const ARCH s_rArchs[] = {
+    { 0x014c, "x86",   5,  DetourBuildFunctionGraphX86,   DetourIsPatchSafeX86,
+      DetourDecodeInstructionsX86,   DetourSetCodeModuleX86 },
+    { 0x8664, "x64",   5,  DetourBuildFunctionGraphX64,   DetourIsPatchSafeX64,
+      DetourDecodeInstructionsX64,   DetourSetCodeModuleX64 },
+    { 0xaa64, "arm64", 12, DetourBuildFunctionGraphARM64, DetourIsPatchSafeARM64,
+      DetourDecodeInstructionsARM64, DetourSetCodeModuleARM64 },
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+enum STATUS
+{
+    STATUS_SAFE = 0,        // The prologue can be detoured.
+    STATUS_BRANCH,          // A branch in the function lands in the moved bytes.
+    STATUS_SMALL,           // The function ends inside the patch.
+    STATUS_UNKNOWN,         // Some path could not be followed to its end.
+    STATUS_THUNK,           // A jump elsewhere; DetourAttachEx follows it first.
+    STATUS_FORWARD,         // Forwarded to another DLL.
+    STATUS_DATA,            // Not in a code section.
+};
+
+static const char *s_rpszStatus[] = {
+    "safe", "branch", "small", "unknown", "thunk", "forward", "data",
+};
+
+struct EXPORT
+{
+    ULONG       nOrdinal;
+    ULONG       nRva;
+    const char *pszName;    // Points into the mapped image, or NULL.
+    BOOL        fForward;
+};
+
+struct RESULT
+{
+    BYTE        bStatus;
+    BYTE        cbCopied;   // Bytes of whole instructions moved to the trampoline.
+    BYTE        cbExtra;    // Extra trampoline bytes for relocated branches.
+    BYTE        fGraph;     // DETOUR_GRAPH_* flags.
+    USHORT      cBlocks;
+    USHORT      cInstructions;
+};
+
+struct SECTION
+{
+    ULONG   nRva;
+    ULONG   cbVirtual;
+    BOOL    fCode;
+};
+
+struct IMAGE
+{
+    const ARCH *            pArch;
+    std::vector<BYTE>       rbImage;        // Sections at their virtual addresses.
+    std::vector<SECTION>    rSections;
+    std::vector<EXPORT>     rExports;
+};
+
+//////////////////////////////////////////////////////////// Binary Report.
+//
+//  A REPORT_HEADER, then cRecords REPORT_RECORDs in ordinal order, then
+//  cbStrings bytes of NUL-terminated export names.  All fields are little
+//  endian.
+//
+#define REPORT_MAGIC    0x31525844  // "DXR1"
+#define REPORT_NO_NAME  0xffffffff
+
+struct REPORT_HEADER
+{
+    ULONG   nMagic;
+    USHORT  wMachine;
+    USHORT  cbPatch;
+    ULONG   cRecords;
+    ULONG   cbStrings;
+};
+
+struct REPORT_RECORD
+{
+    ULONG   nOrdinal;
+    ULONG   nRva;
+    ULONG   nName;          // Offset into the strings, or REPORT_NO_NAME.
+    RESULT  result;
+};
+
+static_assert(sizeof(REPORT_HEADER) == 16, "REPORT_HEADER must be packed");
+static_assert(sizeof(REPORT_RECORD) == 20, "REPORT_RECORD must be packed");
+
+//////////////////////////////////////////////////////////////// PE Parsing.
+//
+//  The headers are read by offset so that no Win32 structure definitions
+//  are needed on other hosts.
+//
+static BOOL ReadField(const std::vector<BYTE>& rbFile, ULONG nOffset, PVOID pv, ULONG cb)
+{
+    if ((ULONGLONG)nOffset + cb > rbFile.size()) {
+        return FALSE;
+    }
+    memcpy(pv, &rbFile[nOffset], cb);
+    return TRUE;
+}
+
+static BOOL LoadFile(const char *pszFile, std::vector<BYTE>& rbFile)
+{
+    FILE *pFile = fopen(pszFile, "rb");
+    if (pFile == NULL) {
+        return FALSE;
+    }
+
+    BYTE rbBuffer[65536];
+    size_t cbRead;
+    while ((cbRead = fread(rbBuffer, 1, sizeof(rbBuffer), pFile)) > 0) {
+        rbFile.insert(rbFile.end(), rbBuffer, rbBuffer + cbRead);
+    }
+    fclose(pFile);
+    return TRUE;
+}
+
+static const SECTION *FindSection(const IMAGE& image, ULONG nRva)
+{
+    for (size_t n = 0; n < image.rSections.size(); n++) {
+        const SECTION& section = image.rSections[n];
+        if (nRva >= section.nRva && nRva < section.nRva + section.cbVirtual) {
+            return &section;
+        }
+    }
+    return NULL;
+}
+
+static const char *ImageString(const IMAGE& image, ULONG nRva)
+{
+    if (nRva == 0 || nRva >= image.rbImage.size()) {
+        return NULL;
+    }
+    const char *psz = (const char *)&image.rbImage[nRva];
+    if (memchr(psz, 0, image.rbImage.size() - nRva) == NULL) {
+        return NULL;
+    }
+    return psz;
+}
+
+static BOOL MapImage(const char *pszFile, IMAGE& image)
+{
+    std::vector<BYTE> rbFile;
+    WORD wMagic = 0;
+    LONG nNtHeader = 0;
+    DWORD dwSignature = 0;
+    WORD wMachine = 0;
+    WORD nSections = 0;
+    WORD cbOptionalHeader = 0;
+    WORD wOptionalMagic = 0;
+    DWORD cbImage = 0;
+    DWORD cbHeaders = 0;
+
+    if (!LoadFile(pszFile, rbFile)) {
+        fprintf(stderr, "disolexp: Could not read %s.\n", pszFile);
+        return FALSE;
+    }
+
+    if (!ReadField(rbFile, 0x00, &wMagic, sizeof(wMagic)) || wMagic != 0x5a4d ||
+        !ReadField(rbFile, 0x3c, &nNtHeader, sizeof(nNtHeader)) || nNtHeader < 0 ||
+        !ReadField(rbFile, nNtHeader, &dwSignature, sizeof(dwSignature)) ||
+        dwSignature != 0x00004550) {
+
+        fprintf(stderr, "disolexp: %s is not a PE file.\n", pszFile);
+        return FALSE;
+    }
+    ReadField(rbFile, nNtHeader + 4, &wMachine, sizeof(wMachine));
+    ReadField(rbFile, nNtHeader + 6, &nSections, sizeof(nSections));
+    ReadField(rbFile, nNtHeader + 20, &cbOptionalHeader, sizeof(cbOptionalHeader));
+
+    ULONG nOptional = nNtHeader + 24;
+    ReadField(rbFile, nOptional, &wOptionalMagic, sizeof(wOptionalMagic));
+    ReadField(rbFile, nOptional + 56, &cbImage, sizeof(cbImage));
+    ReadField(rbFile, nOptional + 60, &cbHeaders, sizeof(cbHeaders));
+
+    image.pArch = NULL;
+    for (ULONG n = 0; n < ARRAYSIZE(s_rArchs); n++) {
+        if (s_rArchs[n].wMachine == wMachine) {
+            image.pArch = &s_rArchs[n];
+            break;
+        }
+    }
+    if (image.pArch == NULL) {
+        fprintf(stderr, "disolexp: %s has unsupported machine 0x%04x.\n", pszFile, wMachine);
+        return FALSE;
+    }
+    // DetourSetCodeModule reads the headers of the mapped copy.
+    if (cbImage == 0 || cbImage > 0x40000000 ||
+        (ULONGLONG)nOptional + cbOptionalHeader > cbHeaders ||
+        cbHeaders > cbImage || cbHeaders > rbFile.size()) {
+        fprintf(stderr, "disolexp: %s has bad image headers.\n", pszFile);
+        return FALSE;
+    }
+
+    image.rbImage.assign(cbImage, 0);
+    memcpy(&image.rbImage[0], &rbFile[0], cbHeaders);
+
+    ULONG nSection = nOptional + cbOptionalHeader;
+    for (ULONG n = 0; n < nSections; n++, nSection += 40) {
+        SECTION section;
+        DWORD cbRaw = 0;
+        DWORD nRaw = 0;
+        DWORD dwCharacteristics = 0;
+
+        if (!ReadField(rbFile, nSection + 8, &section.cbVirtual, sizeof(section.cbVirtual)) ||
+            !ReadField(rbFile, nSection + 12, &section.nRva, sizeof(section.nRva)) ||
+            !ReadField(rbFile, nSection + 16, &cbRaw, sizeof(cbRaw)) ||
+            !ReadField(rbFile, nSection + 20, &nRaw, sizeof(nRaw)) ||
+            !ReadField(rbFile, nSection + 36, &dwCharacteristics, sizeof(dwCharacteristics))) {
+            break;
+        }
+        if (section.cbVirtual == 0) {
+            section.cbVirtual = cbRaw;
+        }
+        if (section.nRva >= cbImage) {
+            continue;
+        }
+        if (section.cbVirtual > cbImage - section.nRva) {
+            section.cbVirtual = cbImage - section.nRva;
+        }
+        // IMAGE_SCN_CNT_CODE or IMAGE_SCN_MEM_EXECUTE.
+        section.fCode = (dwCharacteristics & 0x20000020) != 0;
+        image.rSections.push_back(section);
+
+        ULONG cbCopy = std::min(cbRaw, section.cbVirtual);
+        if (nRaw < rbFile.size()) {
+            cbCopy = (ULONG)std::min<size_t>(cbCopy, rbFile.size() - nRaw);
+            memcpy(&image.rbImage[section.nRva], &rbFile[nRaw], cbCopy);
+        }
+    }
+
+    // Walk the export directory as DetourEnumerateExports does, but name
+    // the ordinals in one pass over AddressOfNames rather than one pass per
+    // function.
+    ULONG nDirectories = nOptional + ((wOptionalMagic == 0x20b) ? 112 : 96);
+    DWORD nExportRva = 0;
+    DWORD cbExport = 0;
+    ReadField(rbFile, nDirectories + 0, &nExportRva, sizeof(nExportRva));
+    ReadField(rbFile, nDirectories + 4, &cbExport, sizeof(cbExport));
+
+    if (nExportRva == 0 || (ULONGLONG)nExportRva + 40 > cbImage) {
+        return TRUE;
+    }
+
+    DWORD nBase = 0;
+    DWORD nFunctions = 0;
+    DWORD nNames = 0;
+    DWORD nFunctionsRva = 0;
+    DWORD nNamesRva = 0;
+    DWORD nOrdinalsRva = 0;
+    ReadField(image.rbImage, nExportRva + 16, &nBase, sizeof(nBase));
+    ReadField(image.rbImage, nExportRva + 20, &nFunctions, sizeof(nFunctions));
+    ReadField(image.rbImage, nExportRva + 24, &nNames, sizeof(nNames));
+    ReadField(image.rbImage, nExportRva + 28, &nFunctionsRva, sizeof(nFunctionsRva));
+    ReadField(image.rbImage, nExportRva + 32, &nNamesRva, sizeof(nNamesRva));
+    ReadField(image.rbImage, nExportRva + 36, &nOrdinalsRva, sizeof(nOrdinalsRva));
+
+    if ((ULONGLONG)nFunctionsRva + (ULONGLONG)nFunctions * 4 > cbImage) {
+        fprintf(stderr, "disolexp: %s has a bad export directory.\n", pszFile);
+        return FALSE;
+    }
+
+    image.rExports.resize(nFunctions);
+    for (DWORD n = 0; n < nFunctions; n++) {
+        EXPORT& exp = image.rExports[n];
+        ReadField(image.rbImage, nFunctionsRva + n * 4, &exp.nRva, sizeof(exp.nRva));
+        exp.nOrdinal = nBase + n;
+        exp.pszName = NULL;
+        // if the pointer is in the export region, then it is a forwarder.
+        exp.fForward = (exp.nRva >= nExportRva && exp.nRva < nExportRva + cbExport);
+    }
+    for (DWORD n = 0; n < nNames; n++) {
+        WORD nFunc = 0;
+        DWORD nNameRva = 0;
+        if (!ReadField(image.rbImage, nOrdinalsRva + n * 2, &nFunc, sizeof(nFunc)) ||
+            !ReadField(image.rbImage, nNamesRva + n * 4, &nNameRva, sizeof(nNameRva))) {
+            break;
+        }
+        if (nFunc < nFunctions && image.rExports[nFunc].pszName == NULL) {
+            image.rExports[nFunc].pszName = ImageString(image, nNameRva);
+        }
+    }
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////// Analysis.
+//
+static void AnalyzeExport(const IMAGE& image, ULONG cbPatch, const EXPORT& exp, RESULT *pResult)
+{
+    const ARCH *pArch = image.pArch;
+    PBYTE pbCode = (PBYTE)&image.rbImage[0] + exp.nRva;
+    const SECTION *pSection = FindSection(image, exp.nRva);
+    DETOUR_BASIC_BLOCK rBlocks[1];
+    DETOUR_FUNCTION_GRAPH graph;
+    ULONG cbCopied = 0;
+
+    memset(pResult, 0, sizeof(*pResult));
+
+    if (exp.fForward) {
+        pResult->bStatus = STATUS_FORWARD;
+        return;
+    }
+    if (exp.nRva == 0 || pSection == NULL || !pSection->fCode) {
+        pResult->bStatus = STATUS_DATA;
+        return;
+    }
+
+    ULONG cbCode = pSection->nRva + pSection->cbVirtual - exp.nRva;
+    if (!pArch->pfBuild(pbCode, cbCode, rBlocks, ARRAYSIZE(rBlocks), &graph)) {
+        pResult->bStatus = STATUS_UNKNOWN;
+        return;
+    }
+    pResult->fGraph = (BYTE)graph.fFlags;
+    pResult->cBlocks = (USHORT)std::min<ULONG>(graph.cBlocks, 0xffff);
+    pResult->cInstructions = (USHORT)std::min<ULONG>(graph.cInstructions, 0xffff);
+
+    // DetourAttachEx skips jumps to other code (import thunks and the like)
+    // through DetourCodeFromPointer before measuring the prologue.
+    if (graph.cBlocks > 0 && rBlocks[0].cInstructions == 1 &&
+        (rBlocks[0].fFlags & (DETOUR_BLOCK_EXTERNAL | DETOUR_BLOCK_DYNAMIC)) &&
+        !(rBlocks[0].fFlags & DETOUR_BLOCK_CONDITIONAL)) {
+        pResult->bStatus = STATUS_THUNK;
+        return;
+    }
+
+    if (pArch->pfIsPatchSafe(pbCode, cbCode, cbPatch, &cbCopied)) {
+        pResult->bStatus = STATUS_SAFE;
+    }
+    else if (GetLastError() == ERROR_INVALID_BLOCK) {
+        pResult->bStatus = (cbCopied != 0) ? STATUS_BRANCH : STATUS_SMALL;
+    }
+    else {
+        pResult->bStatus = STATUS_UNKNOWN;
+    }
+    pResult->cbCopied = (BYTE)cbCopied;
+
+    // Short branches in the moved bytes grow when they are relocated.
+    DETOUR_INSTRUCTION rInstructions[16];
+    ULONG nInstructions = pArch->pfDecode(pbCode, cbCopied,
+                                          rInstructions, ARRAYSIZE(rInstructions), NULL);
+    ULONG cbExtra = 0;
+    for (ULONG n = 0; n < nInstructions; n++) {
+        if (rInstructions[n].nExtra > 0) {
+            cbExtra += rInstructions[n].nExtra;
+        }
+    }
+    pResult->cbExtra = (BYTE)cbExtra;
+}
+
+static void AnalyzeImage(const IMAGE& image, ULONG cbPatch, ULONG nThreads,
+                         std::vector<RESULT>& rResults)
+{
+    const ULONG cChunk = 64;
+    ULONG nExports = (ULONG)image.rExports.size();
+    std::atomic<ULONG> nNext(0);
+    std::vector<std::thread> rThreads;
+
+    rResults.resize(nExports);
+
+    // The module range is global, so it is set once for all the workers.
+    image.pArch->pfSetCodeModule((HMODULE)&image.rbImage[0], TRUE);
+
+    auto worker = [&]() {
+        for (;;) {
+            ULONG nBeg = nNext.fetch_add(cChunk);
+            if (nBeg >= nExports) {
+                break;
+            }
+            ULONG nEnd = std::min(nBeg + cChunk, nExports);
+            for (ULONG n = nBeg; n < nEnd; n++) {
+                AnalyzeExport(image, cbPatch, image.rExports[n], &rResults[n]);
+            }
+        }
+    };
+
+    for (ULONG n = 1; n < nThreads; n++) {
+        rThreads.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t n = 0; n < rThreads.size(); n++) {
+        rThreads[n].join();
+    }
+}
+
+//////////////////////////////////////////////////////////////// Reporting.
+//
+static void WriteCsv(FILE *pOut, const char *pszFile, const IMAGE& image,
+                     const std::vector<RESULT>& rResults)
+{
+    for (size_t n = 0; n < rResults.size(); n++) {
+        const EXPORT& exp = image.rExports[n];
+        const RESULT& res = rResults[n];
+
+        if (exp.nRva == 0) {
+            continue;           // Unused ordinal.
+        }
+        fprintf(pOut, "%s,%s,%u,%s,%08x,%s,%u,%u,%u,%u,%x\n",
+                pszFile, image.pArch->pszName, exp.nOrdinal,
+                exp.pszName ? exp.pszName : "", exp.nRva,
+                s_rpszStatus[res.bStatus], res.cbCopied, res.cbExtra,
+                res.cBlocks, res.cInstructions, res.fGraph);
+    }
+}
+
+static void WriteBinary(FILE *pOut, const IMAGE& image, ULONG cbPatch,
+                        const std::vector<RESULT>& rResults)
+{
+    std::vector<REPORT_RECORD> rRecords;
+    std::string strings;
+
+    for (size_t n = 0; n < rResults.size(); n++) {
+        const EXPORT& exp = image.rExports[n];
+        REPORT_RECORD record;
+
+        if (exp.nRva == 0) {
+            continue;
+        }
+        record.nOrdinal = exp.nOrdinal;
+        record.nRva = exp.nRva;
+        record.nName = REPORT_NO_NAME;
+        record.result = rResults[n];
+        if (exp.pszName != NULL) {
+            record.nName = (ULONG)strings.size();
+            strings.append(exp.pszName);
+            strings.push_back('\0');
+        }
+        rRecords.push_back(record);
+    }
+
+    REPORT_HEADER header;
+    header.nMagic = REPORT_MAGIC;
+    header.wMachine = image.pArch->wMachine;
+    header.cbPatch = (USHORT)cbPatch;
+    header.cRecords = (ULONG)rRecords.size();
+    header.cbStrings = (ULONG)strings.size();
+
+    fwrite(&header, sizeof(header), 1, pOut);
+    if (!rRecords.empty()) {
+        fwrite(&rRecords[0], sizeof(REPORT_RECORD), rRecords.size(), pOut);
+    }
+    fwrite(strings.data(), 1, strings.size(), pOut);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    disolexp [options] pefiles...\n"
+           "Options:\n"
+           "    -o:file        Write the report to file (default stdout).\n"
+           "    -b             Binary report (one per file, see REPORT_HEADER).\n"
+           "    -p:bytes       Patch size to check (default: DetourAttach's jump).\n"
+           "    -t:threads     Worker threads (default: one per processor).\n"
+           "    -?             This help screen.\n"
+           "CSV columns:\n"
+           "    file,arch,ordinal,name,rva,status,copied,extra,blocks,insts,flags\n");
+}
+
+static BOOL IsOption(const char *pszArg)
+{
+#ifdef DETOURS_OFFLINE_PORTABLE
+    return pszArg[0] == '-';    // '/' starts a path.
+#else
+    return pszArg[0] == '-' || pszArg[0] == '/';
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    const char *pszOut = NULL;
+    BOOL fBinary = FALSE;
+    ULONG cbPatchOption = 0;
+    ULONG nThreads = std::thread::hardware_concurrency();
+    std::vector<const char *> rpszFiles;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (IsOption(argv[arg])) {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case 'b':
+              case 'B':
+                fBinary = TRUE;
+                break;
+              case 'o':
+              case 'O':
+                pszOut = argp;
+                break;
+              case 'p':
+              case 'P':
+                cbPatchOption = strtoul(argp, NULL, 0);
+                break;
+              case 't':
+              case 'T':
+                nThreads = strtoul(argp, NULL, 0);
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("disolexp: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+            continue;
+        }
+        rpszFiles.push_back(argv[arg]);
+    }
+
+    if (rpszFiles.empty()) {
+        PrintUsage();
+        return 1;
+    }
+    if (nThreads == 0) {
+        nThreads = 1;
+    }
+
+    FILE *pOut = stdout;
+    if (pszOut != NULL) {
+        pOut = fopen(pszOut, fBinary ? "wb" : "w");
+        if (pOut == NULL) {
+            fprintf(stderr, "disolexp: Could not create %s.\n", pszOut);
+            return 1;
+        }
+    }
+
+    ULONGLONG nExports = 0;
+    double dSeconds = 0;
+    int nError = 0;
+
+    for (size_t f = 0; f < rpszFiles.size(); f++) {
+        IMAGE image;
+        std::vector<RESULT> rResults;
+
+        if (!MapImage(rpszFiles[f], image)) {
+            nError = 2;
+            continue;
+        }
+        ULONG cbPatch = cbPatchOption ? cbPatchOption : image.pArch->cbPatch;
+
+        auto tStart = std::chrono::steady_clock::now();
+        AnalyzeImage(image, cbPatch, nThreads, rResults);
+        std::chrono::duration<double> dElapsed = std::chrono::steady_clock::now() - tStart;
+        dSeconds += dElapsed.count();
+        nExports += rResults.size();
+
+        if (fBinary) {
+            WriteBinary(pOut, image, cbPatch, rResults);
+        }
+        else {
+            WriteCsv(pOut, rpszFiles[f], image, rResults);
+        }
+    }
+
+    if (pOut != stdout) {
+        fclose(pOut);
+    }
+    fprintf(stderr, "disolexp: %llu exports in %.3f seconds on %u threads.\n",
+            (unsigned long long)nExports, dSeconds, nThreads);
+    return nError;
+}
+
+///////////////////////////////////////////////////////////////// End of File.
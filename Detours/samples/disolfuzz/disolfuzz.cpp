@@ -0,0 +1,443 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: disolfuzz.cpp (disolfuzz.exe - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Differential test of the x86 and x64 instruction lengths reported by
+//  DetourCopyInstruction##x.  A corpus lists one encoded instruction per
+//  line as hex bytes, optionally followed by "# text"; the length of each
+//  line is the expected length.  Results are reported per encoding class
+//  (legacy, VEX, EVEX, REX2, XOP) as mismatch rate and decode throughput.
+//
+//  With -g, writes a stream of random, encoding-aware instruction bytes
+//  instead.  Disassembling that stream with a reference disassembler (see
+//  the fuzz target in GNUmakefile) produces a corpus for the comparison.
+//
+//  Builds with nmake on Windows and with GNU make (libdisol.a) on Linux.
+//
+
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include <disol.h>
+#else
+#define DETOURS_INTERNAL
+#include <detours.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+typedef PVOID (WINAPI *PF_COPY_INSTRUCTION)(PVOID pDst,
+                                            PVOID *ppDstPool,
+                                            PVOID pSrc,
+                                            PVOID *ppTarget,
+                                            LONG *plExtra);
+
+enum CLASS
+{
+    CLASS_LEGACY = 0,
+    CLASS_VEX,
+    CLASS_EVEX,
+    CLASS_REX2,
+    CLASS_XOP,
+    CLASS_COUNT,
+};
+
+static const char *s_rpszClass[CLASS_COUNT] = {
+    "legacy", "vex", "evex", "rex2", "xop",
+};
+
+#define MAX_INSTRUCTION 15
+#define SLOT_SIZE       32              // Instruction plus readahead filler.
+
+struct CORPUS
+{
+    std::vector<BYTE>           rbSlots;    // SLOT_SIZE bytes per instruction.
+    std::vector<BYTE>           rcbExpected;
+    std::vector<std::string>    rText;
+};
+
+static BOOL s_fVerbose = FALSE;
+static BOOL s_f32Bit = FALSE;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static CLASS Classify(const BYTE *pb, ULONG cb)
+{
+    ULONG n = 0;
+
+    while (n < cb) {
+        BYTE b = pb[n];
+        if (b == 0x26 || b == 0x2e || b == 0x36 || b == 0x3e ||
+            b == 0x64 || b == 0x65 || b == 0x66 || b == 0x67 ||
+            b == 0xf0 || b == 0xf2 || b == 0xf3 ||
+            (!s_f32Bit && (b & 0xf0) == 0x40)) {
+            n++;
+            continue;
+        }
+        break;
+    }
+    if (n + 1 >= cb) {
+        return CLASS_LEGACY;
+    }
+
+    BYTE b0 = pb[n];
+    BYTE b1 = pb[n + 1];
+    BOOL fModeOk = !s_f32Bit || (b1 & 0xc0) == 0xc0;
+
+    if ((b0 == 0xc4 || b0 == 0xc5) && fModeOk) {
+        return CLASS_VEX;
+    }
+    if (b0 == 0x62 && fModeOk) {
+        return CLASS_EVEX;
+    }
+    if (b0 == 0xd5 && !s_f32Bit) {
+        return CLASS_REX2;
+    }
+    if (b0 == 0x8f && (b1 & 0x1f) >= 8) {
+        return CLASS_XOP;
+    }
+    return CLASS_LEGACY;
+}
+
+static int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static BOOL LoadCorpus(const char *pszFile, CORPUS& corpus)
+{
+    FILE *pFile = fopen(pszFile, "r");
+    if (pFile == NULL) {
+        printf("disolfuzz: Could not read %s.\n", pszFile);
+        return FALSE;
+    }
+
+    char szLine[1024];
+    ULONG nLine = 0;
+    while (fgets(szLine, sizeof(szLine), pFile) != NULL) {
+        BYTE rbInstruction[MAX_INSTRUCTION];
+        ULONG cbInstruction = 0;
+        const char *psz = szLine;
+
+        nLine++;
+        for (;;) {
+            while (*psz == ' ' || *psz == '\t') {
+                psz++;
+            }
+            int hi = HexDigit(psz[0]);
+            int lo = (hi >= 0) ? HexDigit(psz[1]) : -1;
+            if (lo < 0) {
+                break;
+            }
+            if (cbInstruction == MAX_INSTRUCTION) {
+                cbInstruction = 0;
+                break;
+            }
+            rbInstruction[cbInstruction++] = (BYTE)((hi << 4) | lo);
+            psz += 2;
+        }
+        if (cbInstruction == 0) {
+            continue;   // Blank, comment or overlong line.
+        }
+
+        std::string text;
+        const char *pszHash = strchr(psz, '#');
+        if (pszHash != NULL) {
+            text = pszHash + 1;
+            while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+                text.pop_back();
+            }
+        }
+
+        // Fill the readahead with int3 so that a decoder that runs long
+        // sees neither a valid continuation nor the next instruction.
+        size_t nSlot = corpus.rbSlots.size();
+        corpus.rbSlots.resize(nSlot + SLOT_SIZE, 0xcc);
+        memcpy(&corpus.rbSlots[nSlot], rbInstruction, cbInstruction);
+        corpus.rcbExpected.push_back((BYTE)cbInstruction);
+        corpus.rText.push_back(text);
+    }
+    fclose(pFile);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static ULONG Measure(PF_COPY_INSTRUCTION pfCopy, PBYTE pbSlot)
+{
+    PVOID pTarget = NULL;
+    LONG lExtra = 0;
+    PBYTE pbNext = (PBYTE)pfCopy(NULL, NULL, pbSlot, &pTarget, &lExtra);
+    if (pbNext == NULL || pbNext < pbSlot) {
+        return 0;
+    }
+    return (ULONG)(pbNext - pbSlot);
+}
+
+static int Compare(PF_COPY_INSTRUCTION pfCopy, CORPUS& corpus, ULONG nIterations)
+{
+    ULONGLONG rnTotal[CLASS_COUNT] = { 0 };
+    ULONGLONG rnWrong[CLASS_COUNT] = { 0 };
+    size_t nInstructions = corpus.rcbExpected.size();
+
+    for (size_t n = 0; n < nInstructions; n++) {
+        PBYTE pbSlot = &corpus.rbSlots[n * SLOT_SIZE];
+        ULONG cbExpected = corpus.rcbExpected[n];
+        ULONG cbActual = Measure(pfCopy, pbSlot);
+        CLASS nClass = Classify(pbSlot, cbExpected);
+
+        rnTotal[nClass]++;
+        if (cbActual != cbExpected) {
+            rnWrong[nClass]++;
+            if (s_fVerbose) {
+                printf("  %-6s", s_rpszClass[nClass]);
+                for (ULONG i = 0; i < cbExpected; i++) {
+                    printf(" %02x", pbSlot[i]);
+                }
+                printf(" : expected %u, got %u #%s\n",
+                       cbExpected, cbActual, corpus.rText[n].c_str());
+            }
+        }
+    }
+
+    ULONGLONG nDecoded = 0;
+    auto tStart = std::chrono::steady_clock::now();
+    for (ULONG i = 0; i < nIterations; i++) {
+        for (size_t n = 0; n < nInstructions; n++) {
+            nDecoded += Measure(pfCopy, &corpus.rbSlots[n * SLOT_SIZE]) != 0;
+        }
+    }
+    std::chrono::duration<double> dElapsed = std::chrono::steady_clock::now() - tStart;
+    double dSeconds = dElapsed.count() > 0 ? dElapsed.count() : 1e-9;
+
+    ULONGLONG nAll = 0;
+    ULONGLONG nAllWrong = 0;
+    printf("%-8s %10s %10s %9s\n", "class", "count", "mismatch", "rate");
+    for (ULONG c = 0; c < CLASS_COUNT; c++) {
+        if (rnTotal[c] == 0) {
+            continue;
+        }
+        printf("%-8s %10llu %10llu %8.3f%%\n", s_rpszClass[c],
+               (unsigned long long)rnTotal[c], (unsigned long long)rnWrong[c],
+               100.0 * rnWrong[c] / rnTotal[c]);
+        nAll += rnTotal[c];
+        nAllWrong += rnWrong[c];
+    }
+    printf("%-8s %10llu %10llu %8.3f%%\n", "total",
+           (unsigned long long)nAll, (unsigned long long)nAllWrong,
+           nAll ? 100.0 * nAllWrong / nAll : 0.0);
+    printf("decoded %llu instructions in %.3f seconds, %.2f Minst/sec\n",
+           (unsigned long long)nDecoded, dSeconds, nDecoded / dSeconds / 1e6);
+
+    return nAllWrong ? 2 : 0;
+}
+
+//////////////////////////////////////////////////////////////// Generator.
+//
+//  Each candidate is an optional run of legacy prefixes, an encoding
+//  chosen by class, an opcode, ModR/M, SIB and enough random bytes for the
+//  largest displacement and immediate.  The tail bytes simply become the
+//  start of the next instructions when the stream is disassembled.
+//
+static void Generate(FILE *pOut, ULONG nCount, ULONG nSeed)
+{
+    std::mt19937 rng(nSeed);
+    std::vector<BYTE> rb;
+
+    auto byte = [&]() { return (BYTE)(rng() & 0xff); };
+    static const BYTE rbPrefixes[] = { 0x66, 0x67, 0xf2, 0xf3, 0x2e, 0x3e, 0x64, 0x65, 0xf0 };
+
+    for (ULONG n = 0; n < nCount; n++) {
+        ULONG nPick = rng() % 100;
+
+        if (rng() % 4 == 0) {
+            rb.push_back(rbPrefixes[rng() % ARRAYSIZE(rbPrefixes)]);
+        }
+
+        if (nPick < 25) {                       // Legacy one-byte or 0F map.
+            if (!s_f32Bit && rng() % 3 == 0) {
+                rb.push_back((BYTE)(0x40 | (rng() & 0xf)));
+            }
+            if (rng() % 2) {
+                rb.push_back(0x0f);
+                ULONG nMap = rng() % 8;
+                if (nMap == 0) {
+                    rb.push_back(0x38);
+                }
+                else if (nMap == 1) {
+                    rb.push_back(0x3a);
+                }
+            }
+            rb.push_back(byte());
+        }
+        else if (nPick < 45) {                  // VEX.
+            if (rng() % 2) {
+                rb.push_back(0xc5);
+                rb.push_back((BYTE)(byte() | (s_f32Bit ? 0xc0 : 0)));
+            }
+            else {
+                static const BYTE rbMaps[] = { 1, 2, 3, 7 };
+                rb.push_back(0xc4);
+                rb.push_back((BYTE)((byte() & 0xe0) | rbMaps[rng() % ARRAYSIZE(rbMaps)] |
+                                    (s_f32Bit ? 0xc0 : 0)));
+                rb.push_back(byte());
+            }
+            rb.push_back(byte());
+        }
+        else if (nPick < 75) {                  // EVEX.
+            static const BYTE rbMaps[] = { 1, 2, 3, 5, 6 };
+            rb.push_back(0x62);
+            rb.push_back((BYTE)((byte() & 0xf0) | rbMaps[rng() % ARRAYSIZE(rbMaps)] |
+                                (s_f32Bit ? 0xc0 : 0)));
+            rb.push_back((BYTE)(byte() | 0x04));
+            rb.push_back(byte());
+            rb.push_back(byte());
+        }
+        else if (nPick < 85 && !s_f32Bit) {     // REX2.
+            rb.push_back(0xd5);
+            rb.push_back(byte());
+            rb.push_back(byte());
+        }
+        else {                                  // XOP.
+            static const BYTE rbMaps[] = { 8, 9, 10 };
+            rb.push_back(0x8f);
+            rb.push_back((BYTE)((byte() & 0xe0) | rbMaps[rng() % ARRAYSIZE(rbMaps)]));
+            rb.push_back((BYTE)(byte() & 0xfc));
+            rb.push_back(byte());
+        }
+
+        // ModR/M, SIB, displacement and immediate.
+        ULONG cbTail = 2 + rng() % 9;
+        for (ULONG i = 0; i < cbTail; i++) {
+            rb.push_back(byte());
+        }
+    }
+    fwrite(&rb[0], 1, rb.size(), pOut);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    disolfuzz [options] corpus...\n"
+           "    disolfuzz -g:count [-s:seed] [-o:file]\n"
+           "Options:\n"
+           "    -32            Test the x86 disassembler (default x64).\n"
+           "    -n:count       Decode the corpus count times for timing (default 10).\n"
+           "    -v             Verbose; list every mismatch.\n"
+           "    -g:count       Generate count random candidates instead.\n"
+           "    -s:seed        Random seed for -g (default 1).\n"
+           "    -o:file        Output file for -g (default stdout).\n"
+           "    -?             This help screen.\n");
+}
+
+static BOOL IsOption(const char *pszArg)
+{
+#ifdef DETOURS_OFFLINE_PORTABLE
+    return pszArg[0] == '-';    // '/' starts a path.
+#else
+    return pszArg[0] == '-' || pszArg[0] == '/';
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    ULONG nIterations = 10;
+    ULONG nGenerate = 0;
+    ULONG nSeed = 1;
+    const char *pszOut = NULL;
+    CORPUS corpus;
+    ULONG nFiles = 0;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (IsOption(argv[arg])) {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case '3':
+                s_f32Bit = TRUE;
+                break;
+              case 'g':
+              case 'G':
+                nGenerate = strtoul(argp, NULL, 0);
+                break;
+              case 'n':
+              case 'N':
+                nIterations = strtoul(argp, NULL, 0);
+                break;
+              case 'o':
+              case 'O':
+                pszOut = argp;
+                break;
+              case 's':
+              case 'S':
+                nSeed = strtoul(argp, NULL, 0);
+                break;
+              case 'v':
+              case 'V':
+                s_fVerbose = TRUE;
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("disolfuzz: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+            continue;
+        }
+        if (LoadCorpus(argv[arg], corpus)) {
+            nFiles++;
+        }
+    }
+
+    if (nGenerate != 0) {
+        FILE *pOut = stdout;
+        if (pszOut != NULL && (pOut = fopen(pszOut, "wb")) == NULL) {
+            printf("disolfuzz: Could not create %s.\n", pszOut);
+            return 1;
+        }
+        Generate(pOut, nGenerate, nSeed);
+        if (pOut != stdout) {
+            fclose(pOut);
+        }
+        return 0;
+    }
+
+    if (nFiles == 0 || corpus.rcbExpected.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    return Compare(s_f32Bit ? DetourCopyInstructionX86 : DetourCopyInstructionX64,
+                   corpus, nIterations);
+}
+
+///////////////////////////////////////////////////////////////// End of File.
@@ -0,0 +1,523 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: disolperf.cpp (disolperf.exe - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Measures the offline disassemblers over the code sections of PE files.
+//  Every executable section is decoded once per iteration with
+//  DetourCopyInstruction##x and with DetourDecodeInstructions##x, and the
+//  totals are reported per architecture as instructions/sec and MB/sec.
+//  Each file is mapped as an image and named with DetourSetCodeModule##x,
+//  so the indirect jump slots read while decoding stay within its copy.
+//
+//  Before timing, the x86 and x64 batch decoders are checked on branches
+//  in the last 64 bytes of a buffer, which they decode from a padded copy.
+//  With no files, only the checks are run.
+//
+//  Builds with nmake on Windows and with GNU make (libdisol.a) on Linux.
+//
+
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include <disol.h>
+#else
+#define DETOURS_INTERNAL
+#include <detours.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+typedef PVOID (WINAPI *PF_COPY_INSTRUCTION)(PVOID pDst,
+                                            PVOID *ppDstPool,
+                                            PVOID pSrc,
+                                            PVOID *ppTarget,
+                                            LONG *plExtra);
+
+typedef ULONG (WINAPI *PF_DECODE_INSTRUCTIONS)(PVOID pCode,
+                                               ULONG cbCode,
+                                               PDETOUR_INSTRUCTION pInstructions,
+                                               ULONG cMaxInstructions,
+                                               ULONG *pcbDecoded);
+
+typedef BOOL (WINAPI *PF_SET_CODE_MODULE)(HMODULE hModule,
+                                          BOOL fLimitReferencesToModule);
+
+struct IMAGE
+{
+    std::vector<BYTE>       rbImage;    // Sections at their virtual addresses.
+    std::vector<ULONG>      rnSection;  // RVA of each code section.
+    std::vector<ULONG>      rcbSection; // Length of each code section.
+};
+
+struct ARCH
+{
+    WORD                    wMachine;
+    const char *            pszName;
+    PF_COPY_INSTRUCTION     pfCopy;
+    PF_DECODE_INSTRUCTIONS  pfDecode;
+    PF_SET_CODE_MODULE      pfSetCodeModule;
+
+    std::vector<IMAGE>      rImages;
+};
+
+static ARCH s_rArchs[] = {
+    { 0x014c, "x86",   DetourCopyInstructionX86,   DetourDecodeInstructionsX86,
+      DetourSetCodeModuleX86,   {} },
+    { 0x8664, "x64",   DetourCopyInstructionX64,   DetourDecodeInstructionsX64,
+      DetourSetCodeModuleX64,   {} },
+    { 0x01c4, "arm",   DetourCopyInstructionARM,   DetourDecodeInstructionsARM,
+      DetourSetCodeModuleARM,   {} },
+    { 0xaa64, "arm64", DetourCopyInstructionARM64, DetourDecodeInstructionsARM64,
+      DetourSetCodeModuleARM64, {} },
+};
+
+static BOOL s_fVerbose = FALSE;
+
+//////////////////////////////////////////////////////////////// PE Parsing.
+//
+//  The headers are read by offset so that no Win32 structure definitions
+//  are needed on other hosts.
+//
+static BOOL ReadField(const std::vector<BYTE>& rbFile, ULONG nOffset, PVOID pv, ULONG cb)
+{
+    if ((ULONGLONG)nOffset + cb > rbFile.size()) {
+        return FALSE;
+    }
+    memcpy(pv, &rbFile[nOffset], cb);
+    return TRUE;
+}
+
+static BOOL LoadFile(const char *pszFile, std::vector<BYTE>& rbFile)
+{
+    FILE *pFile = fopen(pszFile, "rb");
+    if (pFile == NULL) {
+        return FALSE;
+    }
+
+    BYTE rbBuffer[65536];
+    size_t cbRead;
+    while ((cbRead = fread(rbBuffer, 1, sizeof(rbBuffer), pFile)) > 0) {
+        rbFile.insert(rbFile.end(), rbBuffer, rbBuffer + cbRead);
+    }
+    fclose(pFile);
+    return TRUE;
+}
+
+static BOOL AddCodeSections(const char *pszFile)
+{
+    std::vector<BYTE> rbFile;
+    WORD wMagic = 0;
+    LONG nNtHeader = 0;
+    DWORD dwSignature = 0;
+    WORD wMachine = 0;
+    WORD nSections = 0;
+    WORD cbOptionalHeader = 0;
+    DWORD cbImage = 0;
+    DWORD cbHeaders = 0;
+
+    if (!LoadFile(pszFile, rbFile)) {
+        printf("disolperf: Could not read %s.\n", pszFile);
+        return FALSE;
+    }
+
+    if (!ReadField(rbFile, 0x00, &wMagic, sizeof(wMagic)) || wMagic != 0x5a4d ||
+        !ReadField(rbFile, 0x3c, &nNtHeader, sizeof(nNtHeader)) || nNtHeader < 0 ||
+        !ReadField(rbFile, nNtHeader, &dwSignature, sizeof(dwSignature)) ||
+        dwSignature != 0x00004550) {
+
+        printf("disolperf: %s is not a PE file.\n", pszFile);
+        return FALSE;
+    }
+    ReadField(rbFile, nNtHeader + 4, &wMachine, sizeof(wMachine));
+    ReadField(rbFile, nNtHeader + 6, &nSections, sizeof(nSections));
+    ReadField(rbFile, nNtHeader + 20, &cbOptionalHeader, sizeof(cbOptionalHeader));
+    ReadField(rbFile, nNtHeader + 24 + 56, &cbImage, sizeof(cbImage));
+    ReadField(rbFile, nNtHeader + 24 + 60, &cbHeaders, sizeof(cbHeaders));
+
+    ARCH *pArch = NULL;
+    for (ULONG n = 0; n < ARRAYSIZE(s_rArchs); n++) {
+        if (s_rArchs[n].wMachine == wMachine) {
+            pArch = &s_rArchs[n];
+            break;
+        }
+    }
+    if (pArch == NULL) {
+        printf("disolperf: %s has unsupported machine 0x%04x.\n", pszFile, wMachine);
+        return FALSE;
+    }
+    // DetourSetCodeModule reads the headers of the mapped copy.
+    if (cbImage == 0 || cbImage > 0x40000000 ||
+        (ULONGLONG)nNtHeader + 24 + cbOptionalHeader > cbHeaders ||
+        cbHeaders > cbImage || cbHeaders > rbFile.size()) {
+        printf("disolperf: %s has bad image headers.\n", pszFile);
+        return FALSE;
+    }
+
+    pArch->rImages.push_back(IMAGE());
+    IMAGE& image = pArch->rImages.back();
+    image.rbImage.assign(cbImage, 0);
+    memcpy(&image.rbImage[0], &rbFile[0], cbHeaders);
+
+    ULONG nSection = nNtHeader + 24 + cbOptionalHeader;
+    for (ULONG n = 0; n < nSections; n++, nSection += 40) {
+        CHAR szName[9] = { 0 };
+        DWORD cbVirtual = 0;
+        DWORD nRva = 0;
+        DWORD cbRaw = 0;
+        DWORD nRaw = 0;
+        DWORD dwCharacteristics = 0;
+
+        if (!ReadField(rbFile, nSection, szName, 8) ||
+            !ReadField(rbFile, nSection + 8, &cbVirtual, sizeof(cbVirtual)) ||
+            !ReadField(rbFile, nSection + 12, &nRva, sizeof(nRva)) ||
+            !ReadField(rbFile, nSection + 16, &cbRaw, sizeof(cbRaw)) ||
+            !ReadField(rbFile, nSection + 20, &nRaw, sizeof(nRaw)) ||
+            !ReadField(rbFile, nSection + 36, &dwCharacteristics, sizeof(dwCharacteristics))) {
+            break;
+        }
+
+        ULONG cbCopy = (cbVirtual != 0 && cbVirtual < cbRaw) ? cbVirtual : cbRaw;
+        if (cbCopy == 0 || (ULONGLONG)nRaw + cbCopy > rbFile.size() ||
+            (ULONGLONG)nRva + cbCopy > cbImage) {
+            continue;
+        }
+        memcpy(&image.rbImage[nRva], &rbFile[nRaw], cbCopy);
+
+        // IMAGE_SCN_CNT_CODE or IMAGE_SCN_MEM_EXECUTE.
+        if ((dwCharacteristics & 0x20000020) == 0) {
+            continue;
+        }
+        if (s_fVerbose) {
+            printf("  %-8s %-8s %8u bytes\n", pArch->pszName, szName, cbCopy);
+        }
+        image.rnSection.push_back(nRva);
+        image.rcbSection.push_back(cbCopy);
+    }
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////// Tail Checks.
+//
+//  The last 64 bytes of a buffer are decoded from a zero-padded copy.  Their
+//  relative targets must be rebased to the original code, absolute targets
+//  kept, and memory-indirect targets reported as dynamic, since the slot of
+//  a jmp [rip+disp] would be located relative to the copy.  The code lives
+//  in a minimal image, and is checked with slot reads limited to the image
+//  and again with them unlimited, the default on Windows.
+//
+#define CHECK_IMAGE     512             // Bytes in the check image.
+#define CHECK_SLOT      0x100           // Offset of the memory-indirect slot.
+#define CHECK_CODE      0x110           // Offset of the code.
+
+static BYTE s_rbCheck[CHECK_IMAGE];
+
+static void InitCheckImage(PBYTE pbValue)
+{
+    LONG nNtHeader = 0x40;
+    WORD cbOptionalHeader = 0xf0;
+    DWORD cbImage = CHECK_IMAGE;
+
+    memset(s_rbCheck, 0, CHECK_CODE);
+    memset(s_rbCheck + CHECK_CODE, 0x90, CHECK_IMAGE - CHECK_CODE);    // NOPs.
+    s_rbCheck[0] = 'M';
+    s_rbCheck[1] = 'Z';
+    memcpy(s_rbCheck + 0x3c, &nNtHeader, sizeof(nNtHeader));
+    memcpy(s_rbCheck + nNtHeader, "PE\0\0", 4);
+    memcpy(s_rbCheck + nNtHeader + 20, &cbOptionalHeader, sizeof(cbOptionalHeader));
+    memcpy(s_rbCheck + nNtHeader + 0x50, &cbImage, sizeof(cbImage));
+    memcpy(s_rbCheck + CHECK_SLOT, &pbValue, sizeof(pbValue));
+}
+
+static BOOL CheckTarget(const char *pszArch, const char *pszWhat,
+                        const DETOUR_INSTRUCTION *pInstructions, ULONG nInstructions,
+                        ULONG nOffset, PVOID pExpected)
+{
+    for (ULONG n = 0; n < nInstructions; n++) {
+        if (pInstructions[n].nOffset == nOffset) {
+            if (pInstructions[n].pTarget != pExpected) {
+                printf("disolperf: %s %s at +%u has target %p, expected %p.\n",
+                       pszArch, pszWhat, nOffset, pInstructions[n].pTarget, pExpected);
+                return FALSE;
+            }
+            return TRUE;
+        }
+    }
+    printf("disolperf: %s %s at +%u was not decoded.\n", pszArch, pszWhat, nOffset);
+    return FALSE;
+}
+
+static BOOL CheckTail(const char *pszArch, BOOL fX64, BOOL fLimit,
+                      PF_DECODE_INSTRUCTIONS pfDecode, PF_SET_CODE_MODULE pfSetCodeModule)
+{
+    DETOUR_INSTRUCTION rInstructions[CHECK_IMAGE];
+    PBYTE pbSlot = s_rbCheck + CHECK_SLOT;
+    PBYTE pbCode = s_rbCheck + CHECK_CODE;
+    ULONG cbCode = CHECK_IMAGE - CHECK_CODE;
+    PBYTE pbValue = (PBYTE)(ULONG_PTR)0x5a5a1234;
+    ULONGLONG qwAbsolute = 0x0000123456789abcull;
+    BOOL fHead = fX64 || sizeof(PVOID) == sizeof(ULONG);
+    ULONG nHead = 0;                    // jmp [slot], decoded in place.
+    ULONG nRelative = cbCode - 40;      // jmp rel32, decoded from the copy.
+    ULONG nAbsolute = nRelative + 5;    // jmpabs imm64 (x64 only).
+    ULONG nIndirect = nAbsolute + 11;   // jmp [slot].
+    LONG lRelative = -(LONG)nRelative;
+    ULONG cbDecoded = 0;
+    BOOL fOk = TRUE;
+
+    InitCheckImage(pbValue);
+
+    // An x86 slot is an absolute 32-bit address, so it can only be read in
+    // place on a 32-bit host.
+    for (ULONG nOffset = fHead ? nHead : nIndirect; nOffset <= nIndirect; nOffset += nIndirect) {
+        LONG lSlot = fX64
+            ? (LONG)(pbSlot - (pbCode + nOffset + 6))
+            : (LONG)(ULONG)(ULONG_PTR)pbSlot;
+        pbCode[nOffset] = 0xff;
+        pbCode[nOffset + 1] = 0x25;
+        memcpy(pbCode + nOffset + 2, &lSlot, sizeof(lSlot));
+    }
+
+    pbCode[nRelative] = 0xe9;
+    memcpy(pbCode + nRelative + 1, &lRelative, sizeof(lRelative));
+
+    if (fX64) {
+        pbCode[nAbsolute] = 0xd5;
+        pbCode[nAbsolute + 1] = 0x00;
+        pbCode[nAbsolute + 2] = 0xa1;
+        memcpy(pbCode + nAbsolute + 3, &qwAbsolute, sizeof(qwAbsolute));
+    }
+
+    pfSetCodeModule(fLimit ? (HMODULE)s_rbCheck : NULL, fLimit);
+    ULONG nDecoded = pfDecode(pbCode, cbCode, rInstructions, ARRAYSIZE(rInstructions), &cbDecoded);
+
+    if (cbDecoded != cbCode) {
+        printf("disolperf: %s decoded %u of %u bytes.\n", pszArch, cbDecoded, cbCode);
+        fOk = FALSE;
+    }
+    if (fHead) {
+        fOk &= CheckTarget(pszArch, "jmp [slot]", rInstructions, nDecoded,
+                           nHead, pbValue);
+    }
+    fOk &= CheckTarget(pszArch, "tail jmp rel32", rInstructions, nDecoded,
+                       nRelative, pbCode + nRelative + 5 + lRelative);
+    if (fX64) {
+        fOk &= CheckTarget(pszArch, "tail jmpabs", rInstructions, nDecoded,
+                           nAbsolute, (PVOID)(ULONG_PTR)qwAbsolute);
+    }
+    fOk &= CheckTarget(pszArch, "tail jmp [slot]", rInstructions, nDecoded,
+                       nIndirect, DETOUR_INSTRUCTION_TARGET_DYNAMIC);
+    return fOk;
+}
+
+//////////////////////////////////////////////////////////////// Benchmarks.
+//
+//  Both loops stop short of the end of each section in the same place, so
+//  the instruction counts match; DetourCopyInstruction alone cannot tell
+//  when it would read past the end of the buffer.
+//
+static ULONGLONG CopyLoop(ARCH *pArch, IMAGE& image, ULONGLONG *pcbDecoded)
+{
+    ULONGLONG nInstructions = 0;
+    PBYTE pbImage = &image.rbImage[0];
+
+    pArch->pfSetCodeModule((HMODULE)pbImage, TRUE);
+    for (size_t s = 0; s < image.rnSection.size(); s++) {
+        PBYTE pbSection = pbImage + image.rnSection[s];
+        PBYTE pbCode = pbSection;
+        PBYTE pbEnd = pbSection + image.rcbSection[s];
+
+        while (pbEnd - pbCode >= 16) {
+            PVOID pTarget = NULL;
+            LONG lExtra = 0;
+            PBYTE pbNext = (PBYTE)pArch->pfCopy(NULL, NULL, pbCode, &pTarget, &lExtra);
+            if (pbNext == NULL || pbNext <= pbCode) {
+                break;
+            }
+            pbCode = pbNext;
+            nInstructions++;
+        }
+        *pcbDecoded += pbCode - pbSection;
+    }
+    return nInstructions;
+}
+
+static ULONGLONG BatchLoop(ARCH *pArch, IMAGE& image, ULONGLONG *pcbDecoded)
+{
+    DETOUR_INSTRUCTION rInstructions[4096];
+    ULONGLONG nInstructions = 0;
+    PBYTE pbImage = &image.rbImage[0];
+
+    pArch->pfSetCodeModule((HMODULE)pbImage, TRUE);
+    for (size_t s = 0; s < image.rnSection.size(); s++) {
+        PBYTE pbSection = pbImage + image.rnSection[s];
+        ULONG cbSection = image.rcbSection[s];
+        ULONG cbLimit = cbSection - 15;
+        ULONG nOffset = 0;
+
+        if (cbSection < 16) {
+            continue;
+        }
+        while (nOffset < cbLimit) {
+            ULONG cbDecoded = 0;
+            ULONG nDecoded = pArch->pfDecode(pbSection + nOffset, cbSection - nOffset,
+                                             rInstructions, ARRAYSIZE(rInstructions),
+                                             &cbDecoded);
+            if (nDecoded == 0) {
+                break;
+            }
+            // Match CopyLoop: count only instructions starting before cbLimit.
+            for (ULONG n = 0; n < nDecoded; n++) {
+                if (nOffset + rInstructions[n].nOffset >= cbLimit) {
+                    cbDecoded = rInstructions[n].nOffset;
+                    break;
+                }
+                nInstructions++;
+            }
+            nOffset += cbDecoded;
+        }
+        *pcbDecoded += nOffset;
+    }
+    return nInstructions;
+}
+
+static void Report(const char *pszArch, const char *pszMode,
+                   ULONGLONG nInstructions, ULONGLONG cbDecoded, double dSeconds)
+{
+    if (dSeconds <= 0) {
+        dSeconds = 1e-9;
+    }
+    printf("%-6s %-6s %12llu %12llu %9.3f %12.2f %10.2f\n",
+           pszArch, pszMode,
+           (unsigned long long)nInstructions, (unsigned long long)cbDecoded,
+           dSeconds,
+           nInstructions / dSeconds / 1e6,
+           cbDecoded / dSeconds / (1024.0 * 1024.0));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    disolperf [options] [pefiles...]\n"
+           "Options:\n"
+           "    -n:count       Decode each file count times (default 10).\n"
+           "    -v             Verbose; list the code sections used.\n"
+           "    -?             This help screen.\n");
+}
+
+static BOOL IsOption(const char *pszArg)
+{
+#ifdef DETOURS_OFFLINE_PORTABLE
+    return pszArg[0] == '-';    // '/' starts a path.
+#else
+    return pszArg[0] == '-' || pszArg[0] == '/';
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    ULONG nIterations = 10;
+    ULONG nFiles = 0;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (IsOption(argv[arg])) {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case 'n':
+              case 'N':
+                nIterations = strtoul(argp, NULL, 0);
+                if (nIterations == 0) {
+                    nIterations = 1;
+                }
+                break;
+              case 'v':
+              case 'V':
+                s_fVerbose = TRUE;
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("disolperf: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (AddCodeSections(argv[arg])) {
+            nFiles++;
+        }
+    }
+
+    // The limited pass runs last, so only the check image is read through
+    // afterwards.
+    for (int pass = 0; pass < 2; pass++) {
+        BOOL fLimit = (pass == 1);
+        if (!CheckTail("x86", FALSE, fLimit, DetourDecodeInstructionsX86, DetourSetCodeModuleX86) ||
+            !CheckTail("x64", TRUE, fLimit, DetourDecodeInstructionsX64, DetourSetCodeModuleX64)) {
+            return 2;
+        }
+    }
+    printf("disolperf: tail checks passed.\n");
+
+    if (nFiles == 0) {
+        return 0;
+    }
+
+    printf("%-6s %-6s %12s %12s %9s %12s %10s\n",
+           "arch", "mode", "instructions", "bytes", "seconds", "Minst/sec", "MB/sec");
+
+    for (ULONG n = 0; n < ARRAYSIZE(s_rArchs); n++) {
+        ARCH *pArch = &s_rArchs[n];
+        if (pArch->rImages.empty()) {
+            continue;
+        }
+
+        ULONGLONG nCopy = 0;
+        ULONGLONG cbCopy = 0;
+        auto tStart = std::chrono::steady_clock::now();
+        for (ULONG i = 0; i < nIterations; i++) {
+            for (size_t f = 0; f < pArch->rImages.size(); f++) {
+                nCopy += CopyLoop(pArch, pArch->rImages[f], &cbCopy);
+            }
+        }
+        std::chrono::duration<double> dCopy = std::chrono::steady_clock::now() - tStart;
+
+        ULONGLONG nBatch = 0;
+        ULONGLONG cbBatch = 0;
+        tStart = std::chrono::steady_clock::now();
+        for (ULONG i = 0; i < nIterations; i++) {
+            for (size_t f = 0; f < pArch->rImages.size(); f++) {
+                nBatch += BatchLoop(pArch, pArch->rImages[f], &cbBatch);
+            }
+        }
+        std::chrono::duration<double> dBatch = std::chrono::steady_clock::now() - tStart;
+
+        Report(pArch->pszName, "copy", nCopy, cbCopy, dCopy.count());
+        Report(pArch->pszName, "batch", nBatch, cbBatch, dBatch.count());
+
+        if (nCopy != nBatch) {
+            printf("disolperf: %s instruction counts differ (%llu vs %llu).\n",
+                   pArch->pszName, (unsigned long long)nCopy, (unsigned long long)nBatch);
+            return 2;
+        }
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////// End of File.
@@ -0,0 +1,681 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: expperf.cpp (expperf - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Checks and times the export index (src/expindex.cpp).  Each image is
+//  read twice: once with a plain walk of its export tables, which is taken
+//  as the truth, and once through DetourCreateExportIndex.  Every name,
+//  every ordinal and every forwarder must match, and altered names must
+//  miss.
+//
+//  The timings compare a batch of DetourFindExports against a linear
+//  search of the name table (as DetourEnumerateExports callers do) and a
+//  binary search of the sorted name table (as GetProcAddress does).
+//
+//  With no files, a synthesized image is used: API-like names, ordinal-only
+//  exports, forwarders and unused ordinals, laid out both as a file and as
+//  a mapped image.
+//
+//  Builds with GNU make (libdisol.a) on Linux.
+//
+
+#include <disol.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static BOOL s_fVerbose = FALSE;
+static ULONG s_nRounds = 20;
+
+struct EXPORT
+{
+    ULONG           nOrdinal;
+    ULONG           nRva;               // 0 if forwarded or unused.
+    std::string     strName;            // First name, if any.
+    std::string     strForward;
+};
+
+struct NAME
+{
+    std::string     strName;
+    ULONG           nOrdinal;
+};
+
+struct EXPORTS
+{
+    std::vector<EXPORT> rExports;       // By ordinal.
+    std::vector<NAME>   rNames;         // In name table order.
+};
+
+////////////////////////////////////////////////////////// Reference Reader.
+//
+//  A deliberately simple walk of the export tables, sharing no code with
+//  the index.
+//
+struct READER
+{
+    const std::vector<BYTE> *   prbImage;
+    BOOL                        fMapped;
+    ULONG                       nSections;
+    ULONG                       cSections;
+    ULONG                       cbHeaders;
+};
+
+template <class T> static BOOL ReadAt(const READER& r, ULONGLONG nOffset, T *pValue)
+{
+    if (nOffset + sizeof(T) > r.prbImage->size()) {
+        return FALSE;
+    }
+    memcpy(pValue, &(*r.prbImage)[(size_t)nOffset], sizeof(T));
+    return TRUE;
+}
+
+static BOOL RvaToOffset(const READER& r, ULONG nRva, ULONGLONG *pnOffset)
+{
+    if (r.fMapped || nRva < r.cbHeaders) {
+        *pnOffset = nRva;
+        return nRva < r.prbImage->size();
+    }
+    for (ULONG n = 0; n < r.cSections; n++) {
+        ULONG nSection = r.nSections + n * 40;
+        ULONG nVirtual = 0;
+        ULONG cbRaw = 0;
+        ULONG nRaw = 0;
+        if (!ReadAt(r, nSection + 12, &nVirtual) ||
+            !ReadAt(r, nSection + 16, &cbRaw) ||
+            !ReadAt(r, nSection + 20, &nRaw)) {
+            return FALSE;
+        }
+        if (nRva >= nVirtual && nRva < nVirtual + cbRaw) {
+            *pnOffset = (ULONGLONG)nRaw + (nRva - nVirtual);
+            return *pnOffset < r.prbImage->size();
+        }
+    }
+    return FALSE;
+}
+
+static BOOL ReadString(const READER& r, ULONG nRva, std::string *pstr)
+{
+    ULONGLONG nOffset = 0;
+    if (!RvaToOffset(r, nRva, &nOffset)) {
+        return FALSE;
+    }
+    pstr->clear();
+    for (; nOffset < r.prbImage->size(); nOffset++) {
+        char ch = (char)(*r.prbImage)[(size_t)nOffset];
+        if (ch == '\0') {
+            return TRUE;
+        }
+        *pstr += ch;
+    }
+    return FALSE;
+}
+
+static BOOL ReadExports(const std::vector<BYTE>& rbImage, BOOL fMapped, EXPORTS *pExports)
+{
+    READER r = { &rbImage, fMapped, 0, 0, 0 };
+    LONG nNtHeader = 0;
+    WORD cSections = 0;
+    WORD cbOptional = 0;
+    WORD wMagic = 0;
+
+    if (!ReadAt(r, 0x3c, &nNtHeader) ||
+        !ReadAt(r, nNtHeader + 6, &cSections) ||
+        !ReadAt(r, nNtHeader + 20, &cbOptional) ||
+        !ReadAt(r, nNtHeader + 24, &wMagic) ||
+        !ReadAt(r, nNtHeader + 24 + 60, &r.cbHeaders)) {
+        return FALSE;
+    }
+    r.nSections = nNtHeader + 24 + cbOptional;
+    r.cSections = cSections;
+
+    ULONG nDirectory = nNtHeader + 24 + ((wMagic == 0x20b) ? 112 : 96);
+    ULONG nExportRva = 0;
+    ULONG cbExport = 0;
+    if (!ReadAt(r, nDirectory, &nExportRva) || !ReadAt(r, nDirectory + 4, &cbExport)) {
+        return FALSE;
+    }
+    pExports->rExports.clear();
+    pExports->rNames.clear();
+    if (nExportRva == 0) {
+        return TRUE;
+    }
+
+    ULONGLONG nExport = 0;
+    ULONG nBase = 0, cFunctions = 0, cNames = 0;
+    ULONG nFunctionsRva = 0, nNamesRva = 0, nOrdinalsRva = 0;
+    if (!RvaToOffset(r, nExportRva, &nExport) ||
+        !ReadAt(r, nExport + 16, &nBase) ||
+        !ReadAt(r, nExport + 20, &cFunctions) ||
+        !ReadAt(r, nExport + 24, &cNames) ||
+        !ReadAt(r, nExport + 28, &nFunctionsRva) ||
+        !ReadAt(r, nExport + 32, &nNamesRva) ||
+        !ReadAt(r, nExport + 36, &nOrdinalsRva)) {
+        return FALSE;
+    }
+
+    for (ULONG n = 0; n < cFunctions; n++) {
+        ULONGLONG nOffset = 0;
+        EXPORT e;
+        e.nOrdinal = nBase + n;
+        e.nRva = 0;
+        if (!RvaToOffset(r, nFunctionsRva + n * 4, &nOffset) || !ReadAt(r, nOffset, &e.nRva)) {
+            return FALSE;
+        }
+        if (e.nRva >= nExportRva && e.nRva < nExportRva + cbExport) {
+            ReadString(r, e.nRva, &e.strForward);
+            e.nRva = 0;
+        }
+        pExports->rExports.push_back(e);
+    }
+
+    for (ULONG n = 0; n < cNames; n++) {
+        ULONGLONG nOffset = 0;
+        ULONG nRva = 0;
+        WORD iFunction = 0;
+        NAME name;
+        if (!RvaToOffset(r, nNamesRva + n * 4, &nOffset) || !ReadAt(r, nOffset, &nRva) ||
+            !RvaToOffset(r, nOrdinalsRva + n * 2, &nOffset) || !ReadAt(r, nOffset, &iFunction)) {
+            return FALSE;
+        }
+        if (!ReadString(r, nRva, &name.strName) || iFunction >= cFunctions) {
+            continue;
+        }
+        name.nOrdinal = nBase + iFunction;
+        pExports->rNames.push_back(name);
+        if (pExports->rExports[iFunction].strName.empty()) {
+            pExports->rExports[iFunction].strName = name.strName;
+        }
+    }
+    return TRUE;
+}
+
+///////////////////////////////////////////////////////// Synthesized Image.
+//
+//  One .edata section at RVA 0x1000.  The file form puts the section at
+//  0x400, so the index must translate RVAs through the section table.
+//
+const ULONG SYNTH_HEADERS   = 0x400;
+const ULONG SYNTH_EDATA_RVA = 0x1000;
+const ULONG SYNTH_CODE_RVA  = 0x100000;         // Code RVAs are never read.
+
+static const char *s_rpszVerbs[] = {
+    "Create", "Open", "Close", "Get", "Set", "Query", "Enum", "Delete",
+    "Read", "Write", "Map", "Unmap", "Register", "Notify", "Wait", "Lock",
+};
+static const char *s_rpszNouns[] = {
+    "File", "Process", "Thread", "Event", "Mutex", "Semaphore", "Registry",
+    "Key", "Value", "Window", "Module", "Section", "Token", "Pipe", "Console",
+    "Handle", "Service", "Timer", "Heap", "Fiber", "Job", "Path", "Locale",
+    "Resource", "Atom", "Device", "Volume", "Mailslot", "Environment",
+};
+static const char *s_rpszSuffixes[] = {
+    "", "A", "W", "Ex", "ExA", "ExW", "Information", "Attributes", "Internal",
+};
+
+static ULONG Random(ULONGLONG *pnState)
+{
+    *pnState = *pnState * 6364136223846793005ull + 1442695040888963407ull;
+    return (ULONG)(*pnState >> 33);
+}
+
+static VOID MakeNames(ULONG cNames, std::vector<std::string>& rstrNames)
+{
+    std::set<std::string> seen;
+    ULONGLONG nState = 0x4578706f7274ull;
+
+    rstrNames.clear();
+    while (rstrNames.size() < cNames) {
+        std::string str = s_rpszVerbs[Random(&nState) % ARRAYSIZE(s_rpszVerbs)];
+        str += s_rpszNouns[Random(&nState) % ARRAYSIZE(s_rpszNouns)];
+        if (Random(&nState) % 4 == 0) {
+            str += s_rpszNouns[Random(&nState) % ARRAYSIZE(s_rpszNouns)];
+        }
+        str += s_rpszSuffixes[Random(&nState) % ARRAYSIZE(s_rpszSuffixes)];
+        if (seen.count(str) != 0) {
+            char szNumber[16];
+            sprintf(szNumber, "%u", (unsigned)rstrNames.size());
+            str += szNumber;
+        }
+        seen.insert(str);
+        rstrNames.push_back(str);
+    }
+}
+
+template <class T> static VOID Put(std::vector<BYTE>& rb, size_t nOffset, T value)
+{
+    memcpy(&rb[nOffset], &value, sizeof(T));
+}
+
+static VOID MakeImage(ULONG cNames, BOOL fMapped, std::vector<BYTE>& rbImage)
+{
+    std::vector<std::string> rstrNames;
+    MakeNames(cNames, rstrNames);
+
+    // Every 16th function has no name, every 23rd forwards and every 61st
+    // is unused.  Names are assigned to the remaining functions in order.
+    ULONG cFunctions = 0;
+    for (ULONG cNamed = 0; cNamed < cNames; cFunctions++) {
+        if (cFunctions % 16 != 15 && cFunctions % 61 != 60) {
+            cNamed++;
+        }
+    }
+
+    std::vector<ULONG> rnFunctions(cFunctions, 0);
+    std::vector<std::string> rstrForwards(cFunctions);
+    std::vector<std::pair<std::string, WORD> > rNames;
+    for (ULONG n = 0, iName = 0; n < cFunctions; n++) {
+        if (n % 61 == 60) {
+            continue;
+        }
+        if (n % 23 == 22) {
+            rstrForwards[n] = "NTDLL.Rtl" + std::to_string(n);
+        }
+        else {
+            rnFunctions[n] = SYNTH_CODE_RVA + n * 16;
+        }
+        if (n % 16 != 15) {
+            rNames.push_back(std::make_pair(rstrNames[iName++], (WORD)n));
+        }
+    }
+    std::sort(rNames.begin(), rNames.end());
+
+    // Directory, functions, names, ordinals, then the strings.
+    ULONG nFunctions = 40;
+    ULONG nNames = nFunctions + cFunctions * 4;
+    ULONG nOrdinals = nNames + (ULONG)rNames.size() * 4;
+    ULONG nStrings = (nOrdinals + (ULONG)rNames.size() * 2 + 3) & ~3u;
+    std::string strings = "SYNTH.DLL";
+    strings += '\0';
+    std::vector<BYTE> rbEdata(nStrings);
+
+    for (size_t n = 0; n < rNames.size(); n++) {
+        Put(rbEdata, nNames + n * 4, (ULONG)(SYNTH_EDATA_RVA + nStrings + strings.size()));
+        Put(rbEdata, nOrdinals + n * 2, rNames[n].second);
+        strings += rNames[n].first;
+        strings += '\0';
+    }
+    for (ULONG n = 0; n < cFunctions; n++) {
+        if (!rstrForwards[n].empty()) {
+            rnFunctions[n] = SYNTH_EDATA_RVA + nStrings + (ULONG)strings.size();
+            strings += rstrForwards[n];
+            strings += '\0';
+        }
+        Put(rbEdata, nFunctions + n * 4, rnFunctions[n]);
+    }
+    rbEdata.insert(rbEdata.end(), strings.begin(), strings.end());
+
+    Put(rbEdata, 12, (ULONG)(SYNTH_EDATA_RVA + nStrings));      // Name
+    Put(rbEdata, 16, (ULONG)1);                                 // Base
+    Put(rbEdata, 20, cFunctions);
+    Put(rbEdata, 24, (ULONG)rNames.size());
+    Put(rbEdata, 28, SYNTH_EDATA_RVA + nFunctions);
+    Put(rbEdata, 32, SYNTH_EDATA_RVA + nNames);
+    Put(rbEdata, 36, SYNTH_EDATA_RVA + nOrdinals);
+
+    ULONG cbEdata = (ULONG)rbEdata.size();
+    ULONG nEdata = fMapped ? SYNTH_EDATA_RVA : SYNTH_HEADERS;
+    rbImage.assign(nEdata + cbEdata, 0);
+
+    const ULONG nNtHeader = 0x40;
+    const ULONG nOptional = nNtHeader + 24;
+    const ULONG nSection = nOptional + 240;
+    Put(rbImage, 0x00, (WORD)0x5a4d);
+    Put(rbImage, 0x3c, nNtHeader);
+    Put(rbImage, nNtHeader, (ULONG)0x00004550);
+    Put(rbImage, nNtHeader + 4, (WORD)0x8664);
+    Put(rbImage, nNtHeader + 6, (WORD)1);
+    Put(rbImage, nNtHeader + 20, (WORD)240);
+    Put(rbImage, nOptional, (WORD)0x20b);
+    Put(rbImage, nOptional + 60, SYNTH_HEADERS);
+    Put(rbImage, nOptional + 108, (ULONG)16);
+    Put(rbImage, nOptional + 112, SYNTH_EDATA_RVA);
+    Put(rbImage, nOptional + 116, cbEdata);
+    memcpy(&rbImage[nSection], ".edata", 6);
+    Put(rbImage, nSection + 8, cbEdata);
+    Put(rbImage, nSection + 12, SYNTH_EDATA_RVA);
+    Put(rbImage, nSection + 16, cbEdata);
+    Put(rbImage, nSection + 20, SYNTH_HEADERS);
+    memcpy(&rbImage[nEdata], &rbEdata[0], cbEdata);
+}
+
+//////////////////////////////////////////////////////////////// Checking.
+//
+static BOOL SameString(LPCSTR psz, const std::string& str)
+{
+    return (psz == NULL) ? str.empty() : (str == psz);
+}
+
+static BOOL CheckExport(const char *pszWhat,
+                        const DETOUR_EXPORT& found,
+                        const EXPORT& expected,
+                        const std::vector<BYTE>& rbImage,
+                        BOOL fMapped)
+{
+    PVOID pvCode = (fMapped && expected.nRva != 0)
+        ? (PVOID)(&rbImage[0] + expected.nRva) : NULL;
+
+    if (found.nOrdinal != expected.nOrdinal ||
+        found.nRva != expected.nRva ||
+        !SameString(found.pszForward, expected.strForward) ||
+        found.pvCode != pvCode) {
+        printf("expperf: %s: ordinal %u rva %08x fwd %s, expected %u %08x %s\n",
+               pszWhat, found.nOrdinal, found.nRva,
+               found.pszForward ? found.pszForward : "-",
+               expected.nOrdinal, expected.nRva,
+               expected.strForward.empty() ? "-" : expected.strForward.c_str());
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL Check(PDETOUR_EXPORT_INDEX pIndex,
+                  const EXPORTS& exports,
+                  const std::vector<BYTE>& rbImage,
+                  BOOL fMapped)
+{
+    ULONG nBase = exports.rExports.empty() ? 1 : exports.rExports[0].nOrdinal;
+    std::set<std::string> names;
+    std::vector<const NAME *> rpNames;
+    std::vector<LPCSTR> rpszNames;
+    for (size_t n = 0; n < exports.rNames.size(); n++) {
+        // A repeated name finds its first entry.
+        if (names.insert(exports.rNames[n].strName).second) {
+            rpNames.push_back(&exports.rNames[n]);
+            rpszNames.push_back(exports.rNames[n].strName.c_str());
+        }
+    }
+
+    // Every name, in one batch.
+    std::vector<DETOUR_EXPORT> rFound(rpszNames.size() + 1);
+    ULONG cFound = DetourFindExports(pIndex, rpszNames.data(), (ULONG)rpszNames.size(), rFound.data());
+    if (cFound != rpszNames.size()) {
+        printf("expperf: found %u of %u names.\n", cFound, (ULONG)rpszNames.size());
+        return FALSE;
+    }
+    for (size_t n = 0; n < rpszNames.size(); n++) {
+        const NAME& name = *rpNames[n];
+        const EXPORT& expected = exports.rExports[name.nOrdinal - nBase];
+        if (!SameString(rFound[n].pszName, name.strName) ||
+            !CheckExport(name.strName.c_str(), rFound[n], expected, rbImage, fMapped)) {
+            return FALSE;
+        }
+    }
+
+    // Every ordinal, plus one on each side.
+    for (ULONG nOrdinal = nBase - 1; nOrdinal <= nBase + exports.rExports.size(); nOrdinal++) {
+        DETOUR_EXPORT found;
+        BOOL fFound = DetourFindExportByOrdinal(pIndex, nOrdinal, &found);
+        BOOL fUsed = (nOrdinal >= nBase && nOrdinal - nBase < exports.rExports.size() &&
+                      (exports.rExports[nOrdinal - nBase].nRva != 0 ||
+                       !exports.rExports[nOrdinal - nBase].strForward.empty()));
+        if (fFound != fUsed) {
+            printf("expperf: ordinal %u %s.\n", nOrdinal, fFound ? "should be unused" : "missing");
+            return FALSE;
+        }
+        if (fFound) {
+            const EXPORT& expected = exports.rExports[nOrdinal - nBase];
+            if (!SameString(found.pszName, expected.strName) ||
+                !CheckExport("ordinal", found, expected, rbImage, fMapped)) {
+                return FALSE;
+            }
+        }
+    }
+
+    // Altered names miss.
+    std::vector<std::string> rstrMisses;
+    for (size_t n = 0; n < exports.rNames.size(); n++) {
+        std::string str = exports.rNames[n].strName;
+        rstrMisses.push_back(str + "X");
+        rstrMisses.push_back(str.substr(0, str.size() - 1));
+        str[str.size() / 2] ^= 0x20;
+        rstrMisses.push_back(str);
+    }
+    rstrMisses.push_back("");
+    std::vector<LPCSTR> rpszMisses;
+    for (size_t n = 0; n < rstrMisses.size(); n++) {
+        if (names.count(rstrMisses[n]) == 0) {
+            rpszMisses.push_back(rstrMisses[n].c_str());
+        }
+    }
+    rpszMisses.push_back(NULL);
+    rFound.resize(rpszMisses.size());
+    cFound = DetourFindExports(pIndex, rpszMisses.data(), (ULONG)rpszMisses.size(), rFound.data());
+    if (cFound != 0) {
+        for (size_t n = 0; n < rpszMisses.size(); n++) {
+            if (rFound[n].pszName != NULL) {
+                printf("expperf: %s should miss, found %s.\n", rpszMisses[n], rFound[n].pszName);
+            }
+        }
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////// Timing.
+//
+static double Seconds(std::chrono::steady_clock::time_point tStart)
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - tStart;
+    return d.count();
+}
+
+static BOOL Measure(const char *pszName, const std::vector<BYTE>& rbImage, BOOL fMapped)
+{
+    EXPORTS exports;
+    if (!ReadExports(rbImage, fMapped, &exports)) {
+        printf("expperf: %s: cannot read the export tables.\n", pszName);
+        return FALSE;
+    }
+
+    // Build.
+    PDETOUR_EXPORT_INDEX pIndex = NULL;
+    auto tStart = std::chrono::steady_clock::now();
+    for (ULONG r = 0; r < s_nRounds; r++) {
+        DetourFreeExportIndex(pIndex);
+        pIndex = DetourCreateExportIndex((PVOID)&rbImage[0], rbImage.size(), fMapped);
+        if (pIndex == NULL) {
+            printf("expperf: %s: DetourCreateExportIndex failed: %u\n",
+                   pszName, (ULONG)GetLastError());
+            return FALSE;
+        }
+    }
+    double dBuild = Seconds(tStart) / s_nRounds;
+
+    if (!Check(pIndex, exports, rbImage, fMapped)) {
+        printf("expperf: %s: check failed.\n", pszName);
+        DetourFreeExportIndex(pIndex);
+        return FALSE;
+    }
+
+    // Look up every name, in a shuffled order.
+    std::vector<LPCSTR> rpszNames;
+    for (size_t n = 0; n < exports.rNames.size(); n++) {
+        rpszNames.push_back(exports.rNames[n].strName.c_str());
+    }
+    ULONGLONG nState = 0x5368756666ull;
+    for (size_t n = rpszNames.size(); n > 1; n--) {
+        std::swap(rpszNames[n - 1], rpszNames[Random(&nState) % n]);
+    }
+    ULONG cLookups = (ULONG)rpszNames.size();
+    if (cLookups == 0) {
+        printf("%-24s %6u %6u  (no names)\n", pszName,
+               (ULONG)exports.rExports.size(), 0u);
+        DetourFreeExportIndex(pIndex);
+        return TRUE;
+    }
+
+    std::vector<DETOUR_EXPORT> rFound(cLookups);
+    ULONG cFound = 0;
+    tStart = std::chrono::steady_clock::now();
+    for (ULONG r = 0; r < s_nRounds; r++) {
+        cFound += DetourFindExports(pIndex, rpszNames.data(), cLookups, rFound.data());
+    }
+    double dIndex = Seconds(tStart) / s_nRounds / cLookups;
+
+    // Binary search of the name table, as GetProcAddress.
+    tStart = std::chrono::steady_clock::now();
+    for (ULONG r = 0; r < s_nRounds; r++) {
+        for (ULONG n = 0; n < cLookups; n++) {
+            size_t nLo = 0;
+            size_t nHi = exports.rNames.size();
+            while (nLo < nHi) {
+                size_t nMid = (nLo + nHi) / 2;
+                int c = strcmp(exports.rNames[nMid].strName.c_str(), rpszNames[n]);
+                if (c == 0) {
+                    cFound++;
+                    break;
+                }
+                if (c < 0) {
+                    nLo = nMid + 1;
+                }
+                else {
+                    nHi = nMid;
+                }
+            }
+        }
+    }
+    double dBinary = Seconds(tStart) / s_nRounds / cLookups;
+
+    // Linear search, once; it is quadratic in the names.
+    tStart = std::chrono::steady_clock::now();
+    for (ULONG n = 0; n < cLookups; n++) {
+        for (size_t m = 0; m < exports.rNames.size(); m++) {
+            if (strcmp(exports.rNames[m].strName.c_str(), rpszNames[n]) == 0) {
+                cFound++;
+                break;
+            }
+        }
+    }
+    double dLinear = Seconds(tStart) / cLookups;
+
+    printf("%-24s %6u %6u %10.1f %8.1f %8.1f %8.1f\n",
+           pszName,
+           (ULONG)exports.rExports.size(),
+           cLookups,
+           dBuild * 1e6,
+           dIndex * 1e9,
+           dBinary * 1e9,
+           dLinear * 1e9);
+    if (s_fVerbose) {
+        printf("    %u lookups found\n", cFound);
+    }
+    DetourFreeExportIndex(pIndex);
+    return TRUE;
+}
+
+static BOOL LoadFile(const char *pszFile, std::vector<BYTE>& rbFile)
+{
+    FILE *pFile = fopen(pszFile, "rb");
+    if (pFile == NULL) {
+        return FALSE;
+    }
+
+    BYTE rbBuffer[65536];
+    size_t cbRead;
+    while ((cbRead = fread(rbBuffer, 1, sizeof(rbBuffer), pFile)) > 0) {
+        rbFile.insert(rbFile.end(), rbBuffer, rbBuffer + cbRead);
+    }
+    fclose(pFile);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    expperf [options] [files.dll]\n"
+           "Options:\n"
+           "    -n:count       Names in the synthesized image (default 1600).\n"
+           "    -r:count       Timed rounds (default 20).\n"
+           "    -v             Verbose.\n"
+           "    -?             This help screen.\n"
+           "With no files, a synthesized image is checked as a file and as a\n"
+           "mapped image.\n");
+}
+
+int main(int argc, char **argv)
+{
+    ULONG cNames = 1600;
+    std::vector<const char *> rpszFiles;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (argv[arg][0] == '-') {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case 'n':
+              case 'N':
+                cNames = strtoul(argp, NULL, 0);
+                break;
+              case 'r':
+              case 'R':
+                s_nRounds = strtoul(argp, NULL, 0);
+                break;
+              case 'v':
+              case 'V':
+                s_fVerbose = TRUE;
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("expperf: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+        }
+        else {
+            rpszFiles.push_back(argv[arg]);
+        }
+    }
+
+    if (cNames > 0xf000 || s_nRounds == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    printf("%-24s %6s %6s %10s %8s %8s %8s\n",
+           "image", "funcs", "names", "build us", "index ns", "bsrch ns", "linear ns");
+
+    BOOL fOk = TRUE;
+    if (rpszFiles.empty()) {
+        std::vector<BYTE> rbImage;
+        MakeImage(cNames, FALSE, rbImage);
+        fOk = Measure("synth (file)", rbImage, FALSE) && fOk;
+        MakeImage(cNames, TRUE, rbImage);
+        fOk = Measure("synth (mapped)", rbImage, TRUE) && fOk;
+    }
+    for (size_t n = 0; n < rpszFiles.size(); n++) {
+        std::vector<BYTE> rbFile;
+        if (!LoadFile(rpszFiles[n], rbFile)) {
+            printf("expperf: Cannot read %s\n", rpszFiles[n]);
+            fOk = FALSE;
+            continue;
+        }
+        const char *pszName = strrchr(rpszFiles[n], '/');
+        fOk = Measure(pszName ? pszName + 1 : rpszFiles[n], rbFile, FALSE) && fOk;
+    }
+    return fOk ? 0 : 2;
+}
+
+///////////////////////////////////////////////////////////////// End of File.
@@ -0,0 +1,614 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: imgperf.cpp (imgperf - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Compares the two ways DetourBinaryOpenEx reads a PE file: the default,
+//  which maps the file and parses the headers and imports in place, and
+//  DETOUR_BINARY_OPEN_COPY, which reads the whole file into memory first.
+//
+//  Each mode runs in its own child process, so that its peak RSS can be
+//  measured; "base KB" is the RSS the child starts with.  For every file of the corpus the child opens the image, adds
+//  a byway DLL, writes the result and closes the image, as setdll does.
+//  Afterwards both outputs of every file must be identical, must list the
+//  byway, and must import the same DLLs as the input.
+//
+//  With no files, a corpus of PE32+ images with large code sections and
+//  several import descriptors is synthesized in a temporary directory.
+//
+//  Builds with GNU make (libdisol.a) on Linux.
+//
+
+#include <disol.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static BOOL s_fVerbose = FALSE;
+static ULONG s_nRounds = 3;
+static CHAR s_szByway[] = "trace64.dll";
+
+struct RESULT
+{
+    BOOL            fOk;
+    ULONG           cFiles;             // Files written, over all rounds.
+    double          usElapsed;
+    long            kbMaxRss;
+    long            kbStartRss;         // Inherited from the parent.
+};
+
+static long MaxRss(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+///////////////////////////////////////////////////////////// Synthesized PE.
+//
+//  A PE32+ image with a .text section of cbText bytes and an .idata
+//  section importing cNames functions from each of cDlls DLLs.
+//
+static void Put16(std::vector<BYTE>& rb, size_t nOffset, WORD w)
+{
+    memcpy(&rb[nOffset], &w, sizeof(w));
+}
+
+static void Put32(std::vector<BYTE>& rb, size_t nOffset, DWORD dw)
+{
+    memcpy(&rb[nOffset], &dw, sizeof(dw));
+}
+
+static void Put64(std::vector<BYTE>& rb, size_t nOffset, ULONGLONG qw)
+{
+    memcpy(&rb[nOffset], &qw, sizeof(qw));
+}
+
+static DWORD AlignUp(DWORD n, DWORD a)
+{
+    return (n + a - 1) & ~(a - 1);
+}
+
+static void MakeImage(ULONG nSeed, DWORD cbText, ULONG cDlls, ULONG cNames,
+                      std::vector<BYTE>& rbFile)
+{
+    const DWORD cbHeaders = 0x400;
+    const DWORD cbFileAlign = 0x200;
+    const DWORD cbSectAlign = 0x1000;
+
+    // .idata layout: descriptors, then per DLL its lookup and address
+    // tables, then the hint/name entries and DLL names.
+    DWORD cbDesc = AlignUp((cDlls + 1) * sizeof(IMAGE_IMPORT_DESCRIPTOR), 8);
+    DWORD cbThunks = (cNames + 1) * sizeof(ULONGLONG);
+    DWORD cbStrings = 0;
+    for (ULONG d = 0; d < cDlls; d++) {
+        cbStrings += 16;
+        for (ULONG n = 0; n < cNames; n++) {
+            cbStrings += 2 + 32;
+        }
+    }
+    DWORD cbIdata = cbDesc + cDlls * 2 * cbThunks + cbStrings;
+
+    DWORD rvaText = cbSectAlign;
+    DWORD cbTextRaw = AlignUp(cbText, cbFileAlign);
+    DWORD rvaIdata = rvaText + AlignUp(cbText, cbSectAlign);
+    DWORD cbIdataRaw = AlignUp(cbIdata, cbFileAlign);
+    DWORD nTextRaw = cbHeaders;
+    DWORD nIdataRaw = nTextRaw + cbTextRaw;
+
+    rbFile.assign(nIdataRaw + cbIdataRaw, 0);
+
+    // DOS and NT headers.
+    DWORD nPe = 0x80;
+    Put16(rbFile, 0, IMAGE_DOS_SIGNATURE);
+    Put32(rbFile, offsetof(IMAGE_DOS_HEADER, e_lfanew), nPe);
+
+    IMAGE_NT_HEADERS64 nt;
+    memset(&nt, 0, sizeof(nt));
+    nt.Signature = IMAGE_NT_SIGNATURE;
+    nt.FileHeader.Machine = IMAGE_FILE_MACHINE_AMD64;
+    nt.FileHeader.NumberOfSections = 2;
+    nt.FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER64);
+    nt.FileHeader.Characteristics = 0x0022;
+    nt.OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR64_MAGIC;
+    nt.OptionalHeader.SizeOfCode = cbTextRaw;
+    nt.OptionalHeader.AddressOfEntryPoint = rvaText;
+    nt.OptionalHeader.BaseOfCode = rvaText;
+    nt.OptionalHeader.ImageBase = 0x140000000ull;
+    nt.OptionalHeader.SectionAlignment = cbSectAlign;
+    nt.OptionalHeader.FileAlignment = cbFileAlign;
+    nt.OptionalHeader.MajorOperatingSystemVersion = 6;
+    nt.OptionalHeader.MajorSubsystemVersion = 6;
+    nt.OptionalHeader.SizeOfImage = rvaIdata + AlignUp(cbIdata, cbSectAlign);
+    nt.OptionalHeader.SizeOfHeaders = cbHeaders;
+    nt.OptionalHeader.Subsystem = 3;
+    nt.OptionalHeader.SizeOfStackReserve = 0x100000;
+    nt.OptionalHeader.SizeOfStackCommit = 0x1000;
+    nt.OptionalHeader.SizeOfHeapReserve = 0x100000;
+    nt.OptionalHeader.SizeOfHeapCommit = 0x1000;
+    nt.OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    nt.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress = rvaIdata;
+    nt.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size
+        = (cDlls + 1) * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+    memcpy(&rbFile[nPe], &nt, sizeof(nt));
+
+    IMAGE_SECTION_HEADER rSections[2];
+    memset(rSections, 0, sizeof(rSections));
+    memcpy(rSections[0].Name, ".text", 5);
+    rSections[0].Misc.VirtualSize = cbText;
+    rSections[0].VirtualAddress = rvaText;
+    rSections[0].SizeOfRawData = cbTextRaw;
+    rSections[0].PointerToRawData = nTextRaw;
+    rSections[0].Characteristics = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ;
+    memcpy(rSections[1].Name, ".idata", 6);
+    rSections[1].Misc.VirtualSize = cbIdata;
+    rSections[1].VirtualAddress = rvaIdata;
+    rSections[1].SizeOfRawData = cbIdataRaw;
+    rSections[1].PointerToRawData = nIdataRaw;
+    rSections[1].Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+    memcpy(&rbFile[nPe + sizeof(nt)], rSections, sizeof(rSections));
+
+    // Code: a pseudo-random fill, so that every file differs.
+    ULONG nState = nSeed * 2654435761u + 1;
+    for (DWORD n = 0; n < cbText; n += 4) {
+        nState = nState * 1103515245u + 12345u;
+        Put32(rbFile, nTextRaw + n, nState);
+    }
+
+    // Imports.
+    DWORD nDesc = nIdataRaw;
+    DWORD nThunks = nIdataRaw + cbDesc;
+    DWORD nStrings = nThunks + cDlls * 2 * cbThunks;
+    for (ULONG d = 0; d < cDlls; d++) {
+        DWORD nIlt = nThunks + (2 * d) * cbThunks;
+        DWORD nIat = nIlt + cbThunks;
+        DWORD nName = nStrings;
+        snprintf((char *)&rbFile[nName], 16, "dll%02u_%u.dll", (unsigned)d, (unsigned)(nSeed % 100));
+        nStrings += 16;
+
+        IMAGE_IMPORT_DESCRIPTOR desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.OriginalFirstThunk = rvaIdata + (nIlt - nIdataRaw);
+        desc.Name = rvaIdata + (nName - nIdataRaw);
+        desc.FirstThunk = rvaIdata + (nIat - nIdataRaw);
+        memcpy(&rbFile[nDesc + d * sizeof(desc)], &desc, sizeof(desc));
+
+        for (ULONG n = 0; n < cNames; n++) {
+            DWORD nHint = nStrings;
+            Put16(rbFile, nHint, (WORD)n);
+            snprintf((char *)&rbFile[nHint + 2], 32, "Function%02u_%04u", (unsigned)d, (unsigned)n);
+            nStrings += 2 + 32;
+
+            ULONGLONG rva = rvaIdata + (nHint - nIdataRaw);
+            Put64(rbFile, nIlt + n * sizeof(ULONGLONG), rva);
+            Put64(rbFile, nIat + n * sizeof(ULONGLONG), rva);
+        }
+    }
+}
+
+static BOOL SaveFile(const std::string& strFile, const std::vector<BYTE>& rbFile)
+{
+    FILE *pFile = fopen(strFile.c_str(), "wb");
+    if (pFile == NULL) {
+        return FALSE;
+    }
+    BOOL fOk = fwrite(rbFile.data(), 1, rbFile.size(), pFile) == rbFile.size();
+    return (fclose(pFile) == 0) && fOk;
+}
+
+static BOOL LoadFile(const std::string& strFile, std::vector<BYTE>& rbFile)
+{
+    FILE *pFile = fopen(strFile.c_str(), "rb");
+    if (pFile == NULL) {
+        return FALSE;
+    }
+
+    BYTE rbBuffer[65536];
+    size_t cbRead;
+    rbFile.clear();
+    while ((cbRead = fread(rbBuffer, 1, sizeof(rbBuffer), pFile)) > 0) {
+        rbFile.insert(rbFile.end(), rbBuffer, rbBuffer + cbRead);
+    }
+    fclose(pFile);
+    return TRUE;
+}
+
+// Writes the synthesized corpus from a child process, so that the image
+// buffers do not count against the RSS of either mode.
+static BOOL MakeCorpus(const std::vector<std::string>& rstrFiles, DWORD cbText)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return FALSE;
+    }
+    if (pid == 0) {
+        for (size_t n = 0; n < rstrFiles.size(); n++) {
+            std::vector<BYTE> rbFile;
+            MakeImage((ULONG)n, cbText, 4 + n % 5, 40 + 7 * (n % 11), rbFile);
+            if (!SaveFile(rstrFiles[n], rbFile)) {
+                printf("imgperf: Cannot write %s\n", rstrFiles[n].c_str());
+                fflush(stdout);
+                _exit(1);
+            }
+        }
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+////////////////////////////////////////////////////////////// Edit Callbacks.
+//
+struct IMPORTS
+{
+    ULONG           cBywayFound;
+    std::vector<std::string> rstrFiles;
+};
+
+static BOOL CALLBACK AddBywayCallback(_In_opt_ PVOID pContext,
+                                      _In_opt_ LPCSTR pszFile,
+                                      _Outptr_result_maybenull_ LPCSTR *ppszOutFile)
+{
+    BOOL *pbAddedDll = (BOOL *)pContext;
+    if (!pszFile && !*pbAddedDll) {                     // Add new byway.
+        *pbAddedDll = TRUE;
+        *ppszOutFile = s_szByway;
+    }
+    return TRUE;
+}
+
+static BOOL CALLBACK ListBywayCallback(_In_opt_ PVOID pContext,
+                                       _In_opt_ LPCSTR pszFile,
+                                       _Outptr_result_maybenull_ LPCSTR *ppszOutFile)
+{
+    IMPORTS *pImports = (IMPORTS *)pContext;
+
+    *ppszOutFile = pszFile;
+    if (pszFile && strcmp(pszFile, s_szByway) == 0) {
+        pImports->cBywayFound++;
+    }
+    return TRUE;
+}
+
+static BOOL CALLBACK ListFileCallback(_In_opt_ PVOID pContext,
+                                      _In_ LPCSTR pszOrigFile,
+                                      _In_ LPCSTR pszFile,
+                                      _Outptr_result_maybenull_ LPCSTR *ppszOutFile)
+{
+    IMPORTS *pImports = (IMPORTS *)pContext;
+
+    (void)pszOrigFile;
+    *ppszOutFile = pszFile;
+    pImports->rstrFiles.push_back(pszFile);
+    return TRUE;
+}
+
+static BOOL ListImports(const std::string& strFile, IMPORTS *pImports)
+{
+    int fd = open(strFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return FALSE;
+    }
+    PDETOUR_BINARY pBinary = DetourBinaryOpen(DetourOfflineFileHandle(fd));
+    close(fd);
+    if (pBinary == NULL) {
+        return FALSE;
+    }
+    BOOL fOk = DetourBinaryEditImports(pBinary, pImports,
+                                       ListBywayCallback, ListFileCallback,
+                                       NULL, NULL);
+    DetourBinaryClose(pBinary);
+    return fOk;
+}
+
+////////////////////////////////////////////////////////////////// Benchmark.
+//
+static BOOL SetFile(const std::string& strIn, const std::string& strOut, DWORD dwFlags)
+{
+    int fdIn = open(strIn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fdIn < 0) {
+        printf("imgperf: Cannot open %s: %s\n", strIn.c_str(), strerror(errno));
+        return FALSE;
+    }
+    PDETOUR_BINARY pBinary = DetourBinaryOpenEx(DetourOfflineFileHandle(fdIn), dwFlags);
+    close(fdIn);
+    if (pBinary == NULL) {
+        printf("imgperf: DetourBinaryOpenEx(%s) failed: %u\n",
+               strIn.c_str(), (unsigned)GetLastError());
+        return FALSE;
+    }
+
+    BOOL fOk = TRUE;
+    BOOL bAddedDll = FALSE;
+    if (!DetourBinaryEditImports(pBinary, &bAddedDll,
+                                 AddBywayCallback, NULL, NULL, NULL)) {
+        printf("imgperf: DetourBinaryEditImports(%s) failed: %u\n",
+               strIn.c_str(), (unsigned)GetLastError());
+        fOk = FALSE;
+    }
+
+    int fdOut = open(strOut.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fdOut < 0) {
+        printf("imgperf: Cannot create %s: %s\n", strOut.c_str(), strerror(errno));
+        fOk = FALSE;
+    }
+    else {
+        if (fOk && !DetourBinaryWrite(pBinary, DetourOfflineFileHandle(fdOut))) {
+            printf("imgperf: DetourBinaryWrite(%s) failed: %u\n",
+                   strIn.c_str(), (unsigned)GetLastError());
+            fOk = FALSE;
+        }
+        close(fdOut);
+    }
+
+    DetourBinaryClose(pBinary);
+    return fOk;
+}
+
+static std::string OutputName(const std::string& strDir, const char *pszMode, size_t nFile)
+{
+    char szName[64];
+    snprintf(szName, sizeof(szName), "/%s.%zu.exe", pszMode, nFile);
+    return strDir + szName;
+}
+
+static void RunMode(const std::vector<std::string>& rstrFiles,
+                    const std::string& strDir,
+                    const char *pszMode,
+                    DWORD dwFlags,
+                    RESULT *pResult)
+{
+    pResult->fOk = TRUE;
+    pResult->cFiles = 0;
+    pResult->kbStartRss = MaxRss();
+
+    auto tStart = std::chrono::steady_clock::now();
+    for (ULONG r = 0; r < s_nRounds; r++) {
+        for (size_t n = 0; n < rstrFiles.size(); n++) {
+            if (!SetFile(rstrFiles[n], OutputName(strDir, pszMode, n), dwFlags)) {
+                pResult->fOk = FALSE;
+                continue;
+            }
+            pResult->cFiles++;
+        }
+    }
+    auto tEnd = std::chrono::steady_clock::now();
+
+    pResult->usElapsed = std::chrono::duration<double, std::micro>(tEnd - tStart).count();
+    pResult->kbMaxRss = MaxRss();
+}
+
+// Runs one mode in a child process and returns its result through a pipe.
+static BOOL ForkMode(const std::vector<std::string>& rstrFiles,
+                     const std::string& strDir,
+                     const char *pszMode,
+                     DWORD dwFlags,
+                     RESULT *pResult)
+{
+    int rfd[2];
+    if (pipe(rfd) != 0) {
+        return FALSE;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(rfd[0]);
+        close(rfd[1]);
+        return FALSE;
+    }
+    if (pid == 0) {
+        close(rfd[0]);
+        RESULT result;
+        RunMode(rstrFiles, strDir, pszMode, dwFlags, &result);
+        fflush(stdout);
+        BOOL fSent = write(rfd[1], &result, sizeof(result)) == (ssize_t)sizeof(result);
+        _exit(fSent ? 0 : 1);
+    }
+
+    close(rfd[1]);
+    ssize_t cbRead = read(rfd[0], pResult, sizeof(*pResult));
+    close(rfd[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return cbRead == (ssize_t)sizeof(*pResult) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static BOOL Verify(const std::vector<std::string>& rstrFiles, const std::string& strDir)
+{
+    BOOL fOk = TRUE;
+    for (size_t n = 0; n < rstrFiles.size(); n++) {
+        std::vector<BYTE> rbCopy;
+        std::vector<BYTE> rbMap;
+        std::string strCopy = OutputName(strDir, "copy", n);
+        std::string strMap = OutputName(strDir, "map", n);
+
+        if (!LoadFile(strCopy, rbCopy) || !LoadFile(strMap, rbMap)) {
+            printf("imgperf: %s: missing output.\n", rstrFiles[n].c_str());
+            fOk = FALSE;
+            continue;
+        }
+        if (rbCopy != rbMap) {
+            printf("imgperf: %s: outputs differ.\n", rstrFiles[n].c_str());
+            fOk = FALSE;
+        }
+
+        IMPORTS in = { 0, {} };
+        IMPORTS out = { 0, {} };
+        if (!ListImports(rstrFiles[n], &in) || !ListImports(strMap, &out)) {
+            printf("imgperf: %s: cannot list imports.\n", rstrFiles[n].c_str());
+            fOk = FALSE;
+            continue;
+        }
+        if (out.cBywayFound != in.cBywayFound + 1) {
+            printf("imgperf: %s: %s not added.\n", rstrFiles[n].c_str(), s_szByway);
+            fOk = FALSE;
+        }
+        if (out.rstrFiles != in.rstrFiles) {
+            printf("imgperf: %s: imports changed.\n", rstrFiles[n].c_str());
+            fOk = FALSE;
+        }
+        if (s_fVerbose) {
+            printf("    %-40s %8zu bytes, %zu imports\n",
+                   rstrFiles[n].c_str(), rbMap.size(), out.rstrFiles.size());
+        }
+    }
+    return fOk;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    imgperf [options] [files.exe]\n"
+           "Options:\n"
+           "    -n:count       Files in the synthesized corpus (default 32).\n"
+           "    -k:KB          Code section size of each synthesized file (default 4096).\n"
+           "    -r:count       Passes over the corpus (default 3).\n"
+           "    -v             Verbose.\n"
+           "    -?             This help screen.\n"
+           "With no files, a corpus of PE32+ images is synthesized.\n");
+}
+
+int main(int argc, char **argv)
+{
+    ULONG cSynth = 32;
+    ULONG cbSynthKB = 4096;
+    std::vector<std::string> rstrFiles;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (argv[arg][0] == '-') {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case 'k':
+              case 'K':
+                cbSynthKB = strtoul(argp, NULL, 0);
+                break;
+              case 'n':
+              case 'N':
+                cSynth = strtoul(argp, NULL, 0);
+                break;
+              case 'r':
+              case 'R':
+                s_nRounds = strtoul(argp, NULL, 0);
+                break;
+              case 'v':
+              case 'V':
+                s_fVerbose = TRUE;
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("imgperf: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+        }
+        else {
+            rstrFiles.push_back(argv[arg]);
+        }
+    }
+
+    if (s_nRounds == 0 || cbSynthKB == 0 || cbSynthKB > 256 * 1024 ||
+        (rstrFiles.empty() && cSynth == 0)) {
+        PrintUsage();
+        return 1;
+    }
+
+    char szDir[] = "/tmp/imgperf.XXXXXX";
+    if (mkdtemp(szDir) == NULL) {
+        printf("imgperf: Cannot create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+    std::string strDir = szDir;
+
+    BOOL fOk = TRUE;
+    std::vector<std::string> rstrSynth;
+    if (rstrFiles.empty()) {
+        for (ULONG n = 0; n < cSynth; n++) {
+            rstrSynth.push_back(OutputName(strDir, "synth", n));
+        }
+        rstrFiles = rstrSynth;
+        fOk = MakeCorpus(rstrSynth, cbSynthKB * 1024);
+    }
+
+    ULONGLONG cbCorpus = 0;
+    for (size_t n = 0; n < rstrFiles.size(); n++) {
+        struct stat st;
+        if (stat(rstrFiles[n].c_str(), &st) == 0) {
+            cbCorpus += st.st_size;
+        }
+    }
+    printf("imgperf: %zu files, %.1f MB, %u rounds.\n",
+           rstrFiles.size(), cbCorpus / 1048576.0, (unsigned)s_nRounds);
+    printf("%-8s %8s %10s %10s %10s %10s\n",
+           "mode", "files", "files/sec", "MB/sec", "base KB", "peak KB");
+
+    static const struct { const char *pszMode; DWORD dwFlags; } s_rModes[] = {
+        { "copy",   DETOUR_BINARY_OPEN_COPY },
+        { "map",    0 },
+    };
+    for (size_t m = 0; fOk && m < ARRAYSIZE(s_rModes); m++) {
+        RESULT result;
+        if (!ForkMode(rstrFiles, strDir, s_rModes[m].pszMode, s_rModes[m].dwFlags, &result)) {
+            printf("imgperf: %s: child failed.\n", s_rModes[m].pszMode);
+            fOk = FALSE;
+            break;
+        }
+        double sElapsed = result.usElapsed / 1000000.0;
+        printf("%-8s %8u %10.1f %10.1f %10ld %10ld\n",
+               s_rModes[m].pszMode,
+               (unsigned)result.cFiles,
+               result.cFiles / sElapsed,
+               (cbCorpus * s_nRounds / 1048576.0) / sElapsed,
+               result.kbStartRss,
+               result.kbMaxRss);
+        fOk = result.fOk && fOk;
+    }
+
+    if (fOk) {
+        fOk = Verify(rstrFiles, strDir);
+        printf("imgperf: outputs %s.\n", fOk ? "match" : "DO NOT match");
+    }
+
+    for (size_t n = 0; n < rstrFiles.size(); n++) {
+        unlink(OutputName(strDir, "copy", n).c_str());
+        unlink(OutputName(strDir, "map", n).c_str());
+    }
+    for (size_t n = 0; n < rstrSynth.size(); n++) {
+        unlink(rstrSynth[n].c_str());
+    }
+    rmdir(strDir.c_str());
+
+    return fOk ? 0 : 2;
+}
+
+///////////////////////////////////////////////////////////////// End of File.
@@ -0,0 +1,597 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Module: slabperf.cpp (slabperf - Detours Test Program)
+//
+//  Microsoft Research Detours Package
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Measures the trampoline slab allocator (src/slab.cpp) against the
+//  region list it replaced in detours.cpp.  Both run on the same pages,
+//  which come from mmap instead of VirtualAlloc, and see the same stream
+//  of attach and detach transactions.  Every transaction ends the way
+//  DetourTransactionCommit does, by releasing any empty regions.
+//
+//  Builds with GNU make (libdisol.a) on Linux.
+//
+
+#include <disol.h>
+#include <slab.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <chrono>
+#include <unordered_set>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+const ULONG SLOT_SIZE       = 96;               // sizeof(DETOUR_TRAMPOLINE) on x64.
+const ULONG MODULE_SIZE     = 0x01000000;       // Code spread of each module.
+const ULONG ARENA_SIZE      = 0x10000000;       // Address space for regions.
+
+static BOOL s_fVerbose = FALSE;
+static BOOL s_fShuffle = FALSE;
+
+inline ULONG_PTR Below2gb(ULONG_PTR address)
+{
+    return (address > (ULONG_PTR)0x7ff80000) ? address - 0x7ff80000 : 0x80000;
+}
+
+inline ULONG_PTR Above2gb(ULONG_PTR address)
+{
+#if defined(DETOURS_64BIT)
+    return (address < (ULONG_PTR)0xffffffff80000000) ? address + 0x7ff80000 : (ULONG_PTR)0xfffffffffff80000;
+#else
+    return (address < (ULONG_PTR)0x80000000) ? address + 0x7ff80000 : (ULONG_PTR)0xfff80000;
+#endif
+}
+
+////////////////////////////////////////////////////////////// mmap Pages.
+//
+//  Stands in for VirtualAlloc: one mmap reservation beside the modules is
+//  carved into 64KB regions, so that the timings measure the allocators
+//  rather than the kernel.  Released regions go back on a stack.
+//
+struct PAGES
+{
+    std::vector<PBYTE>  rpbFree;
+    ULONGLONG           cAlloc;
+    ULONGLONG           cFree;
+};
+
+static PBYTE s_pbArena = NULL;
+
+static BOOL ReserveArena(PAGES *pPages)
+{
+    if (s_pbArena == NULL) {
+        PVOID pv = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (pv == MAP_FAILED) {
+            printf("slabperf: mmap failed for the region arena.\n");
+            return FALSE;
+        }
+        s_pbArena = (PBYTE)pv;
+    }
+
+    // The arena is page aligned; use the 64KB aligned regions within it.
+    PBYTE pbBase = (PBYTE)(((ULONG_PTR)s_pbArena + DETOUR_SLAB_REGION_SIZE - 1)
+                           & ~(ULONG_PTR)(DETOUR_SLAB_REGION_SIZE - 1));
+    pPages->rpbFree.clear();
+    for (PBYTE pb = s_pbArena + ARENA_SIZE - DETOUR_SLAB_REGION_SIZE; pb >= pbBase;
+         pb -= DETOUR_SLAB_REGION_SIZE) {
+        pPages->rpbFree.push_back(pb);
+    }
+    pPages->cAlloc = 0;
+    pPages->cFree = 0;
+    return TRUE;
+}
+
+static PVOID MmapAlloc(PVOID pvContext, PBYTE pbTarget, PBYTE pbLo, PBYTE pbHi)
+{
+    PAGES *pPages = (PAGES *)pvContext;
+    (void)pbTarget;
+
+    if (pPages->rpbFree.empty()) {
+        return NULL;
+    }
+    // As in detour_alloc_region_from_lo, only the start of the region need
+    // be within bounds.
+    PBYTE pb = pPages->rpbFree.back();
+    if (pb < pbLo || pb >= pbHi) {
+        return NULL;
+    }
+    pPages->rpbFree.pop_back();
+    pPages->cAlloc++;
+    return pb;
+}
+
+static VOID MmapFree(PVOID pvContext, PVOID pvRegion)
+{
+    PAGES *pPages = (PAGES *)pvContext;
+
+    pPages->cFree++;
+    pPages->rpbFree.push_back((PBYTE)pvRegion);
+}
+
+////////////////////////////////////////////////////////// Region List (Old).
+//
+//  The allocator from detours.cpp before slab.cpp, reduced to its
+//  bookkeeping.  Free slots are linked through their first pointer; a
+//  live slot holds a pointer outside the region, as pbRemain does in a
+//  real trampoline.
+//
+struct LIST_REGION
+{
+    ULONG           dwSignature;
+    LIST_REGION *   pNext;
+    PBYTE           pFree;
+};
+
+const ULONG LIST_SIGNATURE = DETOUR_SLAB_SIGNATURE;
+
+class CListAlloc
+{
+  public:
+    CListAlloc(PAGES *pPages)
+        : m_pPages(pPages), m_pRegions(NULL), m_pRegion(NULL),
+          m_cSlots(DETOUR_SLAB_REGION_SIZE / SLOT_SIZE - 1)
+    {
+    }
+
+    PBYTE Alloc(PBYTE pbTarget, PBYTE pbLo, PBYTE pbHi)
+    {
+        if (m_pRegion == NULL && m_pRegions != NULL) {
+            m_pRegion = m_pRegions;
+        }
+        if (m_pRegion != NULL && m_pRegion->pFree != NULL &&
+            m_pRegion->pFree >= pbLo && m_pRegion->pFree <= pbHi) {
+            return Take(pbTarget);
+        }
+        for (m_pRegion = m_pRegions; m_pRegion != NULL; m_pRegion = m_pRegion->pNext) {
+            if (m_pRegion->pFree != NULL &&
+                m_pRegion->pFree >= pbLo && m_pRegion->pFree <= pbHi) {
+                return Take(pbTarget);
+            }
+        }
+
+        m_pRegion = (LIST_REGION *)MmapAlloc(m_pPages, pbTarget, pbLo, pbHi);
+        if (m_pRegion == NULL) {
+            return NULL;
+        }
+        m_pRegion->dwSignature = LIST_SIGNATURE;
+        m_pRegion->pNext = m_pRegions;
+        m_pRegions = m_pRegion;
+
+        PBYTE pFree = NULL;
+        PBYTE pbSlots = (PBYTE)m_pRegion + SLOT_SIZE;
+        for (LONG i = m_cSlots - 1; i >= 0; i--) {
+            *(PBYTE *)(pbSlots + i * SLOT_SIZE) = pFree;
+            pFree = pbSlots + i * SLOT_SIZE;
+        }
+        m_pRegion->pFree = pFree;
+        return Take(pbTarget);
+    }
+
+    VOID Free(PBYTE pbSlot)
+    {
+        LIST_REGION *pRegion = (LIST_REGION *)
+            ((ULONG_PTR)pbSlot & ~(ULONG_PTR)(DETOUR_SLAB_REGION_SIZE - 1));
+
+        memset(pbSlot, 0, SLOT_SIZE);
+        *(PBYTE *)pbSlot = pRegion->pFree;
+        pRegion->pFree = pbSlot;
+    }
+
+    ULONG FreeEmptyRegions()
+    {
+        LIST_REGION **ppRegionBase = &m_pRegions;
+        LIST_REGION *pRegion = m_pRegions;
+        ULONG cFreed = 0;
+
+        while (pRegion != NULL) {
+            if (IsRegionEmpty(pRegion)) {
+                *ppRegionBase = pRegion->pNext;
+                MmapFree(m_pPages, pRegion);
+                m_pRegion = NULL;
+                cFreed++;
+            }
+            else {
+                ppRegionBase = &pRegion->pNext;
+            }
+            pRegion = *ppRegionBase;
+        }
+        return cFreed;
+    }
+
+  protected:
+    PBYTE Take(PBYTE pbTarget)
+    {
+        PBYTE pbSlot = m_pRegion->pFree;
+        m_pRegion->pFree = *(PBYTE *)pbSlot;
+        memset(pbSlot, 0xcc, SLOT_SIZE);
+        *(PBYTE *)pbSlot = pbTarget;
+        return pbSlot;
+    }
+
+    BOOL IsRegionEmpty(LIST_REGION *pRegion)
+    {
+        if (pRegion->dwSignature != LIST_SIGNATURE) {
+            return FALSE;
+        }
+
+        PBYTE pbRegionBeg = (PBYTE)pRegion;
+        PBYTE pbRegionLim = pbRegionBeg + DETOUR_SLAB_REGION_SIZE;
+        PBYTE pbSlots = pbRegionBeg + SLOT_SIZE;
+        for (ULONG i = 0; i < m_cSlots; i++) {
+            PBYTE pbRemain = *(PBYTE *)(pbSlots + i * SLOT_SIZE);
+            if (pbRemain != NULL && (pbRemain < pbRegionBeg || pbRemain >= pbRegionLim)) {
+                return FALSE;
+            }
+        }
+        return TRUE;
+    }
+
+  protected:
+    PAGES *         m_pPages;
+    LIST_REGION *   m_pRegions;
+    LIST_REGION *   m_pRegion;
+    ULONG           m_cSlots;
+};
+
+/////////////////////////////////////////////////////////////// Slab (New).
+//
+class CSlabAlloc
+{
+  public:
+    CSlabAlloc(PAGES *pPages)
+    {
+        DETOUR_SLAB_PAGES Pages = { MmapAlloc, MmapFree, pPages };
+        detour_slab_init(&m_Slab, SLOT_SIZE, &Pages);
+    }
+
+    PBYTE Alloc(PBYTE pbTarget, PBYTE pbLo, PBYTE pbHi)
+    {
+        PBYTE pbSlot = detour_slab_alloc(&m_Slab, pbTarget, pbLo, pbHi);
+        if (pbSlot != NULL) {
+            memset(pbSlot, 0xcc, SLOT_SIZE);
+            *(PBYTE *)pbSlot = pbTarget;
+        }
+        return pbSlot;
+    }
+
+    VOID Free(PBYTE pbSlot)
+    {
+        memset(pbSlot, 0, SLOT_SIZE);
+        detour_slab_free(&m_Slab, pbSlot);
+    }
+
+    ULONG FreeEmptyRegions()
+    {
+        return detour_slab_free_empty_regions(&m_Slab);
+    }
+
+  protected:
+    DETOUR_SLAB     m_Slab;
+};
+
+//////////////////////////////////////////////////////////////////// Bounds.
+//
+//  A jump bound can fall inside a region.  The slots of the region that are
+//  in reach must still be handed out, without taking another region, and a
+//  new region whose end is past the bound must be kept.
+//
+static BOOL CheckBounds()
+{
+    PAGES pages;
+    if (!ReserveArena(&pages)) {
+        return FALSE;
+    }
+    CSlabAlloc alloc(&pages);
+
+    PBYTE pbRegion = pages.rpbFree.back();
+    PBYTE pbMid = pbRegion + DETOUR_SLAB_REGION_SIZE / 2;
+    PBYTE pbEnd = pbRegion + DETOUR_SLAB_REGION_SIZE;
+
+    // A new region, with the bound in its first half.
+    PBYTE pbLow = alloc.Alloc(pbRegion, pbRegion, pbRegion + 0x1000);
+    if (pbLow == NULL || pbLow < pbRegion || pbLow > pbRegion + 0x1000) {
+        printf("slabperf: bounds: no slot below %p in a new region.\n", pbRegion + 0x1000);
+        return FALSE;
+    }
+
+    // The same region, with a bound through its middle from either side.
+    PBYTE pbBelow = alloc.Alloc(pbRegion, pbRegion, pbMid);
+    PBYTE pbAbove = alloc.Alloc(pbRegion, pbMid, pbEnd);
+    if (pbBelow == NULL || pbBelow < pbRegion || pbBelow > pbMid ||
+        pbAbove == NULL || pbAbove < pbMid || pbAbove >= pbEnd) {
+        printf("slabperf: bounds: no slot on each side of %p.\n", pbMid);
+        return FALSE;
+    }
+    if (pbLow == pbBelow || pages.cAlloc != 1) {
+        printf("slabperf: bounds: %llu regions for three slots.\n",
+               (unsigned long long)pages.cAlloc);
+        return FALSE;
+    }
+
+    alloc.Free(pbLow);
+    alloc.Free(pbBelow);
+    alloc.Free(pbAbove);
+    alloc.FreeEmptyRegions();
+    if (pages.cAlloc != pages.cFree) {
+        printf("slabperf: bounds: region left after freeing its slots.\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/////////////////////////////////////////////////////////////////// Workload.
+//
+struct TARGET
+{
+    PBYTE   pbTarget;
+    PBYTE   pbLo;
+    PBYTE   pbHi;
+    PBYTE   pbSlot;
+};
+
+static BOOL MakeTargets(std::vector<TARGET>& rTargets, ULONG nTargets, ULONG nModules)
+{
+    // Reserve address space for each module so that regions land beside
+    // real mappings, as they would next to loaded DLLs.
+    std::vector<PBYTE> rpbModules;
+    for (ULONG m = 0; m < nModules; m++) {
+        PVOID pv = mmap(NULL, MODULE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (pv == MAP_FAILED) {
+            printf("slabperf: mmap failed for module %u.\n", m);
+            return FALSE;
+        }
+        rpbModules.push_back((PBYTE)pv);
+    }
+
+    srand(1);
+    rTargets.resize(nTargets);
+    for (ULONG n = 0; n < nTargets; n++) {
+        TARGET& t = rTargets[n];
+        ULONG nOffset = ((ULONG)rand() * 16) % MODULE_SIZE;
+        t.pbTarget = rpbModules[n % nModules] + nOffset;
+        t.pbLo = (PBYTE)Below2gb((ULONG_PTR)t.pbTarget);
+        t.pbHi = (PBYTE)Above2gb((ULONG_PTR)t.pbTarget);
+        t.pbSlot = NULL;
+    }
+    return TRUE;
+}
+
+static BOOL Check(const char *pszName, std::vector<TARGET>& rTargets)
+{
+    std::unordered_set<PBYTE> live;
+    for (size_t n = 0; n < rTargets.size(); n++) {
+        TARGET& t = rTargets[n];
+        if (t.pbSlot == NULL) {
+            continue;
+        }
+        if (t.pbSlot < t.pbLo || t.pbSlot > t.pbHi) {
+            printf("slabperf: %s: slot %p out of bounds for %p.\n", pszName, t.pbSlot, t.pbTarget);
+            return FALSE;
+        }
+        if (!live.insert(t.pbSlot).second) {
+            printf("slabperf: %s: slot %p handed out twice.\n", pszName, t.pbSlot);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Attach every target, then detach every target, nPerTransaction at a
+// time.  Detaching in attach order, as generated code does, leaves long
+// runs of free slots ahead of the live ones in each region.
+
+template <class ALLOC>
+static BOOL RunRound(const char *pszName,
+                     ALLOC& alloc,
+                     std::vector<TARGET>& rTargets,
+                     const std::vector<ULONG>& rnDetachOrder,
+                     ULONG nPerTransaction,
+                     BOOL fCheck)
+{
+    ULONG nPending = 0;
+    for (size_t n = 0; n < rTargets.size(); n++) {
+        TARGET& t = rTargets[n];
+        t.pbSlot = alloc.Alloc(t.pbTarget, t.pbLo, t.pbHi);
+        if (t.pbSlot == NULL) {
+            printf("slabperf: %s: no region for %p.\n", pszName, t.pbTarget);
+            return FALSE;
+        }
+        if (++nPending == nPerTransaction) {
+            alloc.FreeEmptyRegions();
+            nPending = 0;
+        }
+    }
+    alloc.FreeEmptyRegions();
+    nPending = 0;
+
+    if (fCheck && !Check(pszName, rTargets)) {
+        return FALSE;
+    }
+
+    for (size_t n = 0; n < rnDetachOrder.size(); n++) {
+        TARGET& t = rTargets[rnDetachOrder[n]];
+        alloc.Free(t.pbSlot);
+        t.pbSlot = NULL;
+        if (++nPending == nPerTransaction) {
+            alloc.FreeEmptyRegions();
+            nPending = 0;
+        }
+    }
+    alloc.FreeEmptyRegions();
+    return TRUE;
+}
+
+template <class ALLOC>
+static BOOL Measure(const char *pszName,
+                    std::vector<TARGET>& rTargets,
+                    const std::vector<ULONG>& rnDetachOrder,
+                    ULONG nPerTransaction,
+                    ULONG nRounds)
+{
+    PAGES pages;
+    if (!ReserveArena(&pages)) {
+        return FALSE;
+    }
+    ALLOC alloc(&pages);
+
+    if (!RunRound(pszName, alloc, rTargets, rnDetachOrder, nPerTransaction, TRUE)) {
+        return FALSE;
+    }
+    if (pages.cAlloc != pages.cFree) {
+        printf("slabperf: %s: %llu regions left after detaching everything.\n",
+               pszName, (unsigned long long)(pages.cAlloc - pages.cFree));
+        return FALSE;
+    }
+    ULONGLONG cRegions = pages.cAlloc;
+
+    auto tStart = std::chrono::steady_clock::now();
+    for (ULONG r = 0; r < nRounds; r++) {
+        RunRound(pszName, alloc, rTargets, rnDetachOrder, nPerTransaction, FALSE);
+    }
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - tStart;
+
+    ULONGLONG nOps = 2ull * rTargets.size() * nRounds;
+    printf("%-5s %8u %10llu %9.3f %10.1f %8llu\n",
+           pszName,
+           nPerTransaction,
+           (unsigned long long)nOps,
+           d.count(),
+           d.count() * 1e9 / (double)nOps,
+           (unsigned long long)cRegions);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static void PrintUsage(void)
+{
+    printf("Usage:\n"
+           "    slabperf [options]\n"
+           "Options:\n"
+           "    -n:count       Targets to attach (default 1600, about all of kernel32).\n"
+           "    -m:count       Modules the targets are spread over (default 8).\n"
+           "    -r:count       Timed rounds of attach and detach (default 10).\n"
+           "    -s             Detach in a shuffled order instead of attach order.\n"
+           "    -t:count       Attaches per transaction; 0 for all in one (default 1).\n"
+           "    -v             Verbose; show the slab geometry.\n"
+           "    -?             This help screen.\n");
+}
+
+int main(int argc, char **argv)
+{
+    ULONG nTargets = 1600;
+    ULONG nModules = 8;
+    ULONG nRounds = 10;
+    ULONG nPerTransaction = 1;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (argv[arg][0] == '-') {
+            CHAR *argn = argv[arg] + 1;
+            CHAR *argp = argn;
+            while (*argp && *argp != ':' && *argp != '=') {
+                argp++;
+            }
+            if (*argp == ':' || *argp == '=') {
+                *argp++ = '\0';
+            }
+
+            switch (argn[0]) {
+              case 'm':
+              case 'M':
+                nModules = strtoul(argp, NULL, 0);
+                break;
+              case 'n':
+              case 'N':
+                nTargets = strtoul(argp, NULL, 0);
+                break;
+              case 'r':
+              case 'R':
+                nRounds = strtoul(argp, NULL, 0);
+                break;
+              case 's':
+              case 'S':
+                s_fShuffle = TRUE;
+                break;
+              case 't':
+              case 'T':
+                nPerTransaction = strtoul(argp, NULL, 0);
+                break;
+              case 'v':
+              case 'V':
+                s_fVerbose = TRUE;
+                break;
+              case '?':
+                PrintUsage();
+                return 0;
+              default:
+                printf("slabperf: Unknown argument: %s\n", argv[arg]);
+                PrintUsage();
+                return 1;
+            }
+        }
+        else {
+            printf("slabperf: Unknown argument: %s\n", argv[arg]);
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (nTargets == 0 || nModules == 0 || nRounds == 0) {
+        PrintUsage();
+        return 1;
+    }
+    if (nPerTransaction == 0 || nPerTransaction > nTargets) {
+        nPerTransaction = nTargets;
+    }
+
+    if (!CheckBounds()) {
+        return 2;
+    }
+
+    // The arena goes first so that the modules are mapped beside it.
+    PAGES pages;
+    if (!ReserveArena(&pages)) {
+        return 2;
+    }
+    std::vector<TARGET> rTargets;
+    if (!MakeTargets(rTargets, nTargets, nModules)) {
+        return 2;
+    }
+    std::vector<ULONG> rnDetachOrder(nTargets);
+    for (ULONG n = 0; n < nTargets; n++) {
+        rnDetachOrder[n] = n;
+    }
+    for (ULONG n = nTargets - 1; s_fShuffle && n > 0; n--) {
+        ULONG j = (ULONG)rand() % (n + 1);
+        ULONG t = rnDetachOrder[n];
+        rnDetachOrder[n] = rnDetachOrder[j];
+        rnDetachOrder[j] = t;
+    }
+
+    if (s_fVerbose) {
+        DETOUR_SLAB_PAGES Pages = { MmapAlloc, MmapFree, NULL };
+        DETOUR_SLAB slab;
+        detour_slab_init(&slab, SLOT_SIZE, &Pages);
+        printf("slot %u bytes, %u slots per region (%u for the header), list %u slots.\n",
+               slab.cbSlot, slab.cSlots, slab.nFirstSlot,
+               DETOUR_SLAB_REGION_SIZE / SLOT_SIZE - 1);
+    }
+
+    printf("%-5s %8s %10s %9s %10s %8s\n",
+           "alloc", "per-txn", "ops", "seconds", "ns/op", "regions");
+
+    if (!Measure<CListAlloc>("list", rTargets, rnDetachOrder, nPerTransaction, nRounds) ||
+        !Measure<CSlabAlloc>("slab", rTargets, rnDetachOrder, nPerTransaction, nRounds)) {
+        return 2;
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////// End of File.
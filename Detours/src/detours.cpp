@@ -11,6 +11,9 @@
 //#define DETOUR_DEBUG 1
 #define DETOURS_INTERNAL
 #include "detours.h"
+#include "slab.h"
+#include "protect.h"
+#include <new>
 
 #if DETOURS_VERSION != 0x4c0c1   // 0xMAJORcMINORcPATCH
 #error detours.h version mismatch
@@ -1155,26 +1158,19 @@ inline ULONG detour_is_code_filler(PBYTE pbCode)
 
 //////////////////////////////////////////////// Trampoline Memory Management.
 //
-struct DETOUR_REGION
-{
-    ULONG               dwSignature;
-    DETOUR_REGION *     pNext;  // Next region in list of regions.
-    DETOUR_TRAMPOLINE * pFree;  // List of free trampolines in this region.
-};
-typedef DETOUR_REGION * PDETOUR_REGION;
-
-const ULONG DETOUR_REGION_SIGNATURE = 'Rrtd';
-const ULONG DETOUR_REGION_SIZE = 0x10000;
-const ULONG DETOUR_TRAMPOLINES_PER_REGION = (DETOUR_REGION_SIZE
-                                             / sizeof(DETOUR_TRAMPOLINE)) - 1;
-static PDETOUR_REGION s_pRegions = NULL;            // List of all regions.
-static PDETOUR_REGION s_pRegion = NULL;             // Default region.
+// Trampolines are kept in 64KB regions by the slab allocator (slab.cpp);
+// this file supplies the pages and the protection changes.
+//
+const ULONG DETOUR_REGION_SIZE = DETOUR_SLAB_REGION_SIZE;
+static DETOUR_SLAB s_Slab;                          // cbSlot == 0 until first use.
+static ULONG s_cProtectCalls = 0;                   // VirtualProtect calls by this transaction.
 
 static DWORD detour_writable_trampoline_regions()
 {
     // Mark all of the regions as writable.
-    for (PDETOUR_REGION pRegion = s_pRegions; pRegion != NULL; pRegion = pRegion->pNext) {
+    for (PDETOUR_SLAB_REGION pRegion = s_Slab.pRegions; pRegion != NULL; pRegion = pRegion->pNext) {
         DWORD dwOld;
+        s_cProtectCalls++;
         if (!VirtualProtect(pRegion, DETOUR_REGION_SIZE, PAGE_EXECUTE_READWRITE, &dwOld)) {
             return GetLastError();
         }
@@ -1187,8 +1183,9 @@ static void detour_runnable_trampoline_regions()
     HANDLE hProcess = GetCurrentProcess();
 
     // Mark all of the regions as executable.
-    for (PDETOUR_REGION pRegion = s_pRegions; pRegion != NULL; pRegion = pRegion->pNext) {
+    for (PDETOUR_SLAB_REGION pRegion = s_Slab.pRegions; pRegion != NULL; pRegion = pRegion->pNext) {
         DWORD dwOld;
+        s_cProtectCalls++;
         VirtualProtect(pRegion, DETOUR_REGION_SIZE, PAGE_EXECUTE_READ, &dwOld);
         FlushInstructionCache(hProcess, pRegion, DETOUR_REGION_SIZE);
     }
@@ -1368,6 +1365,25 @@ PVOID WINAPI DetourAllocateRegionWithinJumpBounds(_In_ LPCVOID pbTarget,
     return pbNewlyAllocated;
 }
 
+static PVOID detour_alloc_region(PVOID pvContext, PBYTE pbTarget, PBYTE pbLo, PBYTE pbHi)
+{
+    (void)pvContext;
+
+    // Round pbTarget down to 64KB block.
+    pbTarget = pbTarget - (PtrToUlong(pbTarget) & 0xffff);
+
+    return detour_alloc_trampoline_allocate_new(pbTarget,
+                                                (PDETOUR_TRAMPOLINE)pbLo,
+                                                (PDETOUR_TRAMPOLINE)pbHi);
+}
+
+static VOID detour_free_region(PVOID pvContext, PVOID pvRegion)
+{
+    (void)pvContext;
+
+    VirtualFree(pvRegion, 0, MEM_RELEASE);
+}
+
 static PDETOUR_TRAMPOLINE detour_alloc_trampoline(PBYTE pbTarget)
 {
     // We have to place trampolines within +/- 2GB of target.
@@ -1377,118 +1393,38 @@ static PDETOUR_TRAMPOLINE detour_alloc_trampoline(PBYTE pbTarget)
 
     detour_find_jmp_bounds(pbTarget, &pLo, &pHi);
 
-    PDETOUR_TRAMPOLINE pTrampoline = NULL;
-
-    // Insure that there is a default region.
-    if (s_pRegion == NULL && s_pRegions != NULL) {
-        s_pRegion = s_pRegions;
-    }
-
-    // First check the default region for an valid free block.
-    if (s_pRegion != NULL && s_pRegion->pFree != NULL &&
-        s_pRegion->pFree >= pLo && s_pRegion->pFree <= pHi) {
-
-      found_region:
-        pTrampoline = s_pRegion->pFree;
-        // do a last sanity check on region.
-        if (pTrampoline < pLo || pTrampoline > pHi) {
+    if (s_Slab.cbSlot == 0) {
+        static const DETOUR_SLAB_PAGES s_Pages = {
+            detour_alloc_region, detour_free_region, NULL
+        };
+        if (!detour_slab_init(&s_Slab, sizeof(DETOUR_TRAMPOLINE), &s_Pages)) {
             return NULL;
         }
-        s_pRegion->pFree = (PDETOUR_TRAMPOLINE)pTrampoline->pbRemain;
-        memset(pTrampoline, 0xcc, sizeof(*pTrampoline));
-        return pTrampoline;
     }
 
-    // Then check the existing regions for a valid free block.
-    for (s_pRegion = s_pRegions; s_pRegion != NULL; s_pRegion = s_pRegion->pNext) {
-        if (s_pRegion != NULL && s_pRegion->pFree != NULL &&
-            s_pRegion->pFree >= pLo && s_pRegion->pFree <= pHi) {
-            goto found_region;
-        }
+    PDETOUR_TRAMPOLINE pTrampoline = (PDETOUR_TRAMPOLINE)
+        detour_slab_alloc(&s_Slab, pbTarget, (PBYTE)pLo, (PBYTE)pHi);
+    if (pTrampoline == NULL) {
+        return NULL;
     }
-
-    // We need to allocate a new region.
-
-    // Round pbTarget down to 64KB block.
-    pbTarget = pbTarget - (PtrToUlong(pbTarget) & 0xffff);
-
-    PVOID pbNewlyAllocated =
-        detour_alloc_trampoline_allocate_new(pbTarget, pLo, pHi);
-    if (pbNewlyAllocated != NULL) {
-        s_pRegion = (DETOUR_REGION*)pbNewlyAllocated;
-        s_pRegion->dwSignature = DETOUR_REGION_SIGNATURE;
-        s_pRegion->pFree = NULL;
-        s_pRegion->pNext = s_pRegions;
-        s_pRegions = s_pRegion;
-        DETOUR_TRACE(("  Allocated region %p..%p\n\n",
-                      s_pRegion, ((PBYTE)s_pRegion) + DETOUR_REGION_SIZE - 1));
-
-        // Put everything but the first trampoline on the free list.
-        PBYTE pFree = NULL;
-        pTrampoline = ((PDETOUR_TRAMPOLINE)s_pRegion) + 1;
-        for (int i = DETOUR_TRAMPOLINES_PER_REGION - 1; i > 1; i--) {
-            pTrampoline[i].pbRemain = pFree;
-            pFree = (PBYTE)&pTrampoline[i];
-        }
-        s_pRegion->pFree = (PDETOUR_TRAMPOLINE)pFree;
-        goto found_region;
+    // do a last sanity check on region.
+    if (pTrampoline < pLo || pTrampoline > pHi) {
+        detour_slab_free(&s_Slab, (PBYTE)pTrampoline);
+        return NULL;
     }
-
-    DETOUR_TRACE(("Couldn't find available memory region!\n"));
-    return NULL;
+    memset(pTrampoline, 0xcc, sizeof(*pTrampoline));
+    return pTrampoline;
 }
 
 static void detour_free_trampoline(PDETOUR_TRAMPOLINE pTrampoline)
 {
-    PDETOUR_REGION pRegion = (PDETOUR_REGION)
-        ((ULONG_PTR)pTrampoline & ~(ULONG_PTR)0xffff);
-
     memset(pTrampoline, 0, sizeof(*pTrampoline));
-    pTrampoline->pbRemain = (PBYTE)pRegion->pFree;
-    pRegion->pFree = pTrampoline;
-}
-
-static BOOL detour_is_region_empty(PDETOUR_REGION pRegion)
-{
-    // Stop if the region isn't a region (this would be bad).
-    if (pRegion->dwSignature != DETOUR_REGION_SIGNATURE) {
-        return FALSE;
-    }
-
-    PBYTE pbRegionBeg = (PBYTE)pRegion;
-    PBYTE pbRegionLim  = pbRegionBeg + DETOUR_REGION_SIZE;
-
-    // Stop if any of the trampolines aren't free.
-    PDETOUR_TRAMPOLINE pTrampoline = ((PDETOUR_TRAMPOLINE)pRegion) + 1;
-    for (int i = 0; i < DETOUR_TRAMPOLINES_PER_REGION; i++) {
-        if (pTrampoline[i].pbRemain != NULL &&
-            (pTrampoline[i].pbRemain < pbRegionBeg ||
-             pTrampoline[i].pbRemain >= pbRegionLim)) {
-            return FALSE;
-        }
-    }
-
-    // OK, the region is empty.
-    return TRUE;
+    detour_slab_free(&s_Slab, (PBYTE)pTrampoline);
 }
 
 static void detour_free_unused_trampoline_regions()
 {
-    PDETOUR_REGION *ppRegionBase = &s_pRegions;
-    PDETOUR_REGION pRegion = s_pRegions;
-
-    while (pRegion != NULL) {
-        if (detour_is_region_empty(pRegion)) {
-            *ppRegionBase = pRegion->pNext;
-
-            VirtualFree(pRegion, 0, MEM_RELEASE);
-            s_pRegion = NULL;
-        }
-        else {
-            ppRegionBase = &pRegion->pNext;
-        }
-        pRegion = *ppRegionBase;
-    }
+    detour_slab_free_empty_regions(&s_Slab);
 }
 
 ///////////////////////////////////////////////////////// Transaction Structs.
@@ -1511,12 +1447,145 @@ struct DetourOperation
 
 static BOOL                 s_fIgnoreTooSmall       = FALSE;
 static BOOL                 s_fRetainRegions        = FALSE;
+static BOOL                 s_fBulkCommit           = FALSE;
+static DETOUR_COMMIT_STATS  s_CommitStats;
 
 static LONG                 s_nPendingThreadId      = 0; // Thread owning pending transaction.
 static LONG                 s_nPendingError         = NO_ERROR;
 static PVOID *              s_ppPendingError        = NULL;
 static DetourThread *       s_pPendingThreads       = NULL;
 static DetourOperation *    s_pPendingOperations    = NULL;
+static BOOL                 s_fPendingBulk          = FALSE; // Pending transaction is a bulk commit.
+
+//////////////////////////////////////////////////////// Bulk Target Protection.
+//
+// In a bulk commit, DetourAttach and DetourDetach leave the targets alone;
+// the commit makes all of them writable with one VirtualProtect per range
+// of pages that share a protection (see protect.cpp), writes the patches,
+// and then restores each range and flushes it from the icache.
+//
+static BOOL detour_protect_query(PVOID pvContext,
+                                 PBYTE pbAddress,
+                                 PBYTE *ppbBase,
+                                 SIZE_T *pcbSize,
+                                 DWORD *pdwPerm)
+{
+    (void)pvContext;
+
+    MEMORY_BASIC_INFORMATION mbi;
+    ZeroMemory(&mbi, sizeof(mbi));
+    if (VirtualQuery(pbAddress, &mbi, sizeof(mbi)) == 0) {
+        return FALSE;
+    }
+    if (mbi.State != MEM_COMMIT) {
+        SetLastError(ERROR_INVALID_ADDRESS);
+        return FALSE;
+    }
+    *ppbBase = (PBYTE)mbi.BaseAddress;
+    *pcbSize = mbi.RegionSize;
+    *pdwPerm = mbi.Protect;
+    return TRUE;
+}
+
+static BOOL detour_protect_set(PVOID pvContext,
+                               PBYTE pbBase,
+                               SIZE_T cbSize,
+                               DWORD dwPerm,
+                               DWORD *pdwOldPerm)
+{
+    (void)pvContext;
+    return VirtualProtect(pbBase, cbSize, dwPerm, pdwOldPerm);
+}
+
+static LONG detour_writable_targets(PDETOUR_PROTECT_PLAN pPlan)
+{
+    static ULONG s_cbPage = 0;
+    if (s_cbPage == 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        s_cbPage = si.dwPageSize;
+    }
+
+    ZeroMemory(pPlan, sizeof(*pPlan));
+    pPlan->Backend.pfQuery = detour_protect_query;
+    pPlan->Backend.pfProtect = detour_protect_set;
+    pPlan->Backend.pvContext = NULL;
+    pPlan->Backend.cbPage = s_cbPage;
+
+    ULONG cSpans = 0;
+    for (DetourOperation *o = s_pPendingOperations; o != NULL; o = o->pNext) {
+        cSpans++;
+    }
+    if (cSpans == 0) {
+        return NO_ERROR;
+    }
+
+    PDETOUR_PROTECT_SPAN pSpans = new (std::nothrow) DETOUR_PROTECT_SPAN [cSpans];
+    pPlan->pRanges = new (std::nothrow) DETOUR_PROTECT_RANGE [cSpans * 2];
+    pPlan->cMaxRanges = cSpans * 2;
+
+    LONG error = ERROR_NOT_ENOUGH_MEMORY;
+    if (pSpans != NULL && pPlan->pRanges != NULL) {
+        ULONG n = 0;
+        for (DetourOperation *o = s_pPendingOperations; o != NULL; o = o->pNext) {
+            pSpans[n].pbTarget = o->pbTarget;
+            pSpans[n].cbTarget = o->pTrampoline->cbRestore;
+            n++;
+        }
+
+        error = detour_protect_plan(pPlan, pSpans, cSpans);
+        if (error == NO_ERROR) {
+            error = detour_protect_apply(pPlan, PAGE_EXECUTE_READWRITE);
+        }
+    }
+    s_cProtectCalls += pPlan->cProtectCalls;
+    pPlan->cProtectCalls = 0;
+
+    delete[] pSpans;
+    if (error != NO_ERROR) {
+        delete[] pPlan->pRanges;
+        pPlan->pRanges = NULL;
+        pPlan->cRanges = 0;
+    }
+    return error;
+}
+
+static void detour_runnable_targets(PDETOUR_PROTECT_PLAN pPlan)
+{
+    HANDLE hProcess = GetCurrentProcess();
+
+    detour_protect_restore(pPlan);
+    s_cProtectCalls += pPlan->cProtectCalls;
+    pPlan->cProtectCalls = 0;
+
+    for (ULONG n = 0; n < pPlan->cRanges; n++) {
+        FlushInstructionCache(hProcess, pPlan->pRanges[n].pbBase, pPlan->pRanges[n].cbSize);
+    }
+
+    delete[] pPlan->pRanges;
+    pPlan->pRanges = NULL;
+}
+
+static void detour_record_commit_stats(ULONG cOperations,
+                                       ULONG cRanges,
+                                       ULONG cThreads,
+                                       const LARGE_INTEGER *pliStart)
+{
+    LARGE_INTEGER liEnd;
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceCounter(&liEnd);
+    QueryPerformanceFrequency(&liFrequency);
+
+    s_CommitStats.cOperations = cOperations;
+    s_CommitStats.cRanges = cRanges;
+    s_CommitStats.cProtectCalls = s_cProtectCalls;
+    s_CommitStats.cThreads = cThreads;
+    s_CommitStats.cMicroseconds = 0;
+    if (liFrequency.QuadPart != 0) {
+        s_CommitStats.cMicroseconds
+            = (ULONG)((liEnd.QuadPart - pliStart->QuadPart) * 1000000 / liFrequency.QuadPart);
+    }
+}
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -1542,6 +1611,25 @@ BOOL WINAPI DetourSetRetainRegions(_In_ BOOL fRetain)
     return fPrevious;
 }
 
+// Takes effect at the next DetourTransactionBegin.  In a bulk transaction,
+// a target that can't be made writable fails the commit, not the attach.
+BOOL WINAPI DetourSetBulkCommit(_In_ BOOL fBulk)
+{
+    BOOL fPrevious = s_fBulkCommit;
+    s_fBulkCommit = fBulk;
+    return fPrevious;
+}
+
+BOOL WINAPI DetourGetCommitStats(_Out_ PDETOUR_COMMIT_STATS pStats)
+{
+    if (pStats == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    *pStats = s_CommitStats;
+    return TRUE;
+}
+
 PVOID WINAPI DetourSetSystemRegionLowerBound(_In_ PVOID pSystemRegionLowerBound)
 {
     PVOID pPrevious = s_pSystemRegionLowerBound;
@@ -1573,6 +1661,8 @@ _Benign_race_end_
     s_pPendingOperations = NULL;
     s_pPendingThreads = NULL;
     s_ppPendingError = NULL;
+    s_fPendingBulk = s_fBulkCommit;
+    s_cProtectCalls = 0;
 
     // Make sure the trampoline pages are writable.
     s_nPendingError = detour_writable_trampoline_regions();
@@ -1586,12 +1676,22 @@ LONG WINAPI DetourTransactionAbort()
         return ERROR_INVALID_OPERATION;
     }
 
+    LARGE_INTEGER liStart;
+    QueryPerformanceCounter(&liStart);
+    ULONG cOperations = 0;
+    ULONG cThreads = 0;
+
     // Restore all of the page permissions.
     for (DetourOperation *o = s_pPendingOperations; o != NULL;) {
         // We don't care if this fails, because the code is still accessible.
-        DWORD dwOld;
-        VirtualProtect(o->pbTarget, o->pTrampoline->cbRestore,
-                       o->dwPerm, &dwOld);
+        // A bulk transaction hasn't changed them yet.
+        if (!s_fPendingBulk) {
+            DWORD dwOld;
+            s_cProtectCalls++;
+            VirtualProtect(o->pbTarget, o->pTrampoline->cbRestore,
+                           o->dwPerm, &dwOld);
+        }
+        cOperations++;
 
         if (!o->fIsRemove) {
             if (o->pTrampoline) {
@@ -1613,12 +1713,14 @@ LONG WINAPI DetourTransactionAbort()
     for (DetourThread *t = s_pPendingThreads; t != NULL;) {
         // There is nothing we can do if this fails.
         ResumeThread(t->hThread);
+        cThreads++;
 
         DetourThread *n = t->pNext;
         delete t;
         t = n;
     }
     s_pPendingThreads = NULL;
+    detour_record_commit_stats(cOperations, 0, cThreads, &liStart);
     s_nPendingThreadId = 0;
 
     return NO_ERROR;
@@ -1670,6 +1772,24 @@ LONG WINAPI DetourTransactionCommitEx(_Out_opt_ PVOID **pppFailedPointer)
     DetourOperation *o;
     DetourThread *t;
     BOOL freed = FALSE;
+    ULONG cOperations = 0;
+    ULONG cThreads = 0;
+    LARGE_INTEGER liStart;
+    QueryPerformanceCounter(&liStart);
+
+    // Make all of the targets writable at once.
+    DETOUR_PROTECT_PLAN plan;
+    ZeroMemory(&plan, sizeof(plan));
+    if (s_fPendingBulk) {
+        LONG error = detour_writable_targets(&plan);
+        if (error != NO_ERROR) {
+            DETOUR_BREAK();
+            s_nPendingError = error;
+            DetourTransactionAbort();
+            return error;
+        }
+    }
+    ULONG cRanges = plan.cRanges;
 
     // Insert or remove each of the detours.
     for (o = s_pPendingOperations; o != NULL; o = o->pNext) {
@@ -1872,12 +1992,19 @@ typedef ULONG_PTR DETOURS_EIP_TYPE;
     }
 
     // Restore all of the page permissions and flush the icache.
+    if (s_fPendingBulk) {
+        detour_runnable_targets(&plan);
+    }
     HANDLE hProcess = GetCurrentProcess();
     for (o = s_pPendingOperations; o != NULL;) {
-        // We don't care if this fails, because the code is still accessible.
-        DWORD dwOld;
-        VirtualProtect(o->pbTarget, o->pTrampoline->cbRestore, o->dwPerm, &dwOld);
-        FlushInstructionCache(hProcess, o->pbTarget, o->pTrampoline->cbRestore);
+        if (!s_fPendingBulk) {
+            // We don't care if this fails, because the code is still accessible.
+            DWORD dwOld;
+            s_cProtectCalls++;
+            VirtualProtect(o->pbTarget, o->pTrampoline->cbRestore, o->dwPerm, &dwOld);
+            FlushInstructionCache(hProcess, o->pbTarget, o->pTrampoline->cbRestore);
+        }
+        cOperations++;
 
         if (o->fIsRemove && o->pTrampoline) {
             detour_free_trampoline(o->pTrampoline);
@@ -1903,12 +2030,14 @@ typedef ULONG_PTR DETOURS_EIP_TYPE;
     for (t = s_pPendingThreads; t != NULL;) {
         // There is nothing we can do if this fails.
         ResumeThread(t->hThread);
+        cThreads++;
 
         DetourThread *n = t->pNext;
         delete t;
         t = n;
     }
     s_pPendingThreads = NULL;
+    detour_record_commit_stats(cOperations, cRanges, cThreads, &liStart);
     s_nPendingThreadId = 0;
 
     if (pppFailedPointer != NULL) {
@@ -2283,11 +2412,15 @@ LONG WINAPI DetourAttachEx(_Inout_ PVOID *ppPointer,
 
     (void)pbTrampoline;
 
+    // A bulk commit changes the protection of all of the targets at once.
     DWORD dwOld = 0;
-    if (!VirtualProtect(pbTarget, cbTarget, PAGE_EXECUTE_READWRITE, &dwOld)) {
-        error = GetLastError();
-        DETOUR_BREAK();
-        goto fail;
+    if (!s_fPendingBulk) {
+        s_cProtectCalls++;
+        if (!VirtualProtect(pbTarget, cbTarget, PAGE_EXECUTE_READWRITE, &dwOld)) {
+            error = GetLastError();
+            DETOUR_BREAK();
+            goto fail;
+        }
     }
 
     DETOUR_TRACE(("detours: pbTarget=%p: "
@@ -2442,11 +2575,14 @@ LONG WINAPI DetourDetach(_Inout_ PVOID *ppPointer,
     }
 
     DWORD dwOld = 0;
-    if (!VirtualProtect(pbTarget, cbTarget,
-                        PAGE_EXECUTE_READWRITE, &dwOld)) {
-        error = GetLastError();
-        DETOUR_BREAK();
-        goto fail;
+    if (!s_fPendingBulk) {
+        s_cProtectCalls++;
+        if (!VirtualProtect(pbTarget, cbTarget,
+                            PAGE_EXECUTE_READWRITE, &dwOld)) {
+            error = GetLastError();
+            DETOUR_BREAK();
+            goto fail;
+        }
     }
 
     o->fIsRemove = TRUE;
@@ -467,6 +467,47 @@ typedef struct _DETOUR_EXE_HELPER
       0,\
 }
 
+//////////////////////////////////////////////////////// Instruction Typedefs.
+//
+typedef struct _DETOUR_INSTRUCTION
+{
+    ULONG               nOffset;        // Offset of the instruction from the start of the code.
+    USHORT              cbInstruction;  // Length of the instruction in bytes.
+    SHORT               nExtra;         // Extra bytes needed to reach pTarget (see DetourCopyInstruction).
+    PVOID               pTarget;        // Branch target, or DETOUR_INSTRUCTION_TARGET_NONE/_DYNAMIC.
+} DETOUR_INSTRUCTION, *PDETOUR_INSTRUCTION;
+
+#define DETOUR_BLOCK_FALLTHROUGH        0x0001  // Execution may continue into the next block.
+#define DETOUR_BLOCK_BRANCH             0x0002  // Ends in a direct branch to nTarget.
+#define DETOUR_BLOCK_CONDITIONAL        0x0004  // The ending branch is conditional.
+#define DETOUR_BLOCK_EXTERNAL           0x0008  // The ending branch leaves the code (tail call).
+#define DETOUR_BLOCK_DYNAMIC            0x0010  // Ends in an indirect jump.
+#define DETOUR_BLOCK_RETURN             0x0020  // Ends in a return.
+#define DETOUR_BLOCK_TRAP               0x0040  // Ends in a breakpoint or undefined instruction.
+#define DETOUR_BLOCK_TRUNCATED          0x0080  // Runs off the end of the code or into bad code.
+
+typedef struct _DETOUR_BASIC_BLOCK
+{
+    ULONG               nOffset;        // Offset of the first instruction from the entry point.
+    ULONG               cbBlock;        // Length of the block in bytes.
+    ULONG               nTarget;        // Offset of the branch target if DETOUR_BLOCK_BRANCH.
+    USHORT              cInstructions;  // Number of instructions in the block.
+    USHORT              fFlags;         // DETOUR_BLOCK_* flags.
+} DETOUR_BASIC_BLOCK, *PDETOUR_BASIC_BLOCK;
+
+#define DETOUR_GRAPH_DYNAMIC            0x0001  // Has indirect jumps whose targets are unknown.
+#define DETOUR_GRAPH_EXTERNAL           0x0002  // Has branches that leave the code.
+#define DETOUR_GRAPH_OVERLAP            0x0004  // A branch lands inside another instruction.
+#define DETOUR_GRAPH_TRUNCATED          0x0008  // Analysis stopped before all paths ended.
+
+typedef struct _DETOUR_FUNCTION_GRAPH
+{
+    ULONG               cBlocks;        // Number of blocks found; may exceed the array size.
+    ULONG               cInstructions;  // Number of instructions reachable from the entry.
+    ULONG               cbExtent;       // One past the highest byte decoded.
+    ULONG               fFlags;         // DETOUR_GRAPH_* flags.
+} DETOUR_FUNCTION_GRAPH, *PDETOUR_FUNCTION_GRAPH;
+
 ///////////////////////////////////////////////////////////// Binary Typedefs.
 //
 typedef BOOL (CALLBACK *PF_DETOUR_BINARY_BYWAY_CALLBACK)(
@@ -514,6 +555,26 @@ typedef BOOL (CALLBACK *PF_DETOUR_IMPORT_FUNC_CALLBACK_EX)(_In_opt_ PVOID pConte
 
 typedef VOID * PDETOUR_BINARY;
 typedef VOID * PDETOUR_LOADED_BINARY;
+typedef struct _DETOUR_EXPORT_INDEX * PDETOUR_EXPORT_INDEX;
+
+typedef struct _DETOUR_EXPORT
+{
+    ULONG   nOrdinal;
+    ULONG   nRva;               // 0 if forwarded.
+    LPCSTR  pszName;            // NULL if exported by ordinal only.
+    LPCSTR  pszForward;         // "DLL.Name" or "DLL.#nn" if forwarded, else NULL.
+    PVOID   pvCode;             // Address in a mapped image, else NULL.
+} DETOUR_EXPORT, *PDETOUR_EXPORT;
+
+// Filled in by each DetourTransactionCommit and DetourTransactionAbort.
+typedef struct _DETOUR_COMMIT_STATS
+{
+    ULONG   cOperations;        // Attaches and detaches in the transaction.
+    ULONG   cRanges;            // Target page ranges made writable (bulk commit only).
+    ULONG   cProtectCalls;      // VirtualProtect calls, including trampoline regions.
+    ULONG   cThreads;           // Threads updated by DetourUpdateThread.
+    ULONG   cMicroseconds;      // Time spent in the commit.
+} DETOUR_COMMIT_STATS, *PDETOUR_COMMIT_STATS;
 
 //////////////////////////////////////////////////////////// Transaction APIs.
 //
@@ -538,6 +599,8 @@ LONG WINAPI DetourDetach(_Inout_ PVOID *ppPointer,
 
 BOOL WINAPI DetourSetIgnoreTooSmall(_In_ BOOL fIgnore);
 BOOL WINAPI DetourSetRetainRegions(_In_ BOOL fRetain);
+BOOL WINAPI DetourSetBulkCommit(_In_ BOOL fBulk);
+BOOL WINAPI DetourGetCommitStats(_Out_ PDETOUR_COMMIT_STATS pStats);
 PVOID WINAPI DetourSetSystemRegionLowerBound(_In_ PVOID pSystemRegionLowerBound);
 PVOID WINAPI DetourSetSystemRegionUpperBound(_In_ PVOID pSystemRegionUpperBound);
 
@@ -552,6 +615,20 @@ PVOID WINAPI DetourCopyInstruction(_In_opt_ PVOID pDst,
                                    _In_ PVOID pSrc,
                                    _Out_opt_ PVOID *ppTarget,
                                    _Out_opt_ LONG *plExtra);
+ULONG WINAPI DetourDecodeInstructions(_In_reads_bytes_(cbCode) PVOID pCode,
+                                      _In_ ULONG cbCode,
+                                      _Out_writes_(cMaxInstructions) PDETOUR_INSTRUCTION pInstructions,
+                                      _In_ ULONG cMaxInstructions,
+                                      _Out_opt_ ULONG *pcbDecoded);
+BOOL WINAPI DetourBuildFunctionGraph(_In_reads_bytes_(cbCode) PVOID pCode,
+                                     _In_ ULONG cbCode,
+                                     _Out_writes_opt_(cMaxBlocks) PDETOUR_BASIC_BLOCK pBlocks,
+                                     _In_ ULONG cMaxBlocks,
+                                     _Out_ PDETOUR_FUNCTION_GRAPH pGraph);
+BOOL WINAPI DetourIsPatchSafe(_In_reads_bytes_(cbCode) PVOID pCode,
+                              _In_ ULONG cbCode,
+                              _In_ ULONG cbPatch,
+                              _Out_opt_ ULONG *pcbCopied);
 BOOL WINAPI DetourSetCodeModule(_In_ HMODULE hModule,
                                 _In_ BOOL fLimitReferencesToModule);
 PVOID WINAPI DetourAllocateRegionWithinJumpBounds(_In_ LPCVOID pbTarget,
@@ -566,6 +643,21 @@ ULONG WINAPI DetourGetModuleSize(_In_opt_ HMODULE hModule);
 BOOL WINAPI DetourEnumerateExports(_In_ HMODULE hModule,
                                    _In_opt_ PVOID pContext,
                                    _In_ PF_DETOUR_ENUMERATE_EXPORT_CALLBACK pfExport);
+
+// An immutable, perfect-hashed index of an export directory.  pImage is a
+// module (fMapped) or the bytes of a PE file; the index keeps its own copy
+// of the names and may outlive a file image.
+PDETOUR_EXPORT_INDEX WINAPI DetourCreateExportIndex(_In_reads_bytes_(cbImage) PVOID pImage,
+                                                    _In_ SIZE_T cbImage,
+                                                    _In_ BOOL fMapped);
+ULONG WINAPI DetourFindExports(_In_ PDETOUR_EXPORT_INDEX pIndex,
+                               _In_reads_(cNames) LPCSTR *ppszNames,
+                               _In_ ULONG cNames,
+                               _Out_writes_(cNames) PDETOUR_EXPORT pExports);
+BOOL WINAPI DetourFindExportByOrdinal(_In_ PDETOUR_EXPORT_INDEX pIndex,
+                                      _In_ ULONG nOrdinal,
+                                      _Out_ PDETOUR_EXPORT pExport);
+VOID WINAPI DetourFreeExportIndex(_In_ PDETOUR_EXPORT_INDEX pIndex);
 BOOL WINAPI DetourEnumerateImports(_In_opt_ HMODULE hModule,
                                    _In_opt_ PVOID pContext,
                                    _In_opt_ PF_DETOUR_IMPORT_FILE_CALLBACK pfImportFile,
@@ -594,7 +686,10 @@ DWORD WINAPI DetourGetSizeOfPayloads(_In_opt_ HMODULE hModule);
 ///////////////////////////////////////////////// Persistent Binary Functions.
 //
 
+#define DETOUR_BINARY_OPEN_COPY         0x00000001  // Read the file into memory.
+
 PDETOUR_BINARY WINAPI DetourBinaryOpen(_In_ HANDLE hFile);
+PDETOUR_BINARY WINAPI DetourBinaryOpenEx(_In_ HANDLE hFile, _In_ DWORD dwFlags);
 
 _Writable_bytes_(*pcbData)
 _Readable_bytes_(*pcbData)
@@ -1062,6 +1157,23 @@ PVOID WINAPI DetourCopyInstruction##x(_In_opt_ PVOID pDst,              \
                                       _Out_opt_ PVOID *ppTarget,        \
                                       _Out_opt_ LONG *plExtra);         \
                                                                         \
+ULONG WINAPI DetourDecodeInstructions##x(_In_reads_bytes_(cbCode) PVOID pCode, \
+                                         _In_ ULONG cbCode,             \
+                                         _Out_writes_(cMaxInstructions) PDETOUR_INSTRUCTION pInstructions, \
+                                         _In_ ULONG cMaxInstructions,   \
+                                         _Out_opt_ ULONG *pcbDecoded);  \
+                                                                        \
+BOOL WINAPI DetourBuildFunctionGraph##x(_In_reads_bytes_(cbCode) PVOID pCode, \
+                                        _In_ ULONG cbCode,              \
+                                        _Out_writes_opt_(cMaxBlocks) PDETOUR_BASIC_BLOCK pBlocks, \
+                                        _In_ ULONG cMaxBlocks,          \
+                                        _Out_ PDETOUR_FUNCTION_GRAPH pGraph); \
+                                                                        \
+BOOL WINAPI DetourIsPatchSafe##x(_In_reads_bytes_(cbCode) PVOID pCode,  \
+                                 _In_ ULONG cbCode,                     \
+                                 _In_ ULONG cbPatch,                    \
+                                 _Out_opt_ ULONG *pcbCopied);           \
+                                                                        \
 BOOL WINAPI DetourSetCodeModule##x(_In_ HMODULE hModule,                \
                                    _In_ BOOL fLimitReferencesToModule); \
 
@@ -8,8 +8,12 @@
 //
 
 // #define DETOUR_DEBUG 1
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include "disol.h"
+#else
 #define DETOURS_INTERNAL
 #include "detours.h"
+#endif
 #include <limits.h>
 
 #if DETOURS_VERSION != 0x4c0c1   // 0xMAJORcMINORcPATCH
@@ -42,6 +46,10 @@
 
 #define DetourCopyInstruction   DetourCopyInstructionX86
 #define DetourSetCodeModule     DetourSetCodeModuleX86
+#define DetourDecodeInstructions DetourDecodeInstructionsX86
+#define DetourBuildFunctionGraph DetourBuildFunctionGraphX86
+#define DetourIsPatchSafe       DetourIsPatchSafeX86
+#define CDetourGraph            CDetourGraphX86
 #define CDetourDis              CDetourDisX86
 #define DETOURS_X86
 
@@ -54,6 +62,10 @@
 
 #define DetourCopyInstruction   DetourCopyInstructionX64
 #define DetourSetCodeModule     DetourSetCodeModuleX64
+#define DetourDecodeInstructions DetourDecodeInstructionsX64
+#define DetourBuildFunctionGraph DetourBuildFunctionGraphX64
+#define DetourIsPatchSafe       DetourIsPatchSafeX64
+#define CDetourGraph            CDetourGraphX64
 #define CDetourDis              CDetourDisX64
 #define DETOURS_X64
 
@@ -61,6 +73,10 @@
 
 #define DetourCopyInstruction   DetourCopyInstructionARM
 #define DetourSetCodeModule     DetourSetCodeModuleARM
+#define DetourDecodeInstructions DetourDecodeInstructionsARM
+#define DetourBuildFunctionGraph DetourBuildFunctionGraphARM
+#define DetourIsPatchSafe       DetourIsPatchSafeARM
+#define CDetourGraph            CDetourGraphARM
 #define CDetourDis              CDetourDisARM
 #define DETOURS_ARM
 
@@ -68,6 +84,10 @@
 
 #define DetourCopyInstruction   DetourCopyInstructionARM64
 #define DetourSetCodeModule     DetourSetCodeModuleARM64
+#define DetourDecodeInstructions DetourDecodeInstructionsARM64
+#define DetourBuildFunctionGraph DetourBuildFunctionGraphARM64
+#define DetourIsPatchSafe       DetourIsPatchSafeARM64
+#define CDetourGraph            CDetourGraphARM64
 #define CDetourDis              CDetourDisARM64
 #define DETOURS_ARM64
 
@@ -75,6 +95,9 @@
 
 #define DetourCopyInstruction   DetourCopyInstructionIA64
 #define DetourSetCodeModule     DetourSetCodeModuleIA64
+#define DetourDecodeInstructions DetourDecodeInstructionsIA64
+#define DetourBuildFunctionGraph DetourBuildFunctionGraphIA64
+#define DetourIsPatchSafe       DetourIsPatchSafeIA64
 #define DETOURS_IA64
 
 #else
@@ -160,6 +183,8 @@ class CDetourDis
                _Out_opt_ LONG *plExtra);
 
     PBYTE   CopyInstruction(PBYTE pbDst, PBYTE pbSrc);
+    VOID    Reset(BOOL fPaddedCopy = FALSE);
+    BOOL    IsTargetAbsolute() const { return m_bAbsoluteTarget; }
     static BOOL SanityCheckSystem();
     static BOOL SetCodeModule(PBYTE pbBeg, PBYTE pbEnd, BOOL fLimitReferencesToModule);
 
@@ -167,7 +192,32 @@ class CDetourDis
     struct COPYENTRY;
     typedef const COPYENTRY * REFCOPYENTRY;
 
-    typedef PBYTE (CDetourDis::* COPYFUNC)(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc);
+    // Handler for an opcode; the cases of Dispatch.
+    enum COPYOP {
+        OP_End = 0,             // Table end marker (no handler).
+        OP_CopyBytes,
+        OP_CopyBytesPrefix,
+        OP_CopyBytesSegment,
+        OP_CopyBytesRax,
+        OP_CopyBytesJump,
+        OP_Invalid,
+        OP_Copy0F,
+        OP_Copy0F00,
+        OP_Copy0F78,
+        OP_Copy0FB8,
+        OP_Copy66,
+        OP_Copy67,
+        OP_CopyF2,
+        OP_CopyF3,
+        OP_CopyF6,
+        OP_CopyF7,
+        OP_CopyFF,
+        OP_CopyVex2,
+        OP_CopyVex3,
+        OP_CopyEvex,
+        OP_CopyXop,
+        OP_CopyRex2,
+    };
 
     // nFlagBits flags.
     enum {
@@ -184,77 +234,83 @@ class CDetourDis
         NOTSIB      = 0x0fu,
     };
 
+    // One dense, constant word per opcode: the length class, ModR/M and
+    // relative-target offsets, and the handler to use when the opcode is
+    // not plain CopyBytes.  The tables are constexpr so that their shape is
+    // checked at compile time (see CheckCopyTable).
     struct COPYENTRY
     {
         // Many of these fields are often ignored. See ENTRY_DataIgnored.
         ULONG       nOpcode         : 8;    // Opcode (ignored)
         ULONG       nFixedSize      : 4;    // Fixed size of opcode
         ULONG       nFixedSize16    : 4;    // Fixed size when 16 bit operand
-        ULONG       nModOffset      : 4;    // Offset to mod/rm byte (0=none)
+        ULONG       nModOffset      : 3;    // Offset to mod/rm byte (0=none)
         ULONG       nRelOffset      : 4;    // Offset to relative target.
         ULONG       nFlagBits       : 4;    // Flags for DYNAMIC, etc.
-        COPYFUNC    pfCopy;                 // Function pointer.
+        ULONG       nCopy           : 5;    // COPYOP handler.
     };
 
   protected:
-// These macros define common uses of nFixedSize, nFixedSize16, nModOffset, nRelOffset, nFlagBits, pfCopy.
+// These macros define common uses of nFixedSize, nFixedSize16, nModOffset, nRelOffset, nFlagBits, nCopy.
 #define ENTRY_DataIgnored           0, 0, 0, 0, 0,
-#define ENTRY_CopyBytes1            1, 1, 0, 0, 0, &CDetourDis::CopyBytes
+#define ENTRY_CopyBytes1            1, 1, 0, 0, 0, OP_CopyBytes
 #ifdef DETOURS_X64
-#define ENTRY_CopyBytes1Address     9, 5, 0, 0, ADDRESS, &CDetourDis::CopyBytes
+#define ENTRY_CopyBytes1Address     9, 5, 0, 0, ADDRESS, OP_CopyBytes
 #else
-#define ENTRY_CopyBytes1Address     5, 3, 0, 0, ADDRESS, &CDetourDis::CopyBytes
+#define ENTRY_CopyBytes1Address     5, 3, 0, 0, ADDRESS, OP_CopyBytes
 #endif
-#define ENTRY_CopyBytes1Dynamic     1, 1, 0, 0, DYNAMIC, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes2            2, 2, 0, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes2Jump        ENTRY_DataIgnored &CDetourDis::CopyBytesJump
-#define ENTRY_CopyBytes2CantJump    2, 2, 0, 1, NOENLARGE, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes2Dynamic     2, 2, 0, 0, DYNAMIC, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes3            3, 3, 0, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes3Dynamic     3, 3, 0, 0, DYNAMIC, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes3Or5         5, 3, 0, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes3Or5Dynamic  5, 3, 0, 0, DYNAMIC, &CDetourDis::CopyBytes // x86 only
+#define ENTRY_CopyBytes1Dynamic     1, 1, 0, 0, DYNAMIC, OP_CopyBytes
+#define ENTRY_CopyBytes2            2, 2, 0, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes2Jump        ENTRY_DataIgnored OP_CopyBytesJump
+#define ENTRY_CopyBytes2CantJump    2, 2, 0, 1, NOENLARGE, OP_CopyBytes
+#define ENTRY_CopyBytes2Dynamic     2, 2, 0, 0, DYNAMIC, OP_CopyBytes
+#define ENTRY_CopyBytes3            3, 3, 0, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes3Dynamic     3, 3, 0, 0, DYNAMIC, OP_CopyBytes
+#define ENTRY_CopyBytes3Or5         5, 3, 0, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes3Or5Dynamic  5, 3, 0, 0, DYNAMIC, OP_CopyBytes // x86 only
 #ifdef DETOURS_X64
-#define ENTRY_CopyBytes3Or5Rax      5, 3, 0, 0, RAX, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes3Or5Target   5, 5, 0, 1, 0, &CDetourDis::CopyBytes
+#define ENTRY_CopyBytes3Or5Rax      5, 3, 0, 0, RAX, OP_CopyBytes
+#define ENTRY_CopyBytes3Or5Target   5, 5, 0, 1, 0, OP_CopyBytes
 #else
-#define ENTRY_CopyBytes3Or5Rax      5, 3, 0, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes3Or5Target   5, 3, 0, 1, 0, &CDetourDis::CopyBytes
+#define ENTRY_CopyBytes3Or5Rax      5, 3, 0, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes3Or5Target   5, 3, 0, 1, 0, OP_CopyBytes
 #endif
-#define ENTRY_CopyBytes4            4, 4, 0, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes5            5, 5, 0, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes5Or7Dynamic  7, 5, 0, 0, DYNAMIC, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes7            7, 7, 0, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes2Mod         2, 2, 1, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes2ModDynamic  2, 2, 1, 0, DYNAMIC, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes2Mod1        3, 3, 1, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes2ModOperand  6, 4, 1, 0, 0, &CDetourDis::CopyBytes
-#define ENTRY_CopyBytes3Mod         3, 3, 2, 0, 0, &CDetourDis::CopyBytes // SSE3 0F 38 opcode modrm
-#define ENTRY_CopyBytes3Mod1        4, 4, 2, 0, 0, &CDetourDis::CopyBytes // SSE3 0F 3A opcode modrm .. imm8
-#define ENTRY_CopyBytesPrefix       ENTRY_DataIgnored &CDetourDis::CopyBytesPrefix
-#define ENTRY_CopyBytesSegment      ENTRY_DataIgnored &CDetourDis::CopyBytesSegment
-#define ENTRY_CopyBytesRax          ENTRY_DataIgnored &CDetourDis::CopyBytesRax
-#define ENTRY_CopyF2                ENTRY_DataIgnored &CDetourDis::CopyF2
-#define ENTRY_CopyF3                ENTRY_DataIgnored &CDetourDis::CopyF3   // 32bit x86 only
-#define ENTRY_Copy0F                ENTRY_DataIgnored &CDetourDis::Copy0F
-#define ENTRY_Copy0F78              ENTRY_DataIgnored &CDetourDis::Copy0F78
-#define ENTRY_Copy0F00              ENTRY_DataIgnored &CDetourDis::Copy0F00 // 32bit x86 only
-#define ENTRY_Copy0FB8              ENTRY_DataIgnored &CDetourDis::Copy0FB8 // 32bit x86 only
-#define ENTRY_Copy66                ENTRY_DataIgnored &CDetourDis::Copy66
-#define ENTRY_Copy67                ENTRY_DataIgnored &CDetourDis::Copy67
-#define ENTRY_CopyF6                ENTRY_DataIgnored &CDetourDis::CopyF6
-#define ENTRY_CopyF7                ENTRY_DataIgnored &CDetourDis::CopyF7
-#define ENTRY_CopyFF                ENTRY_DataIgnored &CDetourDis::CopyFF
-#define ENTRY_CopyVex2              ENTRY_DataIgnored &CDetourDis::CopyVex2
-#define ENTRY_CopyVex3              ENTRY_DataIgnored &CDetourDis::CopyVex3
-#define ENTRY_CopyEvex              ENTRY_DataIgnored &CDetourDis::CopyEvex // 62, 3 byte payload, then normal with implied prefixes like vex
-#define ENTRY_CopyXop               ENTRY_DataIgnored &CDetourDis::CopyXop   // 0x8F ... POP /0 or AMD XOP
-#define ENTRY_CopyBytesXop          5, 5, 4, 0, 0, &CDetourDis::CopyBytes // 0x8F xop1 xop2 opcode modrm
-#define ENTRY_CopyBytesXop1         6, 6, 4, 0, 0, &CDetourDis::CopyBytes // 0x8F xop1 xop2 opcode modrm ... imm8
-#define ENTRY_CopyBytesXop4         9, 9, 4, 0, 0, &CDetourDis::CopyBytes // 0x8F xop1 xop2 opcode modrm ... imm32
-#define ENTRY_Invalid               ENTRY_DataIgnored &CDetourDis::Invalid
-#define ENTRY_End                   ENTRY_DataIgnored NULL
-
+#define ENTRY_CopyBytes4            4, 4, 0, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes5            5, 5, 0, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes5Or7Dynamic  7, 5, 0, 0, DYNAMIC, OP_CopyBytes
+#define ENTRY_CopyBytes7            7, 7, 0, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes2Mod         2, 2, 1, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes2ModDynamic  2, 2, 1, 0, DYNAMIC, OP_CopyBytes
+#define ENTRY_CopyBytes2Mod1        3, 3, 1, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes2ModOperand  6, 4, 1, 0, 0, OP_CopyBytes
+#define ENTRY_CopyBytes3Mod         3, 3, 2, 0, 0, OP_CopyBytes // SSE3 0F 38 opcode modrm
+#define ENTRY_CopyBytes3Mod1        4, 4, 2, 0, 0, OP_CopyBytes // SSE3 0F 3A opcode modrm .. imm8
+#define ENTRY_CopyBytesPrefix       ENTRY_DataIgnored OP_CopyBytesPrefix
+#define ENTRY_CopyBytesSegment      ENTRY_DataIgnored OP_CopyBytesSegment
+#define ENTRY_CopyBytesRax          ENTRY_DataIgnored OP_CopyBytesRax
+#define ENTRY_CopyF2                ENTRY_DataIgnored OP_CopyF2
+#define ENTRY_CopyF3                ENTRY_DataIgnored OP_CopyF3   // 32bit x86 only
+#define ENTRY_Copy0F                ENTRY_DataIgnored OP_Copy0F
+#define ENTRY_Copy0F78              ENTRY_DataIgnored OP_Copy0F78
+#define ENTRY_Copy0F00              ENTRY_DataIgnored OP_Copy0F00 // 32bit x86 only
+#define ENTRY_Copy0FB8              ENTRY_DataIgnored OP_Copy0FB8 // 32bit x86 only
+#define ENTRY_Copy66                ENTRY_DataIgnored OP_Copy66
+#define ENTRY_Copy67                ENTRY_DataIgnored OP_Copy67
+#define ENTRY_CopyF6                ENTRY_DataIgnored OP_CopyF6
+#define ENTRY_CopyF7                ENTRY_DataIgnored OP_CopyF7
+#define ENTRY_CopyFF                ENTRY_DataIgnored OP_CopyFF
+#define ENTRY_CopyVex2              ENTRY_DataIgnored OP_CopyVex2
+#define ENTRY_CopyVex3              ENTRY_DataIgnored OP_CopyVex3
+#define ENTRY_CopyEvex              ENTRY_DataIgnored OP_CopyEvex // 62, 3 byte payload, then normal with implied prefixes like vex
+#define ENTRY_CopyXop               ENTRY_DataIgnored OP_CopyXop   // 0x8F ... POP /0 or AMD XOP
+#define ENTRY_CopyRex2              ENTRY_DataIgnored OP_CopyRex2  // 0xD5, 1 byte payload, x64 only
+#define ENTRY_CopyBytesXop          5, 5, 4, 0, 0, OP_CopyBytes // 0x8F xop1 xop2 opcode modrm
+#define ENTRY_CopyBytesXop1         6, 6, 4, 0, 0, OP_CopyBytes // 0x8F xop1 xop2 opcode modrm ... imm8
+#define ENTRY_CopyBytesXop4         9, 9, 4, 0, 0, OP_CopyBytes // 0x8F xop1 xop2 opcode modrm ... imm32
+#define ENTRY_Invalid               ENTRY_DataIgnored OP_Invalid
+#define ENTRY_End                   ENTRY_DataIgnored OP_End
+
+    PBYTE Dispatch(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc);
     PBYTE CopyBytes(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc);
     PBYTE CopyBytesPrefix(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc);
     PBYTE CopyBytesSegment(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc);
@@ -284,6 +340,19 @@ class CDetourDis
     PBYTE CopyVexEvexCommon(BYTE m, PBYTE pbDst, PBYTE pbSrc, BYTE p);
     PBYTE CopyEvex(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc);
     PBYTE CopyXop(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc);
+    PBYTE CopyEvexMap4(PBYTE pbDst, PBYTE pbSrc);
+    PBYTE CopyRex2(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc); // x64 only
+
+  protected:
+    static constexpr BOOL CheckCopyTable(const COPYENTRY *pTable, ULONG n)
+    {
+        return (n == 256)
+            ? pTable[256].nCopy == OP_End
+            : (pTable[n].nOpcode == n &&
+               pTable[n].nCopy != OP_End &&
+               (pTable[n].nCopy != OP_CopyBytes || pTable[n].nFixedSize != 0) &&
+               CheckCopyTable(pTable, n + 1));
+    }
 
   protected:
     static const COPYENTRY  s_rceCopyTable[257];
@@ -302,6 +371,8 @@ class CDetourDis
     BOOL                m_bF2;
     BOOL                m_bF3; // x86 only
     BYTE                m_nSegmentOverride;
+    BOOL                m_bPaddedCopy;      // pbSrc is a copy; don't read through it.
+    BOOL                m_bAbsoluteTarget;  // *m_ppbTarget isn't relative to pbSrc.
 
     PBYTE *             m_ppbTarget;
     LONG *              m_plExtra;
@@ -327,6 +398,18 @@ PVOID WINAPI DetourCopyInstruction(_In_opt_ PVOID pDst,
 //
 CDetourDis::CDetourDis(_Out_opt_ PBYTE *ppbTarget, _Out_opt_ LONG *plExtra)
 {
+    m_ppbTarget = ppbTarget ? ppbTarget : &m_pbScratchTarget;
+    m_plExtra = plExtra ? plExtra : &m_lScratchExtra;
+
+    Reset();
+}
+
+VOID CDetourDis::Reset(BOOL fPaddedCopy)
+{
+    // Clear the prefix state so one instance can decode a run of instructions.
+    // When the next instruction is decoded from a padded copy of the code,
+    // memory-indirect targets are reported as dynamic, since their slots
+    // would be located relative to the copy.
     m_bOperandOverride = FALSE;
     m_bAddressOverride = FALSE;
     m_bRaxOverride = FALSE;
@@ -334,9 +417,8 @@ CDetourDis::CDetourDis(_Out_opt_ PBYTE *ppbTarget, _Out_opt_ LONG *plExtra)
     m_bF3 = FALSE;
     m_bVex = FALSE;
     m_bEvex = FALSE;
-
-    m_ppbTarget = ppbTarget ? ppbTarget : &m_pbScratchTarget;
-    m_plExtra = plExtra ? plExtra : &m_lScratchExtra;
+    m_bPaddedCopy = fPaddedCopy;
+    m_bAbsoluteTarget = FALSE;
 
     *m_ppbTarget = (PBYTE)DETOUR_INSTRUCTION_TARGET_NONE;
     *m_plExtra = 0;
@@ -358,7 +440,44 @@ PBYTE CDetourDis::CopyInstruction(PBYTE pbDst, PBYTE pbSrc)
     // and figure out what the target of the instruction is if any.
     //
     REFCOPYENTRY pEntry = &s_rceCopyTable[pbSrc[0]];
-    return (this->*pEntry->pfCopy)(pEntry, pbDst, pbSrc);
+    return Dispatch(pEntry, pbDst, pbSrc);
+}
+
+PBYTE CDetourDis::Dispatch(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
+{
+    // A switch over the handler id replaces the member-function pointer
+    // that each table entry used to carry.  Plain CopyBytes is tested first
+    // because it covers most opcodes; it already measures them from the
+    // packed entry, so the test compiles to a tail call and an inline copy
+    // of its length logic gains nothing measurable.
+    if (pEntry->nCopy == OP_CopyBytes) {
+        return CopyBytes(pEntry, pbDst, pbSrc);
+    }
+
+    switch (pEntry->nCopy) {
+      case OP_CopyBytesPrefix:  return CopyBytesPrefix(pEntry, pbDst, pbSrc);
+      case OP_CopyBytesSegment: return CopyBytesSegment(pEntry, pbDst, pbSrc);
+      case OP_CopyBytesRax:     return CopyBytesRax(pEntry, pbDst, pbSrc);
+      case OP_CopyBytesJump:    return CopyBytesJump(pEntry, pbDst, pbSrc);
+      case OP_Copy0F:           return Copy0F(pEntry, pbDst, pbSrc);
+      case OP_Copy0F00:         return Copy0F00(pEntry, pbDst, pbSrc);
+      case OP_Copy0F78:         return Copy0F78(pEntry, pbDst, pbSrc);
+      case OP_Copy0FB8:         return Copy0FB8(pEntry, pbDst, pbSrc);
+      case OP_Copy66:           return Copy66(pEntry, pbDst, pbSrc);
+      case OP_Copy67:           return Copy67(pEntry, pbDst, pbSrc);
+      case OP_CopyF2:           return CopyF2(pEntry, pbDst, pbSrc);
+      case OP_CopyF3:           return CopyF3(pEntry, pbDst, pbSrc);
+      case OP_CopyF6:           return CopyF6(pEntry, pbDst, pbSrc);
+      case OP_CopyF7:           return CopyF7(pEntry, pbDst, pbSrc);
+      case OP_CopyFF:           return CopyFF(pEntry, pbDst, pbSrc);
+      case OP_CopyVex2:         return CopyVex2(pEntry, pbDst, pbSrc);
+      case OP_CopyVex3:         return CopyVex3(pEntry, pbDst, pbSrc);
+      case OP_CopyEvex:         return CopyEvex(pEntry, pbDst, pbSrc);
+      case OP_CopyXop:          return CopyXop(pEntry, pbDst, pbSrc);
+      case OP_CopyRex2:         return CopyRex2(pEntry, pbDst, pbSrc);
+      case OP_Invalid:
+      default:                  return Invalid(pEntry, pbDst, pbSrc);
+    }
 }
 
 PBYTE CDetourDis::CopyBytes(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
@@ -446,7 +565,7 @@ PBYTE CDetourDis::CopyBytesPrefix(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
 {
     pbDst[0] = pbSrc[0];
     pEntry = &s_rceCopyTable[pbSrc[1]];
-    return (this->*pEntry->pfCopy)(pEntry, pbDst + 1, pbSrc + 1);
+    return Dispatch(pEntry, pbDst + 1, pbSrc + 1);
 }
 
 PBYTE CDetourDis::CopyBytesSegment(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
@@ -590,7 +709,7 @@ PBYTE CDetourDis::Copy0F(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
 {
     pbDst[0] = pbSrc[0];
     pEntry = &s_rceCopyTable0F[pbSrc[1]];
-    return (this->*pEntry->pfCopy)(pEntry, pbDst + 1, pbSrc + 1);
+    return Dispatch(pEntry, pbDst + 1, pbSrc + 1);
 }
 
 PBYTE CDetourDis::Copy0F78(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
@@ -608,7 +727,7 @@ PBYTE CDetourDis::Copy0F78(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
 
     REFCOPYENTRY const pEntry = ((m_bF2 || m_bOperandOverride) ? &extrq_insertq : &vmread);
 
-    return (this->*pEntry->pfCopy)(pEntry, pbDst, pbSrc);
+    return CopyBytes(pEntry, pbDst, pbSrc);
 }
 
 PBYTE CDetourDis::Copy0F00(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
@@ -620,7 +739,7 @@ PBYTE CDetourDis::Copy0F00(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
     static const COPYENTRY jmpe = { 0xB8, ENTRY_CopyBytes2ModDynamic }; // jmpe/6 x86-on-IA64 syscalls
 
     REFCOPYENTRY const pEntry = (((6 << 3) == ((7 << 3) & pbSrc[1])) ?  &jmpe : &other);
-    return (this->*pEntry->pfCopy)(pEntry, pbDst, pbSrc);
+    return CopyBytes(pEntry, pbDst, pbSrc);
 }
 
 PBYTE CDetourDis::Copy0FB8(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
@@ -630,7 +749,7 @@ PBYTE CDetourDis::Copy0FB8(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
     static const COPYENTRY popcnt = { 0xB8, ENTRY_CopyBytes2Mod };
     static const COPYENTRY jmpe = { 0xB8, ENTRY_CopyBytes3Or5Dynamic }; // jmpe x86-on-IA64 syscalls
     REFCOPYENTRY const pEntry = m_bF3 ? &popcnt : &jmpe;
-    return (this->*pEntry->pfCopy)(pEntry, pbDst, pbSrc);
+    return CopyBytes(pEntry, pbDst, pbSrc);
 }
 
 PBYTE CDetourDis::Copy66(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
@@ -662,9 +781,10 @@ PBYTE CDetourDis::CopyF6(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
     (void)pEntry;
 
     // TEST BYTE /0
-    if (0x00 == (0x38 & pbSrc[1])) {    // reg(bits 543) of ModR/M == 0
+    // TEST BYTE /1 (undocumented alias, also takes an immediate)
+    if (0x00 == (0x30 & pbSrc[1])) {    // reg(bits 543) of ModR/M == 0 or 1
         static const COPYENTRY ce = { 0xf6, ENTRY_CopyBytes2Mod1 };
-        return (this->*ce.pfCopy)(&ce, pbDst, pbSrc);
+        return CopyBytes(&ce, pbDst, pbSrc);
     }
     // DIV /6
     // IDIV /7
@@ -674,7 +794,7 @@ PBYTE CDetourDis::CopyF6(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
     // NOT /2
 
     static const COPYENTRY ce = { 0xf6, ENTRY_CopyBytes2Mod };
-    return (this->*ce.pfCopy)(&ce, pbDst, pbSrc);
+    return CopyBytes(&ce, pbDst, pbSrc);
 }
 
 PBYTE CDetourDis::CopyF7(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
@@ -682,9 +802,10 @@ PBYTE CDetourDis::CopyF7(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
     (void)pEntry;
 
     // TEST WORD /0
-    if (0x00 == (0x38 & pbSrc[1])) {    // reg(bits 543) of ModR/M == 0
+    // TEST WORD /1 (undocumented alias, also takes an immediate)
+    if (0x00 == (0x30 & pbSrc[1])) {    // reg(bits 543) of ModR/M == 0 or 1
         static const COPYENTRY ce = { 0xf7, ENTRY_CopyBytes2ModOperand };
-        return (this->*ce.pfCopy)(&ce, pbDst, pbSrc);
+        return CopyBytes(&ce, pbDst, pbSrc);
     }
 
     // DIV /6
@@ -694,7 +815,7 @@ PBYTE CDetourDis::CopyF7(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
     // NEG /3
     // NOT /2
     static const COPYENTRY ce = { 0xf7, ENTRY_CopyBytes2Mod };
-    return (this->*ce.pfCopy)(&ce, pbDst, pbSrc);
+    return CopyBytes(&ce, pbDst, pbSrc);
 }
 
 PBYTE CDetourDis::CopyFF(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
@@ -709,11 +830,14 @@ PBYTE CDetourDis::CopyFF(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
     (void)pEntry;
 
     static const COPYENTRY ce = { 0xff, ENTRY_CopyBytes2Mod };
-    PBYTE pbOut = (this->*ce.pfCopy)(&ce, pbDst, pbSrc);
+    PBYTE pbOut = CopyBytes(&ce, pbDst, pbSrc);
 
     BYTE const b1 = pbSrc[1];
 
-    if (0x15 == b1 || 0x25 == b1) {         // CALL [], JMP []
+    if ((0x15 == b1 || 0x25 == b1) && m_bPaddedCopy) {
+        *m_ppbTarget = (PBYTE)DETOUR_INSTRUCTION_TARGET_DYNAMIC;
+    }
+    else if (0x15 == b1 || 0x25 == b1) {    // CALL [], JMP []
 #ifdef DETOURS_X64
         // All segments but FS and GS are equivalent.
         if (m_nSegmentOverride != 0x64 && m_nSegmentOverride != 0x65)
@@ -735,6 +859,7 @@ PBYTE CDetourDis::CopyFF(REFCOPYENTRY pEntry, PBYTE pbDst, PBYTE pbSrc)
             else {
                 // This can access violate on random bytes. Use DetourSetCodeModule.
                 *m_ppbTarget = *ppbTarget;
+                m_bAbsoluteTarget = TRUE;
             }
         }
         else {
@@ -754,6 +879,7 @@ PBYTE CDetourDis::CopyVexEvexCommon(BYTE m, PBYTE pbDst, PBYTE pbSrc, BYTE p)
 {
     static const COPYENTRY ceF38 = { 0x38, ENTRY_CopyBytes2Mod };
     static const COPYENTRY ceF3A = { 0x3A, ENTRY_CopyBytes2Mod1 };
+    static const COPYENTRY ceMap7 = { 0xF8, ENTRY_CopyBytes2ModOperand }; // USER_MSR /0 id
     static const COPYENTRY ceInvalid = { 0xC4, ENTRY_Invalid };
 
     switch (p & 3) {
@@ -767,10 +893,53 @@ PBYTE CDetourDis::CopyVexEvexCommon(BYTE m, PBYTE pbDst, PBYTE pbSrc, BYTE p)
 
     switch (m) {
     default: return Invalid(&ceInvalid, pbDst, pbSrc);
-    case 1:  pEntry = &s_rceCopyTable0F[pbSrc[0]];
-             return (this->*pEntry->pfCopy)(pEntry, pbDst, pbSrc);
+    case 1:  if (m_bEvex && (pbSrc[0] & 0xFC) == 0x78) {
+                 // AVX512 unsigned conversions reuse VMREAD/VMWRITE/_7A/_7B.
+                 return CopyBytes(&ceF38, pbDst, pbSrc);
+             }
+             pEntry = &s_rceCopyTable0F[pbSrc[0]];
+             return Dispatch(pEntry, pbDst, pbSrc);
     case 2:  return CopyBytes(&ceF38, pbDst, pbSrc);
     case 3:  return CopyBytes(&ceF3A, pbDst, pbSrc);
+    case 4:  if (!m_bEvex) {                        // APX promoted legacy, EVEX only
+                 return Invalid(&ceInvalid, pbDst, pbSrc);
+             }
+             return CopyEvexMap4(pbDst, pbSrc);
+    case 5:                                         // AVX512-FP16, EVEX only
+    case 6:  if (!m_bEvex) {
+                 return Invalid(&ceInvalid, pbDst, pbSrc);
+             }
+             return CopyBytes(&ceF38, pbDst, pbSrc);
+    case 7:  return CopyBytes(&ceMap7, pbDst, pbSrc);
+    }
+}
+
+PBYTE CDetourDis::CopyEvexMap4(PBYTE pbDst, PBYTE pbSrc)
+// EVEX map 4 holds the APX promotions of legacy opcodes.  Every one has a
+// ModR/M byte; the immediates follow the legacy one byte map.
+{
+    static const COPYENTRY ceMod = { 0x01, ENTRY_CopyBytes2Mod };
+    static const COPYENTRY ceMod1 = { 0x80, ENTRY_CopyBytes2Mod1 };
+    static const COPYENTRY ceModOperand = { 0x81, ENTRY_CopyBytes2ModOperand };
+
+    switch (pbSrc[0]) {
+    case 0x24:                                      // SHLD /r ib
+    case 0x2C:                                      // SHRD /r ib
+    case 0x6B:                                      // IMUL /r ib
+    case 0x80:                                      // ALU and CCMP /n ib
+    case 0x83:
+    case 0xC0:                                      // Shifts /n ib
+    case 0xC1:
+        return CopyBytes(&ceMod1, pbDst, pbSrc);
+    case 0x69:                                      // IMUL /r iz
+    case 0x81:                                      // ALU and CCMP /n iz
+        return CopyBytes(&ceModOperand, pbDst, pbSrc);
+    case 0xF6:                                      // CTEST /0 ib
+        return CopyBytes(((pbSrc[1] & 0x38) == 0x00) ? &ceMod1 : &ceMod, pbDst, pbSrc);
+    case 0xF7:                                      // CTEST /0 iz
+        return CopyBytes(((pbSrc[1] & 0x38) == 0x00) ? &ceModOperand : &ceMod, pbDst, pbSrc);
+    default:
+        return CopyBytes(&ceMod, pbDst, pbSrc);
     }
 }
 
@@ -791,7 +960,7 @@ PBYTE CDetourDis::CopyVex3(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
     const static COPYENTRY ceLES = { 0xC4, ENTRY_CopyBytes2Mod };
     if ((pbSrc[1] & 0xC0) != 0xC0) {
         REFCOPYENTRY pEntry = &ceLES;
-        return (this->*pEntry->pfCopy)(pEntry, pbDst, pbSrc);
+        return CopyBytes(pEntry, pbDst, pbSrc);
     }
 #endif
     pbDst[0] = pbSrc[0];
@@ -836,7 +1005,7 @@ PBYTE CDetourDis::CopyVex2(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
     const static COPYENTRY ceLDS = { 0xC5, ENTRY_CopyBytes2Mod };
     if ((pbSrc[1] & 0xC0) != 0xC0) {
         REFCOPYENTRY pEntry = &ceLDS;
-        return (this->*pEntry->pfCopy)(pEntry, pbDst, pbSrc);
+        return CopyBytes(pEntry, pbDst, pbSrc);
     }
 #endif
     pbDst[0] = pbSrc[0];
@@ -860,15 +1029,16 @@ PBYTE CDetourDis::CopyEvex(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
     }
 #endif
 
-    static const COPYENTRY ceInvalid = { 0x62, ENTRY_Invalid };
-
-    if ((p0 & 0x0C) != 0)
-        return Invalid(&ceInvalid, pbDst, pbSrc);
-
     BYTE const p1 = pbSrc[2];
 
-    if ((p1 & 0x04) != 0x04)
+#ifdef DETOURS_X86
+    static const COPYENTRY ceInvalid = { 0x62, ENTRY_Invalid };
+
+    // P0 bit 3 must be 0 and P1 bit 2 must be 1.  On x64, APX reuses them
+    // as B4 and the inverted X4 for the extended general purpose registers.
+    if ((p0 & 0x08) != 0 || (p1 & 0x04) != 0x04)
         return Invalid(&ceInvalid, pbDst, pbSrc);
+#endif
 
     // Copy 4 byte prefix.
     *(UNALIGNED ULONG *)pbDst = *(UNALIGNED ULONG*)pbSrc;
@@ -879,7 +1049,8 @@ PBYTE CDetourDis::CopyEvex(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
     m_bRaxOverride |= !!(p1 & 0x80); // w
 #endif
 
-    return CopyVexEvexCommon(p0 & 3u, pbDst + 4, pbSrc + 4, p1 & 3u);
+    // mmm selects maps 1-3 as with VEX, 4 for APX and 5-6 for AVX512-FP16.
+    return CopyVexEvexCommon(p0 & 7u, pbDst + 4, pbSrc + 4, p1 & 3u);
 }
 
 PBYTE CDetourDis::CopyXop(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
@@ -916,11 +1087,77 @@ pp is like VEX but only instructions with 0 are defined
     }
 }
 
+PBYTE CDetourDis::CopyRex2(REFCOPYENTRY, PBYTE pbDst, PBYTE pbSrc)
+/* 2 byte APX REX2 prefix 0xD5, x64 only (AAD on x86)
+byte0: 0xD5
+byte1: M0 R4 X4 B4 W R3 X3 B3
+byte2: opcode in the legacy one byte map (M0 = 0) or 0F map (M0 = 1)
+REX2 is always the last prefix, so escapes and prefixes may not follow it.
+*/
+{
+    static const COPYENTRY cePop = { 0x8F, ENTRY_CopyBytes2Mod };
+    static const COPYENTRY ceInvalid = { 0xD5, ENTRY_Invalid };
+
+    BYTE const p = pbSrc[1];
+    BYTE const bOpcode = pbSrc[2];
+    REFCOPYENTRY pEntry;
+
+    if (p & 0x80) {
+        if (bOpcode == 0x38 || bOpcode == 0x3A) {   // 3 byte maps have no REX2 form
+            return Invalid(&ceInvalid, pbDst, pbSrc);
+        }
+        pEntry = &s_rceCopyTable0F[bOpcode];
+    }
+    else if (bOpcode == 0x8F) {                     // POP /0, never XOP here
+        pEntry = &cePop;
+    }
+    else {
+        pEntry = &s_rceCopyTable[bOpcode];
+        switch (pEntry->nCopy) {
+          case OP_CopyBytesPrefix:
+          case OP_CopyBytesSegment:
+          case OP_CopyBytesRax:
+          case OP_Copy0F:
+          case OP_Copy66:
+          case OP_Copy67:
+          case OP_CopyF2:
+          case OP_CopyF3:
+          case OP_CopyVex2:
+          case OP_CopyVex3:
+          case OP_CopyEvex:
+          case OP_CopyRex2:
+            return Invalid(&ceInvalid, pbDst, pbSrc);
+        }
+    }
+
+    pbDst[0] = pbSrc[0];
+    pbDst[1] = p;
+    if (p & 0x08) {
+        m_bRaxOverride = TRUE;                      // W, see CopyBytesRax
+    }
+
+    PBYTE pbOut = Dispatch(pEntry, pbDst + 2, pbSrc + 2);
+
+    if (p == 0x00 && bOpcode == 0xA1) {             // JMPABS imm64
+        *m_ppbTarget = (PBYTE)*(UNALIGNED ULONG_PTR *)&pbSrc[3];
+        m_bAbsoluteTarget = TRUE;
+    }
+    return pbOut;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
+#ifdef DETOURS_OFFLINE_PORTABLE
+// Portable builds decode code read from files, not a loaded image, so
+// indirect targets are not dereferenced until DetourSetCodeModule names one.
+PBYTE CDetourDis::s_pbModuleBeg = NULL;
+PBYTE CDetourDis::s_pbModuleEnd = NULL;
+BOOL CDetourDis::s_fLimitReferencesToModule = TRUE;
+#else
 PBYTE CDetourDis::s_pbModuleBeg = NULL;
 PBYTE CDetourDis::s_pbModuleEnd = (PBYTE)~(ULONG_PTR)0;
 BOOL CDetourDis::s_fLimitReferencesToModule = FALSE;
+#endif
 
 BOOL CDetourDis::SetCodeModule(PBYTE pbBeg, PBYTE pbEnd, BOOL fLimitReferencesToModule)
 {
@@ -956,7 +1193,7 @@ const BYTE CDetourDis::s_rbModRm[256] = {
     0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0                  // Fx
 };
 
-const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable[257] =
+constexpr const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable[257] =
 {
     { 0x00, ENTRY_CopyBytes2Mod },                      // ADD /r
     { 0x01, ENTRY_CopyBytes2Mod },                      // ADD /r
@@ -1244,7 +1481,7 @@ const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable[257] =
     { 0xD3, ENTRY_CopyBytes2Mod },                      // RCL/2, etc.
 #ifdef DETOURS_X64
     { 0xD4, ENTRY_Invalid },                            // Invalid
-    { 0xD5, ENTRY_Invalid },                            // Invalid
+    { 0xD5, ENTRY_CopyRex2 },                           // APX REX2
 #else
     { 0xD4, ENTRY_CopyBytes2 },                         // AAM
     { 0xD5, ENTRY_CopyBytes2 },                         // AAD
@@ -1304,7 +1541,7 @@ const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable[257] =
     { 0, ENTRY_End },
 };
 
-const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable0F[257] =
+constexpr const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable0F[257] =
 {
 #ifdef DETOURS_X86
     { 0x00, ENTRY_Copy0F00 },                           // sldt/0 str/1 lldt/2 ltr/3 err/4 verw/5 jmpe/6/dynamic invalid/7
@@ -1342,10 +1579,10 @@ const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable0F[257] =
     { 0x1D, ENTRY_CopyBytes2Mod },                      // NOP/r multi byte nop, not documented by Intel, documented by AMD
     { 0x1E, ENTRY_CopyBytes2Mod },                      // NOP/r multi byte nop, not documented by Intel, documented by AMD
     { 0x1F, ENTRY_CopyBytes2Mod },                      // NOP/r multi byte nop
-    { 0x20, ENTRY_CopyBytes2Mod },                      // MOV/r
-    { 0x21, ENTRY_CopyBytes2Mod },                      // MOV/r
-    { 0x22, ENTRY_CopyBytes2Mod },                      // MOV/r
-    { 0x23, ENTRY_CopyBytes2Mod },                      // MOV/r
+    { 0x20, ENTRY_CopyBytes2 },                         // MOV/r (mod is ignored, always a register)
+    { 0x21, ENTRY_CopyBytes2 },                         // MOV/r
+    { 0x22, ENTRY_CopyBytes2 },                         // MOV/r
+    { 0x23, ENTRY_CopyBytes2 },                         // MOV/r
 #ifdef DETOURS_X64
     { 0x24, ENTRY_Invalid },                            // _24
 #else
@@ -1525,7 +1762,7 @@ const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable0F[257] =
 #else
     { 0xB8, ENTRY_CopyBytes2Mod },                      // f3/popcnt
 #endif
-    { 0xB9, ENTRY_Invalid },                            // _B9
+    { 0xB9, ENTRY_CopyBytes2Mod },                      // UD1
     { 0xBA, ENTRY_CopyBytes2Mod1 },                     // BT & BTC & BTR & BTS (0F BA)
     { 0xBB, ENTRY_CopyBytes2Mod },                      // BTC (0F BB)
     { 0xBC, ENTRY_CopyBytes2Mod },                      // BSF (0F BC)
@@ -1595,12 +1832,16 @@ const CDetourDis::COPYENTRY CDetourDis::s_rceCopyTable0F[257] =
     { 0xFC, ENTRY_CopyBytes2Mod },                      // PADDB/r
     { 0xFD, ENTRY_CopyBytes2Mod },                      // PADDW/r
     { 0xFE, ENTRY_CopyBytes2Mod },                      // PADDD/r
-    { 0xFF, ENTRY_Invalid },                            // _FF
+    { 0xFF, ENTRY_CopyBytes2Mod },                      // UD0
     { 0, ENTRY_End },
 };
 
 BOOL CDetourDis::SanityCheckSystem()
 {
+    static_assert(sizeof(COPYENTRY) == sizeof(ULONG), "COPYENTRY must stay one dense word.");
+    static_assert(CheckCopyTable(s_rceCopyTable, 0), "s_rceCopyTable is malformed.");
+    static_assert(CheckCopyTable(s_rceCopyTable0F, 0), "s_rceCopyTable0F is malformed.");
+
     ULONG n = 0;
     for (; n < 256; n++) {
         REFCOPYENTRY pEntry = &s_rceCopyTable[n];
@@ -1610,7 +1851,7 @@ BOOL CDetourDis::SanityCheckSystem()
             return FALSE;
         }
     }
-    if (s_rceCopyTable[256].pfCopy != NULL) {
+    if (s_rceCopyTable[256].nCopy != OP_End) {
         ASSERT(!"Missing end marker.");
         return FALSE;
     }
@@ -1623,7 +1864,7 @@ BOOL CDetourDis::SanityCheckSystem()
             return FALSE;
         }
     }
-    if (s_rceCopyTable0F[256].pfCopy != NULL) {
+    if (s_rceCopyTable0F[256].nCopy != OP_End) {
         ASSERT(!"Missing end marker.");
         return FALSE;
     }
@@ -4303,6 +4544,707 @@ PVOID WINAPI DetourCopyInstruction(_In_opt_ PVOID pDst,
 
 #endif // DETOURS_ARM64
 
+///////////////////////////////////////////////////////////// Batch Decoding.
+//
+//  Function:
+//      DetourDecodeInstructions(PVOID pCode,
+//                               ULONG cbCode,
+//                               PDETOUR_INSTRUCTION pInstructions,
+//                               ULONG cMaxInstructions,
+//                               ULONG *pcbDecoded)
+//  Purpose:
+//      Measure a run of instructions in a single pass.
+//
+//  Arguments:
+//      pCode:
+//          Start of the code to decode.
+//      cbCode:
+//          Number of bytes readable at pCode.  No byte beyond pCode + cbCode
+//          is read, even when the last instruction is truncated.
+//      pInstructions:
+//          Out array receiving the offset, length, extra bytes and target
+//          of each instruction, in the same form DetourCopyInstruction
+//          reports them through ppTarget and plExtra.
+//      cMaxInstructions:
+//          Number of entries available in pInstructions.
+//      pcbDecoded:
+//          Out parameter for the offset at which decoding stopped.  This is
+//          less than cbCode if pInstructions filled up or the final
+//          instruction extends past the end of the buffer.  May be NULL.
+//
+//  Returns:
+//      Returns the number of instructions stored in pInstructions.
+//
+//  Comments:
+//      On x86 and x64 a single CDetourDis is reused for the whole run so
+//      that sweeping an entire code section does not pay the per-call setup
+//      of DetourCopyInstruction.  Instructions near the end of the buffer
+//      are decoded from a zero-padded copy.  Their relative targets are
+//      rebased to the original address; their memory-indirect targets are
+//      reported as DETOUR_INSTRUCTION_TARGET_DYNAMIC.
+//
+#define DETOUR_DECODE_SLOP  64  // Readahead that may be consumed by one decode.
+
+ULONG WINAPI DetourDecodeInstructions(_In_reads_bytes_(cbCode) PVOID pCode,
+                                      _In_ ULONG cbCode,
+                                      _Out_writes_(cMaxInstructions) PDETOUR_INSTRUCTION pInstructions,
+                                      _In_ ULONG cMaxInstructions,
+                                      _Out_opt_ ULONG *pcbDecoded)
+{
+    PBYTE pbCode = (PBYTE)pCode;
+    PBYTE pbTarget = NULL;
+    LONG lExtra = 0;
+    BYTE rbTail[DETOUR_DECODE_SLOP];
+    ULONG nOffset = 0;
+    ULONG nInstructions = 0;
+
+#if defined(DETOURS_X64) || defined(DETOURS_X86)
+    CDetourDis oDetourDisasm(&pbTarget, &lExtra);
+#endif
+
+    if (pbCode == NULL || (pInstructions == NULL && cMaxInstructions != 0)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        if (pcbDecoded != NULL) {
+            *pcbDecoded = 0;
+        }
+        return 0;
+    }
+
+    while (nOffset < cbCode && nInstructions < cMaxInstructions) {
+        PBYTE pbSrc = pbCode + nOffset;
+        PBYTE pbDecode = pbSrc;
+        ULONG cbLeft = cbCode - nOffset;
+
+        if (cbLeft < DETOUR_DECODE_SLOP) {
+            ZeroMemory(rbTail, sizeof(rbTail));
+            CopyMemory(rbTail, pbSrc, cbLeft);
+            pbDecode = rbTail;
+        }
+
+#if defined(DETOURS_X64) || defined(DETOURS_X86)
+        oDetourDisasm.Reset(pbDecode != pbSrc);
+        PBYTE pbNext = oDetourDisasm.CopyInstruction(NULL, pbDecode);
+        BOOL fRelative = !oDetourDisasm.IsTargetAbsolute();
+#else
+        PBYTE pbNext = (PBYTE)DetourCopyInstruction(NULL, NULL, pbDecode,
+                                                    (PVOID *)&pbTarget, &lExtra);
+        BOOL fRelative = TRUE;
+#endif
+        if (pbNext == NULL) {
+            break;
+        }
+
+        ULONG cbInstruction = (ULONG)(pbNext - pbDecode);
+        if (cbInstruction == 0 || cbInstruction > cbLeft) {
+            // Truncated by the end of the buffer; let the caller resume here.
+            break;
+        }
+
+        if (pbDecode != pbSrc && fRelative &&
+            pbTarget != (PBYTE)DETOUR_INSTRUCTION_TARGET_NONE &&
+            pbTarget != (PBYTE)DETOUR_INSTRUCTION_TARGET_DYNAMIC) {
+            pbTarget = pbSrc + (pbTarget - pbDecode);
+        }
+
+        PDETOUR_INSTRUCTION pInstruction = &pInstructions[nInstructions++];
+        pInstruction->nOffset = nOffset;
+        pInstruction->cbInstruction = (USHORT)cbInstruction;
+        pInstruction->nExtra = (SHORT)lExtra;
+        pInstruction->pTarget = pbTarget;
+
+        nOffset += cbInstruction;
+    }
+
+    if (pcbDecoded != NULL) {
+        *pcbDecoded = nOffset;
+    }
+    return nInstructions;
+}
+
+///////////////////////////////////////////////////////////// Function Graphs.
+//
+//  CDetourGraph discovers the basic blocks reachable from a function entry
+//  point by following the targets DetourCopyInstruction reports through
+//  ppTarget.  Instruction starts, covered bytes and branch targets (leaders)
+//  are kept as bitsets over the analyzed window, so the work per function is
+//  proportional to the code reached rather than to the size of the image.
+//
+//  Calls are assumed to return.  Indirect jumps end a path and are reported
+//  through DETOUR_GRAPH_DYNAMIC since their targets are unknown.
+//
+#define DETOUR_GRAPH_MAX_CODE   0x10000 // Largest window analyzed, in bytes.
+#define DETOUR_GRAPH_MAX_WORK   1024    // Pending branch targets.
+
+#if defined(DETOURS_X64) || defined(DETOURS_X86) || defined(DETOURS_ARM64)
+
+class CDetourGraph
+{
+  public:
+    enum KIND
+    {
+        KIND_NEXT = 0,      // Continues with the next instruction.
+        KIND_CALL,          // Calls and continues with the next instruction.
+        KIND_BRANCH,        // Conditional branch.
+        KIND_JUMP,          // Unconditional jump.
+        KIND_RETURN,
+        KIND_TRAP,          // Breakpoint, halt or undefined instruction.
+    };
+
+  public:
+    CDetourGraph(PBYTE pbCode, ULONG cbCode);
+
+    ULONG   Decode(ULONG nOffset, KIND *pnKind, PBYTE *ppbTarget);
+    VOID    Explore();
+    ULONG   Partition(PDETOUR_BASIC_BLOCK pBlocks, ULONG cMaxBlocks);
+    BOOL    HasLeader(ULONG nBeg, ULONG nEnd);
+
+    ULONG   Flags()             { return m_fFlags; }
+    ULONG   Instructions()      { return m_cInstructions; }
+    ULONG   Extent()            { return m_cbExtent; }
+
+  protected:
+    static KIND Classify(PBYTE pbCode);
+
+    static BOOL TestBit(const ULONG *pBits, ULONG nBit)
+    {
+        return (pBits[nBit >> 5] >> (nBit & 31)) & 1;
+    }
+    static VOID SetBit(ULONG *pBits, ULONG nBit)
+    {
+        pBits[nBit >> 5] |= 1u << (nBit & 31);
+    }
+    static ULONG NextBit(const ULONG *pBits, ULONG nBit, ULONG nLimit);
+
+    VOID    AddLeader(ULONG nOffset);
+
+  protected:
+    PBYTE       m_pbCode;
+    ULONG       m_cbCode;
+    ULONG       m_fFlags;
+    ULONG       m_cInstructions;
+    ULONG       m_cbExtent;
+    ULONG       m_nWork;
+#if defined(DETOURS_X64) || defined(DETOURS_X86)
+    PBYTE       m_pbTarget;
+    LONG        m_lExtra;
+    CDetourDis  m_oDisasm;
+#endif
+
+    ULONG       m_rnWork[DETOUR_GRAPH_MAX_WORK];
+    ULONG       m_rStarts[DETOUR_GRAPH_MAX_CODE / 32];      // Instruction starts.
+    ULONG       m_rCovered[DETOUR_GRAPH_MAX_CODE / 32];     // Bytes in decoded instructions.
+    ULONG       m_rLeaders[DETOUR_GRAPH_MAX_CODE / 32];     // Entry and branch targets.
+};
+
+CDetourGraph::CDetourGraph(PBYTE pbCode, ULONG cbCode)
+#if defined(DETOURS_X64) || defined(DETOURS_X86)
+    : m_oDisasm(&m_pbTarget, &m_lExtra)
+#endif
+{
+    if (cbCode > DETOUR_GRAPH_MAX_CODE) {
+        cbCode = DETOUR_GRAPH_MAX_CODE;
+    }
+    m_pbCode = pbCode;
+    m_cbCode = cbCode;
+    m_fFlags = 0;
+    m_cInstructions = 0;
+    m_cbExtent = 0;
+    m_nWork = 0;
+
+    ULONG cbBits = ((cbCode + 31) / 32) * sizeof(ULONG);
+    ZeroMemory(m_rStarts, cbBits);
+    ZeroMemory(m_rCovered, cbBits);
+    ZeroMemory(m_rLeaders, cbBits);
+}
+
+#if defined(DETOURS_X64) || defined(DETOURS_X86)
+
+CDetourGraph::KIND CDetourGraph::Classify(PBYTE pbCode)
+{
+    // Skip legacy prefixes (and REX on x64); they do not change the kind
+    // of a control transfer.  Prefixed ret/jmp/call include "rep ret" and
+    // the MPX/CET "bnd" and "notrack" forms.
+    for (ULONG n = 0; n < 14; n++) {
+        BYTE b = pbCode[0];
+        if (b == 0x26 || b == 0x2e || b == 0x36 || b == 0x3e ||
+            b == 0x64 || b == 0x65 || b == 0x66 || b == 0x67 ||
+            b == 0xf0 || b == 0xf2 || b == 0xf3
+#ifdef DETOURS_X64
+            || (b & 0xf0) == 0x40
+#endif
+            ) {
+            pbCode++;
+            continue;
+        }
+        break;
+    }
+
+#ifdef DETOURS_X64
+    // APX REX2 selects map 0 or map 1 in its payload, so the 0F escape is
+    // folded into the prefix.
+    if (pbCode[0] == 0xd5) {
+        if (pbCode[1] == 0x00 && pbCode[2] == 0xa1) {  // jmpabs imm64
+            return KIND_JUMP;
+        }
+        if (pbCode[1] & 0x80) {
+            return (pbCode[2] == 0x0b) ? KIND_TRAP : KIND_NEXT;
+        }
+        pbCode += 2;
+    }
+#endif
+
+    switch (pbCode[0]) {
+      case 0xc2:                                // ret imm16
+      case 0xc3:                                // ret
+      case 0xca:                                // retf imm16
+      case 0xcb:                                // retf
+      case 0xcf:                                // iret
+        return KIND_RETURN;
+      case 0xcc:                                // int 3
+      case 0xf4:                                // hlt
+        return KIND_TRAP;
+      case 0xcd:                                // int 29h (__fastfail)
+        return (pbCode[1] == 0x29) ? KIND_TRAP : KIND_NEXT;
+      case 0xe9:                                // jmp rel32
+      case 0xeb:                                // jmp rel8
+      case 0xea:                                // jmp far
+        return KIND_JUMP;
+      case 0xe8:                                // call rel32
+      case 0x9a:                                // call far
+        return KIND_CALL;
+      case 0xe0:                                // loopne
+      case 0xe1:                                // loope
+      case 0xe2:                                // loop
+      case 0xe3:                                // jcxz
+        return KIND_BRANCH;
+      case 0x0f:
+        if (pbCode[1] == 0x0b) {                // ud2
+            return KIND_TRAP;
+        }
+        if ((pbCode[1] & 0xf0) == 0x80) {       // jcc rel32
+            return KIND_BRANCH;
+        }
+        return KIND_NEXT;
+      case 0xff:
+        switch ((pbCode[1] >> 3) & 7) {
+          case 2:                               // call /2
+          case 3:                               // call far /3
+            return KIND_CALL;
+          case 4:                               // jmp /4
+          case 5:                               // jmp far /5
+            return KIND_JUMP;
+        }
+        return KIND_NEXT;
+    }
+    if ((pbCode[0] & 0xf0) == 0x70) {           // jcc rel8
+        return KIND_BRANCH;
+    }
+    return KIND_NEXT;
+}
+
+#elif defined(DETOURS_ARM64)
+
+CDetourGraph::KIND CDetourGraph::Classify(PBYTE pbCode)
+{
+    ULONG op = (ULONG)pbCode[0] | ((ULONG)pbCode[1] << 8) |
+        ((ULONG)pbCode[2] << 16) | ((ULONG)pbCode[3] << 24);
+
+    if ((op & 0xfc000000) == 0x14000000) {      // b
+        return KIND_JUMP;
+    }
+    if ((op & 0xfc000000) == 0x94000000) {      // bl
+        return KIND_CALL;
+    }
+    if ((op & 0xff000010) == 0x54000000 ||      // b.cond
+        (op & 0x7e000000) == 0x34000000 ||      // cbz, cbnz
+        (op & 0x7e000000) == 0x36000000) {      // tbz, tbnz
+        return KIND_BRANCH;
+    }
+    if ((op & 0xfffffc1f) == 0xd65f0000 ||      // ret
+        (op & 0xfffffbff) == 0xd65f0bff) {      // retaa, retab
+        return KIND_RETURN;
+    }
+    if ((op & 0xfffffc1f) == 0xd61f0000 ||      // br
+        (op & 0xfefff800) == 0xd61f0800) {      // braa, brab, braaz, brabz
+        return KIND_JUMP;
+    }
+    if ((op & 0xfffffc1f) == 0xd63f0000 ||      // blr
+        (op & 0xfefff800) == 0xd63f0800) {      // blraa, blrab, blraaz, blrabz
+        return KIND_CALL;
+    }
+    if ((op & 0xffe0001f) == 0xd4200000 ||      // brk
+        (op & 0xffff0000) == 0x00000000) {      // udf
+        return KIND_TRAP;
+    }
+    return KIND_NEXT;
+}
+
+#endif
+
+ULONG CDetourGraph::NextBit(const ULONG *pBits, ULONG nBit, ULONG nLimit)
+{
+    while (nBit < nLimit) {
+        ULONG nWord = pBits[nBit >> 5] >> (nBit & 31);
+        if (nWord == 0) {
+            nBit = (nBit | 31) + 1;
+            continue;
+        }
+        while ((nWord & 1) == 0) {
+            nWord >>= 1;
+            nBit++;
+        }
+        return nBit < nLimit ? nBit : nLimit;
+    }
+    return nLimit;
+}
+
+ULONG CDetourGraph::Decode(ULONG nOffset, KIND *pnKind, PBYTE *ppbTarget)
+{
+    PBYTE pbSrc = m_pbCode + nOffset;
+    PBYTE pbDecode = pbSrc;
+    PBYTE pbTarget = (PBYTE)DETOUR_INSTRUCTION_TARGET_NONE;
+    ULONG cbLeft = m_cbCode - nOffset;
+    BYTE rbTail[DETOUR_DECODE_SLOP];
+
+    if (cbLeft < DETOUR_DECODE_SLOP) {
+        ZeroMemory(rbTail, sizeof(rbTail));
+        CopyMemory(rbTail, pbSrc, cbLeft);
+        pbDecode = rbTail;
+    }
+
+#if defined(DETOURS_X64) || defined(DETOURS_X86)
+    m_oDisasm.Reset(pbDecode != pbSrc);
+    PBYTE pbNext = m_oDisasm.CopyInstruction(NULL, pbDecode);
+    pbTarget = m_pbTarget;
+    BOOL fRelative = !m_oDisasm.IsTargetAbsolute();
+#else
+    LONG lExtra = 0;
+    PBYTE pbNext = (PBYTE)DetourCopyInstruction(NULL, NULL, pbDecode,
+                                                (PVOID *)&pbTarget, &lExtra);
+    BOOL fRelative = TRUE;
+#endif
+    if (pbNext == NULL) {
+        return 0;
+    }
+
+    ULONG cbInstruction = (ULONG)(pbNext - pbDecode);
+    if (cbInstruction == 0 || cbInstruction > cbLeft) {
+        return 0;
+    }
+
+    // As in DetourDecodeInstructions, only targets relative to the tail
+    // copy are moved back to the real code.
+    if (pbDecode != pbSrc && fRelative &&
+        pbTarget != (PBYTE)DETOUR_INSTRUCTION_TARGET_NONE &&
+        pbTarget != (PBYTE)DETOUR_INSTRUCTION_TARGET_DYNAMIC) {
+        pbTarget = pbSrc + (pbTarget - pbDecode);
+    }
+
+    *pnKind = Classify(pbDecode);
+    *ppbTarget = pbTarget;
+    return cbInstruction;
+}
+
+VOID CDetourGraph::AddLeader(ULONG nOffset)
+{
+    if (TestBit(m_rLeaders, nOffset)) {
+        return;
+    }
+    SetBit(m_rLeaders, nOffset);
+
+    if (m_nWork >= DETOUR_GRAPH_MAX_WORK) {
+        m_fFlags |= DETOUR_GRAPH_TRUNCATED;
+        return;
+    }
+    m_rnWork[m_nWork++] = nOffset;
+}
+
+VOID CDetourGraph::Explore()
+{
+    if (m_cbCode == 0) {
+        m_fFlags |= DETOUR_GRAPH_TRUNCATED;
+        return;
+    }
+    AddLeader(0);
+
+    while (m_nWork > 0) {
+        ULONG nOffset = m_rnWork[--m_nWork];
+
+        for (;;) {
+            if (TestBit(m_rStarts, nOffset)) {
+                break;                          // Joins code already decoded.
+            }
+            if (TestBit(m_rCovered, nOffset)) {
+                m_fFlags |= DETOUR_GRAPH_OVERLAP;
+            }
+
+            KIND nKind;
+            PBYTE pbTarget;
+            ULONG cbInstruction = Decode(nOffset, &nKind, &pbTarget);
+            if (cbInstruction == 0) {
+                m_fFlags |= DETOUR_GRAPH_TRUNCATED;
+                break;
+            }
+
+            ULONG nNext = nOffset + cbInstruction;
+            SetBit(m_rStarts, nOffset);
+            for (ULONG n = nOffset; n < nNext; n++) {
+                SetBit(m_rCovered, n);
+            }
+            m_cInstructions++;
+            if (m_cbExtent < nNext) {
+                m_cbExtent = nNext;
+            }
+
+            if (nKind == KIND_BRANCH || nKind == KIND_JUMP) {
+                if (pbTarget == (PBYTE)DETOUR_INSTRUCTION_TARGET_NONE ||
+                    pbTarget == (PBYTE)DETOUR_INSTRUCTION_TARGET_DYNAMIC) {
+                    m_fFlags |= DETOUR_GRAPH_DYNAMIC;
+                }
+                else if (pbTarget >= m_pbCode && pbTarget < m_pbCode + m_cbCode) {
+                    AddLeader((ULONG)(pbTarget - m_pbCode));
+                }
+                else {
+                    m_fFlags |= DETOUR_GRAPH_EXTERNAL;
+                }
+            }
+            if (nKind == KIND_JUMP || nKind == KIND_RETURN || nKind == KIND_TRAP) {
+                break;
+            }
+            if (nNext >= m_cbCode) {
+                m_fFlags |= DETOUR_GRAPH_TRUNCATED;
+                break;
+            }
+            nOffset = nNext;
+        }
+    }
+}
+
+ULONG CDetourGraph::Partition(PDETOUR_BASIC_BLOCK pBlocks, ULONG cMaxBlocks)
+{
+    ULONG cBlocks = 0;
+    ULONG nOffset = 0;
+
+    while ((nOffset = NextBit(m_rStarts, nOffset, m_cbExtent)) < m_cbExtent) {
+        DETOUR_BASIC_BLOCK block;
+        block.nOffset = nOffset;
+        block.nTarget = 0;
+        block.cInstructions = 0;
+        block.fFlags = 0;
+
+        for (;;) {
+            KIND nKind = KIND_NEXT;
+            PBYTE pbTarget = NULL;
+            ULONG cbInstruction = Decode(nOffset, &nKind, &pbTarget);
+            ULONG nNext = nOffset + cbInstruction;
+
+            if (block.cInstructions < 0xffff) {
+                block.cInstructions++;
+            }
+
+            if (nKind == KIND_BRANCH || nKind == KIND_JUMP) {
+                if (pbTarget == (PBYTE)DETOUR_INSTRUCTION_TARGET_NONE ||
+                    pbTarget == (PBYTE)DETOUR_INSTRUCTION_TARGET_DYNAMIC) {
+                    block.fFlags |= DETOUR_BLOCK_DYNAMIC;
+                }
+                else if (pbTarget >= m_pbCode && pbTarget < m_pbCode + m_cbCode) {
+                    block.fFlags |= DETOUR_BLOCK_BRANCH;
+                    block.nTarget = (ULONG)(pbTarget - m_pbCode);
+                }
+                else {
+                    block.fFlags |= DETOUR_BLOCK_EXTERNAL;
+                }
+                if (nKind == KIND_BRANCH) {
+                    block.fFlags |= DETOUR_BLOCK_CONDITIONAL;
+                }
+            }
+            else if (nKind == KIND_RETURN) {
+                block.fFlags |= DETOUR_BLOCK_RETURN;
+            }
+            else if (nKind == KIND_TRAP) {
+                block.fFlags |= DETOUR_BLOCK_TRAP;
+            }
+
+            nOffset = nNext;
+            if (nKind == KIND_JUMP || nKind == KIND_RETURN || nKind == KIND_TRAP) {
+                break;
+            }
+            if (nNext >= m_cbCode || !TestBit(m_rStarts, nNext)) {
+                // Explore stopped here: bad code, the window end or overlap.
+                block.fFlags |= DETOUR_BLOCK_TRUNCATED;
+                break;
+            }
+            if (nKind == KIND_BRANCH || TestBit(m_rLeaders, nNext)) {
+                block.fFlags |= DETOUR_BLOCK_FALLTHROUGH;
+                break;
+            }
+        }
+
+        block.cbBlock = nOffset - block.nOffset;
+        if (cBlocks < cMaxBlocks) {
+            pBlocks[cBlocks] = block;
+        }
+        cBlocks++;
+    }
+    return cBlocks;
+}
+
+BOOL CDetourGraph::HasLeader(ULONG nBeg, ULONG nEnd)
+{
+    if (nEnd > m_cbCode) {
+        nEnd = m_cbCode;
+    }
+    return NextBit(m_rLeaders, nBeg, nEnd) < nEnd;
+}
+
+#endif // defined(DETOURS_X64) || defined(DETOURS_X86) || defined(DETOURS_ARM64)
+
+//  Function:
+//      DetourBuildFunctionGraph(PVOID pCode,
+//                               ULONG cbCode,
+//                               PDETOUR_BASIC_BLOCK pBlocks,
+//                               ULONG cMaxBlocks,
+//                               PDETOUR_FUNCTION_GRAPH pGraph)
+//  Purpose:
+//      Find the basic blocks of the function entered at pCode.
+//
+//  Arguments:
+//      pCode:
+//          Entry point of the function.
+//      cbCode:
+//          Number of bytes readable at pCode.  Branches beyond this window
+//          are treated as leaving the function.  Only the first 64KB are
+//          analyzed.
+//      pBlocks:
+//          Out array receiving the blocks in ascending address order.  May
+//          be NULL if cMaxBlocks is zero.
+//      cMaxBlocks:
+//          Number of entries available in pBlocks.
+//      pGraph:
+//          Out parameter receiving the block and instruction counts and the
+//          DETOUR_GRAPH_* flags.  pGraph->cBlocks may exceed cMaxBlocks.
+//
+//  Returns:
+//      TRUE if the graph was built, FALSE for bad arguments or on
+//      architectures without a graph builder (ARM and IA64).
+//
+BOOL WINAPI DetourBuildFunctionGraph(_In_reads_bytes_(cbCode) PVOID pCode,
+                                     _In_ ULONG cbCode,
+                                     _Out_writes_opt_(cMaxBlocks) PDETOUR_BASIC_BLOCK pBlocks,
+                                     _In_ ULONG cMaxBlocks,
+                                     _Out_ PDETOUR_FUNCTION_GRAPH pGraph)
+{
+    if (pCode == NULL || pGraph == NULL || (pBlocks == NULL && cMaxBlocks != 0)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    ZeroMemory(pGraph, sizeof(*pGraph));
+
+#if defined(DETOURS_X64) || defined(DETOURS_X86) || defined(DETOURS_ARM64)
+    CDetourGraph oGraph((PBYTE)pCode, cbCode);
+
+    oGraph.Explore();
+    pGraph->cBlocks = oGraph.Partition(pBlocks, cMaxBlocks);
+    pGraph->cInstructions = oGraph.Instructions();
+    pGraph->cbExtent = oGraph.Extent();
+    pGraph->fFlags = oGraph.Flags();
+    return TRUE;
+#else
+    (void)cbCode;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+#endif
+}
+
+//  Function:
+//      DetourIsPatchSafe(PVOID pCode,
+//                        ULONG cbCode,
+//                        ULONG cbPatch,
+//                        ULONG *pcbCopied)
+//  Purpose:
+//      Check that the first cbPatch bytes of a function can be replaced by
+//      a jump without breaking the function.
+//
+//  Arguments:
+//      pCode:
+//          Entry point of the function.
+//      cbCode:
+//          Number of bytes readable at pCode, as for DetourBuildFunctionGraph.
+//      cbPatch:
+//          Number of bytes overwritten by the jump.
+//      pcbCopied:
+//          Out parameter for the number of bytes of whole instructions that
+//          would be moved to the trampoline.  May be NULL.
+//
+//  Returns:
+//      TRUE if the patch is safe.  Otherwise FALSE, and GetLastError returns
+//      ERROR_INVALID_BLOCK if the function ends inside the patch or a branch
+//      in the function lands inside the moved instructions, or
+//      ERROR_INSUFFICIENT_BUFFER if some path could not be followed to its
+//      end within cbCode.
+//
+//  Comments:
+//      A branch back to the entry point itself is allowed; it re-enters the
+//      detour just as an outside caller does.  Targets of indirect jumps are
+//      not known and are not checked.
+//
+BOOL WINAPI DetourIsPatchSafe(_In_reads_bytes_(cbCode) PVOID pCode,
+                              _In_ ULONG cbCode,
+                              _In_ ULONG cbPatch,
+                              _Out_opt_ ULONG *pcbCopied)
+{
+    if (pcbCopied != NULL) {
+        *pcbCopied = 0;
+    }
+    if (pCode == NULL || cbPatch == 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+#if defined(DETOURS_X64) || defined(DETOURS_X86) || defined(DETOURS_ARM64)
+    CDetourGraph oGraph((PBYTE)pCode, cbCode);
+    ULONG cbCopied = 0;
+
+    while (cbCopied < cbPatch) {
+        CDetourGraph::KIND nKind;
+        PBYTE pbTarget;
+        ULONG cbInstruction = oGraph.Decode(cbCopied, &nKind, &pbTarget);
+        if (cbInstruction == 0) {
+            SetLastError(cbCopied < cbCode ? ERROR_INVALID_BLOCK : ERROR_INSUFFICIENT_BUFFER);
+            return FALSE;
+        }
+        cbCopied += cbInstruction;
+
+        if (cbCopied < cbPatch &&
+            (nKind == CDetourGraph::KIND_JUMP ||
+             nKind == CDetourGraph::KIND_RETURN ||
+             nKind == CDetourGraph::KIND_TRAP)) {
+            // The function is smaller than the patch.
+            SetLastError(ERROR_INVALID_BLOCK);
+            return FALSE;
+        }
+    }
+    if (pcbCopied != NULL) {
+        *pcbCopied = cbCopied;
+    }
+
+    oGraph.Explore();
+    if (oGraph.HasLeader(1, cbCopied)) {
+        SetLastError(ERROR_INVALID_BLOCK);
+        return FALSE;
+    }
+    if (oGraph.Flags() & DETOUR_GRAPH_TRUNCATED) {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+    return TRUE;
+#else
+    (void)cbCode;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+#endif
+}
+
 BOOL WINAPI DetourSetCodeModule(_In_ HMODULE hModule,
                                 _In_ BOOL fLimitReferencesToModule)
 {
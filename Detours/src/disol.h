@@ -0,0 +1,682 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Portable Offline Disassembler Definitions (disol.h of disol.a)
+//
+//  Microsoft Research Detours Package, Version 4.0.1
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Supplies the subset of Win32 types and Detours declarations needed to
+//  build the offline disassemblers (disolx86, disolx64, disolarm,
+//  disolarm64) with gcc or clang on hosts without windows.h.  Selected by
+//  defining DETOURS_OFFLINE_PORTABLE; see GNUmakefile.
+//
+//  The persistent binary functions (image.cpp) are also built; there a
+//  HANDLE is a POSIX file descriptor, see DetourOfflineFileHandle.
+//
+//  The IA64 disassembler depends on DETOUR_IA64_BUNDLE from detours.h and
+//  is only built by the Windows makefile.
+//
+
+#pragma once
+#ifndef _DISOL_H_
+#define _DISOL_H_
+
+#define DETOURS_VERSION     0x4c0c1   // 0xMAJORcMINORcPATCH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if UINTPTR_MAX > 0xffffffffu
+#define DETOURS_64BIT 1
+#define DETOURS_BITS 64
+#else
+#define DETOURS_32BIT 1
+#define DETOURS_BITS 32
+#endif
+
+////////////////////////////////////////////////////////////// Win32 Subset.
+//
+//  Sizes follow the Windows LLP64 model, so LONG and ULONG stay 32 bits
+//  even where the host long is 64 bits.
+//
+typedef void                VOID;
+typedef void *              PVOID;
+typedef const void *        LPCVOID;
+typedef char                CHAR;
+typedef char *              PCHAR;
+typedef char *              LPSTR;
+typedef const char *        LPCSTR;
+typedef uint8_t             BYTE;
+typedef BYTE *              PBYTE;
+typedef int16_t             SHORT;
+typedef uint16_t            USHORT;
+typedef USHORT *            PUSHORT;
+typedef uint16_t            WORD;
+typedef int32_t             LONG;
+typedef uint32_t            ULONG;
+typedef ULONG *             PULONG;
+typedef uint32_t            DWORD;
+typedef DWORD *             PDWORD;
+typedef DWORD *             LPDWORD;
+typedef int32_t             INT32;
+typedef unsigned int        UINT;
+typedef int64_t             INT64;
+typedef uint64_t            UINT64;
+typedef int64_t             LONG64;
+typedef int64_t             LONGLONG;
+typedef uint64_t            ULONGLONG;
+typedef intptr_t            LONG_PTR;
+typedef uintptr_t           ULONG_PTR;
+typedef size_t              SIZE_T;
+typedef int                 BOOL;
+typedef PVOID               HMODULE;
+typedef PVOID               HANDLE;
+typedef LONG                HRESULT;
+
+typedef struct _GUID
+{
+    DWORD   Data1;
+    WORD    Data2;
+    WORD    Data3;
+    BYTE    Data4[8];
+} GUID;
+
+#ifdef __cplusplus
+#define REFGUID             const GUID &
+#else
+#define REFGUID             const GUID * const
+#endif
+
+#ifndef TRUE
+#define TRUE                1
+#endif
+#ifndef FALSE
+#define FALSE               0
+#endif
+
+#define WINAPI
+#define CALLBACK
+#define UNALIGNED
+
+#define UNREFERENCED_PARAMETER(P)   ((void)(P))
+#define CopyMemory(d,s,n)           memcpy((d),(s),(n))
+#define MoveMemory(d,s,n)           memmove((d),(s),(n))
+#define ZeroMemory(d,n)             memset((d),0,(n))
+#define __debugbreak()              __builtin_trap()
+
+#define PAGE_NOACCESS               0x01
+#define PAGE_READONLY               0x02
+#define PAGE_READWRITE              0x04
+#define PAGE_WRITECOPY              0x08
+#define PAGE_EXECUTE                0x10
+#define PAGE_EXECUTE_READ           0x20
+#define PAGE_EXECUTE_READWRITE      0x40
+#define PAGE_EXECUTE_WRITECOPY      0x80
+
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(x)    (sizeof(x)/sizeof(x[0]))
+#endif
+
+#define INVALID_HANDLE_VALUE        ((HANDLE)(LONG_PTR)-1)
+
+#define S_OK                        ((HRESULT)0L)
+#define SUCCEEDED(hr)               (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)                  (((HRESULT)(hr)) < 0)
+
+#define NO_ERROR                    0L
+#define ERROR_INVALID_HANDLE        6L
+#define ERROR_NOT_ENOUGH_MEMORY     8L
+#define ERROR_INVALID_BLOCK         9L
+#define ERROR_INVALID_DATA          13L
+#define ERROR_OUTOFMEMORY           14L
+#define ERROR_WRITE_FAULT           29L
+#define ERROR_READ_FAULT            30L
+#define ERROR_NOT_SUPPORTED         50L
+#define ERROR_INVALID_PARAMETER     87L
+#define ERROR_CALL_NOT_IMPLEMENTED  120L
+#define ERROR_INSUFFICIENT_BUFFER   122L
+#define ERROR_MOD_NOT_FOUND         126L
+#define ERROR_INVALID_EXE_SIGNATURE 191L
+#define ERROR_EXE_MARKED_INVALID    192L
+#define ERROR_BAD_EXE_FORMAT        193L
+
+inline DWORD & DetourOfflineLastError()
+{
+    static thread_local DWORD s_dwLastError = 0;
+    return s_dwLastError;
+}
+
+inline VOID SetLastError(DWORD dwErrCode)
+{
+    DetourOfflineLastError() = dwErrCode;
+}
+
+inline DWORD GetLastError()
+{
+    return DetourOfflineLastError();
+}
+
+/////////////////////////////////////////////////////////// SAL Annotations.
+//
+#define _In_
+#define _In_opt_
+#define _In_reads_(x)
+#define _In_reads_bytes_(x)
+#define _Inout_
+#define _Inout_opt_
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(x)
+#define _Out_writes_opt_(x)
+#define _Success_(x)
+#define _In_reads_opt_(x)
+#define _In_reads_or_z_(x)
+#define _In_range_(...)
+#define _Deref_out_range_(...)
+#define _Always_(x)
+#define _Field_size_(x)
+#define _Must_inspect_result_
+#define _Outptr_result_maybenull_
+#define _Readable_bytes_(x)
+#define _Writable_bytes_(x)
+#define _Analysis_assume_(x)
+
+/////////////////////////////////////////////////// Instruction Target Macros.
+//
+#define DETOUR_INSTRUCTION_TARGET_NONE          ((PVOID)0)
+#define DETOUR_INSTRUCTION_TARGET_DYNAMIC       ((PVOID)(LONG_PTR)-1)
+
+#define DETOURS_PFUNC_TO_PBYTE(p)  ((PBYTE)(((ULONG_PTR)(p)) & ~(ULONG_PTR)1))
+#define DETOURS_PBYTE_TO_PFUNC(p)  ((PBYTE)(((ULONG_PTR)(p)) | (ULONG_PTR)1))
+
+typedef struct _DETOUR_INSTRUCTION
+{
+    ULONG               nOffset;        // Offset of the instruction from the start of the code.
+    USHORT              cbInstruction;  // Length of the instruction in bytes.
+    SHORT               nExtra;         // Extra bytes needed to reach pTarget (see DetourCopyInstruction).
+    PVOID               pTarget;        // Branch target, or DETOUR_INSTRUCTION_TARGET_NONE/_DYNAMIC.
+} DETOUR_INSTRUCTION, *PDETOUR_INSTRUCTION;
+
+#define DETOUR_BLOCK_FALLTHROUGH        0x0001  // Execution may continue into the next block.
+#define DETOUR_BLOCK_BRANCH             0x0002  // Ends in a direct branch to nTarget.
+#define DETOUR_BLOCK_CONDITIONAL        0x0004  // The ending branch is conditional.
+#define DETOUR_BLOCK_EXTERNAL           0x0008  // The ending branch leaves the code (tail call).
+#define DETOUR_BLOCK_DYNAMIC            0x0010  // Ends in an indirect jump.
+#define DETOUR_BLOCK_RETURN             0x0020  // Ends in a return.
+#define DETOUR_BLOCK_TRAP               0x0040  // Ends in a breakpoint or undefined instruction.
+#define DETOUR_BLOCK_TRUNCATED          0x0080  // Runs off the end of the code or into bad code.
+
+typedef struct _DETOUR_BASIC_BLOCK
+{
+    ULONG               nOffset;        // Offset of the first instruction from the entry point.
+    ULONG               cbBlock;        // Length of the block in bytes.
+    ULONG               nTarget;        // Offset of the branch target if DETOUR_BLOCK_BRANCH.
+    USHORT              cInstructions;  // Number of instructions in the block.
+    USHORT              fFlags;         // DETOUR_BLOCK_* flags.
+} DETOUR_BASIC_BLOCK, *PDETOUR_BASIC_BLOCK;
+
+#define DETOUR_GRAPH_DYNAMIC            0x0001  // Has indirect jumps whose targets are unknown.
+#define DETOUR_GRAPH_EXTERNAL           0x0002  // Has branches that leave the code.
+#define DETOUR_GRAPH_OVERLAP            0x0004  // A branch lands inside another instruction.
+#define DETOUR_GRAPH_TRUNCATED          0x0008  // Analysis stopped before all paths ended.
+
+typedef struct _DETOUR_FUNCTION_GRAPH
+{
+    ULONG               cBlocks;        // Number of blocks found; may exceed the array size.
+    ULONG               cInstructions;  // Number of instructions reachable from the entry.
+    ULONG               cbExtent;       // One past the highest byte decoded.
+    ULONG               fFlags;         // DETOUR_GRAPH_* flags.
+} DETOUR_FUNCTION_GRAPH, *PDETOUR_FUNCTION_GRAPH;
+
+///////////////////////////////////////////////////////////// Module Helpers.
+//
+//  An HMODULE is the base of an image mapped with its sections at their
+//  virtual addresses, as with the loader on Windows.
+//
+inline ULONG DetourGetModuleSize(_In_opt_ HMODULE hModule)
+{
+    PBYTE pbModule = (PBYTE)hModule;
+    LONG nNtHeader = 0;
+
+    if (pbModule == NULL || pbModule[0] != 'M' || pbModule[1] != 'Z') {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    memcpy(&nNtHeader, pbModule + 0x3c, sizeof(nNtHeader));   // e_lfanew
+
+    PBYTE pbNtHeader = pbModule + nNtHeader;
+    ULONG cbImage = 0;
+    if (memcmp(pbNtHeader, "PE\0\0", 4) != 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    // OptionalHeader.SizeOfImage is at the same offset for PE32 and PE32+.
+    memcpy(&cbImage, pbNtHeader + 0x50, sizeof(cbImage));
+    return cbImage;
+}
+
+////////////////////////////////////////////////////////// Image Structures.
+//
+//  The PE structures used by the persistent binary functions.  As with
+//  windows.h, IMAGE_NT_HEADERS and IMAGE_THUNK_DATA match the host, so a
+//  64-bit build edits PE32+ images.
+//
+#define IMAGE_DOS_SIGNATURE                     0x5A4D      // MZ
+#define IMAGE_NT_SIGNATURE                      0x00004550  // PE00
+#define IMAGE_NUMBEROF_DIRECTORY_ENTRIES        16
+#define IMAGE_SIZEOF_SHORT_NAME                 8
+#define IMAGE_NT_OPTIONAL_HDR32_MAGIC           0x10b
+#define IMAGE_NT_OPTIONAL_HDR64_MAGIC           0x20b
+#define IMAGE_FILE_MACHINE_I386                 0x014c
+#define IMAGE_FILE_MACHINE_AMD64                0x8664
+
+#define IMAGE_DIRECTORY_ENTRY_EXPORT            0
+#define IMAGE_DIRECTORY_ENTRY_IMPORT            1
+#define IMAGE_DIRECTORY_ENTRY_DEBUG             6
+#define IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT      11
+#define IMAGE_DIRECTORY_ENTRY_IAT               12
+#define IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR    14
+
+#define IMAGE_SCN_CNT_CODE                      0x00000020
+#define IMAGE_SCN_CNT_INITIALIZED_DATA          0x00000040
+#define IMAGE_SCN_MEM_EXECUTE                   0x20000000
+#define IMAGE_SCN_MEM_READ                      0x40000000
+#define IMAGE_SCN_MEM_WRITE                     0x80000000
+
+#pragma pack(push, 2)
+typedef struct _IMAGE_DOS_HEADER
+{
+    WORD    e_magic;
+    WORD    e_cblp;
+    WORD    e_cp;
+    WORD    e_crlc;
+    WORD    e_cparhdr;
+    WORD    e_minalloc;
+    WORD    e_maxalloc;
+    WORD    e_ss;
+    WORD    e_sp;
+    WORD    e_csum;
+    WORD    e_ip;
+    WORD    e_cs;
+    WORD    e_lfarlc;
+    WORD    e_ovno;
+    WORD    e_res[4];
+    WORD    e_oemid;
+    WORD    e_oeminfo;
+    WORD    e_res2[10];
+    LONG    e_lfanew;
+} IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
+#pragma pack(pop)
+
+typedef struct _IMAGE_FILE_HEADER
+{
+    WORD    Machine;
+    WORD    NumberOfSections;
+    DWORD   TimeDateStamp;
+    DWORD   PointerToSymbolTable;
+    DWORD   NumberOfSymbols;
+    WORD    SizeOfOptionalHeader;
+    WORD    Characteristics;
+} IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
+
+typedef struct _IMAGE_DATA_DIRECTORY
+{
+    DWORD   VirtualAddress;
+    DWORD   Size;
+} IMAGE_DATA_DIRECTORY, *PIMAGE_DATA_DIRECTORY;
+
+typedef struct _IMAGE_OPTIONAL_HEADER
+{
+    WORD    Magic;
+    BYTE    MajorLinkerVersion;
+    BYTE    MinorLinkerVersion;
+    DWORD   SizeOfCode;
+    DWORD   SizeOfInitializedData;
+    DWORD   SizeOfUninitializedData;
+    DWORD   AddressOfEntryPoint;
+    DWORD   BaseOfCode;
+    DWORD   BaseOfData;
+    DWORD   ImageBase;
+    DWORD   SectionAlignment;
+    DWORD   FileAlignment;
+    WORD    MajorOperatingSystemVersion;
+    WORD    MinorOperatingSystemVersion;
+    WORD    MajorImageVersion;
+    WORD    MinorImageVersion;
+    WORD    MajorSubsystemVersion;
+    WORD    MinorSubsystemVersion;
+    DWORD   Win32VersionValue;
+    DWORD   SizeOfImage;
+    DWORD   SizeOfHeaders;
+    DWORD   CheckSum;
+    WORD    Subsystem;
+    WORD    DllCharacteristics;
+    DWORD   SizeOfStackReserve;
+    DWORD   SizeOfStackCommit;
+    DWORD   SizeOfHeapReserve;
+    DWORD   SizeOfHeapCommit;
+    DWORD   LoaderFlags;
+    DWORD   NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER32, *PIMAGE_OPTIONAL_HEADER32;
+
+typedef struct _IMAGE_OPTIONAL_HEADER64
+{
+    WORD        Magic;
+    BYTE        MajorLinkerVersion;
+    BYTE        MinorLinkerVersion;
+    DWORD       SizeOfCode;
+    DWORD       SizeOfInitializedData;
+    DWORD       SizeOfUninitializedData;
+    DWORD       AddressOfEntryPoint;
+    DWORD       BaseOfCode;
+    ULONGLONG   ImageBase;
+    DWORD       SectionAlignment;
+    DWORD       FileAlignment;
+    WORD        MajorOperatingSystemVersion;
+    WORD        MinorOperatingSystemVersion;
+    WORD        MajorImageVersion;
+    WORD        MinorImageVersion;
+    WORD        MajorSubsystemVersion;
+    WORD        MinorSubsystemVersion;
+    DWORD       Win32VersionValue;
+    DWORD       SizeOfImage;
+    DWORD       SizeOfHeaders;
+    DWORD       CheckSum;
+    WORD        Subsystem;
+    WORD        DllCharacteristics;
+    ULONGLONG   SizeOfStackReserve;
+    ULONGLONG   SizeOfStackCommit;
+    ULONGLONG   SizeOfHeapReserve;
+    ULONGLONG   SizeOfHeapCommit;
+    DWORD       LoaderFlags;
+    DWORD       NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
+
+typedef struct _IMAGE_NT_HEADERS64
+{
+    DWORD                   Signature;
+    IMAGE_FILE_HEADER       FileHeader;
+    IMAGE_OPTIONAL_HEADER64 OptionalHeader;
+} IMAGE_NT_HEADERS64, *PIMAGE_NT_HEADERS64;
+
+typedef struct _IMAGE_NT_HEADERS
+{
+    DWORD                   Signature;
+    IMAGE_FILE_HEADER       FileHeader;
+    IMAGE_OPTIONAL_HEADER32 OptionalHeader;
+} IMAGE_NT_HEADERS32, *PIMAGE_NT_HEADERS32;
+
+typedef struct _IMAGE_SECTION_HEADER
+{
+    BYTE    Name[IMAGE_SIZEOF_SHORT_NAME];
+    union {
+        DWORD   PhysicalAddress;
+        DWORD   VirtualSize;
+    } Misc;
+    DWORD   VirtualAddress;
+    DWORD   SizeOfRawData;
+    DWORD   PointerToRawData;
+    DWORD   PointerToRelocations;
+    DWORD   PointerToLinenumbers;
+    WORD    NumberOfRelocations;
+    WORD    NumberOfLinenumbers;
+    DWORD   Characteristics;
+} IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
+
+typedef struct _IMAGE_IMPORT_DESCRIPTOR
+{
+    union {
+        DWORD   Characteristics;
+        DWORD   OriginalFirstThunk;
+    };
+    DWORD   TimeDateStamp;
+    DWORD   ForwarderChain;
+    DWORD   Name;
+    DWORD   FirstThunk;
+} IMAGE_IMPORT_DESCRIPTOR, *PIMAGE_IMPORT_DESCRIPTOR;
+
+typedef struct _IMAGE_IMPORT_BY_NAME
+{
+    WORD    Hint;
+    CHAR    Name[1];
+} IMAGE_IMPORT_BY_NAME, *PIMAGE_IMPORT_BY_NAME;
+
+typedef struct _IMAGE_THUNK_DATA64
+{
+    union {
+        ULONGLONG   ForwarderString;
+        ULONGLONG   Function;
+        ULONGLONG   Ordinal;
+        ULONGLONG   AddressOfData;
+    } u1;
+} IMAGE_THUNK_DATA64, *PIMAGE_THUNK_DATA64;
+
+typedef struct _IMAGE_THUNK_DATA32
+{
+    union {
+        DWORD   ForwarderString;
+        DWORD   Function;
+        DWORD   Ordinal;
+        DWORD   AddressOfData;
+    } u1;
+} IMAGE_THUNK_DATA32, *PIMAGE_THUNK_DATA32;
+
+typedef struct _IMAGE_DEBUG_DIRECTORY
+{
+    DWORD   Characteristics;
+    DWORD   TimeDateStamp;
+    WORD    MajorVersion;
+    WORD    MinorVersion;
+    DWORD   Type;
+    DWORD   SizeOfData;
+    DWORD   AddressOfRawData;
+    DWORD   PointerToRawData;
+} IMAGE_DEBUG_DIRECTORY, *PIMAGE_DEBUG_DIRECTORY;
+
+#ifdef DETOURS_64BIT
+typedef IMAGE_NT_HEADERS64              IMAGE_NT_HEADERS;
+typedef PIMAGE_NT_HEADERS64             PIMAGE_NT_HEADERS;
+typedef IMAGE_THUNK_DATA64              IMAGE_THUNK_DATA;
+typedef PIMAGE_THUNK_DATA64             PIMAGE_THUNK_DATA;
+#define IMAGE_ORDINAL_FLAG              0x8000000000000000ull
+#else
+typedef IMAGE_NT_HEADERS32              IMAGE_NT_HEADERS;
+typedef PIMAGE_NT_HEADERS32             PIMAGE_NT_HEADERS;
+typedef IMAGE_THUNK_DATA32              IMAGE_THUNK_DATA;
+typedef PIMAGE_THUNK_DATA32             PIMAGE_THUNK_DATA;
+#define IMAGE_ORDINAL_FLAG              0x80000000
+#endif
+#define IMAGE_ORDINAL(Ordinal)          ((Ordinal) & 0xffff)
+
+////////////////////////////////////////////////////////// Binary Structures.
+//
+#define DETOUR_SECTION_HEADER_SIGNATURE         0x00727444   // "Dtr\0"
+
+#pragma pack(push, 8)
+typedef struct _DETOUR_SECTION_HEADER
+{
+    DWORD       cbHeaderSize;
+    DWORD       nSignature;
+    DWORD       nDataOffset;
+    DWORD       cbDataSize;
+
+    DWORD       nOriginalImportVirtualAddress;
+    DWORD       nOriginalImportSize;
+    DWORD       nOriginalBoundImportVirtualAddress;
+    DWORD       nOriginalBoundImportSize;
+
+    DWORD       nOriginalIatVirtualAddress;
+    DWORD       nOriginalIatSize;
+    DWORD       nOriginalSizeOfImage;
+    DWORD       cbPrePE;
+
+    DWORD       nOriginalClrFlags;
+    DWORD       reserved1;
+    DWORD       reserved2;
+    DWORD       reserved3;
+
+    // Followed by cbPrePE bytes of data.
+} DETOUR_SECTION_HEADER, *PDETOUR_SECTION_HEADER;
+
+typedef struct _DETOUR_SECTION_RECORD
+{
+    DWORD       cbBytes;
+    DWORD       nReserved;
+    GUID        guid;
+} DETOUR_SECTION_RECORD, *PDETOUR_SECTION_RECORD;
+
+typedef struct _DETOUR_CLR_HEADER
+{
+    // Header versioning
+    ULONG                   cb;
+    USHORT                  MajorRuntimeVersion;
+    USHORT                  MinorRuntimeVersion;
+
+    // Symbol table and startup information
+    IMAGE_DATA_DIRECTORY    MetaData;
+    ULONG                   Flags;
+
+    // Followed by the rest of the IMAGE_COR20_HEADER
+} DETOUR_CLR_HEADER, *PDETOUR_CLR_HEADER;
+#pragma pack(pop)
+
+typedef BOOL (CALLBACK *PF_DETOUR_BINARY_BYWAY_CALLBACK)(
+    _In_opt_ PVOID pContext,
+    _In_opt_ LPCSTR pszFile,
+    _Outptr_result_maybenull_ LPCSTR *ppszOutFile);
+
+typedef BOOL (CALLBACK *PF_DETOUR_BINARY_FILE_CALLBACK)(
+    _In_opt_ PVOID pContext,
+    _In_ LPCSTR pszOrigFile,
+    _In_ LPCSTR pszFile,
+    _Outptr_result_maybenull_ LPCSTR *ppszOutFile);
+
+typedef BOOL (CALLBACK *PF_DETOUR_BINARY_SYMBOL_CALLBACK)(
+    _In_opt_ PVOID pContext,
+    _In_ ULONG nOrigOrdinal,
+    _In_ ULONG nOrdinal,
+    _Out_ ULONG *pnOutOrdinal,
+    _In_opt_ LPCSTR pszOrigSymbol,
+    _In_opt_ LPCSTR pszSymbol,
+    _Outptr_result_maybenull_ LPCSTR *ppszOutSymbol);
+
+typedef BOOL (CALLBACK *PF_DETOUR_BINARY_COMMIT_CALLBACK)(
+    _In_opt_ PVOID pContext);
+
+typedef VOID * PDETOUR_BINARY;
+
+#define DETOUR_BINARY_OPEN_COPY         0x00000001  // Read the file into memory.
+
+// The persistent binary functions take a file descriptor as a HANDLE.
+inline HANDLE DetourOfflineFileHandle(int fd)
+{
+    return (HANDLE)(LONG_PTR)fd;
+}
+
+///////////////////////////////////////////////////////////// Export Index.
+//
+typedef struct _DETOUR_EXPORT_INDEX * PDETOUR_EXPORT_INDEX;
+
+typedef struct _DETOUR_EXPORT
+{
+    ULONG   nOrdinal;
+    ULONG   nRva;               // 0 if forwarded.
+    LPCSTR  pszName;            // NULL if exported by ordinal only.
+    LPCSTR  pszForward;         // "DLL.Name" or "DLL.#nn" if forwarded, else NULL.
+    PVOID   pvCode;             // Address in a mapped image, else NULL.
+} DETOUR_EXPORT, *PDETOUR_EXPORT;
+
+//////////////////////////////////////////////////// Offline Library Entries.
+//
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+PDETOUR_EXPORT_INDEX WINAPI DetourCreateExportIndex(_In_reads_bytes_(cbImage) PVOID pImage,
+                                                    _In_ SIZE_T cbImage,
+                                                    _In_ BOOL fMapped);
+ULONG WINAPI DetourFindExports(_In_ PDETOUR_EXPORT_INDEX pIndex,
+                               _In_reads_(cNames) LPCSTR *ppszNames,
+                               _In_ ULONG cNames,
+                               _Out_writes_(cNames) PDETOUR_EXPORT pExports);
+BOOL WINAPI DetourFindExportByOrdinal(_In_ PDETOUR_EXPORT_INDEX pIndex,
+                                      _In_ ULONG nOrdinal,
+                                      _Out_ PDETOUR_EXPORT pExport);
+VOID WINAPI DetourFreeExportIndex(_In_ PDETOUR_EXPORT_INDEX pIndex);
+
+PDETOUR_BINARY WINAPI DetourBinaryOpen(_In_ HANDLE hFile);
+PDETOUR_BINARY WINAPI DetourBinaryOpenEx(_In_ HANDLE hFile, _In_ DWORD dwFlags);
+_Writable_bytes_(*pcbData)
+_Readable_bytes_(*pcbData)
+_Success_(return != NULL)
+PVOID WINAPI DetourBinaryEnumeratePayloads(_In_ PDETOUR_BINARY pBinary,
+                                           _Out_opt_ GUID *pGuid,
+                                           _Out_ DWORD *pcbData,
+                                           _Inout_ DWORD *pnIterator);
+_Writable_bytes_(*pcbData)
+_Readable_bytes_(*pcbData)
+_Success_(return != NULL)
+PVOID WINAPI DetourBinaryFindPayload(_In_ PDETOUR_BINARY pBinary,
+                                     _In_ REFGUID rguid,
+                                     _Out_ DWORD *pcbData);
+PVOID WINAPI DetourBinarySetPayload(_In_ PDETOUR_BINARY pBinary,
+                                    _In_ REFGUID rguid,
+                                    _In_reads_opt_(cbData) PVOID pData,
+                                    _In_ DWORD cbData);
+BOOL WINAPI DetourBinaryDeletePayload(_In_ PDETOUR_BINARY pBinary, _In_ REFGUID rguid);
+BOOL WINAPI DetourBinaryPurgePayloads(_In_ PDETOUR_BINARY pBinary);
+BOOL WINAPI DetourBinaryResetImports(_In_ PDETOUR_BINARY pBinary);
+BOOL WINAPI DetourBinaryEditImports(_In_ PDETOUR_BINARY pBinary,
+                                    _In_opt_ PVOID pContext,
+                                    _In_opt_ PF_DETOUR_BINARY_BYWAY_CALLBACK pfByway,
+                                    _In_opt_ PF_DETOUR_BINARY_FILE_CALLBACK pfFile,
+                                    _In_opt_ PF_DETOUR_BINARY_SYMBOL_CALLBACK pfSymbol,
+                                    _In_opt_ PF_DETOUR_BINARY_COMMIT_CALLBACK pfCommit);
+BOOL WINAPI DetourBinaryWrite(_In_ PDETOUR_BINARY pBinary, _In_ HANDLE hFile);
+BOOL WINAPI DetourBinaryClose(_In_ PDETOUR_BINARY pBinary);
+
+#define DETOUR_OFFLINE_LIBRARY(x)                                       \
+PVOID WINAPI DetourCopyInstruction##x(_In_opt_ PVOID pDst,              \
+                                      _Inout_opt_ PVOID *ppDstPool,     \
+                                      _In_ PVOID pSrc,                  \
+                                      _Out_opt_ PVOID *ppTarget,        \
+                                      _Out_opt_ LONG *plExtra);         \
+                                                                        \
+ULONG WINAPI DetourDecodeInstructions##x(_In_reads_bytes_(cbCode) PVOID pCode, \
+                                         _In_ ULONG cbCode,             \
+                                         _Out_writes_(cMaxInstructions) PDETOUR_INSTRUCTION pInstructions, \
+                                         _In_ ULONG cMaxInstructions,   \
+                                         _Out_opt_ ULONG *pcbDecoded);  \
+                                                                        \
+BOOL WINAPI DetourBuildFunctionGraph##x(_In_reads_bytes_(cbCode) PVOID pCode, \
+                                        _In_ ULONG cbCode,              \
+                                        _Out_writes_opt_(cMaxBlocks) PDETOUR_BASIC_BLOCK pBlocks, \
+                                        _In_ ULONG cMaxBlocks,          \
+                                        _Out_ PDETOUR_FUNCTION_GRAPH pGraph); \
+                                                                        \
+BOOL WINAPI DetourIsPatchSafe##x(_In_reads_bytes_(cbCode) PVOID pCode,  \
+                                 _In_ ULONG cbCode,                     \
+                                 _In_ ULONG cbPatch,                    \
+                                 _Out_opt_ ULONG *pcbCopied);           \
+                                                                        \
+BOOL WINAPI DetourSetCodeModule##x(_In_ HMODULE hModule,                \
+                                   _In_ BOOL fLimitReferencesToModule); \
+
+DETOUR_OFFLINE_LIBRARY(X86)
+DETOUR_OFFLINE_LIBRARY(X64)
+DETOUR_OFFLINE_LIBRARY(ARM)
+DETOUR_OFFLINE_LIBRARY(ARM64)
+
+#undef DETOUR_OFFLINE_LIBRARY
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // _DISOL_H_
+//
+///////////////////////////////////////////////////////////////// End of File.
@@ -0,0 +1,663 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Export Directory Index (expindex.cpp of detours.lib)
+//
+//  Microsoft Research Detours Package, Version 4.0.1
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  DetourCreateExportIndex copies the export directory of an image into a
+//  single immutable block: the functions by ordinal, the names, and a
+//  perfect hash of the names (hash and displace).  Each name hashes to a
+//  bucket, and each bucket has a displacement chosen when the index is
+//  built so that its names land in distinct slots.  A lookup is one hash,
+//  one slot and one string compare, whether or not the name exists.
+//
+//  The headers are read by offset, with every RVA checked against the
+//  image, so an index can be built from the bytes of a PE file on any host.
+//
+
+// #define DETOUR_DEBUG 1
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include "disol.h"
+#else
+#define DETOURS_INTERNAL
+#include "detours.h"
+#endif
+#include <new>
+
+#if DETOURS_VERSION != 0x4c0c1   // 0xMAJORcMINORcPATCH
+#error detours.h version mismatch
+#endif
+
+#ifndef DETOUR_TRACE
+#define DETOUR_TRACE(x)
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//
+const ULONG DETOUR_EXPORT_INDEX_SIGNATURE   = 0x78457464;   // 'dtEx'
+const ULONG DETOUR_EXPORT_NONE              = 0xffffffff;
+const ULONG DETOUR_EXPORT_NAMES_PER_BUCKET  = 4;
+const ULONG DETOUR_EXPORT_MAX_DISPLACE      = 0xffff;
+const ULONG DETOUR_EXPORT_SEEDS             = 8;            // Seeds tried per table size.
+const ULONG DETOUR_EXPORT_BATCH             = 8;            // Names hashed ahead of probing.
+
+struct DETOUR_EXPORT_FUNCTION
+{
+    ULONG   nRva;           // 0 if forwarded or unused.
+    ULONG   nForward;       // Offset of the forwarder string, or DETOUR_EXPORT_NONE.
+    ULONG   nName;          // Offset of the first name, or DETOUR_EXPORT_NONE.
+};
+
+struct DETOUR_EXPORT_NAME
+{
+    ULONG   nName;          // Offset of the name string.
+    ULONG   iFunction;
+};
+
+struct DETOUR_EXPORT_SLOT
+{
+    ULONG   nHash;          // Low 32 bits of the name hash.
+    ULONG   iName;          // DETOUR_EXPORT_NONE if empty.
+};
+
+struct _DETOUR_EXPORT_INDEX
+{
+    ULONG                       dwSignature;
+    ULONG                       nBase;          // Ordinal of pFunctions[0].
+    ULONG                       cFunctions;
+    ULONG                       cNames;
+    ULONG                       cBuckets;
+    ULONG                       nSlotMask;      // Slots - 1; slots are a power of 2.
+    ULONG                       nSeed;
+    PBYTE                       pbImage;        // Base of a mapped image, else NULL.
+    DETOUR_EXPORT_FUNCTION *    pFunctions;
+    DETOUR_EXPORT_NAME *        pNames;
+    DETOUR_EXPORT_SLOT *        pSlots;         // Allocated separately.
+    USHORT *                    pwDisplace;     // One per bucket.
+    CHAR *                      pszStrings;
+};
+
+//////////////////////////////////////////////////////////////// Hashing.
+//
+static inline ULONGLONG detour_export_hash(LPCSTR psz, ULONG nSeed)
+{
+    // FNV-1a, then a finalizer so that both halves depend on every byte.
+    ULONGLONG h = 0xcbf29ce484222325ull ^ nSeed;
+    for (; *psz; psz++) {
+        h ^= (BYTE)*psz;
+        h *= 0x100000001b3ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline ULONG detour_export_bucket(ULONGLONG h, ULONG cBuckets)
+{
+    return (ULONG)(((h >> 32) * cBuckets) >> 32);
+}
+
+static inline ULONG detour_export_slot(ULONGLONG h, ULONG nDisplace, ULONG nSlotMask)
+{
+    // The step is odd, so the displacements of one name visit every slot.
+    ULONG nStep = ((ULONG)(h >> 32) << 1) | 1;
+    return ((ULONG)h + nDisplace * nStep) & nSlotMask;
+}
+
+//////////////////////////////////////////////////////////// Image Parsing.
+//
+struct DETOUR_EXPORT_IMAGE
+{
+    PBYTE   pbImage;
+    SIZE_T  cbImage;
+    BOOL    fMapped;
+    ULONG   nSections;      // Offset of the section table.
+    ULONG   cSections;
+    ULONG   cbHeaders;
+};
+
+static BOOL detour_export_read(const DETOUR_EXPORT_IMAGE *pImage, SIZE_T nOffset, PVOID pv, ULONG cb)
+{
+    if (nOffset > pImage->cbImage || cb > pImage->cbImage - nOffset) {
+        return FALSE;
+    }
+    memcpy(pv, pImage->pbImage + nOffset, cb);
+    return TRUE;
+}
+
+// Returns the offset of cb bytes at nRva, or DETOUR_EXPORT_NONE.
+static ULONG detour_export_offset(const DETOUR_EXPORT_IMAGE *pImage, ULONG nRva, ULONG cb)
+{
+    SIZE_T nOffset = DETOUR_EXPORT_NONE;
+
+    if (pImage->fMapped || nRva < pImage->cbHeaders) {
+        nOffset = nRva;
+    }
+    else {
+        for (ULONG n = 0; n < pImage->cSections; n++) {
+            ULONG nSection = pImage->nSections + n * 40;
+            ULONG cbVirtual = 0;
+            ULONG nVirtual = 0;
+            ULONG cbRaw = 0;
+            ULONG nRaw = 0;
+            if (!detour_export_read(pImage, nSection + 8, &cbVirtual, sizeof(cbVirtual)) ||
+                !detour_export_read(pImage, nSection + 12, &nVirtual, sizeof(nVirtual)) ||
+                !detour_export_read(pImage, nSection + 16, &cbRaw, sizeof(cbRaw)) ||
+                !detour_export_read(pImage, nSection + 20, &nRaw, sizeof(nRaw))) {
+                break;
+            }
+            if (nRva >= nVirtual && nRva - nVirtual < cbRaw) {
+                nOffset = (SIZE_T)nRaw + (nRva - nVirtual);
+                break;
+            }
+        }
+    }
+
+    if (nOffset == DETOUR_EXPORT_NONE ||
+        nOffset > pImage->cbImage || cb > pImage->cbImage - nOffset) {
+        return DETOUR_EXPORT_NONE;
+    }
+    return (ULONG)nOffset;
+}
+
+// Returns the length of the string at nRva, or DETOUR_EXPORT_NONE.
+static ULONG detour_export_string(const DETOUR_EXPORT_IMAGE *pImage, ULONG nRva, LPCSTR *ppsz)
+{
+    ULONG nOffset = detour_export_offset(pImage, nRva, 1);
+    if (nOffset == DETOUR_EXPORT_NONE) {
+        return DETOUR_EXPORT_NONE;
+    }
+    LPCSTR psz = (LPCSTR)pImage->pbImage + nOffset;
+    LPCSTR pszEnd = (LPCSTR)memchr(psz, 0, pImage->cbImage - nOffset);
+    if (pszEnd == NULL) {
+        return DETOUR_EXPORT_NONE;
+    }
+    *ppsz = psz;
+    return (ULONG)(pszEnd - psz);
+}
+
+///////////////////////////////////////////////////////////// Perfect Hash.
+//
+//  Buckets are placed largest first, trying displacements until all of a
+//  bucket's names land in empty slots.  A repeated name is left out.
+//  Returns FALSE if some bucket finds no displacement, or if two different
+//  names share a 64-bit hash, so that the caller can try another seed or a
+//  larger table.
+//
+static BOOL detour_export_place(PDETOUR_EXPORT_INDEX pIndex,
+                                const ULONGLONG *pHashes,
+                                ULONG *pnBucketStart,
+                                ULONG *piBucketNames,
+                                ULONG *piBuckets,
+                                ULONG *pnSlots)
+{
+    const ULONG cNames = pIndex->cNames;
+    const ULONG cBuckets = pIndex->cBuckets;
+
+    // Counting sort of the names by bucket.
+    for (ULONG b = 0; b <= cBuckets; b++) {
+        pnBucketStart[b] = 0;
+    }
+    for (ULONG n = 0; n < cNames; n++) {
+        pnBucketStart[detour_export_bucket(pHashes[n], cBuckets) + 1]++;
+    }
+    ULONG cMaxBucket = 0;
+    for (ULONG b = 0; b < cBuckets; b++) {
+        if (pnBucketStart[b + 1] > cMaxBucket) {
+            cMaxBucket = pnBucketStart[b + 1];
+        }
+        pnBucketStart[b + 1] += pnBucketStart[b];
+    }
+    for (ULONG n = 0; n < cNames; n++) {
+        ULONG b = detour_export_bucket(pHashes[n], cBuckets);
+        piBucketNames[pnBucketStart[b]++] = n;
+    }
+    for (ULONG b = cBuckets; b > 0; b--) {
+        pnBucketStart[b] = pnBucketStart[b - 1];
+    }
+    pnBucketStart[0] = 0;
+
+    // Largest buckets first.
+    ULONG c = 0;
+    for (ULONG cSize = cMaxBucket; cSize > 0; cSize--) {
+        for (ULONG b = 0; b < cBuckets; b++) {
+            if (pnBucketStart[b + 1] - pnBucketStart[b] == cSize) {
+                piBuckets[c++] = b;
+            }
+        }
+    }
+
+    for (ULONG s = 0; s <= pIndex->nSlotMask; s++) {
+        pIndex->pSlots[s].nHash = 0;
+        pIndex->pSlots[s].iName = DETOUR_EXPORT_NONE;
+    }
+    for (ULONG b = 0; b < cBuckets; b++) {
+        pIndex->pwDisplace[b] = 0;
+    }
+
+    for (ULONG i = 0; i < c; i++) {
+        ULONG b = piBuckets[i];
+        ULONG nFirst = pnBucketStart[b];
+        ULONG nLast = pnBucketStart[b + 1];
+
+        for (ULONG n = nFirst; n < nLast; n++) {
+            for (ULONG m = nFirst; m < n; m++) {
+                if (piBucketNames[m] != DETOUR_EXPORT_NONE &&
+                    pHashes[piBucketNames[n]] == pHashes[piBucketNames[m]]) {
+                    if (strcmp(pIndex->pszStrings + pIndex->pNames[piBucketNames[n]].nName,
+                               pIndex->pszStrings + pIndex->pNames[piBucketNames[m]].nName) != 0) {
+                        return FALSE;
+                    }
+                    piBucketNames[n] = DETOUR_EXPORT_NONE;
+                    break;
+                }
+            }
+        }
+
+        ULONG nDisplace = 0;
+        for (; nDisplace <= DETOUR_EXPORT_MAX_DISPLACE; nDisplace++) {
+            ULONG n = nFirst;
+            for (; n < nLast; n++) {
+                ULONG iName = piBucketNames[n];
+                if (iName == DETOUR_EXPORT_NONE) {
+                    pnSlots[n - nFirst] = DETOUR_EXPORT_NONE;
+                    continue;
+                }
+                ULONG nSlot = detour_export_slot(pHashes[iName], nDisplace, pIndex->nSlotMask);
+                if (pIndex->pSlots[nSlot].iName != DETOUR_EXPORT_NONE) {
+                    break;
+                }
+                pIndex->pSlots[nSlot].iName = iName;
+                pnSlots[n - nFirst] = nSlot;
+            }
+            if (n == nLast) {
+                break;
+            }
+            // Undo the names already placed with this displacement.
+            for (ULONG m = nFirst; m < n; m++) {
+                if (pnSlots[m - nFirst] != DETOUR_EXPORT_NONE) {
+                    pIndex->pSlots[pnSlots[m - nFirst]].iName = DETOUR_EXPORT_NONE;
+                }
+            }
+        }
+        if (nDisplace > DETOUR_EXPORT_MAX_DISPLACE) {
+            return FALSE;
+        }
+
+        pIndex->pwDisplace[b] = (USHORT)nDisplace;
+        for (ULONG n = nFirst; n < nLast; n++) {
+            if (pnSlots[n - nFirst] != DETOUR_EXPORT_NONE) {
+                pIndex->pSlots[pnSlots[n - nFirst]].nHash = (ULONG)pHashes[piBucketNames[n]];
+            }
+        }
+    }
+    return TRUE;
+}
+
+static BOOL detour_export_build_hash(PDETOUR_EXPORT_INDEX pIndex)
+{
+    const ULONG cNames = pIndex->cNames;
+    ULONGLONG *pHashes = new (std::nothrow) ULONGLONG [cNames + 1];
+    ULONG *pnBucketStart = new (std::nothrow) ULONG [pIndex->cBuckets + 1];
+    ULONG *piBucketNames = new (std::nothrow) ULONG [cNames + 1];
+    ULONG *piBuckets = new (std::nothrow) ULONG [pIndex->cBuckets];
+    ULONG *pnSlots = new (std::nothrow) ULONG [cNames + 1];
+    BOOL fDone = FALSE;
+
+    // Start with at least 1.25 slots per name; grow the table up to 4x
+    // until some seed places every name.
+    ULONG cSlots = 1;
+    while (cSlots < cNames + cNames / 4) {
+        cSlots <<= 1;
+    }
+    for (ULONG cGrow = 0; !fDone && cGrow < 3; cGrow++, cSlots <<= 1) {
+        if (pHashes == NULL || pnBucketStart == NULL || piBucketNames == NULL ||
+            piBuckets == NULL || pnSlots == NULL) {
+            break;
+        }
+        pIndex->pSlots = new (std::nothrow) DETOUR_EXPORT_SLOT [cSlots];
+        if (pIndex->pSlots == NULL) {
+            break;
+        }
+        pIndex->nSlotMask = cSlots - 1;
+
+        for (ULONG nSeed = 0; !fDone && nSeed < DETOUR_EXPORT_SEEDS; nSeed++) {
+            pIndex->nSeed = nSeed * 0x9e3779b9;
+            for (ULONG n = 0; n < cNames; n++) {
+                pHashes[n] = detour_export_hash(pIndex->pszStrings + pIndex->pNames[n].nName,
+                                                pIndex->nSeed);
+            }
+            fDone = detour_export_place(pIndex, pHashes, pnBucketStart,
+                                        piBucketNames, piBuckets, pnSlots);
+        }
+        if (!fDone) {
+            delete[] pIndex->pSlots;
+            pIndex->pSlots = NULL;
+        }
+    }
+
+    delete[] pHashes;
+    delete[] pnBucketStart;
+    delete[] piBucketNames;
+    delete[] piBuckets;
+    delete[] pnSlots;
+    SetLastError(fDone ? NO_ERROR : ERROR_NOT_ENOUGH_MEMORY);
+    return fDone;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+PDETOUR_EXPORT_INDEX WINAPI DetourCreateExportIndex(_In_reads_bytes_(cbImage) PVOID pImage,
+                                                    _In_ SIZE_T cbImage,
+                                                    _In_ BOOL fMapped)
+{
+    DETOUR_EXPORT_IMAGE image;
+    image.pbImage = (PBYTE)pImage;
+    image.cbImage = cbImage;
+    image.fMapped = fMapped;
+
+    WORD wMagic = 0;
+    LONG nNtHeader = 0;
+    DWORD dwSignature = 0;
+    WORD cSections = 0;
+    WORD cbOptionalHeader = 0;
+    WORD wOptionalMagic = 0;
+
+    if (pImage == NULL ||
+        !detour_export_read(&image, 0x00, &wMagic, sizeof(wMagic)) || wMagic != 0x5a4d ||
+        !detour_export_read(&image, 0x3c, &nNtHeader, sizeof(nNtHeader)) || nNtHeader < 0 ||
+        !detour_export_read(&image, nNtHeader, &dwSignature, sizeof(dwSignature)) ||
+        dwSignature != 0x00004550 ||
+        !detour_export_read(&image, nNtHeader + 6, &cSections, sizeof(cSections)) ||
+        !detour_export_read(&image, nNtHeader + 20, &cbOptionalHeader, sizeof(cbOptionalHeader))) {
+
+        SetLastError(ERROR_BAD_EXE_FORMAT);
+        return NULL;
+    }
+
+    ULONG nOptional = nNtHeader + 24;
+    ULONG nDirectories = 0;
+    DWORD nExportRva = 0;
+    DWORD cbExport = 0;
+    image.nSections = nOptional + cbOptionalHeader;
+    image.cSections = cSections;
+    image.cbHeaders = 0;
+    if (!detour_export_read(&image, nOptional, &wOptionalMagic, sizeof(wOptionalMagic)) ||
+        (wOptionalMagic != 0x10b && wOptionalMagic != 0x20b) ||
+        !detour_export_read(&image, nOptional + 60, &image.cbHeaders, sizeof(image.cbHeaders))) {
+        SetLastError(ERROR_EXE_MARKED_INVALID);
+        return NULL;
+    }
+    nDirectories = nOptional + ((wOptionalMagic == 0x20b) ? 112 : 96);
+    if (cbOptionalHeader >= nDirectories - nOptional + 8) {
+        detour_export_read(&image, nDirectories + 0, &nExportRva, sizeof(nExportRva));
+        detour_export_read(&image, nDirectories + 4, &cbExport, sizeof(cbExport));
+    }
+
+    // An image without exports gets an empty index.
+    DWORD nBase = 0;
+    DWORD cFunctions = 0;
+    DWORD cNames = 0;
+    DWORD nFunctionsRva = 0;
+    DWORD nNamesRva = 0;
+    DWORD nOrdinalsRva = 0;
+    ULONG nFunctions = 0;
+    ULONG nNames = 0;
+    ULONG nOrdinals = 0;
+
+    if (nExportRva != 0) {
+        ULONG nExport = detour_export_offset(&image, nExportRva, 40);
+        if (nExport == DETOUR_EXPORT_NONE) {
+            SetLastError(ERROR_EXE_MARKED_INVALID);
+            return NULL;
+        }
+        detour_export_read(&image, nExport + 16, &nBase, sizeof(nBase));
+        detour_export_read(&image, nExport + 20, &cFunctions, sizeof(cFunctions));
+        detour_export_read(&image, nExport + 24, &cNames, sizeof(cNames));
+        detour_export_read(&image, nExport + 28, &nFunctionsRva, sizeof(nFunctionsRva));
+        detour_export_read(&image, nExport + 32, &nNamesRva, sizeof(nNamesRva));
+        detour_export_read(&image, nExport + 36, &nOrdinalsRva, sizeof(nOrdinalsRva));
+
+        // Ordinals are 16 bits.
+        if (cFunctions > 0x10000 || cNames > 0x10000) {
+            SetLastError(ERROR_EXE_MARKED_INVALID);
+            return NULL;
+        }
+        nFunctions = detour_export_offset(&image, nFunctionsRva, cFunctions * 4);
+        nNames = detour_export_offset(&image, nNamesRva, cNames * 4);
+        nOrdinals = detour_export_offset(&image, nOrdinalsRva, cNames * 2);
+        if ((cFunctions != 0 && nFunctions == DETOUR_EXPORT_NONE) ||
+            (cNames != 0 && (nNames == DETOUR_EXPORT_NONE || nOrdinals == DETOUR_EXPORT_NONE))) {
+            SetLastError(ERROR_EXE_MARKED_INVALID);
+            return NULL;
+        }
+    }
+
+    // Size the strings: the names, then the forwarders.
+    SIZE_T cbStrings = 0;
+    for (ULONG n = 0; n < cNames; n++) {
+        DWORD nRva = 0;
+        LPCSTR psz = NULL;
+        detour_export_read(&image, nNames + n * 4, &nRva, sizeof(nRva));
+        ULONG cch = detour_export_string(&image, nRva, &psz);
+        if (cch != DETOUR_EXPORT_NONE) {
+            cbStrings += cch + 1;
+        }
+    }
+    for (ULONG n = 0; n < cFunctions; n++) {
+        DWORD nRva = 0;
+        LPCSTR psz = NULL;
+        detour_export_read(&image, nFunctions + n * 4, &nRva, sizeof(nRva));
+        if (nRva >= nExportRva && nRva - nExportRva < cbExport) {
+            ULONG cch = detour_export_string(&image, nRva, &psz);
+            if (cch != DETOUR_EXPORT_NONE) {
+                cbStrings += cch + 1;
+            }
+        }
+    }
+    if (cbStrings >= DETOUR_EXPORT_NONE) {
+        SetLastError(ERROR_EXE_MARKED_INVALID);
+        return NULL;
+    }
+
+    // One block holds the header, the arrays and then the strings; the
+    // slots are sized when the hash is built.
+    ULONG cBuckets = (cNames + DETOUR_EXPORT_NAMES_PER_BUCKET - 1) / DETOUR_EXPORT_NAMES_PER_BUCKET;
+    if (cBuckets == 0) {
+        cBuckets = 1;
+    }
+
+    SIZE_T cbIndex = (sizeof(_DETOUR_EXPORT_INDEX) + 7) & ~(SIZE_T)7;
+    SIZE_T nFunctionsAt = cbIndex;
+    cbIndex += cFunctions * sizeof(DETOUR_EXPORT_FUNCTION);
+    SIZE_T nNamesAt = cbIndex;
+    cbIndex += cNames * sizeof(DETOUR_EXPORT_NAME);
+    SIZE_T nDisplaceAt = cbIndex;
+    cbIndex += cBuckets * sizeof(USHORT);
+    SIZE_T nStringsAt = cbIndex;
+    cbIndex += cbStrings;
+
+    PBYTE pbIndex = new (std::nothrow) BYTE [cbIndex];
+    if (pbIndex == NULL) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    PDETOUR_EXPORT_INDEX pIndex = (PDETOUR_EXPORT_INDEX)pbIndex;
+    pIndex->dwSignature = DETOUR_EXPORT_INDEX_SIGNATURE;
+    pIndex->nBase = nBase;
+    pIndex->cFunctions = cFunctions;
+    pIndex->cNames = 0;
+    pIndex->cBuckets = cBuckets;
+    pIndex->nSlotMask = 0;
+    pIndex->nSeed = 0;
+    pIndex->pbImage = fMapped ? (PBYTE)pImage : NULL;
+    pIndex->pFunctions = (DETOUR_EXPORT_FUNCTION *)(pbIndex + nFunctionsAt);
+    pIndex->pNames = (DETOUR_EXPORT_NAME *)(pbIndex + nNamesAt);
+    pIndex->pSlots = NULL;
+    pIndex->pwDisplace = (USHORT *)(pbIndex + nDisplaceAt);
+    pIndex->pszStrings = (CHAR *)(pbIndex + nStringsAt);
+
+    ULONG cbUsed = 0;
+    for (ULONG n = 0; n < cFunctions; n++) {
+        DETOUR_EXPORT_FUNCTION *pFunction = &pIndex->pFunctions[n];
+        DWORD nRva = 0;
+        LPCSTR psz = NULL;
+
+        detour_export_read(&image, nFunctions + n * 4, &nRva, sizeof(nRva));
+        pFunction->nRva = nRva;
+        pFunction->nForward = DETOUR_EXPORT_NONE;
+        pFunction->nName = DETOUR_EXPORT_NONE;
+
+        // if the pointer is in the export region, then it is a forwarder.
+        if (nRva >= nExportRva && nRva - nExportRva < cbExport) {
+            pFunction->nRva = 0;
+            ULONG cch = detour_export_string(&image, nRva, &psz);
+            if (cch != DETOUR_EXPORT_NONE) {
+                pFunction->nForward = cbUsed;
+                memcpy(pIndex->pszStrings + cbUsed, psz, cch + 1);
+                cbUsed += cch + 1;
+            }
+        }
+    }
+
+    for (ULONG n = 0; n < cNames; n++) {
+        DWORD nRva = 0;
+        WORD iFunction = 0;
+        LPCSTR psz = NULL;
+
+        detour_export_read(&image, nNames + n * 4, &nRva, sizeof(nRva));
+        detour_export_read(&image, nOrdinals + n * 2, &iFunction, sizeof(iFunction));
+        ULONG cch = detour_export_string(&image, nRva, &psz);
+        if (cch == DETOUR_EXPORT_NONE || iFunction >= cFunctions) {
+            continue;
+        }
+
+        DETOUR_EXPORT_NAME *pName = &pIndex->pNames[pIndex->cNames++];
+        pName->nName = cbUsed;
+        pName->iFunction = iFunction;
+        memcpy(pIndex->pszStrings + cbUsed, psz, cch + 1);
+        cbUsed += cch + 1;
+
+        if (pIndex->pFunctions[iFunction].nName == DETOUR_EXPORT_NONE) {
+            pIndex->pFunctions[iFunction].nName = pName->nName;
+        }
+    }
+
+    if (!detour_export_build_hash(pIndex)) {
+        DETOUR_TRACE(("DetourCreateExportIndex: no perfect hash for %u names\n", pIndex->cNames));
+        delete[] pbIndex;
+        return NULL;
+    }
+
+    DETOUR_TRACE(("DetourCreateExportIndex: %u functions, %u names, %u slots\n",
+                  pIndex->cFunctions, pIndex->cNames, pIndex->nSlotMask + 1));
+    SetLastError(NO_ERROR);
+    return pIndex;
+}
+
+static VOID detour_export_fill(PDETOUR_EXPORT_INDEX pIndex, ULONG iFunction, PDETOUR_EXPORT pExport)
+{
+    const DETOUR_EXPORT_FUNCTION *pFunction = &pIndex->pFunctions[iFunction];
+
+    pExport->nOrdinal = pIndex->nBase + iFunction;
+    pExport->nRva = pFunction->nRva;
+    pExport->pszName = (pFunction->nName != DETOUR_EXPORT_NONE)
+        ? pIndex->pszStrings + pFunction->nName : NULL;
+    pExport->pszForward = (pFunction->nForward != DETOUR_EXPORT_NONE)
+        ? pIndex->pszStrings + pFunction->nForward : NULL;
+    pExport->pvCode = (pIndex->pbImage != NULL && pFunction->nRva != 0)
+        ? pIndex->pbImage + pFunction->nRva : NULL;
+}
+
+ULONG WINAPI DetourFindExports(_In_ PDETOUR_EXPORT_INDEX pIndex,
+                               _In_reads_(cNames) LPCSTR *ppszNames,
+                               _In_ ULONG cNames,
+                               _Out_writes_(cNames) PDETOUR_EXPORT pExports)
+{
+    if (pIndex == NULL || pIndex->dwSignature != DETOUR_EXPORT_INDEX_SIGNATURE ||
+        (cNames != 0 && (ppszNames == NULL || pExports == NULL))) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+
+    ULONG cFound = 0;
+    for (ULONG nFirst = 0; nFirst < cNames; nFirst += DETOUR_EXPORT_BATCH) {
+        ULONG cBatch = cNames - nFirst;
+        if (cBatch > DETOUR_EXPORT_BATCH) {
+            cBatch = DETOUR_EXPORT_BATCH;
+        }
+
+        // Hash the whole batch first so that the slot loads overlap.
+        ULONGLONG rHashes[DETOUR_EXPORT_BATCH];
+        const DETOUR_EXPORT_SLOT *rpSlots[DETOUR_EXPORT_BATCH];
+        for (ULONG n = 0; n < cBatch; n++) {
+            LPCSTR pszName = ppszNames[nFirst + n];
+            rpSlots[n] = NULL;
+            if (pszName != NULL && pIndex->cNames != 0) {
+                ULONGLONG h = detour_export_hash(pszName, pIndex->nSeed);
+                ULONG nDisplace = pIndex->pwDisplace[detour_export_bucket(h, pIndex->cBuckets)];
+                rHashes[n] = h;
+                rpSlots[n] = &pIndex->pSlots[detour_export_slot(h, nDisplace, pIndex->nSlotMask)];
+            }
+        }
+
+        for (ULONG n = 0; n < cBatch; n++) {
+            PDETOUR_EXPORT pExport = &pExports[nFirst + n];
+            const DETOUR_EXPORT_SLOT *pSlot = rpSlots[n];
+
+            if (pSlot != NULL && pSlot->iName != DETOUR_EXPORT_NONE &&
+                pSlot->nHash == (ULONG)rHashes[n]) {
+                const DETOUR_EXPORT_NAME *pName = &pIndex->pNames[pSlot->iName];
+                LPCSTR pszName = pIndex->pszStrings + pName->nName;
+                if (strcmp(pszName, ppszNames[nFirst + n]) == 0) {
+                    detour_export_fill(pIndex, pName->iFunction, pExport);
+                    pExport->pszName = pszName;
+                    cFound++;
+                    continue;
+                }
+            }
+            ZeroMemory(pExport, sizeof(*pExport));
+        }
+    }
+    SetLastError(NO_ERROR);
+    return cFound;
+}
+
+BOOL WINAPI DetourFindExportByOrdinal(_In_ PDETOUR_EXPORT_INDEX pIndex,
+                                      _In_ ULONG nOrdinal,
+                                      _Out_ PDETOUR_EXPORT pExport)
+{
+    if (pIndex == NULL || pIndex->dwSignature != DETOUR_EXPORT_INDEX_SIGNATURE ||
+        pExport == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    ULONG iFunction = nOrdinal - pIndex->nBase;
+    if (nOrdinal < pIndex->nBase || iFunction >= pIndex->cFunctions ||
+        (pIndex->pFunctions[iFunction].nRva == 0 &&
+         pIndex->pFunctions[iFunction].nForward == DETOUR_EXPORT_NONE)) {
+
+        ZeroMemory(pExport, sizeof(*pExport));
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    detour_export_fill(pIndex, iFunction, pExport);
+    SetLastError(NO_ERROR);
+    return TRUE;
+}
+
+VOID WINAPI DetourFreeExportIndex(_In_ PDETOUR_EXPORT_INDEX pIndex)
+{
+    if (pIndex != NULL && pIndex->dwSignature == DETOUR_EXPORT_INDEX_SIGNATURE) {
+        pIndex->dwSignature = 0;
+        delete[] pIndex->pSlots;
+        delete[] (PBYTE)pIndex;
+    }
+}
+
+//  End of File
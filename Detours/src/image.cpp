@@ -8,14 +8,31 @@
 //
 //  Used for for payloads, byways, and imports.
 //
+//  The input file is mapped read-only and parsed in place: the import names
+//  point into the view, and only the names that are edited are copied.  The
+//  portable build (DETOURS_OFFLINE_PORTABLE) maps with mmap and copies the
+//  unchanged sections file to file.
+//
 
 #if _MSC_VER < 1299
 #pragma warning(disable: 4710)
 #endif
 
 // #define DETOUR_DEBUG 1
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include "disol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#define NOTHROW
+#else
 #define DETOURS_INTERNAL
 #include "detours.h"
+#endif
+#include <new>
 
 #if DETOURS_VERSION != 0x4c0c1   // 0xMAJORcMINORcPATCH
 #error detours.h version mismatch
@@ -118,6 +135,8 @@ static inline HRESULT StringCchCatA(
 
 ///////////////////////////////////////////////////////////////////////////////
 //
+class CImageImportName;
+
 class CImageData
 {
     friend class CImage;
@@ -202,7 +221,7 @@ public:
     static CImage *         IsValid(PDETOUR_BINARY pBinary);
 
 public:                                                 // File Functions
-    BOOL                    Read(HANDLE hFile);
+    BOOL                    Read(HANDLE hFile, BOOL fCopy);
     BOOL                    Write(HANDLE hFile);
     BOOL                    Close();
 
@@ -232,8 +251,13 @@ protected:
     PBYTE                   AllocateOutput(DWORD cbData, DWORD *pnVirtAddr);
 
     PVOID                   RvaToVa(ULONG_PTR nRva);
+    LPCSTR                  RvaToString(ULONG_PTR nRva);
+    DWORD                   RvaToItems(ULONG_PTR nRva, DWORD cbItem);
+    BOOL                    IsFileRange(ULONG_PTR nOffset, ULONG_PTR cbData);
     DWORD                   RvaToFileOffset(DWORD nRva);
 
+    LPCSTR                  DuplicateString(_In_ LPCSTR pszIn);
+
     DWORD                   FileAlign(DWORD nAddr);
     DWORD                   SectionAlign(DWORD nAddr);
 
@@ -249,6 +273,8 @@ private:
 
     HANDLE                  m_hMap;                     // Read & Write
     PBYTE                   m_pMap;                     // Read & Write
+    BOOL                    m_fMapCopied;               // m_pMap is a heap copy.
+    PBYTE                   m_pbStrings;                // Edited names.
 
     DWORD                   m_nNextFileAddr;            // Write
     DWORD                   m_nNextVirtAddr;            // Write
@@ -308,41 +334,243 @@ static inline DWORD QuadAlign(DWORD a)
     return Align(a, 8);
 }
 
-static LPCSTR DuplicateString(_In_ LPCSTR pszIn)
+//////////////////////////////////////////////////////////// File Backend.
+//
+//  The input is read through a read-only view (or a heap copy) and the
+//  output is written sequentially with explicit seeks.  In the portable
+//  build a HANDLE is a file descriptor and the "mapping" is a duplicate of
+//  the input descriptor, so that unchanged data can be copied in the kernel
+//  without faulting in the view.
+//
+#ifdef DETOURS_OFFLINE_PORTABLE
+static inline int detour_file_fd(HANDLE hFile)
 {
-    if (pszIn == NULL) {
-        return NULL;
+    return (int)(LONG_PTR)hFile;
+}
+
+static BOOL detour_file_error(DWORD dwError)
+{
+    SetLastError(errno == ENOMEM ? ERROR_OUTOFMEMORY :
+                 errno == EBADF ? ERROR_INVALID_HANDLE : dwError);
+    return FALSE;
+}
+
+static BOOL detour_file_size(HANDLE hFile, DWORD *pcbFile)
+{
+    struct stat st;
+    if (fstat(detour_file_fd(hFile), &st) != 0) {
+        return detour_file_error(ERROR_READ_FAULT);
     }
+    if ((ULONGLONG)st.st_size >= 0xffffffffull) {
+        SetLastError(ERROR_BAD_EXE_FORMAT);
+        return FALSE;
+    }
+    *pcbFile = (DWORD)st.st_size;
+    return TRUE;
+}
 
-    size_t cch;
-    HRESULT hr = StringCchLengthA(pszIn, 8192, &cch);
-    if (FAILED(hr)) {
-        SetLastError(ERROR_INVALID_PARAMETER);
-        return NULL;
+static BOOL detour_file_map(HANDLE hFile, DWORD cbFile, HANDLE *phMap, PBYTE *ppbMap)
+{
+    // Above 2, so that a mapping is never NULL.
+    int fd = fcntl(detour_file_fd(hFile), F_DUPFD_CLOEXEC, 3);
+    if (fd < 0) {
+        return detour_file_error(ERROR_READ_FAULT);
     }
+    *phMap = (HANDLE)(LONG_PTR)fd;
 
-    PCHAR pszOut = new NOTHROW CHAR [cch + 1];
-    if (pszOut == NULL) {
-        SetLastError(ERROR_OUTOFMEMORY);
-        return NULL;
+    // Only the headers and the import tables are read through the view; a
+    // view on a 2MB boundary would let the first fault map a whole 2MB folio
+    // of the cached file and charge it all to RSS, so the view is placed one
+    // page off any such boundary.
+    const size_t cbLarge = 0x200000;
+    size_t cbPage = (size_t)sysconf(_SC_PAGESIZE);
+    size_t cbView = (cbFile + cbPage - 1) & ~(cbPage - 1);
+    PBYTE pbArea = (PBYTE)mmap(NULL, cbView + 2 * cbPage, PROT_NONE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pbArea == (PBYTE)MAP_FAILED) {
+        return detour_file_error(ERROR_OUTOFMEMORY);
+    }
+    PBYTE pbView = pbArea + cbPage;
+    if (((ULONG_PTR)pbView & (cbLarge - 1)) == 0) {
+        pbView += cbPage;
     }
 
-    hr = StringCchCopyA(pszOut, cch + 1, pszIn);
-    if (FAILED(hr)) {
-        delete[] pszOut;
-        return NULL;
+    PVOID pv = mmap(pbView, cbFile, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (pv == MAP_FAILED) {
+        munmap(pbArea, cbView + 2 * cbPage);
+        return detour_file_error(ERROR_READ_FAULT);
     }
+    munmap(pbArea, pbView - pbArea);
+    munmap(pbView + cbView, pbArea + cbView + 2 * cbPage - (pbView + cbView));
 
-    return pszOut;
+    madvise(pv, cbFile, MADV_RANDOM);
+    *ppbMap = (PBYTE)pv;
+    return TRUE;
+}
+
+static VOID detour_file_unmap(PBYTE pbMap, DWORD cbFile)
+{
+    munmap(pbMap, cbFile);
 }
 
-static VOID ReleaseString(_In_opt_ LPCSTR psz)
+static VOID detour_file_close(HANDLE hMap)
 {
-    if (psz != NULL) {
-        delete[] psz;
+    close(detour_file_fd(hMap));
+}
+
+static BOOL detour_file_read(HANDLE hFile, PBYTE pbData, DWORD cbData)
+{
+    for (DWORD nPos = 0; nPos < cbData;) {
+        ssize_t cbRead = pread(detour_file_fd(hFile), pbData + nPos, cbData - nPos, nPos);
+        if (cbRead <= 0) {
+            if (cbRead < 0 && errno == EINTR) {
+                continue;
+            }
+            return detour_file_error(ERROR_READ_FAULT);
+        }
+        nPos += (DWORD)cbRead;
+    }
+    return TRUE;
+}
+
+static BOOL detour_file_seek(HANDLE hFile, DWORD nPos)
+{
+    if (lseek(detour_file_fd(hFile), nPos, SEEK_SET) < 0) {
+        return detour_file_error(ERROR_WRITE_FAULT);
     }
+    return TRUE;
+}
+
+static BOOL detour_file_tell(HANDLE hFile, DWORD *pnPos)
+{
+    off_t nPos = lseek(detour_file_fd(hFile), 0, SEEK_CUR);
+    if (nPos < 0) {
+        return detour_file_error(ERROR_WRITE_FAULT);
+    }
+    *pnPos = (DWORD)nPos;
+    return TRUE;
+}
+
+static BOOL detour_file_write(HANDLE hFile, LPCVOID pvData, DWORD cbData, DWORD *pcbDone)
+{
+    *pcbDone = 0;
+    while (*pcbDone < cbData) {
+        ssize_t cbWritten = write(detour_file_fd(hFile),
+                                  (const BYTE *)pvData + *pcbDone, cbData - *pcbDone);
+        if (cbWritten <= 0) {
+            if (cbWritten < 0 && errno == EINTR) {
+                continue;
+            }
+            return detour_file_error(ERROR_WRITE_FAULT);
+        }
+        *pcbDone += (DWORD)cbWritten;
+    }
+    return TRUE;
+}
+
+static BOOL detour_file_copy(HANDLE hFile, HANDLE hMap, PBYTE pbMap, DWORD nPos, DWORD cbData)
+{
+#ifdef __linux__
+    // Large runs are copied in the kernel, without faulting in the view.
+    // Falls back to writing from the view if the files cannot share
+    // extents, e.g. when the output is a pipe.
+    if (hMap != NULL && cbData >= 0x10000) {
+        loff_t nIn = nPos;
+        while (cbData > 0) {
+            ssize_t cbCopied = copy_file_range(detour_file_fd(hMap), &nIn,
+                                               detour_file_fd(hFile), NULL, cbData, 0);
+            if (cbCopied <= 0) {
+                if (cbCopied < 0 && errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            cbData -= (DWORD)cbCopied;
+        }
+        nPos = (DWORD)nIn;
+    }
+#else
+    UNREFERENCED_PARAMETER(hMap);
+#endif
+    DWORD cbDone = 0;
+    return cbData == 0 || detour_file_write(hFile, pbMap + nPos, cbData, &cbDone);
+}
+
+#else // !DETOURS_OFFLINE_PORTABLE
+
+static BOOL detour_file_size(HANDLE hFile, DWORD *pcbFile)
+{
+    *pcbFile = GetFileSize(hFile, NULL);
+    return *pcbFile != (DWORD)-1;
+}
+
+static BOOL detour_file_map(HANDLE hFile, DWORD cbFile, HANDLE *phMap, PBYTE *ppbMap)
+{
+    UNREFERENCED_PARAMETER(cbFile);
+
+    *phMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (*phMap == NULL) {
+        return FALSE;
+    }
+    *ppbMap = (PBYTE)MapViewOfFileEx(*phMap, FILE_MAP_READ, 0, 0, 0, NULL);
+    return *ppbMap != NULL;
+}
+
+static VOID detour_file_unmap(PBYTE pbMap, DWORD cbFile)
+{
+    UNREFERENCED_PARAMETER(cbFile);
+    UnmapViewOfFile(pbMap);
+}
+
+static VOID detour_file_close(HANDLE hMap)
+{
+    CloseHandle(hMap);
+}
+
+static BOOL detour_file_seek(HANDLE hFile, DWORD nPos)
+{
+    return SetFilePointer(hFile, nPos, NULL, FILE_BEGIN) != ~0u;
+}
+
+static BOOL detour_file_tell(HANDLE hFile, DWORD *pnPos)
+{
+    *pnPos = SetFilePointer(hFile, 0, NULL, FILE_CURRENT);
+    return *pnPos != ~0u;
+}
+
+static BOOL detour_file_read(HANDLE hFile, PBYTE pbData, DWORD cbData)
+{
+    if (!detour_file_seek(hFile, 0)) {
+        return FALSE;
+    }
+    for (DWORD nPos = 0; nPos < cbData;) {
+        DWORD cbRead = 0;
+        if (!ReadFile(hFile, pbData + nPos, cbData - nPos, &cbRead, NULL)) {
+            return FALSE;
+        }
+        if (cbRead == 0) {
+            SetLastError(ERROR_HANDLE_EOF);
+            return FALSE;
+        }
+        nPos += cbRead;
+    }
+    return TRUE;
 }
 
+static BOOL detour_file_write(HANDLE hFile, LPCVOID pvData, DWORD cbData, DWORD *pcbDone)
+{
+    return ::WriteFile(hFile, pvData, cbData, pcbDone, NULL);
+}
+
+static BOOL detour_file_copy(HANDLE hFile, HANDLE hMap, PBYTE pbMap, DWORD nPos, DWORD cbData)
+{
+    UNREFERENCED_PARAMETER(hMap);
+
+    DWORD cbDone = 0;
+    return detour_file_write(hFile, pbMap + nPos, cbData, &cbDone);
+}
+#endif // !DETOURS_OFFLINE_PORTABLE
+
 //////////////////////////////////////////////////////////////////////////////
 //
 CImageImportFile::CImageImportFile()
@@ -372,14 +600,9 @@ CImageImportFile::~CImageImportFile()
         m_pImportNames = NULL;
         m_nImportNames = 0;
     }
-    if (m_pszName) {
-        delete[] m_pszName;
-        m_pszName = NULL;
-    }
-    if (m_pszOrig) {
-        delete[] m_pszOrig;
-        m_pszOrig = NULL;
-    }
+    // The names belong to the view or to CImage::DuplicateString.
+    m_pszName = NULL;
+    m_pszOrig = NULL;
 }
 
 CImageImportName::CImageImportName()
@@ -393,14 +616,8 @@ CImageImportName::CImageImportName()
 
 CImageImportName::~CImageImportName()
 {
-    if (m_pszName) {
-        delete[] m_pszName;
-        m_pszName = NULL;
-    }
-    if (m_pszOrig) {
-        delete[] m_pszOrig;
-        m_pszOrig = NULL;
-    }
+    m_pszName = NULL;
+    m_pszOrig = NULL;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -774,6 +991,8 @@ CImage::CImage()
 
     m_hMap = NULL;
     m_pMap = NULL;
+    m_fMapCopied = FALSE;
+    m_pbStrings = NULL;
 
     m_nPeOffset = 0;
     m_nSectionsOffset = 0;
@@ -808,13 +1027,25 @@ BOOL CImage::Close()
         m_pImageData = NULL;
     }
 
+    while (m_pbStrings != NULL) {
+        PBYTE pbNext = *(PBYTE *)m_pbStrings;
+        delete[] m_pbStrings;
+        m_pbStrings = pbNext;
+    }
+
     if (m_pMap != NULL) {
-        UnmapViewOfFile(m_pMap);
+        if (m_fMapCopied) {
+            delete[] m_pMap;
+        }
+        else {
+            detour_file_unmap(m_pMap, m_nFileSize);
+        }
         m_pMap = NULL;
+        m_fMapCopied = FALSE;
     }
 
     if (m_hMap) {
-        CloseHandle(m_hMap);
+        detour_file_close(m_hMap);
         m_hMap = NULL;
     }
 
@@ -943,14 +1174,75 @@ PVOID CImage::RvaToVa(ULONG_PTR nRva)
         DWORD vaEnd = vaStart + m_SectionHeaders[n].SizeOfRawData;
 
         if (nRva >= vaStart && nRva < vaEnd) {
-            return (PBYTE)m_pMap
-                + m_SectionHeaders[n].PointerToRawData
+            ULONG_PTR nOffset = m_SectionHeaders[n].PointerToRawData
                 + nRva - m_SectionHeaders[n].VirtualAddress;
+            if (nOffset >= m_nFileSize) {
+                return NULL;
+            }
+            return (PBYTE)m_pMap + nOffset;
         }
     }
     return NULL;
 }
 
+// Returns the string at nRva in the view if it ends within the file.
+LPCSTR CImage::RvaToString(ULONG_PTR nRva)
+{
+    LPCSTR psz = (LPCSTR)RvaToVa(nRva);
+    if (psz == NULL ||
+        memchr(psz, 0, m_nFileSize - (DWORD)((PBYTE)psz - m_pMap)) == NULL) {
+        return NULL;
+    }
+    return psz;
+}
+
+// Returns the number of whole items of cbItem bytes in the file from nRva.
+DWORD CImage::RvaToItems(ULONG_PTR nRva, DWORD cbItem)
+{
+    PBYTE pbItems = (PBYTE)RvaToVa(nRva);
+    if (pbItems == NULL) {
+        return 0;
+    }
+    return (m_nFileSize - (DWORD)(pbItems - m_pMap)) / cbItem;
+}
+
+BOOL CImage::IsFileRange(ULONG_PTR nOffset, ULONG_PTR cbData)
+{
+    return nOffset <= m_nFileSize && cbData <= m_nFileSize - nOffset;
+}
+
+// Copies a name set by an edit.  The copies are freed by Close.
+LPCSTR CImage::DuplicateString(_In_ LPCSTR pszIn)
+{
+    if (pszIn == NULL) {
+        return NULL;
+    }
+
+    size_t cch;
+    HRESULT hr = StringCchLengthA(pszIn, 8192, &cch);
+    if (FAILED(hr)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    PBYTE pbOut = new NOTHROW BYTE [sizeof(PBYTE) + cch + 1];
+    if (pbOut == NULL) {
+        SetLastError(ERROR_OUTOFMEMORY);
+        return NULL;
+    }
+
+    PCHAR pszOut = (PCHAR)(pbOut + sizeof(PBYTE));
+    hr = StringCchCopyA(pszOut, cch + 1, pszIn);
+    if (FAILED(hr)) {
+        delete[] pbOut;
+        return NULL;
+    }
+
+    *(PBYTE *)pbOut = m_pbStrings;
+    m_pbStrings = pbOut;
+    return pszOut;
+}
+
 DWORD CImage::RvaToFileOffset(DWORD nRva)
 {
     DWORD n;
@@ -971,34 +1263,32 @@ DWORD CImage::RvaToFileOffset(DWORD nRva)
 BOOL CImage::WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite,
                        LPDWORD lpNumberOfBytesWritten)
 {
-    return ::WriteFile(hFile,
-                       lpBuffer,
-                       nNumberOfBytesToWrite,
-                       lpNumberOfBytesWritten,
-                       NULL);
+    return detour_file_write(hFile,
+                             lpBuffer,
+                             nNumberOfBytesToWrite,
+                             lpNumberOfBytesWritten);
 }
 
 
 BOOL CImage::CopyFileData(HANDLE hFile, DWORD nOldPos, DWORD cbData)
 {
-    DWORD cbDone = 0;
-    return WriteFile(hFile, m_pMap + nOldPos, cbData, &cbDone);
+    if (nOldPos > m_nFileSize || cbData > m_nFileSize - nOldPos) {
+        SetLastError(ERROR_EXE_MARKED_INVALID);
+        return FALSE;
+    }
+    return detour_file_copy(hFile, m_hMap, m_pMap, nOldPos, cbData);
 }
 
 BOOL CImage::ZeroFileData(HANDLE hFile, DWORD cbData)
 {
-    if (!SizeOutputBuffer(4096)) {
-        return FALSE;
-    }
-
-    ZeroMemory(m_pbOutputBuffer, 4096);
+    static const BYTE s_rbZeros[512] = { 0 };
 
     for (DWORD cbLeft = cbData; cbLeft > 0;) {
-        DWORD cbStep = cbLeft > sizeof(m_pbOutputBuffer)
-            ? sizeof(m_pbOutputBuffer) : cbLeft;
+        DWORD cbStep = cbLeft > sizeof(s_rbZeros)
+            ? sizeof(s_rbZeros) : cbLeft;
         DWORD cbDone = 0;
 
-        if (!WriteFile(hFile, m_pbOutputBuffer, cbStep, &cbDone)) {
+        if (!WriteFile(hFile, s_rbZeros, cbStep, &cbDone)) {
             return FALSE;
         }
         if (cbDone == 0) {
@@ -1019,7 +1309,7 @@ BOOL CImage::AlignFileData(HANDLE hFile)
 
     if (hFile != INVALID_HANDLE_VALUE) {
         if (m_nNextFileAddr > nLastFileAddr) {
-            if (SetFilePointer(hFile, nLastFileAddr, NULL, FILE_BEGIN) == ~0u) {
+            if (!detour_file_seek(hFile, nLastFileAddr)) {
                 return FALSE;
             }
             return ZeroFileData(hFile, m_nNextFileAddr - nLastFileAddr);
@@ -1028,7 +1318,7 @@ BOOL CImage::AlignFileData(HANDLE hFile)
     return TRUE;
 }
 
-BOOL CImage::Read(HANDLE hFile)
+BOOL CImage::Read(HANDLE hFile, BOOL fCopy)
 {
     DWORD n;
     PBYTE pbData = NULL;
@@ -1041,18 +1331,27 @@ BOOL CImage::Read(HANDLE hFile)
 
     ///////////////////////////////////////////////////////// Create mapping.
     //
-    m_nFileSize = GetFileSize(hFile, NULL);
-    if (m_nFileSize == (DWORD)-1) {
+    if (!detour_file_size(hFile, &m_nFileSize)) {
         return FALSE;
     }
-
-    m_hMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (m_hMap == NULL) {
+    if (m_nFileSize < sizeof(IMAGE_DOS_HEADER)) {
+        SetLastError(ERROR_BAD_EXE_FORMAT);
         return FALSE;
     }
 
-    m_pMap = (PBYTE)MapViewOfFileEx(m_hMap, FILE_MAP_READ, 0, 0, 0, NULL);
-    if (m_pMap == NULL) {
+    if (fCopy) {
+        // The whole file is read; the image no longer needs the file.
+        m_pMap = new (std::nothrow) BYTE [m_nFileSize];
+        if (m_pMap == NULL) {
+            SetLastError(ERROR_OUTOFMEMORY);
+            return FALSE;
+        }
+        m_fMapCopied = TRUE;
+        if (!detour_file_read(hFile, m_pMap, m_nFileSize)) {
+            return FALSE;
+        }
+    }
+    else if (!detour_file_map(hFile, m_nFileSize, &m_hMap, &m_pMap)) {
         return FALSE;
     }
 
@@ -1094,7 +1393,9 @@ BOOL CImage::Read(HANDLE hFile)
 
     ///////////////////////////////////////////////// Process Section Headers.
     //
-    if (m_NtHeader.FileHeader.NumberOfSections > ARRAYSIZE(m_SectionHeaders)) {
+    if (m_NtHeader.FileHeader.NumberOfSections > ARRAYSIZE(m_SectionHeaders) ||
+        m_nSectionsOffset + sizeof(m_SectionHeaders[0])
+        * m_NtHeader.FileHeader.NumberOfSections > m_nFileSize) {
         SetLastError(ERROR_EXE_MARKED_INVALID);
         return FALSE;
     }
@@ -1113,6 +1414,10 @@ BOOL CImage::Read(HANDLE hFile)
     for (n = 0; n < m_NtHeader.FileHeader.NumberOfSections; n++) {
         if (strcmp((PCHAR)m_SectionHeaders[n].Name, ".detour") == 0) {
             DETOUR_SECTION_HEADER dh;
+            if (!IsFileRange(m_SectionHeaders[n].PointerToRawData, sizeof(dh))) {
+                SetLastError(ERROR_EXE_MARKED_INVALID);
+                return FALSE;
+            }
             CopyMemory(&dh,
                        m_pMap + m_SectionHeaders[n].PointerToRawData,
                        sizeof(dh));
@@ -1121,6 +1426,10 @@ BOOL CImage::Read(HANDLE hFile)
             if (dh.cbPrePE != 0) {
                 m_nPrePE = m_SectionHeaders[n].PointerToRawData + sizeof(dh);
                 m_cbPrePE = dh.cbPrePE;
+                if (!IsFileRange(m_nPrePE, m_cbPrePE)) {
+                    SetLastError(ERROR_EXE_MARKED_INVALID);
+                    return FALSE;
+                }
             }
             rvaDetourBeg = m_SectionHeaders[n].VirtualAddress;
             rvaDetourEnd = rvaDetourBeg + m_SectionHeaders[n].SizeOfRawData;
@@ -1144,16 +1453,27 @@ BOOL CImage::Read(HANDLE hFile)
         return FALSE;
     }
 
+    // Every table read below must end within the file.
     DWORD nFiles = 0;
-    for (; iidp[nFiles].OriginalFirstThunk != 0 || iidp[nFiles].FirstThunk != 0; nFiles++) {
+    DWORD nMaxFiles = RvaToItems(rvaImageDirectory, sizeof(*iidp));
+    for (; nFiles < nMaxFiles &&
+             (iidp[nFiles].OriginalFirstThunk != 0 || iidp[nFiles].FirstThunk != 0);
+         nFiles++) {
+    }
+    if (nFiles == nMaxFiles ||
+        (oidp != iidp &&
+         RvaToItems(rvaOriginalImageDirectory, sizeof(*oidp)) < nFiles)) {
+        SetLastError(ERROR_EXE_MARKED_INVALID);
+        return FALSE;
     }
 
     CImageImportFile **ppLastFile = &m_pImportFiles;
     m_pImportFiles = NULL;
 
+    // The names are left in the view; EditImports copies any it changes.
     for (n = 0; n < nFiles; n++, iidp++) {
         ULONG_PTR rvaName = iidp->Name;
-        PCHAR pszName = (PCHAR)RvaToVa(rvaName);
+        LPCSTR pszName = RvaToString(rvaName);
         if (pszName == NULL) {
             SetLastError(ERROR_EXE_MARKED_INVALID);
             goto fail;
@@ -1169,10 +1489,7 @@ BOOL CImage::Read(HANDLE hFile)
         ppLastFile = &pImportFile->m_pNextFile;
         m_nImportFiles++;
 
-        pImportFile->m_pszName = DuplicateString(pszName);
-        if (pImportFile->m_pszName == NULL) {
-            goto fail;
-        }
+        pImportFile->m_pszName = pszName;
 
         pImportFile->m_rvaOriginalFirstThunk = iidp->OriginalFirstThunk;
         pImportFile->m_rvaFirstThunk = iidp->FirstThunk;
@@ -1190,21 +1507,19 @@ BOOL CImage::Read(HANDLE hFile)
         }
 
         rvaName = oidp->Name;
-        pszName = (PCHAR)RvaToVa(rvaName);
+        pszName = RvaToString(rvaName);
         if (pszName == NULL) {
             SetLastError(ERROR_EXE_MARKED_INVALID);
             goto fail;
         }
-        pImportFile->m_pszOrig = DuplicateString(pszName);
-        if (pImportFile->m_pszOrig == NULL) {
-            goto fail;
-        }
+        pImportFile->m_pszOrig = pszName;
 
         DWORD rvaThunk = iidp->OriginalFirstThunk;
         if( !rvaThunk ) {
             rvaThunk = iidp->FirstThunk;
         }
         PIMAGE_THUNK_DATA pAddrThunk = (PIMAGE_THUNK_DATA)RvaToVa(rvaThunk);
+        DWORD nMaxNames = RvaToItems(rvaThunk, sizeof(*pAddrThunk));
         rvaThunk = oidp->OriginalFirstThunk;
         if( !rvaThunk ) {
             rvaThunk = oidp->FirstThunk;
@@ -1213,7 +1528,12 @@ BOOL CImage::Read(HANDLE hFile)
 
         DWORD nNames = 0;
         if (pAddrThunk) {
-            for (; pAddrThunk[nNames].u1.Ordinal; nNames++) {
+            for (; nNames < nMaxNames && pAddrThunk[nNames].u1.Ordinal; nNames++) {
+            }
+            if (nNames == nMaxNames ||
+                (nNames != 0 && RvaToItems(rvaThunk, sizeof(*pLookThunk)) < nNames)) {
+                SetLastError(ERROR_EXE_MARKED_INVALID);
+                goto fail;
             }
         }
 
@@ -1243,11 +1563,12 @@ BOOL CImage::Read(HANDLE hFile)
                     PIMAGE_IMPORT_BY_NAME pName
                         = (PIMAGE_IMPORT_BY_NAME)RvaToVa(rvaName);
                     if (pName) {
-                        pImportName->m_nHint = pName->Hint;
-                        pImportName->m_pszName = DuplicateString((PCHAR)pName->Name);
+                        pImportName->m_pszName = RvaToString(rvaName + sizeof(WORD));
                         if (pImportName->m_pszName == NULL) {
+                            SetLastError(ERROR_EXE_MARKED_INVALID);
                             goto fail;
                         }
+                        pImportName->m_nHint = pName->Hint;
                     }
 
                     rvaName = pLookThunk[f].u1.Ordinal;
@@ -1258,9 +1579,9 @@ BOOL CImage::Read(HANDLE hFile)
                     else {
                         pName = (PIMAGE_IMPORT_BY_NAME)RvaToVa(rvaName);
                         if (pName) {
-                            pImportName->m_pszOrig
-                                = DuplicateString((PCHAR)pName->Name);
+                            pImportName->m_pszOrig = RvaToString(rvaName + sizeof(WORD));
                             if (pImportName->m_pszOrig == NULL) {
+                                SetLastError(ERROR_EXE_MARKED_INVALID);
                                 goto fail;
                             }
                         }
@@ -1288,6 +1609,12 @@ BOOL CImage::Read(HANDLE hFile)
             if (dh.nDataOffset == 0) {
                 dh.nDataOffset = dh.cbHeaderSize;
             }
+            if (dh.cbDataSize < dh.nDataOffset ||
+                !IsFileRange((ULONG_PTR)m_SectionHeaders[n].PointerToRawData + dh.nDataOffset,
+                             dh.cbDataSize - dh.nDataOffset)) {
+                SetLastError(ERROR_EXE_MARKED_INVALID);
+                goto fail;
+            }
 
             cbData = dh.cbDataSize - dh.nDataOffset;
             pbData = (m_pMap +
@@ -1481,10 +1808,7 @@ BOOL CImage::EditImports(PVOID pContext,
                 if (pszFile != NULL) {
                     // Replace? Byway
                     if (pszFile != pImportFile->m_pszName) {
-                        LPCSTR pszLast = pImportFile->m_pszName;
                         pImportFile->m_pszName = DuplicateString(pszFile);
-                        ReleaseString(pszLast);
-
                         if (pImportFile->m_pszName == NULL) {
                             goto fail;
                         }
@@ -1512,10 +1836,7 @@ BOOL CImage::EditImports(PVOID pContext,
 
                 if (pszFile != NULL) {
                     if (pszFile != pImportFile->m_pszName) {
-                        LPCSTR pszLast = pImportFile->m_pszName;
                         pImportFile->m_pszName = DuplicateString(pszFile);
-                        ReleaseString(pszLast);
-
                         if (pImportFile->m_pszName == NULL) {
                             goto fail;
                         }
@@ -1543,10 +1864,7 @@ BOOL CImage::EditImports(PVOID pContext,
                         if (pszName != pImportName->m_pszName) {
                             pImportName->m_nOrdinal = 0;
 
-                            LPCSTR pszLast = pImportName->m_pszName;
                             pImportName->m_pszName = DuplicateString(pszName);
-                            ReleaseString(pszLast);
-
                             if (pImportName->m_pszName == NULL) {
                                 goto fail;
                             }
@@ -1555,10 +1873,7 @@ BOOL CImage::EditImports(PVOID pContext,
                     else if (nOrdinal != 0) {
                         pImportName->m_nOrdinal = nOrdinal;
 
-                        if (pImportName->m_pszName != NULL) {
-                            delete[] pImportName->m_pszName;
-                            pImportName->m_pszName = NULL;
-                        }
+                        pImportName->m_pszName = NULL;
                     }
                 }
             }
@@ -1622,7 +1937,7 @@ BOOL CImage::Write(HANDLE hFile)
 
     //////////////////////////////////////////////////////////// Copy Headers.
     //
-    if (SetFilePointer(hFile, 0, NULL, FILE_BEGIN) == ~0u) {
+    if (!detour_file_seek(hFile, 0)) {
         return FALSE;
     }
     if (!CopyFileData(hFile, 0, m_NtHeader.OptionalHeader.SizeOfHeaders)) {
@@ -1638,7 +1953,7 @@ BOOL CImage::Write(HANDLE hFile)
             + m_NtHeader.FileHeader.SizeOfOptionalHeader;
         m_DosHeader.e_lfanew = m_nPeOffset;
 
-        if (SetFilePointer(hFile, 0, NULL, FILE_BEGIN) == ~0u) {
+        if (!detour_file_seek(hFile, 0)) {
             return FALSE;
         }
         if (!WriteFile(hFile, &m_DosHeader, sizeof(m_DosHeader), &cbDone)) {
@@ -1659,7 +1974,7 @@ BOOL CImage::Write(HANDLE hFile)
             m_DosHeader.e_lfanew = m_nPeOffset;
 
 
-            if (SetFilePointer(hFile, 0, NULL, FILE_BEGIN) == ~0u) {
+            if (!detour_file_seek(hFile, 0)) {
                 return FALSE;
             }
             if (!CopyFileData(hFile, m_nPrePE, m_cbPrePE)) {
@@ -1679,9 +1994,7 @@ BOOL CImage::Write(HANDLE hFile)
     DWORD n = 0;
     for (; n < m_NtHeader.FileHeader.NumberOfSections; n++) {
         if (m_SectionHeaders[n].SizeOfRawData) {
-            if (SetFilePointer(hFile,
-                               m_SectionHeaders[n].PointerToRawData,
-                               NULL, FILE_BEGIN) == ~0u) {
+            if (!detour_file_seek(hFile, m_SectionHeaders[n].PointerToRawData)) {
                 return FALSE;
             }
             if (!CopyFileData(hFile,
@@ -1906,8 +2219,7 @@ BOOL CImage::Write(HANDLE hFile)
 
         //////////////////////////////////////////////////////////////////////////
         //
-        if (SetFilePointer(hFile, m_SectionHeaders[nSection].PointerToRawData,
-                           NULL, FILE_BEGIN) == ~0u) {
+        if (!detour_file_seek(hFile, m_SectionHeaders[nSection].PointerToRawData)) {
             return FALSE;
         }
         if (!WriteFile(hFile, m_pbOutputBuffer, m_SectionHeaders[nSection].SizeOfRawData,
@@ -1945,7 +2257,7 @@ BOOL CImage::Write(HANDLE hFile)
         .DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG].Size;
     if (debugAddr && debugSize) {
         DWORD nFileOffset = RvaToFileOffset(debugAddr);
-        if (SetFilePointer(hFile, nFileOffset, NULL, FILE_BEGIN) == ~0u) {
+        if (!detour_file_seek(hFile, nFileOffset)) {
             return FALSE;
         }
 
@@ -1975,7 +2287,7 @@ BOOL CImage::Write(HANDLE hFile)
         .DataDirectory[IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR].Size;
     if (clrAddr && clrSize && fNeedDetourSection) {
         DWORD nFileOffset = RvaToFileOffset(clrAddr);
-        if (SetFilePointer(hFile, nFileOffset, NULL, FILE_BEGIN) == ~0u) {
+        if (!detour_file_seek(hFile, nFileOffset)) {
             return FALSE;
         }
 
@@ -1996,7 +2308,7 @@ BOOL CImage::Write(HANDLE hFile)
     ///////////////////////////////////////////////// Copy Left-over Data.
     //
     if (m_nFileSize > m_nExtraOffset) {
-        if (SetFilePointer(hFile, m_nNextFileAddr, NULL, FILE_BEGIN) == ~0u) {
+        if (!detour_file_seek(hFile, m_nNextFileAddr)) {
             return FALSE;
         }
         if (!CopyFileData(hFile, m_nExtraOffset, m_nFileSize - m_nExtraOffset)) {
@@ -2008,14 +2320,14 @@ BOOL CImage::Write(HANDLE hFile)
     //////////////////////////////////////////////////// Finalize Headers.
     //
 
-    if (SetFilePointer(hFile, m_nPeOffset, NULL, FILE_BEGIN) == ~0u) {
+    if (!detour_file_seek(hFile, m_nPeOffset)) {
         return FALSE;
     }
     if (!WriteFile(hFile, &m_NtHeader, sizeof(m_NtHeader), &cbDone)) {
         return FALSE;
     }
 
-    if (SetFilePointer(hFile, m_nSectionsOffset, NULL, FILE_BEGIN) == ~0u) {
+    if (!detour_file_seek(hFile, m_nSectionsOffset)) {
         return FALSE;
     }
     if (!WriteFile(hFile, &m_SectionHeaders,
@@ -2025,8 +2337,7 @@ BOOL CImage::Write(HANDLE hFile)
         return FALSE;
     }
 
-    m_cbPostPE = SetFilePointer(hFile, 0, NULL, FILE_CURRENT);
-    if (m_cbPostPE == ~0u) {
+    if (!detour_file_tell(hFile, &m_cbPostPE)) {
         return FALSE;
     }
     m_cbPostPE = m_NtHeader.OptionalHeader.SizeOfHeaders - m_cbPostPE;
@@ -2040,6 +2351,16 @@ BOOL CImage::Write(HANDLE hFile)
 //
 PDETOUR_BINARY WINAPI DetourBinaryOpen(_In_ HANDLE hFile)
 {
+    return DetourBinaryOpenEx(hFile, 0);
+}
+
+PDETOUR_BINARY WINAPI DetourBinaryOpenEx(_In_ HANDLE hFile, _In_ DWORD dwFlags)
+{
+    if ((dwFlags & ~DETOUR_BINARY_OPEN_COPY) != 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
     Detour::CImage *pImage = new NOTHROW
         Detour::CImage;
     if (pImage == NULL) {
@@ -2047,7 +2368,7 @@ PDETOUR_BINARY WINAPI DetourBinaryOpen(_In_ HANDLE hFile)
         return FALSE;
     }
 
-    if (!pImage->Read(hFile)) {
+    if (!pImage->Read(hFile, (dwFlags & DETOUR_BINARY_OPEN_COPY) != 0)) {
         delete pImage;
         return FALSE;
     }
@@ -12,6 +12,7 @@
 // #define DETOUR_DEBUG 1
 #define DETOURS_INTERNAL
 #include "detours.h"
+#include <new>
 
 #if DETOURS_VERSION != 0x4c0c1   // 0xMAJORcMINORcPATCH
 #error detours.h version mismatch
@@ -457,6 +458,8 @@ BOOL WINAPI DetourEnumerateExports(_In_ HMODULE hModule,
                                    _In_ PF_DETOUR_ENUMERATE_EXPORT_CALLBACK pfExport)
 {
     PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)hModule;
+    PCHAR *ppszByOrdinal = NULL;
+    DWORD cByOrdinal = 0;
     if (hModule == NULL) {
         pDosHeader = (PIMAGE_DOS_HEADER)GetModuleHandleW(NULL);
     }
@@ -496,6 +499,25 @@ BOOL WINAPI DetourEnumerateExports(_In_ HMODULE hModule,
         PDWORD pdwNames = (PDWORD)RvaAdjust(pDosHeader, pExportDir->AddressOfNames);
         PWORD pwOrdinals = (PWORD)RvaAdjust(pDosHeader, pExportDir->AddressOfNameOrdinals);
 
+        // Name the functions in one pass over the name table, rather than
+        // one pass per function; fall back to the search if memory is short.
+        // Name ordinals are 16 bits, so no more functions can have names.
+        cByOrdinal = (pExportDir->NumberOfFunctions < 0x10000)
+            ? pExportDir->NumberOfFunctions : 0x10000;
+        if (pdwNames != NULL && pwOrdinals != NULL && cByOrdinal != 0) {
+            ppszByOrdinal = new (std::nothrow) PCHAR [cByOrdinal];
+        }
+        if (ppszByOrdinal != NULL) {
+            ZeroMemory(ppszByOrdinal, cByOrdinal * sizeof(PCHAR));
+            for (DWORD n = pExportDir->NumberOfNames; n > 0; n--) {
+                // Walk backwards so that the first name of a function wins.
+                if (pwOrdinals[n - 1] < cByOrdinal) {
+                    ppszByOrdinal[pwOrdinals[n - 1]]
+                        = (PCHAR)RvaAdjust(pDosHeader, pdwNames[n - 1]);
+                }
+            }
+        }
+
         for (DWORD nFunc = 0; nFunc < pExportDir->NumberOfFunctions; nFunc++) {
             PBYTE pbCode = (pdwFunctions != NULL)
                 ? (PBYTE)RvaAdjust(pDosHeader, pdwFunctions[nFunc]) : NULL;
@@ -506,11 +528,16 @@ BOOL WINAPI DetourEnumerateExports(_In_ HMODULE hModule,
                 pbCode = NULL;
             }
 
-            for (DWORD n = 0; n < pExportDir->NumberOfNames; n++) {
-                if (pwOrdinals[n] == nFunc) {
-                    pszName = (pdwNames != NULL)
-                        ? (PCHAR)RvaAdjust(pDosHeader, pdwNames[n]) : NULL;
-                    break;
+            if (ppszByOrdinal != NULL) {
+                pszName = (nFunc < cByOrdinal) ? ppszByOrdinal[nFunc] : NULL;
+            }
+            else {
+                for (DWORD n = 0; n < pExportDir->NumberOfNames; n++) {
+                    if (pwOrdinals[n] == nFunc) {
+                        pszName = (pdwNames != NULL)
+                            ? (PCHAR)RvaAdjust(pDosHeader, pdwNames[n]) : NULL;
+                        break;
+                    }
                 }
             }
             ULONG nOrdinal = pExportDir->Base + nFunc;
@@ -519,11 +546,13 @@ BOOL WINAPI DetourEnumerateExports(_In_ HMODULE hModule,
                 break;
             }
         }
+        delete[] ppszByOrdinal;
         SetLastError(NO_ERROR);
         return TRUE;
     }
     __except(GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ?
              EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        delete[] ppszByOrdinal;
         SetLastError(ERROR_EXE_MARKED_INVALID);
         return NULL;
     }
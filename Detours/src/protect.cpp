@@ -0,0 +1,219 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Bulk Page Protection Planning (protect.cpp of detours.lib)
+//
+//  Microsoft Research Detours Package, Version 4.0.1
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+
+// #define DETOUR_DEBUG 1
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include "disol.h"
+#else
+#define DETOURS_INTERNAL
+#include "detours.h"
+#endif
+#include "protect.h"
+
+#if DETOURS_VERSION != 0x4c0c1   // 0xMAJORcMINORcPATCH
+#error detours.h version mismatch
+#endif
+
+#ifndef DETOUR_TRACE
+#define DETOUR_TRACE(x)
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Sorts by target address.  A typed quicksort is several times faster than
+// qsort here; the smaller side recurses, so the depth is at most log2(n).
+static VOID detour_protect_sort(PDETOUR_PROTECT_SPAN pSpans, ULONG cSpans)
+{
+    while (cSpans > 16) {
+        // Median of three, left in pSpans[0].
+        PDETOUR_PROTECT_SPAN pMid = &pSpans[cSpans / 2];
+        PDETOUR_PROTECT_SPAN pEnd = &pSpans[cSpans - 1];
+        DETOUR_PROTECT_SPAN t;
+        if (pMid->pbTarget < pSpans->pbTarget) {
+            t = *pMid; *pMid = *pSpans; *pSpans = t;
+        }
+        if (pEnd->pbTarget < pMid->pbTarget) {
+            t = *pEnd; *pEnd = *pMid; *pMid = t;
+            if (pMid->pbTarget < pSpans->pbTarget) {
+                t = *pMid; *pMid = *pSpans; *pSpans = t;
+            }
+        }
+        t = *pMid; *pMid = *pSpans; *pSpans = t;
+
+        PBYTE pbPivot = pSpans->pbTarget;
+        ULONG nLo = 1;
+        ULONG nHi = cSpans - 1;
+        for (;;) {
+            while (nLo <= nHi && pSpans[nLo].pbTarget < pbPivot) {
+                nLo++;
+            }
+            while (pSpans[nHi].pbTarget > pbPivot) {
+                nHi--;
+            }
+            if (nLo >= nHi) {
+                break;
+            }
+            t = pSpans[nLo]; pSpans[nLo] = pSpans[nHi]; pSpans[nHi] = t;
+            nLo++;
+            nHi--;
+        }
+        t = pSpans[nHi]; pSpans[nHi] = pSpans[0]; pSpans[0] = t;
+
+        // pSpans[0..nHi-1] <= pivot <= pSpans[nHi+1..cSpans-1].
+        if (nHi < cSpans - nHi - 1) {
+            detour_protect_sort(pSpans, nHi);
+            pSpans += nHi + 1;
+            cSpans -= nHi + 1;
+        }
+        else {
+            detour_protect_sort(pSpans + nHi + 1, cSpans - nHi - 1);
+            cSpans = nHi;
+        }
+    }
+
+    for (ULONG n = 1; n < cSpans; n++) {
+        DETOUR_PROTECT_SPAN t = pSpans[n];
+        ULONG m = n;
+        for (; m > 0 && pSpans[m - 1].pbTarget > t.pbTarget; m--) {
+            pSpans[m] = pSpans[m - 1];
+        }
+        pSpans[m] = t;
+    }
+}
+
+static LONG detour_protect_last_error(LONG error)
+{
+    LONG last = (LONG)GetLastError();
+    return (last != NO_ERROR) ? last : error;
+}
+
+LONG detour_protect_plan(PDETOUR_PROTECT_PLAN pPlan,
+                         PDETOUR_PROTECT_SPAN pSpans,
+                         ULONG cSpans)
+{
+    const ULONG_PTR mask = (ULONG_PTR)pPlan->Backend.cbPage - 1;
+
+    pPlan->cRanges = 0;
+    if (cSpans == 0) {
+        return NO_ERROR;
+    }
+    if (pPlan->Backend.cbPage == 0 || (pPlan->Backend.cbPage & mask) != 0) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    detour_protect_sort(pSpans, cSpans);
+
+    ULONG_PTR nQueryLo = 0;
+    ULONG_PTR nQueryHi = 0;
+    DWORD dwQueryPerm = 0;
+
+    for (ULONG n = 0; n < cSpans;) {
+        // Merge the targets whose pages overlap or touch into one run.
+        ULONG_PTR nLo = (ULONG_PTR)pSpans[n].pbTarget & ~mask;
+        ULONG_PTR nHi = ((ULONG_PTR)pSpans[n].pbTarget + pSpans[n].cbTarget + mask) & ~mask;
+
+        for (n++; n < cSpans; n++) {
+            if (((ULONG_PTR)pSpans[n].pbTarget & ~mask) > nHi) {
+                break;
+            }
+            ULONG_PTR nEnd = ((ULONG_PTR)pSpans[n].pbTarget + pSpans[n].cbTarget + mask) & ~mask;
+            if (nEnd > nHi) {
+                nHi = nEnd;
+            }
+        }
+
+        // A single page needs no query; apply records its protection.
+        if (nHi - nLo == pPlan->Backend.cbPage) {
+            if (pPlan->cRanges >= pPlan->cMaxRanges) {
+                return ERROR_INSUFFICIENT_BUFFER;
+            }
+            PDETOUR_PROTECT_RANGE pRange = &pPlan->pRanges[pPlan->cRanges++];
+            pRange->pbBase = (PBYTE)nLo;
+            pRange->cbSize = nHi - nLo;
+            pRange->dwPerm = 0;
+            pRange->fChanged = FALSE;
+            continue;
+        }
+
+        // Split a longer run wherever the current protection changes, so
+        // that each range can be restored with a single call.  Runs often
+        // lie within the region returned by the previous query.
+        while (nLo < nHi) {
+            if (nLo < nQueryLo || nLo >= nQueryHi) {
+                PBYTE pbBase = NULL;
+                SIZE_T cbSize = 0;
+
+                pPlan->cQueryCalls++;
+                if (!pPlan->Backend.pfQuery(pPlan->Backend.pvContext,
+                                            (PBYTE)nLo, &pbBase, &cbSize, &dwQueryPerm)) {
+                    return detour_protect_last_error(ERROR_INVALID_PARAMETER);
+                }
+                nQueryLo = (ULONG_PTR)pbBase;
+                nQueryHi = (ULONG_PTR)pbBase + cbSize;
+                if (nQueryLo > nLo || nQueryHi <= nLo) {
+                    return ERROR_INVALID_DATA;
+                }
+            }
+
+            ULONG_PTR nEnd = (nQueryHi < nHi) ? nQueryHi : nHi;
+            if (pPlan->cRanges >= pPlan->cMaxRanges) {
+                return ERROR_INSUFFICIENT_BUFFER;
+            }
+
+            PDETOUR_PROTECT_RANGE pRange = &pPlan->pRanges[pPlan->cRanges++];
+            pRange->pbBase = (PBYTE)nLo;
+            pRange->cbSize = nEnd - nLo;
+            pRange->dwPerm = dwQueryPerm;
+            pRange->fChanged = FALSE;
+
+            DETOUR_TRACE(("detours: protect range %p..%p [%x]\n",
+                          pRange->pbBase, pRange->pbBase + pRange->cbSize - 1, dwQueryPerm));
+            nLo = nEnd;
+        }
+    }
+    return NO_ERROR;
+}
+
+LONG detour_protect_apply(PDETOUR_PROTECT_PLAN pPlan, DWORD dwPerm)
+{
+    for (ULONG n = 0; n < pPlan->cRanges; n++) {
+        PDETOUR_PROTECT_RANGE pRange = &pPlan->pRanges[n];
+        DWORD dwOld = 0;
+
+        pPlan->cProtectCalls++;
+        if (!pPlan->Backend.pfProtect(pPlan->Backend.pvContext,
+                                      pRange->pbBase, pRange->cbSize, dwPerm, &dwOld)) {
+            LONG error = detour_protect_last_error(ERROR_INVALID_PARAMETER);
+            detour_protect_restore(pPlan);
+            return error;
+        }
+        // The page protection may have changed since the plan was made.
+        pRange->dwPerm = dwOld;
+        pRange->fChanged = TRUE;
+    }
+    return NO_ERROR;
+}
+
+VOID detour_protect_restore(PDETOUR_PROTECT_PLAN pPlan)
+{
+    for (ULONG n = 0; n < pPlan->cRanges; n++) {
+        PDETOUR_PROTECT_RANGE pRange = &pPlan->pRanges[n];
+
+        if (pRange->fChanged) {
+            // We don't care if this fails, because the code is still accessible.
+            DWORD dwOld = 0;
+            pPlan->cProtectCalls++;
+            pPlan->Backend.pfProtect(pPlan->Backend.pvContext,
+                                     pRange->pbBase, pRange->cbSize, pRange->dwPerm, &dwOld);
+            pRange->fChanged = FALSE;
+        }
+    }
+}
+
+//  End of File
@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Bulk Page Protection Planning (protect.h of detours.lib)
+//
+//  Microsoft Research Detours Package, Version 4.0.1
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  A bulk commit makes every target of a transaction writable before any
+//  patch is written and restores them all afterwards.  The targets are
+//  sorted, merged into runs of whole pages, and each run longer than a
+//  page is split where the current protection changes, so that one
+//  protection call covers as many patches as possible and every range can
+//  be restored exactly.
+//
+//  The page queries and protection changes go through the
+//  DETOUR_PROTECT_BACKEND callbacks, so the planner also builds without
+//  Win32 (see samples/bulkperf).  Include detours.h (or disol.h) first.
+//
+
+#pragma once
+#ifndef _DETOURS_PROTECT_H_
+#define _DETOURS_PROTECT_H_
+
+typedef struct _DETOUR_PROTECT_SPAN
+{
+    PBYTE               pbTarget;
+    ULONG               cbTarget;
+} DETOUR_PROTECT_SPAN, *PDETOUR_PROTECT_SPAN;
+
+typedef struct _DETOUR_PROTECT_RANGE
+{
+    PBYTE               pbBase;         // Page aligned.
+    SIZE_T              cbSize;         // Whole pages.
+    DWORD               dwPerm;         // Protection to restore (set by apply).
+    BOOL                fChanged;       // Protection has been changed.
+} DETOUR_PROTECT_RANGE, *PDETOUR_PROTECT_RANGE;
+
+// Return the pages from pbAddress (rounded down) that share its current
+// protection, as VirtualQuery does.
+typedef BOOL (*PF_DETOUR_PROTECT_QUERY)(PVOID pvContext,
+                                        PBYTE pbAddress,
+                                        PBYTE *ppbBase,
+                                        SIZE_T *pcbSize,
+                                        DWORD *pdwPerm);
+typedef BOOL (*PF_DETOUR_PROTECT_SET)(PVOID pvContext,
+                                      PBYTE pbBase,
+                                      SIZE_T cbSize,
+                                      DWORD dwPerm,
+                                      DWORD *pdwOldPerm);
+
+typedef struct _DETOUR_PROTECT_BACKEND
+{
+    PF_DETOUR_PROTECT_QUERY pfQuery;
+    PF_DETOUR_PROTECT_SET   pfProtect;
+    PVOID                   pvContext;
+    ULONG                   cbPage;     // Power of 2.
+} DETOUR_PROTECT_BACKEND, *PDETOUR_PROTECT_BACKEND;
+
+typedef struct _DETOUR_PROTECT_PLAN
+{
+    DETOUR_PROTECT_BACKEND  Backend;
+    PDETOUR_PROTECT_RANGE   pRanges;
+    ULONG                   cRanges;
+    ULONG                   cMaxRanges; // 2 per span is always enough.
+    ULONG                   cQueryCalls;
+    ULONG                   cProtectCalls;
+} DETOUR_PROTECT_PLAN, *PDETOUR_PROTECT_PLAN;
+
+// Sorts pSpans in place.
+LONG detour_protect_plan(PDETOUR_PROTECT_PLAN pPlan,
+                         PDETOUR_PROTECT_SPAN pSpans,
+                         ULONG cSpans);
+LONG detour_protect_apply(PDETOUR_PROTECT_PLAN pPlan, DWORD dwPerm);
+VOID detour_protect_restore(PDETOUR_PROTECT_PLAN pPlan);
+
+#endif // _DETOURS_PROTECT_H_
+//
+//////////////////////////////////////////////////////////////// End of File.
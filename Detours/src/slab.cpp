@@ -0,0 +1,332 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Trampoline Slab Allocator (slab.cpp of detours.lib)
+//
+//  Microsoft Research Detours Package, Version 4.0.1
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+
+// #define DETOUR_DEBUG 1
+#ifdef DETOURS_OFFLINE_PORTABLE
+#include "disol.h"
+#else
+#define DETOURS_INTERNAL
+#include "detours.h"
+#endif
+#include "slab.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if DETOURS_VERSION != 0x4c0c1   // 0xMAJORcMINORcPATCH
+#error detours.h version mismatch
+#endif
+
+#ifndef DETOUR_TRACE
+#define DETOUR_TRACE(x)
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//
+static inline ULONG detour_slab_lowest_bit(ULONG dw)
+{
+#if defined(_MSC_VER)
+    unsigned long n;
+    _BitScanForward(&n, dw);
+    return (ULONG)n;
+#else
+    return (ULONG)__builtin_ctz(dw);
+#endif
+}
+
+static inline ULONG detour_slab_bucket(ULONG_PTR nWindow)
+{
+    return (ULONG)(nWindow & (DETOUR_SLAB_BUCKETS - 1));
+}
+
+static inline PDETOUR_SLAB_REGION detour_slab_region_of(PBYTE pbSlot)
+{
+    return (PDETOUR_SLAB_REGION)((ULONG_PTR)pbSlot & ~(ULONG_PTR)(DETOUR_SLAB_REGION_SIZE - 1));
+}
+
+static void detour_slab_link(PDETOUR_SLAB pSlab, PDETOUR_SLAB_REGION pRegion)
+{
+    PDETOUR_SLAB_REGION *ppHead =
+        &pSlab->rpBuckets[detour_slab_bucket((ULONG_PTR)pRegion >> DETOUR_SLAB_WINDOW_SHIFT)];
+
+    pRegion->pPrevFree = NULL;
+    pRegion->pNextFree = *ppHead;
+    if (*ppHead != NULL) {
+        (*ppHead)->pPrevFree = pRegion;
+    }
+    *ppHead = pRegion;
+}
+
+static void detour_slab_unlink(PDETOUR_SLAB pSlab, PDETOUR_SLAB_REGION pRegion)
+{
+    if (pRegion->pPrevFree != NULL) {
+        pRegion->pPrevFree->pNextFree = pRegion->pNextFree;
+    }
+    else {
+        pSlab->rpBuckets[detour_slab_bucket((ULONG_PTR)pRegion >> DETOUR_SLAB_WINDOW_SHIFT)]
+            = pRegion->pNextFree;
+    }
+    if (pRegion->pNextFree != NULL) {
+        pRegion->pNextFree->pPrevFree = pRegion->pPrevFree;
+    }
+    pRegion->pNextFree = NULL;
+    pRegion->pPrevFree = NULL;
+}
+
+// Find the slots of a region that lie within pbLo..pbHi.  A region that
+// straddles a jump bound still hands out the slots in reach, as the
+// region list did.
+
+static BOOL detour_slab_reach(PDETOUR_SLAB pSlab,
+                              PDETOUR_SLAB_REGION pRegion,
+                              PBYTE pbLo,
+                              PBYTE pbHi,
+                              ULONG *pnMin,
+                              ULONG *pnMax)
+{
+    PBYTE pbRegion = (PBYTE)pRegion;
+    ULONG nMin = pSlab->nFirstSlot;
+    ULONG nMax = pSlab->nFirstSlot + pSlab->cSlots - 1;
+
+    if (pbRegion + nMax * pSlab->cbSlot < pbLo || pbRegion + nMin * pSlab->cbSlot > pbHi) {
+        return FALSE;
+    }
+    if (pbRegion + nMin * pSlab->cbSlot < pbLo) {
+        nMin = (ULONG)((pbLo - pbRegion + pSlab->cbSlot - 1) / pSlab->cbSlot);
+    }
+    if (pbRegion + nMax * pSlab->cbSlot > pbHi) {
+        nMax = (ULONG)((pbHi - pbRegion) / pSlab->cbSlot);
+    }
+    *pnMin = nMin;
+    *pnMax = nMax;
+    return TRUE;
+}
+
+// Return the lowest free slot of a region that is in reach, or 0 (the
+// header) if there is none.  The region must have a free slot.
+
+static ULONG detour_slab_find(PDETOUR_SLAB pSlab,
+                              PDETOUR_SLAB_REGION pRegion,
+                              PBYTE pbLo,
+                              PBYTE pbHi)
+{
+    ULONG nMin;
+    ULONG nMax;
+
+    if (!detour_slab_reach(pSlab, pRegion, pbLo, pbHi, &nMin, &nMax)) {
+        return 0;
+    }
+
+    ULONG n = pRegion->nHint;
+    while (pRegion->rdwFree[n] == 0) {
+        n++;
+    }
+    pRegion->nHint = n;
+
+    if (n < nMin / 32) {
+        n = nMin / 32;
+    }
+    for (; n <= nMax / 32; n++) {
+        ULONG dw = pRegion->rdwFree[n];
+        if (n == nMin / 32) {
+            dw &= ~0u << (nMin % 32);
+        }
+        if (n == nMax / 32 && nMax % 32 != 31) {
+            dw &= (1u << (nMax % 32 + 1)) - 1;
+        }
+        if (dw != 0) {
+            return n * 32 + detour_slab_lowest_bit(dw);
+        }
+    }
+    return 0;
+}
+
+static PBYTE detour_slab_take(PDETOUR_SLAB pSlab, PDETOUR_SLAB_REGION pRegion, ULONG n)
+{
+    pRegion->rdwFree[n / 32] &= ~(1u << (n % 32));
+    if (--pRegion->cFree == 0) {
+        detour_slab_unlink(pSlab, pRegion);
+    }
+    pSlab->pDefault = pRegion;
+
+    return (PBYTE)pRegion + n * pSlab->cbSlot;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+BOOL detour_slab_init(PDETOUR_SLAB pSlab,
+                      ULONG cbSlot,
+                      const DETOUR_SLAB_PAGES *pPages)
+{
+    if (cbSlot < DETOUR_SLAB_MIN_SLOT || cbSlot > DETOUR_SLAB_REGION_SIZE / 2 ||
+        pPages->pfAlloc == NULL || pPages->pfFree == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(pSlab, sizeof(*pSlab));
+    pSlab->Pages = *pPages;
+    pSlab->cbSlot = cbSlot;
+    pSlab->nFirstSlot = (sizeof(DETOUR_SLAB_REGION) + cbSlot - 1) / cbSlot;
+    pSlab->cSlots = DETOUR_SLAB_REGION_SIZE / cbSlot - pSlab->nFirstSlot;
+    return TRUE;
+}
+
+PBYTE detour_slab_alloc(PDETOUR_SLAB pSlab,
+                        PBYTE pbTarget,
+                        PBYTE pbLo,
+                        PBYTE pbHi)
+{
+    // First check the region of the last allocation, as attaching to
+    // several functions in one module tends to hit the same region.
+    PDETOUR_SLAB_REGION pRegion = pSlab->pDefault;
+    ULONG n;
+    if (pRegion != NULL && pRegion->cFree != 0 &&
+        (n = detour_slab_find(pSlab, pRegion, pbLo, pbHi)) != 0) {
+        return detour_slab_take(pSlab, pRegion, n);
+    }
+
+    // Then probe the windows within bounds, nearest the target first.
+    ULONG_PTR nLo = (ULONG_PTR)pbLo >> DETOUR_SLAB_WINDOW_SHIFT;
+    ULONG_PTR nHi = (ULONG_PTR)pbHi >> DETOUR_SLAB_WINDOW_SHIFT;
+    ULONG_PTR nTarget = (ULONG_PTR)pbTarget >> DETOUR_SLAB_WINDOW_SHIFT;
+
+    // Bounds wider than the table (e.g. IA64) may match in any bucket,
+    // and walking one side of the target visits every bucket.
+    BOOL fWide = (nHi - nLo >= DETOUR_SLAB_BUCKETS);
+    ULONG_PTR cProbe = fWide ? DETOUR_SLAB_BUCKETS - 1 : nHi - nLo;
+
+    for (ULONG_PTR d = 0; d <= cProbe; d++) {
+        for (int nSide = 0; nSide < 2; nSide++) {
+            ULONG_PTR nWindow = nSide ? nTarget + d : nTarget - d;
+            if (nSide && (d == 0 || fWide)) {
+                continue;
+            }
+            if (!fWide && (nWindow < nLo || nWindow > nHi)) {
+                continue;
+            }
+
+            pRegion = pSlab->rpBuckets[detour_slab_bucket(nWindow)];
+            for (; pRegion != NULL; pRegion = pRegion->pNextFree) {
+                if ((n = detour_slab_find(pSlab, pRegion, pbLo, pbHi)) != 0) {
+                    return detour_slab_take(pSlab, pRegion, n);
+                }
+            }
+        }
+    }
+
+    // We need to allocate a new region.
+    pRegion = (PDETOUR_SLAB_REGION)
+        pSlab->Pages.pfAlloc(pSlab->Pages.pvContext, pbTarget, pbLo, pbHi);
+    if (pRegion == NULL) {
+        DETOUR_TRACE(("Couldn't find available memory region!\n"));
+        return NULL;
+    }
+    // The pages may end past pbHi (or begin before pbLo), as long as a
+    // slot is in reach.
+    ULONG nMin;
+    ULONG nMax;
+    if (((ULONG_PTR)pRegion & (DETOUR_SLAB_REGION_SIZE - 1)) != 0 ||
+        !detour_slab_reach(pSlab, pRegion, pbLo, pbHi, &nMin, &nMax)) {
+        pSlab->Pages.pfFree(pSlab->Pages.pvContext, pRegion);
+        return NULL;
+    }
+
+    DETOUR_TRACE(("  Allocated region %p..%p\n\n",
+                  pRegion, ((PBYTE)pRegion) + DETOUR_SLAB_REGION_SIZE - 1));
+
+    pRegion->dwSignature = DETOUR_SLAB_SIGNATURE;
+    pRegion->cFree = pSlab->cSlots;
+    pRegion->nHint = pSlab->nFirstSlot / 32;
+    pRegion->fEmpty = FALSE;
+    pRegion->pNextEmpty = NULL;
+    ZeroMemory(pRegion->rdwFree, sizeof(pRegion->rdwFree));
+    for (ULONG n = pSlab->nFirstSlot; n < pSlab->nFirstSlot + pSlab->cSlots; n++) {
+        pRegion->rdwFree[n / 32] |= 1u << (n % 32);
+    }
+
+    pRegion->pPrev = NULL;
+    pRegion->pNext = pSlab->pRegions;
+    if (pSlab->pRegions != NULL) {
+        pSlab->pRegions->pPrev = pRegion;
+    }
+    pSlab->pRegions = pRegion;
+    pSlab->cRegions++;
+    detour_slab_link(pSlab, pRegion);
+
+    return detour_slab_take(pSlab, pRegion, nMin);
+}
+
+VOID detour_slab_free(PDETOUR_SLAB pSlab, PBYTE pbSlot)
+{
+    PDETOUR_SLAB_REGION pRegion = detour_slab_region_of(pbSlot);
+    ULONG n = (ULONG)(pbSlot - (PBYTE)pRegion) / pSlab->cbSlot;
+
+    if (pRegion->cFree++ == 0) {
+        detour_slab_link(pSlab, pRegion);
+    }
+    pRegion->rdwFree[n / 32] |= 1u << (n % 32);
+    if (n / 32 < pRegion->nHint) {
+        pRegion->nHint = n / 32;
+    }
+
+    if (pRegion->cFree == pSlab->cSlots && !pRegion->fEmpty) {
+        pRegion->fEmpty = TRUE;
+        pRegion->pNextEmpty = pSlab->pEmpty;
+        pSlab->pEmpty = pRegion;
+    }
+}
+
+BOOL detour_slab_is_region_empty(PDETOUR_SLAB pSlab, PDETOUR_SLAB_REGION pRegion)
+{
+    // Stop if the region isn't a region (this would be bad).
+    if (pRegion->dwSignature != DETOUR_SLAB_SIGNATURE) {
+        return FALSE;
+    }
+    return pRegion->cFree == pSlab->cSlots;
+}
+
+ULONG detour_slab_free_empty_regions(PDETOUR_SLAB pSlab)
+{
+    ULONG cFreed = 0;
+
+    // Only regions whose last slot was freed are checked; any that have
+    // since been reused stay.
+    while (pSlab->pEmpty != NULL) {
+        PDETOUR_SLAB_REGION pRegion = pSlab->pEmpty;
+        pSlab->pEmpty = pRegion->pNextEmpty;
+        pRegion->pNextEmpty = NULL;
+        pRegion->fEmpty = FALSE;
+
+        if (!detour_slab_is_region_empty(pSlab, pRegion)) {
+            continue;
+        }
+
+        if (pRegion->pPrev != NULL) {
+            pRegion->pPrev->pNext = pRegion->pNext;
+        }
+        else {
+            pSlab->pRegions = pRegion->pNext;
+        }
+        if (pRegion->pNext != NULL) {
+            pRegion->pNext->pPrev = pRegion->pPrev;
+        }
+        detour_slab_unlink(pSlab, pRegion);
+        if (pSlab->pDefault == pRegion) {
+            pSlab->pDefault = NULL;
+        }
+        pSlab->cRegions--;
+        cFreed++;
+
+        pSlab->Pages.pfFree(pSlab->Pages.pvContext, pRegion);
+    }
+    return cFreed;
+}
+
+//  End of File
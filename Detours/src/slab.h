@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Trampoline Slab Allocator (slab.h of detours.lib)
+//
+//  Microsoft Research Detours Package, Version 4.0.1
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Trampolines are carved out of 64KB regions.  Each region starts with a
+//  header holding a bitmap of its free slots, and regions that still have
+//  free slots are hashed by 256MB address window.  Allocation probes only
+//  the windows within the jump bounds of the target; freeing a slot or
+//  asking whether a region is empty touches only that region's header,
+//  and a region whose last slot is freed is queued for release.
+//
+//  The pages themselves come from the DETOUR_SLAB_PAGES callbacks, so the
+//  allocator also builds without Win32 (see samples/slabperf).  Include
+//  detours.h (or disol.h) first.
+//
+
+#pragma once
+#ifndef _DETOURS_SLAB_H_
+#define _DETOURS_SLAB_H_
+
+const ULONG DETOUR_SLAB_REGION_SIZE     = 0x10000;
+const ULONG DETOUR_SLAB_SIGNATURE       = 0x52727464;   // 'Rrtd'
+const ULONG DETOUR_SLAB_MIN_SLOT        = 64;
+const ULONG DETOUR_SLAB_MAX_SLOTS       = DETOUR_SLAB_REGION_SIZE / DETOUR_SLAB_MIN_SLOT;
+const ULONG DETOUR_SLAB_WINDOW_SHIFT    = 28;           // 256MB windows.
+const ULONG DETOUR_SLAB_BUCKETS         = 64;           // Power of 2.
+
+typedef struct _DETOUR_SLAB_REGION DETOUR_SLAB_REGION, *PDETOUR_SLAB_REGION;
+
+struct _DETOUR_SLAB_REGION
+{
+    ULONG               dwSignature;
+    ULONG               cFree;      // Free slots in this region.
+    PDETOUR_SLAB_REGION pNext;      // Next region in list of all regions.
+    PDETOUR_SLAB_REGION pPrev;      // Previous region in list of all regions.
+    PDETOUR_SLAB_REGION pNextFree;  // Next region with free slots in this bucket.
+    PDETOUR_SLAB_REGION pPrevFree;  // Previous region with free slots in this bucket.
+    PDETOUR_SLAB_REGION pNextEmpty; // Next region that may have become empty.
+    ULONG               nHint;      // No free slots in rdwFree[0..nHint-1].
+    ULONG               fEmpty;     // On the list of regions that may be empty.
+    ULONG               rdwFree[DETOUR_SLAB_MAX_SLOTS / 32];    // Bit set if slot free.
+};
+
+// Commit a DETOUR_SLAB_REGION_SIZE aligned, writable region that lies
+// within pbLo..pbHi, preferring addresses near pbTarget.
+typedef PVOID (*PF_DETOUR_SLAB_ALLOC)(PVOID pvContext,
+                                      PBYTE pbTarget,
+                                      PBYTE pbLo,
+                                      PBYTE pbHi);
+typedef VOID (*PF_DETOUR_SLAB_FREE)(PVOID pvContext, PVOID pvRegion);
+
+typedef struct _DETOUR_SLAB_PAGES
+{
+    PF_DETOUR_SLAB_ALLOC    pfAlloc;
+    PF_DETOUR_SLAB_FREE     pfFree;
+    PVOID                   pvContext;
+} DETOUR_SLAB_PAGES, *PDETOUR_SLAB_PAGES;
+
+typedef struct _DETOUR_SLAB
+{
+    DETOUR_SLAB_PAGES   Pages;
+    ULONG               cbSlot;
+    ULONG               nFirstSlot;     // Slots covered by the region header.
+    ULONG               cSlots;         // Usable slots per region.
+    ULONG               cRegions;
+    PDETOUR_SLAB_REGION pRegions;       // List of all regions.
+    PDETOUR_SLAB_REGION pDefault;       // Region of the last allocation.
+    PDETOUR_SLAB_REGION pEmpty;         // Regions that may have become empty.
+    PDETOUR_SLAB_REGION rpBuckets[DETOUR_SLAB_BUCKETS];    // Regions with free slots.
+} DETOUR_SLAB, *PDETOUR_SLAB;
+
+BOOL detour_slab_init(PDETOUR_SLAB pSlab,
+                      ULONG cbSlot,
+                      const DETOUR_SLAB_PAGES *pPages);
+PBYTE detour_slab_alloc(PDETOUR_SLAB pSlab,
+                        PBYTE pbTarget,
+                        PBYTE pbLo,
+                        PBYTE pbHi);
+VOID detour_slab_free(PDETOUR_SLAB pSlab, PBYTE pbSlot);
+BOOL detour_slab_is_region_empty(PDETOUR_SLAB pSlab, PDETOUR_SLAB_REGION pRegion);
+ULONG detour_slab_free_empty_regions(PDETOUR_SLAB pSlab);
+
+#endif // _DETOURS_SLAB_H_
+//
+//////////////////////////////////////////////////////////////// End of File.
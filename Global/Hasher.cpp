@@ -0,0 +1,815 @@
+//
+// FACILITY:	Hasher - Streaming, tree and fast hashes
+//
+// DESCRIPTION:	This module contains the implementation of the Hasher class.
+//
+//				Both modes hash fixed-size blocks (64 bytes for SHA-256, 32-byte stripes for XXH64) and keep the bytes of a
+//				partial block until the next update or finish. update hashes whole blocks straight from the caller's buffer, so
+//				the copy is at most one block per call. XXH64 follows the reference algorithm, so its digests match xxhsum's
+//				(the digest bytes are the 64-bit value, most significant byte first).
+//
+//				tree splits the buffer into chunks, and the calling thread and the workers it starts take the next chunk from
+//				a shared counter, so a thread that is slowed by page faults takes fewer chunks. The root is the hash, in the
+//				same mode, of the chunks' digests in order followed by the length and the chunk size (64-bit, little-endian)
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstring>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "Hasher.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	HASHER_SHA256_BLOCK		64						// Bytes in a SHA-256 block
+#define	HASHER_FAST_STRIPE		32						// Bytes in an XXH64 stripe
+
+#define	HASHER_PRIME64_1		0x9E3779B185EBCA87ull	// XXH64 primes
+#define	HASHER_PRIME64_2		0xC2B2AE3D27D4EB4Full
+#define	HASHER_PRIME64_3		0x165667B19E3779F9ull
+#define	HASHER_PRIME64_4		0x85EBCA77C2B2AE63ull
+#define	HASHER_PRIME64_5		0x27D4EB2F165667C5ull
+
+//
+// TYPES:
+//
+
+typedef struct _HASHER_TREE_WORK						// Shared by the threads of a tree hash
+	{
+	HASHER_MODE				mode;						// Hash to compute
+	const uint8_t			*data;						// Bytes to hash
+	size_t					length;						// Number of bytes
+	size_t					chunk_size;					// Bytes in each chunk
+	size_t					chunks;						// Number of chunks
+	size_t					digest_size;				// Size of each chunk's digest
+	uint8_t					*digests;					// Chunk digests, in order
+	std::atomic<size_t>		next;						// Next chunk to hash
+	} HASHER_TREE_WORK, *PHASHER_TREE_WORK;
+
+//
+// DECLARATIONS:
+//
+
+static const uint32_t	HASHER_sha256_k [64] =
+	{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+	};
+
+static const uint32_t	HASHER_sha256_initial [8] =
+	{
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+	};
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+inline
+uint32_t
+rotr32													// Rotate a longword right
+	(
+	uint32_t	Value,									// Value
+	unsigned	Count									// Bits (1 - 31)
+	);
+
+static
+inline
+uint64_t
+rotl64													// Rotate a quadword left
+	(
+	uint64_t	Value,									// Value
+	unsigned	Count									// Bits (1 - 63)
+	);
+
+static
+inline
+uint64_t
+fast_round												// Mix a quadword into an XXH64 accumulator
+	(
+	uint64_t	Lane,									// Accumulator
+	uint64_t	Input									// Quadword of input
+	);
+
+static
+inline
+uint64_t
+fast_merge												// Merge an XXH64 accumulator into the hash
+	(
+	uint64_t	Hash,									// Hash
+	uint64_t	Lane									// Accumulator
+	);
+
+static
+uint64_t
+fast_tail												// Finish an XXH64 hash
+	(
+	uint64_t		Hash,								// Hash so far, with the length added
+	const uint8_t	*Tail,								// Bytes after the last whole stripe
+	size_t			Length								// Number of bytes (less than a stripe)
+	);
+
+static
+void
+tree_worker												// Hash chunks until there are none left
+	(
+	PHASHER_TREE_WORK	Work							// Shared work
+	);
+
+
+
+Hasher::Hasher											// Constructor
+	(
+	_In_	HASHER_MODE		Mode,						// Hash to compute
+	_In_	uint64_t		Seed						// Seed (HASHER_FAST only)
+	)
+{
+
+	reset (Mode, Seed);
+}							// End routine Hasher::Hasher
+
+
+void
+Hasher::reset											// Start a new hash
+	(
+	_In_	HASHER_MODE		Mode,						// Hash to compute
+	_In_	uint64_t		Seed						// Seed (HASHER_FAST only)
+	)
+
+//
+// DESCRIPTION:		Set the initial state of the mode, and discard anything added since the last reset
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+
+	hash_mode = Mode;
+	seed = Seed;
+	total = 0;
+	used = 0;
+
+	if (Mode == HASHER_SHA256)
+		{
+		block_bytes = HASHER_SHA256_BLOCK;
+		memcpy (sha, HASHER_sha256_initial, sizeof (sha));
+		}
+	else
+		{
+		block_bytes = HASHER_FAST_STRIPE;
+		lane [0] = Seed + HASHER_PRIME64_1 + HASHER_PRIME64_2;
+		lane [1] = Seed + HASHER_PRIME64_2;
+		lane [2] = Seed;
+		lane [3] = Seed - HASHER_PRIME64_1;
+		}
+
+}							// End routine Hasher::reset
+
+
+void
+Hasher::update											// Add bytes to the hash
+	(
+	_In_reads_bytes_(Length)	const void	*Data,		// Bytes to hash
+	_In_						size_t		Length		// Number of bytes
+	)
+
+//
+// DESCRIPTION:		Complete the partial block, if there is one, then hash the whole blocks in place, and keep what is left over
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+const uint8_t	*in = (const uint8_t *) Data;
+size_t			take;
+size_t			count;
+
+
+	if (Length == 0)
+		{
+		return;
+		}
+
+	total += Length;
+
+	if (used != 0)
+		{
+		take = block_bytes - used < Length ? block_bytes - used : Length;
+		memcpy (block + used, in, take);
+		used += take;
+		in += take;
+		Length -= take;
+
+		if (used < block_bytes)
+			{
+			return;
+			}
+
+		if (hash_mode == HASHER_SHA256)
+			{
+			sha256_blocks (block, 1);
+			}
+		else
+			{
+			fast_stripes (block, 1);
+			}
+
+		used = 0;
+		}
+
+	count = Length / block_bytes;
+
+	if (count != 0)
+		{
+
+		if (hash_mode == HASHER_SHA256)
+			{
+			sha256_blocks (in, count);
+			}
+		else
+			{
+			fast_stripes (in, count);
+			}
+
+		in += count * block_bytes;
+		Length -= count * block_bytes;
+		}
+
+	memcpy (block, in, Length);
+	used = Length;
+}							// End routine Hasher::update
+
+
+size_t
+Hasher::finish											// Produce the digest
+	(
+	_Out_writes_bytes_(HASHER_MAX_DIGEST)
+	uint8_t					*Digest						// Receives the digest (digest_size bytes)
+	)
+
+//
+// DESCRIPTION:		For SHA-256, pad the last block with 0x80, zeros and the length in bits, and store the state most significant
+//					byte first. For XXH64, merge the accumulators (or, if there was less than a stripe, start from the seed), add
+//					the length and the bytes of the partial stripe, and avalanche
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	The hash must be reset before it is used again
+//
+// RETURN VALUES:
+//
+//		Size of the digest
+//
+
+{
+uint64_t	bits;
+uint64_t	hash;
+
+
+	if (hash_mode == HASHER_SHA256)
+		{
+		bits = total * 8;
+		block [used++] = 0x80;
+
+		if (used > HASHER_SHA256_BLOCK - 8)
+			{
+			memset (block + used, 0, HASHER_SHA256_BLOCK - used);
+			sha256_blocks (block, 1);
+			used = 0;
+			}
+
+		memset (block + used, 0, HASHER_SHA256_BLOCK - 8 - used);
+
+		for (int i = 0; i < 8; i++)
+			{
+			block [HASHER_SHA256_BLOCK - 1 - i] = (uint8_t) (bits >> (i * 8));
+			}
+
+		sha256_blocks (block, 1);
+
+		for (int i = 0; i < 8; i++)
+			{
+			Digest [i * 4] = (uint8_t) (sha [i] >> 24);
+			Digest [i * 4 + 1] = (uint8_t) (sha [i] >> 16);
+			Digest [i * 4 + 2] = (uint8_t) (sha [i] >> 8);
+			Digest [i * 4 + 3] = (uint8_t) sha [i];
+			}
+
+		return HASHER_SHA256_BYTES;
+		}
+
+	if (total >= HASHER_FAST_STRIPE)
+		{
+		hash = rotl64 (lane [0], 1) + rotl64 (lane [1], 7) + rotl64 (lane [2], 12) + rotl64 (lane [3], 18);
+		hash = fast_merge (hash, lane [0]);
+		hash = fast_merge (hash, lane [1]);
+		hash = fast_merge (hash, lane [2]);
+		hash = fast_merge (hash, lane [3]);
+		}
+	else
+		{
+		hash = seed + HASHER_PRIME64_5;
+		}
+
+	hash = fast_tail (hash + total, block, used);
+
+	for (int i = 0; i < 8; i++)
+		{
+		Digest [i] = (uint8_t) (hash >> (56 - i * 8));
+		}
+
+	return HASHER_FAST_BYTES;
+}							// End routine Hasher::finish
+
+
+size_t
+Hasher::hash											// Hash a buffer
+	(
+	_In_	HASHER_MODE		Mode,						// Hash to compute
+	_In_reads_bytes_(Length)
+	const void				*Data,						// Bytes to hash
+	_In_	size_t			Length,						// Number of bytes
+	_Out_writes_bytes_(HASHER_MAX_DIGEST)
+	uint8_t					*Digest						// Receives the digest
+	)
+
+//
+// DESCRIPTION:		Hash the buffer with a Hasher on the stack
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Size of the digest
+//
+
+{
+Hasher	hasher (Mode);
+
+
+	hasher.update (Data, Length);
+	return hasher.finish (Digest);
+}							// End routine Hasher::hash
+
+
+uint64_t
+Hasher::fast64											// XXH64 of a buffer, as a number
+	(
+	_In_reads_bytes_(Length)
+	const void				*Data,						// Bytes to hash
+	_In_	size_t			Length,						// Number of bytes
+	_In_	uint64_t		Seed						// Seed
+	)
+
+//
+// DESCRIPTION:		Hash the buffer without copying any of it, which makes short buffers (the usual case when looking for
+//					duplicates) cheaper than with update and finish
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		XXH64 of the bytes
+//
+
+{
+Hasher		hasher (HASHER_FAST, Seed);
+size_t		count = Length / HASHER_FAST_STRIPE;
+uint64_t	hash;
+
+
+	if (count == 0)
+		{
+		return fast_tail (Seed + HASHER_PRIME64_5 + Length, (const uint8_t *) Data, Length);
+		}
+
+	hasher.fast_stripes ((const uint8_t *) Data, count);
+	hash = rotl64 (hasher.lane [0], 1) + rotl64 (hasher.lane [1], 7) + rotl64 (hasher.lane [2], 12) + rotl64 (hasher.lane [3], 18);
+	hash = fast_merge (hash, hasher.lane [0]);
+	hash = fast_merge (hash, hasher.lane [1]);
+	hash = fast_merge (hash, hasher.lane [2]);
+	hash = fast_merge (hash, hasher.lane [3]);
+	return fast_tail (hash + Length, (const uint8_t *) Data + count * HASHER_FAST_STRIPE, Length - count * HASHER_FAST_STRIPE);
+}							// End routine Hasher::fast64
+
+
+bool
+Hasher::tree											// Hash a large buffer in chunks, on several threads
+	(
+	_In_	HASHER_MODE		Mode,						// Hash to compute
+	_In_reads_bytes_(Length)
+	const void				*Data,						// Bytes to hash
+	_In_	size_t			Length,						// Number of bytes
+	_In_	size_t			Chunk_size,					// Bytes in each chunk (a multiple of HASHER_BLOCK_BYTES)
+	_In_	unsigned		Threads,					// Threads to use (0 for one per processor)
+	_Out_writes_bytes_(HASHER_MAX_DIGEST)
+	uint8_t					*Digest						// Receives the digest
+	)
+
+//
+// DESCRIPTION:		Hash each chunk into its slot of an array of digests, on the calling thread and up to Threads - 1 workers,
+//					then hash the array, the length and the chunk size. If a worker cannot be started, the threads that were
+//					started do its share. The digest does not depend on the number of threads
+//
+// ASSUMPTIONS:		The buffer stays mapped, and does not change, until tree returns
+//
+// SIDE EFFECTS:	Creates threads, and waits for them to exit
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The chunk size is not a multiple of HASHER_BLOCK_BYTES, or there is not enough memory
+//
+
+{
+HASHER_TREE_WORK			work;
+std::vector<uint8_t>		digests;
+std::vector<std::thread>	workers;
+Hasher						root (Mode);
+uint8_t						trailer [16];
+
+
+	if (Chunk_size == 0 || Chunk_size % HASHER_BLOCK_BYTES != 0)
+		{
+		return false;
+		}
+
+	work.mode = Mode;
+	work.data = (const uint8_t *) Data;
+	work.length = Length;
+	work.chunk_size = Chunk_size;
+	work.chunks = Length == 0 ? 1 : (Length - 1) / Chunk_size + 1;
+	work.digest_size = digest_size (Mode);
+	work.next = 0;
+
+	if (Threads == 0)
+		{
+		Threads = std::thread::hardware_concurrency ();
+		}
+
+	if (Threads == 0 || Threads > work.chunks)
+		{
+		Threads = Threads == 0 ? 1 : (unsigned) work.chunks;
+		}
+
+	try
+		{
+		digests.resize (work.chunks * work.digest_size);
+		workers.reserve (Threads - 1);
+		}
+	catch (...)
+		{
+		return false;
+		}
+
+	work.digests = digests.data ();
+
+	try
+		{
+
+		for (unsigned t = 1; t < Threads; t++)
+			{
+			workers.push_back (std::thread (tree_worker, &work));
+			}
+
+		}
+	catch (...)
+		{
+		}
+
+	tree_worker (&work);
+
+	for (std::thread& worker : workers)
+		{
+		worker.join ();
+		}
+
+	for (int i = 0; i < 8; i++)
+		{
+		trailer [i] = (uint8_t) ((uint64_t) Length >> (i * 8));
+		trailer [8 + i] = (uint8_t) ((uint64_t) Chunk_size >> (i * 8));
+		}
+
+	root.update (digests.data (), digests.size ());
+	root.update (trailer, sizeof (trailer));
+	root.finish (Digest);
+	return true;
+}							// End routine Hasher::tree
+
+
+void
+Hasher::sha256_blocks									// Hash whole SHA-256 blocks
+	(
+	_In_reads_bytes_(Count * 64)
+	const uint8_t			*Blocks,					// Blocks
+	_In_	size_t			Count						// Number of blocks
+	)
+
+//
+// DESCRIPTION:		Run the SHA-256 compression function over each block. The message schedule is computed 16 words ahead in a
+//					ring, so it takes 64 bytes instead of 256
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint32_t	w [16];
+uint32_t	a, b, c, d, e, f, g, h;
+uint32_t	t1;
+uint32_t	t2;
+
+
+	for (; Count != 0; Count--, Blocks += HASHER_SHA256_BLOCK)
+		{
+		a = sha [0];
+		b = sha [1];
+		c = sha [2];
+		d = sha [3];
+		e = sha [4];
+		f = sha [5];
+		g = sha [6];
+		h = sha [7];
+
+		for (int i = 0; i < 64; i++)
+			{
+
+			if (i < 16)
+				{
+				w [i] = (uint32_t) Blocks [i * 4] << 24 | (uint32_t) Blocks [i * 4 + 1] << 16 |
+					(uint32_t) Blocks [i * 4 + 2] << 8 | Blocks [i * 4 + 3];
+				}
+			else
+				{
+				uint32_t	w15 = w [(i - 15) & 15];
+				uint32_t	w2 = w [(i - 2) & 15];
+
+				w [i & 15] += (rotr32 (w15, 7) ^ rotr32 (w15, 18) ^ (w15 >> 3)) + w [(i - 7) & 15] +
+					(rotr32 (w2, 17) ^ rotr32 (w2, 19) ^ (w2 >> 10));
+				}
+
+			t1 = h + (rotr32 (e, 6) ^ rotr32 (e, 11) ^ rotr32 (e, 25)) + ((e & f) ^ (~e & g)) + HASHER_sha256_k [i] + w [i & 15];
+			t2 = (rotr32 (a, 2) ^ rotr32 (a, 13) ^ rotr32 (a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+			}
+
+		sha [0] += a;
+		sha [1] += b;
+		sha [2] += c;
+		sha [3] += d;
+		sha [4] += e;
+		sha [5] += f;
+		sha [6] += g;
+		sha [7] += h;
+		}
+
+}							// End routine Hasher::sha256_blocks
+
+
+void
+Hasher::fast_stripes									// Hash whole XXH64 stripes
+	(
+	_In_reads_bytes_(Count * 32)
+	const uint8_t			*Stripes,					// Stripes
+	_In_	size_t			Count						// Number of stripes
+	)
+
+//
+// DESCRIPTION:		Mix each quadword of a stripe into its accumulator. The four accumulators are independent, so their multiplies
+//					overlap
+//
+// ASSUMPTIONS:		Little-endian
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint64_t	v [4];
+uint64_t	input [4];
+
+
+	memcpy (v, lane, sizeof (v));
+
+	for (; Count != 0; Count--, Stripes += HASHER_FAST_STRIPE)
+		{
+		memcpy (input, Stripes, sizeof (input));
+		v [0] = fast_round (v [0], input [0]);
+		v [1] = fast_round (v [1], input [1]);
+		v [2] = fast_round (v [2], input [2]);
+		v [3] = fast_round (v [3], input [3]);
+		}
+
+	memcpy (lane, v, sizeof (lane));
+}							// End routine Hasher::fast_stripes
+
+
+static
+inline
+uint32_t
+rotr32													// Rotate a longword right
+	(
+	uint32_t	Value,									// Value
+	unsigned	Count									// Bits (1 - 31)
+	)
+{
+
+	return (Value >> Count) | (Value << (32 - Count));
+}							// End rotr32
+
+
+static
+inline
+uint64_t
+rotl64													// Rotate a quadword left
+	(
+	uint64_t	Value,									// Value
+	unsigned	Count									// Bits (1 - 63)
+	)
+{
+
+	return (Value << Count) | (Value >> (64 - Count));
+}							// End rotl64
+
+
+static
+inline
+uint64_t
+fast_round												// Mix a quadword into an XXH64 accumulator
+	(
+	uint64_t	Lane,									// Accumulator
+	uint64_t	Input									// Quadword of input
+	)
+{
+
+	return rotl64 (Lane + Input * HASHER_PRIME64_2, 31) * HASHER_PRIME64_1;
+}							// End fast_round
+
+
+static
+inline
+uint64_t
+fast_merge												// Merge an XXH64 accumulator into the hash
+	(
+	uint64_t	Hash,									// Hash
+	uint64_t	Lane									// Accumulator
+	)
+{
+
+	return (Hash ^ fast_round (0, Lane)) * HASHER_PRIME64_1 + HASHER_PRIME64_4;
+}							// End fast_merge
+
+
+static
+uint64_t
+fast_tail												// Finish an XXH64 hash
+	(
+	uint64_t		Hash,								// Hash so far, with the length added
+	const uint8_t	*Tail,								// Bytes after the last whole stripe
+	size_t			Length								// Number of bytes (less than a stripe)
+	)
+
+//
+// DESCRIPTION:		Mix in the remaining quadwords, longword and bytes, then avalanche the bits
+//
+// ASSUMPTIONS:		Little-endian
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Hash
+//
+
+{
+uint64_t	quad;
+uint32_t	lword;
+
+
+	for (; Length >= 8; Length -= 8, Tail += 8)
+		{
+		memcpy (&quad, Tail, 8);
+		Hash = rotl64 (Hash ^ fast_round (0, quad), 27) * HASHER_PRIME64_1 + HASHER_PRIME64_4;
+		}
+
+	if (Length >= 4)
+		{
+		memcpy (&lword, Tail, 4);
+		Hash = rotl64 (Hash ^ (uint64_t) lword * HASHER_PRIME64_1, 23) * HASHER_PRIME64_2 + HASHER_PRIME64_3;
+		Length -= 4;
+		Tail += 4;
+		}
+
+	for (; Length != 0; Length--, Tail++)
+		{
+		Hash = rotl64 (Hash ^ *Tail * HASHER_PRIME64_5, 11) * HASHER_PRIME64_1;
+		}
+
+	Hash ^= Hash >> 33;
+	Hash *= HASHER_PRIME64_2;
+	Hash ^= Hash >> 29;
+	Hash *= HASHER_PRIME64_3;
+	Hash ^= Hash >> 32;
+	return Hash;
+}							// End fast_tail
+
+
+static
+void
+tree_worker												// Hash chunks until there are none left
+	(
+	PHASHER_TREE_WORK	Work							// Shared work
+	)
+
+//
+// DESCRIPTION:		Take the next chunk from the shared counter and hash it into its slot, until every chunk has been taken
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+size_t	chunk;
+size_t	offset;
+
+
+	while ((chunk = Work->next++) < Work->chunks)
+		{
+		offset = chunk * Work->chunk_size;
+		Hasher::hash (Work->mode, Work->data + offset, Work->length - offset < Work->chunk_size ? Work->length - offset :
+			Work->chunk_size, Work->digests + chunk * Work->digest_size);
+		}
+
+}							// End tree_worker
@@ -0,0 +1,205 @@
+//
+// FACILITY:	Hasher - Streaming, tree and fast hashes
+//
+// DESCRIPTION:	The Hasher class hashes data that arrives in pieces of any size: reset starts a hash, update adds bytes to it,
+//				and finish produces the digest. A Hasher is reused by calling reset again, so nothing is opened or allocated
+//				for each hash. There are two modes:
+//
+//					HASHER_SHA256	SHA-256 (FIPS 180-4), the digest Utils::hash_data returned from BCrypt
+//					HASHER_FAST		XXH64, a 64-bit non-cryptographic hash that runs at memory speed. It is for finding
+//									duplicates among captured buffers, not for anything an attacker could choose
+//
+//				tree hashes a large buffer (such as a mapped file) in chunks, on several threads, and then hashes the chunks'
+//				digests. A tree digest depends on the chunk size, and is not the same as the plain hash of the same bytes.
+//
+//				This module uses only standard C++, so that it can be built and tested on Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux build
+#define	_In_
+#define	_In_reads_bytes_(x)
+#define	_Out_writes_bytes_(x)
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	HASHER_SHA256_BYTES		32						// Size of a SHA-256 digest
+#define	HASHER_FAST_BYTES		8						// Size of an XXH64 digest
+#define	HASHER_MAX_DIGEST		HASHER_SHA256_BYTES		// Largest digest
+#define	HASHER_BLOCK_BYTES		64						// Largest block the modes hash at a time
+#define	HASHER_TREE_CHUNK		(1024 * 1024)			// Default chunk size for tree
+
+//
+// TYPES:
+//
+
+typedef enum _HASHER_MODE
+	{
+	HASHER_SHA256,										// SHA-256
+	HASHER_FAST											// XXH64
+	} HASHER_MODE;
+
+//
+// DECLARATIONS:
+//
+
+class Hasher
+{
+public:
+
+	//
+	// Class constructors and destructor
+	//
+
+	Hasher												// Constructor
+		(
+		_In_	HASHER_MODE		Mode = HASHER_SHA256,	// Hash to compute
+		_In_	uint64_t		Seed = 0				// Seed (HASHER_FAST only)
+		);
+
+	~Hasher												// Destructor
+		(
+		) = default;
+
+	//
+	// Public methods
+	//
+
+	void
+	reset												// Start a new hash
+		(
+		_In_	HASHER_MODE		Mode,					// Hash to compute
+		_In_	uint64_t		Seed = 0				// Seed (HASHER_FAST only)
+		);
+
+	void
+	update												// Add bytes to the hash
+		(
+		_In_reads_bytes_(Length)	const void	*Data,	// Bytes to hash
+		_In_						size_t		Length	// Number of bytes
+		);
+
+	size_t
+	finish												// Produce the digest
+		(
+		_Out_writes_bytes_(HASHER_MAX_DIGEST)
+		uint8_t					*Digest					// Receives the digest (digest_size bytes)
+		);
+
+	HASHER_MODE
+	mode												// Hash being computed
+		(
+		) const
+		{
+		return hash_mode;
+		}
+
+	static
+	size_t
+	digest_size											// Size of a mode's digest
+		(
+		_In_	HASHER_MODE		Mode					// Hash
+		)
+		{
+		return Mode == HASHER_SHA256 ? HASHER_SHA256_BYTES : HASHER_FAST_BYTES;
+		}
+
+	static
+	size_t
+	hash												// Hash a buffer
+		(
+		_In_	HASHER_MODE		Mode,					// Hash to compute
+		_In_reads_bytes_(Length)
+		const void				*Data,					// Bytes to hash
+		_In_	size_t			Length,					// Number of bytes
+		_Out_writes_bytes_(HASHER_MAX_DIGEST)
+		uint8_t					*Digest					// Receives the digest
+		);
+
+	static
+	uint64_t
+	fast64												// XXH64 of a buffer, as a number
+		(
+		_In_reads_bytes_(Length)
+		const void				*Data,					// Bytes to hash
+		_In_	size_t			Length,					// Number of bytes
+		_In_	uint64_t		Seed = 0				// Seed
+		);
+
+	static
+	bool
+	tree												// Hash a large buffer in chunks, on several threads
+		(
+		_In_	HASHER_MODE		Mode,					// Hash to compute
+		_In_reads_bytes_(Length)
+		const void				*Data,					// Bytes to hash
+		_In_	size_t			Length,					// Number of bytes
+		_In_	size_t			Chunk_size,				// Bytes in each chunk (a multiple of HASHER_BLOCK_BYTES)
+		_In_	unsigned		Threads,				// Threads to use (0 for one per processor)
+		_Out_writes_bytes_(HASHER_MAX_DIGEST)
+		uint8_t					*Digest					// Receives the digest
+		);
+
+private:
+
+	void
+	sha256_blocks										// Hash whole SHA-256 blocks
+		(
+		_In_reads_bytes_(Count * 64)
+		const uint8_t			*Blocks,				// Blocks
+		_In_	size_t			Count					// Number of blocks
+		);
+
+	void
+	fast_stripes										// Hash whole XXH64 stripes
+		(
+		_In_reads_bytes_(Count * 32)
+		const uint8_t			*Stripes,				// Stripes
+		_In_	size_t			Count					// Number of stripes
+		);
+
+	HASHER_MODE			hash_mode;						// Hash being computed
+	uint64_t			seed;							// XXH64 seed
+	uint64_t			total;							// Bytes added since reset
+	uint32_t			sha [8];						// SHA-256 state
+	uint64_t			lane [4];						// XXH64 accumulators
+	uint8_t				block [HASHER_BLOCK_BYTES];		// Bytes waiting for the rest of their block
+	size_t				used;							// Bytes in block
+	size_t				block_bytes;					// Block size of the mode
+
+};	// End class Hasher
+
+}	// End of namespace FDI
@@ -0,0 +1,468 @@
+//
+// FACILITY:	HexDump - Formatted hex dumps
+//
+// DESCRIPTION:	This module contains the implementation of the HexDump class.
+//
+//				Each line starts as a copy of a blank line, and only the characters of its bytes and offset are written into it.
+//				Because the groups are little-endian and the first group is at the right, the hex of a line is its bytes in
+//				reverse order. For each 16 bytes, the SSE2 path reverses the bytes, splits them into nibbles, converts the
+//				nibbles to hex digits with a compare and two adds, and interleaves the high and low digits. This gives the
+//				32 digits of 4 groups, in the order they appear on the line, which are stored 8 at a time around the spaces
+//				between the groups
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define	HEXDUMP_SSE2
+#include <emmintrin.h>
+#endif
+
+//
+// Project includes
+//
+
+#include "HexDump.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	HEXDUMP_GROUP_CHARS		(8 + 1)					// 8 hex characters per longword + 1 space
+#define	HEXDUMP_OFFSET_CHARS	8						// Hex characters in the offset
+
+//
+// DECLARATIONS:
+//
+
+static const char	HEXDUMP_nibble_to_hex [] = "0123456789ABCDEF";
+
+
+
+HexDump::HexDump										// Constructor
+	(
+	)
+	: options (), sink (), bytes_per_line (0), line_length (0), first_hex_index (0), offset_index (0), ascii_index (0),
+	  position (0), pending (0), used (0), started (false)
+{
+}							// End routine HexDump::HexDump
+
+
+bool
+HexDump::start											// Start a dump
+	(
+	_In_	const HEXDUMP_OPTIONS&	Options,			// Layout of the lines
+	_In_	const HEXDUMP_SINK&		Sink				// Where the lines go
+	)
+
+//
+// DESCRIPTION:		Calculate how many bytes can be dumped per line. A line consists of: some number of longword groups, separated
+//					by spaces, optionally the offset into the buffer, and optionally the ASCII representation of each of the bytes
+//					in the longwords. The line is printed without its last column, which is where the '\n' goes, so the groups
+//					must fit in one less than the width. Then allocate the blank line and the output buffer
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Discards anything written since the last finish
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The line is too narrow for a group, or too wide, there is no sink, or there is not
+//										enough memory
+//
+
+{
+uint32_t	overhead = 0;
+uint32_t	chars_per_byte = 2;							// 2 hex characters per byte
+uint32_t	num_groups;
+uint32_t	next_column;
+
+
+	started = false;
+	options = Options;
+	sink = Sink;
+	position = 0;
+	pending = 0;
+	used = 0;
+
+	if (Options.show_offset)
+		{
+		overhead = 3 + HEXDUMP_OFFSET_CHARS;			// 3 spaces + 8 characters for the offset value
+		}
+
+	if (Options.show_ascii)
+		{
+		chars_per_byte = 3;								// 2 hex characters per byte + 1 ASCII character per byte
+		overhead = overhead + 1;						// Space before the ASCII
+		}
+
+	if (Sink.write == nullptr || Options.line_width > HEXDUMP_MAX_WIDTH || Options.line_width < overhead + 1)
+		{
+		return false;
+		}
+
+	num_groups = (Options.line_width - 1 - overhead) / ((chars_per_byte * 4) + 1);
+
+	if (num_groups == 0)
+		{
+		return false;
+		}
+
+	bytes_per_line = num_groups * 4;
+	line_length = Options.line_width;
+	first_hex_index = num_groups * HEXDUMP_GROUP_CHARS;
+	next_column = first_hex_index;
+	offset_index = 0;
+	ascii_index = 0;
+
+	if (Options.show_offset)
+		{
+		offset_index = next_column + 3;					// Calculate where the offset appears on the line
+		next_column = offset_index + HEXDUMP_OFFSET_CHARS;
+		}
+
+	if (Options.show_ascii)
+		{
+		ascii_index = next_column + 1;					// Space before ASCII
+		}
+
+	try
+		{
+		partial.assign (bytes_per_line, 0);
+		blank.assign (line_length, ' ');
+		blank [line_length - 1] = '\n';
+		buffer.resize (line_length > HEXDUMP_BUFFER_BYTES ? line_length : HEXDUMP_BUFFER_BYTES);
+		}
+	catch (...)
+		{
+		return false;
+		}
+
+	started = true;
+	return true;
+}							// End routine HexDump::start
+
+
+bool
+HexDump::write											// Dump more bytes
+	(
+	_In_reads_bytes_(Length)	const void	*Data,		// Bytes to dump
+	_In_						size_t		Length		// Number of bytes
+	)
+
+//
+// DESCRIPTION:		Complete the partial line left by the last write, if there is one, then format each whole line of the data
+//					where it is, and keep what is left for the next write or finish
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	May pass formatted lines to the sink
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The dump was not started, or the sink failed
+//
+
+{
+const uint8_t	*bytes = (const uint8_t *) Data;
+size_t			count;
+
+
+	if (!started)
+		{
+		return false;
+		}
+
+	if (pending != 0)
+		{
+		count = bytes_per_line - pending < Length ? bytes_per_line - pending : Length;
+		memcpy (&partial [pending], bytes, count);
+		pending += (uint32_t) count;
+		bytes += count;
+		Length -= count;
+
+		if (pending < bytes_per_line)
+			{
+			return true;
+			}
+
+		pending = 0;
+
+		if (!format_line (partial.data (), bytes_per_line))
+			{
+			return false;
+			}
+		}
+
+	for (; Length >= bytes_per_line; bytes += bytes_per_line, Length -= bytes_per_line)
+		{
+		if (!format_line (bytes, bytes_per_line))
+			{
+			return false;
+			}
+		}
+
+	if (Length != 0)
+		{
+		memcpy (partial.data (), bytes, Length);
+		pending = (uint32_t) Length;
+		}
+
+	return true;
+}							// End routine HexDump::write
+
+
+bool
+HexDump::finish											// Dump the last partial line and flush the buffer
+	(
+	)
+
+//
+// DESCRIPTION:		Format the bytes waiting for the rest of their line as a short line, and pass everything formatted to the
+//					sink. Later writes continue the dump, at the next offset, on a new line
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Passes the formatted lines to the sink
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The dump was not started, or the sink failed
+//
+
+{
+uint32_t	count = pending;
+
+
+	if (!started)
+		{
+		return false;
+		}
+
+	pending = 0;
+
+	if (count != 0 && !format_line (partial.data (), count))
+		{
+		return false;
+		}
+
+	return flush ();
+}							// End routine HexDump::finish
+
+
+bool
+HexDump::file_sink										// Sink that writes to a FILE * (the context)
+	(
+	_In_	void		*Context,						// FILE * to write to
+	_In_	const char	*Text,							// Lines to write
+	_In_	size_t		Length							// Length of the text
+	)
+
+//
+// DESCRIPTION:		Write the lines to the stream
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The write failed
+//
+
+{
+	return fwrite (Text, 1, Length, (FILE *) Context) == Length;
+}							// End routine HexDump::file_sink
+
+
+bool
+HexDump::format_line									// Format one line into the buffer
+	(
+	_In_reads_bytes_(Count)	const uint8_t	*Bytes,		// Bytes of the line
+	_In_					uint32_t		Count		// Number of bytes (at most bytes_per_line)
+	)
+
+//
+// DESCRIPTION:		Make room for the line, copy the blank line there, and write the offset, the hex and the ASCII of the bytes
+//					into it. Byte j of the line is in group j / 4, which ends (at the right) j / 4 groups left of first_hex_index,
+//					and its two digits are 2 * (j % 4) columns left of that
+//
+// ASSUMPTIONS:		The dump is started
+//
+// SIDE EFFECTS:	May pass the buffer to the sink
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The sink failed
+//
+
+{
+char		*line;
+uint32_t	offset;
+uint32_t	cur;
+uint32_t	j = 0;
+
+
+	if (used + line_length > buffer.size () && !flush ())
+		{
+		return false;
+		}
+
+	line = &buffer [used];
+	memcpy (line, blank.data (), line_length);
+
+	//
+	// Write the current offset
+	//
+
+	if (options.show_offset)
+		{
+		offset = (uint32_t) (options.base + position);
+
+		for (int k = HEXDUMP_OFFSET_CHARS - 1; k >= 0; k--, offset >>= 4)
+			{
+			line [offset_index + k] = HEXDUMP_nibble_to_hex [offset & 0xf];
+			}
+		}
+
+#ifdef HEXDUMP_SSE2
+	{
+	const __m128i	nibble_mask = _mm_set1_epi8 (0x0F);
+	const __m128i	nine = _mm_set1_epi8 (9);
+	const __m128i	zero_char = _mm_set1_epi8 ('0');
+	const __m128i	letter_gap = _mm_set1_epi8 ('A' - '0' - 10);
+	const __m128i	space = _mm_set1_epi8 (' ' - 1);
+	const __m128i	tilde = _mm_set1_epi8 ('~' + 1);
+	const __m128i	dot = _mm_set1_epi8 ('.');
+
+	for (; j + 16 <= Count; j += 16)
+		{
+		__m128i		bytes = _mm_loadu_si128 ((const __m128i *) (Bytes + j));
+		__m128i		reversed;
+		__m128i		high;
+		__m128i		low;
+		__m128i		first;
+		__m128i		second;
+		__m128i		printable;
+		char		*hex = line + first_hex_index - (j / 4 + 4) * HEXDUMP_GROUP_CHARS + 1;
+
+		//
+		// Reverse the bytes: swap the bytes of each word, the words of each quadword, then the quadwords
+		//
+
+		reversed = _mm_or_si128 (_mm_slli_epi16 (bytes, 8), _mm_srli_epi16 (bytes, 8));
+		reversed = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (reversed, _MM_SHUFFLE (0, 1, 2, 3)), _MM_SHUFFLE (0, 1, 2, 3));
+		reversed = _mm_shuffle_epi32 (reversed, _MM_SHUFFLE (1, 0, 3, 2));
+
+		//
+		// Convert each nibble to '0' - '9' or 'A' - 'F'
+		//
+
+		high = _mm_and_si128 (_mm_srli_epi16 (reversed, 4), nibble_mask);
+		low = _mm_and_si128 (reversed, nibble_mask);
+		high = _mm_add_epi8 (_mm_add_epi8 (high, zero_char), _mm_and_si128 (_mm_cmpgt_epi8 (high, nine), letter_gap));
+		low = _mm_add_epi8 (_mm_add_epi8 (low, zero_char), _mm_and_si128 (_mm_cmpgt_epi8 (low, nine), letter_gap));
+
+		//
+		// The digits of bytes 15 - 8 are groups j / 4 + 3 and j / 4 + 2, and those of bytes 7 - 0 are groups j / 4 + 1 and
+		// j / 4, from left to right
+		//
+
+		first = _mm_unpacklo_epi8 (high, low);
+		second = _mm_unpackhi_epi8 (high, low);
+		_mm_storel_epi64 ((__m128i *) hex, first);
+		_mm_storel_epi64 ((__m128i *) (hex + HEXDUMP_GROUP_CHARS), _mm_srli_si128 (first, 8));
+		_mm_storel_epi64 ((__m128i *) (hex + 2 * HEXDUMP_GROUP_CHARS), second);
+		_mm_storel_epi64 ((__m128i *) (hex + 3 * HEXDUMP_GROUP_CHARS), _mm_srli_si128 (second, 8));
+
+		//
+		// Replace each byte that is not printable (' ' - '~'; the bytes from 0x80 up are negative) with '.'
+		//
+
+		if (options.show_ascii)
+			{
+			printable = _mm_and_si128 (_mm_cmpgt_epi8 (bytes, space), _mm_cmplt_epi8 (bytes, tilde));
+			_mm_storeu_si128 ((__m128i *) (line + ascii_index + j),
+				_mm_or_si128 (_mm_and_si128 (printable, bytes), _mm_andnot_si128 (printable, dot)));
+			}
+		}
+	}
+#endif
+
+	//
+	// Display the rest of the bytes on the current line, one at a time
+	//
+
+	for (; j < Count; j++)
+		{
+		cur = first_hex_index - 1 - (j / 4) - 2 * j;
+		line [cur] = HEXDUMP_nibble_to_hex [Bytes [j] & 0xf];
+		line [cur - 1] = HEXDUMP_nibble_to_hex [Bytes [j] >> 4];
+
+		if (options.show_ascii)
+			{
+			line [ascii_index + j] = (char) (Bytes [j] >= ' ' && Bytes [j] <= '~' ? Bytes [j] : '.');
+			}
+		}
+
+	used += line_length;
+	position += Count;
+	return true;
+}							// End routine HexDump::format_line
+
+
+bool
+HexDump::flush											// Pass the buffer to the sink
+	(
+	)
+
+//
+// DESCRIPTION:		Pass the lines formatted so far to the sink, and empty the buffer
+//
+// ASSUMPTIONS:		The dump is started
+//
+// SIDE EFFECTS:	If the sink fails, the dump stops
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The sink failed
+//
+
+{
+	if (used != 0 && !sink.write (sink.context, buffer.data (), used))
+		{
+		started = false;
+		return false;
+		}
+
+	used = 0;
+	return true;
+}							// End routine HexDump::flush
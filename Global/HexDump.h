@@ -0,0 +1,191 @@
+//
+// FACILITY:	HexDump - Formatted hex dumps
+//
+// DESCRIPTION:	A HexDump formats bytes the way Utils::dump always has: each line holds groups of 4 bytes, each shown as a
+//				little-endian longword, with the first group at the right, followed by the offset of the line's first byte and
+//				the bytes as ASCII, with '.' for each byte that is not printable. For example, with an 80-column line:
+//
+//					 73692073 69687420 2C646C72 6F77206F 6C6C6548   00000000 Hello world, this is
+//					                      706D75 64207865 68206120   00000014  a hex dump
+//
+//				The bytes can be passed in pieces of any size (write), and the last partial line is formatted when the dump is
+//				finished. The lines are formatted into a buffer, and the buffer is passed to a sink when it is full, so the sink
+//				can be the console, a file, or anything else. A dump can be resumed where an earlier one stopped by starting it
+//				with that offset as its base.
+//
+//				16 bytes at a time are converted to hex and ASCII with SSE2 where it is available; the rest of a line is converted
+//				one byte at a time.
+//
+//				This module uses only standard C++ (plus SSE2 intrinsics where they are available), so that it can be built and
+//				tested on Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux build
+#define	_In_
+#define	_In_reads_bytes_(x)
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	HEXDUMP_MAX_WIDTH		4096					// Widest line
+#define	HEXDUMP_BUFFER_BYTES	65536					// Size of the output buffer (at least one line)
+
+//
+// TYPES:
+//
+
+typedef bool (*HEXDUMP_SINK_WRITE)						// Write formatted lines
+	(
+	void				*Context,						// Sink context
+	const char			*Text,							// Whole lines, each ending with '\n'
+	size_t				Length							// Length of the text
+	);
+
+typedef struct _HEXDUMP_SINK
+	{
+	HEXDUMP_SINK_WRITE	write;							// Called when the buffer is full, and by finish
+	void				*context;						// Passed to write
+	} HEXDUMP_SINK, *PHEXDUMP_SINK;
+
+typedef struct _HEXDUMP_OPTIONS
+	{
+	uint32_t			line_width;						// Maximum width of an output line, including its '\n'
+	uint64_t			base;							// Offset shown for the first byte (the low 32 bits are shown)
+	bool				show_offset;					// Display the offset on each line
+	bool				show_ascii;						// Display ASCII representation of data
+	} HEXDUMP_OPTIONS, *PHEXDUMP_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+class HexDump
+{
+public:
+
+	//
+	// Class constructors and destructor
+	//
+
+	HexDump												// Constructor
+		(
+		);
+
+	~HexDump											// Destructor
+		(
+		) = default;
+
+	//
+	// Public methods
+	//
+
+	bool
+	start												// Start a dump
+		(
+		_In_	const HEXDUMP_OPTIONS&	Options,		// Layout of the lines
+		_In_	const HEXDUMP_SINK&		Sink			// Where the lines go
+		);
+
+	bool
+	write												// Dump more bytes
+		(
+		_In_reads_bytes_(Length)	const void	*Data,	// Bytes to dump
+		_In_						size_t		Length	// Number of bytes
+		);
+
+	bool
+	finish												// Dump the last partial line and flush the buffer
+		(
+		);
+
+	uint64_t
+	offset												// Offset that the next byte written will have
+		(
+		) const
+		{
+		return options.base + position + pending;
+		}
+
+	uint32_t
+	line_bytes											// Bytes on each line
+		(
+		) const
+		{
+		return bytes_per_line;
+		}
+
+	static
+	bool
+	file_sink											// Sink that writes to a FILE * (the context)
+		(
+		_In_	void		*Context,					// FILE * to write to
+		_In_	const char	*Text,						// Lines to write
+		_In_	size_t		Length						// Length of the text
+		);
+
+private:
+
+	bool
+	format_line											// Format one line into the buffer
+		(
+		_In_reads_bytes_(Count)	const uint8_t	*Bytes,	// Bytes of the line
+		_In_					uint32_t		Count	// Number of bytes (at most bytes_per_line)
+		);
+
+	bool
+	flush												// Pass the buffer to the sink
+		(
+		);
+
+	HEXDUMP_OPTIONS		options;						// Layout
+	HEXDUMP_SINK		sink;							// Where the lines go
+	uint32_t			bytes_per_line;					// Bytes on a full line
+	uint32_t			line_length;					// Characters on a line, including its '\n'
+	uint32_t			first_hex_index;				// Column just after the first (rightmost) group
+	uint32_t			offset_index;					// Column of the offset
+	uint32_t			ascii_index;					// Column of the ASCII
+	uint64_t			position;						// Bytes formatted so far
+	uint32_t			pending;						// Bytes held in partial, waiting for the rest of their line
+	std::vector<uint8_t>	partial;					// Start of a line that is not complete yet
+	std::vector<char>	blank;							// A line of spaces, ending with '\n'
+	std::vector<char>	buffer;							// Formatted lines
+	size_t				used;							// Characters in buffer
+	bool				started;						// start succeeded, and no write has failed
+
+};	// End class HexDump
+
+}	// End of namespace FDI
@@ -0,0 +1,626 @@
+//
+// FACILITY:	MappedFile - Read-only memory-mapped files
+//
+// DESCRIPTION:	This module contains the implementation of the MappedFile class.
+//
+//				A window starts at the view's offset rounded down to the allocation granularity (64 KB on Windows, a page on
+//				POSIX), and is the window size long, or the rest of the file if that is shorter. A view that is in the window
+//				costs a compare. On Windows, a section cannot be created for an empty file, so an empty file has no section,
+//				and only views of no bytes succeed
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+// Project includes
+//
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include "Transcode.h"
+#endif
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#ifdef _WIN32
+#define	MAPPED_FILE_INVALID		ERROR_INVALID_PARAMETER	// A range is not in the file
+#define	MAPPED_FILE_TOO_LARGE	ERROR_FILE_TOO_LARGE	// The whole file does not fit in the address space
+#else
+#define	MAPPED_FILE_INVALID		EINVAL
+#define	MAPPED_FILE_TOO_LARGE	EFBIG
+#endif
+
+//
+// DECLARATIONS:
+//
+
+static const uint8_t	MAPPED_FILE_empty = 0;			// Returned for a view of no bytes
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+size_t
+system_granularity										// Ask the system for the allocation granularity
+	(
+	);
+
+
+
+MappedFile::MappedFile									// Constructor
+	(
+	)
+	:
+#ifdef _WIN32
+	  file (INVALID_HANDLE_VALUE), section (nullptr),
+#else
+	  fd (-1),
+#endif
+	  access (MAPPED_FILE_NORMAL), file_size (0), window_size (0), window (nullptr), window_offset (0), window_length (0),
+	  last_error (0), opened (false)
+{
+}							// End routine MappedFile::MappedFile
+
+
+MappedFile::~MappedFile									// Destructor
+	(
+	)
+{
+	close ();
+}							// End routine MappedFile::~MappedFile
+
+
+#ifdef _WIN32
+bool
+MappedFile::open										// Open a file, and prepare to map it
+	(
+	_In_z_	const char			*File_name,				// File to map (UTF-8)
+	_In_	MAPPED_FILE_ACCESS	Access,					// How the file will be read
+	_In_	size_t				Window_size				// Most bytes mapped at once (MAPPED_FILE_WHOLE for all)
+	)
+
+//
+// DESCRIPTION:		Convert the name to UTF-16, and open the file by that name
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Closes the file that was open, if any
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be opened or mapped; see error
+//
+
+{
+std::wstring	name;
+size_t			length = strlen (File_name);
+
+
+	name.resize (TRANSCODE_UTF16_MAX (length));
+	name.resize (Transcode::utf8_to_utf16 (File_name, length, (char16_t *) &name [0], name.size (), true).written);
+	return open (name.c_str (), Access, Window_size);
+}							// End routine MappedFile::open
+
+
+bool
+MappedFile::open										// Open a file, and prepare to map it
+	(
+	_In_z_	const wchar_t		*File_name,				// File to map
+	_In_	MAPPED_FILE_ACCESS	Access,					// How the file will be read
+	_In_	size_t				Window_size				// Most bytes mapped at once (MAPPED_FILE_WHOLE for all)
+	)
+
+//
+// DESCRIPTION:		Open the file with the access pattern as a hint to the cache manager, get its size, and create a read-only
+//					section for it. No window is mapped until the first view
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Closes the file that was open, if any
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be opened or mapped; see error
+//
+
+{
+DWORD			flags = FILE_ATTRIBUTE_NORMAL;
+LARGE_INTEGER	size;
+
+
+	close ();
+	access = Access;
+
+	if (Access == MAPPED_FILE_SEQUENTIAL)
+		{
+		flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+		}
+	else if (Access == MAPPED_FILE_RANDOM)
+		{
+		flags |= FILE_FLAG_RANDOM_ACCESS;
+		}
+
+	if ((file = CreateFileW (File_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr)) ==
+		INVALID_HANDLE_VALUE)
+		{
+		last_error = (int) GetLastError ();
+		return false;
+		}
+
+	opened = true;
+
+	if (!GetFileSizeEx (file, &size))
+		{
+		last_error = (int) GetLastError ();
+		close ();
+		return false;
+		}
+
+	file_size = (uint64_t) size.QuadPart;
+
+	if (!finish_open (Window_size))
+		{
+		close ();
+		return false;
+		}
+
+	if (file_size != 0 && (section = CreateFileMappingW (file, nullptr, PAGE_READONLY, 0, 0, nullptr)) == nullptr)
+		{
+		last_error = (int) GetLastError ();
+		close ();
+		return false;
+		}
+
+	return true;
+}							// End routine MappedFile::open
+
+#else
+
+bool
+MappedFile::open										// Open a file, and prepare to map it
+	(
+	_In_z_	const char			*File_name,				// File to map (UTF-8)
+	_In_	MAPPED_FILE_ACCESS	Access,					// How the file will be read
+	_In_	size_t				Window_size				// Most bytes mapped at once (MAPPED_FILE_WHOLE for all)
+	)
+
+//
+// DESCRIPTION:		Open the file, get its size, and pass the access pattern to the page cache. No window is mapped until the
+//					first view
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Closes the file that was open, if any
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be opened; see error
+//
+
+{
+struct stat		status;
+
+
+	close ();
+	access = Access;
+
+	if ((fd = ::open (File_name, O_RDONLY | O_CLOEXEC)) < 0)
+		{
+		last_error = errno;
+		return false;
+		}
+
+	opened = true;
+
+	if (fstat (fd, &status) != 0)
+		{
+		last_error = errno;
+		close ();
+		return false;
+		}
+
+	file_size = (uint64_t) status.st_size;
+
+	if (!finish_open (Window_size))
+		{
+		close ();
+		return false;
+		}
+
+	if (Access != MAPPED_FILE_NORMAL)
+		{
+		posix_fadvise (fd, 0, 0, Access == MAPPED_FILE_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+		}
+
+	return true;
+}							// End routine MappedFile::open
+#endif
+
+
+void
+MappedFile::close										// Unmap and close the file
+	(
+	)
+
+//
+// DESCRIPTION:		Unmap the window, and close the section and the file
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Every address returned by view becomes invalid
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	unmap ();
+
+#ifdef _WIN32
+	if (section != nullptr)
+		{
+		CloseHandle (section);
+		section = nullptr;
+		}
+
+	if (file != INVALID_HANDLE_VALUE)
+		{
+		CloseHandle (file);
+		file = INVALID_HANDLE_VALUE;
+		}
+#else
+	if (fd >= 0)
+		{
+		::close (fd);
+		fd = -1;
+		}
+#endif
+
+	file_size = 0;
+	opened = false;
+}							// End routine MappedFile::close
+
+
+const uint8_t *
+MappedFile::view										// Get the address of a range of the file
+	(
+	_In_	uint64_t			Offset,					// Offset of the range
+	_In_	size_t				Length					// Bytes in the range (at most the window size)
+	)
+
+//
+// DESCRIPTION:		Return the address of the range in the window, moving the window first if the range is not all in it
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Moving the window invalidates the addresses returned for the last window
+//
+// RETURN VALUES:
+//
+//		Address							Normal, successful completion (not to be dereferenced if Length is 0)
+//		nullptr							The range is not in the file, is longer than the window, or could not be mapped;
+//										see error
+//
+
+{
+	if (!opened || Offset > file_size || Length > file_size - Offset || Length > window_size)
+		{
+		last_error = MAPPED_FILE_INVALID;
+		return nullptr;
+		}
+
+	if (Length == 0)
+		{
+		return &MAPPED_FILE_empty;
+		}
+
+	if (window == nullptr || Offset < window_offset || Length > window_length ||
+		Offset - window_offset > window_length - Length)
+		{
+		if (!map_window (Offset, Length))
+			{
+			return nullptr;
+			}
+		}
+
+	return window + (size_t) (Offset - window_offset);
+}							// End routine MappedFile::view
+
+
+bool
+MappedFile::prefetch									// Ask for part of the window to be read ahead
+	(
+	_In_	uint64_t			Offset,					// Offset of the range
+	_In_	size_t				Length					// Bytes in the range
+	)
+
+//
+// DESCRIPTION:		Round the range out to whole pages, and ask the system to start reading them (PrefetchVirtualMemory on
+//					Windows, MADV_WILLNEED on POSIX). The pages are read in the background
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The range is not in the window, or the system refused; see error
+//
+
+{
+size_t		page = granularity ();
+size_t		start;
+size_t		end;
+#ifdef _WIN32
+WIN32_MEMORY_RANGE_ENTRY	range;
+#endif
+
+
+	if (window == nullptr || Offset < window_offset || Offset - window_offset > window_length ||
+		Length > window_length - (size_t) (Offset - window_offset))
+		{
+		last_error = MAPPED_FILE_INVALID;
+		return false;
+		}
+
+	if (Length == 0)
+		{
+		return true;
+		}
+
+	start = (size_t) (Offset - window_offset) / page * page;
+	end = (size_t) (Offset - window_offset) + Length;
+
+#ifdef _WIN32
+	range.VirtualAddress = window + start;
+	range.NumberOfBytes = end - start;
+
+	if (!PrefetchVirtualMemory (GetCurrentProcess (), 1, &range, 0))
+		{
+		last_error = (int) GetLastError ();
+		return false;
+		}
+#else
+	if (madvise (window + start, end - start, MADV_WILLNEED) != 0)
+		{
+		last_error = errno;
+		return false;
+		}
+#endif
+
+	return true;
+}							// End routine MappedFile::prefetch
+
+
+size_t
+MappedFile::granularity									// Alignment of a window's offset
+	(
+	)
+
+//
+// DESCRIPTION:		Ask the system for the granularity the first time, and return the same value after that
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Bytes
+//
+
+{
+static const size_t	bytes = system_granularity ();
+
+
+	return bytes;
+}							// End routine MappedFile::granularity
+
+
+bool
+MappedFile::finish_open									// Check the window size
+	(
+	_In_	size_t				Window_size				// Most bytes mapped at once
+	)
+
+//
+// DESCRIPTION:		Round the window size up to the granularity. MAPPED_FILE_WHOLE becomes the size of the file, which must fit
+//					in a size_t
+//
+// ASSUMPTIONS:		file_size is set
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The whole file was asked for, and does not fit in the address space
+//
+
+{
+size_t	unit = granularity ();
+
+
+	if (Window_size == MAPPED_FILE_WHOLE)
+		{
+		if (file_size > (uint64_t) SIZE_MAX - unit)
+			{
+			last_error = MAPPED_FILE_TOO_LARGE;
+			return false;
+			}
+
+		Window_size = (size_t) file_size;
+		}
+
+	window_size = Window_size > SIZE_MAX - unit ? SIZE_MAX / unit * unit : (Window_size + unit - 1) / unit * unit;
+	return true;
+}							// End routine MappedFile::finish_open
+
+
+bool
+MappedFile::map_window									// Map the window that holds a range
+	(
+	_In_	uint64_t			Offset,					// Offset of the range
+	_In_	size_t				Length					// Bytes in the range
+	)
+
+//
+// DESCRIPTION:		Unmap the window, and map the one that starts at the range's offset rounded down to the granularity. The
+//					window is the window size long, or longer if the rounding pushed the end of the range past that, and is
+//					cut off at the end of the file. For a sequential scan, prefetch the new window
+//
+// ASSUMPTIONS:		The range is in the file, is not empty, and is no longer than the window size
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The window could not be mapped; see error
+//
+
+{
+uint64_t	start = Offset - Offset % granularity ();
+size_t		span;
+void		*address;
+
+
+	span = (size_t) (Offset - start) + Length > window_size ? (size_t) (Offset - start) + Length : window_size;
+	span = file_size - start < span ? (size_t) (file_size - start) : span;
+	unmap ();
+
+#ifdef _WIN32
+	if ((address = MapViewOfFile (section, FILE_MAP_READ, (DWORD) (start >> 32), (DWORD) start, span)) == nullptr)
+		{
+		last_error = (int) GetLastError ();
+		return false;
+		}
+#else
+	if ((address = mmap (nullptr, span, PROT_READ, MAP_SHARED, fd, (off_t) start)) == MAP_FAILED)
+		{
+		last_error = errno;
+		return false;
+		}
+
+	if (access != MAPPED_FILE_NORMAL)
+		{
+		madvise (address, span, access == MAPPED_FILE_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+		}
+#endif
+
+	window = (uint8_t *) address;
+	window_offset = start;
+	window_length = span;
+
+	if (access == MAPPED_FILE_SEQUENTIAL)
+		{
+		prefetch (start, span);
+		}
+
+	return true;
+}							// End routine MappedFile::map_window
+
+
+void
+MappedFile::unmap										// Unmap the window
+	(
+	)
+
+//
+// DESCRIPTION:		Unmap the window, if one is mapped
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Every address returned by view becomes invalid
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	if (window != nullptr)
+		{
+#ifdef _WIN32
+		UnmapViewOfFile (window);
+#else
+		munmap (window, window_length);
+#endif
+		window = nullptr;
+		window_offset = 0;
+		window_length = 0;
+		}
+}							// End routine MappedFile::unmap
+
+
+static
+size_t
+system_granularity										// Ask the system for the allocation granularity
+	(
+	)
+
+//
+// DESCRIPTION:		Return the allocation granularity (Windows), which a view's offset must be a multiple of, or the page size
+//					(POSIX)
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Bytes
+//
+
+{
+#ifdef _WIN32
+SYSTEM_INFO		info;
+
+
+	GetSystemInfo (&info);
+	return info.dwAllocationGranularity;
+#else
+	return (size_t) sysconf (_SC_PAGESIZE);
+#endif
+}							// End system_granularity
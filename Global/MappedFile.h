@@ -0,0 +1,220 @@
+//
+// FACILITY:	MappedFile - Read-only memory-mapped files
+//
+// DESCRIPTION:	The MappedFile class maps a file for reading, and unmaps and closes it when it is destroyed or closed, so the
+//				bytes of the file are read in place, without copying them into a buffer. view returns the address of a range of
+//				the file. Only one window of the file is mapped at a time: a view inside the window is returned at once, and a
+//				view outside it moves the window. The window size given to open bounds the address space used, so files larger
+//				than the address space (or than the budget of a 32-bit process) can be read a window at a time; a window size
+//				of MAPPED_FILE_WHOLE maps the whole file at once.
+//
+//				The access pattern given to open is passed to the system (FILE_FLAG_SEQUENTIAL_SCAN and FILE_FLAG_RANDOM_ACCESS
+//				on Windows, posix_fadvise and madvise on POSIX). For a sequential scan, each new window is also prefetched, so
+//				its pages are read ahead in large requests instead of one fault at a time. prefetch asks for any range of the
+//				window to be read ahead.
+//
+//				Example:
+//
+//					MappedFile		file;
+//					const uint8_t	*bytes;
+//					size_t			length;
+//
+//					if (file.open ("TraceAPI-1234.tac", MAPPED_FILE_SEQUENTIAL, 16 * 1024 * 1024))
+//						{
+//						for (uint64_t offset = 0; offset < file.size (); offset += length)
+//							{
+//							length = ...;
+//							bytes = file.view (offset, length);
+//							...
+//							}
+//						}
+//
+//				There are Windows and POSIX implementations, so the users of this class can be built and tested on Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux build
+#define	_In_
+#define	_In_z_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	MAPPED_FILE_WHOLE		0						// Window size that maps the whole file
+#define	MAPPED_FILE_WINDOW		(64 * 1024 * 1024)		// Default window size
+
+//
+// TYPES:
+//
+
+typedef enum _MAPPED_FILE_ACCESS
+	{
+	MAPPED_FILE_NORMAL,									// No hint
+	MAPPED_FILE_SEQUENTIAL,								// Read from start to end; read ahead
+	MAPPED_FILE_RANDOM									// Read in no particular order; do not read ahead
+	} MAPPED_FILE_ACCESS;
+
+//
+// DECLARATIONS:
+//
+
+class MappedFile
+{
+public:
+
+	//
+	// Class constructors and destructor
+	//
+
+	MappedFile											// Constructor
+		(
+		);
+
+	~MappedFile											// Destructor
+		(
+		);
+
+	MappedFile (const MappedFile&) = delete;
+	MappedFile& operator= (const MappedFile&) = delete;
+
+	//
+	// Public methods
+	//
+
+	bool
+	open												// Open a file, and prepare to map it
+		(
+		_In_z_	const char			*File_name,			// File to map (UTF-8)
+		_In_	MAPPED_FILE_ACCESS	Access = MAPPED_FILE_NORMAL,	// How the file will be read
+		_In_	size_t				Window_size = MAPPED_FILE_WINDOW	// Most bytes mapped at once (MAPPED_FILE_WHOLE for all)
+		);
+
+#ifdef _WIN32
+	bool
+	open												// Open a file, and prepare to map it
+		(
+		_In_z_	const wchar_t		*File_name,			// File to map
+		_In_	MAPPED_FILE_ACCESS	Access = MAPPED_FILE_NORMAL,	// How the file will be read
+		_In_	size_t				Window_size = MAPPED_FILE_WINDOW	// Most bytes mapped at once (MAPPED_FILE_WHOLE for all)
+		);
+#endif
+
+	void
+	close												// Unmap and close the file
+		(
+		);
+
+	const uint8_t *
+	view												// Get the address of a range of the file
+		(
+		_In_	uint64_t			Offset,				// Offset of the range
+		_In_	size_t				Length				// Bytes in the range (at most the window size)
+		);
+
+	bool
+	prefetch											// Ask for part of the window to be read ahead
+		(
+		_In_	uint64_t			Offset,				// Offset of the range
+		_In_	size_t				Length				// Bytes in the range
+		);
+
+	bool
+	is_open												// Determine whether a file is open
+		(
+		) const
+		{
+		return opened;
+		}
+
+	uint64_t
+	size												// Size of the file when it was opened
+		(
+		) const
+		{
+		return file_size;
+		}
+
+	int
+	error												// Error code of the last failure (GetLastError or errno)
+		(
+		) const
+		{
+		return last_error;
+		}
+
+	static
+	size_t
+	granularity											// Alignment of a window's offset
+		(
+		);
+
+private:
+
+	bool
+	finish_open											// Check the window size
+		(
+		_In_	size_t				Window_size			// Most bytes mapped at once
+		);
+
+	bool
+	map_window											// Map the window that holds a range
+		(
+		_In_	uint64_t			Offset,				// Offset of the range
+		_In_	size_t				Length				// Bytes in the range
+		);
+
+	void
+	unmap												// Unmap the window
+		(
+		);
+
+#ifdef _WIN32
+	void				*file;							// File handle
+	void				*section;						// Section handle (none for an empty file)
+#else
+	int					fd;								// File descriptor
+#endif
+	MAPPED_FILE_ACCESS	access;							// How the file will be read
+	uint64_t			file_size;						// Size of the file
+	size_t				window_size;					// Most bytes mapped at once
+	uint8_t				*window;						// Address of the window (nullptr if none is mapped)
+	uint64_t			window_offset;					// Offset of the window in the file
+	size_t				window_length;					// Bytes in the window
+	int					last_error;						// Error code of the last failure
+	bool				opened;							// A file is open
+
+};	// End class MappedFile
+
+}	// End of namespace FDI
@@ -0,0 +1,577 @@
+//
+// FACILITY:	Matcher - Compiled string search
+//
+// DESCRIPTION:	This module contains the implementation of the Matcher class.
+//
+//				The automaton for a set of patterns is built in two steps. First the patterns are added to a trie, whose
+//				states are the rows of next. Then a breadth-first walk of the trie computes each state's failure state (the
+//				longest proper suffix of the state's string that is also in the trie), and fills in the missing transitions
+//				of each state from those of its failure state, so that the search takes exactly one transition per character
+//				and never backs up. Each entry of next is the offset of the next state's row, with MATCHER_OUTPUT set if a
+//				pattern ends in that state, so the search loop does no multiplication and tests one bit per character
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define	MATCHER_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//
+// Project includes
+//
+
+#include "Matcher.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	MATCHER_NONE			UINT32_MAX				// No transition yet (while building the trie)
+#define	MATCHER_OUTPUT			0x80000000				// The transition's state has an output
+#define	MATCHER_MAX_TABLE		0x7FFFFFFF				// Most entries in next (a row offset must fit below MATCHER_OUTPUT)
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+inline
+uint32_t
+lowest_bit												// Index of the lowest set bit
+	(
+	uint32_t	Mask									// Nonzero mask
+	);
+
+
+
+Matcher::Matcher										// Constructor
+	(
+	)
+	: state_count (0), class_count (0), compiled (false)
+{
+	for (int c = 0; c < 256; c++)
+		{
+		fold [c] = (uint8_t) c;
+		class_of [c] = 0;
+		}
+}							// End routine Matcher::Matcher
+
+
+bool
+Matcher::compile										// Compile a single pattern
+	(
+	_In_	const std::string&	Pattern,				// Pattern to search for
+	_In_	bool				Case_blind				// If true, searches are case-insensitive
+	)
+
+//
+// DESCRIPTION:		Fold the pattern. A single pattern needs no automaton: search_one compares its first and last characters
+//					with the text, and the rest with same
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Replaces what was compiled before
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The pattern is empty
+//
+
+{
+	compiled = false;
+	pattern_list.clear ();
+	next.clear ();
+	output.clear ();
+	state_count = 0;
+	class_count = 0;
+
+	for (int c = 0; c < 256; c++)
+		{
+		fold [c] = (uint8_t) (Case_blind && c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c);
+		class_of [c] = 0;
+		}
+
+	if (Pattern.empty ())
+		{
+		return false;
+		}
+
+	pattern_list.push_back (Pattern);
+
+	for (char& c : pattern_list [0])
+		{
+		c = (char) fold [(uint8_t) c];
+		}
+
+	compiled = true;
+	return true;
+}							// End routine Matcher::compile
+
+
+bool
+Matcher::compile										// Compile a set of patterns
+	(
+	_In_	const std::vector<std::string>&	Patterns,	// Patterns to search for
+	_In_	bool							Case_blind	// If true, searches are case-insensitive
+	)
+
+//
+// DESCRIPTION:		Build the Aho-Corasick automaton for the patterns. A set of one pattern is compiled as a single pattern.
+//					Characters that are in no pattern share column 0, so the table only has a column for each character that
+//					matters. A pattern that is the same as an earlier one (after folding) is never reported
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Replaces what was compiled before
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							There are no patterns, one is empty, they are too long, or there is not enough memory
+//
+
+{
+std::vector<uint32_t>	failure;
+std::vector<uint32_t>	queue;
+bool					seen [256];
+uint64_t				total = 1;
+uint32_t				state;
+uint32_t				child;
+uint32_t				column;
+
+
+	if (Patterns.size () == 1)
+		{
+		return compile (Patterns [0], Case_blind);
+		}
+
+	compile (std::string (), Case_blind);				// Reset, and set up fold
+
+	if (Patterns.empty () || Patterns.size () >= MATCHER_OUTPUT)
+		{
+		return false;
+		}
+
+	//
+	// Fold the patterns, and give each character that appears in them a column
+	//
+
+	memset (seen, 0, sizeof (seen));
+	class_count = 1;
+
+	for (const std::string& pattern : Patterns)
+		{
+		if (pattern.empty ())
+			{
+			pattern_list.clear ();
+			return false;
+			}
+
+		total += pattern.size ();
+		pattern_list.push_back (pattern);
+
+		for (char& c : pattern_list.back ())
+			{
+			c = (char) fold [(uint8_t) c];
+
+			if (!seen [(uint8_t) c])
+				{
+				//
+				// If every character is in the patterns, none is left for column 0, so the last one takes it
+				//
+
+				seen [(uint8_t) c] = true;
+				class_of [(uint8_t) c] = (uint8_t) (class_count < 256 ? class_count++ : 0);
+				}
+			}
+		}
+
+	for (int c = 0; c < 256; c++)
+		{
+		class_of [c] = class_of [fold [c]];
+		}
+
+	if (total > MATCHER_MAX_STATES || total * class_count > MATCHER_MAX_TABLE)
+		{
+		pattern_list.clear ();
+		return false;
+		}
+
+	try
+		{
+		next.reserve ((size_t) (total * class_count));
+		output.reserve ((size_t) total);
+
+		//
+		// Build the trie. State 0 is the root
+		//
+
+		next.assign (class_count, MATCHER_NONE);
+		output.assign (1, 0);
+		state_count = 1;
+
+		for (uint32_t index = 0; index < pattern_list.size (); index++)
+			{
+			state = 0;
+
+			for (char c : pattern_list [index])
+				{
+				column = class_of [(uint8_t) c];
+
+				if (next [state * class_count + column] == MATCHER_NONE)
+					{
+					next [state * class_count + column] = state_count++;
+					next.insert (next.end (), class_count, MATCHER_NONE);
+					output.push_back (0);
+					}
+
+				state = next [state * class_count + column];
+				}
+
+			if (output [state] == 0)
+				{
+				output [state] = index + 1;
+				}
+			}
+
+		//
+		// Walk the trie breadth first, so that each state's failure state, which is shallower, is complete before the state
+		//
+
+		failure.assign (state_count, 0);
+		queue.reserve (state_count);
+
+		for (column = 0; column < class_count; column++)
+			{
+			if ((child = next [column]) == MATCHER_NONE)
+				{
+				next [column] = 0;
+				}
+			else
+				{
+				queue.push_back (child);
+				}
+			}
+
+		for (size_t head = 0; head < queue.size (); head++)
+			{
+			state = queue [head];
+
+			if (output [state] == 0)
+				{
+				output [state] = output [failure [state]];
+				}
+
+			for (column = 0; column < class_count; column++)
+				{
+				child = next [state * class_count + column];
+
+				if (child == MATCHER_NONE)
+					{
+					next [state * class_count + column] = next [failure [state] * class_count + column];
+					}
+				else
+					{
+					failure [child] = next [failure [state] * class_count + column];
+					queue.push_back (child);
+					}
+				}
+			}
+		}
+	catch (...)
+		{
+		compile (std::string (), Case_blind);
+		return false;
+		}
+
+	//
+	// Turn the state numbers into row offsets, and mark the transitions into states that end a pattern
+	//
+
+	for (uint32_t& entry : next)
+		{
+		entry = entry * class_count | (output [entry] != 0 ? MATCHER_OUTPUT : 0);
+		}
+
+	compiled = true;
+	return true;
+}							// End routine Matcher::compile
+
+
+bool
+Matcher::search											// Find the first match in a text
+	(
+	_In_reads_(Length)	const char		*Text,			// Text to search
+	_In_				size_t			Length,			// Length of the text
+	_Out_opt_			MATCHER_RESULT	*Result			// Where the match is (may be nullptr)
+	) const
+
+//
+// DESCRIPTION:		Search the text for the pattern, or for any of the set of patterns. The match returned is the one that ends
+//					first; if several patterns end there, it is the longest of them
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							A pattern was found
+//		false							None was, or nothing is compiled
+//
+
+{
+	if (!compiled)
+		{
+		return false;
+		}
+
+	return state_count == 0 ? search_one (Text, Length, Result) : search_set (Text, Length, Result);
+}							// End routine Matcher::search
+
+
+bool
+Matcher::search_one										// Find the single pattern
+	(
+	_In_reads_(Length)	const char		*Text,			// Text to search
+	_In_				size_t			Length,			// Length of the text
+	_Out_opt_			MATCHER_RESULT	*Result			// Where the match is
+	) const
+
+//
+// DESCRIPTION:		For each block of 16 positions, compare the text at those positions with the pattern's first character, and
+//					the text pattern length - 1 characters further on with its last character. Only the positions where both
+//					match, which are rare, are compared in full. In a case-blind search, a character is compared with both its
+//					cases. The positions left over at the end, or all of them without SSE2, are compared one at a time
+//
+// ASSUMPTIONS:		A single pattern is compiled
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The pattern was found
+//		false							It was not
+//
+
+{
+const std::string&	pattern = pattern_list [0];
+const uint8_t		*text = (const uint8_t *) Text;
+size_t				length = pattern.size ();
+size_t				position = 0;
+size_t				found = SIZE_MAX;
+uint8_t				first = (uint8_t) pattern [0];
+uint8_t				last = (uint8_t) pattern [length - 1];
+
+
+	if (length > Length)
+		{
+		return false;
+		}
+
+#ifdef MATCHER_SSE2
+	{
+	uint8_t		first_other = fold [first | 0x20] == first ? (uint8_t) (first | 0x20) : first;
+	uint8_t		last_other = fold [last | 0x20] == last ? (uint8_t) (last | 0x20) : last;
+	__m128i		first_1 = _mm_set1_epi8 ((char) first);
+	__m128i		first_2 = _mm_set1_epi8 ((char) first_other);
+	__m128i		last_1 = _mm_set1_epi8 ((char) last);
+	__m128i		last_2 = _mm_set1_epi8 ((char) last_other);
+
+	for (; found == SIZE_MAX && position + length - 1 + 16 <= Length; position += 16)
+		{
+		__m128i		block_first = _mm_loadu_si128 ((const __m128i *) (text + position));
+		__m128i		block_last = _mm_loadu_si128 ((const __m128i *) (text + position + length - 1));
+		__m128i		eq_first = _mm_or_si128 (_mm_cmpeq_epi8 (block_first, first_1), _mm_cmpeq_epi8 (block_first, first_2));
+		__m128i		eq_last = _mm_or_si128 (_mm_cmpeq_epi8 (block_last, last_1), _mm_cmpeq_epi8 (block_last, last_2));
+		uint32_t	mask = (uint32_t) _mm_movemask_epi8 (_mm_and_si128 (eq_first, eq_last));
+
+		while (mask != 0)
+			{
+			size_t	candidate = position + lowest_bit (mask);
+
+			if (length <= 2 || same (text + candidate + 1, 1, length - 2))
+				{
+				found = candidate;
+				break;
+				}
+
+			mask &= mask - 1;
+			}
+		}
+	}
+#endif
+
+	for (; found == SIZE_MAX && position + length <= Length; position++)
+		{
+		if (fold [text [position]] == first && fold [text [position + length - 1]] == last &&
+			(length <= 2 || same (text + position + 1, 1, length - 2)))
+			{
+			found = position;
+			}
+		}
+
+	if (found == SIZE_MAX)
+		{
+		return false;
+		}
+
+	if (Result != nullptr)
+		{
+		Result->offset = found;
+		Result->length = length;
+		Result->pattern = 0;
+		}
+
+	return true;
+}							// End routine Matcher::search_one
+
+
+bool
+Matcher::search_set										// Run the automaton
+	(
+	_In_reads_(Length)	const char		*Text,			// Text to search
+	_In_				size_t			Length,			// Length of the text
+	_Out_opt_			MATCHER_RESULT	*Result			// Where the match is
+	) const
+
+//
+// DESCRIPTION:		Take one transition for each character of the text, until one leads to a state that ends a pattern
+//
+// ASSUMPTIONS:		A set of patterns is compiled
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							A pattern was found
+//		false							None was
+//
+
+{
+const uint8_t	*text = (const uint8_t *) Text;
+const uint32_t	*table = next.data ();
+uint32_t		row = 0;
+uint32_t		index;
+
+
+	for (size_t position = 0; position < Length; position++)
+		{
+		row = table [row + class_of [text [position]]];
+
+		if (row & MATCHER_OUTPUT)
+			{
+			row &= ~MATCHER_OUTPUT;
+
+			if (Result != nullptr)
+				{
+				index = output [row / class_count] - 1;
+				Result->pattern = index;
+				Result->length = pattern_list [index].size ();
+				Result->offset = position + 1 - Result->length;
+				}
+
+			return true;
+			}
+		}
+
+	return false;
+}							// End routine Matcher::search_set
+
+
+bool
+Matcher::same											// Compare folded text with part of the single pattern
+	(
+	_In_reads_(Length)	const uint8_t	*Text,			// Text
+	_In_				size_t			Start,			// First character of the pattern to compare
+	_In_				size_t			Length			// Characters to compare
+	) const
+
+//
+// DESCRIPTION:		Compare each character of the text, folded, with the pattern, which is already folded
+//
+// ASSUMPTIONS:		A single pattern is compiled, and is at least Start + Length characters long
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The characters are the same
+//		false							They are not
+//
+
+{
+const char	*pattern = pattern_list [0].data () + Start;
+
+
+	for (size_t i = 0; i < Length; i++)
+		{
+		if (fold [Text [i]] != (uint8_t) pattern [i])
+			{
+			return false;
+			}
+		}
+
+	return true;
+}							// End routine Matcher::same
+
+
+static
+inline
+uint32_t
+lowest_bit												// Index of the lowest set bit
+	(
+	uint32_t	Mask									// Nonzero mask
+	)
+
+//
+// DESCRIPTION:		Count the trailing zero bits
+//
+// ASSUMPTIONS:		Mask is not 0
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Bit number
+//
+
+{
+#ifdef _MSC_VER
+unsigned long	index;
+
+
+	_BitScanForward (&index, Mask);
+	return index;
+#else
+	return (uint32_t) __builtin_ctz (Mask);
+#endif
+}							// End routine lowest_bit
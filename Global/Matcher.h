@@ -0,0 +1,192 @@
+//
+// FACILITY:	Matcher - Compiled string search
+//
+// DESCRIPTION:	A Matcher is compiled once from a pattern, or a set of patterns, and can then search any number of texts without
+//				allocating. Case folding (ASCII, as toupper does in the "C" locale) is done when the Matcher is compiled, so a
+//				case-blind search costs the same as an exact one.
+//
+//				A single pattern is found by comparing its first and last characters with 16 positions of the text at a time
+//				(SSE2), and comparing the rest only where both match. A set of patterns is compiled into an Aho-Corasick
+//				automaton: a table with a row for each state and a column for each distinct character of the patterns, which
+//				finds every pattern in one pass over the text, looking at each character once.
+//
+//				Example:
+//
+//					Matcher			matcher;
+//					MATCHER_RESULT	match;
+//
+//					if (matcher.compile ({"notepad.exe", "calc.exe"}, true) && matcher.search (text, &match))
+//						{
+//						... match.pattern is 0 or 1, and starts at match.offset in text
+//						}
+//
+//				This module uses only standard C++ (plus SSE2 intrinsics where they are available), so that it can be built and
+//				tested on Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux build
+#define	_In_
+#define	_In_reads_(x)
+#define	_Out_opt_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	MATCHER_MAX_STATES		(1 << 24)				// Most states in an automaton (total length of the patterns)
+
+//
+// TYPES:
+//
+
+typedef struct _MATCHER_RESULT
+	{
+	size_t		offset;									// Where the match starts in the text
+	size_t		length;									// Length of the match (the pattern's length)
+	uint32_t	pattern;								// Index of the pattern that matched
+	} MATCHER_RESULT, *PMATCHER_RESULT;
+
+//
+// DECLARATIONS:
+//
+
+class Matcher
+{
+public:
+
+	//
+	// Class constructors and destructor
+	//
+
+	Matcher												// Constructor
+		(
+		);
+
+	~Matcher											// Destructor
+		(
+		) = default;
+
+	//
+	// Public methods
+	//
+
+	bool
+	compile												// Compile a single pattern
+		(
+		_In_	const std::string&	Pattern,			// Pattern to search for
+		_In_	bool				Case_blind			// If true, searches are case-insensitive
+		);
+
+	bool
+	compile												// Compile a set of patterns
+		(
+		_In_	const std::vector<std::string>&	Patterns,	// Patterns to search for
+		_In_	bool							Case_blind	// If true, searches are case-insensitive
+		);
+
+	bool
+	search												// Find the first match in a text
+		(
+		_In_reads_(Length)	const char		*Text,		// Text to search
+		_In_				size_t			Length,		// Length of the text
+		_Out_opt_			MATCHER_RESULT	*Result		// Where the match is (may be nullptr)
+		) const;
+
+	bool
+	search												// Find the first match in a text
+		(
+		_In_		const std::string&	Text,			// Text to search
+		_Out_opt_	MATCHER_RESULT		*Result			// Where the match is (may be nullptr)
+		) const
+		{
+		return search (Text.data (), Text.size (), Result);
+		}
+
+	size_t
+	patterns											// Number of patterns compiled
+		(
+		) const
+		{
+		return pattern_list.size ();
+		}
+
+	size_t
+	states												// Number of states in the automaton (0 for a single pattern)
+		(
+		) const
+		{
+		return state_count;
+		}
+
+private:
+
+	bool
+	search_one											// Find the single pattern
+		(
+		_In_reads_(Length)	const char		*Text,		// Text to search
+		_In_				size_t			Length,		// Length of the text
+		_Out_opt_			MATCHER_RESULT	*Result		// Where the match is
+		) const;
+
+	bool
+	search_set											// Run the automaton
+		(
+		_In_reads_(Length)	const char		*Text,		// Text to search
+		_In_				size_t			Length,		// Length of the text
+		_Out_opt_			MATCHER_RESULT	*Result		// Where the match is
+		) const;
+
+	bool
+	same												// Compare folded text with part of the single pattern
+		(
+		_In_reads_(Length)	const uint8_t	*Text,		// Text
+		_In_				size_t			Start,		// First character of the pattern to compare
+		_In_				size_t			Length		// Characters to compare
+		) const;
+
+	std::vector<std::string>	pattern_list;			// The patterns, folded
+	std::vector<uint32_t>		next;					// Automaton: for each state, a row of class_count transitions
+	std::vector<uint32_t>		output;					// For each state, the longest pattern that ends there, plus 1 (0 if none)
+	uint32_t					state_count;			// States in the automaton
+	uint32_t					class_count;			// Columns of next: 1 + the distinct characters of the patterns
+	uint8_t						fold [256];				// Maps each character to its folded form
+	uint8_t						class_of [256];			// Maps each character to its column in next
+	bool						compiled;				// compile succeeded
+
+};	// End class Matcher
+
+}	// End of namespace FDI
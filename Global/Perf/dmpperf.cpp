@@ -0,0 +1,634 @@
+//
+// FACILITY:	dmpperf - Test and measure the hex dump formatter
+//
+// DESCRIPTION:	This program runs HexDump (HexDump.cpp) on Linux. It checks that:
+//
+//					- For every line width from the narrowest to 200 columns, with and without the offset and the ASCII, and for
+//					  random lengths and bases, HexDump writes the same lines as the byte-at-a-time formatter that Utils::dump
+//					  used before
+//					- Writing the bytes in random pieces gives the same lines as writing them at once
+//					- A dump stopped at the end of a line and resumed by a new HexDump, started with the offset the first one
+//					  reached, gives the same lines as one dump
+//					- A line too narrow for one group is refused, and a sink that fails stops the dump
+//
+//				It then prints the rate at which each formatter turns a large buffer into lines, in GB/s of input. Both write
+//				to a sink that only counts the characters, so only the formatting is measured; the old formatter passes
+//				each line to the sink, as it passed each line to printf. The times are thread CPU time.
+//
+//				Usage: dmpperf [-n:rounds] [-m:buffer MB] [-w:line width]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the clocks, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../HexDump.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_CHECKS				40						// Random buffers for each layout
+#define	PERF_MAX_CHECK_WIDTH	200						// Widest line checked
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		rounds;								// Dumps of the buffer in each timing
+	unsigned		megabytes;							// Size of the buffer
+	unsigned		width;								// Line width in the timing
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS	PERF_options = {4, 16, 80};
+
+static const PERF_OPTION	PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.rounds},
+	{'m', &PERF_options.megabytes},
+	{'w', &PERF_options.width}
+	};
+
+static uint64_t		PERF_random = 12345;				// Generator state
+
+
+
+static
+bool
+string_sink												// Sink that appends to a std::string (the context)
+	(
+	void		*Context,								// std::string to append to
+	const char	*Text,									// Lines
+	size_t		Length									// Length of the text
+	)
+
+//
+// DESCRIPTION:		Append the lines
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	((std::string *) Context)->append (Text, Length);
+	return true;
+}							// End string_sink
+
+
+static
+bool
+count_sink												// Sink that counts the characters (the context is a uint64_t)
+	(
+	void		*Context,								// Count
+	const char	*Text,									// Lines
+	size_t		Length									// Length of the text
+	)
+
+//
+// DESCRIPTION:		Add the length, and look at the last character so that the lines must be written
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	*(uint64_t *) Context += Length + (Text [Length - 1] != '\n');
+	return true;
+}							// End count_sink
+
+
+static
+bool
+failing_sink											// Sink that always fails
+	(
+	void		*Context,								// Unused
+	const char	*Text,									// Unused
+	size_t		Length									// Unused
+	)
+
+//
+// DESCRIPTION:		Fail
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		false							Always
+//
+
+{
+	return false;
+}							// End failing_sink
+
+
+static
+void
+old_dump												// Format a buffer the way Utils::dump did
+	(
+	const void			*Address,						// Address of buffer
+	uint32_t			Length,							// Length of buffer
+	uint32_t			Line_width,						// Maximum width of output line
+	uint32_t			Base_disp_addr,					// Base address for display
+	bool				Show_offset,					// Display the offset on each line
+	bool				Show_ascii,						// Display ASCII representation of data
+	const HEXDUMP_SINK&	Sink							// Where each line goes
+	)
+
+//
+// DESCRIPTION:		The body of Utils::dump before HexDump, with printf replaced by the sink and sprintf_s by snprintf. The
+//					groups are computed from one less than the width, as HexDump computes them, because Utils::dump printed
+//					one less than the width and so cut off the last ASCII character when the line was exactly full
+//
+// ASSUMPTIONS:		The width allows at least one group
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+static const char	nibble_to_hex [] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+uint32_t			i;
+uint32_t			chars_per_byte;
+const uint8_t		*buffer = (const uint8_t *) Address;
+uint32_t			overhead;
+uint32_t			bytes_per_line;
+uint32_t			num_groups;
+uint32_t			offset_index;
+uint32_t			ascii_index;
+char				*line;
+uint32_t			bytes_this_line;
+uint32_t			j;
+uint32_t			cur;
+uint32_t			num_lines;
+uint32_t			group_size;
+uint32_t			first_hex_index;
+uint32_t			next_column;
+
+
+	overhead = Show_offset ? 3 + 8 : 0;
+
+	if (Show_ascii)
+		{
+		chars_per_byte = 3;
+		overhead = overhead + 1;
+		}
+	else
+		{
+		chars_per_byte = 2;
+		}
+
+	group_size = 8 + 1;
+	num_groups = (Line_width - 1 - overhead) / ((chars_per_byte * 4) + 1);
+	bytes_per_line = num_groups * 4;
+	first_hex_index = (num_groups * group_size);
+	next_column = first_hex_index;
+
+	if (Show_offset)
+		{
+		offset_index = next_column + 3;
+		next_column = offset_index + 8;
+		}
+	else
+		{
+		offset_index = 0;
+		}
+
+	ascii_index = Show_ascii ? next_column + 1 : 0;
+	line = (char *) malloc (Line_width + 1);
+	num_lines = ((Length + bytes_per_line - 1) / bytes_per_line);
+
+	for (i = 0; i < num_lines; i++)
+		{
+		bytes_this_line = Length - (i * bytes_per_line);
+
+		if (bytes_this_line > bytes_per_line)
+			{
+			bytes_this_line = bytes_per_line;
+			}
+
+		memset (line, ' ', Line_width);
+
+		if (Show_offset)
+			{
+			snprintf (&line [offset_index], 9, "%08X", i * bytes_per_line + Base_disp_addr);
+			line [offset_index + 8] = ' ';
+			}
+
+		cur = first_hex_index;
+
+		for (j = 0; j < bytes_this_line; j++)
+			{
+			if ((j % 4) == 0)
+				{
+				cur = cur - 1;
+				}
+
+			line [cur] = nibble_to_hex [(buffer [(i * bytes_per_line) + j] >> 0) & 0xf];
+			cur = cur - 1;
+			line [cur] = nibble_to_hex [(buffer [(i * bytes_per_line) + j] >> 4) & 0xf];
+			cur = cur - 1;
+
+			if (Show_ascii)
+				{
+				if (isprint (buffer [(i * bytes_per_line) + j]))
+					{
+					line [ascii_index + j] = buffer [(i * bytes_per_line) + j];
+					}
+				else
+					{
+					line [ascii_index + j] = '.';
+					}
+				}
+			}
+
+		line [Line_width - 1] = '\n';
+		Sink.write (Sink.context, line, Line_width);
+		}
+
+	free (line);
+}							// End old_dump
+
+
+static
+bool
+new_dump												// Format a buffer with HexDump, in pieces
+	(
+	const std::vector<uint8_t>&	Data,					// Bytes to dump
+	const HEXDUMP_OPTIONS&		Options,				// Layout
+	size_t						Piece,					// Largest piece written at once (0 for random pieces)
+	std::string&				Text					// Lines
+	)
+
+//
+// DESCRIPTION:		Start a HexDump that appends to the string, write the bytes, and finish
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							HexDump failed
+//
+
+{
+HexDump			dump;
+HEXDUMP_SINK	sink = {string_sink, &Text};
+size_t			done = 0;
+size_t			count;
+
+
+	if (!dump.start (Options, sink))
+		{
+		return false;
+		}
+
+	while (done < Data.size ())
+		{
+		count = Piece != 0 ? Piece : 1 + mix (PERF_random) % 50;
+		count = count < Data.size () - done ? count : Data.size () - done;
+
+		if (!dump.write (Data.data () + done, count))
+			{
+			return false;
+			}
+
+		done += count;
+		}
+
+	return dump.finish () && dump.offset () == Options.base + Data.size ();
+}							// End new_dump
+
+
+static
+bool
+check_layouts											// Compare HexDump with the old formatter
+	(
+	)
+
+//
+// DESCRIPTION:		For each width and choice of offset and ASCII, dump random buffers of random lengths (from empty to several
+//					lines) with both formatters, at once and in random pieces, and compare the lines
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Passed
+//		false							Failed
+//
+
+{
+std::vector<uint8_t>	data;
+std::string				want;
+std::string				whole;
+std::string				pieces;
+
+
+	for (uint32_t width = 1; width <= PERF_MAX_CHECK_WIDTH; width++)
+		{
+		for (int layout = 0; layout < 4; layout++)
+			{
+			HEXDUMP_OPTIONS	options = {width, 0, (layout & 1) != 0, (layout & 2) != 0};
+			uint32_t		overhead = (options.show_offset ? 11 : 0) + (options.show_ascii ? 1 : 0);
+			bool			fits = width >= overhead + 1 && (width - 1 - overhead) / (options.show_ascii ? 13 : 9) != 0;
+			HexDump			dump;
+			HEXDUMP_SINK	sink = {string_sink, &whole};
+
+			if (dump.start (options, sink) != fits)
+				{
+				printf ("dmpperf: width %u, layout %d: start returned %s\n", width, layout, fits ? "false" : "true");
+				return false;
+				}
+
+			if (!fits)
+				{
+				continue;
+				}
+
+			for (unsigned k = 0; k < PERF_CHECKS; k++)
+				{
+				data.resize (mix (PERF_random) % (width * 4));
+				options.base = (uint32_t) mix (PERF_random);
+
+				for (uint8_t& byte : data)
+					{
+					byte = (uint8_t) mix (PERF_random);
+					}
+
+				want.clear ();
+				whole.clear ();
+				pieces.clear ();
+				sink.context = &want;
+				old_dump (data.data (), (uint32_t) data.size (), width, (uint32_t) options.base, options.show_offset,
+					options.show_ascii, sink);
+
+				if (!new_dump (data, options, data.size () + 1, whole) || !new_dump (data, options, 0, pieces) ||
+					whole != want || pieces != want)
+					{
+					printf ("dmpperf: width %u, offset %s, ASCII %s, %zu bytes: the lines differ\n", width,
+						options.show_offset ? "on" : "off", options.show_ascii ? "on" : "off", data.size ());
+					printf ("expected:\n%s", want.c_str ());
+					printf ("whole:\n%s", whole.c_str ());
+					printf ("pieces:\n%s", pieces.c_str ());
+					return false;
+					}
+				}
+			}
+		}
+
+	printf ("  layouts verified\n");
+	return true;
+}							// End check_layouts
+
+
+static
+bool
+check_resume											// Check resuming a dump, and a failing sink
+	(
+	)
+
+//
+// DESCRIPTION:		Dump a buffer in one HexDump, and in two, the second starting at the offset where the first finished, which
+//					is at the end of a line. Then check that a sink that fails makes write and finish fail
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Passed
+//		false							Failed
+//
+
+{
+std::vector<uint8_t>	data (10000);
+std::string				want;
+std::string				text;
+HEXDUMP_OPTIONS			options = {80, 0x1000, true, true};
+HEXDUMP_SINK			sink = {string_sink, &text};
+HexDump					first;
+HexDump					second;
+size_t					split;
+
+
+	for (uint8_t& byte : data)
+		{
+		byte = (uint8_t) mix (PERF_random);
+		}
+
+	if (!new_dump (data, options, 0, want) || !first.start (options, sink))
+		{
+		return false;
+		}
+
+	split = first.line_bytes () * 37;
+
+	if (!first.write (data.data (), split) || !first.finish ())
+		{
+		return false;
+		}
+
+	options.base = first.offset ();
+
+	if (!second.start (options, sink) || !second.write (data.data () + split, data.size () - split) || !second.finish () ||
+		text != want)
+		{
+		printf ("dmpperf: the resumed dump differs\n");
+		return false;
+		}
+
+	sink.write = failing_sink;
+
+	if (!first.start (options, sink) || !first.write (data.data (), data.size ()) || first.finish () ||
+		first.write (data.data (), 1))
+		{
+		printf ("dmpperf: a failing sink did not stop the dump\n");
+		return false;
+		}
+
+	printf ("  resume verified\n");
+	return true;
+}							// End check_resume
+
+
+static
+void
+time_dump												// Time both formatters
+	(
+	)
+
+//
+// DESCRIPTION:		Dump a buffer of random bytes with each formatter, into a sink that counts the characters, with and without
+//					the ASCII
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::vector<uint8_t>	data ((size_t) PERF_options.megabytes << 20);
+double					bytes = (double) data.size () * PERF_options.rounds;
+uint64_t				old_chars = 0;
+uint64_t				new_chars = 0;
+uint64_t				start;
+double					old_gbps;
+double					new_gbps;
+
+
+	for (uint8_t& byte : data)
+		{
+		byte = (uint8_t) mix (PERF_random);
+		}
+
+	for (int ascii = 1; ascii >= 0; ascii--)
+		{
+		HEXDUMP_OPTIONS	options = {PERF_options.width, 0, true, ascii != 0};
+		HEXDUMP_SINK	old_sink = {count_sink, &old_chars};
+		HEXDUMP_SINK	new_sink = {count_sink, &new_chars};
+		HexDump			dump;
+
+		start = thread_nsec ();
+
+		for (unsigned r = 0; r < PERF_options.rounds; r++)
+			{
+			old_dump (data.data (), (uint32_t) data.size (), PERF_options.width, 0, true, ascii != 0, old_sink);
+			}
+
+		old_gbps = bytes / (thread_nsec () - start);
+		start = thread_nsec ();
+
+		for (unsigned r = 0; r < PERF_options.rounds; r++)
+			{
+			dump.start (options, new_sink);
+			dump.write (data.data (), data.size ());
+			dump.finish ();
+			}
+
+		new_gbps = bytes / (thread_nsec () - start);
+
+		printf ("  %u columns (%u bytes/line), ASCII %-3s: old %6.3f GB/s, HexDump %6.3f GB/s (%.0fx)\n", PERF_options.width,
+			dump.line_bytes (), ascii ? "on" : "off", old_gbps, new_gbps, new_gbps / old_gbps);
+		}
+
+	if (old_chars != new_chars)
+		{
+		printf ("  (the formatters wrote %llu and %llu characters)\n", (unsigned long long) old_chars,
+			(unsigned long long) new_chars);
+		}
+}							// End time_dump
+
+
+int
+main													// Test and measure the hex dump formatter
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, run the checks, then time the formatters
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every check passed
+//		1								One did not, or the options were bad
+//
+
+{
+bool	ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: dmpperf [-n:rounds] [-m:buffer MB] [-w:line width]\n");
+		return 1;
+		}
+
+	if (PERF_options.rounds == 0 || PERF_options.megabytes == 0 || PERF_options.megabytes > 1024 ||
+		PERF_options.width < 26 || PERF_options.width > HEXDUMP_MAX_WIDTH)
+		{
+		printf ("dmpperf: -n must be at least 1, -m from 1 to 1024, and -w from 26 to %u\n", HEXDUMP_MAX_WIDTH);
+		return 1;
+		}
+
+	printf ("dmpperf: %u rounds over %u MB\n", PERF_options.rounds, PERF_options.megabytes);
+
+	ok = check_layouts () && check_resume ();
+
+	if (ok)
+		{
+		time_dump ();
+		}
+
+	printf ("dmpperf: %s\n", ok ? "HexDump verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
@@ -0,0 +1,511 @@
+//
+// FACILITY:	hshperf - Test and measure the hashes
+//
+// DESCRIPTION:	This program runs Hasher (Hasher.cpp) on Linux. It checks that:
+//
+//					- SHA-256 and XXH64 produce the published digests of the standard test messages
+//					- Hashing a buffer in pieces, split at every position and in pieces of random sizes, produces the same
+//					  digest as hashing it at once, and fast64 produces the same value as update and finish
+//					- tree produces the same digest with every number of threads, and that digest is the hash of the chunks'
+//					  digests, the length and the chunk size
+//
+//				It then prints the rate, in GB/s, at which each mode hashes small buffers (the size of a typical captured
+//				buffer) and a large buffer, and the rate at which tree hashes the large buffer with 1 to -t: threads. The
+//				times are wall-clock time, so that the threads of tree are counted. Utils::hash_data opened a BCrypt algorithm
+//				provider and allocated a hash object for every buffer, which cannot be timed on Linux.
+//
+//				Usage: hshperf [-n:rounds] [-m:buffer MB] [-t:threads]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the clocks, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Hasher.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_SPLIT_BYTES		300						// Longest buffer split at every position
+#define	PERF_SMALL_BYTES		256						// Size of a small buffer
+#define	PERF_TREE_CHUNK			(64 * 1024)				// Chunk size in the tree check
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		rounds;								// Hashes of the large buffer in the timing
+	unsigned		megabytes;							// Size of the large buffer
+	unsigned		threads;							// Most threads for tree
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+typedef struct _PERF_VECTOR								// A published digest
+	{
+	HASHER_MODE		mode;								// Hash
+	const char		*message;							// Message (repeated)
+	unsigned		repeat;								// Times the message is repeated
+	const char		*digest;							// Digest, in hex
+	} PERF_VECTOR, *PPERF_VECTOR;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS	PERF_options = {4, 64, 4};
+
+static const PERF_OPTION	PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.rounds},
+	{'m', &PERF_options.megabytes},
+	{'t', &PERF_options.threads}
+	};
+
+static uint64_t		PERF_random = 12345;				// Generator state
+
+static const PERF_VECTOR	PERF_vectors [] =
+	{
+	{HASHER_SHA256, "", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+	{HASHER_SHA256, "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+	{HASHER_SHA256, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+	{HASHER_SHA256, "a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+	{HASHER_FAST, "", 1, "ef46db3751d8e999"},
+	{HASHER_FAST, "a", 1, "d24ec4f1a98c6e5b"},
+	{HASHER_FAST, "abc", 1, "44bc2cf5ad770999"}
+	};
+
+
+
+static
+void
+random_bytes											// Fill a buffer with random bytes
+	(
+	std::vector<uint8_t>&	Buffer,						// Buffer
+	size_t					Length						// Bytes
+	)
+
+//
+// DESCRIPTION:		Resize the buffer, and fill it from mix
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	Buffer.resize (Length);
+
+	for (uint8_t& byte : Buffer)
+		{
+		byte = (uint8_t) mix (PERF_random);
+		}
+}							// End random_bytes
+
+
+static
+bool
+check_vectors											// Hash the standard test messages
+	(
+	)
+
+//
+// DESCRIPTION:		Hash each message, adding each repetition with its own update, and compare the digest in hex with the
+//					published one
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Every digest matched
+//		false							One did not
+//
+
+{
+Hasher	hasher;
+uint8_t	digest [HASHER_MAX_DIGEST];
+char	hex [HASHER_MAX_DIGEST * 2 + 1];
+size_t	size;
+
+
+	for (const PERF_VECTOR& vector : PERF_vectors)
+		{
+		hasher.reset (vector.mode);
+
+		for (unsigned r = 0; r < vector.repeat; r++)
+			{
+			hasher.update (vector.message, strlen (vector.message));
+			}
+
+		size = hasher.finish (digest);
+
+		for (size_t i = 0; i < size; i++)
+			{
+			sprintf (hex + i * 2, "%02x", digest [i]);
+			}
+
+		if (size != Hasher::digest_size (vector.mode) || strcmp (hex, vector.digest) != 0)
+			{
+			printf ("  %s of \"%s\" x %u is %s, not %s\n", vector.mode == HASHER_SHA256 ? "SHA-256" : "XXH64", vector.message,
+				vector.repeat, hex, vector.digest);
+			return false;
+			}
+		}
+
+	printf ("  test vectors verified\n");
+	return true;
+}							// End check_vectors
+
+
+static
+bool
+check_pieces											// Hash buffers in pieces
+	(
+	)
+
+//
+// DESCRIPTION:		For each mode, split every buffer up to PERF_SPLIT_BYTES at every position into two pieces, and a 1 MB buffer
+//					into pieces of random sizes, and compare the digests with the digest of the whole buffer. Then compare
+//					fast64, with random seeds, with update and finish
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Every digest matched
+//		false							One did not
+//
+
+{
+std::vector<uint8_t>	data;
+Hasher					hasher;
+uint8_t					whole [HASHER_MAX_DIGEST];
+uint8_t					pieces [HASHER_MAX_DIGEST];
+size_t					size;
+size_t					offset;
+size_t					piece;
+uint64_t				seed;
+uint64_t				value;
+
+
+	random_bytes (data, 1024 * 1024);
+
+	for (HASHER_MODE mode : {HASHER_SHA256, HASHER_FAST})
+		{
+		for (size_t length = 0; length <= PERF_SPLIT_BYTES; length++)
+			{
+			size = Hasher::hash (mode, data.data (), length, whole);
+
+			for (size_t split = 0; split <= length; split++)
+				{
+				hasher.reset (mode);
+				hasher.update (data.data (), split);
+				hasher.update (data.data () + split, length - split);
+
+				if (hasher.finish (pieces) != size || memcmp (whole, pieces, size) != 0)
+					{
+					printf ("  mode %d, %zu bytes split at %zu: digest differs\n", (int) mode, length, split);
+					return false;
+					}
+				}
+			}
+
+		size = Hasher::hash (mode, data.data (), data.size (), whole);
+		hasher.reset (mode);
+
+		for (offset = 0; offset < data.size (); offset += piece)
+			{
+			piece = (size_t) (mix (PERF_random) % 5000);
+			piece = piece < data.size () - offset ? piece : data.size () - offset;
+			hasher.update (data.data () + offset, piece);
+			}
+
+		if (hasher.finish (pieces) != size || memcmp (whole, pieces, size) != 0)
+			{
+			printf ("  mode %d, random pieces: digest differs\n", (int) mode);
+			return false;
+			}
+		}
+
+	for (size_t length = 0; length <= PERF_SPLIT_BYTES; length++)
+		{
+		seed = length % 3 == 0 ? 0 : mix (PERF_random);
+		value = Hasher::fast64 (data.data (), length, seed);
+		hasher.reset (HASHER_FAST, seed);
+		hasher.update (data.data (), length);
+		hasher.finish (pieces);
+
+		for (int i = 0; i < HASHER_FAST_BYTES; i++)
+			{
+			if (pieces [i] != (uint8_t) (value >> (56 - i * 8)))
+				{
+				printf ("  fast64 of %zu bytes differs from finish\n", length);
+				return false;
+				}
+			}
+		}
+
+	printf ("  pieces verified\n");
+	return true;
+}							// End check_pieces
+
+
+static
+bool
+check_tree												// Hash buffers as trees
+	(
+	)
+
+//
+// DESCRIPTION:		For lengths around the chunk boundaries, build the expected root from the digests of the chunks, and compare
+//					it with tree on 1 to 5 threads and on one per processor. Then check that a bad chunk size is refused
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Every digest matched
+//		false							One did not
+//
+
+{
+static const size_t		lengths [] = {0, 1, PERF_TREE_CHUNK - 1, PERF_TREE_CHUNK, PERF_TREE_CHUNK + 1, 5 * PERF_TREE_CHUNK,
+									  17 * PERF_TREE_CHUNK + 12345};
+std::vector<uint8_t>	data;
+Hasher					root;
+uint8_t					chunk [HASHER_MAX_DIGEST];
+uint8_t					expected [HASHER_MAX_DIGEST];
+uint8_t					digest [HASHER_MAX_DIGEST];
+uint8_t					trailer [16];
+size_t					size;
+size_t					offset;
+
+
+	random_bytes (data, 17 * PERF_TREE_CHUNK + 12345);
+
+	for (HASHER_MODE mode : {HASHER_SHA256, HASHER_FAST})
+		{
+		for (size_t length : lengths)
+			{
+			root.reset (mode);
+			offset = 0;
+
+			do
+				{
+				size_t	piece = length - offset < PERF_TREE_CHUNK ? length - offset : PERF_TREE_CHUNK;
+
+				size = Hasher::hash (mode, data.data () + offset, piece, chunk);
+				root.update (chunk, size);
+				offset += piece;
+				}
+			while (offset < length);
+
+			for (int i = 0; i < 8; i++)
+				{
+				trailer [i] = (uint8_t) ((uint64_t) length >> (i * 8));
+				trailer [8 + i] = (uint8_t) ((uint64_t) PERF_TREE_CHUNK >> (i * 8));
+				}
+
+			root.update (trailer, sizeof (trailer));
+			root.finish (expected);
+
+			for (unsigned threads = 0; threads <= 5; threads++)
+				{
+				if (!Hasher::tree (mode, data.data (), length, PERF_TREE_CHUNK, threads, digest) ||
+					memcmp (digest, expected, size) != 0)
+					{
+					printf ("  mode %d, %zu bytes on %u threads: tree digest differs\n", (int) mode, length, threads);
+					return false;
+					}
+				}
+			}
+		}
+
+	if (Hasher::tree (HASHER_FAST, data.data (), data.size (), 0, 1, digest) ||
+		Hasher::tree (HASHER_FAST, data.data (), data.size (), 100, 1, digest))
+		{
+		printf ("  tree accepted a bad chunk size\n");
+		return false;
+		}
+
+	printf ("  trees verified\n");
+	return true;
+}							// End check_tree
+
+
+static
+void
+time_mode												// Time one mode
+	(
+	HASHER_MODE		Mode,								// Hash
+	const char		*Name								// Name of the hash
+	)
+
+//
+// DESCRIPTION:		Hash the large buffer as small buffers, one at a time, then whole, then as a tree on 1 to
+//					PERF_options.threads threads, doubling the threads each time
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::vector<uint8_t>	data;
+uint8_t					digest [HASHER_MAX_DIGEST];
+uint64_t				start;
+uint64_t				sum = 0;
+double					bytes;
+double					small;
+double					whole;
+
+
+	random_bytes (data, (size_t) PERF_options.megabytes << 20);
+	bytes = (double) data.size () * PERF_options.rounds;
+	start = wall_nsec ();
+
+	for (unsigned r = 0; r < PERF_options.rounds; r++)
+		{
+		for (size_t offset = 0; offset + PERF_SMALL_BYTES <= data.size (); offset += PERF_SMALL_BYTES)
+			{
+			if (Mode == HASHER_FAST)
+				{
+				sum += Hasher::fast64 (data.data () + offset, PERF_SMALL_BYTES);
+				}
+			else
+				{
+				Hasher::hash (Mode, data.data () + offset, PERF_SMALL_BYTES, digest);
+				sum += digest [0];
+				}
+			}
+		}
+
+	small = bytes / (wall_nsec () - start);
+	start = wall_nsec ();
+
+	for (unsigned r = 0; r < PERF_options.rounds; r++)
+		{
+		Hasher::hash (Mode, data.data (), data.size (), digest);
+		sum += digest [0];
+		}
+
+	whole = bytes / (wall_nsec () - start);
+	printf ("  %-7s %u-byte buffers %6.2f GB/s, whole %6.2f GB/s, tree:", Name, PERF_SMALL_BYTES, small, whole);
+
+	for (unsigned threads = 1; threads <= PERF_options.threads; threads *= 2)
+		{
+		start = wall_nsec ();
+
+		for (unsigned r = 0; r < PERF_options.rounds; r++)
+			{
+			Hasher::tree (Mode, data.data (), data.size (), HASHER_TREE_CHUNK, threads, digest);
+			sum += digest [0];
+			}
+
+		printf (" %u: %6.2f", threads, bytes / (wall_nsec () - start));
+		}
+
+	printf (" GB/s%s\n", sum == 0 ? " " : "");
+}							// End time_mode
+
+
+int
+main													// Test and measure the hashes
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, run the checks, then time the hashes
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every check passed
+//		1								One did not, or the options were bad
+//
+
+{
+bool	ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: hshperf [-n:rounds] [-m:buffer MB] [-t:threads]\n");
+		return 1;
+		}
+
+	if (PERF_options.rounds == 0 || PERF_options.megabytes == 0 || PERF_options.megabytes > 1024 ||
+		PERF_options.threads == 0 || PERF_options.threads > 256)
+		{
+		printf ("hshperf: -n must be at least 1, -m from 1 to 1024, and -t from 1 to 256\n");
+		return 1;
+		}
+
+	printf ("hshperf: %u rounds over %u MB, up to %u threads (%u processors)\n", PERF_options.rounds, PERF_options.megabytes,
+		PERF_options.threads, std::thread::hardware_concurrency ());
+
+	ok = check_vectors () && check_pieces () && check_tree ();
+
+	if (ok)
+		{
+		time_mode (HASHER_SHA256, "SHA-256");
+		time_mode (HASHER_FAST, "XXH64");
+		}
+
+	printf ("hshperf: %s\n", ok ? "Hasher verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
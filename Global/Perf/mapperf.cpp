@@ -0,0 +1,443 @@
+//
+// FACILITY:	mapperf - Test and measure the memory-mapped files
+//
+// DESCRIPTION:	This program runs MappedFile (MappedFile.cpp) on Linux. It writes a file of random bytes whose size is not a
+//				multiple of the page size, and checks that:
+//
+//					- With the whole file mapped, and with windows of 1 and 3 pages and of 1 MB, and with each access pattern,
+//					  random views (many of which cross the end of a window) and a sequential scan return the file's bytes
+//					- A view as long as the window, at an offset that is not aligned, succeeds, and views past the end of the
+//					  file or longer than the window fail
+//					- prefetch accepts ranges in the window, and refuses others
+//					- An empty file can be opened and has only empty views, a missing file cannot be opened, and a closed
+//					  MappedFile has no views
+//
+//				It then prints the rate, in GB/s, at which a file of -m: MB is scanned (each quadword is read) through fread and
+//				a 64 KB buffer, as TraceReader read trace files, and through MappedFile, with 16 MB windows and with the whole
+//				file mapped. The file is in the page cache, so this measures the copying and the system calls, not the disk.
+//
+//				Usage: mapperf [-n:rounds] [-m:file MB] [-o:file]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the clocks, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../MappedFile.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_CHECK_BYTES		(5 * 1024 * 1024 + 1234)	// Size of the file in the checks
+#define	PERF_RANDOM_VIEWS		2000					// Random views of each layout
+#define	PERF_READ_BUFFER		(64 * 1024)				// Buffer of the fread scan
+#define	PERF_WINDOW				(16 * 1024 * 1024)		// Window of the windowed scan
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		rounds;								// Scans of the file in the timing
+	unsigned		megabytes;							// Size of the file in the timing
+	const char		*file_name;							// File to write and map
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS	PERF_options = {8, 64, "mapperf.dat"};
+
+static const PERF_OPTION	PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.rounds},
+	{'m', &PERF_options.megabytes},
+	{'o', nullptr, &PERF_options.file_name}
+	};
+
+static uint64_t		PERF_random = 12345;				// Generator state
+
+
+
+static
+bool
+write_file												// Write a file of random bytes
+	(
+	size_t					Length,						// Size of the file
+	std::vector<uint8_t>&	Contents					// Bytes written
+	)
+
+//
+// DESCRIPTION:		Fill the buffer from mix, and write it to PERF_options.file_name
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Replaces the file
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be written
+//
+
+{
+FILE	*file;
+bool	ok;
+
+
+	Contents.resize (Length);
+
+	for (uint8_t& byte : Contents)
+		{
+		byte = (uint8_t) mix (PERF_random);
+		}
+
+	if ((file = fopen (PERF_options.file_name, "wb")) == nullptr)
+		{
+		printf ("  cannot create %s\n", PERF_options.file_name);
+		return false;
+		}
+
+	ok = fwrite (Contents.data (), 1, Length, file) == Length;
+	return fclose (file) == 0 && ok;
+}							// End write_file
+
+
+static
+uint64_t
+scan													// Read each quadword of a range
+	(
+	const uint8_t	*Bytes,								// Range
+	size_t			Length								// Bytes (a multiple of 8)
+	)
+
+//
+// DESCRIPTION:		Add up the quadwords, so that each is read
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Sum
+//
+
+{
+uint64_t	sum = 0;
+uint64_t	quad;
+
+
+	for (size_t i = 0; i + 8 <= Length; i += 8)
+		{
+		memcpy (&quad, Bytes + i, 8);
+		sum += quad;
+		}
+
+	return sum;
+}							// End scan
+
+
+static
+bool
+check_views												// Check views with each window and access pattern
+	(
+	)
+
+//
+// DESCRIPTION:		Write the check file, then for each layout check random views, a sequential scan, the edges of the file
+//					and the window, and prefetch
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Replaces the file
+//
+// RETURN VALUES:
+//
+//		true							Every view was right
+//		false							One was not
+//
+
+{
+std::vector<uint8_t>	contents;
+MappedFile				file;
+const size_t			page = MappedFile::granularity ();
+const size_t			windows [] = {MAPPED_FILE_WHOLE, page, 3 * page, 1024 * 1024};
+const uint8_t			*bytes;
+uint64_t				offset;
+size_t					length;
+size_t					window;
+
+
+	if (!write_file (PERF_CHECK_BYTES, contents))
+		{
+		return false;
+		}
+
+	for (size_t window_size : windows)
+		{
+		for (MAPPED_FILE_ACCESS access : {MAPPED_FILE_NORMAL, MAPPED_FILE_SEQUENTIAL, MAPPED_FILE_RANDOM})
+			{
+			window = window_size == MAPPED_FILE_WHOLE ? contents.size () : window_size;
+
+			if (!file.open (PERF_options.file_name, access, window_size) || file.size () != contents.size ())
+				{
+				printf ("  window %zu, access %d: open failed, error %d\n", window_size, (int) access, file.error ());
+				return false;
+				}
+
+			for (unsigned v = 0; v < PERF_RANDOM_VIEWS; v++)
+				{
+				offset = mix (PERF_random) % (contents.size () + 1);
+				length = (size_t) (mix (PERF_random) % (window + 1));
+				length = length < contents.size () - offset ? length : (size_t) (contents.size () - offset);
+
+				if ((bytes = file.view (offset, length)) == nullptr ||
+					(length != 0 && memcmp (bytes, contents.data () + offset, length) != 0))
+					{
+					printf ("  window %zu, access %d: view of %zu bytes at %llu is wrong\n", window_size, (int) access, length,
+						(unsigned long long) offset);
+					return false;
+					}
+				}
+
+			for (offset = 0; offset < contents.size (); offset += length)
+				{
+				length = 1 + (size_t) (mix (PERF_random) % window);
+				length = length < contents.size () - offset ? length : (size_t) (contents.size () - offset);
+
+				if ((bytes = file.view (offset, length)) == nullptr || memcmp (bytes, contents.data () + offset, length) != 0)
+					{
+					printf ("  window %zu, access %d: scan at %llu is wrong\n", window_size, (int) access,
+						(unsigned long long) offset);
+					return false;
+					}
+				}
+
+			if ((window < contents.size () && ((bytes = file.view (page / 2, window)) == nullptr ||
+				memcmp (bytes, contents.data () + page / 2, window) != 0 || file.view (0, window + 1) != nullptr)) ||
+				file.view (contents.size (), 1) != nullptr || file.error () != EINVAL ||
+				file.view (contents.size (), 0) == nullptr)
+				{
+				printf ("  window %zu, access %d: the edges of the file or window are wrong\n", window_size, (int) access);
+				return false;
+				}
+
+			if (file.view (page, 10) == nullptr || !file.prefetch (page, 10) || !file.prefetch (page + 5, 0) ||
+				file.prefetch (contents.size () + 1, 1))
+				{
+				printf ("  window %zu, access %d: prefetch is wrong\n", window_size, (int) access);
+				return false;
+				}
+			}
+		}
+
+	if (!write_file (0, contents) || !file.open (PERF_options.file_name) || file.size () != 0 || file.view (0, 0) == nullptr ||
+		file.view (0, 1) != nullptr)
+		{
+		printf ("  an empty file is wrong\n");
+		return false;
+		}
+
+	file.close ();
+
+	if (file.is_open () || file.view (0, 0) != nullptr || file.open ("/nonexistent/mapperf.dat") || file.error () != ENOENT)
+		{
+		printf ("  a closed or missing file is wrong\n");
+		return false;
+		}
+
+	printf ("  views verified\n");
+	return true;
+}							// End check_views
+
+
+static
+bool
+time_scans												// Time the scans of a large file
+	(
+	)
+
+//
+// DESCRIPTION:		Write a file of PERF_options.megabytes, read it once to bring it into the page cache, then time each way of
+//					reading it
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Replaces the file
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be written or read
+//
+
+{
+std::vector<uint8_t>	contents;
+std::vector<uint8_t>	buffer (PERF_READ_BUFFER);
+MappedFile				file;
+FILE					*stream;
+const uint8_t			*bytes;
+uint64_t				start;
+uint64_t				expected;
+uint64_t				sum;
+size_t					length;
+double					bytes_read;
+double					rate [3];
+
+
+	if (!write_file ((size_t) PERF_options.megabytes << 20, contents))
+		{
+		return false;
+		}
+
+	expected = scan (contents.data (), contents.size ());
+	bytes_read = (double) contents.size () * PERF_options.rounds;
+	contents.clear ();
+	contents.shrink_to_fit ();
+
+	for (int way = -1; way < 3; way++)
+		{
+		start = wall_nsec ();
+
+		for (unsigned r = 0; r < (way < 0 ? 1 : PERF_options.rounds); r++)
+			{
+			sum = 0;
+
+			if (way <= 0)
+				{
+				if ((stream = fopen (PERF_options.file_name, "rb")) == nullptr)
+					{
+					return false;
+					}
+
+				while ((length = fread (buffer.data (), 1, buffer.size (), stream)) != 0)
+					{
+					sum += scan (buffer.data (), length);
+					}
+
+				fclose (stream);
+				}
+			else
+				{
+				if (!file.open (PERF_options.file_name, MAPPED_FILE_SEQUENTIAL, way == 1 ? PERF_WINDOW : MAPPED_FILE_WHOLE))
+					{
+					return false;
+					}
+
+				for (uint64_t offset = 0; offset < file.size (); offset += length)
+					{
+					length = file.size () - offset < PERF_WINDOW ? (size_t) (file.size () - offset) : PERF_WINDOW;
+
+					if ((bytes = file.view (offset, length)) == nullptr)
+						{
+						return false;
+						}
+
+					sum += scan (bytes, length);
+					}
+
+				file.close ();
+				}
+
+			if (sum != expected)
+				{
+				printf ("  scan %d read the wrong bytes\n", way);
+				return false;
+				}
+			}
+
+		if (way >= 0)
+			{
+			rate [way] = bytes_read / (wall_nsec () - start);
+			}
+		}
+
+	printf ("  %u MB scan: fread %6.2f GB/s, MappedFile %u MB windows %6.2f GB/s, whole %6.2f GB/s\n", PERF_options.megabytes,
+		rate [0], PERF_WINDOW >> 20, rate [1], rate [2]);
+	return true;
+}							// End time_scans
+
+
+int
+main													// Test and measure the memory-mapped files
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, run the checks, then time the scans
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Writes the file, and removes it
+//
+// RETURN VALUES:
+//
+//		0								Every check passed
+//		1								One did not, or the options were bad
+//
+
+{
+bool	ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: mapperf [-n:rounds] [-m:file MB] [-o:file]\n");
+		return 1;
+		}
+
+	if (PERF_options.rounds == 0 || PERF_options.megabytes == 0 || PERF_options.megabytes > 1024 ||
+		PERF_options.file_name [0] == '\0')
+		{
+		printf ("mapperf: -n must be at least 1, -m from 1 to 1024, and -o not empty\n");
+		return 1;
+		}
+
+	printf ("mapperf: %u rounds over %u MB, %zu-byte pages, file %s\n", PERF_options.rounds, PERF_options.megabytes,
+		MappedFile::granularity (), PERF_options.file_name);
+
+	ok = check_views () && time_scans ();
+	remove (PERF_options.file_name);
+
+	printf ("mapperf: %s\n", ok ? "MappedFile verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
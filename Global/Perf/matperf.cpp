@@ -0,0 +1,773 @@
+//
+// FACILITY:	matperf - Test and measure the Matcher
+//
+// DESCRIPTION:	This program runs the Matcher (Matcher.cpp) on Linux. It checks that, for random texts and patterns, with and
+//				without case folding:
+//
+//					- A single pattern is found where a naive search finds it, at every alignment and near the end of the text,
+//					  and where the Knuth-Morris-Pratt search that Utils used finds it
+//					- A set of patterns reports the match that ends first (the longest, if several end there) that a naive
+//					  search finds, including sets that use every character, and sets with duplicate patterns
+//
+//				It then compares the time the KMP search (a copy of Utils::kmp_search, with its table computed once) and the
+//				Matcher take to:
+//
+//					- Look for an executable name in a snapshot of process names, as Utils::find_process_by_name does
+//					- Scan a large text for one pattern that is not in it
+//					- Scan the text for a set of API names (one KMP pass per name, against one Matcher pass)
+//
+//				The times are thread CPU time.
+//
+//				Usage: matperf [-n:rounds] [-m:text MB] [-p:set patterns]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the clocks, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Matcher.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_CHECKS				4000					// Random texts in each check
+#define	PERF_PROCESSES			300						// Names in the simulated process snapshot
+#define	PERF_SNAPSHOTS			20000					// Snapshots searched in the timing
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		rounds;								// Scans of the large text in each timing
+	unsigned		megabytes;							// Size of the large text
+	unsigned		patterns;							// Patterns in the set timing
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS	PERF_options = {4, 16, 32};
+
+static const PERF_OPTION	PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.rounds},
+	{'m', &PERF_options.megabytes},
+	{'p', &PERF_options.patterns}
+	};
+
+static uint64_t		PERF_random = 12345;				// Generator state
+
+static const char	*PERF_apis [] =						// Names for the set timing
+	{
+	"CreateFileW", "ReadFile", "WriteFile", "CloseHandle", "DeviceIoControl", "CreateProcessW", "OpenProcess",
+	"VirtualAllocEx", "WriteProcessMemory", "CreateRemoteThread", "LoadLibraryW", "GetProcAddress", "RegOpenKeyExW",
+	"RegSetValueExW", "RegQueryValueExW", "RegCloseKey", "FindFirstFileW", "FindNextFileW", "MoveFileExW", "DeleteFileW",
+	"CopyFileW", "GetFileAttributesExW", "SetFileAttributesW", "CreateDirectoryW", "RemoveDirectoryW", "MapViewOfFile",
+	"UnmapViewOfFile", "CreateFileMappingW", "OpenThread", "SuspendThread", "ResumeThread", "SetThreadContext",
+	"GetThreadContext", "NtQuerySystemInformation", "InternetOpenUrlW", "HttpSendRequestW", "WSAStartup", "connect",
+	"CryptEncrypt", "CryptDecrypt"
+	};
+
+
+
+static
+std::string
+random_string											// Make a random string
+	(
+	const char	*Alphabet,								// Characters to use
+	size_t		Length									// Length of the string
+	)
+
+//
+// DESCRIPTION:		Choose each character from the alphabet
+//
+// ASSUMPTIONS:		The alphabet is not empty
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		String
+//
+
+{
+std::string	text (Length, ' ');
+size_t		size = strlen (Alphabet);
+
+
+	for (char& c : text)
+		{
+		c = Alphabet [mix (PERF_random) % size];
+		}
+
+	return text;
+}							// End random_string
+
+
+static
+void
+kmp_table												// Build the KMP lookup table
+	(
+	const std::string&	Pattern,						// Pattern to search for
+	std::vector<int>&	Table							// Lookup table
+	)
+
+//
+// DESCRIPTION:		Utils::kmp_compute_lookup_table
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	Table.assign (Pattern.size () + 1, -1);
+
+	for (size_t i = 0; i < Pattern.size (); i++)
+		{
+		Table [i + 1] = Table [i] + 1;
+
+		while ((Table [i + 1] > 0) && (Pattern [i] != Pattern [Table [i + 1] - 1]))
+			{
+			Table [i + 1] = Table [Table [i + 1] - 1] + 1;
+			}
+		}
+}							// End kmp_table
+
+
+static
+bool
+kmp_search												// Search the text with a KMP lookup table
+	(
+	const char				*Text,						// Text to search
+	size_t					Length,						// Length of the text
+	const std::string&		Pattern,					// Pattern to search for
+	const std::vector<int>&	Table,						// Lookup table from kmp_table
+	bool					Case_blind,					// If true, upcase both characters
+	size_t					*Index						// Where the pattern starts
+	)
+
+//
+// DESCRIPTION:		Utils::kmp_search
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Found
+//		false							Not found
+//
+
+{
+size_t	t_idx = 0;
+long	p_idx = 0;
+long	p_len = (long) Pattern.size ();
+char	t_char;
+char	p_char;
+
+
+	while (t_idx < Length)
+		{
+		if (p_idx < 0)
+			{
+			t_idx = t_idx + 1;
+			p_idx = p_idx + 1;
+			continue;
+			}
+
+		if (Case_blind)
+			{
+			t_char = (char) toupper (Text [t_idx]);
+			p_char = (char) toupper (Pattern [p_idx]);
+			}
+		else
+			{
+			t_char = Text [t_idx];
+			p_char = Pattern [p_idx];
+			}
+
+		if (t_char == p_char)
+			{
+			t_idx = t_idx + 1;
+			p_idx = p_idx + 1;
+
+			if (p_idx == p_len)
+				{
+				*Index = t_idx - p_idx;
+				return true;
+				}
+			}
+		else
+			{
+			p_idx = Table [p_idx];
+			}
+		}
+
+	return false;
+}							// End kmp_search
+
+
+static
+bool
+naive_search											// Find the first match of a set of patterns, one position at a time
+	(
+	const std::string&				Text,				// Text to search
+	const std::vector<std::string>&	Patterns,			// Patterns to search for
+	bool							Case_blind,			// If true, fold ASCII letters to upper case
+	MATCHER_RESULT					*Result				// Where the match is
+	)
+
+//
+// DESCRIPTION:		For each end position in turn, try every pattern, and keep the longest (the first, if patterns are equal)
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Found
+//		false							Not found
+//
+
+{
+	for (size_t end = 1; end <= Text.size (); end++)
+		{
+		bool	found = false;
+
+		for (size_t k = 0; k < Patterns.size (); k++)
+			{
+			const std::string&	pattern = Patterns [k];
+			size_t				i;
+
+			if (pattern.size () > end || (found && pattern.size () <= Result->length))
+				{
+				continue;
+				}
+
+			for (i = 0; i < pattern.size (); i++)
+				{
+				unsigned char	t = (unsigned char) Text [end - pattern.size () + i];
+				unsigned char	p = (unsigned char) pattern [i];
+
+				if (Case_blind)
+					{
+					t = (unsigned char) (t >= 'a' && t <= 'z' ? t - ('a' - 'A') : t);
+					p = (unsigned char) (p >= 'a' && p <= 'z' ? p - ('a' - 'A') : p);
+					}
+
+				if (t != p)
+					{
+					break;
+					}
+				}
+
+			if (i == pattern.size ())
+				{
+				found = true;
+				Result->offset = end - pattern.size ();
+				Result->length = pattern.size ();
+				Result->pattern = (uint32_t) k;
+				}
+			}
+
+		if (found)
+			{
+			return true;
+			}
+		}
+
+	return false;
+}							// End naive_search
+
+
+static
+bool
+same_result												// Compare a Matcher's answer with the naive search's
+	(
+	const char						*Check,				// Name of the check
+	const std::string&				Text,				// Text searched
+	const std::vector<std::string>&	Patterns,			// Patterns
+	bool							Case_blind,			// Case folding
+	const Matcher&					Compiled			// Matcher compiled from Patterns
+	)
+
+//
+// DESCRIPTION:		Search the text both ways and print the first difference
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Same answer
+//		false							Different
+//
+
+{
+MATCHER_RESULT	want = {0, 0, 0};
+MATCHER_RESULT	got = {0, 0, 0};
+bool			want_found = naive_search (Text, Patterns, Case_blind, &want);
+bool			got_found = Compiled.search (Text, &got);
+
+
+	if (want_found == got_found && (!want_found ||
+		(want.offset == got.offset && want.length == got.length && want.pattern == got.pattern)))
+		{
+		return true;
+		}
+
+	printf ("matperf: %s, %s: expected %s at %zu (pattern %u), got %s at %zu (pattern %u), %zu patterns, text length %zu\n",
+		Check, Case_blind ? "case-blind" : "exact", want_found ? "match" : "none", want.offset, want.pattern,
+		got_found ? "match" : "none", got.offset, got.pattern, Patterns.size (), Text.size ());
+	return false;
+}							// End same_result
+
+
+static
+bool
+check_single											// Check single patterns
+	(
+	)
+
+//
+// DESCRIPTION:		Search random texts over a small alphabet, so that there are many partial matches, for random patterns, and
+//					compare with the naive search and, when the search is exact, with KMP. Then plant a pattern at every
+//					offset of a text of 64 characters, which covers every lane of the 16-byte blocks and the scalar tail
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Passed
+//		false							Failed
+//
+
+{
+Matcher				matcher;
+MATCHER_RESULT		match;
+std::vector<int>	table;
+size_t				index;
+bool				kmp_found;
+
+
+	for (int blind = 0; blind < 2; blind++)
+		{
+		for (unsigned k = 0; k < PERF_CHECKS; k++)
+			{
+			std::string					text = random_string ("abAB.", mix (PERF_random) % 200);
+			std::vector<std::string>	patterns (1, random_string ("abAB.", 1 + mix (PERF_random) % 6));
+
+			if (!matcher.compile (patterns [0], blind != 0) || matcher.states () != 0 ||
+				!same_result ("single", text, patterns, blind != 0, matcher))
+				{
+				return false;
+				}
+
+			if (!blind)
+				{
+				kmp_table (patterns [0], table);
+				kmp_found = kmp_search (text.data (), text.size (), patterns [0], table, false, &index);
+
+				if (kmp_found != matcher.search (text, &match) || (kmp_found && index != match.offset))
+					{
+					printf ("matperf: single: KMP and Matcher differ for \"%s\" in \"%s\"\n", patterns [0].c_str (), text.c_str ());
+					return false;
+					}
+				}
+			}
+
+		for (size_t length = 1; length <= 40; length++)
+			{
+			std::string	pattern = random_string ("QRSTqrst", length);
+
+			if (!matcher.compile (pattern, blind != 0))
+				{
+				return false;
+				}
+
+			for (size_t offset = 0; offset + length <= 64; offset++)
+				{
+				std::string	text = random_string ("abc", 64);
+
+				text.replace (offset, length, pattern);
+
+				if (blind)
+					{
+					for (size_t i = offset; i < offset + length; i += 2)
+						{
+						text [i] = (char) (isupper ((unsigned char) text [i]) ? tolower (text [i]) : toupper (text [i]));
+						}
+					}
+
+				if (!matcher.search (text, &match) || match.offset != offset || match.length != length)
+					{
+					printf ("matperf: single: pattern of %zu at %zu not found\n", length, offset);
+					return false;
+					}
+				}
+			}
+		}
+
+	if (matcher.compile (std::string (), false) || matcher.search ("abc", 3, &match))
+		{
+		printf ("matperf: single: an empty pattern compiled\n");
+		return false;
+		}
+
+	printf ("  single patterns verified\n");
+	return true;
+}							// End check_single
+
+
+static
+bool
+check_set												// Check sets of patterns
+	(
+	)
+
+//
+// DESCRIPTION:		Search random texts over a small alphabet for random sets (with duplicates and patterns that are suffixes
+//					and prefixes of others, which the small alphabet makes likely), then random bytes for a set that holds every
+//					character, so that none is left for the column of characters in no pattern
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Passed
+//		false							Failed
+//
+
+{
+Matcher						matcher;
+std::vector<std::string>	patterns;
+
+
+	for (int blind = 0; blind < 2; blind++)
+		{
+		for (unsigned k = 0; k < PERF_CHECKS; k++)
+			{
+			std::string	text = random_string ("abcAB", mix (PERF_random) % 300);
+
+			patterns.assign (2 + mix (PERF_random) % 12, std::string ());
+
+			for (std::string& pattern : patterns)
+				{
+				pattern = random_string ("abcAB", 1 + mix (PERF_random) % 5);
+				}
+
+			if (!matcher.compile (patterns, blind != 0) || matcher.states () == 0 ||
+				!same_result ("set", text, patterns, blind != 0, matcher))
+				{
+				return false;
+				}
+			}
+
+		patterns.clear ();
+
+		for (int c = 255; c >= 0; c--)
+			{
+			patterns.push_back (std::string (2, (char) c));
+			}
+
+		patterns.push_back (std::string ("\x01\x02\x03", 3));
+
+		for (unsigned k = 0; k < PERF_CHECKS / 10; k++)
+			{
+			std::string	text (500, ' ');
+
+			for (char& c : text)
+				{
+				c = (char) mix (PERF_random);
+				}
+
+			if (!matcher.compile (patterns, blind != 0) || !same_result ("every character", text, patterns, blind != 0, matcher))
+				{
+				return false;
+				}
+			}
+		}
+
+	patterns.assign (2, std::string ("x"));
+	patterns [1].clear ();
+
+	if (matcher.compile (patterns, false) || matcher.compile (std::vector<std::string> (), false))
+		{
+		printf ("matperf: set: an empty pattern or set compiled\n");
+		return false;
+		}
+
+	printf ("  pattern sets verified\n");
+	return true;
+}							// End check_set
+
+
+static
+void
+time_processes											// Time the process name lookup
+	(
+	)
+
+//
+// DESCRIPTION:		Build a snapshot of executable names, then look for one near its end, case-blind, the way
+//					find_process_by_name did with KMP and does with the Matcher. Each snapshot is searched to the name
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::vector<std::string>	names;
+std::string					target = "TRACETARGET.EXE";
+std::vector<int>			table;
+Matcher						matcher;
+uint64_t					start;
+uint64_t					kmp_nsec;
+uint64_t					matcher_nsec;
+size_t						index;
+unsigned					found = 0;
+
+
+	for (unsigned k = 0; k < PERF_PROCESSES; k++)
+		{
+		names.push_back (random_string ("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ", 4 + mix (PERF_random) % 12) + ".exe");
+		}
+
+	names [PERF_PROCESSES - 10] = "TraceTarget.exe";
+	kmp_table (target, table);
+	matcher.compile (target, true);
+
+	start = thread_nsec ();
+
+	for (unsigned i = 0; i < PERF_SNAPSHOTS; i++)
+		{
+		for (const std::string& name : names)
+			{
+			if (kmp_search (name.data (), name.size (), target, table, true, &index))
+				{
+				found++;
+				break;
+				}
+			}
+		}
+
+	kmp_nsec = thread_nsec () - start;
+	start = thread_nsec ();
+
+	for (unsigned i = 0; i < PERF_SNAPSHOTS; i++)
+		{
+		for (const std::string& name : names)
+			{
+			if (matcher.search (name, nullptr))
+				{
+				found++;
+				break;
+				}
+			}
+		}
+
+	matcher_nsec = thread_nsec () - start;
+
+	printf ("  process lookup, %u names: KMP %7.2f us, Matcher %7.2f us (%s)\n", PERF_PROCESSES,
+		kmp_nsec / 1000.0 / PERF_SNAPSHOTS, matcher_nsec / 1000.0 / PERF_SNAPSHOTS,
+		found == 2 * PERF_SNAPSHOTS ? "found" : "NOT FOUND");
+}							// End time_processes
+
+
+static
+void
+time_scan												// Time scans of a large text
+	(
+	)
+
+//
+// DESCRIPTION:		Fill a text with identifiers and spaces, then scan it for a pattern that is not in it, and for a set of API
+//					names that are not in it, with KMP and with the Matcher, exact and case-blind
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::string					text = random_string ("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_ ",
+								(size_t) PERF_options.megabytes << 20);
+std::vector<std::string>	apis (PERF_apis, PERF_apis + PERF_options.patterns);
+std::string					pattern = "CreateFileTransactedW";
+std::vector<int>			table;
+Matcher						matcher;
+uint64_t					start;
+double						bytes = (double) text.size () * PERF_options.rounds;
+size_t						index;
+unsigned					found = 0;
+
+
+	for (int blind = 0; blind < 2; blind++)
+		{
+		kmp_table (pattern, table);
+		matcher.compile (pattern, blind != 0);
+
+		start = thread_nsec ();
+
+		for (unsigned r = 0; r < PERF_options.rounds; r++)
+			{
+			found += kmp_search (text.data (), text.size (), pattern, table, blind != 0, &index);
+			}
+
+		double	kmp_gbps = bytes / (thread_nsec () - start);
+
+		start = thread_nsec ();
+
+		for (unsigned r = 0; r < PERF_options.rounds; r++)
+			{
+			found += matcher.search (text, nullptr);
+			}
+
+		double	matcher_gbps = bytes / (thread_nsec () - start);
+
+		printf ("  1 pattern, %-10s:  KMP %6.2f GB/s, Matcher %6.2f GB/s\n", blind ? "case-blind" : "exact", kmp_gbps, matcher_gbps);
+
+		start = thread_nsec ();
+
+		for (unsigned r = 0; r < PERF_options.rounds; r++)
+			{
+			for (const std::string& api : apis)
+				{
+				kmp_table (api, table);
+				found += kmp_search (text.data (), text.size (), api, table, blind != 0, &index);
+				}
+			}
+
+		kmp_gbps = bytes / (thread_nsec () - start);
+		matcher.compile (apis, blind != 0);
+		start = thread_nsec ();
+
+		for (unsigned r = 0; r < PERF_options.rounds; r++)
+			{
+			found += matcher.search (text, nullptr);
+			}
+
+		matcher_gbps = bytes / (thread_nsec () - start);
+
+		printf ("  %u patterns, %-10s: KMP %6.2f GB/s, Matcher %6.2f GB/s (%u states)\n", PERF_options.patterns,
+			blind ? "case-blind" : "exact", kmp_gbps, matcher_gbps, (unsigned) matcher.states ());
+		}
+
+	if (found != 0)
+		{
+		printf ("  (the random text contained a pattern %u times)\n", found);
+		}
+}							// End time_scan
+
+
+int
+main													// Test and measure the Matcher
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, run the checks, then time the searches
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every check passed
+//		1								One did not, or the options were bad
+//
+
+{
+bool	ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: matperf [-n:rounds] [-m:text MB] [-p:set patterns]\n");
+		return 1;
+		}
+
+	if (PERF_options.rounds == 0 || PERF_options.megabytes == 0 || PERF_options.megabytes > 1024 ||
+		PERF_options.patterns < 2 || PERF_options.patterns > sizeof (PERF_apis) / sizeof (PERF_apis [0]))
+		{
+		printf ("matperf: -n must be at least 1, -m from 1 to 1024, and -p from 2 to %zu\n",
+			sizeof (PERF_apis) / sizeof (PERF_apis [0]));
+		return 1;
+		}
+
+	printf ("matperf: %u rounds over %u MB, %u patterns in the set\n", PERF_options.rounds, PERF_options.megabytes,
+		PERF_options.patterns);
+
+	ok = check_single () && check_set ();
+
+	if (ok)
+		{
+		time_processes ();
+		time_scan ();
+		}
+
+	printf ("matperf: %s\n", ok ? "Matcher verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
@@ -0,0 +1,607 @@
+//
+// FACILITY:	utfperf - Test and measure the UTF-8 and UTF-16 conversions
+//
+// DESCRIPTION:	This program runs Transcode (Transcode.cpp) on Linux. It checks that:
+//
+//					- Random text, with runs of ASCII of every length between characters of 2, 3 and 4 bytes (so that every
+//					  character falls at every position of the 16-character blocks), converts both ways to what a simple
+//					  encoder produces from the code points
+//					- Each kind of invalid UTF-8 (overlong forms, surrogates, code points above U+10FFFF, bytes that cannot
+//					  start a sequence, truncated sequences) and of invalid UTF-16 (unpaired surrogates) stops the conversion at
+//					  the right place, or is replaced by the right number of U+FFFD
+//					- With every output size too small for the text, the conversion stops at the end of a character, having
+//					  written exactly the characters it read, and says so
+//
+//				It then prints the rate, in GB/s of input, at which the old conversions (which widened or truncated each unit
+//				into a string that was resized first, and so were only right for ASCII) and Transcode convert ASCII text, text
+//				that is mostly ASCII, text that is half ASCII, and CJK text. The times are thread CPU time.
+//
+//				Usage: utfperf [-n:rounds] [-m:text MB]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the clocks, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Transcode.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_CHECKS				3000					// Random texts in the checks
+#define	PERF_CAPACITY_CHECKS	200						// Random texts in the output size check
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		rounds;								// Conversions of each text in the timing
+	unsigned		megabytes;							// Size of each text
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+typedef struct _PERF_INVALID_UTF8						// An invalid UTF-8 case
+	{
+	const char		*utf8;								// Input
+	size_t			stop;								// Where a strict conversion stops
+	const char16_t	*replaced;							// What a replacing conversion writes
+	} PERF_INVALID_UTF8, *PPERF_INVALID_UTF8;
+
+typedef struct _PERF_INVALID_UTF16						// An invalid UTF-16 case
+	{
+	const char16_t	*utf16;								// Input
+	size_t			stop;								// Where a strict conversion stops
+	const char		*replaced;							// What a replacing conversion writes
+	} PERF_INVALID_UTF16, *PPERF_INVALID_UTF16;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS	PERF_options = {4, 16};
+
+static const PERF_OPTION	PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.rounds},
+	{'m', &PERF_options.megabytes}
+	};
+
+static uint64_t		PERF_random = 12345;				// Generator state
+
+static const PERF_INVALID_UTF8	PERF_invalid_utf8 [] =
+	{
+	{"\x80", 0, u"\xFFFD"},												// Continuation byte on its own
+	{"\xC0\xAF", 0, u"\xFFFD\xFFFD"},									// Overlong '/' (C0 never starts a sequence)
+	{"\xC1\xBF", 0, u"\xFFFD\xFFFD"},									// Overlong
+	{"\xE0\x80\xAF", 0, u"\xFFFD\xFFFD\xFFFD"},							// Overlong 3-byte form
+	{"\xF0\x80\x80\xAF", 0, u"\xFFFD\xFFFD\xFFFD\xFFFD"},				// Overlong 4-byte form
+	{"\xED\xA0\x80", 0, u"\xFFFD\xFFFD\xFFFD"},							// Encoded high surrogate
+	{"\xED\xBF\xBF", 0, u"\xFFFD\xFFFD\xFFFD"},							// Encoded low surrogate
+	{"\xF4\x90\x80\x80", 0, u"\xFFFD\xFFFD\xFFFD\xFFFD"},				// U+110000
+	{"\xF5\x80\x80\x80", 0, u"\xFFFD\xFFFD\xFFFD\xFFFD"},				// F5 never starts a sequence
+	{"\xFF", 0, u"\xFFFD"},
+	{"a\xE2\x82", 1, u"a\xFFFD"},										// Truncated at the end
+	{"\xE2\x82" "a", 0, u"\xFFFD" "a"},									// Truncated before ASCII
+	{"\xF0\x9F\x98" "x\xF0\x9F\x98\x80", 0, u"\xFFFD" "x\U0001F600"},	// Truncated, then complete
+	{"\xE2\x82\xAC\xC3", 3, u"\x20AC\xFFFD"},							// Complete, then truncated
+	{"abcdefghijklmnopqrst\xFF", 20, u"abcdefghijklmnopqrst\xFFFD"},	// After a block of ASCII
+	{"abcdefghijklmno\xC3\xA9pqrstuvwxyz\xC3", 28, u"abcdefghijklmno\x00E9pqrstuvwxyz\xFFFD"}
+	};
+
+static const PERF_INVALID_UTF16	PERF_invalid_utf16 [] =
+	{
+	{u"\xD800", 0, "\xEF\xBF\xBD"},										// High surrogate at the end
+	{u"\xDC00" "a", 0, "\xEF\xBF\xBD" "a"},								// Low surrogate on its own
+	{u"\xD800\xD800\xDC00", 0, "\xEF\xBF\xBD\xF0\x90\x80\x80"},			// High surrogate, then a pair
+	{u"\xD83D" "a", 0, "\xEF\xBF\xBD" "a"},								// High surrogate before ASCII
+	{u"abcdefghijklmnopqrst\xDFFF", 20, "abcdefghijklmnopqrst\xEF\xBF\xBD"}
+	};
+
+
+
+static
+void
+encode													// Encode code points the simple way
+	(
+	const std::vector<uint32_t>&	Code_points,		// Characters (no surrogates)
+	std::string&					Utf8,				// UTF-8
+	std::u16string&					Utf16				// UTF-16
+	)
+
+//
+// DESCRIPTION:		Encode each code point in UTF-8 and UTF-16
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	Utf8.clear ();
+	Utf16.clear ();
+
+	for (uint32_t cp : Code_points)
+		{
+		if (cp < 0x80)
+			{
+			Utf8 += (char) cp;
+			}
+		else if (cp < 0x800)
+			{
+			Utf8 += (char) (0xC0 | (cp >> 6));
+			Utf8 += (char) (0x80 | (cp & 0x3F));
+			}
+		else if (cp < 0x10000)
+			{
+			Utf8 += (char) (0xE0 | (cp >> 12));
+			Utf8 += (char) (0x80 | ((cp >> 6) & 0x3F));
+			Utf8 += (char) (0x80 | (cp & 0x3F));
+			}
+		else
+			{
+			Utf8 += (char) (0xF0 | (cp >> 18));
+			Utf8 += (char) (0x80 | ((cp >> 12) & 0x3F));
+			Utf8 += (char) (0x80 | ((cp >> 6) & 0x3F));
+			Utf8 += (char) (0x80 | (cp & 0x3F));
+			}
+
+		if (cp < 0x10000)
+			{
+			Utf16 += (char16_t) cp;
+			}
+		else
+			{
+			Utf16 += (char16_t) (0xD800 + ((cp - 0x10000) >> 10));
+			Utf16 += (char16_t) (0xDC00 + ((cp - 0x10000) & 0x3FF));
+			}
+		}
+}							// End encode
+
+
+static
+void
+random_text												// Make random code points
+	(
+	size_t					Characters,					// About how many
+	unsigned				Ascii_percent,				// Share of ASCII runs
+	bool					Cjk,						// If true, the other characters are CJK ideographs
+	std::vector<uint32_t>&	Code_points					// Characters
+	)
+
+//
+// DESCRIPTION:		Alternate runs of 0 to 40 ASCII characters with characters of 2, 3 and 4 bytes, or CJK ideographs (3 bytes).
+//					Ascii_percent is the chance that the next character starts a run of ASCII
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint32_t	cp;
+
+
+	Code_points.clear ();
+
+	while (Code_points.size () < Characters)
+		{
+		if (mix (PERF_random) % 100 < Ascii_percent)
+			{
+			for (size_t run = mix (PERF_random) % 41; run != 0; run--)
+				{
+				Code_points.push_back ((uint32_t) (mix (PERF_random) % 0x80));
+				}
+
+			continue;
+			}
+
+		switch (Cjk ? 3 : mix (PERF_random) % 3)
+			{
+			case 0:		cp = (uint32_t) (0x80 + mix (PERF_random) % (0x800 - 0x80));							break;
+			case 1:		cp = (uint32_t) (0x800 + mix (PERF_random) % (0x10000 - 0x800 - 0x800));
+						cp = cp >= 0xD800 ? cp + 0x800 : cp;										break;
+			case 2:		cp = (uint32_t) (0x10000 + mix (PERF_random) % (0x110000 - 0x10000));					break;
+			default:	cp = (uint32_t) (0x4E00 + mix (PERF_random) % (0xA000 - 0x4E00));						break;
+			}
+
+		Code_points.push_back (cp);
+		}
+}							// End random_text
+
+
+static
+bool
+check_valid												// Convert valid text both ways
+	(
+	)
+
+//
+// DESCRIPTION:		Encode random text the simple way, convert it with Transcode both ways, strictly, into outputs of the largest
+//					size the input can need, and compare
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Passed
+//		false							Failed
+//
+
+{
+std::vector<uint32_t>	code_points;
+std::string				utf8;
+std::u16string			utf16;
+std::vector<char16_t>	out16;
+std::vector<char>		out8;
+TRANSCODE_RESULT		to16;
+TRANSCODE_RESULT		to8;
+
+
+	for (unsigned k = 0; k < PERF_CHECKS; k++)
+		{
+		random_text (mix (PERF_random) % 200, (unsigned) (mix (PERF_random) % 101), false, code_points);
+		encode (code_points, utf8, utf16);
+		out16.assign (TRANSCODE_UTF16_MAX (utf8.size ()) + 1, 0);
+		out8.assign (TRANSCODE_UTF8_MAX (utf16.size ()) + 1, 0);
+		to16 = Transcode::utf8_to_utf16 (utf8.data (), utf8.size (), out16.data (), out16.size () - 1, false);
+		to8 = Transcode::utf16_to_utf8 (utf16.data (), utf16.size (), out8.data (), out8.size () - 1, false);
+
+		if (to16.status != TRANSCODE_OK || to16.read != utf8.size () || to16.written != utf16.size () ||
+			std::u16string (out16.data (), to16.written) != utf16 || to8.status != TRANSCODE_OK ||
+			to8.read != utf16.size () || to8.written != utf8.size () || std::string (out8.data (), to8.written) != utf8)
+			{
+			printf ("utfperf: valid text of %zu characters did not convert\n", code_points.size ());
+			return false;
+			}
+		}
+
+	printf ("  valid text verified\n");
+	return true;
+}							// End check_valid
+
+
+static
+bool
+check_invalid											// Convert each kind of invalid text
+	(
+	)
+
+//
+// DESCRIPTION:		Convert each invalid case strictly, which must stop at the invalid sequence, having written what comes before
+//					the first U+FFFD of the replacing conversion, then replacing, and compare with what is expected
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Passed
+//		false							Failed
+//
+
+{
+char16_t			out16 [64];
+char				out8 [192];
+TRANSCODE_RESULT	result;
+
+
+	for (const PERF_INVALID_UTF8& test : PERF_invalid_utf8)
+		{
+		size_t	length = strlen (test.utf8);
+
+		size_t	written = std::u16string (test.replaced).find (u'\xFFFD');
+
+		result = Transcode::utf8_to_utf16 (test.utf8, length, out16, 64, false);
+
+		if (result.status != TRANSCODE_INVALID || result.read != test.stop || result.written != written)
+			{
+			printf ("utfperf: invalid UTF-8 case %zu: stopped at %zu with status %d\n", &test - PERF_invalid_utf8,
+				result.read, (int) result.status);
+			return false;
+			}
+
+		result = Transcode::utf8_to_utf16 (test.utf8, length, out16, 64, true);
+
+		if (result.status != TRANSCODE_OK || result.read != length || std::u16string (out16, result.written) != test.replaced)
+			{
+			printf ("utfperf: invalid UTF-8 case %zu: wrong replacement\n", &test - PERF_invalid_utf8);
+			return false;
+			}
+		}
+
+	for (const PERF_INVALID_UTF16& test : PERF_invalid_utf16)
+		{
+		size_t	length = std::char_traits<char16_t>::length (test.utf16);
+
+		size_t	written = std::string (test.replaced).find ("\xEF\xBF\xBD");
+
+		result = Transcode::utf16_to_utf8 (test.utf16, length, out8, 192, false);
+
+		if (result.status != TRANSCODE_INVALID || result.read != test.stop || result.written != written)
+			{
+			printf ("utfperf: invalid UTF-16 case %zu: stopped at %zu with status %d\n", &test - PERF_invalid_utf16,
+				result.read, (int) result.status);
+			return false;
+			}
+
+		result = Transcode::utf16_to_utf8 (test.utf16, length, out8, 192, true);
+
+		if (result.status != TRANSCODE_OK || result.read != length || std::string (out8, result.written) != test.replaced)
+			{
+			printf ("utfperf: invalid UTF-16 case %zu: wrong replacement\n", &test - PERF_invalid_utf16);
+			return false;
+			}
+		}
+
+	printf ("  invalid text verified\n");
+	return true;
+}							// End check_invalid
+
+
+static
+bool
+check_capacity											// Convert into outputs that are too small
+	(
+	)
+
+//
+// DESCRIPTION:		For each output size from 0 to what the text needs, convert both ways, and check that the conversion stops at
+//					the end of a character that fits, and that what it wrote is what the characters it read encode to
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Passed
+//		false							Failed
+//
+
+{
+std::vector<uint32_t>	code_points;
+std::string				utf8;
+std::u16string			utf16;
+std::vector<char16_t>	out16;
+std::vector<char>		out8;
+TRANSCODE_RESULT		result;
+
+
+	for (unsigned k = 0; k < PERF_CAPACITY_CHECKS; k++)
+		{
+		random_text (1 + mix (PERF_random) % 60, 50, false, code_points);
+		encode (code_points, utf8, utf16);
+		out16.assign (utf16.size (), 0);
+		out8.assign (utf8.size (), 0);
+
+		for (size_t capacity = 0; capacity <= utf16.size (); capacity++)
+			{
+			result = Transcode::utf8_to_utf16 (utf8.data (), utf8.size (), out16.data (), capacity, false);
+
+			if (result.status != (capacity < utf16.size () ? TRANSCODE_TOO_SMALL : TRANSCODE_OK) ||
+				result.written > capacity || capacity - result.written > 1 ||
+				(result.read < utf8.size () && (utf8 [result.read] & 0xC0) == 0x80) ||
+				std::u16string (out16.data (), result.written) != utf16.substr (0, result.written) ||
+				(result.written < utf16.size () && utf16 [result.written] >= 0xDC00 && utf16 [result.written] <= 0xDFFF))
+				{
+				printf ("utfperf: UTF-16 output of %zu units for %zu: wrong stop\n", capacity, utf16.size ());
+				return false;
+				}
+			}
+
+		for (size_t capacity = 0; capacity <= utf8.size (); capacity++)
+			{
+			result = Transcode::utf16_to_utf8 (utf16.data (), utf16.size (), out8.data (), capacity, false);
+
+			if (result.status != (capacity < utf8.size () ? TRANSCODE_TOO_SMALL : TRANSCODE_OK) ||
+				result.written > capacity || capacity - result.written > 3 ||
+				(result.written < utf8.size () && (utf8 [result.written] & 0xC0) == 0x80) ||
+				std::string (out8.data (), result.written) != utf8.substr (0, result.written) ||
+				(result.read < utf16.size () && utf16 [result.read] >= 0xDC00 && utf16 [result.read] <= 0xDFFF))
+				{
+				printf ("utfperf: UTF-8 output of %zu bytes for %zu: wrong stop\n", capacity, utf8.size ());
+				return false;
+				}
+			}
+		}
+
+	printf ("  output sizes verified\n");
+	return true;
+}							// End check_capacity
+
+
+static
+void
+time_text												// Time both conversions of one kind of text
+	(
+	const char	*Name,									// Kind of text
+	unsigned	Ascii_percent,							// Share of ASCII runs (100 for all ASCII)
+	bool		Cjk										// If true, the other characters are CJK ideographs
+	)
+
+//
+// DESCRIPTION:		Make a text of about PERF_options.megabytes of UTF-8, and time the old and new conversions each way. The old
+//					conversions resize a string and copy each unit into it, as Utils::s_to_u16 and u16_to_s did; Transcode
+//					converts into a buffer allocated once
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::vector<uint32_t>	code_points;
+std::string				utf8;
+std::u16string			utf16;
+std::vector<char16_t>	out16;
+std::vector<char>		out8;
+uint64_t				start;
+uint64_t				sum = 0;
+double					old_8;
+double					new_8;
+double					old_16;
+double					new_16;
+
+
+	random_text (((size_t) PERF_options.megabytes << 20) / (Ascii_percent == 100 ? 1 : 3), Ascii_percent, Cjk, code_points);
+	encode (code_points, utf8, utf16);
+	out16.resize (TRANSCODE_UTF16_MAX (utf8.size ()));
+	out8.resize (TRANSCODE_UTF8_MAX (utf16.size ()));
+
+	start = thread_nsec ();
+
+	for (unsigned r = 0; r < PERF_options.rounds; r++)
+		{
+		std::u16string	result;
+
+		result.resize (utf8.size ());
+
+		for (size_t i = 0; i < utf8.size (); i++)
+			{
+			result [i] = utf8 [i];
+			}
+
+		sum += result [result.size () - 1];
+		}
+
+	old_8 = (double) utf8.size () * PERF_options.rounds / (thread_nsec () - start);
+	start = thread_nsec ();
+
+	for (unsigned r = 0; r < PERF_options.rounds; r++)
+		{
+		sum += Transcode::utf8_to_utf16 (utf8.data (), utf8.size (), out16.data (), out16.size (), true).written;
+		}
+
+	new_8 = (double) utf8.size () * PERF_options.rounds / (thread_nsec () - start);
+	start = thread_nsec ();
+
+	for (unsigned r = 0; r < PERF_options.rounds; r++)
+		{
+		std::string	result;
+
+		result.resize (utf16.size ());
+
+		for (size_t i = 0; i < utf16.size (); i++)
+			{
+			result [i] = (char) utf16 [i];
+			}
+
+		sum += (uint8_t) result [result.size () - 1];
+		}
+
+	old_16 = (double) utf16.size () * 2 * PERF_options.rounds / (thread_nsec () - start);
+	start = thread_nsec ();
+
+	for (unsigned r = 0; r < PERF_options.rounds; r++)
+		{
+		sum += Transcode::utf16_to_utf8 (utf16.data (), utf16.size (), out8.data (), out8.size (), true).written;
+		}
+
+	new_16 = (double) utf16.size () * 2 * PERF_options.rounds / (thread_nsec () - start);
+
+	printf ("  %-12s UTF-8 to 16: old %6.2f GB/s, Transcode %6.2f GB/s;  UTF-16 to 8: old %6.2f GB/s, Transcode %6.2f GB/s%s\n",
+		Name, old_8, new_8, old_16, new_16, sum == 0 ? " " : "");
+}							// End time_text
+
+
+int
+main													// Test and measure the UTF-8 and UTF-16 conversions
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, run the checks, then time the conversions
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every check passed
+//		1								One did not, or the options were bad
+//
+
+{
+bool	ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: utfperf [-n:rounds] [-m:text MB]\n");
+		return 1;
+		}
+
+	if (PERF_options.rounds == 0 || PERF_options.megabytes == 0 || PERF_options.megabytes > 1024)
+		{
+		printf ("utfperf: -n must be at least 1, and -m from 1 to 1024\n");
+		return 1;
+		}
+
+	printf ("utfperf: %u rounds over %u MB\n", PERF_options.rounds, PERF_options.megabytes);
+
+	ok = check_valid () && check_invalid () && check_capacity ();
+
+	if (ok)
+		{
+		time_text ("ASCII", 100, false);
+		time_text ("mostly ASCII", 97, false);
+		time_text ("mixed", 50, false);
+		time_text ("CJK", 0, true);
+		}
+
+	printf ("utfperf: %s\n", ok ? "Transcode verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
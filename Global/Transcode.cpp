@@ -0,0 +1,445 @@
+//
+// FACILITY:	Transcode - UTF-8 and UTF-16 conversion
+//
+// DESCRIPTION:	This module contains the implementation of the Transcode class.
+//
+//				Each conversion is a loop over characters. Where SSE2 is available, each pass of the loop first tries to convert
+//				16 ASCII characters at once: it loads 16 input units, stores them converted (widened with unpack, or narrowed
+//				with a saturating pack), and advances over the ASCII characters at the start of them, which movemask finds. The
+//				stores may write past the ASCII characters, but only into room the output has, and the characters that follow
+//				overwrite them. The first character that is not ASCII is then converted one at a time, with the validation, and
+//				the loop goes back to the 16-character path if the next character is ASCII, so text without ASCII does not
+//				pay for the 16-character path at every character
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define	TRANSCODE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//
+// Project includes
+//
+
+#include "Transcode.h"
+
+using namespace FDI;
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+inline
+uint32_t
+lowest_bit												// Index of the lowest set bit
+	(
+	uint32_t	Mask									// Nonzero mask
+	);
+
+
+
+TRANSCODE_RESULT
+Transcode::utf8_to_utf16								// Convert UTF-8 to UTF-16
+	(
+	_In_reads_(Length)		const char		*Utf8,		// UTF-8 to convert
+	_In_					size_t			Length,		// Bytes of UTF-8
+	_Out_writes_(Capacity)	char16_t		*Utf16,		// Where the UTF-16 goes
+	_In_					size_t			Capacity,	// Units of UTF-16 that fit
+	_In_					bool			Replace		// If true, replace invalid sequences with U+FFFD
+	)
+
+//
+// DESCRIPTION:		Decode each character, checking its lead byte and the range each continuation byte must be in. The second byte
+//					has a narrower range after E0 (no overlong forms), ED (no surrogates), F0 (no overlong forms) and F4 (nothing
+//					above U+10FFFF); C0, C1 and F5 - FF are never valid. An invalid sequence is the lead byte and the continuation
+//					bytes that were in range before the one that was not, or a single byte that cannot start a sequence.
+//					Characters above U+FFFF become a surrogate pair
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Status, and the units read and written
+//
+
+{
+TRANSCODE_RESULT	result = {TRANSCODE_OK, 0, 0, 0};
+const uint8_t		*in = (const uint8_t *) Utf8;
+size_t				i = 0;
+size_t				o = 0;
+size_t				need;
+size_t				k;
+uint32_t			cp;
+uint8_t				lead;
+uint8_t				low;
+uint8_t				high;
+
+
+	while (i < Length)
+		{
+
+#ifdef TRANSCODE_SSE2
+		while (i + 16 <= Length && o + 16 <= Capacity && in [i] < 0x80)
+			{
+			__m128i		bytes = _mm_loadu_si128 ((const __m128i *) (in + i));
+			uint32_t	mask = (uint32_t) _mm_movemask_epi8 (bytes);
+
+			_mm_storeu_si128 ((__m128i *) (Utf16 + o), _mm_unpacklo_epi8 (bytes, _mm_setzero_si128 ()));
+			_mm_storeu_si128 ((__m128i *) (Utf16 + o + 8), _mm_unpackhi_epi8 (bytes, _mm_setzero_si128 ()));
+
+			if (mask != 0)
+				{
+				i += lowest_bit (mask);
+				o += lowest_bit (mask);
+				break;
+				}
+
+			i += 16;
+			o += 16;
+			}
+
+		if (i >= Length)
+			{
+			break;
+			}
+#endif
+
+		lead = in [i];
+
+		if (lead < 0x80)
+			{
+			if (o >= Capacity)
+				{
+				result.status = TRANSCODE_TOO_SMALL;
+				break;
+				}
+
+			Utf16 [o++] = lead;
+			i++;
+			continue;
+			}
+
+		//
+		// Most characters that are not ASCII are 2 or 3 bytes from leads whose continuation bytes have the full range,
+		// so try those before the general case
+		//
+
+		if (o < Capacity && i + 2 < Length && (in [i + 1] & 0xC0) == 0x80)
+			{
+			if (lead >= 0xC2 && lead <= 0xDF)
+				{
+				Utf16 [o++] = (char16_t) (((lead & 0x1F) << 6) | (in [i + 1] & 0x3F));
+				i += 2;
+				continue;
+				}
+
+			if (lead >= 0xE1 && lead <= 0xEF && lead != 0xED && (in [i + 2] & 0xC0) == 0x80)
+				{
+				Utf16 [o++] = (char16_t) (((lead & 0x0F) << 12) | ((in [i + 1] & 0x3F) << 6) | (in [i + 2] & 0x3F));
+				i += 3;
+				continue;
+				}
+			}
+
+		//
+		// Find the length of the sequence, and the range of its second byte
+		//
+
+		need = 0;
+		cp = 0;
+		low = 0x80;
+		high = 0xBF;
+
+		if (lead >= 0xC2 && lead <= 0xDF)
+			{
+			need = 1;
+			cp = lead & 0x1F;
+			}
+		else if (lead >= 0xE0 && lead <= 0xEF)
+			{
+			need = 2;
+			cp = lead & 0x0F;
+			low = lead == 0xE0 ? 0xA0 : 0x80;
+			high = lead == 0xED ? 0x9F : 0xBF;
+			}
+		else if (lead >= 0xF0 && lead <= 0xF4)
+			{
+			need = 3;
+			cp = lead & 0x07;
+			low = lead == 0xF0 ? 0x90 : 0x80;
+			high = lead == 0xF4 ? 0x8F : 0xBF;
+			}
+
+		for (k = 0; k < need; k++)
+			{
+			if (i + 1 + k >= Length || in [i + 1 + k] < low || in [i + 1 + k] > high)
+				{
+				break;
+				}
+
+			cp = (cp << 6) | (in [i + 1 + k] & 0x3F);
+			low = 0x80;
+			high = 0xBF;
+			}
+
+		if (need == 0 || k < need)
+			{
+			if (!Replace)
+				{
+				result.status = TRANSCODE_INVALID;
+				break;
+				}
+
+			if (o >= Capacity)
+				{
+				result.status = TRANSCODE_TOO_SMALL;
+				break;
+				}
+
+			Utf16 [o++] = TRANSCODE_REPLACEMENT;
+			result.replaced++;
+			i += 1 + k;
+			continue;
+			}
+
+		if (o + (cp >= 0x10000 ? 2 : 1) > Capacity)
+			{
+			result.status = TRANSCODE_TOO_SMALL;
+			break;
+			}
+
+		if (cp >= 0x10000)
+			{
+			cp -= 0x10000;
+			Utf16 [o++] = (char16_t) (0xD800 + (cp >> 10));
+			Utf16 [o++] = (char16_t) (0xDC00 + (cp & 0x3FF));
+			}
+		else
+			{
+			Utf16 [o++] = (char16_t) cp;
+			}
+
+		i += 1 + need;
+		}
+
+	result.read = i;
+	result.written = o;
+	return result;
+}							// End routine Transcode::utf8_to_utf16
+
+
+TRANSCODE_RESULT
+Transcode::utf16_to_utf8								// Convert UTF-16 to UTF-8
+	(
+	_In_reads_(Length)		const char16_t	*Utf16,		// UTF-16 to convert
+	_In_					size_t			Length,		// Units of UTF-16
+	_Out_writes_(Capacity)	char			*Utf8,		// Where the UTF-8 goes
+	_In_					size_t			Capacity,	// Bytes of UTF-8 that fit
+	_In_					bool			Replace		// If true, replace unpaired surrogates with U+FFFD
+	)
+
+//
+// DESCRIPTION:		Encode each character in 1 to 3 bytes, or a surrogate pair in 4. A high surrogate that is not followed by a low
+//					surrogate, or a low surrogate on its own, is invalid
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Status, and the units read and written
+//
+
+{
+TRANSCODE_RESULT	result = {TRANSCODE_OK, 0, 0, 0};
+uint8_t				*out = (uint8_t *) Utf8;
+size_t				i = 0;
+size_t				o = 0;
+uint32_t			cp;
+size_t				units;
+
+
+	while (i < Length)
+		{
+
+#ifdef TRANSCODE_SSE2
+		while (i + 16 <= Length && o + 16 <= Capacity && Utf16 [i] < 0x80)
+			{
+			const __m128i	not_ascii = _mm_set1_epi16 ((short) 0xFF80);
+			__m128i			first = _mm_loadu_si128 ((const __m128i *) (Utf16 + i));
+			__m128i			second = _mm_loadu_si128 ((const __m128i *) (Utf16 + i + 8));
+			__m128i			ascii_first = _mm_cmpeq_epi16 (_mm_and_si128 (first, not_ascii), _mm_setzero_si128 ());
+			__m128i			ascii_second = _mm_cmpeq_epi16 (_mm_and_si128 (second, not_ascii), _mm_setzero_si128 ());
+			uint32_t		mask = (uint32_t) _mm_movemask_epi8 (_mm_packs_epi16 (ascii_first, ascii_second));
+
+			_mm_storeu_si128 ((__m128i *) (out + o), _mm_packus_epi16 (first, second));
+
+			if (mask != 0xFFFF)
+				{
+				i += lowest_bit (~mask);
+				o += lowest_bit (~mask);
+				break;
+				}
+
+			i += 16;
+			o += 16;
+			}
+
+		if (i >= Length)
+			{
+			break;
+			}
+#endif
+
+		cp = Utf16 [i];
+		units = 1;
+
+		//
+		// Most characters that are not ASCII take 2 or 3 bytes, and are not surrogates, so try those before the general case
+		//
+
+		if (cp >= 0x80 && (cp < 0xD800 || cp >= 0xE000) && o + 3 <= Capacity)
+			{
+			do
+				{
+				if (cp < 0x800)
+					{
+					out [o] = (uint8_t) (0xC0 | (cp >> 6));
+					out [o + 1] = (uint8_t) (0x80 | (cp & 0x3F));
+					o += 2;
+					}
+				else
+					{
+					out [o] = (uint8_t) (0xE0 | (cp >> 12));
+					out [o + 1] = (uint8_t) (0x80 | ((cp >> 6) & 0x3F));
+					out [o + 2] = (uint8_t) (0x80 | (cp & 0x3F));
+					o += 3;
+					}
+
+				if (++i >= Length)
+					{
+					break;
+					}
+
+				cp = Utf16 [i];
+				}
+			while (cp >= 0x80 && (cp < 0xD800 || cp >= 0xE000) && o + 3 <= Capacity);
+
+			continue;
+			}
+
+		if (cp >= 0xD800 && cp <= 0xDFFF)
+			{
+			if (cp <= 0xDBFF && i + 1 < Length && Utf16 [i + 1] >= 0xDC00 && Utf16 [i + 1] <= 0xDFFF)
+				{
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (Utf16 [i + 1] - 0xDC00);
+				units = 2;
+				}
+			else if (!Replace)
+				{
+				result.status = TRANSCODE_INVALID;
+				break;
+				}
+			else
+				{
+				cp = TRANSCODE_REPLACEMENT;
+				result.replaced++;
+				}
+			}
+
+		if (o + (cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4) > Capacity)
+			{
+			result.status = TRANSCODE_TOO_SMALL;
+			break;
+			}
+
+		if (cp < 0x80)
+			{
+			out [o++] = (uint8_t) cp;
+			}
+		else if (cp < 0x800)
+			{
+			out [o++] = (uint8_t) (0xC0 | (cp >> 6));
+			out [o++] = (uint8_t) (0x80 | (cp & 0x3F));
+			}
+		else if (cp < 0x10000)
+			{
+			out [o++] = (uint8_t) (0xE0 | (cp >> 12));
+			out [o++] = (uint8_t) (0x80 | ((cp >> 6) & 0x3F));
+			out [o++] = (uint8_t) (0x80 | (cp & 0x3F));
+			}
+		else
+			{
+			out [o++] = (uint8_t) (0xF0 | (cp >> 18));
+			out [o++] = (uint8_t) (0x80 | ((cp >> 12) & 0x3F));
+			out [o++] = (uint8_t) (0x80 | ((cp >> 6) & 0x3F));
+			out [o++] = (uint8_t) (0x80 | (cp & 0x3F));
+			}
+
+		i += units;
+		}
+
+	result.read = i;
+	result.written = o;
+	return result;
+}							// End routine Transcode::utf16_to_utf8
+
+
+static
+inline
+uint32_t
+lowest_bit												// Index of the lowest set bit
+	(
+	uint32_t	Mask									// Nonzero mask
+	)
+
+//
+// DESCRIPTION:		Count the trailing zero bits
+//
+// ASSUMPTIONS:		Mask is not 0
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Bit number
+//
+
+{
+#ifdef _MSC_VER
+unsigned long	index;
+
+
+	_BitScanForward (&index, Mask);
+	return index;
+#else
+	return (uint32_t) __builtin_ctz (Mask);
+#endif
+}							// End routine lowest_bit
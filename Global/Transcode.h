@@ -0,0 +1,120 @@
+//
+// FACILITY:	Transcode - UTF-8 and UTF-16 conversion
+//
+// DESCRIPTION:	The Transcode class converts between UTF-8 and UTF-16, into buffers supplied by the caller, so a conversion never
+//				allocates. The input is validated: in UTF-8, overlong forms, encoded surrogates, code points above U+10FFFF and
+//				truncated or stray sequences are invalid, and in UTF-16, unpaired surrogates are invalid. An invalid sequence
+//				either stops the conversion, or is replaced by U+FFFD (as MultiByteToWideChar does), one U+FFFD for each maximal
+//				part of a sequence that could have been valid, as the Unicode standard recommends.
+//
+//				Runs of ASCII, which is most of what this project converts (executable names, paths, API names), are converted
+//				16 characters at a time with SSE2 where it is available.
+//
+//				Output sizes are bounded by the input: UTF-16 never needs more units than the UTF-8 had bytes
+//				(TRANSCODE_UTF16_MAX), and UTF-8 never needs more than 3 bytes per UTF-16 unit (TRANSCODE_UTF8_MAX), so a
+//				buffer of that size is always large enough. A conversion may change the output past the units it reports as
+//				written.
+//
+//				This module uses only standard C++ (plus SSE2 intrinsics where they are available), so that it can be built and
+//				tested on Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux build
+#define	_In_
+#define	_In_reads_(x)
+#define	_Out_writes_(x)
+#endif
+
+#define	TRANSCODE_UTF16_MAX(Utf8_bytes)		(Utf8_bytes)			// Most UTF-16 units needed for UTF-8
+#define	TRANSCODE_UTF8_MAX(Utf16_units)		((Utf16_units) * 3)		// Most UTF-8 bytes needed for UTF-16
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TRANSCODE_REPLACEMENT	0xFFFD					// Replaces each invalid sequence
+
+//
+// TYPES:
+//
+
+typedef enum _TRANSCODE_STATUS
+	{
+	TRANSCODE_OK,										// Everything was converted
+	TRANSCODE_INVALID,									// Stopped at an invalid sequence (only without Replace)
+	TRANSCODE_TOO_SMALL									// Stopped at a character that did not fit in the output
+	} TRANSCODE_STATUS;
+
+typedef struct _TRANSCODE_RESULT
+	{
+	TRANSCODE_STATUS	status;							// Why the conversion stopped
+	size_t				read;							// Input units converted (where the invalid sequence or the character
+														// that did not fit starts)
+	size_t				written;						// Output units written
+	size_t				replaced;						// Invalid sequences replaced by U+FFFD
+	} TRANSCODE_RESULT, *PTRANSCODE_RESULT;
+
+//
+// DECLARATIONS:
+//
+
+class Transcode
+{
+public:
+
+	static
+	TRANSCODE_RESULT
+	utf8_to_utf16										// Convert UTF-8 to UTF-16
+		(
+		_In_reads_(Length)		const char		*Utf8,		// UTF-8 to convert
+		_In_					size_t			Length,		// Bytes of UTF-8
+		_Out_writes_(Capacity)	char16_t		*Utf16,		// Where the UTF-16 goes
+		_In_					size_t			Capacity,	// Units of UTF-16 that fit
+		_In_					bool			Replace		// If true, replace invalid sequences with U+FFFD
+		);
+
+	static
+	TRANSCODE_RESULT
+	utf16_to_utf8										// Convert UTF-16 to UTF-8
+		(
+		_In_reads_(Length)		const char16_t	*Utf16,		// UTF-16 to convert
+		_In_					size_t			Length,		// Units of UTF-16
+		_Out_writes_(Capacity)	char			*Utf8,		// Where the UTF-8 goes
+		_In_					size_t			Capacity,	// Bytes of UTF-8 that fit
+		_In_					bool			Replace		// If true, replace unpaired surrogates with U+FFFD
+		);
+
+};	// End class Transcode
+
+}	// End of namespace FDI
@@ -4,7 +4,7 @@
 //
 // DESCRIPTION:	This module contains the implementation of the Utils class, which contains generic support routines
 //
-// VERSION:		1.3
+// VERSION:		1.9
 //
 // AUTHOR:		Brian Catlin
 //
@@ -12,6 +12,26 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.9		2026-10-17	Brian Catlin
+//			hash_file maps the file with MappedFile. open_and_map_file returns the whole size of a file of 4GB or more,
+//			and closes its handles when it fails
+//
+//	1.8		2026-10-17	Brian Catlin
+//			hash_data hashes with Hasher instead of opening a BCrypt provider for each buffer. Added hash_file
+//
+//	1.7		2026-10-17	Brian Catlin
+//			The string conversions convert between UTF-8 and UTF-16 with Transcode, instead of truncating or widening each
+//			character. find_process_by_name converts each executable name into a buffer on the stack
+//
+//	1.6		2026-10-17	Brian Catlin
+//			dump formats its lines with HexDump
+//
+//	1.5		2026-10-17	Brian Catlin
+//			find_process_by_name uses a compiled Matcher instead of KMP
+//
+//	1.4		2026-10-17	Brian Catlin
+//			Added registry_read_multi_wstring
+//
 //	1.3		2019-06-23	Brian Catlin
 //			Added ANSI_STRING and UNICODE_STRING case-blind compare routines
 //
@@ -52,6 +72,11 @@
 //
 
 #include "Utils.h"
+#include "Hasher.h"
+#include "HexDump.h"
+#include "MappedFile.h"
+#include "Matcher.h"
+#include "Transcode.h"
 #include "WPP_Tracing.h"
 
 #include "Utils.tmh"									// Created by TraceWPP
@@ -63,7 +88,8 @@ using namespace FDI;
 //
 
 const std::wstring		APP_REGISTRY_PARAMETERS	= L"Software\\FiveDirections\\Detours\\TraceAPI";
-constexpr static CHAR	UTILS_nibble_to_hex [] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+static_assert (sizeof (wchar_t) == sizeof (char16_t), "A wstring holds UTF-16");
 
 //
 // MACROS:
@@ -772,7 +798,8 @@ Utils::dump												// Dump a buffer (in hex) to the console
 
 //
 //
-// DESCRIPTION:		Dump the buffer to the console, in the proper little-endian format.
+// DESCRIPTION:		Dump the buffer to the console, in the proper little-endian format. The lines are formatted by HexDump, which
+//					can also dump to other sinks, and in pieces
 //
 // ASSUMPTIONS:		User mode
 //
@@ -782,171 +809,18 @@ Utils::dump												// Dump a buffer (in hex) to the console
 //
 
 {
-ULONG		i;
-ULONG		chars_per_byte;
-PUCHAR		buffer = (PUCHAR) Address;
-ULONG		overhead;
-ULONG		bytes_per_line;
-ULONG		num_groups;
-ULONG		offset_index;
-ULONG		ascii_index;
-PUCHAR		line;
-ULONG		bytes_this_line;
-ULONG		j;
-ULONG		cur;
-ULONG		num_lines;
-ULONG		group_size;
-ULONG		first_hex_index;
-ULONG		next_column;
+HexDump			formatter;
+HEXDUMP_OPTIONS	options = {Line_width, Base_disp_addr, Show_offset, Show_ascii};
+HEXDUMP_SINK	sink = {HexDump::file_sink, stdout};
 
 
 	TRACE_ENTER ();
 
-	//
-	// Calculate how many bytes can be dumped per line.  A line consists of: some number of longword groups, separated by spaces, optionally the 
-	// offset into the buffer, and optionally the ASCII representation of each of the bytes in the longwords.
-	//
-
-	if (Show_offset)
+	if (!formatter.start (options, sink) || !formatter.write (Address, Length) || !formatter.finish ())
 		{
-		overhead = 3 + 8;								// 3 spaces + 8 characters for the offset value
+		printf ("Error dumping %d bytes with a line width of %d\n", (int) Length, (int) Line_width);
 		}
-	else
-		{
-		overhead = 0;									// Without the offset, there isn't any fixed overhead
-		}
-
-	if (Show_ascii)
-		{
-		chars_per_byte = 3;								// 2 hex characters per byte + 1 ASCII character per byte
-		overhead = overhead + 1;						// Space before the ASCII
-		}
-	else
-		{
-		chars_per_byte = 2;								// 2 hex characters per byte
-		}
-
-	group_size = 8 + 1;									// 8 characters per longword + 1 space
-	num_groups = (Line_width - overhead) / ((chars_per_byte * 4) + 1);
-	bytes_per_line = num_groups * 4;					// num_groups * 4 bytes per group
-	first_hex_index = (num_groups * group_size);
-	next_column = first_hex_index;
-
-	if (Show_offset)
-		{
-		offset_index = next_column + 3;					// Calculate where the offset appears on the line
-		next_column = offset_index + 8;					// 8 hex characters in offset
-		}
-	else
-		{
-		offset_index = 0;
-		}
-
-	if (Show_ascii)
-		{
-		ascii_index = next_column + 1;					// Space before ASCII
-		}
-	else
-		{
-		ascii_index = 0;
-		}
-
-	//
-	// Allocate the line buffer
-	//
 
-	if ((line = (PUCHAR) malloc (Line_width)) != 0)
-		{
-
-		//
-		// Walk through the buffer one line at a time
-		//
-
-		num_lines = ((Length + bytes_per_line - 1) / bytes_per_line);
-
-		for (i = 0; i < num_lines; i++)
-			{
-			bytes_this_line = Length - (i * bytes_per_line);
-
-			if (bytes_this_line > bytes_per_line)
-				{
-				bytes_this_line = bytes_per_line;
-				}
-
-			//
-			// Erase the line
-			//
-
-			memset (line, ' ', Line_width);
-
-			//
-			// Write the current offset
-			//
-
-			if (Show_offset)
-				{
-				sprintf_s ((char *) &line [offset_index], 9, "%08X", i * bytes_per_line + Base_disp_addr);
-				line [offset_index + 8] = ' ';		// sprintf_s zero-terminates the buffer; replace the zero with space
-				}
-
-			cur = first_hex_index;
-
-			//
-			// Display the bytes on the current line
-			//
-
-			for (j = 0; j < bytes_this_line; j++)
-				{
-
-				if ((j % 4) == 0)
-					{
-					cur = cur - 1;
-					}
-
-				//
-				// Write the little-endian hex representation of the byte
-				//
-
-				line [cur] = UTILS_nibble_to_hex [(buffer [(i * bytes_per_line) + j] >> 0) & 0xf];
-				cur = cur - 1;
-				line [cur] = UTILS_nibble_to_hex [(buffer [(i * bytes_per_line) + j] >> 4) & 0xf];
-				cur = cur - 1;
-
-				//
-				// Write the ASCII representation of the byte
-				//
-
-				if (Show_ascii)
-					{
-
-					if (isprint (buffer [(i * bytes_per_line) + j]))
-						{
-						line [ascii_index + j] = buffer [(i * bytes_per_line) + j];
-						}
-					else
-						{
-						line [ascii_index + j] = '.';
-						}
-
-					}
-
-				}	// End for j
-
-			printf ("%.*s\n", Line_width-1, line);
-			}	// End for i
-
-		}
-	else
-		{
-
-		//
-		// Couldn't allocate line buffer
-		//
-
-		printf ("Error allocating %d bytes for line buffer\n", (int) Line_width);
-		}
-
-	free (line);
 	TRACE_EXIT ();
 }							// End of function Utils::dump
 
@@ -1063,17 +937,19 @@ Utils::find_process_by_name								// Lookup a process given its executable name
 NTSTATUS		status = STATUS_NOT_FOUND;
 PROCESSENTRY32	proc_info = {0};
 HANDLE			proc_snapshot;
-std::string		pattern = ws_to_s (Process_exe);
-PINT			lookup_table;
+Matcher			matcher;
+char			name [TRANSCODE_UTF8_MAX (MAX_PATH)];
+size_t			name_length;
 
 
 	TRACE_ENTER ();
 
 	//
-	// Compute the KMP lookup table to speed up the search
+	// Compile the name once, folded to upper case, so that each executable name is searched in a single pass without
+	// upcasing either string
 	//
 
-	if (SUCCESS (status = kmp_compute_lookup_table (pattern, &lookup_table)))
+	if (matcher.compile (ws_to_s (Process_exe), true))
 		{
 
 		//
@@ -1093,14 +969,15 @@ PINT			lookup_table;
 
 			do
 				{
-				std::string	text = ws_to_s (std::wstring (proc_info.szExeFile));
-
 
 				//
 				// Does the name of the executable match what we're looking for?
 				//
 
-				if (SUCCESS (status = kmp_search (text, pattern, lookup_table, true, nullptr)))
+				name_length = Transcode::utf16_to_utf8 ((const char16_t *) proc_info.szExeFile,
+					wcsnlen (proc_info.szExeFile, MAX_PATH), name, sizeof (name), true).written;
+
+				if (matcher.search (name, name_length, nullptr))
 					{
 					TRACE_VERBOSE (UTILS, "Found process ID %08x for executable name %S", proc_info.th32ProcessID, Process_exe.c_str ());
 					status = STATUS_SUCCESS;
@@ -1118,15 +995,11 @@ PINT			lookup_table;
 			TRACE_ERROR (UTILS, "Error getting process snapshot, status = %!STATUS!", status);
 			}
 
-		//
-		// Free the lookup table
-		//
-
-		delete [] lookup_table;
 		}
 	else
 		{
-		TRACE_ERROR (UTILS, "Error computing KMP lookup table, status = %!STATUS!", status);
+		TRACE_ERROR (UTILS, "Error compiling the executable name %S", Process_exe.c_str ());
+		status = STATUS_INVALID_PARAMETER;
 		}
 
 	TRACE_EXIT ();
@@ -1238,7 +1111,8 @@ Utils::hash_data											// Calculate the hash for a buffer
 	)
 
 //
-// DESCRIPTION:		Hash the data starting at the specified address, for the specified length
+// DESCRIPTION:		Hash the data starting at the specified address, for the specified length, with SHA-256. The hash is returned
+//					in a buffer allocated from the process heap, which the caller frees with HeapFree
 //
 // ASSUMPTIONS:		User mode
 //
@@ -1247,160 +1121,100 @@ Utils::hash_data											// Calculate the hash for a buffer
 // RETURN VALUES:
 //
 //	STATUS_SUCCESS			Normal, successful completion
+//	STATUS_NO_MEMORY		The buffer for the hash could not be allocated
 //
 
 {
-NTSTATUS			status;
-BCRYPT_ALG_HANDLE	algorithm_handle;
-DWORD				hash_object_size;
-DWORD				bytes_written;
-PBYTE				hash_object;
-DWORD				hash_size;
-PBYTE				hash_buffer;
-BCRYPT_HASH_HANDLE	hash_object_handle;
+NTSTATUS	status;
+PBYTE		hash_buffer;
 
 
 	TRACE_ENTER ();
 
 	//
-	// Get a handle to the algorithm
+	// Allocate a buffer to hold the hash, and hash the data into it
 	//
 
-	if (SUCCESS (status = BCryptOpenAlgorithmProvider (&algorithm_handle, HASH_ALGORITHM, NULL, 0)))
+	if ((hash_buffer = (PBYTE) HeapAlloc (GetProcessHeap (), 0, HASHER_SHA256_BYTES)) != 0)
 		{
+		*Hash_size = (ULONG) Hasher::hash (HASHER_SHA256, Data, Length, hash_buffer);
+		*Hash = hash_buffer;
+		status = STATUS_SUCCESS;
+		}
+	else
+		{
+		status = STATUS_NO_MEMORY;
+		TRACE_ERROR (UTILS, "Error allocating %d bytes for the hash, status = %!STATUS!", HASHER_SHA256_BYTES, status);
+		}
 
-		//
-		// Find out how big the buffer needs to be to hold the hash object
-		//
-
-		if (SUCCESS (status = BCryptGetProperty (algorithm_handle,  BCRYPT_OBJECT_LENGTH, (PBYTE) &hash_object_size, sizeof (hash_object_size), &bytes_written, 0)))
-			{
-
-			//
-			// Allocate space for the hash object on the heap
-			//
-
-			if ((hash_object = (PBYTE) HeapAlloc (GetProcessHeap (), 0, hash_object_size)) != 0)
-				{
-
-				//
-				// Create the hash object
-				//
-
-				if (SUCCESS (status = BCryptCreateHash (algorithm_handle, &hash_object_handle, hash_object, hash_object_size, NULL, 0, 0)))
-					{
-
-					//
-					// Get the size of the hash
-					//
-
-					if (SUCCESS (status = BCryptGetProperty (algorithm_handle, BCRYPT_HASH_LENGTH, (PUCHAR) &hash_size, sizeof (hash_size), &bytes_written, 0)))
-						{
-
-						//
-						// Allocate a buffer to hold the hash
-						//
-
-						if ((hash_buffer = (PBYTE) HeapAlloc (GetProcessHeap (), 0, hash_size)) != 0)
-							{
-
-							//
-							// Calculate the hash of the buffer
-							//
-
-							if (SUCCESS (status = BCryptHashData (hash_object, (PUCHAR) Data, Length, 0)))
-								{
-
-								//
-								// Read the hash from the hash object
-								//
-
-								if (SUCCESS (status = BCryptFinishHash (hash_object, hash_buffer, hash_size, 0)))
-									{
-
-									//
-									// Return the hash
-									//
-
-									*Hash = hash_buffer;
-									*Hash_size = hash_size;
-									status = STATUS_SUCCESS;
-
-									//
-									// Cleanup
-									//
-
-									if (!SUCCESS (status = BCryptDestroyHash (hash_object_handle)))
-										{
-										TRACE_ERROR (UTILS, "Error destroying hash, status = %!STATUS!", status);
-										}
-
-									if (!HeapFree (GetProcessHeap (), 0, hash_object))
-										{
-										status = GetLastError ();
-										TRACE_ERROR (UTILS, "Error freeing hash object buffer, status = %!STATUS!", status);
-										}
+	TRACE_EXIT ();
+	return status;
+}							// End of Utils::hash_data
 
-									if (!SUCCESS (status = BCryptCloseAlgorithmProvider (algorithm_handle, 0)))
-										{
-										TRACE_ERROR (UTILS, "Error closing algorithm provider, status = %!STATUS!", status);
-										}
 
-									}
-								else
-									{
-									TRACE_ERROR (UTILS, "Error reading the hash from the hash object, status = %!STATUS!", status);
-									}
+NTSTATUS
+Utils::hash_file											// Calculate the tree hash of a file
+	(
+	_In_	const std::wstring&	File_name,					// File to hash
+	_In_	HASHER_MODE			Mode,						// Hash to compute
+	_Out_writes_bytes_(HASHER_MAX_DIGEST)
+	PBYTE						Digest,						// Receives the digest
+	_Out_	ULONG				*Digest_size				// Size of the digest
+	)
 
-								}
-							else
-								{
+//
+// DESCRIPTION:		Map the whole file with MappedFile, and hash it with Hasher::tree, in chunks of HASHER_TREE_CHUNK on one
+//					thread per processor. The digest is not the plain hash of the file's bytes (see Hasher.h)
+//
+// ASSUMPTIONS:		User mode. The file is not truncated while it is being hashed (reading a page that is no longer in the file
+//					raises an exception on a worker thread)
+//
+// SIDE EFFECTS:	Creates threads, and waits for them to exit
+//
+// RETURN VALUES:
+//
+//	STATUS_SUCCESS			Normal, successful completion
+//	STATUS_NO_MEMORY		The chunk digests could not be allocated
+//	Return status from MappedFile (GetLastError)
+//
 
-								TRACE_ERROR (UTILS, "Error hashing the buffer, status = %!STATUS!", status);
-								}
+{
+NTSTATUS		status;
+MappedFile		file;
+const uint8_t	*bytes;
 
-							}
-						else
-							{
-							status = GetLastError ();
-							TRACE_ERROR (UTILS, "Error allocating %d bytes for the hash, status = %!STATUS!", hash_size, status);
-							}
 
-						}
-					else
-						{
-						TRACE_ERROR (UTILS, "Error getting the size of the hash, status = %!STATUS!", status);
-						}
+	TRACE_ENTER ();
 
-					}
-				else
-					{
-					TRACE_ERROR (UTILS, "Error creating the hash object, status = %!STATUS!", status);
-					}
+	if (file.open (File_name.c_str (), MAPPED_FILE_SEQUENTIAL, MAPPED_FILE_WHOLE)
+		&& (bytes = file.view (0, (size_t) file.size ())) != nullptr)
+		{
 
-				}
-			else
-				{
-				status = GetLastError ();
-				TRACE_ERROR (UTILS, "Error allocating %d bytes for the hash object, status = %!STATUS!", hash_object_size, status);
-				}
+		//
+		// Hash the mapped file. It is unmapped and closed when file is destroyed
+		//
 
+		if (Hasher::tree (Mode, bytes, (size_t) file.size (), HASHER_TREE_CHUNK, 0, Digest))
+			{
+			*Digest_size = (ULONG) Hasher::digest_size (Mode);
+			status = STATUS_SUCCESS;
 			}
 		else
 			{
-			TRACE_ERROR (UTILS, "Error getting the hash object size, status = %!STATUS!", status);
+			status = STATUS_NO_MEMORY;
+			TRACE_ERROR (UTILS, "Error allocating the chunk digests for %S, status = %!STATUS!", File_name.c_str (), status);
 			}
 
 		}
 	else
 		{
-		TRACE_ERROR (UTILS, "Error opening a handle to the algorithm %S, status = %!STATUS!", HASH_ALGORITHM, status);
+		status = file.error ();
+		TRACE_ERROR (UTILS, "Couldn't map file %S, status = %!STATUS!", File_name.c_str (), status);
 		}
 
-
 	TRACE_EXIT ();
 	return status;
-}							// End of Utils::hash_data
+}							// End of Utils::hash_file
 
 
 NTSTATUS
@@ -1737,7 +1551,8 @@ Utils::open_and_map_file								// Map a file into the process's address space
 //+
 //
 // DESCRIPTION:		Open the specified file, and map the file's contents into the process's
-//					address space.
+//					address space. New code should use MappedFile, which unmaps and closes the
+//					file itself, and can map a large file a window at a time
 //
 // ASSUMPTIONS:		File must already exist
 //
@@ -1756,6 +1571,7 @@ NTSTATUS	status;
 HANDLE		file_handle;
 HANDLE		mapping_handle;
 PVOID		mapped_address;
+LARGE_INTEGER	file_size;
 
 
 	TRACE_ENTER ();
@@ -1785,10 +1601,11 @@ PVOID		mapped_address;
 				// Return the information on the mapped file
 				//
 
+				GetFileSizeEx (file_handle, &file_size);
 				*Handle = file_handle;
 				*Mapping_handle = mapping_handle;
 				*Mapped_address = mapped_address;
-				*Mapped_size = GetFileSize (file_handle, 0);	// Assume file size < 4GB !!!
+				*Mapped_size = (SIZE_T) file_size.QuadPart;	// The view succeeded, so the file fits in SIZE_T
 				status = STATUS_SUCCESS;
 				}
 			else
@@ -1800,6 +1617,8 @@ PVOID		mapped_address;
 
 				status = GetLastError ();
 				TRACE_ERROR (UTILS, "Error mapping the file, status = %!STATUS!", status);
+				CloseHandle (mapping_handle);
+				CloseHandle (file_handle);
 				}
 
 			}
@@ -1812,6 +1631,7 @@ PVOID		mapped_address;
 
 			status = GetLastError ();
 			TRACE_ERROR (UTILS, "Couldn't create the file mapping object, status = %!STATUS!", status);
+			CloseHandle (file_handle);
 			}
 
 		}
@@ -1831,6 +1651,100 @@ PVOID		mapped_address;
 }											// End of function Utils::open_and_map_file
 
 
+_Use_decl_annotations_
+NTSTATUS
+Utils::registry_read_multi_wstring						// Read a REG_MULTI_SZ value from the registry
+	(
+	_In_	LPWSTR			Parameter,					// Parameter to read
+	_Out_	std::wstring&	Return_value				// Strings read, each followed by a null (empty, if not found)
+	)
+
+//+
+//
+// DESCRIPTION:		Read the specified multi-string parameter from the application's area of the registry. The strings are returned
+//					as they are stored, each followed by a null character, without the final empty string
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:
+//
+// RETURN VALUES:
+//
+//		STATUS_SUCCESS					Normal, successful completion
+//		STATUS_NO_WORK_DONE				The value was not found, or is not a REG_MULTI_SZ, and an empty string was returned
+//
+//-
+
+{
+NTSTATUS		status;
+HKEY			hkey;
+ULONG			win32_status;
+ULONG			type;
+ULONG			size = 0;
+
+
+	TRACE_ENTER ();
+
+	Return_value.clear ();
+
+	//
+	// Open the key
+	//
+
+	if ((status = RegOpenKeyEx (HKEY_LOCAL_MACHINE, (LPCWSTR) APP_REGISTRY_PARAMETERS.c_str (), 0, KEY_QUERY_VALUE, &hkey)) == ERROR_SUCCESS)
+		{
+
+		//
+		// Get the size of the value, then read it. RegQueryValueEx doesn't guarantee that the data it returns is
+		// terminated, so trim the buffer to the last null it contains
+		//
+
+		if (RegQueryValueExW (hkey, Parameter, NULL, &type, NULL, &size) == ERROR_SUCCESS && type == REG_MULTI_SZ && size >= sizeof (WCHAR))
+			{
+			Return_value.resize (size / sizeof (WCHAR));
+
+			if (RegQueryValueExW (hkey, Parameter, NULL, NULL, (PBYTE) &Return_value [0], &size) == ERROR_SUCCESS)
+				{
+				Return_value.resize (size / sizeof (WCHAR));
+
+				while (!Return_value.empty () && Return_value.back () == L'\0')
+					{
+					Return_value.pop_back ();
+					}
+
+				Return_value.push_back (L'\0');
+				status = STATUS_SUCCESS;
+				}
+			else
+				{
+				Return_value.clear ();
+				status = STATUS_NO_WORK_DONE;
+				}
+			}
+		else
+			{
+			status = STATUS_NO_WORK_DONE;
+			}
+
+		//
+		// Close the key, so we don't leak handles
+		//
+
+		RegCloseKey (hkey);
+		}
+	else
+		{
+		win32_status = GetLastError ();
+		TRACE_WARN (UTILS, "Couldn't open handle to registry key (%S), status = %d", (LPCWSTR) APP_REGISTRY_PARAMETERS.c_str (), win32_status);
+		status = STATUS_NO_WORK_DONE;
+		}
+
+	TRACE_EXIT ();
+	return status;
+}							// End routine Utils::registry_read_multi_wstring
+
+
+
 _Use_decl_annotations_
 NTSTATUS
 Utils::registry_read_ulong								// Read a ULONG value from the registry
@@ -2344,7 +2258,7 @@ Utils::s_to_u16											// Convert ANSI string to u16string
 
 //
 //
-// DESCRIPTION:		Convert an ANSI string to a UTF-16 (Windows Unicode) string
+// DESCRIPTION:		Convert a UTF-8 string to a UTF-16 (Windows Unicode) string. Each invalid sequence becomes U+FFFD
 //
 // ASSUMPTIONS:		User mode
 //
@@ -2354,18 +2268,15 @@ Utils::s_to_u16											// Convert ANSI string to u16string
 //
 
 {
-std::u16string	result;
-ULONG			size = (ULONG) Ansi_string.size ();
+std::u16string		result;
+TRANSCODE_RESULT	converted;
 
 
 	TRACE_ENTER ();
 
-	result.resize (size);
-
-	for (ULONG i = 0; i < size; i++)
-		{
-		result [i] = Ansi_string [i];		
-		}
+	result.resize (TRANSCODE_UTF16_MAX (Ansi_string.size ()));
+	converted = Transcode::utf8_to_utf16 (Ansi_string.data (), Ansi_string.size (), &result [0], result.size (), true);
+	result.resize (converted.written);
 
 	TRACE_EXIT ();
 	return result;
@@ -2380,7 +2291,7 @@ Utils::s_to_ws											// Convert ANSI string to wstring
 
 //
 //
-// DESCRIPTION:		Convert an ANSI string to a wstring (Windows Unicode) string
+// DESCRIPTION:		Convert a UTF-8 string to a wstring (Windows Unicode) string. Each invalid sequence becomes U+FFFD
 //
 // ASSUMPTIONS:		User mode
 //
@@ -2390,18 +2301,16 @@ Utils::s_to_ws											// Convert ANSI string to wstring
 //
 
 {
-std::wstring	result;
-ULONG			size = (ULONG) Ansi_string.size ();
+std::wstring		result;
+TRANSCODE_RESULT	converted;
 
 
 	TRACE_ENTER ();
 
-	result.resize (size);
-
-	for (ULONG i = 0; i < size; i++)
-		{
-		result [i] = Ansi_string [i];		
-		}
+	result.resize (TRANSCODE_UTF16_MAX (Ansi_string.size ()));
+	converted = Transcode::utf8_to_utf16 (Ansi_string.data (), Ansi_string.size (), (char16_t *) &result [0], result.size (),
+		true);
+	result.resize (converted.written);
 
 	TRACE_EXIT ();
 	return result;
@@ -2416,9 +2325,7 @@ Utils::u16_to_s											// Convert wide-string to ANSI string
 
 //
 //
-// DESCRIPTION:		Convert a wide-string (UTF-16; Windows Unicode) to ANSI byte-string
-//
-//					NOTE: This will throw away the upper 16-bits of each UCS-2 character
+// DESCRIPTION:		Convert a wide-string (UTF-16; Windows Unicode) to a UTF-8 string. Each unpaired surrogate becomes U+FFFD
 //
 // ASSUMPTIONS:		User mode
 //
@@ -2428,19 +2335,15 @@ Utils::u16_to_s											// Convert wide-string to ANSI string
 //
 
 {
-std::string		result;
-ULONG			size = (ULONG) U16_string.size ();
+std::string			result;
+TRANSCODE_RESULT	converted;
 
 
 	TRACE_ENTER ();
 
-	result.resize (size);
-
-	for (ULONG i = 0; i < size; i++)
-		{
-		result [i] = (char) U16_string [i];		
-		}
-
+	result.resize (TRANSCODE_UTF8_MAX (U16_string.size ()));
+	converted = Transcode::utf16_to_utf8 (U16_string.data (), U16_string.size (), &result [0], result.size (), true);
+	result.resize (converted.written);
 
 	TRACE_EXIT ();
 	return result;
@@ -2455,7 +2358,7 @@ Utils::u16_to_ws										// Convert u16string to wide-string
 
 //
 //
-// DESCRIPTION:		Convert a u16string (UTF-16; Windows Unicode) to wide-string
+// DESCRIPTION:		Convert a u16string (UTF-16; Windows Unicode) to wide-string. Both are UTF-16, so the units are copied
 //
 // ASSUMPTIONS:		User mode
 //
@@ -2465,20 +2368,10 @@ Utils::u16_to_ws										// Convert u16string to wide-string
 //
 
 {
-std::wstring	result;
-ULONG			size = (ULONG) U16_string.size ();
+std::wstring	result ((const wchar_t *) U16_string.data (), U16_string.size ());
 
 
 	TRACE_ENTER ();
-
-	result.resize (size);
-
-	for (ULONG i = 0; i < size; i++)
-		{
-		result [i] = (WCHAR) U16_string [i];		
-		}
-
-
 	TRACE_EXIT ();
 	return result;
 }							// End of Utils::u16_to_ws
@@ -2556,9 +2449,7 @@ Utils::ws_to_s											// Convert wide-string to ANSI string
 
 //
 //
-// DESCRIPTION:		Convert a wide-string (UTF-16; Windows Unicode) to ANSI byte-string
-//
-//					NOTE: This will throw away the upper 16-bits of each UCS-2 character
+// DESCRIPTION:		Convert a wide-string (UTF-16; Windows Unicode) to a UTF-8 string. Each unpaired surrogate becomes U+FFFD
 //
 // ASSUMPTIONS:		User mode
 //
@@ -2568,19 +2459,15 @@ Utils::ws_to_s											// Convert wide-string to ANSI string
 //
 
 {
-std::string		result;
-ULONG			size = (ULONG) Wstring.size ();
+std::string			result;
+TRANSCODE_RESULT	converted;
 
 
 	TRACE_ENTER ();
 
-	result.resize (size);
-
-	for (ULONG i = 0; i < size; i++)
-		{
-		result [i] = (char) Wstring [i];		
-		}
-
+	result.resize (TRANSCODE_UTF8_MAX (Wstring.size ()));
+	converted = Transcode::utf16_to_utf8 ((const char16_t *) Wstring.data (), Wstring.size (), &result [0], result.size (), true);
+	result.resize (converted.written);
 
 	TRACE_EXIT ();
 	return result;
@@ -2595,7 +2482,7 @@ Utils::ws_to_u16										// Convert wide-string to u16string
 
 //
 //
-// DESCRIPTION:		Convert a wide-string to a UTF-16 (Windows Unicode) string
+// DESCRIPTION:		Convert a wide-string to a UTF-16 (Windows Unicode) string. Both are UTF-16, so the units are copied
 //
 // ASSUMPTIONS:		User mode
 //
@@ -2605,19 +2492,10 @@ Utils::ws_to_u16										// Convert wide-string to u16string
 //
 
 {
-std::u16string	result;
-ULONG			size = (ULONG) Wide_string.size ();
+std::u16string	result ((const char16_t *) Wide_string.data (), Wide_string.size ());
 
 
 	TRACE_ENTER ();
-
-	result.resize (size);
-
-	for (ULONG i = 0; i < size; i++)
-		{
-		result [i] = Wide_string [i];
-		}
-
 	TRACE_EXIT ();
 	return result;
 }							// End of Utils::ws_to_u16
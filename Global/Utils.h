@@ -18,6 +18,9 @@
 //
 
 #pragma once
+
+#include "Hasher.h"										// HASHER_MODE, for hash_file
+
 namespace FDI		// Five Directions Inc
 {
 
@@ -27,12 +30,6 @@ namespace FDI		// Five Directions Inc
 
 #include <AccCtrl.h>
 
-//
-// CONSTANTS:
-//
-
-#define	HASH_ALGORITHM	BCRYPT_SHA256_ALGORITHM
-
 //
 // MACROS:
 //
@@ -225,6 +222,18 @@ public:
 		_Out_	ULONG	*Hash_size						// Length of hash
 		);
 
+	_Check_return_
+	static
+	NTSTATUS
+	hash_file											// Calculate the tree hash of a file
+		(
+		_In_	const std::wstring&	File_name,			// File to hash
+		_In_	HASHER_MODE			Mode,				// Hash to compute
+		_Out_writes_bytes_(HASHER_MAX_DIGEST)
+		PBYTE						Digest,				// Receives the digest
+		_Out_	ULONG				*Digest_size		// Size of the digest
+		);
+
 	_Check_return_
 	static
 	NTSTATUS
@@ -279,6 +288,15 @@ public:
 		_Out_	SIZE_T			*Mapped_size			// Size of mapped file
 		);
 
+	_Check_return_
+	static
+	NTSTATUS
+	registry_read_multi_wstring							// Read a REG_MULTI_SZ value from the registry
+		(
+		_In_	LPWSTR			Parameter,				// Parameter to read
+		_Out_	std::wstring&	Return_value			// Strings read, each followed by a null (empty, if not found)
+		);
+
 	_Check_return_
 	static
 	NTSTATUS
@@ -365,6 +383,7 @@ public:
 		const std::wstring&	Wide_string					// Wide string to convert
 		);
 
+	static
 	std::u16string
 	ws_to_u16											// Convert wide-string to u16string
 		(
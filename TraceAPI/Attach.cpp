@@ -0,0 +1,609 @@
+//
+// FACILITY:	Attach - Staged attach of the Detours
+//
+// DESCRIPTION:	This module contains the implementation of the Attach class. start splits the APIs that are enabled into the core
+//				set, which it attaches itself, and a list of the others, which the worker thread attaches in batches. A lock is held
+//				while a batch is attached, so stop can wait for the batch in progress, and no batch starts after stop returns; the
+//				caller then detaches exactly the APIs that attached returns.
+//
+//				This module uses only standard C++, so that it can be built and tested on Linux. It does not use WPP; DLLMain.cpp
+//				logs the progress
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Added add, remove and is_attached. The worker thread skips the APIs that were attached or removed since start
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+//
+// Project includes
+//
+
+#include "Attach.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	ATT_STOP_WAIT_MS		1000					// Longest stop and attached wait for the batch in progress
+
+//
+// DECLARATIONS:
+//
+
+static std::timed_mutex			TA_att_lock;					// Held while a batch is attached; protects the fields below
+static TA_ATTACH_CONFIG			TA_att_config;					// Configuration passed to start
+static uint32_t					TA_att_attached [TA_MAX_APIS / 32];	// Per-API bits (1 = attached)
+static uint32_t					TA_att_removed [TA_MAX_APIS / 32];	// Per-API bits (1 = removed, so the worker thread skips it)
+static TA_ATTACH_PROGRESS		TA_att_progress;				// Progress after the last batch
+static std::chrono::steady_clock::time_point	TA_att_start;	// When start was called
+
+static std::vector<uint32_t>	TA_att_pending;					// APIs the worker thread attaches (set before it starts)
+
+static std::mutex				TA_att_wake_lock;				// Serializes setting TA_att_stopping with the worker's wait
+static std::condition_variable	TA_att_wake;					// Wakes the worker thread from its pause between batches
+static std::atomic<bool>		TA_att_stopping (false);		// Tells the worker thread to exit
+static std::atomic<bool>		TA_att_thread_done (true);		// The worker thread has left its loop
+static std::thread				TA_att_thread;					// The worker thread
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+void
+attach_batch											// Attach a batch of APIs, and update the progress
+	(
+	_In_	uint32_t				Batch,				// Batch number
+	_In_	const uint32_t			*Apis,				// APIs in the batch
+	_In_	uint32_t				Count,				// Number of APIs
+	_In_	bool					Last,				// No more batches follow
+	_Out_	TA_ATTACH_PROGRESS&		Progress			// Progress after the batch
+	);
+
+static
+void
+attach_thread											// Body of the worker thread
+	(
+	);
+
+static
+inline
+uint64_t
+usec_since												// Microseconds from a time until now
+	(
+	_In_	std::chrono::steady_clock::time_point	Start	// Time
+	);
+
+
+
+bool
+Attach::start											// Attach the core set, and start the worker thread for the rest
+	(
+	_In_	const TA_ATTACH_CONFIG&	Config				// APIs, batches and routines
+	)
+
+//
+// DESCRIPTION:		Sort the APIs that are enabled into the core set and the rest, attach the core set, then start the worker
+//					thread that attaches the rest. If batch_apis is 0, or the thread cannot be created, all the APIs are attached
+//					before start returns
+//
+// ASSUMPTIONS:		Attach is not running. The APIs disabled by name are set in Intercept before start is called
+//
+// SIDE EFFECTS:	Creates a thread
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							There is no attach routine, or the core set (or, without the worker thread, the rest)
+//										could not be attached
+//
+
+{
+std::vector<uint32_t>	core;
+TA_ATTACH_PROGRESS		progress;
+bool					is_core;
+bool					ok;
+
+
+	if (Config.attach == nullptr || Config.api_count > TA_MAX_APIS || TA_att_thread.joinable ())
+		{
+		return false;
+		}
+
+	TA_att_start = std::chrono::steady_clock::now ();
+
+	{
+	std::lock_guard<std::timed_mutex>	lock (TA_att_lock);
+
+	TA_att_config = Config;
+	TA_att_pending.clear ();
+	memset (TA_att_attached, 0, sizeof (TA_att_attached));
+	memset (TA_att_removed, 0, sizeof (TA_att_removed));
+	memset (&TA_att_progress, 0, sizeof (TA_att_progress));
+
+	for (uint32_t api = 0; api < Config.api_count; api++)
+		{
+		if (!Intercept::api_configured (api))
+			{
+			TA_att_progress.skipped++;
+			continue;
+			}
+
+		is_core = Config.batch_apis == 0 || std::find (Config.core, Config.core + Config.core_count, api) != Config.core + Config.core_count;
+		(is_core ? core : TA_att_pending).push_back (api);
+		}
+
+	TA_att_progress.planned = (uint32_t) (core.size () + TA_att_pending.size ());
+	attach_batch (0, core.data (), (uint32_t) core.size (), TA_att_pending.empty (), progress);
+	ok = progress.ok;
+	}
+
+	if (Config.report != nullptr)
+		{
+		Config.report (progress);
+		}
+
+	if (TA_att_pending.empty ())
+		{
+		return ok;
+		}
+
+	TA_att_stopping = false;
+	TA_att_thread_done = false;
+
+	try
+		{
+		TA_att_thread = std::thread (attach_thread);
+		}
+	catch (...)
+		{
+		TA_att_thread_done = true;
+
+		//
+		// Without the worker thread, attach the rest now, as one batch
+		//
+
+		{
+		std::lock_guard<std::timed_mutex>	lock (TA_att_lock);
+
+		attach_batch (1, TA_att_pending.data (), (uint32_t) TA_att_pending.size (), true, progress);
+		}
+
+		if (Config.report != nullptr)
+			{
+			Config.report (progress);
+			}
+
+		ok = ok && progress.ok;
+		}
+
+	return ok;
+}							// End routine Attach::start
+
+
+void
+Attach::stop											// Stop attaching batches
+	(
+	_In_	bool	Join_thread							// Wait for the worker thread (must be false under the loader lock)
+	)
+
+//
+// DESCRIPTION:		Tell the worker thread to stop, and wait for the batch it is attaching. No batch is started after stop returns.
+//
+//					Under the loader lock (in DllMain) a thread cannot exit, so it cannot be joined; instead, wait a short time for
+//					it to leave its loop. A worker thread that has not started yet (it waits for the loader lock to start) finds
+//					that it has been stopped, and exits without attaching anything
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	{
+	std::lock_guard<std::mutex>	lock (TA_att_wake_lock);
+
+	TA_att_stopping = true;
+	}
+
+	TA_att_wake.notify_all ();
+
+	if (TA_att_thread.joinable ())
+		{
+		if (Join_thread)
+			{
+			TA_att_thread.join ();
+			}
+		else
+			{
+			auto	give_up = std::chrono::steady_clock::now () + std::chrono::milliseconds (ATT_STOP_WAIT_MS);
+
+			while (!TA_att_thread_done.load () && std::chrono::steady_clock::now () < give_up)
+				{
+				std::this_thread::sleep_for (std::chrono::milliseconds (1));
+				}
+
+			TA_att_thread.detach ();
+			}
+		}
+}							// End routine Attach::stop
+
+
+bool
+Attach::attached										// Get the APIs that have been attached
+	(
+	_Out_	std::vector<uint32_t>&	Apis				// API numbers, in increasing order
+	)
+
+//
+// DESCRIPTION:		Return the APIs of the batches that have been attached. After stop, these are the APIs to detach
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							A batch is still being attached (when the process is exiting, the worker thread may
+//										have been terminated in the middle of one); Apis is empty
+//
+
+{
+std::unique_lock<std::timed_mutex>	lock (TA_att_lock, std::chrono::milliseconds (ATT_STOP_WAIT_MS));
+
+
+	Apis.clear ();
+
+	if (!lock.owns_lock ())
+		{
+		return false;
+		}
+
+	for (uint32_t api = 0; api < TA_att_config.api_count; api++)
+		{
+		if ((TA_att_attached [api >> 5] & (1u << (api & 31))) != 0)
+			{
+			Apis.push_back (api);
+			}
+		}
+
+	return true;
+}							// End routine Attach::attached
+
+
+bool
+Attach::add												// Attach an API now
+	(
+	_In_	uint32_t	Api								// API number
+	)
+
+//
+// DESCRIPTION:		Attach the API in a transaction of its own, unless it is already attached. If the worker thread has not
+//					reached it yet, it skips it
+//
+// ASSUMPTIONS:		start has been called
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The API is attached
+//		false							The API number is not valid, or the attach routine failed
+//
+
+{
+std::lock_guard<std::timed_mutex>	lock (TA_att_lock);
+bool								ok;
+
+
+	if (TA_att_config.attach == nullptr || Api >= TA_att_config.api_count)
+		{
+		return false;
+		}
+
+	TA_att_removed [Api >> 5] &= ~(1u << (Api & 31));
+
+	if ((TA_att_attached [Api >> 5] & (1u << (Api & 31))) != 0)
+		{
+		return true;
+		}
+
+	if ((ok = TA_att_config.attach (&Api, 1)))
+		{
+		TA_att_attached [Api >> 5] |= 1u << (Api & 31);
+		TA_att_progress.attached++;
+		}
+
+	return ok;
+}							// End routine Attach::add
+
+
+bool
+Attach::remove											// Detach an API now, and keep the worker thread from attaching it
+	(
+	_In_	uint32_t	Api								// API number
+	)
+
+//
+// DESCRIPTION:		Detach the API in a transaction of its own, if it is attached. Either way, the worker thread does not attach it
+//					afterwards
+//
+// ASSUMPTIONS:		start has been called
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The API is not attached
+//		false							The API number is not valid, or the detach routine failed (or there is none)
+//
+
+{
+std::lock_guard<std::timed_mutex>	lock (TA_att_lock);
+
+
+	if (Api >= TA_att_config.api_count)
+		{
+		return false;
+		}
+
+	TA_att_removed [Api >> 5] |= 1u << (Api & 31);
+
+	if ((TA_att_attached [Api >> 5] & (1u << (Api & 31))) == 0)
+		{
+		return true;
+		}
+
+	if (TA_att_config.detach == nullptr || !TA_att_config.detach (&Api, 1))
+		{
+		return false;
+		}
+
+	TA_att_attached [Api >> 5] &= ~(1u << (Api & 31));
+	TA_att_progress.attached--;
+	return true;
+}							// End routine Attach::remove
+
+
+bool
+Attach::is_attached										// Determine whether an API is attached
+	(
+	_In_	uint32_t	Api								// API number
+	)
+
+//
+// DESCRIPTION:		Return the API's attached bit
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The API is attached
+//		false							It is not, or the API number is not valid
+//
+
+{
+std::lock_guard<std::timed_mutex>	lock (TA_att_lock);
+
+
+	return Api < TA_att_config.api_count && (TA_att_attached [Api >> 5] & (1u << (Api & 31))) != 0;
+}							// End routine Attach::is_attached
+
+
+void
+Attach::get_progress									// Get the progress of the attach
+	(
+	_Out_	TA_ATTACH_PROGRESS&		Progress			// Progress after the last batch
+	)
+
+//
+// DESCRIPTION:		Return the progress as of the last batch that was attached
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::lock_guard<std::timed_mutex>	lock (TA_att_lock);
+
+
+	Progress = TA_att_progress;
+}							// End routine Attach::get_progress
+
+
+static
+void
+attach_batch											// Attach a batch of APIs, and update the progress
+	(
+	_In_	uint32_t				Batch,				// Batch number
+	_In_	const uint32_t			*Apis,				// APIs in the batch
+	_In_	uint32_t				Count,				// Number of APIs
+	_In_	bool					Last,				// No more batches follow
+	_Out_	TA_ATTACH_PROGRESS&		Progress			// Progress after the batch
+	)
+
+//
+// DESCRIPTION:		Call the attach routine (unless the batch is empty), record which APIs it attached, and time it
+//
+// ASSUMPTIONS:		The caller holds TA_att_lock
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::chrono::steady_clock::time_point	begin = std::chrono::steady_clock::now ();
+bool									ok;
+
+
+	ok = Count == 0 || TA_att_config.attach (Apis, Count);
+
+	TA_att_progress.batch_usec = usec_since (begin);
+	TA_att_progress.elapsed_usec = usec_since (TA_att_start);
+	TA_att_progress.batch = Batch;
+	TA_att_progress.apis = Count;
+	TA_att_progress.ok = ok;
+	TA_att_progress.done = Last;
+
+	if (ok)
+		{
+		for (uint32_t i = 0; i < Count; i++)
+			{
+			TA_att_attached [Apis [i] >> 5] |= 1u << (Apis [i] & 31);
+			}
+
+		TA_att_progress.attached += Count;
+		}
+	else
+		{
+		TA_att_progress.failed += Count;
+		}
+
+	Progress = TA_att_progress;
+}							// End attach_batch
+
+
+static
+void
+attach_thread											// Body of the worker thread
+	(
+	)
+
+//
+// DESCRIPTION:		Attach the pending APIs in batches of batch_apis, pausing batch_pause_ms between them, until they are all
+//					attached or stop is called. APIs that add has attached, or that remove has removed, are left out of their batch
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::vector<uint32_t>	apis;
+TA_ATTACH_PROGRESS		progress;
+size_t					next;
+uint32_t				count;
+uint32_t				batch = 1;
+
+
+	//
+	// Detours calls APIs (VirtualProtect, and so on) while it patches, which may be in an earlier batch. Their intercepts must
+	// not build events for this thread
+	//
+
+	Intercept::exclude_thread ();
+
+	for (next = 0; next < TA_att_pending.size (); next += count, batch++)
+		{
+		if (batch > 1 && TA_att_config.batch_pause_ms != 0)
+			{
+			std::unique_lock<std::mutex>	lock (TA_att_wake_lock);
+
+			TA_att_wake.wait_for (lock, std::chrono::milliseconds (TA_att_config.batch_pause_ms), [] {return TA_att_stopping.load ();});
+			}
+
+		count = (uint32_t) std::min<size_t> (TA_att_config.batch_apis, TA_att_pending.size () - next);
+
+		{
+		std::lock_guard<std::timed_mutex>	lock (TA_att_lock);
+
+		if (TA_att_stopping)
+			{
+			break;
+			}
+
+		apis.clear ();
+
+		for (size_t i = next; i < next + count; i++)
+			{
+			uint32_t	api = TA_att_pending [i];
+
+			if (((TA_att_attached [api >> 5] | TA_att_removed [api >> 5]) & (1u << (api & 31))) == 0)
+				{
+				apis.push_back (api);
+				}
+			}
+
+		attach_batch (batch, apis.data (), (uint32_t) apis.size (), next + count == TA_att_pending.size (), progress);
+		}
+
+		if (TA_att_config.report != nullptr)
+			{
+			TA_att_config.report (progress);
+			}
+		}
+
+	TA_att_thread_done = true;
+}							// End attach_thread
+
+
+static
+inline
+uint64_t
+usec_since												// Microseconds from a time until now
+	(
+	_In_	std::chrono::steady_clock::time_point	Start	// Time
+	)
+
+//
+// DESCRIPTION:		Return the time elapsed since Start
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Microseconds
+//
+
+{
+	return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now () - Start).count ();
+}							// End usec_since
@@ -0,0 +1,175 @@
+//
+// FACILITY:	Attach - Staged attach of the Detours
+//
+// DESCRIPTION:	Attaching every Detour in process_attach holds the loader lock for as long as the Detours transactions take, and
+//				with a whole-DLL export list that stalls the program being traced. In staged attach, start attaches a small core
+//				set of APIs immediately, and a worker thread attaches the rest in batches, one Detours transaction per batch.
+//				The worker cannot run until DllMain returns, so the remaining batches never hold the loader lock. APIs that are
+//				disabled by name (Intercept::api_configured) are never attached, so they never pay the cost of being patched.
+//
+//				Progress is passed to the report routine after each batch: the APIs attached so far, and the time the batch
+//				and the whole attach have taken.
+//
+//				add and remove attach or detach one API at any time, for the control channel. An API that is removed before the
+//				worker thread reaches it is not attached by the worker thread.
+//
+//				This module does not call Detours itself; the caller passes the routine that attaches a batch. Like Capture, it
+//				uses only standard C++, so that it can be tested on Linux
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Added add and remove, which attach and detach a single API at any time (see Control.h)
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstdint>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "Intercept.h"
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux test build
+#define	_In_
+#define	_Out_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// TYPES:
+//
+
+//
+// Progress of an attach, passed to the report routine after each batch
+//
+
+typedef struct _TA_ATTACH_PROGRESS
+	{
+	uint32_t			batch;							// Batch just attached (0 is the core set, attached by start)
+	uint32_t			apis;							// APIs in the batch
+	uint32_t			attached;						// APIs attached so far
+	uint32_t			failed;							// APIs in batches that could not be attached
+	uint32_t			planned;						// APIs that are attached in all (core and batches)
+	uint32_t			skipped;						// APIs not attached because they are disabled
+	uint64_t			batch_usec;						// Time the batch took
+	uint64_t			elapsed_usec;					// Time since start
+	bool				ok;								// The batch was attached
+	bool				done;							// No more batches follow
+	} TA_ATTACH_PROGRESS, *PTA_ATTACH_PROGRESS;
+
+//
+// Attach or detach a batch of APIs, in one Detours transaction. Called by start for the core set, by the worker thread for
+// the other batches, and by add and remove; never by two threads at once
+//
+
+typedef bool (*TA_ATTACH_ROUTINE) (const uint32_t *Apis, uint32_t Count);
+
+//
+// Called after each batch with the progress so far, on the thread that attached the batch
+//
+
+typedef void (*TA_ATTACH_REPORT) (const TA_ATTACH_PROGRESS& Progress);
+
+typedef struct _TA_ATTACH_CONFIG
+	{
+	uint32_t			api_count;						// Number of APIs (API numbers are 0 to api_count - 1)
+	const uint32_t		*core;							// APIs that start attaches itself (read only by start)
+	uint32_t			core_count;						// Number of APIs in core
+	uint32_t			batch_apis;						// APIs in each of the worker thread's batches (0 = start attaches them all)
+	uint32_t			batch_pause_ms;					// Time the worker thread waits between batches
+	TA_ATTACH_ROUTINE	attach;							// Routine that attaches a batch
+	TA_ATTACH_ROUTINE	detach;							// Routine that detaches a batch (or nullptr: remove fails)
+	TA_ATTACH_REPORT	report;							// Routine that reports the progress (or nullptr)
+	} TA_ATTACH_CONFIG, *PTA_ATTACH_CONFIG;
+
+//
+// DECLARATIONS:
+//
+
+class Attach
+{
+public:
+
+	//
+	// Public methods
+	//
+
+	static
+	bool
+	start												// Attach the core set, and start the worker thread for the rest
+		(
+		_In_	const TA_ATTACH_CONFIG&	Config			// APIs, batches and routines
+		);
+
+	static
+	void
+	stop												// Stop attaching batches
+		(
+		_In_	bool	Join_thread						// Wait for the worker thread (must be false under the loader lock)
+		);
+
+	static
+	bool
+	attached											// Get the APIs that have been attached
+		(
+		_Out_	std::vector<uint32_t>&	Apis			// API numbers, in increasing order
+		);
+
+	static
+	bool
+	add													// Attach an API now
+		(
+		_In_	uint32_t	Api							// API number
+		);
+
+	static
+	bool
+	remove												// Detach an API now, and keep the worker thread from attaching it
+		(
+		_In_	uint32_t	Api							// API number
+		);
+
+	static
+	bool
+	is_attached											// Determine whether an API is attached
+		(
+		_In_	uint32_t	Api							// API number
+		);
+
+	static
+	void
+	get_progress										// Get the progress of the attach
+		(
+		_Out_	TA_ATTACH_PROGRESS&		Progress		// Progress after the last batch
+		);
+
+};	// End class Attach
+
+}	// End of namespace FDI
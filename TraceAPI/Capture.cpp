@@ -0,0 +1,1538 @@
+//
+// FACILITY:	Capture - In-process capture of intercept events
+//
+// DESCRIPTION:	This module contains the implementation of the Capture class. Each thread that calls an intercept gets a ring of
+//				TA_RECORDs the first time it captures a record. The thread is the only producer for its ring, and the drain thread is
+//				the only consumer, so the ring needs no locks: the producer owns head, the drain thread owns tail, and each publishes
+//				its index with a release store. The rings are on a singly linked list; a new ring is pushed onto the front with a
+//				compare-and-swap, and only the drain thread unlinks rings (those whose thread has exited, once they are empty, and
+//				never the first one, which is the one the producers swap against).
+//
+//				This module uses only standard C++ (plus the Windows or POSIX clock and thread ID), so that it can be built and tested
+//				on Linux. It does not use WPP; DLLMain.cpp logs the statistics when the DLL is unloaded
+//
+//				When stacks are captured, the drain thread sends the stacks added to StackTable since its last pass before the
+//				records in the rings, so a stack's TA_REC_STACK record is usually written before the first record that uses it.
+//				Stop sends them again after the last pass, so that every stack used in a trace is defined in it
+//
+// VERSION:		1.5
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.5		2026-10-17	Brian Catlin
+//			Send the new stacks in StackTable to the sink on each drain. begin_record clears the stack ID, and the file sink
+//			writes it
+//
+//	1.4		2026-10-17	Brian Catlin
+//			Added add_data and set_data_limit. The snapshot of a buffer is copied into the ring slots after its call's
+//			record, and commit_record publishes them together. The file sink writes them as TA_REC_DATA records
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Added timestamp
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Records carry the API number instead of the address of its name. The file sink writes the schema once, then each
+//			record in the compact form described in TraceFormat.h, instead of the fixed 256-byte TA_RECORDs
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Exclude the drain thread from the intercepts, so that the sink's own API calls are not captured
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <thread>
+
+//
+// Project includes
+//
+
+#include "Capture.h"
+#include "Intercept.h"
+#include "StackTable.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	CAP_MIN_RING_RECORDS	8						// Smallest ring
+#define	CAP_MAX_RING_RECORDS	(1 << 20)				// Largest ring (256MB per thread)
+#define	CAP_CACHE_LINE			64						// Keeps the producer's and consumer's fields apart
+#define	CAP_STOP_WAIT_MS		1000					// Longest stop waits for the drain thread or the drain lock
+#define	CAP_FILE_BUFFER			(64 * 1024)				// Bytes the file sink encodes before writing them
+#define	CAP_STACK_BATCH			64						// Stack records built at a time
+#define	CAP_FILE_MAX_RECORD		(4 + 4 * TA_TRACE_MAX_VARINT + TA_TRACE_MAX_ARGS * TA_TRACE_MAX_VARINT + TA_TRACE_MAX_TEXT * 3)
+																// Longest encoded record
+#define	CAP_FILE_MAX_DATA		(4 + 5 * TA_TRACE_MAX_VARINT + TA_TRACE_MAX_DATA)	// Longest encoded TA_REC_DATA record
+
+static_assert (CAP_FILE_MAX_DATA <= CAP_FILE_MAX_RECORD, "The file sink reserves CAP_FILE_MAX_RECORD bytes for each record");
+
+//
+// TYPES:
+//
+
+//
+// A thread's ring. The producer's fields and the consumer's fields are on different cache lines
+//
+
+typedef struct _TA_RING
+	{
+	std::atomic<uint32_t>	head;						// Next record the producer fills (free-running)
+	bool					busy;						// The producer is between begin_record and commit_record
+	uint32_t				pending;					// Data records the producer has added after the record it is building
+	std::atomic<uint64_t>	overflows;					// Records dropped because the ring was full (written by the producer)
+	std::atomic<uint64_t>	nested;						// Records dropped because the producer was busy (written by the producer)
+	std::atomic<uint64_t>	truncated;					// Snapshots cut short because the ring was nearly full (written by the producer)
+	char					pad1 [CAP_CACHE_LINE];
+	std::atomic<uint32_t>	tail;						// Next record the drain thread reads (free-running)
+	char					pad2 [CAP_CACHE_LINE];
+	std::atomic<bool>		closed;						// The thread has exited; the ring is freed once it is empty
+	uint32_t				mask;						// Number of records - 1
+	uint32_t				thread_id;					// Owning thread
+	TA_RECORD				*records;					// The ring
+	struct _TA_RING			*next;						// Next ring on the list
+	} TA_RING, *PTA_RING;
+
+//
+// Frees the calling thread's ring when the thread exits. The ring itself is freed by the drain thread
+//
+
+struct TA_RING_OWNER
+	{
+	TA_RING		*ring = nullptr;
+
+	~TA_RING_OWNER ();
+	};
+
+//
+// The file sink's context
+//
+
+typedef struct _TA_FILE_SINK
+	{
+	FILE			*file;								// Trace file
+	uint64_t		last_timestamp;						// Timestamp of the last record encoded
+	uint32_t		last_thread;						// Thread of the last record encoded
+	bool			thread_known;						// last_thread is valid
+	size_t			used;								// Bytes in buffer
+	uint8_t			buffer [CAP_FILE_BUFFER];			// Encoded, but not yet written
+	} TA_FILE_SINK, *PTA_FILE_SINK;
+
+//
+// DECLARATIONS:
+//
+
+std::atomic<bool>			Capture::capture_enabled (false);
+std::atomic<uint32_t>		Capture::data_limit (TA_CAPTURE_DATA_LIMIT);
+
+static std::atomic<TA_RING *>	TA_cap_rings (nullptr);			// All the rings
+static std::atomic<uint32_t>	TA_cap_rings_allocated (0);		// Rings ever allocated
+static std::atomic<uint32_t>	TA_cap_rings_live (0);			// Rings whose thread has not exited
+static uint32_t					TA_cap_ring_records = 1024;		// Size of new rings
+static uint32_t					TA_cap_drain_period_ms = 10;	// Longest wait between drains
+
+static std::timed_mutex			TA_cap_drain_lock;				// Held while draining; protects the fields below
+static TA_SINK					TA_cap_sink;					// Current sink (write is nullptr once stopped)
+static uint64_t					TA_cap_records = 0;				// Records passed to the sink
+static uint64_t					TA_cap_batches = 0;				// Calls to the sink's write routine
+static uint64_t					TA_cap_sink_errors = 0;			// Batches the sink failed to write
+static uint64_t					TA_cap_retired_overflows = 0;	// Overflows from rings that have been freed
+static uint64_t					TA_cap_retired_nested = 0;		// Nested records from rings that have been freed
+static uint64_t					TA_cap_retired_truncated = 0;	// Truncated snapshots from rings that have been freed
+static TA_RECORD				TA_cap_stacks [CAP_STACK_BATCH];	// Stack records being sent
+
+static std::mutex				TA_cap_wake_lock;				// Protects TA_cap_stopping for the condition variable
+static std::condition_variable	TA_cap_wake;					// Wakes the drain thread early
+static bool						TA_cap_stopping = false;		// Tells the drain thread to exit
+static std::atomic<bool>		TA_cap_thread_done (true);		// The drain thread has left its loop
+static std::thread				TA_cap_thread;					// The drain thread
+
+static thread_local TA_RING_OWNER	TA_cap_owner;				// The calling thread's ring
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+TA_RING *
+ring_create												// Allocate a ring for the calling thread
+	(
+	);
+
+static
+size_t
+drain_rings												// Send everything in the rings to the sink
+	(
+	);
+
+static
+void
+drain_stacks											// Send the stacks not yet sent to the sink
+	(
+	);
+
+static
+void
+drain_thread											// Body of the drain thread
+	(
+	);
+
+static
+inline
+uint64_t
+read_ticks												// Read the timestamp clock
+	(
+	);
+
+static
+bool
+copy_data												// Copy bytes that the traced program passed to an API
+	(
+	void			*To,								// Where to put them
+	const void		*From,								// Bytes to copy
+	size_t			Length								// Number of bytes
+	);
+
+
+
+bool
+Capture::start											// Start capturing and the drain thread
+	(
+	_In_	const TA_CAPTURE_CONFIG&	Config			// Ring size, drain period and sink
+	)
+
+//
+// DESCRIPTION:		Set up the sink and start the drain thread, then let the intercepts capture. Rings that already exist (from an
+//					earlier start) are kept at their current size
+//
+// ASSUMPTIONS:		Capture is not running
+//
+// SIDE EFFECTS:	Creates a thread
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							There is no sink, or the thread could not be created
+//
+
+{
+uint32_t	records = CAP_MIN_RING_RECORDS;
+
+
+	if (Config.sink.write == nullptr || TA_cap_thread.joinable ())
+		{
+		return false;
+		}
+
+	//
+	// Round the ring size up to a power of 2, so the index is a mask of the free-running head and tail
+	//
+
+	while (records < Config.ring_records && records < CAP_MAX_RING_RECORDS)
+		{
+		records <<= 1;
+		}
+
+	TA_cap_ring_records = records;
+	TA_cap_drain_period_ms = Config.drain_period_ms != 0 ? Config.drain_period_ms : 10;
+
+	{
+	std::lock_guard<std::timed_mutex>	lock (TA_cap_drain_lock);
+
+	TA_cap_sink = Config.sink;
+	}
+
+	TA_cap_stopping = false;
+	TA_cap_thread_done = false;
+
+	try
+		{
+		TA_cap_thread = std::thread (drain_thread);
+		}
+	catch (...)
+		{
+		TA_cap_thread_done = true;
+		return false;
+		}
+
+	capture_enabled.store (true, std::memory_order_release);
+	return true;
+}							// End routine Capture::start
+
+
+void
+Capture::stop											// Stop capturing, drain the rings and close the sink
+	(
+	_In_	bool	Join_thread							// Wait for the drain thread (must be false under the loader lock)
+	)
+
+//
+// DESCRIPTION:		Stop the intercepts from capturing, stop the drain thread, then send whatever is left in the rings to the sink
+//					and close it.
+//
+//					Under the loader lock (in DllMain) a thread cannot exit, so it cannot be joined; instead, wait a short time for
+//					it to leave its loop. When the process is exiting, the thread has already been terminated, possibly while
+//					holding the drain lock, so the final drain is skipped if the lock cannot be acquired
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Intercepts that are running on other threads may still commit records that are never drained
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	capture_enabled.store (false, std::memory_order_release);
+
+	{
+	std::lock_guard<std::mutex>	lock (TA_cap_wake_lock);
+
+	TA_cap_stopping = true;
+	}
+
+	TA_cap_wake.notify_all ();
+
+	if (TA_cap_thread.joinable ())
+		{
+		if (Join_thread)
+			{
+			TA_cap_thread.join ();
+			}
+		else
+			{
+			auto	give_up = std::chrono::steady_clock::now () + std::chrono::milliseconds (CAP_STOP_WAIT_MS);
+
+			while (!TA_cap_thread_done.load () && std::chrono::steady_clock::now () < give_up)
+				{
+				std::this_thread::sleep_for (std::chrono::milliseconds (1));
+				}
+
+			TA_cap_thread.detach ();
+			}
+		}
+
+	//
+	// Drain what is left, and close the sink. Clearing the sink keeps a drain thread that did not stop in time from using it
+	//
+
+	if (TA_cap_drain_lock.try_lock_for (std::chrono::milliseconds (CAP_STOP_WAIT_MS)))
+		{
+		drain_rings ();
+		drain_stacks ();
+
+		if (TA_cap_sink.close != nullptr)
+			{
+			TA_cap_sink.close (TA_cap_sink.context);
+			}
+
+		TA_cap_sink.write = nullptr;
+		TA_cap_sink.close = nullptr;
+		TA_cap_drain_lock.unlock ();
+		}
+}							// End routine Capture::stop
+
+
+TA_RECORD *
+Capture::begin_record									// Reserve the next record in this thread's ring
+	(
+	_In_	uint8_t		Kind,							// TA_REC_PRE or TA_REC_POST
+	_In_	uint16_t	Api								// API number
+	)
+
+//
+// DESCRIPTION:		Return the next free record in the calling thread's ring, with its header filled in. The caller adds the
+//					arguments and then calls commit_record. This never blocks: if the ring is full, the record is dropped
+//
+// ASSUMPTIONS:		Called from an intercept, with capture enabled
+//
+// SIDE EFFECTS:	Allocates the thread's ring on its first call
+//
+// RETURN VALUES:
+//
+//		Record							Normal, successful completion
+//		nullptr							The record was dropped (ring full, ring not allocated, or already building a record)
+//
+
+{
+TA_RING		*ring = TA_cap_owner.ring;
+TA_RECORD	*record;
+uint32_t	head;
+
+
+	if (ring == nullptr && (ring = ring_create ()) == nullptr)
+		{
+		return nullptr;
+		}
+
+	//
+	// An intercept called while this thread is building a record (from a signal or APC, or from something the intercept
+	// itself calls) would be given the same record, so drop it
+	//
+
+	if (ring->busy)
+		{
+		ring->nested.store (ring->nested.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return nullptr;
+		}
+
+	head = ring->head.load (std::memory_order_relaxed);
+
+	if (head - ring->tail.load (std::memory_order_acquire) > ring->mask)
+		{
+		ring->overflows.store (ring->overflows.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return nullptr;
+		}
+
+	ring->busy = true;
+	ring->pending = 0;
+	record = &ring->records [head & ring->mask];
+	record->timestamp = read_ticks ();
+	record->thread_id = ring->thread_id;
+	record->api = Api;
+	record->kind = Kind;
+	record->arg_count = 0;
+	record->text_length = 0;
+	record->stack_id = 0;
+	return record;
+}							// End routine Capture::begin_record
+
+
+void
+Capture::commit_record									// Publish the record returned by begin_record
+	(
+	_In_	TA_RECORD	*Record							// Record to publish
+	)
+
+//
+// DESCRIPTION:		Make the record, and the data records added after it, visible to the drain thread. When this makes the ring
+//					half full, wake the drain thread rather than waiting for the end of its period
+//
+// ASSUMPTIONS:		Record was returned by begin_record on this thread
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_RING		*ring = TA_cap_owner.ring;
+uint32_t	added = 1 + ring->pending;
+uint32_t	head = ring->head.load (std::memory_order_relaxed) + added;
+uint32_t	used;
+
+
+	(void) Record;
+	ring->head.store (head, std::memory_order_release);
+	ring->busy = false;
+	used = head - ring->tail.load (std::memory_order_relaxed);
+
+	if (used >= (ring->mask + 1) / 2 && used - added < (ring->mask + 1) / 2)
+		{
+		TA_cap_wake.notify_one ();
+		}
+}							// End routine Capture::commit_record
+
+
+void
+Capture::set_text										// Store the first string argument
+	(
+	_In_		TA_RECORD	*Record,					// Record being built
+	_In_opt_z_	const char	*Text						// ANSI string
+	)
+
+//
+// DESCRIPTION:		Copy the start of the string into the record's text, if the record does not already have one. Each byte
+//					becomes one UTF-16 character
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint16_t	length = 0;
+
+
+	if (Text != nullptr && Record->text_length == 0)
+		{
+		while (length < TA_CAPTURE_MAX_TEXT && Text [length] != '\0')
+			{
+			Record->text [length] = (uint8_t) Text [length];
+			length++;
+			}
+
+		Record->text_length = length;
+		}
+}							// End routine Capture::set_text
+
+
+void
+Capture::set_text										// Store the first string argument
+	(
+	_In_		TA_RECORD		*Record,				// Record being built
+	_In_opt_z_	const wchar_t	*Text					// Wide string
+	)
+
+//
+// DESCRIPTION:		Copy the start of the string into the record's text, if the record does not already have one
+//
+// ASSUMPTIONS:		wchar_t is UTF-16 (Windows). In the Linux test build, characters are truncated to 16 bits
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint16_t	length = 0;
+
+
+	if (Text != nullptr && Record->text_length == 0)
+		{
+		while (length < TA_CAPTURE_MAX_TEXT && Text [length] != L'\0')
+			{
+			Record->text [length] = (uint16_t) Text [length];
+			length++;
+			}
+
+		Record->text_length = length;
+		}
+}							// End routine Capture::set_text
+
+
+void
+Capture::add_data										// Copy the first bytes of a buffer parameter into the ring
+	(
+	_In_	TA_RECORD	*Record,						// Record being built
+	_In_	uint8_t		Param,							// Parameter number
+	_In_	const void	*Data,							// Buffer (may be nullptr)
+	_In_	uint64_t	Size,							// Size of the buffer
+	_In_	uint32_t	Max								// Most bytes to capture (the parameter's rule)
+	)
+
+//
+// DESCRIPTION:		Copy the first data_length bytes of the buffer into the free records that follow Record, as TA_DATA_RECORDs,
+//					which commit_record publishes with it. No more than the free records are used, so a snapshot is cut short
+//					when the ring is nearly full. A buffer that cannot be read (the program passed a bad pointer, which the
+//					real API will reject) is cut short where the fault is
+//
+// ASSUMPTIONS:		Record was returned by begin_record on this thread, and has not been committed
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_RING				*ring = TA_cap_owner.ring;
+PTA_DATA_RECORD		slot;
+uint32_t			head = ring->head.load (std::memory_order_relaxed) + 1 + ring->pending;
+uint32_t			available = ring->mask + 1 - (head - ring->tail.load (std::memory_order_acquire));
+uint16_t			length = data_length (Data, Size, Max);
+uint16_t			offset = 0;
+uint16_t			count;
+
+
+	while (offset < length)
+		{
+		if (available == 0)
+			{
+			ring->truncated.store (ring->truncated.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			break;
+			}
+
+		slot = (PTA_DATA_RECORD) &ring->records [head++ & ring->mask];
+		count = std::min<uint16_t> (length - offset, TA_CAPTURE_SLOT_DATA);
+
+		if (!copy_data (slot->data, (const uint8_t *) Data + offset, count))
+			{
+			break;
+			}
+
+		slot->timestamp = Record->timestamp;
+		slot->thread_id = Record->thread_id;
+		slot->api = Record->api;
+		slot->kind = TA_REC_DATA;
+		slot->param = Param;
+		slot->length = count;
+		slot->offset = offset;
+		slot->size = (uint32_t) std::min<uint64_t> (Size, UINT32_MAX);
+		ring->pending++;
+		offset += count;
+		available--;
+		}
+}							// End routine Capture::add_data
+
+
+void
+Capture::set_data_limit									// Set the limit on the bytes captured from each buffer
+	(
+	_In_	uint32_t	Bytes							// Limit (0 captures no buffers; at most TA_CAPTURE_MAX_DATA)
+	)
+
+//
+// DESCRIPTION:		Set the most bytes that add_data, and the intercepts that write events to ETW, capture from any buffer,
+//					whatever the rule of its parameter allows
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	data_limit.store (std::min<uint32_t> (Bytes, TA_CAPTURE_MAX_DATA), std::memory_order_relaxed);
+}							// End routine Capture::set_data_limit
+
+
+uint64_t
+Capture::overflows										// Records dropped because a ring was full
+	(
+	)
+
+//
+// DESCRIPTION:		Return the number of records dropped because a ring was full, since the DLL was loaded
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Number of records
+//
+
+{
+TA_CAPTURE_STATS	stats;
+
+
+	get_stats (stats);
+	return stats.overflows;
+}							// End routine Capture::overflows
+
+
+void
+Capture::get_stats										// Get the capture statistics
+	(
+	_Out_	TA_CAPTURE_STATS&	Stats					// Statistics
+	)
+
+//
+// DESCRIPTION:		Return the statistics since the DLL was loaded. The producer counters are read from each ring, and may be a
+//					little behind the producers
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::lock_guard<std::timed_mutex>	lock (TA_cap_drain_lock);
+
+
+	Stats.records = TA_cap_records;
+	Stats.overflows = TA_cap_retired_overflows;
+	Stats.nested = TA_cap_retired_nested;
+	Stats.truncated = TA_cap_retired_truncated;
+	Stats.batches = TA_cap_batches;
+	Stats.sink_errors = TA_cap_sink_errors;
+	Stats.rings = TA_cap_rings_allocated.load ();
+	Stats.rings_live = TA_cap_rings_live.load ();
+
+	for (TA_RING *ring = TA_cap_rings.load (std::memory_order_acquire); ring != nullptr; ring = ring->next)
+		{
+		Stats.overflows += ring->overflows.load (std::memory_order_relaxed);
+		Stats.nested += ring->nested.load (std::memory_order_relaxed);
+		Stats.truncated += ring->truncated.load (std::memory_order_relaxed);
+		}
+}							// End routine Capture::get_stats
+
+
+uint64_t
+Capture::tick_frequency									// Timestamp ticks per second
+	(
+	)
+
+//
+// DESCRIPTION:		Return the frequency of the clock used for TA_RECORD.timestamp: the performance counter on Windows, and
+//					nanoseconds of CLOCK_MONOTONIC elsewhere
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Ticks per second
+//
+
+{
+#ifdef _WIN32
+LARGE_INTEGER	frequency;
+
+
+	QueryPerformanceFrequency (&frequency);
+	return (uint64_t) frequency.QuadPart;
+#else
+	return 1000000000;
+#endif
+}							// End routine Capture::tick_frequency
+
+
+uint64_t
+Capture::timestamp										// Read the timestamp clock
+	(
+	)
+
+//
+// DESCRIPTION:		Read the clock described by tick_frequency, the one used for TA_RECORD.timestamp
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Ticks
+//
+
+{
+	return read_ticks ();
+}							// End routine Capture::timestamp
+
+
+static
+bool
+file_sink_flush											// Write the encoded bytes to the file
+	(
+	PTA_FILE_SINK		Sink							// Sink
+	)
+
+//
+// DESCRIPTION:		Pass the bytes in the sink's buffer to stdio, and empty the buffer
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be written
+//
+
+{
+bool	ok;
+
+
+	ok = fwrite (Sink->buffer, 1, Sink->used, Sink->file) == Sink->used;
+	Sink->used = 0;
+	return ok;
+}							// End routine file_sink_flush
+
+
+static
+bool
+file_sink_put											// Append bytes to the sink's buffer
+	(
+	PTA_FILE_SINK		Sink,							// Sink
+	const void			*Data,							// Bytes to append
+	size_t				Length							// Number of bytes
+	)
+
+//
+// DESCRIPTION:		Copy the bytes into the buffer, writing it to the file whenever it fills
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be written
+//
+
+{
+const uint8_t	*data = (const uint8_t *) Data;
+size_t			count;
+bool			ok = true;
+
+
+	while (Length != 0)
+		{
+		if (Sink->used == sizeof (Sink->buffer))
+			{
+			ok &= file_sink_flush (Sink);
+			}
+
+		count = std::min (Length, sizeof (Sink->buffer) - Sink->used);
+		memcpy (Sink->buffer + Sink->used, data, count);
+		Sink->used += count;
+		data += count;
+		Length -= count;
+		}
+
+	return ok;
+}							// End routine file_sink_put
+
+
+static
+bool
+file_sink_put_string									// Append a length-prefixed string to the sink's buffer
+	(
+	PTA_FILE_SINK		Sink,							// Sink
+	const char			*String							// String (may be nullptr, which is written as empty)
+	)
+
+//
+// DESCRIPTION:		Append the length of the string as a varint, then its characters
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be written
+//
+
+{
+uint8_t		length [TA_TRACE_MAX_VARINT];
+size_t		size = String != nullptr ? strlen (String) : 0;
+
+
+	return file_sink_put (Sink, length, ta_put_varint (length, size) - length) & file_sink_put (Sink, String, size);
+}							// End routine file_sink_put_string
+
+
+static
+uint8_t *
+put_utf8												// Append a record's text, converted to UTF-8
+	(
+	uint8_t				*Buffer,						// Where to put it (at least 3 bytes per character)
+	const uint16_t		*Text,							// UTF-16 text
+	size_t				Length							// Number of characters
+	)
+
+//
+// DESCRIPTION:		Convert the text to UTF-8. A surrogate pair becomes one 4-byte character; an unpaired surrogate (including
+//					one split from its pair when the text was truncated) becomes U+FFFD
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Address following the text
+//
+
+{
+uint32_t	c;
+
+
+	for (size_t i = 0; i < Length; i++)
+		{
+		c = Text [i];
+
+		if (c >= 0xD800 && c <= 0xDFFF)
+			{
+			if (c <= 0xDBFF && i + 1 < Length && Text [i + 1] >= 0xDC00 && Text [i + 1] <= 0xDFFF)
+				{
+				c = 0x10000 + ((c - 0xD800) << 10) + (Text [++i] - 0xDC00);
+				}
+			else
+				{
+				c = 0xFFFD;
+				}
+			}
+
+		if (c < 0x80)
+			{
+			*Buffer++ = (uint8_t) c;
+			}
+		else if (c < 0x800)
+			{
+			*Buffer++ = (uint8_t) (0xC0 | (c >> 6));
+			*Buffer++ = (uint8_t) (0x80 | (c & 0x3F));
+			}
+		else if (c < 0x10000)
+			{
+			*Buffer++ = (uint8_t) (0xE0 | (c >> 12));
+			*Buffer++ = (uint8_t) (0x80 | ((c >> 6) & 0x3F));
+			*Buffer++ = (uint8_t) (0x80 | (c & 0x3F));
+			}
+		else
+			{
+			*Buffer++ = (uint8_t) (0xF0 | (c >> 18));
+			*Buffer++ = (uint8_t) (0x80 | ((c >> 12) & 0x3F));
+			*Buffer++ = (uint8_t) (0x80 | ((c >> 6) & 0x3F));
+			*Buffer++ = (uint8_t) (0x80 | (c & 0x3F));
+			}
+		}
+
+	return Buffer;
+}							// End routine put_utf8
+
+
+static
+bool
+file_sink_write											// Write a batch of records to a trace file
+	(
+	void				*Context,						// TA_FILE_SINK
+	const TA_RECORD		*Records,						// Records to write
+	size_t				Count							// Number of records
+	)
+
+//
+// DESCRIPTION:		Encode the records in the compact form described in TraceFormat.h, and write them to the file. The timestamp
+//					is the difference from the previous record's, and the thread ID is only written when it changes, which is
+//					once per batch. A TA_DATA_RECORD is written as a TA_REC_DATA record, with only the bytes it holds. The stack
+//					ID is written only when there is one
+//
+// ASSUMPTIONS:		Called from the drain thread, or from stop
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be written
+//
+
+{
+PTA_FILE_SINK		sink = (PTA_FILE_SINK) Context;
+const TA_RECORD		*record;
+PTA_DATA_RECORD		data;
+uint8_t				*out;
+uint8_t				text [TA_TRACE_MAX_TEXT * 3];
+size_t				length;
+uint8_t				flags;
+bool				ok = true;
+
+
+	for (size_t i = 0; i < Count; i++)
+		{
+		record = &Records [i];
+
+		if (sizeof (sink->buffer) - sink->used < CAP_FILE_MAX_RECORD)
+			{
+			ok &= file_sink_flush (sink);
+			}
+
+		out = sink->buffer + sink->used;
+		flags = record->kind & TA_TRF_KIND_MASK;
+
+		if (!sink->thread_known || record->thread_id != sink->last_thread)
+			{
+			flags |= TA_TRF_THREAD;
+			}
+
+		if (record->text_length != 0 && record->kind != TA_REC_DATA)
+			{
+			flags |= TA_TRF_TEXT;
+			}
+
+		if (record->stack_id != 0 && record->kind != TA_REC_DATA)
+			{
+			flags |= TA_TRF_STACK;
+			}
+
+		*out++ = flags;
+		out = ta_put_varint (out, record->api);
+		out = ta_put_varint (out, ta_zigzag ((int64_t) (record->timestamp - sink->last_timestamp)));
+
+		if (flags & TA_TRF_THREAD)
+			{
+			out = ta_put_varint (out, record->thread_id);
+			}
+
+		if (flags & TA_TRF_STACK)
+			{
+			out = ta_put_varint (out, record->stack_id);
+			}
+
+		if (record->kind == TA_REC_DATA)
+			{
+			data = (PTA_DATA_RECORD) record;
+			length = std::min<size_t> (data->length, TA_TRACE_MAX_DATA);
+			*out++ = data->param;
+			out = ta_put_varint (out, data->offset);
+			out = ta_put_varint (out, data->size);
+			out = ta_put_varint (out, length);
+			memcpy (out, data->data, length);
+			out += length;
+			}
+		else
+			{
+			*out++ = record->arg_count;
+
+			for (uint8_t arg = 0; arg < record->arg_count; arg++)
+				{
+				out = ta_put_varint (out, record->args [arg]);
+				}
+			}
+
+		if (flags & TA_TRF_TEXT)
+			{
+			length = put_utf8 (text, record->text, std::min<size_t> (record->text_length, TA_TRACE_MAX_TEXT)) - text;
+			out = ta_put_varint (out, length);
+			memcpy (out, text, length);
+			out += length;
+			}
+
+		sink->used = out - sink->buffer;
+		sink->last_timestamp = record->timestamp;
+		sink->last_thread = record->thread_id;
+		sink->thread_known = true;
+		}
+
+	ok &= file_sink_flush (sink);
+	return ok;
+}							// End routine file_sink_write
+
+
+static
+void
+file_sink_close											// Flush and close a trace file
+	(
+	void				*Context						// TA_FILE_SINK
+	)
+
+//
+// DESCRIPTION:		Close the file and free the sink
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+PTA_FILE_SINK	sink = (PTA_FILE_SINK) Context;
+
+
+	file_sink_flush (sink);
+	fclose (sink->file);
+	delete sink;
+}							// End routine file_sink_close
+
+
+bool
+Capture::open_file_sink									// Create a trace file and a sink that writes to it
+	(
+	_In_z_	const char				*File_name,			// File to create
+	_In_	const TA_API_SCHEMA		*Schema,			// APIs, indexed by API number
+	_In_	uint32_t				Api_count,			// Entries in Schema
+	_Out_	TA_SINK&				Sink				// Sink to pass to start
+	)
+
+//
+// DESCRIPTION:		Create the file, and write its TA_TRACE_HEADER and the schema of each API, so the file can be decoded
+//					without this process
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be created
+//
+
+{
+TA_TRACE_HEADER			header = {};
+PTA_FILE_SINK			sink;
+const TA_PARAM_SCHEMA	*param;
+uint8_t					count;
+bool					ok;
+
+
+	if ((sink = new (std::nothrow) TA_FILE_SINK) == nullptr)
+		{
+		return false;
+		}
+
+	if ((sink->file = fopen (File_name, "wb")) == nullptr)
+		{
+		delete sink;
+		return false;
+		}
+
+	sink->last_timestamp = read_ticks ();
+	sink->last_thread = 0;
+	sink->thread_known = false;
+	sink->used = 0;
+
+	memcpy (header.magic, TA_TRACE_MAGIC, sizeof (header.magic));
+	header.header_size = sizeof (header);
+	header.version = TA_TRACE_VERSION;
+	header.tick_frequency = tick_frequency ();
+	header.start_timestamp = sink->last_timestamp;
+#ifdef _WIN32
+	header.process_id = GetCurrentProcessId ();
+#else
+	header.process_id = (uint32_t) getpid ();
+#endif
+	header.api_count = Schema != nullptr ? Api_count : 0;
+
+	ok = file_sink_put (sink, &header, sizeof (header));
+
+	for (uint32_t api = 0; api < header.api_count; api++)
+		{
+		ok &= file_sink_put_string (sink, Schema [api].name);
+		param = Schema [api].params;
+
+		//
+		// The pre-call list, then the post-call list, each ended by TA_PT_END
+		//
+
+		for (int list = 0; list < 2; list++)
+			{
+			for (count = 0; param != nullptr && param [count].type != TA_PT_END; count++)
+				{
+				}
+
+			ok &= file_sink_put (sink, &count, 1);
+
+			for (uint8_t i = 0; i < count; i++, param++)
+				{
+				ok &= file_sink_put (sink, &param->type, 1);
+				ok &= file_sink_put_string (sink, param->name);
+				}
+
+			if (param != nullptr)
+				{
+				param++;
+				}
+			}
+		}
+
+	if (!(ok && file_sink_flush (sink)))
+		{
+		fclose (sink->file);
+		delete sink;
+		return false;
+		}
+
+	Sink.write = file_sink_write;
+	Sink.close = file_sink_close;
+	Sink.context = sink;
+	return true;
+}							// End routine Capture::open_file_sink
+
+
+TA_RING_OWNER::~TA_RING_OWNER						// Called when the thread exits
+	(
+	)
+
+//
+// DESCRIPTION:		Mark the thread's ring closed, so the drain thread frees it once it is empty
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	if (ring != nullptr)
+		{
+		ring->closed.store (true, std::memory_order_release);
+		TA_cap_rings_live--;
+		}
+}							// End routine TA_RING_OWNER::~TA_RING_OWNER
+
+
+static
+TA_RING *
+ring_create												// Allocate a ring for the calling thread
+	(
+	)
+
+//
+// DESCRIPTION:		Allocate a ring, and push it onto the front of the list
+//
+// ASSUMPTIONS:		The thread does not have a ring
+//
+// SIDE EFFECTS:	Preserves the thread's last error status, because this is called before the real API
+//
+// RETURN VALUES:
+//
+//		Ring							Normal, successful completion
+//		nullptr							Out of memory
+//
+
+{
+#ifdef _WIN32
+DWORD		last_error = GetLastError ();
+#endif
+TA_RING		*ring = new (std::nothrow) TA_RING;
+TA_RING		*first;
+
+
+	if (ring != nullptr && (ring->records = new (std::nothrow) TA_RECORD [TA_cap_ring_records]) == nullptr)
+		{
+		delete ring;
+		ring = nullptr;
+		}
+
+	if (ring != nullptr)
+		{
+		ring->head.store (0, std::memory_order_relaxed);
+		ring->tail.store (0, std::memory_order_relaxed);
+		ring->busy = false;
+		ring->overflows.store (0, std::memory_order_relaxed);
+		ring->nested.store (0, std::memory_order_relaxed);
+		ring->truncated.store (0, std::memory_order_relaxed);
+		ring->closed.store (false, std::memory_order_relaxed);
+		ring->mask = TA_cap_ring_records - 1;
+#ifdef _WIN32
+		ring->thread_id = GetCurrentThreadId ();
+#else
+		ring->thread_id = (uint32_t) syscall (SYS_gettid);
+#endif
+
+		TA_cap_owner.ring = ring;
+		TA_cap_rings_allocated++;
+		TA_cap_rings_live++;
+
+		first = TA_cap_rings.load (std::memory_order_relaxed);
+
+		do
+			{
+			ring->next = first;
+			}
+		while (!TA_cap_rings.compare_exchange_weak (first, ring, std::memory_order_release, std::memory_order_relaxed));
+		}
+
+#ifdef _WIN32
+	SetLastError (last_error);
+#endif
+	return ring;
+}							// End routine ring_create
+
+
+static
+size_t
+drain_rings												// Send everything in the rings to the sink
+	(
+	)
+
+//
+// DESCRIPTION:		Send the new stacks, then pass the records in each ring to the sink, in at most two batches per ring (the
+//					ring may wrap). Then free the rings of threads that have exited, once they are empty
+//
+// ASSUMPTIONS:		The caller holds TA_cap_drain_lock
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Number of records drained
+//
+
+{
+TA_RING		*previous = nullptr;
+TA_RING		*ring;
+TA_RING		*next;
+size_t		drained = 0;
+uint32_t	head;
+uint32_t	tail;
+uint32_t	index;
+uint32_t	count;
+
+
+	if (TA_cap_sink.write == nullptr)
+		{
+		return 0;
+		}
+
+	drain_stacks ();
+
+	for (ring = TA_cap_rings.load (std::memory_order_acquire); ring != nullptr; ring = next)
+		{
+		next = ring->next;
+		tail = ring->tail.load (std::memory_order_relaxed);
+		head = ring->head.load (std::memory_order_acquire);
+
+		while (tail != head)
+			{
+			index = tail & ring->mask;
+			count = head - tail;
+
+			if (count > ring->mask + 1 - index)
+				{
+				count = ring->mask + 1 - index;
+				}
+
+			if (!TA_cap_sink.write (TA_cap_sink.context, &ring->records [index], count))
+				{
+				TA_cap_sink_errors++;
+				}
+
+			TA_cap_records += count;
+			TA_cap_batches++;
+			drained += count;
+			tail += count;
+			ring->tail.store (tail, std::memory_order_release);
+			}
+
+		//
+		// Free the ring if its thread has exited and it is empty (closed is set after the thread's last commit)
+		//
+
+		if (previous != nullptr && ring->closed.load (std::memory_order_acquire) && ring->head.load (std::memory_order_acquire) == tail)
+			{
+			previous->next = next;
+			TA_cap_retired_overflows += ring->overflows.load (std::memory_order_relaxed);
+			TA_cap_retired_nested += ring->nested.load (std::memory_order_relaxed);
+			TA_cap_retired_truncated += ring->truncated.load (std::memory_order_relaxed);
+			delete [] ring->records;
+			delete ring;
+			}
+		else
+			{
+			previous = ring;
+			}
+		}
+
+	return drained;
+}							// End routine drain_rings
+
+
+static
+void
+drain_stacks											// Send the stacks not yet sent to the sink
+	(
+	)
+
+//
+// DESCRIPTION:		Pass the stacks added to StackTable since the last call to the sink, in batches of CAP_STACK_BATCH records.
+//					They are timestamped now, with thread ID 0
+//
+// ASSUMPTIONS:		The caller holds TA_cap_drain_lock
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint32_t	count;
+uint64_t	now;
+
+
+	if (TA_cap_sink.write == nullptr)
+		{
+		return;
+		}
+
+	while ((count = StackTable::flush (TA_cap_stacks, CAP_STACK_BATCH)) != 0)
+		{
+		now = read_ticks ();
+
+		for (uint32_t i = 0; i < count; i++)
+			{
+			TA_cap_stacks [i].timestamp = now;
+			}
+
+		if (!TA_cap_sink.write (TA_cap_sink.context, TA_cap_stacks, count))
+			{
+			TA_cap_sink_errors++;
+			}
+
+		TA_cap_records += count;
+		TA_cap_batches++;
+		}
+}							// End routine drain_stacks
+
+
+static
+void
+drain_thread											// Body of the drain thread
+	(
+	)
+
+//
+// DESCRIPTION:		Drain the rings until stop is called. When a pass finds nothing, sleep for the drain period, or until a
+//					producer's ring is half full
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+size_t	drained;
+
+
+	//
+	// The sink may call APIs that are intercepted (a file sink calls WriteFile), which must not be captured again
+	//
+
+	Intercept::exclude_thread ();
+
+	for (;;)
+		{
+		{
+		std::lock_guard<std::timed_mutex>	lock (TA_cap_drain_lock);
+
+		drained = drain_rings ();
+		}
+
+		std::unique_lock<std::mutex>	lock (TA_cap_wake_lock);
+
+		if (TA_cap_stopping)
+			{
+			break;
+			}
+
+		if (drained == 0)
+			{
+			TA_cap_wake.wait_for (lock, std::chrono::milliseconds (TA_cap_drain_period_ms));
+			}
+		}
+
+	TA_cap_thread_done.store (true);
+}							// End routine drain_thread
+
+
+static
+inline
+uint64_t
+read_ticks												// Read the timestamp clock
+	(
+	)
+
+//
+// DESCRIPTION:		Read the clock described by Capture::tick_frequency
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Ticks
+//
+
+{
+#ifdef _WIN32
+LARGE_INTEGER	ticks;
+
+
+	QueryPerformanceCounter (&ticks);
+	return (uint64_t) ticks.QuadPart;
+#else
+struct timespec	now;
+
+
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}							// End routine read_ticks
+
+
+static
+bool
+copy_data												// Copy bytes that the traced program passed to an API
+	(
+	void			*To,								// Where to put them
+	const void		*From,								// Bytes to copy
+	size_t			Length								// Number of bytes
+	)
+
+//
+// DESCRIPTION:		Copy the bytes. On Windows, an access violation (the program passed a bad pointer) is caught, so that the
+//					intercept does not crash a program that the real API would only have returned an error to
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The bytes could not be read
+//
+
+{
+#ifdef _WIN32
+	__try
+		{
+		memcpy (To, From, Length);
+		}
+	__except (GetExceptionCode () == EXCEPTION_ACCESS_VIOLATION ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+		{
+		return false;
+		}
+
+	return true;
+#else
+	memcpy (To, From, Length);
+	return true;
+#endif
+}							// End routine copy_data
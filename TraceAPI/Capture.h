@@ -0,0 +1,359 @@
+//
+// FACILITY:	Capture - In-process capture of intercept events
+//
+// DESCRIPTION:	In capture mode, an intercept does not write its events to ETW itself. Instead it appends a fixed-layout binary
+//				record to a single-producer, single-consumer ring buffer owned by the calling thread, and a drain thread sends the
+//				records to a sink in batches. The sink is either ETW (see DLLMain.cpp) or a file, which also works on Linux, where
+//				this module is built by TraceAPI/GNUmakefile for testing.
+//
+//				An intercept never blocks. When its ring is full, the record is dropped and counted as an overflow
+//
+//				An intercept can also capture the first bytes of a buffer parameter (the data of ReadFile and WriteFile, or a
+//				structure an API fills in). The bytes are copied once, straight into TA_DATA_RECORDs that follow the call's record
+//				in the ring, and are published with it. The size of each snapshot is limited by its rule in the generated code,
+//				and by a limit that applies to every buffer (set_data_limit)
+//
+//				A record can carry the ID of the call's stack in StackTable (set_stack). The drain thread sends the stacks added
+//				since its last pass to the sink, as TA_REC_STACK records, before the records in the rings
+//
+// VERSION:		1.4
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.4		2026-10-17	Brian Catlin
+//			Added a stack ID to TA_RECORD, and set_stack
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Added add_data, data_length and set_data_limit, which capture the contents of buffer parameters
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Added timestamp, so that Stats times calls with the same clock
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Records identify the API by its number in the generated schema, and the file sink writes the compact format
+//			described in TraceFormat.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//
+// Project includes
+//
+
+#include "TraceFormat.h"
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux test build
+#define	_In_
+#define	_In_z_
+#define	_In_opt_z_
+#define	_Out_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_CAPTURE_MAX_ARGS		TA_TRACE_MAX_ARGS		// Argument values in a record
+#define	TA_CAPTURE_MAX_TEXT		TA_TRACE_MAX_TEXT		// UTF-16 characters of string argument in a record
+#define	TA_CAPTURE_SLOT_DATA	TA_TRACE_MAX_DATA		// Bytes of a buffer in one TA_DATA_RECORD
+#define	TA_CAPTURE_MAX_DATA		4096					// Largest limit on the bytes captured from one buffer
+#define	TA_CAPTURE_DATA_LIMIT	1024					// Default limit
+
+//
+// TYPES:
+//
+
+//
+// A capture record. The layout is the same in the rings and in the batches passed to a sink. The file sink writes the
+// records in the compact form described in TraceFormat.h
+//
+
+typedef struct _TA_RECORD
+	{
+	uint64_t	timestamp;								// Ticks; see Capture::tick_frequency
+	uint32_t	thread_id;								// Thread that made the call
+	uint16_t	api;									// API number: the index of its entry in the schema
+	uint8_t		kind;									// TA_REC_xxx
+	uint8_t		arg_count;								// Entries used in args
+	uint16_t	text_length;							// Characters used in text
+	uint16_t	reserved;
+	uint32_t	stack_id;								// Call's stack in StackTable (0 if none); the ID a TA_REC_STACK defines
+	uint64_t	args [TA_CAPTURE_MAX_ARGS];				// Raw (little-endian) argument values
+	uint16_t	text [TA_CAPTURE_MAX_TEXT];				// First string argument, truncated
+	} TA_RECORD, *PTA_RECORD;
+
+static_assert (sizeof (TA_RECORD) == 256, "TA_RECORD must stay 256 bytes");
+
+//
+// Part of a snapshot of a buffer parameter. It takes the place of a TA_RECORD in the ring, following the record of its call,
+// and has the same header, up to kind
+//
+
+typedef struct _TA_DATA_RECORD
+	{
+	uint64_t	timestamp;								// Same as the call's record
+	uint32_t	thread_id;								// Same as the call's record
+	uint16_t	api;									// Same as the call's record
+	uint8_t		kind;									// TA_REC_DATA
+	uint8_t		param;									// Parameter number: its index in the API's parameter list
+	uint16_t	length;									// Bytes used in data
+	uint16_t	offset;									// Offset of data in the buffer
+	uint32_t	size;									// Size of the buffer, before the limits were applied
+	uint8_t		data [TA_CAPTURE_SLOT_DATA];			// Contents of the buffer
+	} TA_DATA_RECORD, *PTA_DATA_RECORD;
+
+static_assert (sizeof (TA_DATA_RECORD) == sizeof (TA_RECORD), "A TA_DATA_RECORD takes the place of a TA_RECORD");
+static_assert (TA_CAPTURE_MAX_DATA <= UINT16_MAX, "TA_DATA_RECORD.offset is 16 bits");
+
+//
+// A sink receives batches of records from the drain thread. Records in one batch are from one thread, in order. A record
+// whose kind is TA_REC_DATA is a TA_DATA_RECORD; the drain thread may pass it in the batch after its call's record. A batch
+// of TA_REC_STACK records has thread ID 0
+//
+
+typedef bool (*TA_SINK_WRITE)							// Write a batch of records
+	(
+	void				*Context,						// Sink context
+	const TA_RECORD		*Records,						// Records to write
+	size_t				Count							// Number of records
+	);
+
+typedef void (*TA_SINK_CLOSE)							// Flush and close the sink
+	(
+	void				*Context						// Sink context
+	);
+
+typedef struct _TA_SINK
+	{
+	TA_SINK_WRITE		write;							// Called from the drain thread
+	TA_SINK_CLOSE		close;							// Called by Capture::stop; may be nullptr
+	void				*context;						// Passed to write and close
+	} TA_SINK, *PTA_SINK;
+
+typedef struct _TA_CAPTURE_CONFIG
+	{
+	uint32_t			ring_records;					// Records in each thread's ring (rounded up to a power of 2)
+	uint32_t			drain_period_ms;				// Longest time a record waits in a ring
+	TA_SINK				sink;							// Where the records go
+	} TA_CAPTURE_CONFIG, *PTA_CAPTURE_CONFIG;
+
+typedef struct _TA_CAPTURE_STATS
+	{
+	uint64_t			records;						// Records passed to the sink
+	uint64_t			overflows;						// Records dropped because a ring was full
+	uint64_t			nested;							// Records dropped because the thread was already building one
+	uint64_t			truncated;						// Buffer snapshots cut short because the ring was nearly full
+	uint64_t			batches;						// Calls to the sink's write routine
+	uint64_t			sink_errors;					// Batches the sink failed to write
+	uint32_t			rings;							// Rings allocated
+	uint32_t			rings_live;						// Rings still owned by a thread
+	} TA_CAPTURE_STATS, *PTA_CAPTURE_STATS;
+
+//
+// DECLARATIONS:
+//
+
+class Capture
+{
+public:
+
+	//
+	// Public methods
+	//
+
+	static
+	bool
+	start												// Start capturing and the drain thread
+		(
+		_In_	const TA_CAPTURE_CONFIG&	Config		// Ring size, drain period and sink
+		);
+
+	static
+	void
+	stop												// Stop capturing, drain the rings and close the sink
+		(
+		_In_	bool	Join_thread						// Wait for the drain thread (must be false under the loader lock)
+		);
+
+	static
+	inline
+	bool
+	enabled												// Determine whether intercepts should capture
+		(
+		)
+		{
+		return capture_enabled.load (std::memory_order_relaxed);
+		}
+
+	static
+	TA_RECORD *
+	begin_record										// Reserve the next record in this thread's ring
+		(
+		_In_	uint8_t		Kind,						// TA_REC_PRE or TA_REC_POST
+		_In_	uint16_t	Api							// API number
+		);
+
+	static
+	void
+	commit_record										// Publish the record returned by begin_record
+		(
+		_In_	TA_RECORD	*Record						// Record to publish
+		);
+
+	template <typename T>
+	static
+	inline
+	void
+	add_arg												// Append the raw value of an argument (at most 8 bytes of it)
+		(
+		_In_	TA_RECORD	*Record,					// Record being built
+		_In_	const T&	Value						// Argument
+		)
+		{
+		uint64_t	raw = 0;
+
+
+		if (Record->arg_count < TA_CAPTURE_MAX_ARGS)
+			{
+			memcpy (&raw, &Value, sizeof (T) < sizeof (raw) ? sizeof (T) : sizeof (raw));
+			Record->args [Record->arg_count++] = raw;
+			}
+		}
+
+	static
+	void
+	set_text											// Store the first string argument
+		(
+		_In_		TA_RECORD	*Record,				// Record being built
+		_In_opt_z_	const char	*Text					// ANSI string
+		);
+
+	static
+	void
+	set_text											// Store the first string argument
+		(
+		_In_		TA_RECORD		*Record,			// Record being built
+		_In_opt_z_	const wchar_t	*Text				// Wide string
+		);
+
+	static
+	inline
+	void
+	set_stack											// Store the ID of the call's stack
+		(
+		_In_	TA_RECORD	*Record,					// Record being built
+		_In_	uint32_t	Stack_id					// From StackTable::capture (0 if none)
+		)
+		{
+		Record->stack_id = Stack_id;
+		}
+
+	static
+	void
+	add_data											// Copy the first bytes of a buffer parameter into the ring
+		(
+		_In_	TA_RECORD	*Record,					// Record being built
+		_In_	uint8_t		Param,						// Parameter number
+		_In_	const void	*Data,						// Buffer (may be nullptr)
+		_In_	uint64_t	Size,						// Size of the buffer
+		_In_	uint32_t	Max							// Most bytes to capture (the parameter's rule)
+		);
+
+	static
+	inline
+	uint16_t
+	data_length											// Number of bytes of a buffer to capture
+		(
+		_In_	const void	*Data,						// Buffer (may be nullptr)
+		_In_	uint64_t	Size,						// Size of the buffer
+		_In_	uint32_t	Max							// Most bytes to capture (the parameter's rule)
+		)
+		{
+		uint64_t	limit = data_limit.load (std::memory_order_relaxed);
+
+
+		if (Max < limit)
+			{
+			limit = Max;
+			}
+
+		return Data == nullptr ? 0 : (uint16_t) (Size < limit ? Size : limit);
+		}
+
+	static
+	void
+	set_data_limit										// Set the limit on the bytes captured from each buffer
+		(
+		_In_	uint32_t	Bytes						// Limit (0 captures no buffers; at most TA_CAPTURE_MAX_DATA)
+		);
+
+	static
+	uint64_t
+	overflows											// Records dropped because a ring was full
+		(
+		);
+
+	static
+	void
+	get_stats											// Get the capture statistics
+		(
+		_Out_	TA_CAPTURE_STATS&	Stats				// Statistics
+		);
+
+	static
+	uint64_t
+	tick_frequency										// Timestamp ticks per second
+		(
+		);
+
+	static
+	uint64_t
+	timestamp											// Read the timestamp clock
+		(
+		);
+
+	static
+	bool
+	open_file_sink										// Create a trace file and a sink that writes to it
+		(
+		_In_z_	const char				*File_name,		// File to create
+		_In_	const TA_API_SCHEMA		*Schema,		// APIs, indexed by API number
+		_In_	uint32_t				Api_count,		// Entries in Schema
+		_Out_	TA_SINK&				Sink			// Sink to pass to start
+		);
+
+private:
+
+	static std::atomic<bool>		capture_enabled;	// Read by every intercept
+	static std::atomic<uint32_t>	data_limit;			// Most bytes captured from a buffer
+
+};	// End class Capture
+
+}	// End of namespace FDI
@@ -0,0 +1,692 @@
+//
+// FACILITY:	Control - Runtime control channel for the intercepts
+//
+// DESCRIPTION:	This module contains the implementation of the Control class: the serving thread that TraceAPI runs, and the
+//				routines a controller uses to write commands and wait for their results. The serving thread keeps its own copy
+//				of the tail, so a controller that scribbles on the block can stall the ring, but cannot make TraceAPI run a
+//				command twice or read outside the block.
+//
+//				This module uses only standard C++, so that it can be built and tested on Linux. It does not use WPP; DLLMain.cpp
+//				logs the commands
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+//
+// Project includes
+//
+
+#include "Control.h"
+#include "Attach.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	CTL_STOP_WAIT_MS		1000					// Longest stop waits for the serving thread
+#define	CTL_WAIT_POLL_US		100						// Time between a controller's checks of its command
+
+//
+// DECLARATIONS:
+//
+
+static TA_CONTROL_BLOCK			*TA_ctl_block = nullptr;		// Ring being served
+static TA_CONTROL_CONFIG		TA_ctl_config;					// Configuration passed to start
+static uint32_t					TA_ctl_tail = 0;				// Next position to run (the block's tail is only a copy)
+
+static std::mutex				TA_ctl_wake_lock;				// Protects TA_ctl_stopping for the condition variable
+static std::condition_variable	TA_ctl_wake;					// Wakes the serving thread early
+static bool						TA_ctl_stopping = false;		// Tells the serving thread to exit
+static std::atomic<bool>		TA_ctl_thread_done (true);		// The serving thread has left its loop
+static std::thread				TA_ctl_thread;					// The serving thread
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+TA_CONTROL_STATUS
+run_command												// Run one command
+	(
+	_In_	uint16_t		Opcode,						// TA_CONTROL_OPCODES
+	_In_	uint32_t		Api,						// API number or TA_ALL_APIS (already looked up, if by name)
+	_Out_	uint32_t&		Value						// Value returned by the command
+	);
+
+static
+uint32_t
+lookup_name												// Find an API by name
+	(
+	_In_	const char		*Name						// API name
+	);
+
+static
+void
+serve_thread											// Body of the serving thread
+	(
+	);
+
+
+
+void
+Control::init_block										// Initialize the shared memory
+	(
+	_Out_	void			*Memory,					// sizeof (TA_CONTROL_BLOCK) bytes
+	_In_	uint32_t		Api_count					// Number of APIs
+	)
+
+//
+// DESCRIPTION:		Construct the block in the memory, with every slot free for its first lap. The magic number is written last,
+//					so a controller that opens the block early sees that it is not ready
+//
+// ASSUMPTIONS:		Nothing is using the memory
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_CONTROL_BLOCK	*block = new (Memory) TA_CONTROL_BLOCK;
+
+
+	block->version = TA_CONTROL_VERSION;
+	block->slots = TA_CONTROL_SLOTS;
+	block->api_count = Api_count;
+	block->served.store (0, std::memory_order_relaxed);
+	block->head.store (0, std::memory_order_relaxed);
+	block->tail.store (0, std::memory_order_relaxed);
+
+	for (uint32_t i = 0; i < TA_CONTROL_SLOTS; i++)
+		{
+		block->commands [i].sequence.store (i, std::memory_order_relaxed);
+		block->commands [i].version = 0;
+		block->commands [i].opcode = 0;
+		block->commands [i].api = 0;
+		block->commands [i].result.store (TA_CTL_OK, std::memory_order_relaxed);
+		block->commands [i].value.store (0, std::memory_order_relaxed);
+		block->commands [i].name [0] = '\0';
+		}
+
+	std::atomic_thread_fence (std::memory_order_release);
+	block->magic = TA_CONTROL_MAGIC;
+}							// End routine Control::init_block
+
+
+bool
+Control::start											// Start the thread that serves the ring
+	(
+	_In_	TA_CONTROL_BLOCK			*Block,			// Ring, initialized by init_block
+	_In_	const TA_CONTROL_CONFIG&	Config			// Names of the APIs, poll period and report routine
+	)
+
+//
+// DESCRIPTION:		Remember the ring and start the thread that serves it every poll_ms
+//
+// ASSUMPTIONS:		Control is not running
+//
+// SIDE EFFECTS:	Creates a thread
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							There is no ring or schema, or the thread could not be created
+//
+
+{
+	if (Block == nullptr || Config.schema == nullptr || TA_ctl_thread.joinable ())
+		{
+		return false;
+		}
+
+	TA_ctl_block = Block;
+	TA_ctl_config = Config;
+	TA_ctl_config.poll_ms = Config.poll_ms != 0 ? Config.poll_ms : 50;
+	TA_ctl_tail = Block->tail.load (std::memory_order_relaxed);
+	TA_ctl_stopping = false;
+	TA_ctl_thread_done = false;
+
+	try
+		{
+		TA_ctl_thread = std::thread (serve_thread);
+		}
+	catch (...)
+		{
+		TA_ctl_thread_done = true;
+		return false;
+		}
+
+	return true;
+}							// End routine Control::start
+
+
+bool
+Control::stop											// Stop the serving thread
+	(
+	_In_	bool		Join_thread						// Wait for the thread (must be false under the loader lock)
+	)
+
+//
+// DESCRIPTION:		Tell the serving thread to exit, and wait for it. Commands that are still in the ring are not run; a controller
+//					waiting for one times out.
+//
+//					Under the loader lock (in DllMain) a thread cannot exit, so it cannot be joined; instead, wait a short time for
+//					it to leave its loop
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The thread has left its loop (or was never started)
+//		false							It had not, after CTL_STOP_WAIT_MS; it may still be reading the ring
+//
+
+{
+	{
+	std::lock_guard<std::mutex>	lock (TA_ctl_wake_lock);
+
+	TA_ctl_stopping = true;
+	}
+
+	TA_ctl_wake.notify_all ();
+
+	if (TA_ctl_thread.joinable ())
+		{
+		if (Join_thread)
+			{
+			TA_ctl_thread.join ();
+			}
+		else
+			{
+			auto	give_up = std::chrono::steady_clock::now () + std::chrono::milliseconds (CTL_STOP_WAIT_MS);
+
+			while (!TA_ctl_thread_done.load () && std::chrono::steady_clock::now () < give_up)
+				{
+				std::this_thread::sleep_for (std::chrono::milliseconds (1));
+				}
+
+			TA_ctl_thread.detach ();
+			}
+		}
+
+	return TA_ctl_thread_done.load ();
+}							// End routine Control::stop
+
+
+uint32_t
+Control::serve											// Run the commands in the ring
+	(
+	)
+
+//
+// DESCRIPTION:		Run each command that has been published at the tail, in order: check its version and opcode, look up its
+//					API, run it, write its result and value, then free the slot
+//
+// ASSUMPTIONS:		Called only by the serving thread (or, in a test, by one thread while the serving thread is not running)
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Number of commands run
+//
+
+{
+TA_CONTROL_COMMAND	*slot;
+TA_CONTROL_STATUS	result;
+char				name [TA_CONTROL_MAX_NAME];
+uint32_t			value;
+uint32_t			api;
+uint16_t			opcode;
+uint16_t			version;
+uint32_t			count = 0;
+
+
+	if (TA_ctl_block == nullptr)
+		{
+		return 0;
+		}
+
+	for (;;)
+		{
+		slot = &TA_ctl_block->commands [TA_ctl_tail & (TA_CONTROL_SLOTS - 1)];
+
+		if (slot->sequence.load (std::memory_order_acquire) != TA_ctl_tail + 1)
+			{
+			break;
+			}
+
+		//
+		// Copy the command out of the shared memory before checking it, so the controller cannot change it in between
+		//
+
+		version = slot->version;
+		opcode = slot->opcode;
+		api = slot->api;
+		memcpy (name, slot->name, sizeof (name));
+		name [sizeof (name) - 1] = '\0';
+		value = 0;
+
+		if (version == 0 || version > TA_CONTROL_VERSION)
+			{
+			result = TA_CTL_BAD_VERSION;
+			}
+		else if (opcode >= TA_CTL_OPCODE_COUNT)
+			{
+			result = TA_CTL_BAD_OPCODE;
+			}
+		else
+			{
+			if (api == TA_CONTROL_BY_NAME)
+				{
+				api = lookup_name (name);
+				}
+
+			result = run_command (opcode, api, value);
+			}
+
+		slot->result.store (result, std::memory_order_relaxed);
+		slot->value.store (value, std::memory_order_relaxed);
+		slot->sequence.store (TA_ctl_tail + TA_CONTROL_SLOTS, std::memory_order_release);
+
+		TA_ctl_tail++;
+		TA_ctl_block->tail.store (TA_ctl_tail, std::memory_order_relaxed);
+		TA_ctl_block->served.fetch_add (1, std::memory_order_relaxed);
+		count++;
+
+		if (TA_ctl_config.report != nullptr)
+			{
+			TA_ctl_config.report (opcode, api, result, value);
+			}
+		}
+
+	return count;
+}							// End routine Control::serve
+
+
+bool
+Control::post											// Write a command to the ring
+	(
+	_Inout_		TA_CONTROL_BLOCK&	Block,				// Ring
+	_In_		uint16_t			Opcode,				// TA_CONTROL_OPCODES
+	_In_		uint32_t			Api,				// API number, TA_ALL_APIS, or TA_CONTROL_BY_NAME
+	_In_opt_z_	const char			*Name,				// API name (when Api is TA_CONTROL_BY_NAME)
+	_Out_		uint32_t&			Position			// Position of the command, for wait
+	)
+
+//
+// DESCRIPTION:		Claim the slot at the head, fill it in, and publish it. Any number of controllers (threads or processes) can
+//					post at once
+//
+// ASSUMPTIONS:		The block has the magic number and version this module knows
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The command is in the ring
+//		false							The ring is full
+//
+
+{
+TA_CONTROL_COMMAND	*slot;
+uint32_t			position = Block.head.load (std::memory_order_relaxed);
+int32_t				lap;
+
+
+	for (;;)
+		{
+		slot = &Block.commands [position & (TA_CONTROL_SLOTS - 1)];
+		lap = (int32_t) (slot->sequence.load (std::memory_order_acquire) - position);
+
+		if (lap == 0)
+			{
+			if (Block.head.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+				{
+				break;
+				}
+			}
+		else if (lap < 0)
+			{
+			return false;
+			}
+		else
+			{
+			position = Block.head.load (std::memory_order_relaxed);
+			}
+		}
+
+	slot->version = TA_CONTROL_VERSION;
+	slot->opcode = Opcode;
+	slot->api = Api;
+	slot->name [0] = '\0';
+
+	if (Name != nullptr)
+		{
+		strncpy (slot->name, Name, sizeof (slot->name) - 1);
+		slot->name [sizeof (slot->name) - 1] = '\0';
+		}
+
+	slot->sequence.store (position + 1, std::memory_order_release);
+	Position = position;
+	return true;
+}							// End routine Control::post
+
+
+TA_CONTROL_STATUS
+Control::wait											// Wait for a command's result
+	(
+	_In_		TA_CONTROL_BLOCK&	Block,				// Ring
+	_In_		uint32_t			Position,			// Position returned by post
+	_In_		uint32_t			Timeout_ms,			// Longest wait
+	_Out_opt_	uint32_t			*Value				// Value returned by the command
+	)
+
+//
+// DESCRIPTION:		Poll the command's slot until TraceAPI has freed it, then read the result and value, and check that the slot
+//					was not reused while they were read
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		The command's TA_CONTROL_STATUS, or:
+//
+//		TA_CTL_TIMEOUT					The command was not run within Timeout_ms
+//		TA_CTL_LOST						The slot was reused before the result was read
+//
+
+{
+TA_CONTROL_COMMAND	*slot = &Block.commands [Position & (TA_CONTROL_SLOTS - 1)];
+auto				give_up = std::chrono::steady_clock::now () + std::chrono::milliseconds (Timeout_ms);
+uint32_t			sequence;
+uint32_t			result;
+uint32_t			value;
+int32_t				lap;
+
+
+	for (;;)
+		{
+		sequence = slot->sequence.load (std::memory_order_acquire);
+		lap = (int32_t) (sequence - (Position + TA_CONTROL_SLOTS));
+
+		if (lap == 0)
+			{
+			result = slot->result.load (std::memory_order_relaxed);
+			value = slot->value.load (std::memory_order_relaxed);
+			std::atomic_thread_fence (std::memory_order_acquire);
+
+			if (slot->sequence.load (std::memory_order_relaxed) != sequence)
+				{
+				return TA_CTL_LOST;
+				}
+
+			if (Value != nullptr)
+				{
+				*Value = value;
+				}
+
+			return (TA_CONTROL_STATUS) result;
+			}
+
+		if (lap > 0)
+			{
+			return TA_CTL_LOST;
+			}
+
+		if (std::chrono::steady_clock::now () >= give_up)
+			{
+			return TA_CTL_TIMEOUT;
+			}
+
+		std::this_thread::sleep_for (std::chrono::microseconds (CTL_WAIT_POLL_US));
+		}
+}							// End routine Control::wait
+
+
+TA_CONTROL_STATUS
+Control::send											// Write a command and wait for its result
+	(
+	_Inout_		TA_CONTROL_BLOCK&	Block,				// Ring
+	_In_		uint16_t			Opcode,				// TA_CONTROL_OPCODES
+	_In_		uint32_t			Api,				// API number, TA_ALL_APIS, or TA_CONTROL_BY_NAME
+	_In_opt_z_	const char			*Name,				// API name (when Api is TA_CONTROL_BY_NAME)
+	_In_		uint32_t			Timeout_ms,			// Longest wait
+	_Out_opt_	uint32_t			*Value				// Value returned by the command
+	)
+
+//
+// DESCRIPTION:		post, then wait. If the ring is full, keep trying to post until the timeout
+//
+// ASSUMPTIONS:		The block has the magic number and version this module knows
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		The command's TA_CONTROL_STATUS, or TA_CTL_TIMEOUT or TA_CTL_LOST (see wait)
+//
+
+{
+auto		give_up = std::chrono::steady_clock::now () + std::chrono::milliseconds (Timeout_ms);
+uint32_t	position;
+
+
+	while (!post (Block, Opcode, Api, Name, position))
+		{
+		if (std::chrono::steady_clock::now () >= give_up)
+			{
+			return TA_CTL_TIMEOUT;
+			}
+
+		std::this_thread::sleep_for (std::chrono::microseconds (CTL_WAIT_POLL_US));
+		}
+
+	return wait (Block, position, Timeout_ms, Value);
+}							// End routine Control::send
+
+
+static
+TA_CONTROL_STATUS
+run_command												// Run one command
+	(
+	_In_	uint16_t		Opcode,						// TA_CONTROL_OPCODES
+	_In_	uint32_t		Api,						// API number or TA_ALL_APIS (already looked up, if by name)
+	_Out_	uint32_t&		Value						// Value returned by the command
+	)
+
+//
+// DESCRIPTION:		Enabling and disabling only change the API's bit in Intercept. Attaching and detaching go through Attach, which
+//					keeps track of the APIs whose Detours are attached
+//
+// ASSUMPTIONS:		The opcode is valid
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		TA_CONTROL_STATUS
+//
+
+{
+bool	valid_api = Api < TA_ctl_config.api_count;
+
+
+	Value = 0;
+
+	switch (Opcode)
+		{
+		case TA_CTL_PING:
+			{
+			Value = TA_ctl_config.api_count;
+			return TA_CTL_OK;
+			}
+
+		case TA_CTL_LOOKUP:
+			{
+			Value = Api;
+			return valid_api ? TA_CTL_OK : TA_CTL_BAD_API;
+			}
+
+		case TA_CTL_QUERY:
+			{
+			if (!valid_api)
+				{
+				return TA_CTL_BAD_API;
+				}
+
+			Value = (Intercept::api_configured (Api) ? TA_CTL_STATE_ENABLED : 0) | (Attach::is_attached (Api) ? TA_CTL_STATE_ATTACHED : 0);
+			return TA_CTL_OK;
+			}
+
+		case TA_CTL_ENABLE:
+		case TA_CTL_DISABLE:
+			{
+			if (!valid_api && Api != TA_ALL_APIS)
+				{
+				return TA_CTL_BAD_API;
+				}
+
+			Intercept::set_api_enabled (Api, Opcode == TA_CTL_ENABLE);
+			return TA_CTL_OK;
+			}
+
+		case TA_CTL_ATTACH:
+			{
+			return !valid_api ? TA_CTL_BAD_API : Attach::add (Api) ? TA_CTL_OK : TA_CTL_FAILED;
+			}
+
+		case TA_CTL_DETACH:
+			{
+			return !valid_api ? TA_CTL_BAD_API : Attach::remove (Api) ? TA_CTL_OK : TA_CTL_FAILED;
+			}
+
+		default:
+			{
+			return TA_CTL_BAD_OPCODE;
+			}
+		}
+}							// End run_command
+
+
+static
+uint32_t
+lookup_name												// Find an API by name
+	(
+	_In_	const char		*Name						// API name
+	)
+
+//
+// DESCRIPTION:		Compare the name with each API's name in the schema. Names are not case-sensitive
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		The API number, or TA_CONTROL_BY_NAME if there is no such API
+//
+
+{
+	for (uint32_t api = 0; api < TA_ctl_config.api_count; api++)
+		{
+		const char	*schema_name = TA_ctl_config.schema [api].name;
+		size_t		i;
+
+		for (i = 0; Name [i] != '\0' && schema_name [i] != '\0'; i++)
+			{
+			if ((Name [i] | 0x20) != (schema_name [i] | 0x20))
+				{
+				break;
+				}
+			}
+
+		if (Name [i] == '\0' && schema_name [i] == '\0')
+			{
+			return api;
+			}
+		}
+
+	return TA_CONTROL_BY_NAME;
+}							// End lookup_name
+
+
+static
+void
+serve_thread											// Body of the serving thread
+	(
+	)
+
+//
+// DESCRIPTION:		Serve the ring every poll_ms until stop is called
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	//
+	// Attaching and detaching call APIs (VirtualProtect, and so on) that may be intercepted
+	//
+
+	Intercept::exclude_thread ();
+
+	for (;;)
+		{
+		Control::serve ();
+
+		std::unique_lock<std::mutex>	lock (TA_ctl_wake_lock);
+
+		if (TA_ctl_stopping)
+			{
+			break;
+			}
+
+		TA_ctl_wake.wait_for (lock, std::chrono::milliseconds (TA_ctl_config.poll_ms));
+
+		if (TA_ctl_stopping)
+			{
+			break;
+			}
+		}
+
+	TA_ctl_thread_done = true;
+}							// End serve_thread
@@ -0,0 +1,261 @@
+//
+// FACILITY:	Control - Runtime control channel for the intercepts
+//
+// DESCRIPTION:	A controller (another process, or a test) changes which APIs are intercepted without re-injecting TraceAPI, by
+//				writing commands to a ring in a block of shared memory that TraceAPI creates (TA_CONTROL_BLOCK). A command can:
+//
+//					- Enable or disable the events of an API. This only flips the API's bit in Intercept, which is what the
+//					  intercept's fast path reads
+//					- Attach or detach the API's Detour (through Attach::add and Attach::remove)
+//					- Look up an API's number by name, or query whether it is enabled and attached
+//
+//				The ring is a bounded multi-producer, single-consumer queue. Each slot has a sequence number: a controller
+//				claims a slot by advancing head with compare-and-swap, fills it in, and publishes it by setting its sequence.
+//				The serving thread in TraceAPI runs the commands in order, writes each one's result into its slot, and frees the
+//				slot by setting its sequence for the next lap. A controller reads its result when the slot's sequence says it
+//				is done, and checks the sequence again afterwards, in case the slot was reused while it read. A controller that
+//				exits between claiming a slot and publishing it stalls the ring, so a controller must fill in a slot right after
+//				it claims it.
+//
+//				The block starts with a magic number and a layout version, and each command carries the version of the
+//				controller that wrote it. A controller must not use a block with a version it does not know, and TraceAPI
+//				rejects commands with a version it does not know. The block is written by untrusted processes, so everything
+//				read from it is checked before it is used.
+//
+//				Like Capture, this module uses only standard C++, so that it can be tested on Linux. The shared memory itself is
+//				created by the caller
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <atomic>
+#include <cstdint>
+
+//
+// Project includes
+//
+
+#include "Intercept.h"
+#include "TraceFormat.h"
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux test build
+#define	_In_
+#define	_In_opt_z_
+#define	_Out_
+#define	_Out_opt_
+#define	_Inout_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_CONTROL_MAGIC		0x4C544341				// "ACTL"
+#define	TA_CONTROL_VERSION		1						// Layout of TA_CONTROL_BLOCK and TA_CONTROL_COMMAND
+#define	TA_CONTROL_SLOTS		64						// Commands in the ring (a power of 2)
+#define	TA_CONTROL_MAX_NAME		64						// Characters of an API name, with its terminator
+#define	TA_CONTROL_BY_NAME		0xFFFFFFFE				// API number that selects the API named in the command
+#define	TA_CONTROL_NAME_W		L"Local\\FDI-TraceAPI-Control-%lu"	// Name of the shared memory (%lu is the process ID)
+
+static_assert ((TA_CONTROL_SLOTS & (TA_CONTROL_SLOTS - 1)) == 0, "The ring index is a mask of the free-running counters");
+static_assert (ATOMIC_INT_LOCK_FREE == 2, "The ring's atomics must be lock-free to work in shared memory");
+
+//
+// TYPES:
+//
+
+//
+// Commands
+//
+
+typedef enum _TA_CONTROL_OPCODES : uint16_t
+	{
+	TA_CTL_PING = 0,									// Does nothing; value is the number of APIs
+	TA_CTL_LOOKUP,										// Value is the number of the named API
+	TA_CTL_QUERY,										// Value is the API's TA_CONTROL_STATE bits
+	TA_CTL_ENABLE,										// Enable the API's events (or every API's)
+	TA_CTL_DISABLE,										// Disable the API's events (or every API's)
+	TA_CTL_ATTACH,										// Attach the API's Detour
+	TA_CTL_DETACH,										// Detach the API's Detour
+	TA_CTL_OPCODE_COUNT
+	} TA_CONTROL_OPCODES;
+
+//
+// Results of a command
+//
+
+typedef enum _TA_CONTROL_STATUS : uint32_t
+	{
+	TA_CTL_OK = 0,										// Done
+	TA_CTL_BAD_VERSION,									// The command's version is not known
+	TA_CTL_BAD_OPCODE,									// The opcode is not known
+	TA_CTL_BAD_API,										// No such API number or name (or TA_ALL_APIS where it is not allowed)
+	TA_CTL_FAILED,										// The Detour could not be attached or detached
+	TA_CTL_TIMEOUT,										// The command was not done in time (returned by wait, never by TraceAPI)
+	TA_CTL_LOST											// The slot was reused before its result was read (returned by wait)
+	} TA_CONTROL_STATUS;
+
+//
+// Bits of the value of TA_CTL_QUERY
+//
+
+typedef enum _TA_CONTROL_STATE : uint32_t
+	{
+	TA_CTL_STATE_ENABLED = 0x1,							// The API is enabled by name
+	TA_CTL_STATE_ATTACHED = 0x2,						// Its Detour is attached
+	} TA_CONTROL_STATE;
+
+//
+// A slot of the ring. The controller writes version, opcode, api and name, then sequence; TraceAPI writes result and value,
+// then sequence. A slot at position P (free-running) is free when its sequence is P, holds a command when it is P + 1, and is
+// done (and free for position P + TA_CONTROL_SLOTS) when it is P + TA_CONTROL_SLOTS
+//
+
+typedef struct _TA_CONTROL_COMMAND
+	{
+	std::atomic<uint32_t>	sequence;					// State of the slot
+	uint16_t				version;					// TA_CONTROL_VERSION of the controller
+	uint16_t				opcode;						// TA_CONTROL_OPCODES
+	uint32_t				api;						// API number, TA_ALL_APIS, or TA_CONTROL_BY_NAME
+	std::atomic<uint32_t>	result;						// TA_CONTROL_STATUS
+	std::atomic<uint32_t>	value;						// Value returned by the command
+	char					name [TA_CONTROL_MAX_NAME];	// API name (when api is TA_CONTROL_BY_NAME)
+	} TA_CONTROL_COMMAND, *PTA_CONTROL_COMMAND;
+
+//
+// The shared memory
+//
+
+typedef struct _TA_CONTROL_BLOCK
+	{
+	uint32_t				magic;						// TA_CONTROL_MAGIC
+	uint16_t				version;					// TA_CONTROL_VERSION
+	uint16_t				slots;						// TA_CONTROL_SLOTS
+	uint32_t				api_count;					// Number of APIs TraceAPI intercepts
+	std::atomic<uint32_t>	served;						// Commands TraceAPI has run (free-running)
+	std::atomic<uint32_t>	head;						// Next position a controller claims (free-running)
+	std::atomic<uint32_t>	tail;						// Next position TraceAPI runs (free-running; a copy, for controllers)
+	TA_CONTROL_COMMAND		commands [TA_CONTROL_SLOTS];
+	} TA_CONTROL_BLOCK, *PTA_CONTROL_BLOCK;
+
+//
+// Called after each command TraceAPI runs, on the serving thread
+//
+
+typedef void (*TA_CONTROL_REPORT) (uint16_t Opcode, uint32_t Api, uint32_t Result, uint32_t Value);
+
+typedef struct _TA_CONTROL_CONFIG
+	{
+	const TA_API_SCHEMA		*schema;					// Names of the APIs, indexed by API number
+	uint32_t				api_count;					// Number of APIs
+	uint32_t				poll_ms;					// Time between checks of the ring
+	TA_CONTROL_REPORT		report;						// Routine that reports each command (or nullptr)
+	} TA_CONTROL_CONFIG, *PTA_CONTROL_CONFIG;
+
+//
+// DECLARATIONS:
+//
+
+class Control
+{
+public:
+
+	//
+	// Public methods used by TraceAPI
+	//
+
+	static
+	void
+	init_block											// Initialize the shared memory
+		(
+		_Out_	void			*Memory,				// sizeof (TA_CONTROL_BLOCK) bytes
+		_In_	uint32_t		Api_count				// Number of APIs
+		);
+
+	static
+	bool
+	start												// Start the thread that serves the ring
+		(
+		_In_	TA_CONTROL_BLOCK			*Block,		// Ring, initialized by init_block
+		_In_	const TA_CONTROL_CONFIG&	Config		// Names of the APIs, poll period and report routine
+		);
+
+	static
+	bool
+	stop												// Stop the serving thread
+		(
+		_In_	bool		Join_thread					// Wait for the thread (must be false under the loader lock)
+		);
+
+	static
+	uint32_t
+	serve												// Run the commands in the ring
+		(
+		);
+
+	//
+	// Public methods used by a controller
+	//
+
+	static
+	bool
+	post												// Write a command to the ring
+		(
+		_Inout_		TA_CONTROL_BLOCK&	Block,			// Ring
+		_In_		uint16_t			Opcode,			// TA_CONTROL_OPCODES
+		_In_		uint32_t			Api,			// API number, TA_ALL_APIS, or TA_CONTROL_BY_NAME
+		_In_opt_z_	const char			*Name,			// API name (when Api is TA_CONTROL_BY_NAME)
+		_Out_		uint32_t&			Position		// Position of the command, for wait
+		);
+
+	static
+	TA_CONTROL_STATUS
+	wait												// Wait for a command's result
+		(
+		_In_		TA_CONTROL_BLOCK&	Block,			// Ring
+		_In_		uint32_t			Position,		// Position returned by post
+		_In_		uint32_t			Timeout_ms,		// Longest wait
+		_Out_opt_	uint32_t			*Value			// Value returned by the command
+		);
+
+	static
+	TA_CONTROL_STATUS
+	send												// Write a command and wait for its result
+		(
+		_Inout_		TA_CONTROL_BLOCK&	Block,			// Ring
+		_In_		uint16_t			Opcode,			// TA_CONTROL_OPCODES
+		_In_		uint32_t			Api,			// API number, TA_ALL_APIS, or TA_CONTROL_BY_NAME
+		_In_opt_z_	const char			*Name,			// API name (when Api is TA_CONTROL_BY_NAME)
+		_In_		uint32_t			Timeout_ms,		// Longest wait
+		_Out_opt_	uint32_t			*Value			// Value returned by the command
+		);
+
+};	// End class Control
+
+}	// End of namespace FDI
@@ -4,7 +4,7 @@
 // DESCRIPTION:	This DLL is injected into a process by InjectDLL or WithDLL. Its purpose is to intercept specific APIs and log their parameters using 
 //				ETW
 //
-// VERSION:		1.0
+// VERSION:		1.9
 //
 // AUTHOR:		Brian Catlin
 //
@@ -12,6 +12,45 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.9		2026-10-17	Brian Catlin
+//			Call stacks in capture mode (StackDepth and StackTableSize registry parameters): each pre-call record carries the ID
+//			of its caller's stack, and each stack is written once, as an API-Capture-STACK event or a TA_REC_STACK record
+//
+//	1.8		2026-10-17	Brian Catlin
+//			Runtime control channel (ControlChannel and ControlPollPeriod registry parameters): serve the commands another
+//			process writes to a named block of shared memory, which enable, disable, attach and detach individual APIs without
+//			re-injecting the DLL. Each command is logged as a Control-Command event
+//
+//	1.7		2026-10-17	Brian Catlin
+//			Staged attach (AttachBatchAPIs, AttachBatchPause and AttachCoreAPIs registry parameters): attach a core set of APIs
+//			in process_attach, and the rest in batches from a worker thread, never attaching the APIs disabled by name. Each
+//			batch is logged as an Attach-Progress event
+//
+//	1.6		2026-10-17	Brian Catlin
+//			Read the CaptureBufferBytes registry parameter, which limits the bytes of each buffer parameter the intercepts
+//			capture, and write the captured bytes as API-Capture-DATA events
+//
+//	1.5		2026-10-17	Brian Catlin
+//			Load the sampling and rate limiting rules of the APIPolicies registry parameter, and write the number of calls each
+//			thread skipped as API-Policy-Skipped events
+//
+//	1.4		2026-10-17	Brian Catlin
+//			Added statistics mode (Statistics registry parameter), in which the intercepts count and time the calls instead of
+//			writing events. The counters are written as API-Stats events when an ETW session requests the provider's state,
+//			and when the DLL is unloaded
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Capture records identify their API by number; pass the generated schema to the capture file sink, and look up
+//			API names in it
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Track whether anybody is listening for the API events (TraceLogging enable callback, or capture mode), and read the
+//			DisabledAPIs registry parameter, so the intercepts can skip building events they would throw away
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Added capture mode (CaptureMode registry parameter), in which the intercepts write to per-thread rings, and a drain
+//			thread sends the records to ETW or a file
+//
 //	1.0		2019-11-15	Brian Catlin
 //			Original version
 //
@@ -45,6 +84,7 @@
 #include <list>
 #include <memory>
 #include <iterator>
+#include <cstdio>
 
 //
 // Project includes
@@ -53,6 +93,13 @@
 #include "detours.h"
 
 #include "TraceAPI.h"
+#include "Attach.h"
+#include "Capture.h"
+#include "Control.h"
+#include "Intercept.h"
+#include "Stats.h"
+#include "Policy.h"
+#include "StackTable.h"
 #include "..\Global\Utils.h"
 #include "FDI-Detours.h"
 #include "..\Global\WPP_Tracing.h"
@@ -86,6 +133,8 @@ TRACELOGGING_DEFINE_PROVIDER (TA_tlg, TL_PROVIDER, TL_GUID);
 static LONG		TA_tls_indent = -1;
 static LONG		TA_tls_thread = -1;
 static LONG		TA_thread_count = 0;
+static HANDLE	TA_control_section = nullptr;			// Shared memory of the control channel
+static PVOID	TA_control_view = nullptr;				// Its view in this process
 WCHAR			TA_image_file_name_buff [MAX_PATH];
 UNICODE_STRING	TA_image_file_name = {0};
 
@@ -95,6 +144,68 @@ const char	TA_product_description[] = VER_PRODUCTNAME_STR " " VER_INTERNALNAME_S
 // FORWARD ROUTINES:
 //
 
+bool
+attach_batch											// Attach a batch of APIs, for staged attach
+	(
+	const uint32_t		*Apis,							// API numbers
+	uint32_t			Count							// Number of APIs
+	);
+
+void
+attach_report											// Log the progress of staged attach
+	(
+	const TA_ATTACH_PROGRESS&	Progress				// Progress after a batch
+	);
+
+bool
+detach_batch											// Detach a batch of APIs, for the control channel
+	(
+	const uint32_t		*Apis,							// API numbers
+	uint32_t			Count							// Number of APIs
+	);
+
+VOID
+attach_start											// Attach the Detours, all at once or staged
+	(
+	);
+
+VOID
+capture_start											// Start capture mode, if it is configured
+	(
+	);
+
+VOID
+capture_stop											// Stop capture mode, and log its statistics
+	(
+	);
+
+bool
+capture_etw_write										// Capture sink that writes the records to ETW
+	(
+	void				*Context,						// Not used
+	const TA_RECORD		*Records,						// Records to write
+	size_t				Count							// Number of records
+	);
+
+void
+control_report											// Log a command of the control channel
+	(
+	uint16_t		Opcode,								// TA_CONTROL_OPCODES
+	uint32_t		Api,								// API number
+	uint32_t		Result,								// TA_CONTROL_STATUS
+	uint32_t		Value								// Value returned by the command
+	);
+
+VOID
+control_start											// Start the control channel, if it is configured
+	(
+	);
+
+VOID
+control_stop											// Stop the control channel
+	(
+	);
+
 VOID
 det_attach												// Attach the Detours
 	(
@@ -103,6 +214,28 @@ det_attach												// Attach the Detours
 	_In_	PCCH	Api_name							// API name
 	);
 
+VOID
+events_update											// Tell the intercepts whether anybody wants their events
+	(
+	);
+
+VOID
+intercept_configure										// Disable the APIs listed in the DisabledAPIs registry parameter
+	(
+	);
+
+VOID
+policy_configure										// Load the rules in the APIPolicies registry parameter
+	(
+	);
+
+void
+policy_report											// Write the number of calls of an API that a thread skipped
+	(
+	_In_	uint32_t		Api,						// API number
+	_In_	const uint64_t	Skipped [TA_POLICY_REASON_COUNT]	// Calls skipped, for each reason
+	);
+
 VOID
 det_detach												// Detach the Detours
 	(
@@ -129,6 +262,22 @@ process_detach											// Called when this DLL is unloaded from a process
 	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
 	);
 
+VOID
+stats_report											// Write the call counters of each API
+	(
+	_In_z_	PCSTR		Reason							// Why they are being written
+	);
+
+VOID
+stats_start												// Start statistics mode, if it is configured
+	(
+	);
+
+VOID
+stats_stop												// Stop statistics mode, and write the call counters
+	(
+	);
+
 BOOL
 thread_attach											// Called when the process creates a new thread
 	(
@@ -141,6 +290,19 @@ thread_detach											// Called when a thread is exiting cleanly
 	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
 	);
 
+VOID
+NTAPI
+tl_enable_callback										// Called when an ETW session changes the provider's level or keywords
+	(
+	_In_		LPCGUID						Source_id,			// Session that changed the provider
+	_In_		ULONG						Is_enabled,			// EVENT_CONTROL_CODE_xxx
+	_In_		UCHAR						Level,				// Level enabled by the session
+	_In_		ULONGLONG					Match_any_keyword,	// Keywords enabled by the session
+	_In_		ULONGLONG					Match_all_keyword,	// Keywords that must all be present
+	_In_opt_	PEVENT_FILTER_DESCRIPTOR	Filter_data,		// Not used
+	_In_opt_	PVOID						Callback_context	// Not used
+	);
+
 
 
 BOOL 
@@ -333,228 +495,1249 @@ PCCH	name_ptr = Name;
 }							// End det_real_name
 
 
-BOOL 
-process_attach											// Called when this DLL is loaded into a process
+VOID
+attach_start											// Attach the Detours, all at once or staged
 	(
-	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Read the staged attach parameters from the registry, and attach the Detours of the APIs that are not disabled
+//					by name (see intercept_configure):
 //
-// ASSUMPTIONS:		User mode
+//						AttachBatchAPIs			APIs that the worker thread attaches in each batch (default 0, which attaches
+//												them all here, under the loader lock)
+//						AttachBatchPause		Milliseconds the worker thread waits between batches (default 0)
+//						AttachCoreAPIs			Names of the APIs attached here, before the worker thread starts (REG_MULTI_SZ,
+//												default none). Names are not case-sensitive
 //
-// SIDE EFFECTS:
+// ASSUMPTIONS:		User mode. Called from process_attach, after intercept_configure
+//
+// SIDE EFFECTS:	Creates the worker thread, which does not start running until the loader lock is released
 //
 // RETURN VALUES:
 //
+//		None
 //
 
 {
-HANDLE		process_hdl = GetCurrentProcess ();
+TA_ATTACH_CONFIG		config = {};
+std::vector<uint32_t>	core;
+std::wstring			names;
+std::wstring			api_name;
+ULONG					batch_apis;
+ULONG					batch_pause;
+size_t					start;
+size_t					end;
+ULONG					i;
 
-	//
-	// Initialize WPP tracing
-	//
 
-	WPP_INIT_TRACING (0);
-	TRACE_ALWAYS (TRACEAPI, "%s", TA_product_description);
 	TRACE_ENTER ();
 
-NTSTATUS	status;
-BOOL				ret_val = TRUE;
-ULONG		length;
-
-
-	//
-	// Get the name of the executable that loaded this DLL
-	//
+	Utils::registry_read_ulong ((LPWSTR) L"AttachBatchAPIs", 0, &batch_apis);
+	Utils::registry_read_ulong ((LPWSTR) L"AttachBatchPause", 0, &batch_pause);
 
-	if ((length = GetProcessImageFileName (process_hdl, TA_image_file_name_buff, ARRAYSIZE (TA_image_file_name_buff))) != 0)
+	if (batch_apis != 0 && SUCCESS (Utils::registry_read_multi_wstring ((LPWSTR) L"AttachCoreAPIs", names)))
 		{
+		for (start = 0; (end = names.find (L'\0', start)) != std::wstring::npos; start = end + 1)
+			{
+			if (end == start)
+				{
+				continue;
+				}
+
+			for (i = 0; i < TA_api_count; i++)
+				{
+				api_name.assign (TA_api_schema [i].name, TA_api_schema [i].name + strlen (TA_api_schema [i].name));
+
+				if (_wcsicmp (api_name.c_str (), &names [start]) == 0)
+					{
+					core.push_back (i);
+					break;
+					}
+				}
+
+			if (i == TA_api_count)
+				{
+				TRACE_WARN (TRACEAPI, "AttachCoreAPIs names %S, which is not intercepted", &names [start]);
+				}
+			}
+		}
 
-		//
-		// Fill in the string descriptor
-		//
+	config.api_count = TA_api_count;
+	config.core = core.data ();
+	config.core_count = (uint32_t) core.size ();
+	config.batch_apis = batch_apis;
+	config.batch_pause_ms = batch_pause;
+	config.attach = attach_batch;
+	config.detach = detach_batch;
+	config.report = attach_report;
 
-		TA_image_file_name.Buffer = TA_image_file_name_buff;
-		TA_image_file_name.Length = (USHORT) length * 2;
-		TA_image_file_name.MaximumLength = ARRAYSIZE (TA_image_file_name_buff) * 2;
+	if (!Attach::start (config))
+		{
+		TRACE_ERROR (TRACEAPI, "Error attaching the Detours");
 		}
-	else
+	else if (batch_apis != 0)
 		{
-		status = GetLastError ();
-		TRACE_ERROR (TRACEAPI, "Error getting image file name, status = %!STATUS!", status);
+		TRACE_INFO (TRACEAPI, "Staged attach: %lu core APIs, then batches of %lu APIs, %lu ms apart", (ULONG) core.size (), batch_apis,
+			batch_pause);
 		}
 
-	TA_tls_indent = TlsAlloc ();
-	TA_tls_thread = TlsAlloc ();
-
-	//
-	// Initialize TraceLogging
-	//
+	TRACE_EXIT ();
+}							// End attach_start
 
-	if (SUCCESS (status = TraceLoggingRegisterEx (TA_tlg, nullptr, nullptr)))
-		{
 
-		//
-		// Send a message that we've been loaded
-		//
+bool
+attach_batch											// Attach a batch of APIs, for staged attach
+	(
+	const uint32_t		*Apis,							// API numbers
+	uint32_t			Count							// Number of APIs
+	)
 
-		TraceLoggingWrite (TA_tlg, "DLL-Attach", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_VERBOSE),
-			TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("DLL attached to process"),
-			TraceLoggingString (TA_product_description, "DLL description"),
-			TraceLoggingUnicodeString (&TA_image_file_name,  "Image file name")
-			);
+//
+// DESCRIPTION:		Attach routine passed to Attach::start. It is called from process_attach for the core set, and from the worker
+//					thread for the other batches
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The batch was attached
+//		false							The Detours transaction failed
+//
 
-		//
-		// Replace the pointers to the API we are tracing
-		//
+{
+NTSTATUS	status;
 
-		if (!SUCCESS (status = attach_detours ()))
-			{
-			TRACE_ERROR (TRACEAPI, "Error attaching Detour, status = %!STATUS!", status);
-			}
 
-		thread_attach (Dll_hdl);
-		}
-	else
+	if (!SUCCESS (status = attach_detours (Apis, Count)))
 		{
-		TRACE_ERROR (TRACEAPI, "Error registering with TraceLogging, status = %!STATUS!", status);
-		ret_val = FALSE;
+		TRACE_ERROR (TRACEAPI, "Error attaching %lu Detours, status = %!STATUS!", Count, status);
+		return false;
 		}
 
-	TRACE_EXIT ();
-	return ret_val;
-}							// End process_attach
+	return true;
+}							// End attach_batch
 
-BOOL
-process_detach											// Called when this DLL is unloaded from a process
+
+bool
+detach_batch											// Detach a batch of APIs, for the control channel
 	(
-	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
+	const uint32_t		*Apis,							// API numbers
+	uint32_t			Count							// Number of APIs
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Detach routine passed to Attach::start. It is called from the control channel's thread, when a controller
+//					detaches an API
 //
 // ASSUMPTIONS:		User mode
 //
-// SIDE EFFECTS:
+// SIDE EFFECTS:	None
 //
 // RETURN VALUES:
 //
+//		true							The batch was detached
+//		false							The Detours transaction failed
 //
 
 {
 NTSTATUS	status;
 
 
-	TRACE_ENTER ();
-
-	TraceLoggingWrite (TA_tlg, "DLL-Detach", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_VERBOSE),
-		TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("DLL detached from process"),
-		TraceLoggingUnicodeString (&TA_image_file_name, "Image file name")
-		);
-
-	thread_detach (Dll_hdl);
-
-	if (!SUCCESS (status = detach_detours ()))
-		{
-		TRACE_ERROR (TRACEAPI, "Error detaching Detour, status = %!STATUS!", status);
-		}
-
-	if (TA_tls_indent >= 0) 
+	if (!SUCCESS (status = detach_detours (Apis, Count)))
 		{
-		TlsFree (TA_tls_indent);
+		TRACE_ERROR (TRACEAPI, "Error detaching %lu Detours, status = %!STATUS!", Count, status);
+		return false;
 		}
 
-	if (TA_tls_thread >= 0) 
-		{
-		TlsFree (TA_tls_thread);
-		}
+	return true;
+}							// End detach_batch
 
-	//
-	// Disconnect from TraceLogging
-	//
 
-	TraceLoggingUnregister (TA_tlg);
+void
+attach_report											// Log the progress of staged attach
+	(
+	const TA_ATTACH_PROGRESS&	Progress				// Progress after a batch
+	)
 
-	//
-	// Close WPP tracing
-	//
+//
+// DESCRIPTION:		Report routine passed to Attach::start. Log the batch to WPP, and write it as an Attach-Progress event, so a
+//					trace shows when each API started being intercepted
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
 
-	TRACE_EXIT ();
-	WPP_CLEANUP ();
-	return TRUE;
-}							// End process_detach
+{
+	TRACE_INFO (TRACEAPI, "Attach batch %lu: %lu APIs in %llu usec; %lu of %lu attached, %lu failed, %lu disabled, after %llu usec%s",
+		Progress.batch, Progress.apis, Progress.batch_usec, Progress.attached, Progress.planned, Progress.failed, Progress.skipped,
+		Progress.elapsed_usec, Progress.done ? " (done)" : "");
+
+	TraceLoggingWrite (TA_tlg, "Attach-Progress", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_VERBOSE),
+		TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("Batch of Detours attached"),
+		TraceLoggingUInt32 (Progress.batch, "Batch"),
+		TraceLoggingUInt32 (Progress.apis, "APIs"),
+		TraceLoggingBool (Progress.ok, "Attached"),
+		TraceLoggingUInt64 (Progress.batch_usec, "Batch usec"),
+		TraceLoggingUInt32 (Progress.attached, "APIs attached"),
+		TraceLoggingUInt32 (Progress.planned, "APIs planned"),
+		TraceLoggingUInt32 (Progress.failed, "APIs failed"),
+		TraceLoggingUInt32 (Progress.skipped, "APIs disabled"),
+		TraceLoggingUInt64 (Progress.elapsed_usec, "Elapsed usec"),
+		TraceLoggingBool (Progress.done, "Done")
+		);
+}							// End attach_report
 
 
-BOOL
-thread_attach											// Called when the process creates a new thread
+VOID
+capture_start											// Start capture mode, if it is configured
 	(
-	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Read the capture parameters from the registry, and if CaptureMode is not TA_CAPTURE_OFF, start the capture rings
+//					with the sink it selects:
 //
-// ASSUMPTIONS:		User mode
+//						CaptureMode				TA_CAPTURE_MODES value (default TA_CAPTURE_OFF)
+//						CaptureRingRecords		Records in each thread's ring (default 1024, which is 256KB)
+//						CaptureDrainPeriod		Milliseconds between drains of the rings (default 10)
+//						CaptureBufferBytes		Most bytes captured from each buffer parameter, in capture mode or not (default
+//												TA_CAPTURE_DATA_LIMIT, at most TA_CAPTURE_MAX_DATA; 0 captures no buffers)
+//						StackDepth				Frames of the caller's stack captured for each call (default 0, which captures
+//												no stacks; 1 is the return address only; at most TA_STACK_MAX_FRAMES)
+//						StackTableSize			Unique stacks kept (default TA_STACK_ENTRIES, 144 bytes each)
 //
-// SIDE EFFECTS:
+//					Stacks are only captured in capture mode. Plain ETW mode can get them from ETW itself, by enabling the
+//					provider with the EVENT_ENABLE_PROPERTY_STACK_TRACE property
+//
+// ASSUMPTIONS:		User mode. Called from process_attach, before the Detours are attached
+//
+// SIDE EFFECTS:	Creates the drain thread, which does not start running until the loader lock is released
 //
 // RETURN VALUES:
 //
+//		None
 //
 
 {
-LONG num_thread;
-
+TA_CAPTURE_CONFIG	config = {};
+TA_STACK_CONFIG		stack_config = {};
+ULONG				mode;
+ULONG				ring_records;
+ULONG				drain_period;
+ULONG				buffer_bytes;
+ULONG				stack_depth;
+ULONG				stack_entries;
+CHAR				temp_path [MAX_PATH];
+CHAR				file_name [MAX_PATH];
 
-	UNREFERENCED_PARAMETER (Dll_hdl);
 
 	TRACE_ENTER ();
 
-	if (TA_tls_indent >= 0) 
+	Utils::registry_read_ulong ((LPWSTR) L"CaptureMode", TA_CAPTURE_OFF, &mode);
+	Utils::registry_read_ulong ((LPWSTR) L"CaptureRingRecords", 1024, &ring_records);
+	Utils::registry_read_ulong ((LPWSTR) L"CaptureDrainPeriod", 10, &drain_period);
+	Utils::registry_read_ulong ((LPWSTR) L"CaptureBufferBytes", TA_CAPTURE_DATA_LIMIT, &buffer_bytes);
+	Utils::registry_read_ulong ((LPWSTR) L"StackDepth", 0, &stack_depth);
+	Utils::registry_read_ulong ((LPWSTR) L"StackTableSize", TA_STACK_ENTRIES, &stack_entries);
+
+	Capture::set_data_limit (buffer_bytes);
+
+	config.ring_records = ring_records;
+	config.drain_period_ms = drain_period;
+	stack_config.depth = stack_depth;
+	stack_config.entries = stack_entries;
+
+	switch (mode)
 		{
-		TlsSetValue (TA_tls_indent, (PVOID) 0);
+		case TA_CAPTURE_OFF:
+			{
+			}
+			break;
+
+		case TA_CAPTURE_ETW:
+			{
+			config.sink.write = capture_etw_write;
+			}
+			break;
+
+		case TA_CAPTURE_FILE:
+			{
+			if (GetTempPathA (ARRAYSIZE (temp_path), temp_path) == 0 ||
+				_snprintf_s (file_name, ARRAYSIZE (file_name), _TRUNCATE, "%sTraceAPI-%lu.tac", temp_path, GetCurrentProcessId ()) < 0 ||
+				!Capture::open_file_sink (file_name, TA_api_schema, TA_api_count, config.sink))
+				{
+				TRACE_ERROR (TRACEAPI, "Error creating capture file in %s, status = %!STATUS!", temp_path, GetLastError ());
+				}
+			else
+				{
+				TRACE_INFO (TRACEAPI, "Capturing to file %s", file_name);
+				}
+			}
+			break;
+
+		default:
+			{
+			TRACE_WARN (TRACEAPI, "Unknown CaptureMode %lu, capture is off", mode);
+			}
+			break;
 		}
 
-	if (TA_tls_thread >= 0) 
+	if (config.sink.write != nullptr)
 		{
-		num_thread = InterlockedIncrement (&TA_thread_count);
-		TlsSetValue (TA_tls_thread, (PVOID) (LONG_PTR) num_thread);
+		if (stack_config.depth != 0)
+			{
+			if (StackTable::start (stack_config))
+				{
+				TRACE_INFO (TRACEAPI, "Capturing %lu frames of each call's stack, in a table of %lu stacks", StackTable::depth (),
+					stack_config.entries);
+				}
+			else
+				{
+				TRACE_ERROR (TRACEAPI, "Error allocating a table of %lu stacks, stacks are not captured", stack_config.entries);
+				}
+			}
+
+		if (Capture::start (config))
+			{
+			TRACE_INFO (TRACEAPI, "Capture mode %lu, %lu records per ring, drain period %lu ms", mode, ring_records, drain_period);
+			}
+		else
+			{
+			TRACE_ERROR (TRACEAPI, "Error starting capture mode %lu", mode);
+			StackTable::stop ();
+
+			if (config.sink.close != nullptr)
+				{
+				config.sink.close (config.sink.context);
+				}
+			}
 		}
 
 	TRACE_EXIT ();
-	return TRUE;
-}							// End thread_attach
+}							// End capture_start
 
 
-BOOL 
-thread_detach											// Called when a thread is exiting cleanly
+VOID
+capture_stop											// Stop capture mode, and log its statistics
 	(
-	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Stop the capture rings (without joining the drain thread, because this is called under the loader lock), then
+//					log the statistics to WPP and TraceLogging, so a trace shows how many records were dropped
 //
-// ASSUMPTIONS:		User mode
+// ASSUMPTIONS:		User mode. Called from process_detach, after the Detours are detached
 //
-// SIDE EFFECTS:
+// SIDE EFFECTS:	None
 //
 // RETURN VALUES:
 //
+//		None
 //
 
 {
-	UNREFERENCED_PARAMETER (Dll_hdl);
+TA_CAPTURE_STATS	stats;
+TA_STACK_STATS		stack_stats;
+
 
 	TRACE_ENTER ();
 
-	if (TA_tls_indent >= 0)
+	if (Capture::enabled ())
 		{
-		TlsSetValue (TA_tls_indent, (PVOID) 0);
+		Capture::stop (false);
+		StackTable::stop ();
+		Capture::get_stats (stats);
+		StackTable::get_stats (stack_stats);
+
+		TRACE_INFO (TRACEAPI, "Capture: %llu records, %llu overflows, %llu nested, %llu truncated, %llu batches, %llu sink errors, %lu rings",
+			stats.records, stats.overflows, stats.nested, stats.truncated, stats.batches, stats.sink_errors, stats.rings);
+
+		TraceLoggingWrite (TA_tlg, "Capture-Stats", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("Capture statistics"),
+			TraceLoggingUInt64 (stats.records, "Records"),
+			TraceLoggingUInt64 (stats.overflows, "Overflows"),
+			TraceLoggingUInt64 (stats.nested, "Nested"),
+			TraceLoggingUInt64 (stats.truncated, "Truncated snapshots"),
+			TraceLoggingUInt64 (stats.batches, "Batches"),
+			TraceLoggingUInt64 (stats.sink_errors, "Sink errors"),
+			TraceLoggingUInt32 (stats.rings, "Rings")
+			);
+
+		if (stack_stats.entries != 0)
+			{
+			TRACE_INFO (TRACEAPI, "Stacks: %lu unique, %lu written, %llu calls with no room, %llu calls with a busy slot",
+				stack_stats.stacks, stack_stats.flushed, stack_stats.full, stack_stats.busy);
+
+			TraceLoggingWrite (TA_tlg, "Stack-Stats", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+				TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("Stack table statistics"),
+				TraceLoggingUInt32 (stack_stats.stacks, "Stacks"),
+				TraceLoggingUInt32 (stack_stats.flushed, "Stacks written"),
+				TraceLoggingUInt32 (stack_stats.entries, "Table size"),
+				TraceLoggingUInt64 (stack_stats.full, "Table full"),
+				TraceLoggingUInt64 (stack_stats.busy, "Slot busy")
+				);
+			}
+		}
+
+	TRACE_EXIT ();
+}							// End capture_stop
+
+
+bool
+capture_etw_write										// Capture sink that writes the records to ETW
+	(
+	void				*Context,						// Not used
+	const TA_RECORD		*Records,						// Records to write
+	size_t				Count							// Number of records
+	)
+
+//
+// DESCRIPTION:		Write one TraceLogging event for each record, from the drain thread. The events have the same keywords as the
+//					synchronous API-Trace events, but the arguments are raw 64-bit values in the order of the intercept's
+//					parameters (for a post-call record: the return value, the last error status, then the output parameters).
+//					A data record, part of a buffer captured with the record before it, is an API-Capture-DATA event; the
+//					parameter is numbered by its position in the API's parameter list. A pre-call event's Stack is the ID of its
+//					caller's stack (0 if none), whose frames are in an API-Capture-STACK event
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	UNREFERENCED_PARAMETER (Context);
+
+	for (size_t i = 0; i < Count; i++)
+		{
+		const TA_RECORD	*rec = &Records [i];
+		PCSTR			api_name = rec->api < TA_api_count ? TA_api_schema [rec->api].name : "?";
+
+		if (rec->kind == TA_REC_DATA)
+			{
+			PTA_DATA_RECORD	data = (PTA_DATA_RECORD) rec;
+
+			TraceLoggingWrite (TA_tlg, "API-Capture-DATA", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+				TraceLoggingKeyword (TL_KW_TRACE_PRE | TL_KW_TRACE_POST),
+				TraceLoggingString (api_name, "API"),
+				TraceLoggingUInt32 (data->thread_id, "Thread"),
+				TraceLoggingUInt64 (data->timestamp, "Timestamp"),
+				TraceLoggingUInt8 (data->param, "Parameter"),
+				TraceLoggingUInt32 (data->size, "Size"),
+				TraceLoggingUInt16 (data->offset, "Offset"),
+				TraceLoggingBinary (data->data, data->length, "Data")
+				);
+			}
+		else if (rec->kind == TA_REC_STACK)
+			{
+			TraceLoggingWrite (TA_tlg, "API-Capture-STACK", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+				TraceLoggingKeyword (TL_KW_TRACE_PRE),
+				TraceLoggingUInt32 (rec->stack_id, "Stack"),
+				TraceLoggingUInt64 (rec->timestamp, "Timestamp"),
+				TraceLoggingHexUInt64Array (rec->args, rec->arg_count, "Frames")
+				);
+			}
+		else if (rec->kind == TA_REC_PRE)
+			{
+			TraceLoggingWrite (TA_tlg, "API-Capture-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+				TraceLoggingKeyword (TL_KW_TRACE_PRE),
+				TraceLoggingString (api_name, "API"),
+				TraceLoggingUInt32 (rec->thread_id, "Thread"),
+				TraceLoggingUInt64 (rec->timestamp, "Timestamp"),
+				TraceLoggingUInt32 (rec->stack_id, "Stack"),
+				TraceLoggingUInt64Array (rec->args, rec->arg_count, "Arguments"),
+				TraceLoggingCountedWideString ((PCWSTR) rec->text, rec->text_length, "Text")
+				);
+			}
+		else
+			{
+			TraceLoggingWrite (TA_tlg, "API-Capture-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+				TraceLoggingKeyword (TL_KW_TRACE_POST),
+				TraceLoggingString (api_name, "API"),
+				TraceLoggingUInt32 (rec->thread_id, "Thread"),
+				TraceLoggingUInt64 (rec->timestamp, "Timestamp"),
+				TraceLoggingUInt64Array (rec->args, rec->arg_count, "Arguments"),
+				TraceLoggingCountedWideString ((PCWSTR) rec->text, rec->text_length, "Text")
+				);
+			}
+		}
+
+	return true;
+}							// End capture_etw_write
+
+
+void
+control_report											// Log a command of the control channel
+	(
+	uint16_t		Opcode,								// TA_CONTROL_OPCODES
+	uint32_t		Api,								// API number
+	uint32_t		Result,								// TA_CONTROL_STATUS
+	uint32_t		Value								// Value returned by the command
+	)
+
+//
+// DESCRIPTION:		Report routine passed to Control::start. Log the command to WPP, and write it as a Control-Command event, so a
+//					trace shows when each API was enabled, disabled, attached or detached, and which commands were rejected
+//
+// ASSUMPTIONS:		User mode. Called on the control channel's thread
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+PCSTR	api_name = Api < TA_api_count ? TA_api_schema [Api].name : Api == TA_ALL_APIS ? "(all)" : "(none)";
+
+
+	TRACE_INFO (TRACEAPI, "Control command %lu, API %s: status %lu, value %lu", (ULONG) Opcode, api_name, Result, Value);
+
+	TraceLoggingWrite (TA_tlg, "Control-Command", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_VERBOSE),
+		TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("Command of the control channel"),
+		TraceLoggingUInt16 (Opcode, "Opcode"),
+		TraceLoggingString (api_name, "API"),
+		TraceLoggingUInt32 (Result, "Status"),
+		TraceLoggingUInt32 (Value, "Value")
+		);
+}							// End control_report
+
+
+VOID
+control_start											// Start the control channel, if it is configured
+	(
+	)
+
+//
+// DESCRIPTION:		Read the control channel parameters from the registry, and if it is enabled, create the shared memory and start
+//					the thread that serves it:
+//
+//						ControlChannel			Nonzero to create the control channel (default 0)
+//						ControlPollPeriod		Milliseconds between checks for commands (default 50)
+//
+//					The shared memory is named Local\FDI-TraceAPI-Control-<process ID> (TA_CONTROL_NAME_W). Any process that can
+//					open it can change which APIs are intercepted, so it has the default security of the process
+//
+// ASSUMPTIONS:		User mode. Called from process_attach, after attach_start
+//
+// SIDE EFFECTS:	Creates the control channel's thread, which does not start running until the loader lock is released
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_CONTROL_CONFIG	config = {};
+WCHAR				name [64];
+ULONG				enabled;
+ULONG				poll_period;
+
+
+	TRACE_ENTER ();
+
+	Utils::registry_read_ulong ((LPWSTR) L"ControlChannel", 0, &enabled);
+	Utils::registry_read_ulong ((LPWSTR) L"ControlPollPeriod", 50, &poll_period);
+
+	if (enabled != 0)
+		{
+		if (_snwprintf_s (name, ARRAYSIZE (name), _TRUNCATE, TA_CONTROL_NAME_W, GetCurrentProcessId ()) < 0 ||
+			(TA_control_section = CreateFileMappingW (INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof (TA_CONTROL_BLOCK),
+				name)) == nullptr)
+			{
+			TRACE_ERROR (TRACEAPI, "Error creating the control channel, error = %lu", GetLastError ());
+			}
+		else if (GetLastError () == ERROR_ALREADY_EXISTS ||
+			(TA_control_view = MapViewOfFile (TA_control_section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof (TA_CONTROL_BLOCK))) ==
+				nullptr)
+			{
+
+			//
+			// Never serve a block somebody else created: it may not have been initialized the way this DLL expects
+			//
+
+			TRACE_ERROR (TRACEAPI, "Error mapping the control channel, error = %lu", GetLastError ());
+			control_stop ();
+			}
+		else
+			{
+			Control::init_block (TA_control_view, TA_api_count);
+
+			config.schema = TA_api_schema;
+			config.api_count = TA_api_count;
+			config.poll_ms = poll_period;
+			config.report = control_report;
+
+			if (!Control::start ((TA_CONTROL_BLOCK *) TA_control_view, config))
+				{
+				TRACE_ERROR (TRACEAPI, "Error starting the control channel");
+				control_stop ();
+				}
+			else
+				{
+				TRACE_INFO (TRACEAPI, "Control channel %S, checked every %lu ms", name, poll_period);
+				}
+			}
+		}
+
+	TRACE_EXIT ();
+}							// End control_start
+
+
+VOID
+control_stop											// Stop the control channel
+	(
+	)
+
+//
+// DESCRIPTION:		Stop the control channel's thread (without joining it, because this is called under the loader lock), then
+//					unmap and close the shared memory. If the thread did not stop in time, the view is left mapped, because the
+//					thread may still be reading it. Commands that have not been run time out in the controller
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	if (!Control::stop (false))
+		{
+		TRACE_WARN (TRACEAPI, "The control channel's thread did not stop, so its shared memory is not unmapped");
+		return;
+		}
+
+	if (TA_control_view != nullptr)
+		{
+		UnmapViewOfFile (TA_control_view);
+		TA_control_view = nullptr;
+		}
+
+	if (TA_control_section != nullptr)
+		{
+		CloseHandle (TA_control_section);
+		TA_control_section = nullptr;
+		}
+}							// End control_stop
+
+
+VOID
+events_update											// Tell the intercepts whether anybody wants their events
+	(
+	)
+
+//
+// DESCRIPTION:		The intercepts build events only when capture mode is on, or an ETW session has enabled the API trace keywords
+//					at the level the events are written at, or statistics mode is on (the intercepts count calls instead of writing
+//					events). Otherwise they call the real API directly
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+bool	enabled;
+
+
+	enabled = Capture::enabled () || Stats::enabled () ||
+		TraceLoggingProviderEnabled (TA_tlg, TRACE_LEVEL_INFORMATION, TL_KW_TRACE_PRE | TL_KW_TRACE_POST);
+
+	Intercept::set_events_enabled (enabled);
+	TRACE_INFO (TRACEAPI, "API events %s", enabled ? "enabled" : "disabled");
+}							// End events_update
+
+
+VOID
+intercept_configure										// Disable the APIs listed in the DisabledAPIs registry parameter
+	(
+	)
+
+//
+// DESCRIPTION:		Read the DisabledAPIs registry parameter (REG_MULTI_SZ), and clear the enable bit of each API it names. The
+//					intercepts of those APIs call the real API directly, without building any events. Names are not case-sensitive
+//
+// ASSUMPTIONS:		User mode. Called from process_attach, before the Detours are attached
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::wstring	disabled;
+std::wstring	api_name;
+size_t			start;
+size_t			end;
+ULONG			i;
+
+
+	TRACE_ENTER ();
+
+	if (SUCCESS (Utils::registry_read_multi_wstring ((LPWSTR) L"DisabledAPIs", disabled)))
+		{
+		for (start = 0; (end = disabled.find (L'\0', start)) != std::wstring::npos; start = end + 1)
+			{
+			if (end == start)
+				{
+				continue;
+				}
+
+			for (i = 0; i < TA_api_count; i++)
+				{
+				api_name.assign (TA_api_schema [i].name, TA_api_schema [i].name + strlen (TA_api_schema [i].name));
+
+				if (_wcsicmp (api_name.c_str (), &disabled [start]) == 0)
+					{
+					Intercept::set_api_enabled (i, false);
+					TRACE_INFO (TRACEAPI, "API %s disabled", TA_api_schema [i].name);
+					break;
+					}
+				}
+
+			if (i == TA_api_count)
+				{
+				TRACE_WARN (TRACEAPI, "DisabledAPIs names %S, which is not intercepted", &disabled [start]);
+				}
+			}
+		}
+
+	TRACE_EXIT ();
+}							// End intercept_configure
+
+
+VOID
+policy_configure										// Load the rules in the APIPolicies registry parameter
+	(
+	)
+
+//
+// DESCRIPTION:		Read the APIPolicies registry parameter (REG_MULTI_SZ). Each string is a rule (see Policy.h): an API name, or *
+//					for every API, followed by any of dedup=K, sample=N, rate=R and burst=B. A later rule replaces an earlier one,
+//					so a rule for * can be followed by rules for particular APIs. Names are not case-sensitive
+//
+// ASSUMPTIONS:		User mode. Called from process_attach, before the Detours are attached
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::wstring	policies;
+std::wstring	api_name;
+std::wstring	rule_api;
+TA_POLICY_RULE	rule;
+size_t			start;
+size_t			end;
+ULONG			i;
+
+
+	TRACE_ENTER ();
+
+	if (!SUCCESS (Utils::registry_read_multi_wstring ((LPWSTR) L"APIPolicies", policies)))
+		{
+		TRACE_EXIT ();
+		return;
+		}
+
+	if (!Policy::start (TA_api_count, policy_report))
+		{
+		TRACE_ERROR (TRACEAPI, "Error allocating the API policies");
+		TRACE_EXIT ();
+		return;
+		}
+
+	for (start = 0; (end = policies.find (L'\0', start)) != std::wstring::npos; start = end + 1)
+		{
+		if (end == start)
+			{
+			continue;
+			}
+
+		if (!Policy::parse_rule (&policies [start], rule_api, rule))
+			{
+			TRACE_WARN (TRACEAPI, "APIPolicies rule %S is not valid", &policies [start]);
+			continue;
+			}
+
+		if (rule_api == L"*")
+			{
+			Policy::set_rule (TA_ALL_APIS, rule);
+			TRACE_INFO (TRACEAPI, "Policy of every API: dedup %u, sample %u, rate %u, burst %u", rule.dedup, rule.sample, rule.rate,
+				rule.burst);
+			continue;
+			}
+
+		for (i = 0; i < TA_api_count; i++)
+			{
+			api_name.assign (TA_api_schema [i].name, TA_api_schema [i].name + strlen (TA_api_schema [i].name));
+
+			if (_wcsicmp (api_name.c_str (), rule_api.c_str ()) == 0)
+				{
+				Policy::set_rule (i, rule);
+				TRACE_INFO (TRACEAPI, "Policy of %s: dedup %u, sample %u, rate %u, burst %u", TA_api_schema [i].name, rule.dedup,
+					rule.sample, rule.rate, rule.burst);
+				break;
+				}
+			}
+
+		if (i == TA_api_count)
+			{
+			TRACE_WARN (TRACEAPI, "APIPolicies names %S, which is not intercepted", rule_api.c_str ());
+			}
+		}
+
+	TRACE_EXIT ();
+}							// End policy_configure
+
+
+void
+policy_report											// Write the number of calls of an API that a thread skipped
+	(
+	_In_	uint32_t		Api,						// API number
+	_In_	const uint64_t	Skipped [TA_POLICY_REASON_COUNT]	// Calls skipped, for each reason
+	)
+
+//
+// DESCRIPTION:		Called by Policy before a thread's next logged call of the API, and when the thread exits. The event has the
+//					same keywords as the API events, so a session that gets them sees how many calls are missing between them
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	TraceLoggingWrite (TA_tlg, "API-Policy-Skipped", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+		TraceLoggingKeyword (TL_KW_TRACE_PRE | TL_KW_TRACE_POST), TraceLoggingDescription ("Calls not logged because of the API's policy"),
+		TraceLoggingString (TA_api_schema [Api].name, "API"),
+		TraceLoggingUInt64 (Skipped [TA_POLICY_DEDUP], "Repeated arguments"),
+		TraceLoggingUInt64 (Skipped [TA_POLICY_SAMPLE], "Not sampled"),
+		TraceLoggingUInt64 (Skipped [TA_POLICY_RATE], "Over rate limit")
+		);
+}							// End policy_report
+
+
+BOOL 
+process_attach											// Called when this DLL is loaded into a process
+	(
+	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
+	)
+
+//
+// DESCRIPTION:		
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:
+//
+// RETURN VALUES:
+//
+//
+
+{
+HANDLE		process_hdl = GetCurrentProcess ();
+
+	//
+	// Initialize WPP tracing
+	//
+
+	WPP_INIT_TRACING (0);
+	TRACE_ALWAYS (TRACEAPI, "%s", TA_product_description);
+	TRACE_ENTER ();
+
+NTSTATUS	status;
+BOOL				ret_val = TRUE;
+ULONG		length;
+
+
+	//
+	// Get the name of the executable that loaded this DLL
+	//
+
+	if ((length = GetProcessImageFileName (process_hdl, TA_image_file_name_buff, ARRAYSIZE (TA_image_file_name_buff))) != 0)
+		{
+
+		//
+		// Fill in the string descriptor
+		//
+
+		TA_image_file_name.Buffer = TA_image_file_name_buff;
+		TA_image_file_name.Length = (USHORT) length * 2;
+		TA_image_file_name.MaximumLength = ARRAYSIZE (TA_image_file_name_buff) * 2;
+		}
+	else
+		{
+		status = GetLastError ();
+		TRACE_ERROR (TRACEAPI, "Error getting image file name, status = %!STATUS!", status);
+		}
+
+	TA_tls_indent = TlsAlloc ();
+	TA_tls_thread = TlsAlloc ();
+
+	//
+	// Initialize TraceLogging
+	//
+
+	if (SUCCESS (status = TraceLoggingRegisterEx (TA_tlg, tl_enable_callback, nullptr)))
+		{
+
+		//
+		// Send a message that we've been loaded
+		//
+
+		TraceLoggingWrite (TA_tlg, "DLL-Attach", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_VERBOSE),
+			TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("DLL attached to process"),
+			TraceLoggingString (TA_product_description, "DLL description"),
+			TraceLoggingUnicodeString (&TA_image_file_name,  "Image file name")
+			);
+
+		//
+		// Start the capture rings before any intercept can run
+		//
+
+		capture_start ();
+		stats_start ();
+
+		//
+		// Decide which intercepts build events. Until this is done, they all call the real API directly
+		//
+
+		intercept_configure ();
+		policy_configure ();
+		events_update ();
+
+		//
+		// Replace the pointers to the API we are tracing: all of them now, or the core set now and the rest from the
+		// worker thread, after DllMain returns
+		//
+
+		attach_start ();
+
+		//
+		// Let another process enable, disable, attach and detach APIs from now on
+		//
+
+		control_start ();
+
+		thread_attach (Dll_hdl);
+		}
+	else
+		{
+		TRACE_ERROR (TRACEAPI, "Error registering with TraceLogging, status = %!STATUS!", status);
+		ret_val = FALSE;
+		}
+
+	TRACE_EXIT ();
+	return ret_val;
+}							// End process_attach
+
+BOOL
+process_detach											// Called when this DLL is unloaded from a process
+	(
+	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
+	)
+
+//
+// DESCRIPTION:		
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:
+//
+// RETURN VALUES:
+//
+//
+
+{
+std::vector<uint32_t>	attached;
+NTSTATUS				status;
+
+
+	TRACE_ENTER ();
+
+	TraceLoggingWrite (TA_tlg, "DLL-Detach", TraceLoggingOpcode (TL_OPC_DLL), TraceLoggingLevel (TRACE_LEVEL_VERBOSE),
+		TraceLoggingKeyword (TL_KW_DLL), TraceLoggingDescription ("DLL detached from process"),
+		TraceLoggingUnicodeString (&TA_image_file_name, "Image file name")
+		);
+
+	thread_detach (Dll_hdl);
+
+	//
+	// Stop the control channel first, so no command attaches or detaches an API while they are being detached below
+	//
+
+	control_stop ();
+
+	//
+	// Stop staged attach, then detach the APIs it attached. If a batch is still being attached (when the process is exiting,
+	// the worker thread may have been terminated in the middle of one), nothing can be detached safely
+	//
+
+	Attach::stop (false);
+
+	if (!Attach::attached (attached))
+		{
+		TRACE_WARN (TRACEAPI, "A batch of Detours is still being attached, so none are detached");
+		}
+	else if (!SUCCESS (status = detach_detours (attached.data (), (uint32_t) attached.size ())))
+		{
+		TRACE_ERROR (TRACEAPI, "Error detaching Detour, status = %!STATUS!", status);
+		}
+
+	capture_stop ();
+	stats_stop ();
+	Policy::stop ();
+
+	if (TA_tls_indent >= 0) 
+		{
+		TlsFree (TA_tls_indent);
+		}
+
+	if (TA_tls_thread >= 0) 
+		{
+		TlsFree (TA_tls_thread);
+		}
+
+	//
+	// Disconnect from TraceLogging
+	//
+
+	TraceLoggingUnregister (TA_tlg);
+
+	//
+	// Close WPP tracing
+	//
+
+	TRACE_EXIT ();
+	WPP_CLEANUP ();
+	return TRUE;
+}							// End process_detach
+
+
+VOID
+stats_report											// Write the call counters of each API
+	(
+	_In_z_	PCSTR		Reason							// Why they are being written
+	)
+
+//
+// DESCRIPTION:		Add up the threads' counters for each API that has been called, and write them to WPP and as an API-Stats
+//					TraceLogging event. The times are in microseconds; the median and 99th percentile are the upper bounds of
+//					their histogram buckets. The histogram itself is in ticks (bucket b counts calls of 2^(b-1) to 2^b - 1
+//					ticks), with the tick frequency alongside
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_API_STATS	stats;
+double			usec_per_tick = 1000000.0 / (double) Capture::tick_frequency ();
+
+
+	TRACE_ENTER ();
+
+	for (ULONG i = 0; i < TA_api_count; i++)
+		{
+		if (!Stats::get (i, stats) || stats.calls == 0)
+			{
+			continue;
+			}
+
+		TRACE_INFO (TRACEAPI, "%s: %s: %llu calls, %llu ticks, max %llu, median <= %llu, 99%% <= %llu", Reason, TA_api_schema [i].name,
+			stats.calls, stats.ticks, stats.max_ticks, Stats::percentile (stats, 50), Stats::percentile (stats, 99));
+
+		TraceLoggingWrite (TA_tlg, "API-Stats", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_STATS), TraceLoggingDescription ("API call counters"),
+			TraceLoggingString (Reason, "Reason"),
+			TraceLoggingString (TA_api_schema [i].name, "API"),
+			TraceLoggingUInt64 (stats.calls, "Calls"),
+			TraceLoggingFloat64 (stats.ticks * usec_per_tick, "Total usec"),
+			TraceLoggingFloat64 (stats.ticks * usec_per_tick / stats.calls, "Mean usec"),
+			TraceLoggingFloat64 (stats.max_ticks * usec_per_tick, "Max usec"),
+			TraceLoggingFloat64 (Stats::percentile (stats, 50) * usec_per_tick, "Median usec"),
+			TraceLoggingFloat64 (Stats::percentile (stats, 99) * usec_per_tick, "99th percentile usec"),
+			TraceLoggingUInt64Array (stats.buckets, TA_STATS_BUCKETS, "Histogram"),
+			TraceLoggingUInt64 (Capture::tick_frequency (), "Tick frequency")
+			);
+		}
+
+	TRACE_EXIT ();
+}							// End stats_report
+
+
+VOID
+stats_start												// Start statistics mode, if it is configured
+	(
+	)
+
+//
+// DESCRIPTION:		Read the Statistics registry parameter (DWORD, default 0). If it is not 0, the intercepts count and time each
+//					call to the real API instead of writing events, whether or not capture mode is also configured
+//
+// ASSUMPTIONS:		User mode. Called from process_attach, before the Detours are attached
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+ULONG	statistics;
+
+
+	TRACE_ENTER ();
+
+	Utils::registry_read_ulong ((LPWSTR) L"Statistics", 0, &statistics);
+
+	if (statistics != 0)
+		{
+		if (Stats::start (TA_api_count))
+			{
+			TRACE_INFO (TRACEAPI, "Statistics mode, %lu APIs%s", TA_api_count, Capture::enabled () ? " (capture mode is not used)" : "");
+			}
+		else
+			{
+			TRACE_ERROR (TRACEAPI, "Error starting statistics mode");
+			}
+		}
+
+	TRACE_EXIT ();
+}							// End stats_start
+
+
+VOID
+stats_stop												// Stop statistics mode, and write the call counters
+	(
+	)
+
+//
+// DESCRIPTION:		Stop counting, then write the counters, which include the threads that have exited
+//
+// ASSUMPTIONS:		User mode. Called from process_detach, after the Detours are detached
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	TRACE_ENTER ();
+
+	if (Stats::enabled ())
+		{
+		Stats::stop ();
+		stats_report ("Detach");
+		}
+
+	TRACE_EXIT ();
+}							// End stats_stop
+
+
+BOOL
+thread_attach											// Called when the process creates a new thread
+	(
+	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
+	)
+
+//
+// DESCRIPTION:		
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:
+//
+// RETURN VALUES:
+//
+//
+
+{
+LONG num_thread;
+
+
+	UNREFERENCED_PARAMETER (Dll_hdl);
+
+	TRACE_ENTER ();
+
+	if (TA_tls_indent >= 0) 
+		{
+		TlsSetValue (TA_tls_indent, (PVOID) 0);
+		}
+
+	if (TA_tls_thread >= 0) 
+		{
+		num_thread = InterlockedIncrement (&TA_thread_count);
+		TlsSetValue (TA_tls_thread, (PVOID) (LONG_PTR) num_thread);
+		}
+
+	TRACE_EXIT ();
+	return TRUE;
+}							// End thread_attach
+
+
+BOOL 
+thread_detach											// Called when a thread is exiting cleanly
+	(
+	_In_	HMODULE		Dll_hdl							// This DLL's module handle							
+	)
+
+//
+// DESCRIPTION:		
+//
+// ASSUMPTIONS:		User mode
+//
+// SIDE EFFECTS:
+//
+// RETURN VALUES:
+//
+//
+
+{
+	UNREFERENCED_PARAMETER (Dll_hdl);
+
+	TRACE_ENTER ();
+
+	if (TA_tls_indent >= 0)
+		{
+		TlsSetValue (TA_tls_indent, (PVOID) 0);
 		}
 
 	if (TA_tls_thread >= 0) 
@@ -567,4 +1750,54 @@ thread_detach											// Called when a thread is exiting cleanly
 }							// End thread_detach
 
 
+VOID
+NTAPI
+tl_enable_callback										// Called when an ETW session changes the provider's level or keywords
+	(
+	_In_		LPCGUID						Source_id,			// Session that changed the provider
+	_In_		ULONG						Is_enabled,			// EVENT_CONTROL_CODE_xxx
+	_In_		UCHAR						Level,				// Level enabled by the session
+	_In_		ULONGLONG					Match_any_keyword,	// Keywords enabled by the session
+	_In_		ULONGLONG					Match_all_keyword,	// Keywords that must all be present
+	_In_opt_	PEVENT_FILTER_DESCRIPTOR	Filter_data,		// Not used
+	_In_opt_	PVOID						Callback_context	// Not used
+	)
+
+//
+// DESCRIPTION:		TraceLogging updates the provider's combined level and keywords before it calls this routine, so events_update
+//					sees the new state. A request for the provider's state (EVENT_CONTROL_CODE_CAPTURE_STATE, e.g. from
+//					xperf -capturestate) writes the call counters, if statistics mode is on
+//
+// ASSUMPTIONS:		User mode. Called by ETW on an arbitrary thread, and during TraceLoggingRegisterEx if a session is already
+//					running
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	UNREFERENCED_PARAMETER (Source_id);
+	UNREFERENCED_PARAMETER (Level);
+	UNREFERENCED_PARAMETER (Match_any_keyword);
+	UNREFERENCED_PARAMETER (Match_all_keyword);
+	UNREFERENCED_PARAMETER (Filter_data);
+	UNREFERENCED_PARAMETER (Callback_context);
+
+	if (Is_enabled == EVENT_CONTROL_CODE_CAPTURE_STATE)
+		{
+		if (Stats::enabled ())
+			{
+			stats_report ("Capture state");
+			}
+
+		return;
+		}
+
+	events_update ();
+}							// End tl_enable_callback
+
+
 
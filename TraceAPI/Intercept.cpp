@@ -0,0 +1,199 @@
+//
+// FACILITY:	Intercept - Reentrancy guard and per-API enable bits for the generated intercepts
+//
+// DESCRIPTION:	This module contains the implementation of the Intercept class. The intercepts read only the effective bits, which
+//				are the configured per-API bits when events are enabled, and all clear when they are not. The bits change rarely
+//				(at attach, and when an ETW session changes the provider's keywords), so they are recomputed under a lock
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Added api_configured
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <mutex>
+
+//
+// Project includes
+//
+
+#include "Intercept.h"
+
+using namespace FDI;
+
+//
+// DECLARATIONS:
+//
+
+thread_local bool			Intercept::inside = false;
+std::atomic<uint32_t>		Intercept::effective [TA_MAX_APIS / 32];
+
+static std::mutex			TA_int_lock;						// Protects the fields below and updates of the effective bits
+static uint32_t				TA_int_disabled [TA_MAX_APIS / 32];	// Per-API bits (1 = disabled by name)
+static bool					TA_int_events = false;				// Somebody is listening for events
+
+
+void
+Intercept::set_api_enabled								// Enable or disable the events of an API
+	(
+	_In_	uint32_t	Api,							// API number, or TA_ALL_APIS
+	_In_	bool		Enabled							// New state
+	)
+
+//
+// DESCRIPTION:		Set the configured bit of one API, or of all of them. Every API is enabled until this is called
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_int_lock);
+
+
+	if (Api == TA_ALL_APIS)
+		{
+		for (uint32_t& bits : TA_int_disabled)
+			{
+			bits = Enabled ? 0 : ~0u;
+			}
+		}
+	else if (Api < TA_MAX_APIS)
+		{
+		if (Enabled)
+			{
+			TA_int_disabled [Api >> 5] &= ~(1u << (Api & 31));
+			}
+		else
+			{
+			TA_int_disabled [Api >> 5] |= 1u << (Api & 31);
+			}
+		}
+
+	update_effective ();
+}							// End routine Intercept::set_api_enabled
+
+
+void
+Intercept::set_events_enabled							// Record whether anybody is listening for events
+	(
+	_In_	bool		Enabled							// New state
+	)
+
+//
+// DESCRIPTION:		When no events are wanted, every intercept goes straight to the real API
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_int_lock);
+
+
+	TA_int_events = Enabled;
+	update_effective ();
+}							// End routine Intercept::set_events_enabled
+
+
+bool
+Intercept::api_enabled									// Determine whether an intercept would build its events
+	(
+	_In_	uint32_t	Api								// API number
+	)
+
+//
+// DESCRIPTION:		Return the effective bit of the API
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The API's intercept builds events
+//		false							It calls the real API directly
+//
+
+{
+	return Api < TA_MAX_APIS && (effective [Api >> 5].load (std::memory_order_relaxed) & (1u << (Api & 31))) != 0;
+}							// End routine Intercept::api_enabled
+
+
+bool
+Intercept::api_configured								// Determine whether an API is enabled by name
+	(
+	_In_	uint32_t	Api								// API number
+	)
+
+//
+// DESCRIPTION:		Return whether the API is enabled by set_api_enabled, whether or not anybody is listening for its events
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The API is enabled
+//		false							It is disabled by name, or the API number is too large
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_int_lock);
+
+
+	return Api < TA_MAX_APIS && (TA_int_disabled [Api >> 5] & (1u << (Api & 31))) == 0;
+}							// End routine Intercept::api_configured
+
+
+void
+Intercept::update_effective								// Recompute the bits the intercepts read
+	(
+	)
+
+//
+// DESCRIPTION:		Store the enabled bits, or zero if events are not enabled, into the effective bits
+//
+// ASSUMPTIONS:		The caller holds TA_int_lock
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	for (uint32_t i = 0; i < TA_MAX_APIS / 32; i++)
+		{
+		effective [i].store (TA_int_events ? ~TA_int_disabled [i] : 0, std::memory_order_relaxed);
+		}
+}							// End routine Intercept::update_effective
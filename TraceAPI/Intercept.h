@@ -0,0 +1,151 @@
+//
+// FACILITY:	Intercept - Reentrancy guard and per-API enable bits for the generated intercepts
+//
+// DESCRIPTION:	Each generated intercept calls Intercept::enter with its API number before it builds any event. enter returns false,
+//				and the intercept calls the real API directly, when:
+//
+//					- The thread is already inside an intercept. This happens when the logging path itself (a sink, an allocation,
+//					  a string conversion) calls an API that is detoured, and would otherwise produce recursive events
+//					- The API is disabled, either by name (DisabledAPIs registry parameter), or because nobody is listening for
+//					  its events (no ETW session has enabled its keywords, and capture mode is off)
+//
+//				Like Capture, this module uses only standard C++, so that it can be tested on Linux
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Added api_configured, so that staged attach (see Attach.h) can skip the APIs disabled by name
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <atomic>
+#include <cstdint>
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux test build
+#define	_In_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_MAX_APIS				8192					// Most APIs AutoGen can generate intercepts for
+#define	TA_ALL_APIS				0xFFFFFFFF				// API number that selects every API
+
+//
+// DECLARATIONS:
+//
+
+class Intercept
+{
+public:
+
+	//
+	// Public methods
+	//
+
+	static
+	inline
+	bool
+	enter												// Determine whether an intercept should build its events
+		(
+		_In_	uint32_t	Api							// API number
+		)
+		{
+		if (inside || (effective [Api >> 5].load (std::memory_order_relaxed) & (1u << (Api & 31))) == 0)
+			{
+			return false;
+			}
+
+		inside = true;
+		return true;
+		}
+
+	static
+	inline
+	void
+	leave												// Leave the intercept entered by enter
+		(
+		)
+		{
+		inside = false;
+		}
+
+	static
+	inline
+	void
+	exclude_thread										// Make every intercept called by this thread go straight to the real API
+		(
+		)
+		{
+		inside = true;
+		}
+
+	static
+	void
+	set_api_enabled										// Enable or disable the events of an API
+		(
+		_In_	uint32_t	Api,						// API number, or TA_ALL_APIS
+		_In_	bool		Enabled						// New state
+		);
+
+	static
+	void
+	set_events_enabled									// Record whether anybody is listening for events
+		(
+		_In_	bool		Enabled						// New state
+		);
+
+	static
+	bool
+	api_enabled											// Determine whether an intercept would build its events
+		(
+		_In_	uint32_t	Api							// API number
+		);
+
+	static
+	bool
+	api_configured										// Determine whether an API is enabled by name
+		(
+		_In_	uint32_t	Api							// API number
+		);
+
+private:
+
+	static
+	void
+	update_effective									// Recompute the bits the intercepts read
+		(
+		);
+
+	static thread_local bool	inside;					// The thread is inside an intercept
+	static std::atomic<uint32_t>	effective [TA_MAX_APIS / 32];	// Per-API bits, with set_events_enabled applied
+
+};	// End class Intercept
+
+}	// End of namespace FDI
@@ -0,0 +1,558 @@
+//
+// FACILITY:	attperf - Test and measure staged attach
+//
+// DESCRIPTION:	This program runs the staged attach runtime (Attach.cpp) on Linux, with an attach routine that stands in for a
+//				Detours transaction: it spins for a fixed time per transaction (suspending threads, changing page protection) and
+//				for a time per API (patching it). Every few APIs are disabled by name. The program attaches the APIs all at once,
+//				as process_attach did, and then staged, and checks that:
+//
+//					- Every enabled API is attached exactly once, and no disabled API is ever passed to the attach routine
+//					- The core set is attached before start returns, and the batches are no larger than asked
+//					- The attach routine is never called by two threads at once
+//					- After stop returns no batch is started, and attached returns exactly the APIs that were attached
+//
+//				It prints how long start takes in each mode, which is the time process_attach holds the loader lock, and how
+//				long the whole attach takes.
+//
+//				Usage: attperf [-a:apis] [-c:core] [-b:batch] [-d:disable every] [-w:usec per API] [-x:usec per batch]
+//						[-p:pause ms] [-v]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Attach.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_DONE_WAIT_MS		60000					// Longest wait for a staged attach to finish
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		apis;								// Simulated APIs
+	unsigned		core;								// APIs in the core set (the first ones)
+	unsigned		batch;								// APIs in each of the worker thread's batches
+	unsigned		disable_every;						// Disable every this many APIs (0 = none)
+	unsigned		api_usec;							// Time to patch an API
+	unsigned		batch_usec;							// Time a transaction takes, besides patching
+	unsigned		pause_ms;							// Pause between batches
+	bool			verbose;							// Print each batch
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS				PERF_options = {2000, 16, 100, 7, 10, 500, 0, false};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'a', &PERF_options.apis},
+	{'c', &PERF_options.core},
+	{'b', &PERF_options.batch},
+	{'d', &PERF_options.disable_every},
+	{'w', &PERF_options.api_usec},
+	{'x', &PERF_options.batch_usec},
+	{'p', &PERF_options.pause_ms},
+	{'v', nullptr, nullptr, &PERF_options.verbose}
+	};
+
+static std::mutex				PERF_lock;						// Protects the fields below
+static std::vector<unsigned>	PERF_attach_count;				// Times each API was passed to the attach routine
+static unsigned					PERF_calls = 0;					// Calls of the attach routine
+static unsigned					PERF_largest = 0;				// Largest batch after the core set
+static unsigned					PERF_reports = 0;				// Calls of the report routine
+static bool						PERF_done = false;				// A report said no more batches follow
+static bool						PERF_failed = false;			// A check in a callback failed
+static std::atomic<bool>		PERF_in_attach (false);			// The attach routine is running
+
+
+
+static
+void
+spin_usec												// Spin for a time
+	(
+	unsigned		Usec								// Microseconds
+	)
+
+//
+// DESCRIPTION:		Busy wait, the way patching code keeps a CPU busy
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+auto	until = std::chrono::steady_clock::now () + std::chrono::microseconds (Usec);
+
+
+	while (std::chrono::steady_clock::now () < until)
+		{
+		}
+}							// End spin_usec
+
+
+static
+bool
+simulated_attach										// Stand in for a Detours transaction
+	(
+	const uint32_t		*Apis,							// APIs to attach
+	uint32_t			Count							// Number of APIs
+	)
+
+//
+// DESCRIPTION:		Count the APIs, check that no other call is running, and spin for the time the transaction would take
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	if (PERF_in_attach.exchange (true))
+		{
+		printf ("attperf: the attach routine was called by two threads at once\n");
+		PERF_failed = true;
+		}
+
+	spin_usec (PERF_options.batch_usec + Count * PERF_options.api_usec);
+
+	{
+	std::lock_guard<std::mutex>	lock (PERF_lock);
+
+	for (uint32_t i = 0; i < Count; i++)
+		{
+		PERF_attach_count [Apis [i]]++;
+		}
+
+	PERF_calls++;
+	}
+
+	PERF_in_attach = false;
+	return true;
+}							// End simulated_attach
+
+
+static
+void
+report_progress											// Check and optionally print the progress of each batch
+	(
+	const TA_ATTACH_PROGRESS&	Progress				// Progress after the batch
+	)
+
+//
+// DESCRIPTION:		Check the size of the batch, and remember whether the attach is done
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::lock_guard<std::mutex>	lock (PERF_lock);
+
+
+	if (Progress.batch != 0 && Progress.apis > PERF_largest)
+		{
+		PERF_largest = Progress.apis;
+		}
+
+	if (!Progress.ok || Progress.attached > Progress.planned)
+		{
+		printf ("attperf: batch %u attached %u of %u APIs, ok %d\n", Progress.batch, Progress.attached, Progress.planned,
+			Progress.ok);
+		PERF_failed = true;
+		}
+
+	PERF_reports++;
+	PERF_done = PERF_done || Progress.done;
+
+	if (PERF_options.verbose)
+		{
+		printf ("    batch %u: %u APIs in %llu us, %u of %u attached after %llu us, %u skipped\n", Progress.batch,
+			Progress.apis, (unsigned long long) Progress.batch_usec, Progress.attached, Progress.planned,
+			(unsigned long long) Progress.elapsed_usec, Progress.skipped);
+		}
+}							// End report_progress
+
+
+static
+bool
+is_enabled												// Determine whether a simulated API is disabled by name
+	(
+	unsigned		Api									// API number
+	)
+
+//
+// DESCRIPTION:		Every disable_every API, starting with API 1, is disabled
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The API is enabled
+//		false							It is disabled
+//
+
+{
+	return PERF_options.disable_every == 0 || Api % PERF_options.disable_every != 1;
+}							// End is_enabled
+
+
+static
+bool
+check_attached											// Check which APIs were attached
+	(
+	const char		*Mode,								// Name of the run, for messages
+	bool			All									// Every enabled API must be attached
+	)
+
+//
+// DESCRIPTION:		Check that no API was attached twice or while disabled, that every enabled API was attached (if All), and
+//					that Attach::attached returns exactly the APIs that the attach routine was given
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The APIs were attached correctly
+//		false							They were not; the reason is printed
+//
+
+{
+std::vector<uint32_t>	attached;
+std::vector<unsigned>	expected;
+
+
+	if (!Attach::attached (attached))
+		{
+		printf ("attperf: %s: cannot get the attached APIs\n", Mode);
+		return false;
+		}
+
+	std::lock_guard<std::mutex>	lock (PERF_lock);
+
+	for (unsigned api = 0; api < PERF_options.apis; api++)
+		{
+		if (PERF_attach_count [api] > 1 || (PERF_attach_count [api] != 0 && !is_enabled (api)) ||
+			(All && PERF_attach_count [api] == 0 && is_enabled (api)))
+			{
+			printf ("attperf: %s: API %u (%s) attached %u times\n", Mode, api, is_enabled (api) ? "enabled" : "disabled",
+				PERF_attach_count [api]);
+			return false;
+			}
+
+		if (PERF_attach_count [api] != 0)
+			{
+			expected.push_back (api);
+			}
+		}
+
+	if (std::vector<unsigned> (attached.begin (), attached.end ()) != expected)
+		{
+		printf ("attperf: %s: Attach::attached returned %zu APIs, but %zu were attached\n", Mode, attached.size (),
+			expected.size ());
+		return false;
+		}
+
+	return !PERF_failed;
+}							// End check_attached
+
+
+static
+void
+reset													// Forget the APIs attached by the previous run
+	(
+	)
+
+//
+// DESCRIPTION:		Clear the counts kept by the callbacks
+//
+// ASSUMPTIONS:		No attach is running
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::lock_guard<std::mutex>	lock (PERF_lock);
+
+
+	PERF_attach_count.assign (PERF_options.apis, 0);
+	PERF_calls = 0;
+	PERF_largest = 0;
+	PERF_reports = 0;
+	PERF_done = false;
+}							// End reset
+
+
+static
+bool
+wait_done												// Wait for a staged attach to report its last batch
+	(
+	)
+
+//
+// DESCRIPTION:		Poll the flag set by report_progress
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The last batch was attached
+//		false							It was not, within PERF_DONE_WAIT_MS
+//
+
+{
+auto	give_up = std::chrono::steady_clock::now () + std::chrono::milliseconds (PERF_DONE_WAIT_MS);
+
+
+	while (std::chrono::steady_clock::now () < give_up)
+		{
+		{
+		std::lock_guard<std::mutex>	lock (PERF_lock);
+
+		if (PERF_done)
+			{
+			return true;
+			}
+		}
+
+		std::this_thread::sleep_for (std::chrono::milliseconds (1));
+		}
+
+	return false;
+}							// End wait_done
+
+
+int
+main													// Test and measure staged attach
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, then attach the simulated APIs all at once, staged, and staged but stopped part way
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								The attaches were correct
+//		1								They were not, or the options were bad
+//
+
+{
+std::vector<uint32_t>	core;
+TA_ATTACH_CONFIG		config;
+TA_ATTACH_PROGRESS		progress;
+std::chrono::steady_clock::time_point	begin;
+double					all_ms;
+double					staged_ms;
+unsigned				calls;
+bool					ok = true;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: attperf [-a:apis] [-c:core] [-b:batch] [-d:disable every] [-w:usec per API] [-x:usec per batch] "
+			"[-p:pause ms] [-v]\n");
+		return 1;
+		}
+
+	if (PERF_options.apis == 0 || PERF_options.apis > TA_MAX_APIS || PERF_options.batch == 0 ||
+		PERF_options.core > PERF_options.apis)
+		{
+		printf ("attperf: -a must be 1 to %u, -b at least 1, and -c at most -a\n", TA_MAX_APIS);
+		return 1;
+		}
+
+	printf ("attperf: %u APIs (every %u disabled), core %u, batches of %u, %u us per API, %u us per batch, pause %u ms\n",
+		PERF_options.apis, PERF_options.disable_every, PERF_options.core, PERF_options.batch, PERF_options.api_usec,
+		PERF_options.batch_usec, PERF_options.pause_ms);
+
+	for (unsigned api = 0; api < PERF_options.apis; api++)
+		{
+		Intercept::set_api_enabled (api, is_enabled (api));
+		}
+
+	for (unsigned api = 0; api < PERF_options.core; api++)
+		{
+		core.push_back (api);
+		}
+
+	config.api_count = PERF_options.apis;
+	config.core = core.data ();
+	config.core_count = (uint32_t) core.size ();
+	config.batch_apis = 0;
+	config.batch_pause_ms = PERF_options.pause_ms;
+	config.attach = simulated_attach;
+	config.detach = nullptr;
+	config.report = report_progress;
+
+	//
+	// All at once, the way process_attach attached them
+	//
+
+	reset ();
+	begin = std::chrono::steady_clock::now ();
+	ok = Attach::start (config);
+	all_ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - begin).count ();
+	Attach::stop (true);
+	ok = ok && PERF_done && PERF_calls == 1 && check_attached ("all at once", true);
+	Attach::get_progress (progress);
+	printf ("  all at once: start %8.2f ms, %u APIs attached, %u skipped\n", all_ms, progress.attached, progress.skipped);
+
+	//
+	// Staged: the core set in start, the rest on the worker thread
+	//
+
+	if (ok)
+		{
+		reset ();
+		config.batch_apis = PERF_options.batch;
+		begin = std::chrono::steady_clock::now ();
+		ok = Attach::start (config);
+		staged_ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - begin).count ();
+
+		{
+		std::lock_guard<std::mutex>	lock (PERF_lock);
+
+		for (unsigned api = 0; api < PERF_options.core; api++)
+			{
+			if (is_enabled (api) && PERF_attach_count [api] == 0)
+				{
+				printf ("attperf: staged: core API %u was not attached by start\n", api);
+				ok = false;
+				}
+			}
+		}
+
+		if (!wait_done ())
+			{
+			printf ("attperf: staged: the attach did not finish\n");
+			ok = false;
+			}
+
+		Attach::stop (true);
+		Attach::get_progress (progress);
+		ok = ok && PERF_largest <= PERF_options.batch && check_attached ("staged", true);
+		printf ("  staged:      start %8.2f ms, %u APIs attached in %u batches after %.2f ms\n", staged_ms, progress.attached,
+			progress.batch + 1, (double) progress.elapsed_usec / 1000);
+		printf ("  start takes %.1f%% of the time it took to attach everything at once\n", 100 * staged_ms / all_ms);
+		}
+
+	//
+	// Staged, but stopped after the first few batches
+	//
+
+	if (ok)
+		{
+		reset ();
+		config.batch_pause_ms = PERF_options.pause_ms != 0 ? PERF_options.pause_ms : 1;
+		ok = Attach::start (config);
+
+		for (;;)
+			{
+			{
+			std::lock_guard<std::mutex>	lock (PERF_lock);
+
+			if (PERF_reports >= 3 || PERF_done)
+				{
+				break;
+				}
+			}
+
+			std::this_thread::sleep_for (std::chrono::microseconds (100));
+			}
+
+		Attach::stop (true);
+
+		{
+		std::lock_guard<std::mutex>	lock (PERF_lock);
+
+		calls = PERF_calls;
+		}
+
+		std::this_thread::sleep_for (std::chrono::milliseconds (5 * config.batch_pause_ms + 10));
+
+		if (calls != PERF_calls)
+			{
+			printf ("attperf: stopped: %u batches were attached after stop returned\n", PERF_calls - calls);
+			ok = false;
+			}
+
+		Attach::get_progress (progress);
+		ok = ok && check_attached ("stopped", false);
+		printf ("  stopped:     %u of %u APIs attached in %u batches\n", progress.attached, progress.planned, progress.batch + 1);
+		}
+
+	printf ("attperf: %s\n", ok ? "attach verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
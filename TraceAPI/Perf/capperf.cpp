@@ -0,0 +1,756 @@
+//
+// FACILITY:	capperf - Test and measure the capture rings
+//
+// DESCRIPTION:	This program runs the capture runtime (Capture.cpp) on Linux. Each of a number of threads makes simulated calls
+//				that write a pre-call and a post-call record, the way a generated intercept does, and then the program:
+//
+//					- Reads the capture file back with TraceReader and checks that every thread's records are there, in order, once
+//					  each, and that the records written plus the overflows equal the records produced
+//					- Compares the time per call with writing each record synchronously (one write system call per record, like
+//					  TraceLoggingWrite), which is what the intercepts do when capture is off
+//
+//				Each call spins for the time the real API would take (-w), which is included in the times printed. The times are
+//				thread CPU time. A small ring (-r) with a slow sink (-s) shows the overflow counter at work.
+//
+//				With -b, each simulated WriteFile also captures the contents of a buffer of that many bytes, limited by -l, and
+//				the program checks that each snapshot follows its call's record, holds the right bytes, and is complete unless
+//				it was counted as truncated
+//
+//				Usage: capperf [-t:threads] [-n:calls] [-r:ring records] [-p:drain ms] [-s:sink usec] [-w:api nsec]
+//							   [-b:buffer bytes] [-l:limit] [-o:file] [-v]
+//
+// VERSION:		1.3
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Capture and check buffer snapshots (-b and -l)
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Identify the simulated APIs by number, read the capture file with TraceReader, and print the file's bytes per record
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Capture.h"
+#include "../TraceReader.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_API_READ			0						// API numbers of the simulated APIs
+#define	PERF_API_WRITE			1
+#define	PERF_FILE_NAME			"C:\\Users\\Public\\Documents\\capperf.dat"	// Text of each pre-call record
+#define	PERF_PARAM_BUFFER		4						// Parameter number of lpBuffer
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		threads;							// Producer threads
+	unsigned		calls;								// Simulated calls per thread
+	unsigned		ring_records;						// Records in each ring
+	unsigned		drain_ms;							// Drain period
+	unsigned		sink_usec;							// Delay added to each batch written by the sink
+	unsigned		work_nsec;							// Time the simulated API takes
+	unsigned		buffer_bytes;						// Size of the buffer each WriteFile captures
+	unsigned		data_limit;							// Capture::set_data_limit
+	const char		*file_name;							// Capture file
+	bool			verbose;							// Print each thread's results
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+typedef struct _SLOW_SINK								// Wraps the file sink to simulate a slow consumer
+	{
+	TA_SINK			file;								// The real sink
+	unsigned		usec;								// Delay per batch
+	} SLOW_SINK, *PSLOW_SINK;
+
+//
+// DECLARATIONS:
+//
+
+static const TA_PARAM_SCHEMA	PERF_params [] =		// Parameters of the simulated APIs, as simulated_call captures them
+	{
+	{"Producer", TA_PT_SCALAR},
+	{"Call", TA_PT_SCALAR},
+	{"hFile", TA_PT_POINTER},
+	{"lpFileName", TA_PT_WSTRZ},
+	{"lpBuffer", TA_PT_POINTER},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{"Call", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_API_SCHEMA	PERF_schema [] =			// Schema of the simulated APIs, indexed by PERF_API_xxx
+	{
+	{"ReadFile", PERF_params},
+	{"WriteFile", PERF_params}
+	};
+
+static PERF_OPTIONS	PERF_options = {4, 200000, 1024, 10, 0, 0, 0, TA_CAPTURE_DATA_LIMIT, "capperf.cap", false};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'t', &PERF_options.threads},
+	{'n', &PERF_options.calls},
+	{'r', &PERF_options.ring_records},
+	{'p', &PERF_options.drain_ms},
+	{'s', &PERF_options.sink_usec},
+	{'w', &PERF_options.work_nsec},
+	{'b', &PERF_options.buffer_bytes},
+	{'l', &PERF_options.data_limit},
+	{'o', nullptr, &PERF_options.file_name},
+	{'v', nullptr, nullptr, &PERF_options.verbose}
+	};
+
+static int			PERF_sync_fd = -1;
+static uint64_t		PERF_spin_count = 0;				// Iterations of simulated_api's loop that take -w nanoseconds
+
+
+
+static
+inline
+void
+simulated_api											// Stand in for the real API
+	(
+	)
+
+//
+// DESCRIPTION:		Spin for about the time the API takes (-w), using the loop count calibrated by main
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	for (volatile uint64_t i = 0; i < PERF_spin_count; i++)
+		{
+		}
+}							// End simulated_api
+
+
+static
+void
+simulated_call											// Make one simulated call, writing a record before and after
+	(
+	unsigned		Thread,								// Producer number
+	unsigned		Sequence,							// Call number within the thread
+	bool			Capture_mode						// Capture to the ring, or write synchronously
+	)
+
+//
+// DESCRIPTION:		Build the same records a generated intercept would for ReadFile or WriteFile: the parameters and a file name
+//					before the call, the return value and last error after it. WriteFile also captures its buffer (-b), whose
+//					bytes are the producer number plus their offset
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint16_t	api = (Sequence & 1) ? PERF_API_WRITE : PERF_API_READ;
+uint64_t	handle = 0x100 + Thread;
+uint32_t	status = 0;
+int			ret_value = 1;
+TA_RECORD	*rec;
+TA_RECORD	sync_rec;
+struct iovec	sync_parts [2];
+static thread_local std::vector<uint8_t>	buffer;
+
+
+	if (buffer.size () != PERF_options.buffer_bytes)
+		{
+		buffer.resize (PERF_options.buffer_bytes);
+
+		for (size_t i = 0; i < buffer.size (); i++)
+			{
+			buffer [i] = (uint8_t) (Thread + i);
+			}
+		}
+
+	if (Capture_mode)
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, api)) != nullptr)
+			{
+			Capture::add_arg (rec, Thread);
+			Capture::add_arg (rec, Sequence);
+			Capture::add_arg (rec, handle);
+			Capture::add_arg (rec, L"" PERF_FILE_NAME);
+			Capture::set_text (rec, L"" PERF_FILE_NAME);
+			Capture::add_arg (rec, buffer.data ());
+
+			if (api == PERF_API_WRITE)
+				{
+				Capture::add_data (rec, PERF_PARAM_BUFFER, buffer.data (), buffer.size (), TA_CAPTURE_MAX_DATA);
+				}
+
+			Capture::commit_record (rec);
+			}
+
+		simulated_api ();
+
+		if ((rec = Capture::begin_record (TA_REC_POST, api)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::add_arg (rec, Sequence);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		memset (&sync_rec, 0, sizeof (sync_rec));
+		sync_rec.api = api;
+		sync_rec.kind = TA_REC_PRE;
+		sync_rec.thread_id = Thread;
+		sync_rec.args [0] = Thread;
+		sync_rec.args [1] = Sequence;
+		sync_rec.args [2] = handle;
+		sync_rec.arg_count = 3;
+		Capture::set_text (&sync_rec, L"" PERF_FILE_NAME);
+
+		//
+		// Like TraceLoggingBinary, the buffer goes in the same write as the record, straight from where it is
+		//
+
+		sync_parts [0].iov_base = &sync_rec;
+		sync_parts [0].iov_len = sizeof (sync_rec);
+		sync_parts [1].iov_base = buffer.data ();
+		sync_parts [1].iov_len = api == PERF_API_WRITE ? Capture::data_length (buffer.data (), buffer.size (), TA_CAPTURE_MAX_DATA) : 0;
+
+		if (writev (PERF_sync_fd, sync_parts, 2) != (ssize_t) (sizeof (sync_rec) + sync_parts [1].iov_len))
+			{
+			abort ();
+			}
+
+		simulated_api ();
+
+		sync_rec.kind = TA_REC_POST;
+		sync_rec.args [0] = (uint64_t) ret_value;
+		sync_rec.args [1] = status;
+		sync_rec.args [2] = Sequence;
+		sync_rec.text_length = 0;
+
+		if (write (PERF_sync_fd, &sync_rec, sizeof (sync_rec)) != sizeof (sync_rec))
+			{
+			abort ();
+			}
+		}
+}							// End simulated_call
+
+
+static
+bool
+slow_sink_write											// Write a batch through the file sink, slowly
+	(
+	void				*Context,						// SLOW_SINK
+	const TA_RECORD		*Records,						// Records to write
+	size_t				Count							// Number of records
+	)
+
+//
+// DESCRIPTION:		Sleep, then pass the batch to the file sink
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Status of the file sink
+//
+
+{
+PSLOW_SINK	sink = (PSLOW_SINK) Context;
+
+
+	if (sink->usec != 0)
+		{
+		std::this_thread::sleep_for (std::chrono::microseconds (sink->usec));
+		}
+
+	return sink->file.write (sink->file.context, Records, Count);
+}							// End slow_sink_write
+
+
+static
+void
+slow_sink_close											// Close the file sink
+	(
+	void				*Context						// SLOW_SINK
+	)
+
+//
+// DESCRIPTION:		Close the file sink
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+PSLOW_SINK	sink = (PSLOW_SINK) Context;
+
+
+	sink->file.close (sink->file.context);
+}							// End slow_sink_close
+
+
+static
+double
+run_threads												// Run the producers, and return the mean nanoseconds per call
+	(
+	bool		Capture_mode							// Capture to the rings, or write synchronously
+	)
+
+//
+// DESCRIPTION:		Start the producer threads together, and time each one's calls
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Nanoseconds per call, averaged over the threads
+//
+
+{
+std::vector<std::thread>	threads;
+std::vector<double>			nsec (PERF_options.threads);
+std::atomic<bool>			go (false);
+double						total = 0;
+
+
+	for (unsigned t = 0; t < PERF_options.threads; t++)
+		{
+		threads.emplace_back ([&, t] ()
+			{
+			while (!go.load ())
+				{
+				std::this_thread::yield ();
+				}
+
+			uint64_t	start = thread_nsec ();
+
+			for (unsigned i = 0; i < PERF_options.calls; i++)
+				{
+				simulated_call (t, i, Capture_mode);
+				}
+
+			nsec [t] = (double) (thread_nsec () - start);
+			});
+		}
+
+	go.store (true);
+
+	for (auto& thread : threads)
+		{
+		thread.join ();
+		}
+
+	for (unsigned t = 0; t < PERF_options.threads; t++)
+		{
+		if (PERF_options.verbose)
+			{
+			printf ("  thread %2u: %8.1f ns/call\n", t, nsec [t] / PERF_options.calls);
+			}
+
+		total += nsec [t] / PERF_options.calls;
+		}
+
+	return total / PERF_options.threads;
+}							// End run_threads
+
+
+static
+bool
+verify_file												// Check the capture file against what the producers made
+	(
+	const TA_CAPTURE_STATS&	Stats						// Statistics from the run
+	)
+
+//
+// DESCRIPTION:		Read the capture file with TraceReader, and check that:
+//
+//					- The header is valid, and the schema is the one passed to the sink
+//					- Every producer's pre-call records have increasing call numbers and the file name as their text, and each
+//					  post-call record follows the pre-call record of the same call, or is the first record after a gap (an
+//					  overflow)
+//					- The number of records equals the records passed to the sink, and the pre-call and post-call records plus
+//					  the overflows equal the records produced
+//					- Each WriteFile pre-call record is followed by the data records of its buffer, in order, with the bytes the
+//					  producer put there, and every snapshot is complete except the ones counted as truncated
+//
+//					Then print the size of the file per record, next to the size of a record in the ring
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The file is correct
+//		false							It is not; the reason is printed
+//
+
+{
+std::map<uint32_t, int64_t>			last_pre;			// Last pre-call number for each thread
+std::map<uint32_t, unsigned>		producer;			// Producer number for each thread ID
+TraceReader							reader;
+TA_TRACE_EVENT						rec;
+uint64_t							records = 0;
+uint64_t							data_records = 0;
+uint64_t							produced = 2ULL * PERF_options.threads * PERF_options.calls;
+uint64_t							snapshots = 0;		// WriteFile calls whose buffer was captured
+uint64_t							truncated = 0;		// Snapshots that are not complete
+uint32_t							expected;			// Bytes in a complete snapshot
+uint32_t							snap_thread = 0;	// Thread of the snapshot being read
+int64_t								snap_next = -1;		// Offset of its next byte (-1 if there is none)
+struct stat							info;
+bool								ok = true;
+
+
+	if (!reader.open (PERF_options.file_name))
+		{
+		printf ("capperf: %s is not a trace file\n", PERF_options.file_name);
+		return false;
+		}
+
+	if (reader.header ().tick_frequency == 0 || reader.api_count () != 2 || reader.api (PERF_API_READ).name != "ReadFile" ||
+		reader.api (PERF_API_WRITE).name != "WriteFile" || reader.api (PERF_API_READ).pre.size () != 5 ||
+		reader.api (PERF_API_READ).pre [3].type != TA_PT_WSTRZ || reader.api (PERF_API_READ).post.size () != 3)
+		{
+		printf ("capperf: bad header or schema\n");
+		return false;
+		}
+
+	expected = Capture::data_length (&reader, PERF_options.buffer_bytes, TA_CAPTURE_MAX_DATA);
+
+	while (ok && reader.next (rec))
+		{
+		records++;
+
+		//
+		// A record other than a data record ends the snapshot before it
+		//
+
+		if (rec.kind != TA_REC_DATA && snap_next >= 0)
+			{
+			truncated += snap_next != expected;
+			snap_next = -1;
+			}
+
+		if (rec.api >= reader.api_count ())
+			{
+			printf ("capperf: record for unknown API %u\n", rec.api);
+			ok = false;
+			}
+		else if (rec.kind == TA_REC_PRE)
+			{
+			unsigned	t = (unsigned) rec.args [0];
+			int64_t		sequence = (int64_t) rec.args [1];
+			auto		last = last_pre.find (rec.thread_id);
+
+			if (producer.emplace (rec.thread_id, t).first->second != t || rec.arg_count != 5 || rec.text != PERF_FILE_NAME)
+				{
+				printf ("capperf: bad pre-call record for thread %u\n", rec.thread_id);
+				ok = false;
+				}
+			else if (last != last_pre.end () && sequence <= last->second)
+				{
+				printf ("capperf: thread %u call %lld after call %lld\n", rec.thread_id, (long long) sequence, (long long) last->second);
+				ok = false;
+				}
+			else if (rec.api != ((sequence & 1) ? PERF_API_WRITE : PERF_API_READ))
+				{
+				printf ("capperf: thread %u call %lld has the wrong API\n", rec.thread_id, (long long) sequence);
+				ok = false;
+				}
+
+			last_pre [rec.thread_id] = sequence;
+
+			if (rec.api == PERF_API_WRITE && expected != 0)
+				{
+				snapshots++;
+				snap_thread = rec.thread_id;
+				snap_next = 0;
+				}
+			}
+		else if (rec.kind == TA_REC_DATA)
+			{
+			unsigned	t = producer [rec.thread_id];
+
+			data_records++;
+
+			if (snap_next < 0 || rec.thread_id != snap_thread || rec.param != PERF_PARAM_BUFFER || rec.data_offset != snap_next ||
+				rec.data_size != PERF_options.buffer_bytes || rec.data.empty () || rec.data_offset + rec.data.size () > expected)
+				{
+				printf ("capperf: data record for thread %u at offset %u is out of place\n", rec.thread_id, rec.data_offset);
+				ok = false;
+				}
+
+			for (size_t i = 0; ok && i < rec.data.size (); i++)
+				{
+				if (rec.data [i] != (uint8_t) (t + rec.data_offset + i))
+					{
+					printf ("capperf: data record for thread %u has the wrong byte at offset %zu\n", rec.thread_id,
+						rec.data_offset + i);
+					ok = false;
+					}
+				}
+
+			snap_next += rec.data.size ();
+			}
+		else
+			{
+			auto	last = last_pre.find (rec.thread_id);
+
+			if (rec.arg_count != 3 || rec.args [0] != 1 || !rec.text.empty () ||
+				(last != last_pre.end () && (int64_t) rec.args [2] < last->second))
+				{
+				printf ("capperf: bad post-call record for thread %u\n", rec.thread_id);
+				ok = false;
+				}
+			}
+		}
+
+	if (snap_next >= 0)
+		{
+		truncated += snap_next != expected;
+		}
+
+	if (ok && reader.failed ())
+		{
+		printf ("capperf: damaged record after %llu records\n", (unsigned long long) records);
+		ok = false;
+		}
+
+	if (ok && records != Stats.records)
+		{
+		printf ("capperf: %llu records in the file, but %llu were written\n", (unsigned long long) records, (unsigned long long) Stats.records);
+		ok = false;
+		}
+
+	if (ok && records - data_records + Stats.overflows + Stats.nested != produced)
+		{
+		printf ("capperf: %llu records + %llu overflows != %llu produced\n", (unsigned long long) (records - data_records),
+			(unsigned long long) Stats.overflows, (unsigned long long) produced);
+		ok = false;
+		}
+
+	if (ok && truncated != Stats.truncated)
+		{
+		printf ("capperf: %llu snapshots are cut short, but %llu were counted\n", (unsigned long long) truncated,
+			(unsigned long long) Stats.truncated);
+		ok = false;
+		}
+
+	if (ok && snapshots != 0)
+		{
+		printf ("  snapshots:   %llu of %u bytes in %llu data records, %llu truncated\n", (unsigned long long) snapshots, expected,
+			(unsigned long long) data_records, (unsigned long long) truncated);
+		}
+
+	if (ok && last_pre.size () != PERF_options.threads)
+		{
+		printf ("capperf: %zu threads in the file\n", last_pre.size ());
+		ok = false;
+		}
+
+	if (ok && records != 0 && stat (PERF_options.file_name, &info) == 0)
+		{
+		printf ("  file:        %llu bytes, %.1f bytes/record (%zu in the ring)\n", (unsigned long long) info.st_size,
+			(double) info.st_size / (double) records, sizeof (TA_RECORD));
+		}
+
+	return ok;
+}							// End verify_file
+
+
+int
+main													// Test and measure the capture rings
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, time the synchronous writes, then time and verify a capture
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Creates the capture file and a scratch file, and deletes the scratch file
+//
+// RETURN VALUES:
+//
+//		0								The capture was correct
+//		1								It was not, or the options were bad
+//
+
+{
+TA_CAPTURE_CONFIG	config = {};
+TA_CAPTURE_STATS	stats;
+SLOW_SINK			slow;
+char				sync_name [] = "/tmp/capperf-XXXXXX";
+double				sync_ns;
+double				capture_ns;
+bool				ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: capperf [-t:threads] [-n:calls] [-r:ring records] [-p:drain ms] [-s:sink usec] [-w:api nsec]\n"
+			"               [-b:buffer bytes] [-l:limit] [-o:file] [-v]\n");
+		return 1;
+		}
+
+	if (PERF_options.threads == 0 || PERF_options.calls == 0)
+		{
+		printf ("capperf: -t and -n must be at least 1\n");
+		return 1;
+		}
+
+	Capture::set_data_limit (PERF_options.data_limit);
+	printf ("capperf: %u threads x %u calls (2 records each), API %u ns, ring %u records, drain %u ms, sink delay %u us\n",
+		PERF_options.threads, PERF_options.calls, PERF_options.work_nsec, PERF_options.ring_records, PERF_options.drain_ms,
+		PERF_options.sink_usec);
+
+	if (PERF_options.buffer_bytes != 0)
+		{
+		printf ("  WriteFile captures %u bytes of its %u-byte buffer\n",
+			Capture::data_length (&PERF_options, PERF_options.buffer_bytes, TA_CAPTURE_MAX_DATA), PERF_options.buffer_bytes);
+		}
+
+	//
+	// Calibrate the simulated API
+	//
+
+	if (PERF_options.work_nsec != 0)
+		{
+		uint64_t	best = ~0ULL;
+
+		PERF_spin_count = 10000000;
+
+		for (int i = 0; i < 5; i++)
+			{
+			uint64_t	start = thread_nsec ();
+
+			simulated_api ();
+			best = std::min (best, thread_nsec () - start);
+			}
+
+		PERF_spin_count = (uint64_t) ((double) PERF_spin_count * PERF_options.work_nsec / (double) best);
+		}
+
+	//
+	// Synchronous: one write per record, on the caller's thread
+	//
+
+	if ((PERF_sync_fd = mkstemp (sync_name)) < 0)
+		{
+		printf ("capperf: cannot create %s\n", sync_name);
+		return 1;
+		}
+
+	sync_ns = run_threads (false);
+	close (PERF_sync_fd);
+	unlink (sync_name);
+	printf ("  synchronous: %8.1f ns/call, %8.1f ns over the API\n", sync_ns, sync_ns - PERF_options.work_nsec);
+
+	//
+	// Capture: the rings, drained to the capture file
+	//
+
+	if (!Capture::open_file_sink (PERF_options.file_name, PERF_schema, sizeof (PERF_schema) / sizeof (PERF_schema [0]), slow.file))
+		{
+		printf ("capperf: cannot create %s\n", PERF_options.file_name);
+		return 1;
+		}
+
+	slow.usec = PERF_options.sink_usec;
+	config.ring_records = PERF_options.ring_records;
+	config.drain_period_ms = PERF_options.drain_ms;
+	config.sink.write = slow_sink_write;
+	config.sink.close = slow_sink_close;
+	config.sink.context = &slow;
+
+	if (!Capture::start (config))
+		{
+		printf ("capperf: cannot start capturing\n");
+		return 1;
+		}
+
+	capture_ns = run_threads (true);
+	Capture::stop (true);
+	Capture::get_stats (stats);
+
+	printf ("  capture:     %8.1f ns/call, %8.1f ns over the API\n", capture_ns, capture_ns - PERF_options.work_nsec);
+	printf ("  written %llu, overflows %llu, nested %llu, truncated %llu, batches %llu (%.1f records/batch), sink errors %llu, rings %u (%u live)\n",
+		(unsigned long long) stats.records, (unsigned long long) stats.overflows, (unsigned long long) stats.nested,
+		(unsigned long long) stats.truncated,
+		(unsigned long long) stats.batches, stats.batches ? (double) stats.records / stats.batches : 0.0,
+		(unsigned long long) stats.sink_errors, stats.rings, stats.rings_live);
+
+	ok = verify_file (stats) && stats.sink_errors == 0 && stats.rings_live == 0 && Capture::overflows () == stats.overflows;
+	printf ("capperf: %s\n", ok ? "capture file verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
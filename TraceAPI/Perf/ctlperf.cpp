@@ -0,0 +1,711 @@
+//
+// FACILITY:	ctlperf - Test and measure the runtime control channel
+//
+// DESCRIPTION:	This program runs the control channel (Control.cpp) on Linux. It creates the shared memory and forks: the parent
+//				stands in for TraceAPI, serving the ring with the intercept and staged attach runtimes and simulated attach and
+//				detach routines, and the child stands in for a controller. The controller checks that:
+//
+//					- Every opcode returns the right status and value, and API names are looked up regardless of case
+//					- Commands with an unknown version, opcode or API are rejected
+//					- Attaching and detaching an API that is already attached or detached does nothing
+//					- A full ring refuses more commands, and a command that is not run times out
+//					- Several threads posting at once each get their own results, over many laps of the ring
+//
+//				and the parent checks that enabling and disabling change only Intercept's bits, that each attach and detach
+//				reached the routine once, and that every command posted was run.
+//
+//				It prints the average time a command takes, from posting it to reading its result.
+//
+//				Usage: ctlperf [-t:threads] [-n:commands per thread] [-p:poll ms] [-v]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Attach.h"
+#include "../Control.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_TIMEOUT_MS			10000					// Longest wait for a command
+#define	PERF_DETACHED_API		5						// API the controller detaches and attaches again
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		threads;							// Controller threads posting at once
+	unsigned		commands;							// Commands each thread sends
+	unsigned		poll_ms;							// Time between checks of the ring
+	bool			verbose;							// Print each command the parent runs
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static const TA_API_SCHEMA		PERF_schema [] =				// Same names as TraceAPI's APIs
+	{
+	{"CreateFileW", nullptr},
+	{"DeleteFileW", nullptr},
+	{"FindClose", nullptr},
+	{"FindFirstFileW", nullptr},
+	{"GetFileAttributesExW", nullptr},
+	{"GetFileAttributesW", nullptr},
+	{"GetFileInformationByHandle", nullptr},
+	{"GetFullPathNameW", nullptr},
+	{"ReadFile", nullptr},
+	{"SetEndOfFile", nullptr},
+	{"WriteFile", nullptr},
+	};
+
+#define	PERF_APIS				((uint32_t) (sizeof (PERF_schema) / sizeof (PERF_schema [0])))
+
+static PERF_OPTIONS				PERF_options = {4, 2000, 1, false};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'t', &PERF_options.threads},
+	{'n', &PERF_options.commands},
+	{'p', &PERF_options.poll_ms},
+	{'v', nullptr, nullptr, &PERF_options.verbose}
+	};
+
+static unsigned					PERF_attaches [PERF_APIS];		// Times each API was passed to the attach routine
+static unsigned					PERF_detaches [PERF_APIS];		// Times each API was passed to the detach routine
+static bool						PERF_failed = false;			// A check in a callback failed (set only by the serving thread)
+
+
+
+static
+bool
+simulated_attach										// Stand in for a Detours transaction that attaches
+	(
+	const uint32_t		*Apis,							// APIs to attach
+	uint32_t			Count							// Number of APIs
+	)
+
+//
+// DESCRIPTION:		Count the APIs
+//
+// ASSUMPTIONS:		Attach never calls the attach and detach routines at once
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	for (uint32_t i = 0; i < Count; i++)
+		{
+		PERF_attaches [Apis [i]]++;
+		}
+
+	return true;
+}							// End simulated_attach
+
+
+static
+bool
+simulated_detach										// Stand in for a Detours transaction that detaches
+	(
+	const uint32_t		*Apis,							// APIs to detach
+	uint32_t			Count							// Number of APIs
+	)
+
+//
+// DESCRIPTION:		Count the APIs
+//
+// ASSUMPTIONS:		Attach never calls the attach and detach routines at once
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	for (uint32_t i = 0; i < Count; i++)
+		{
+		PERF_detaches [Apis [i]]++;
+		}
+
+	return true;
+}							// End simulated_detach
+
+
+static
+void
+report_command											// Check each command the parent runs
+	(
+	uint16_t		Opcode,								// TA_CONTROL_OPCODES
+	uint32_t		Api,								// API number
+	uint32_t		Result,								// TA_CONTROL_STATUS
+	uint32_t		Value								// Value returned by the command
+	)
+
+//
+// DESCRIPTION:		After an enable or disable, check that the intercept's fast path sees the new state
+//
+// ASSUMPTIONS:		Called on the serving thread
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint32_t	check = Api == TA_ALL_APIS ? 0 : Api;
+
+
+	if (Result == TA_CTL_OK && (Opcode == TA_CTL_ENABLE || Opcode == TA_CTL_DISABLE) &&
+		Intercept::api_enabled (check) != (Opcode == TA_CTL_ENABLE))
+		{
+		printf ("ctlperf: opcode %u did not change the fast path of API %u\n", Opcode, check);
+		PERF_failed = true;
+		}
+
+	if (PERF_options.verbose)
+		{
+		printf ("    opcode %u, API %#x: status %u, value %u\n", Opcode, Api, Result, Value);
+		}
+}							// End report_command
+
+
+static
+bool
+expect													// Send a command and check its result
+	(
+	TA_CONTROL_BLOCK&	Block,							// Ring
+	uint16_t			Opcode,							// TA_CONTROL_OPCODES
+	uint32_t			Api,							// API number, TA_ALL_APIS, or TA_CONTROL_BY_NAME
+	const char			*Name,							// API name (or nullptr)
+	TA_CONTROL_STATUS	Status,							// Status expected
+	uint32_t			Value							// Value expected (when Status is TA_CTL_OK)
+	)
+
+//
+// DESCRIPTION:		Send the command, and print it if the status or value is not the one expected
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The command returned what was expected
+//		false							It did not
+//
+
+{
+TA_CONTROL_STATUS	status;
+uint32_t			value = 0;
+
+
+	status = Control::send (Block, Opcode, Api, Name, PERF_TIMEOUT_MS, &value);
+
+	if (status != Status || (Status == TA_CTL_OK && value != Value))
+		{
+		printf ("ctlperf: opcode %u, API %#x (%s) returned status %u, value %u; expected %u, %u\n", Opcode, Api,
+			Name != nullptr ? Name : "", status, value, Status, Value);
+		return false;
+		}
+
+	return true;
+}							// End expect
+
+
+static
+bool
+post_version											// Post a command from a controller of another version
+	(
+	TA_CONTROL_BLOCK&	Block,							// Ring
+	uint16_t			Version,						// Version to put in the command
+	uint32_t&			Position						// Position of the command, for wait
+	)
+
+//
+// DESCRIPTION:		Claim a slot the way Control::post does, but write the version given
+//
+// ASSUMPTIONS:		The ring is not full
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The command is in the ring
+//		false							The slot was not free
+//
+
+{
+TA_CONTROL_COMMAND	*slot;
+uint32_t			position = Block.head.load ();
+
+
+	do
+		{
+		slot = &Block.commands [position & (TA_CONTROL_SLOTS - 1)];
+
+		if (slot->sequence.load () != position)
+			{
+			return false;
+			}
+		}
+	while (!Block.head.compare_exchange_weak (position, position + 1));
+
+	slot->version = Version;
+	slot->opcode = TA_CTL_PING;
+	slot->api = 0;
+	slot->name [0] = '\0';
+	slot->sequence.store (position + 1);
+	Position = position;
+	return true;
+}							// End post_version
+
+
+static
+bool
+check_commands											// Check each opcode, and the commands that are rejected
+	(
+	TA_CONTROL_BLOCK&	Block							// Ring
+	)
+
+//
+// DESCRIPTION:		Send one of each command, from one thread, and check the results
+//
+// ASSUMPTIONS:		Every API starts enabled and attached
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Every command returned what was expected
+//		false							One did not
+//
+
+{
+const uint32_t	both = TA_CTL_STATE_ENABLED | TA_CTL_STATE_ATTACHED;
+uint32_t		position;
+bool			ok = true;
+
+
+	ok = expect (Block, TA_CTL_PING, 0, nullptr, TA_CTL_OK, PERF_APIS) && ok;
+	ok = expect (Block, TA_CTL_LOOKUP, TA_CONTROL_BY_NAME, "readfile", TA_CTL_OK, 8) && ok;
+	ok = expect (Block, TA_CTL_LOOKUP, TA_CONTROL_BY_NAME, "ReadFil", TA_CTL_BAD_API, 0) && ok;
+	ok = expect (Block, TA_CTL_LOOKUP, TA_CONTROL_BY_NAME, "ReadFileEx", TA_CTL_BAD_API, 0) && ok;
+	ok = expect (Block, TA_CTL_QUERY, 3, nullptr, TA_CTL_OK, both) && ok;
+
+	//
+	// Enable and disable
+	//
+
+	ok = expect (Block, TA_CTL_DISABLE, TA_CONTROL_BY_NAME, "FindFirstFileW", TA_CTL_OK, 0) && ok;
+	ok = expect (Block, TA_CTL_QUERY, 3, nullptr, TA_CTL_OK, TA_CTL_STATE_ATTACHED) && ok;
+	ok = expect (Block, TA_CTL_ENABLE, 3, nullptr, TA_CTL_OK, 0) && ok;
+	ok = expect (Block, TA_CTL_QUERY, 3, nullptr, TA_CTL_OK, both) && ok;
+	ok = expect (Block, TA_CTL_DISABLE, TA_ALL_APIS, nullptr, TA_CTL_OK, 0) && ok;
+	ok = expect (Block, TA_CTL_QUERY, PERF_APIS - 1, nullptr, TA_CTL_OK, TA_CTL_STATE_ATTACHED) && ok;
+	ok = expect (Block, TA_CTL_ENABLE, TA_ALL_APIS, nullptr, TA_CTL_OK, 0) && ok;
+
+	//
+	// Detach and attach, twice each
+	//
+
+	ok = expect (Block, TA_CTL_DETACH, PERF_DETACHED_API, nullptr, TA_CTL_OK, 0) && ok;
+	ok = expect (Block, TA_CTL_DETACH, PERF_DETACHED_API, nullptr, TA_CTL_OK, 0) && ok;
+	ok = expect (Block, TA_CTL_QUERY, PERF_DETACHED_API, nullptr, TA_CTL_OK, TA_CTL_STATE_ENABLED) && ok;
+	ok = expect (Block, TA_CTL_ATTACH, PERF_DETACHED_API, nullptr, TA_CTL_OK, 0) && ok;
+	ok = expect (Block, TA_CTL_ATTACH, PERF_DETACHED_API, nullptr, TA_CTL_OK, 0) && ok;
+	ok = expect (Block, TA_CTL_QUERY, PERF_DETACHED_API, nullptr, TA_CTL_OK, both) && ok;
+
+	//
+	// Rejected
+	//
+
+	ok = expect (Block, TA_CTL_QUERY, PERF_APIS, nullptr, TA_CTL_BAD_API, 0) && ok;
+	ok = expect (Block, TA_CTL_QUERY, TA_ALL_APIS, nullptr, TA_CTL_BAD_API, 0) && ok;
+	ok = expect (Block, TA_CTL_ATTACH, TA_ALL_APIS, nullptr, TA_CTL_BAD_API, 0) && ok;
+	ok = expect (Block, TA_CTL_DETACH, TA_CONTROL_BY_NAME, "NoSuchApi", TA_CTL_BAD_API, 0) && ok;
+	ok = expect (Block, TA_CTL_OPCODE_COUNT, 0, nullptr, TA_CTL_BAD_OPCODE, 0) && ok;
+
+	for (uint16_t version : {(uint16_t) 0, (uint16_t) (TA_CONTROL_VERSION + 1)})
+		{
+		if (!post_version (Block, version, position) ||
+			Control::wait (Block, position, PERF_TIMEOUT_MS, nullptr) != TA_CTL_BAD_VERSION)
+			{
+			printf ("ctlperf: a command of version %u was not rejected\n", version);
+			ok = false;
+			}
+		}
+
+	return ok;
+}							// End check_commands
+
+
+static
+bool
+check_full												// Check a ring that nobody serves
+	(
+	)
+
+//
+// DESCRIPTION:		Fill a ring of its own, check that one more command is refused, and that waiting for a command times out
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The ring behaved as expected
+//		false							It did not
+//
+
+{
+std::vector<char>	memory (sizeof (TA_CONTROL_BLOCK));
+TA_CONTROL_BLOCK	*block = (TA_CONTROL_BLOCK *) memory.data ();
+uint32_t			position;
+bool				ok = true;
+
+
+	Control::init_block (block, PERF_APIS);
+
+	for (uint32_t i = 0; i < TA_CONTROL_SLOTS; i++)
+		{
+		if (!Control::post (*block, TA_CTL_PING, 0, nullptr, position) || position != i)
+			{
+			printf ("ctlperf: command %u did not fit in an empty ring\n", i);
+			ok = false;
+			}
+		}
+
+	if (Control::post (*block, TA_CTL_PING, 0, nullptr, position))
+		{
+		printf ("ctlperf: a full ring took another command\n");
+		ok = false;
+		}
+
+	if (Control::wait (*block, 0, 1, nullptr) != TA_CTL_TIMEOUT ||
+		Control::send (*block, TA_CTL_PING, 0, nullptr, 1, nullptr) != TA_CTL_TIMEOUT)
+		{
+		printf ("ctlperf: a command that was not run did not time out\n");
+		ok = false;
+		}
+
+	return ok;
+}							// End check_full
+
+
+static
+void
+controller_thread										// Send commands from one of several threads
+	(
+	TA_CONTROL_BLOCK	*Block,							// Ring
+	unsigned			Thread,							// Thread number (its API is Thread % the number of APIs)
+	std::atomic<bool>	*Failed,						// Set if a command returns what was not expected
+	std::atomic<uint64_t>	*Nsec						// Total time taken by the commands
+	)
+
+//
+// DESCRIPTION:		Toggle the thread's API between enabled and disabled, querying it after each change. Threads that share an API
+//					only query it
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint32_t	api = Thread % PERF_APIS;
+bool		owner = Thread < PERF_APIS;
+bool		enabled = true;
+auto		begin = std::chrono::steady_clock::now ();
+TA_CONTROL_STATUS	status;
+uint32_t	value;
+
+
+	for (unsigned i = 0; i < PERF_options.commands; i++)
+		{
+		if (owner && i % 2 == 0)
+			{
+			enabled = !enabled;
+			status = Control::send (*Block, enabled ? TA_CTL_ENABLE : TA_CTL_DISABLE, api, nullptr, PERF_TIMEOUT_MS, &value);
+			}
+		else
+			{
+			status = Control::send (*Block, TA_CTL_QUERY, api, nullptr, PERF_TIMEOUT_MS, &value);
+
+			if (status == TA_CTL_OK && owner && ((value & TA_CTL_STATE_ENABLED) != 0) != enabled)
+				{
+				printf ("ctlperf: thread %u: API %u is %s, but was last %s\n", Thread, api,
+					(value & TA_CTL_STATE_ENABLED) != 0 ? "enabled" : "disabled", enabled ? "enabled" : "disabled");
+				*Failed = true;
+				}
+			}
+
+		if (status != TA_CTL_OK)
+			{
+			printf ("ctlperf: thread %u: command %u returned status %u\n", Thread, i, status);
+			*Failed = true;
+			break;
+			}
+		}
+
+	if (owner && !enabled)
+		{
+		Control::send (*Block, TA_CTL_ENABLE, api, nullptr, PERF_TIMEOUT_MS, nullptr);
+		}
+
+	*Nsec += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count ();
+}							// End controller_thread
+
+
+static
+int
+controller												// Stand in for a controller (the child)
+	(
+	TA_CONTROL_BLOCK	*Block							// Ring
+	)
+
+//
+// DESCRIPTION:		Wait for the block to be ready, run the checks, then send commands from several threads at once
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every command returned what was expected
+//		1								One did not
+//
+
+{
+std::vector<std::thread>	threads;
+std::atomic<bool>			failed (false);
+std::atomic<uint64_t>		nsec (0);
+unsigned					commands = PERF_options.threads * PERF_options.commands;
+bool						ok;
+
+
+	if (Block->magic != TA_CONTROL_MAGIC || Block->version != TA_CONTROL_VERSION || Block->slots != TA_CONTROL_SLOTS)
+		{
+		printf ("ctlperf: the block is not ready\n");
+		return 1;
+		}
+
+	ok = check_full ();
+	ok = check_commands (*Block) && ok;
+
+	for (unsigned t = 0; t < PERF_options.threads; t++)
+		{
+		threads.emplace_back (controller_thread, Block, t, &failed, &nsec);
+		}
+
+	for (auto& thread : threads)
+		{
+		thread.join ();
+		}
+
+	ok = ok && !failed;
+
+	printf ("  %u threads sent %u commands (%u laps of the ring); a command takes %.1f us on average\n",
+		PERF_options.threads, commands, commands / TA_CONTROL_SLOTS, (double) nsec / 1000 / (commands != 0 ? commands : 1));
+	return ok ? 0 : 1;
+}							// End controller
+
+
+int
+main													// Test and measure the control channel
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, create the ring in shared memory, then serve it while a child process sends commands
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								The control channel worked
+//		1								It did not, or the options were bad
+//
+
+{
+std::vector<uint32_t>	core;
+TA_ATTACH_CONFIG		attach_config;
+TA_CONTROL_CONFIG		control_config;
+TA_CONTROL_BLOCK		*block;
+pid_t					child;
+int						child_status;
+bool					ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: ctlperf [-t:threads] [-n:commands per thread] [-p:poll ms] [-v]\n");
+		return 1;
+		}
+
+	if (PERF_options.poll_ms == 0)
+		{
+		printf ("ctlperf: -p must be at least 1\n");
+		return 1;
+		}
+
+	printf ("ctlperf: %u threads, %u commands each, poll every %u ms\n", PERF_options.threads, PERF_options.commands,
+		PERF_options.poll_ms);
+
+	block = (TA_CONTROL_BLOCK *) mmap (nullptr, sizeof (TA_CONTROL_BLOCK), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		-1, 0);
+
+	if (block == MAP_FAILED)
+		{
+		perror ("ctlperf: mmap");
+		return 1;
+		}
+
+	Control::init_block (block, PERF_APIS);
+	fflush (stdout);
+
+	//
+	// Fork before starting any thread
+	//
+
+	if ((child = fork ()) < 0)
+		{
+		perror ("ctlperf: fork");
+		return 1;
+		}
+
+	if (child == 0)
+		{
+		child_status = controller (block);
+		fflush (stdout);
+		_exit (child_status);
+		}
+
+	//
+	// Every API enabled and attached
+	//
+
+	Intercept::set_events_enabled (true);
+	Intercept::set_api_enabled (TA_ALL_APIS, true);
+
+	for (uint32_t api = 0; api < PERF_APIS; api++)
+		{
+		core.push_back (api);
+		}
+
+	attach_config.api_count = PERF_APIS;
+	attach_config.core = core.data ();
+	attach_config.core_count = PERF_APIS;
+	attach_config.batch_apis = 0;
+	attach_config.batch_pause_ms = 0;
+	attach_config.attach = simulated_attach;
+	attach_config.detach = simulated_detach;
+	attach_config.report = nullptr;
+
+	control_config.schema = PERF_schema;
+	control_config.api_count = PERF_APIS;
+	control_config.poll_ms = PERF_options.poll_ms;
+	control_config.report = report_command;
+
+	ok = Attach::start (attach_config) && Control::start (block, control_config);
+
+	if (!ok)
+		{
+		printf ("ctlperf: cannot start serving the ring\n");
+		}
+
+	if (waitpid (child, &child_status, 0) != child || !WIFEXITED (child_status) || WEXITSTATUS (child_status) != 0)
+		{
+		ok = false;
+		}
+
+	ok = Control::stop (true) && ok;
+	Attach::stop (true);
+
+	//
+	// Check what the commands did to this process
+	//
+
+	for (uint32_t api = 0; api < PERF_APIS; api++)
+		{
+		unsigned	expected = api == PERF_DETACHED_API ? 1 : 0;
+
+		if (PERF_attaches [api] != 1 + expected || PERF_detaches [api] != expected || !Attach::is_attached (api) ||
+			!Intercept::api_enabled (api))
+			{
+			printf ("ctlperf: API %u: attached %u times, detached %u times, finally %s and %s\n", api, PERF_attaches [api],
+				PERF_detaches [api], Attach::is_attached (api) ? "attached" : "detached",
+				Intercept::api_enabled (api) ? "enabled" : "disabled");
+			ok = false;
+			}
+		}
+
+	if (block->served.load () != block->head.load () || block->tail.load () != block->head.load ())
+		{
+		printf ("ctlperf: %u commands were posted, but %u were run\n", block->head.load (), block->served.load ());
+		ok = false;
+		}
+
+	ok = ok && !PERF_failed;
+	printf ("ctlperf: %s\n", ok ? "control channel verified" : "FAILED");
+	munmap (block, sizeof (TA_CONTROL_BLOCK));
+	return ok ? 0 : 1;
+}							// End main
@@ -0,0 +1,574 @@
+//
+// FACILITY:	intperf - Measure the overhead of an intercept
+//
+// DESCRIPTION:	This program runs an intercept shaped like the ones Detours.stg generates, around a no-op function, on Linux. The
+//				intercept uses the real Intercept and Capture runtimes; TraceLoggingWrite is replaced by a stand-in event sink that
+//				formats the event and writes it to /dev/null (one system call per event, like EventWrite). The program times:
+//
+//					- Calling the no-op function directly, through the real_ pointer
+//					- The intercept when nobody is listening (events disabled), and when the API is disabled by name
+//					- The intercept writing its events to the stand-in sink, with and without the reentrancy guard
+//					- The intercept in capture mode, with a sink that discards the records
+//					- The intercept in statistics mode, which times the call and counts it
+//					- The intercept writing to the stand-in sink with a policy that logs one call in 10
+//
+//				The stand-in sink and the capture sink both call the intercepted function, like a file sink calling WriteFile. The
+//				program checks that those calls go straight to the real function, so each intercepted call produces exactly one
+//				pre-call and one post-call event. The times are thread CPU time, the best of several runs.
+//
+//				Usage: intperf [-n:calls] [-r:ring records]
+//
+// VERSION:		1.3
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Apply the API's policy, as the generated intercept does, and time a sampled run
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Time the intercept in statistics mode
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+//
+// Project includes
+//
+
+#include "../Capture.h"
+#include "../Intercept.h"
+#include "../Stats.h"
+#include "../Policy.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_RUNS				5						// Runs of each mode; the fastest is reported
+#define	PERF_API_NOOP			0						// API number of the no-op function
+
+//
+// TYPES:
+//
+
+typedef int (*NOOP_ROUTINE) (int, void *);
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		calls;								// Calls per run
+	unsigned		ring_records;						// Records in the capture ring
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS				PERF_options = {1000000, 65536};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.calls},
+	{'r', &PERF_options.ring_records}
+	};
+
+static int						PERF_null_fd = -1;		// /dev/null, where the stand-in sink writes its events
+static uint64_t					PERF_events = 0;		// Events written to the stand-in sink
+static bool						PERF_sink_reenters = true;	// The stand-in sink calls the intercepted function
+static std::atomic<uint64_t>	PERF_captured (0);		// Records passed to the capture sink
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+int
+my_Noop													// Intercept of the no-op function
+	(
+	int				Value,								// Value to return, plus one
+	void			*Buffer								// Not used
+	);
+
+__attribute__ ((noinline))
+static
+int
+Noop													// The function being intercepted
+	(
+	int				Value,								// Value to return, plus one
+	void			*Buffer								// Not used
+	)
+{
+	__asm__ volatile ("" : : "r" (Buffer) : "memory");
+	return Value + 1;
+}							// End Noop
+
+//
+// The real_ pointer, as in the generated code. It is volatile so that the compiler makes an indirect call, as it must
+// for a detoured API
+//
+
+static NOOP_ROUTINE volatile	real_Noop = Noop;
+
+
+
+__attribute__ ((noinline))
+static
+void
+trace_write												// Stand-in for TraceLoggingWrite
+	(
+	const char		*Event,								// Event name
+	const char		*Api,								// API name
+	const uint64_t	*Args,								// Event fields
+	unsigned		Count								// Number of fields
+	)
+
+//
+// DESCRIPTION:		Format the event the way ETW would (name, API and fields packed into a buffer), and write it to /dev/null. Then
+//					call the intercepted function, as a sink that writes to a file would call WriteFile
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+char	buffer [256];
+size_t	length;
+size_t	size;
+
+
+	length = strlen (Event) + 1;
+	memcpy (buffer, Event, length);
+	size = strlen (Api) + 1;
+	memcpy (buffer + length, Api, size);
+	length += size;
+	memcpy (buffer + length, Args, Count * sizeof (uint64_t));
+	length += Count * sizeof (uint64_t);
+
+	if (write (PERF_null_fd, buffer, length) < 0)
+		{
+		return;
+		}
+
+	PERF_events++;
+
+	if (PERF_sink_reenters)
+		{
+		my_Noop (0, buffer);
+		}
+}							// End trace_write
+
+
+static
+int
+my_Noop													// Intercept of the no-op function
+	(
+	int				Value,								// Value to return, plus one
+	void			*Buffer								// Not used
+	)
+
+//
+// DESCRIPTION:		The generated intercept, with TraceLoggingWrite replaced by trace_write and GetLastError by errno
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		The value returned by the real function
+//
+
+{
+int					status;
+int					ret_value;
+static const char	api_name [] = "Noop";
+TA_RECORD			*rec;
+uint64_t			begin;
+
+
+	if (!Intercept::enter (PERF_API_NOOP))
+		{
+		return real_Noop (Value, Buffer);
+		}
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_Noop (Value, Buffer);
+		Stats::call_end (PERF_API_NOOP, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	if (!Policy::admit (PERF_API_NOOP, Value, Buffer))
+		{
+		ret_value = real_Noop (Value, Buffer);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, PERF_API_NOOP)) != nullptr)
+			{
+			Capture::add_arg (rec, Value);
+			Capture::add_arg (rec, Buffer);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		uint64_t	args [2] = {(uint64_t) Value, (uint64_t) (uintptr_t) Buffer};
+
+		trace_write ("API-Trace-PRECALL", api_name, args, 2);
+		}
+
+	ret_value = real_Noop (Value, Buffer);
+	status = errno;
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, PERF_API_NOOP)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		uint64_t	args [2] = {(uint64_t) ret_value, (uint64_t) status};
+
+		trace_write ("API-Trace-POSTCALL", api_name, args, 2);
+		}
+
+	Intercept::leave ();
+	return ret_value;
+}							// End my_Noop
+
+
+static
+int
+my_Noop_unguarded										// The intercept as it was generated before the reentrancy guard
+	(
+	int				Value,								// Value to return, plus one
+	void			*Buffer								// Not used
+	)
+
+//
+// DESCRIPTION:		my_Noop without Intercept::enter and Intercept::leave. Its events are always built, and a sink that calls the
+//					intercepted function would recurse, so it is only run with PERF_sink_reenters clear
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		The value returned by the real function
+//
+
+{
+int					status;
+int					ret_value;
+static const char	api_name [] = "Noop";
+uint64_t			args [2];
+
+
+	args [0] = (uint64_t) Value;
+	args [1] = (uint64_t) (uintptr_t) Buffer;
+	trace_write ("API-Trace-PRECALL", api_name, args, 2);
+
+	ret_value = real_Noop (Value, Buffer);
+	status = errno;
+
+	args [0] = (uint64_t) ret_value;
+	args [1] = (uint64_t) status;
+	trace_write ("API-Trace-POSTCALL", api_name, args, 2);
+	return ret_value;
+}							// End my_Noop_unguarded
+
+
+static
+bool
+capture_sink_write										// Capture sink that counts the records and discards them
+	(
+	void				*Context,						// Not used
+	const TA_RECORD		*Records,						// Records to write
+	size_t				Count							// Number of records
+	)
+
+//
+// DESCRIPTION:		Count the records, and call the intercepted function, as the file sink calls WriteFile
+//
+// ASSUMPTIONS:		Called on the drain thread
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	PERF_captured.fetch_add (Count, std::memory_order_relaxed);
+	my_Noop ((int) Count, (void *) Records);
+	return true;
+}							// End capture_sink_write
+
+
+static
+double
+time_calls												// Time calls through a pointer, and return the nanoseconds per call
+	(
+	NOOP_ROUTINE	Routine								// Routine to call
+	)
+
+//
+// DESCRIPTION:		Call the routine through a volatile pointer, as the caller of a detoured API does, PERF_RUNS times, and
+//					return the time per call of the fastest run
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Nanoseconds per call
+//
+
+{
+NOOP_ROUTINE volatile	routine = Routine;
+uint64_t				best = ~0ULL;
+int						sum = 0;
+
+
+	for (int run = 0; run < PERF_RUNS; run++)
+		{
+		uint64_t	start = thread_nsec ();
+
+		for (unsigned i = 0; i < PERF_options.calls; i++)
+			{
+			sum += routine ((int) i, &sum);
+			}
+
+		best = std::min (best, thread_nsec () - start);
+		}
+
+	__asm__ volatile ("" : : "r" (sum));
+	return (double) best / PERF_options.calls;
+}							// End time_calls
+
+
+int
+main													// Measure the overhead of an intercept
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, then time each mode and check the number of events it produced
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every mode produced the events it should
+//		1								One did not, or the options were bad
+//
+
+{
+TA_CAPTURE_CONFIG	config = {};
+TA_CAPTURE_STATS	stats;
+TA_API_STATS		api_stats;
+TA_POLICY_RULE		rule = {};
+uint64_t			expected = (uint64_t) PERF_RUNS * 2;
+double				direct_ns;
+double				ns;
+bool				ok = true;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: intperf [-n:calls] [-r:ring records]\n");
+		return 1;
+		}
+
+	if (PERF_options.calls == 0 || (PERF_null_fd = open ("/dev/null", O_WRONLY)) < 0)
+		{
+		printf ("intperf: -n must be at least 1, and /dev/null must be writable\n");
+		return 1;
+		}
+
+	expected *= PERF_options.calls;
+	printf ("intperf: %u calls per run, best of %u runs\n", PERF_options.calls, PERF_RUNS);
+
+	//
+	// The function itself
+	//
+
+	direct_ns = time_calls (real_Noop);
+	printf ("  direct:                  %7.1f ns/call\n", direct_ns);
+
+	//
+	// Nobody listening, then listening but with the API disabled by name. The intercept calls the real function
+	//
+
+	Intercept::set_events_enabled (false);
+	ns = time_calls (my_Noop);
+	printf ("  events disabled:         %7.1f ns/call, %7.1f ns over direct\n", ns, ns - direct_ns);
+
+	Intercept::set_events_enabled (true);
+	Intercept::set_api_enabled (PERF_API_NOOP, false);
+	ns = time_calls (my_Noop);
+	printf ("  API disabled:            %7.1f ns/call, %7.1f ns over direct\n", ns, ns - direct_ns);
+	Intercept::set_api_enabled (TA_ALL_APIS, true);
+
+	if (PERF_events != 0)
+		{
+		printf ("intperf: disabled intercepts wrote %llu events\n", (unsigned long long) PERF_events);
+		ok = false;
+		}
+
+	//
+	// Events to the stand-in sink, without the guard (the sink can't call the function, or it would recurse), then with
+	// it (the sink calls the function, which must not produce more events)
+	//
+
+	PERF_sink_reenters = false;
+	PERF_events = 0;
+	ns = time_calls (my_Noop_unguarded);
+	printf ("  sink, unguarded:         %7.1f ns/call, %7.1f ns over direct\n", ns, ns - direct_ns);
+
+	PERF_sink_reenters = true;
+	PERF_events = 0;
+	ns = time_calls (my_Noop);
+	printf ("  sink, guarded:           %7.1f ns/call, %7.1f ns over direct (sink calls the function)\n", ns, ns - direct_ns);
+
+	if (PERF_events != expected)
+		{
+		printf ("intperf: the sink wrote %llu events, not %llu\n", (unsigned long long) PERF_events, (unsigned long long) expected);
+		ok = false;
+		}
+
+	//
+	// Capture mode. The drain thread's sink calls the function, which must not be captured
+	//
+
+	config.ring_records = PERF_options.ring_records;
+	config.drain_period_ms = 10;
+	config.sink.write = capture_sink_write;
+
+	if (!Capture::start (config))
+		{
+		printf ("intperf: cannot start capturing\n");
+		return 1;
+		}
+
+	PERF_events = 0;
+	ns = time_calls (my_Noop);
+	Capture::stop (true);
+	Capture::get_stats (stats);
+	printf ("  capture:                 %7.1f ns/call, %7.1f ns over direct (sink calls the function)\n", ns, ns - direct_ns);
+	printf ("  captured %llu, overflows %llu, nested %llu, batches %llu\n", (unsigned long long) stats.records,
+		(unsigned long long) stats.overflows, (unsigned long long) stats.nested, (unsigned long long) stats.batches);
+
+	if (PERF_events != 0 || stats.records != PERF_captured.load () || stats.nested != 0 ||
+		stats.records + stats.overflows != expected)
+		{
+		printf ("intperf: capture produced %llu records and %llu overflows, not %llu\n", (unsigned long long) stats.records,
+			(unsigned long long) stats.overflows, (unsigned long long) expected);
+		ok = false;
+		}
+
+	//
+	// Statistics mode. The intercept counts each call, and writes no events
+	//
+
+	if (!Stats::start (1))
+		{
+		printf ("intperf: cannot start statistics mode\n");
+		return 1;
+		}
+
+	PERF_events = 0;
+	ns = time_calls (my_Noop);
+	Stats::stop ();
+	Stats::get (PERF_API_NOOP, api_stats);
+	printf ("  statistics:              %7.1f ns/call, %7.1f ns over direct\n", ns, ns - direct_ns);
+	printf ("  counted %llu calls, median <= %llu ns, 99%% <= %llu ns, max %llu ns\n", (unsigned long long) api_stats.calls,
+		(unsigned long long) Stats::percentile (api_stats, 50), (unsigned long long) Stats::percentile (api_stats, 99),
+		(unsigned long long) api_stats.max_ticks);
+
+	if (PERF_events != 0 || api_stats.calls != expected / 2)
+		{
+		printf ("intperf: statistics mode wrote %llu events and counted %llu calls, not %llu\n", (unsigned long long) PERF_events,
+			(unsigned long long) api_stats.calls, (unsigned long long) expected / 2);
+		ok = false;
+		}
+
+	//
+	// A policy that logs one call in 10 (the counter runs on across the runs)
+	//
+
+	rule.sample = 10;
+
+	if (!Policy::start (1, nullptr) || !Policy::set_rule (PERF_API_NOOP, rule))
+		{
+		printf ("intperf: cannot start the policies\n");
+		return 1;
+		}
+
+	PERF_events = 0;
+	ns = time_calls (my_Noop);
+	Policy::stop ();
+	printf ("  sink, 1 in 10 sampled:   %7.1f ns/call, %7.1f ns over direct\n", ns, ns - direct_ns);
+
+	if (PERF_events != (expected / 2 + 9) / 10 * 2)
+		{
+		printf ("intperf: the sampled sink wrote %llu events, not %llu\n", (unsigned long long) PERF_events,
+			(unsigned long long) (expected / 2 + 9) / 10 * 2);
+		ok = false;
+		}
+
+	close (PERF_null_fd);
+	printf ("intperf: %s\n", ok ? "no recursive events" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
@@ -0,0 +1,168 @@
+//
+// FACILITY:	perf - Routines shared by the TraceAPI performance programs
+//
+// DESCRIPTION:	The thread CPU clock the programs time their threads with, the pseudo-random generator they make their
+//				inputs with, and the parser for their -x:value options
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <time.h>
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTION								// One option of a program's command line
+	{
+	char			letter;								// The option is -letter or /letter
+	unsigned		*number;							// Set to the value of -letter:value, or
+	const char		**text;								// Pointed to the value of -letter:value, or
+	bool			*flag;								// Set by -letter
+	} PERF_OPTION, *PPERF_OPTION;
+
+
+
+inline
+uint64_t
+thread_nsec												// Read the calling thread's CPU time
+	(
+	)
+
+//
+// DESCRIPTION:		Return the CPU time used by the calling thread. The times are per thread so that they do not count the time
+//					other threads (including the drain thread) run when there are more threads than processors
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Nanoseconds
+//
+
+{
+struct timespec	now;
+
+
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}							// End thread_nsec
+
+
+inline
+uint64_t
+mix														// Next pseudo-random value
+	(
+	uint64_t&	State									// Generator state
+	)
+
+//
+// DESCRIPTION:		splitmix64
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Value
+//
+
+{
+uint64_t	value = (State += 0x9E3779B97F4A7C15ull);
+
+
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+	return value ^ (value >> 31);
+}							// End mix
+
+
+inline
+bool
+perf_parse_options										// Parse a program's command line
+	(
+	int					argc,							// Number of arguments
+	char				**argv,							// Arguments
+	const PERF_OPTION	*Options,						// The program's options
+	size_t				Count							// Number of options
+	)
+
+//
+// DESCRIPTION:		Set each option given as -letter:value or /letter:value, or as -letter for a flag. The values of numbers
+//					are decimal, or hexadecimal with 0x
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Every argument was an option of the program
+//		false							One was not; the caller prints its usage
+//
+
+{
+	for (int i = 1; i < argc; i++)
+		{
+		const char			*arg = argv [i];
+		const PERF_OPTION	*option = nullptr;
+
+		if ((arg [0] != '-' && arg [0] != '/') || arg [1] == '\0' || (arg [2] != ':' && arg [2] != '\0'))
+			{
+			return false;
+			}
+
+		for (size_t n = 0; n < Count && option == nullptr; n++)
+			{
+			if (Options [n].letter == arg [1])
+				{
+				option = &Options [n];
+				}
+			}
+
+		if (option == nullptr || (option->flag != nullptr) != (arg [2] == '\0'))
+			{
+			return false;
+			}
+
+		if (option->number != nullptr)
+			{
+			*option->number = (unsigned) strtoul (arg + 3, nullptr, 0);
+			}
+		else if (option->text != nullptr)
+			{
+			*option->text = arg + 3;
+			}
+		else
+			{
+			*option->flag = true;
+			}
+		}
+
+	return true;
+}							// End perf_parse_options
@@ -0,0 +1,560 @@
+//
+// FACILITY:	polperf - Test and measure the sampling and rate limiting policies
+//
+// DESCRIPTION:	This program runs the policy runtime (Policy.cpp) on Linux, calling Policy::admit the way a generated intercept
+//				does, with the arguments of a file API. It checks that:
+//
+//					- Rules are parsed, and bad rules are rejected
+//					- dedup=K logs the first K calls with the same arguments, comparing strings by their contents and other
+//					  pointers by their values
+//					- sample=N logs exactly one call in N, counting each thread separately
+//					- rate=R logs the burst, then R calls per second
+//					- Every skipped call is reported exactly once, by the next logged call or when the thread exits
+//
+//				It also prints the time admit takes for an API with no rule and with each kind of rule. The times are thread
+//				CPU time.
+//
+//				Usage: polperf [-n:calls] [-t:threads]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Capture.h"
+#include "../Policy.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_API_NONE			0						// API numbers used: no rule
+#define	PERF_API_DEDUP			1						// dedup
+#define	PERF_API_SAMPLE			2						// sample
+#define	PERF_API_RATE			3						// rate
+#define	PERF_API_COUNT			4
+
+#define	PERF_RATE				2000					// Rate limit tested (calls per second)
+#define	PERF_BURST				50						// And its burst
+#define	PERF_RATE_MSEC			200						// How long it is tested for
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		calls;								// Calls per measurement, and per thread
+	unsigned		threads;							// Threads in the sample test
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS				PERF_options = {1000000, 4};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.calls},
+	{'t', &PERF_options.threads}
+	};
+
+static std::atomic<uint64_t>	PERF_reported [PERF_API_COUNT][TA_POLICY_REASON_COUNT];	// Totals passed to the report routine
+
+static const wchar_t			PERF_path [] = L"C:\\Users\\Public\\Documents\\Project\\settings.ini";
+
+
+
+static
+void
+report_skipped											// Policy report routine
+	(
+	uint32_t		Api,								// API number
+	const uint64_t	Skipped [TA_POLICY_REASON_COUNT]	// Calls skipped, for each reason
+	)
+
+//
+// DESCRIPTION:		Add the counts to the totals
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	for (int reason = 0; reason < TA_POLICY_REASON_COUNT; reason++)
+		{
+		PERF_reported [Api][reason] += Skipped [reason];
+		}
+}							// End report_skipped
+
+
+__attribute__ ((noinline))
+static
+bool
+admit_file_call											// Apply a policy to a call shaped like CreateFileW
+	(
+	uint32_t		Api,								// API number
+	const wchar_t	*File_name,							// File name
+	uint32_t		Access								// Desired access
+	)
+
+//
+// DESCRIPTION:		Call admit with the arguments of CreateFileW, as the generated intercept does
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		The value returned by admit
+//
+
+{
+void		*security = nullptr;
+uint32_t	share = 1;
+uint32_t	disposition = 3;
+uint32_t	flags = 0x80;
+void		*template_file = nullptr;
+
+
+	return Policy::admit (Api, File_name, Access, share, security, disposition, flags, template_file);
+}							// End admit_file_call
+
+
+static
+double
+time_admit												// Time admit for an API
+	(
+	uint32_t		Api,								// API number
+	uint64_t&		Admitted							// Calls admitted
+	)
+
+//
+// DESCRIPTION:		Call admit_file_call PERF_options.calls times, with the same arguments
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Nanoseconds per call
+//
+
+{
+uint64_t	start = thread_nsec ();
+
+
+	Admitted = 0;
+
+	for (unsigned i = 0; i < PERF_options.calls; i++)
+		{
+		Admitted += admit_file_call (Api, PERF_path, 0x80000000);
+		}
+
+	return (double) (thread_nsec () - start) / PERF_options.calls;
+}							// End time_admit
+
+
+static
+bool
+check_parse												// Check the rule parser
+	(
+	)
+
+//
+// DESCRIPTION:		Parse good and bad rules
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Every rule parsed as expected
+//		false							One did not; it is printed
+//
+
+{
+static const struct
+	{
+	const wchar_t	*text;
+	bool			valid;
+	uint32_t		dedup, sample, rate, burst;
+	} rules [] =
+	{
+	{L"GetFileAttributesW dedup=3 rate=100",	true,	3, 0, 100, 0},
+	{L"  ReadFile\tSAMPLE=10  ",				true,	0, 10, 0, 0},
+	{L"* rate=1000 burst=20",					true,	0, 0, 1000, 20},
+	{L"ReadFile",								false},
+	{L"ReadFile burst=5",						false},
+	{L"ReadFile sample=0",						false},
+	{L"ReadFile sample=",						false},
+	{L"ReadFile sample",						false},
+	{L"ReadFile sample=1x",						false},
+	{L"ReadFile rate=4294967296",				false},
+	{L"ReadFile every=2",						false},
+	{L"",										false},
+	};
+std::wstring	name;
+TA_POLICY_RULE	rule;
+bool			ok = true;
+
+
+	for (const auto& test : rules)
+		{
+		bool	valid = Policy::parse_rule (test.text, name, rule);
+
+		if (valid != test.valid || (valid && (rule.dedup != test.dedup || rule.sample != test.sample || rule.rate != test.rate ||
+			rule.burst != test.burst)))
+			{
+			printf ("polperf: rule \"%ls\" parsed wrongly\n", test.text);
+			ok = false;
+			}
+		}
+
+	return ok;
+}							// End check_parse
+
+
+static
+bool
+check_dedup												// Check dedup=3
+	(
+	)
+
+//
+// DESCRIPTION:		Call with the same file name in two buffers, another name, then the first again. Also call with the same
+//					writable buffer holding different names, which dedup compares by address
+//
+// ASSUMPTIONS:		The API has the rule dedup=3
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The right calls were logged
+//		false							They were not; the reason is printed
+//
+
+{
+wchar_t		copy [sizeof (PERF_path) / sizeof (PERF_path [0])];
+wchar_t		other [] = L"C:\\Windows\\win.ini";
+unsigned	admitted = 0;
+
+
+	for (size_t i = 0; i < sizeof (copy) / sizeof (copy [0]); i++)
+		{
+		copy [i] = PERF_path [i];
+		}
+
+	for (int i = 0; i < 10; i++)
+		{
+		admitted += admit_file_call (PERF_API_DEDUP, i & 1 ? copy : PERF_path, 1);	// 3 of 10 logged
+		}
+
+	for (int i = 0; i < 2; i++)
+		{
+		admitted += admit_file_call (PERF_API_DEDUP, other, 1);						// Both logged
+		}
+
+	for (int i = 0; i < 5; i++)
+		{
+		admitted += admit_file_call (PERF_API_DEDUP, PERF_path, 1);					// 3 of 5 logged
+		}
+
+	admitted += admit_file_call (PERF_API_DEDUP, PERF_path, 2);						// Logged
+	admitted += admit_file_call (PERF_API_DEDUP, nullptr, 2);						// Logged
+
+	for (int i = 0; i < 5; i++)
+		{
+		wchar_t	*buffer = copy;
+
+		buffer [0] = (wchar_t) (L'A' + i);
+		admitted += Policy::admit (PERF_API_DEDUP, buffer);						// 3 of 5 logged
+		}
+
+	Policy::flush ();
+
+	if (admitted != 13 || PERF_reported [PERF_API_DEDUP][TA_POLICY_DEDUP] != 11)
+		{
+		printf ("polperf: dedup=3 logged %u calls and reported %llu skipped, not 13 and 11\n", admitted,
+			(unsigned long long) PERF_reported [PERF_API_DEDUP][TA_POLICY_DEDUP].load ());
+		return false;
+		}
+
+	return true;
+}							// End check_dedup
+
+
+static
+bool
+check_sample											// Check sample=7 on several threads
+	(
+	)
+
+//
+// DESCRIPTION:		Each thread makes PERF_options.calls calls, and must log exactly every 7th, starting with its first. The
+//					skipped calls are reported by the threads' later logged calls, and when they exit
+//
+// ASSUMPTIONS:		The API has the rule sample=7
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The right calls were logged
+//		false							They were not; the reason is printed
+//
+
+{
+std::vector<std::thread>	threads;
+std::atomic<uint64_t>		admitted (0);
+uint64_t					calls = (uint64_t) PERF_options.calls * PERF_options.threads;
+uint64_t					expected = (uint64_t) (PERF_options.calls + 6) / 7 * PERF_options.threads;
+
+
+	for (unsigned t = 0; t < PERF_options.threads; t++)
+		{
+		threads.emplace_back ([&] ()
+			{
+			uint64_t	count = 0;
+
+			for (unsigned i = 0; i < PERF_options.calls; i++)
+				{
+				count += admit_file_call (PERF_API_SAMPLE, PERF_path, i);
+				}
+
+			admitted += count;
+			});
+		}
+
+	for (auto& thread : threads)
+		{
+		thread.join ();
+		}
+
+	if (admitted != expected || PERF_reported [PERF_API_SAMPLE][TA_POLICY_SAMPLE] != calls - expected)
+		{
+		printf ("polperf: sample=7 logged %llu calls and reported %llu skipped, not %llu and %llu\n",
+			(unsigned long long) admitted.load (), (unsigned long long) PERF_reported [PERF_API_SAMPLE][TA_POLICY_SAMPLE].load (),
+			(unsigned long long) expected, (unsigned long long) (calls - expected));
+		return false;
+		}
+
+	return true;
+}							// End check_sample
+
+
+static
+bool
+check_rate												// Check rate=PERF_RATE burst=PERF_BURST
+	(
+	)
+
+//
+// DESCRIPTION:		Call as fast as possible for PERF_RATE_MSEC. The calls logged must be the burst plus the rate times the
+//					elapsed time, give or take a few percent for the time the last calls took
+//
+// ASSUMPTIONS:		The API has the rule rate=PERF_RATE burst=PERF_BURST
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The right number of calls was logged
+//		false							It was not; the reason is printed
+//
+
+{
+auto		start = std::chrono::steady_clock::now ();
+double		elapsed;
+double		expected;
+uint64_t	admitted = 0;
+uint64_t	calls = 0;
+
+
+	do
+		{
+		admitted += admit_file_call (PERF_API_RATE, PERF_path, 1);
+		calls++;
+		elapsed = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+		}
+	while (elapsed < PERF_RATE_MSEC / 1000.0);
+
+	expected = PERF_BURST + PERF_RATE * elapsed;
+	Policy::flush ();
+	printf ("  rate=%u burst=%u: %llu of %llu calls logged in %.0f ms (%.0f expected)\n", PERF_RATE, PERF_BURST,
+		(unsigned long long) admitted, (unsigned long long) calls, elapsed * 1000, expected);
+
+	if (admitted < expected * 0.95 || admitted > expected * 1.05 + 1 ||
+		PERF_reported [PERF_API_RATE][TA_POLICY_RATE] != calls - admitted)
+		{
+		printf ("polperf: rate limit logged %llu calls and reported %llu skipped, not %.0f and %llu\n", (unsigned long long) admitted,
+			(unsigned long long) PERF_reported [PERF_API_RATE][TA_POLICY_RATE].load (), expected,
+			(unsigned long long) (calls - admitted));
+		return false;
+		}
+
+	return true;
+}							// End check_rate
+
+
+int
+main													// Test and measure the policies
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, set a rule on each test API, time admit, then run the checks
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every check passed
+//		1								One did not, or the options were bad
+//
+
+{
+TA_POLICY_RULE	rule = {};
+uint64_t		admitted;
+double			ns;
+bool			ok = true;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: polperf [-n:calls] [-t:threads]\n");
+		return 1;
+		}
+
+	if (PERF_options.calls == 0 || PERF_options.threads == 0)
+		{
+		printf ("polperf: -n and -t must be at least 1\n");
+		return 1;
+		}
+
+	if (!Policy::start (PERF_API_COUNT, report_skipped))
+		{
+		printf ("polperf: cannot start the policies\n");
+		return 1;
+		}
+
+	rule.dedup = 3;
+	Policy::set_rule (PERF_API_DEDUP, rule);
+	rule = TA_POLICY_RULE ();
+	rule.sample = 7;
+	Policy::set_rule (PERF_API_SAMPLE, rule);
+	rule = TA_POLICY_RULE ();
+	rule.rate = PERF_RATE;
+	rule.burst = PERF_BURST;
+	Policy::set_rule (PERF_API_RATE, rule);
+
+	printf ("polperf: %u calls per measurement, %u threads\n", PERF_options.calls, PERF_options.threads);
+
+	//
+	// The time admit takes. Timing the rules also runs them, so the report totals are cleared afterwards
+	//
+
+	ns = time_admit (PERF_API_NONE, admitted);
+	printf ("  no rule:     %7.1f ns/call, %llu logged\n", ns, (unsigned long long) admitted);
+	ns = time_admit (PERF_API_DEDUP, admitted);
+	printf ("  dedup=3:     %7.1f ns/call, %llu logged (hashes a %u character path)\n", ns, (unsigned long long) admitted,
+		(unsigned) (sizeof (PERF_path) / sizeof (PERF_path [0]) - 1));
+	ns = time_admit (PERF_API_SAMPLE, admitted);
+	printf ("  sample=7:    %7.1f ns/call, %llu logged\n", ns, (unsigned long long) admitted);
+	ns = time_admit (PERF_API_RATE, admitted);
+	printf ("  rate=%u:   %7.1f ns/call, %llu logged (reads the clock)\n", PERF_RATE, ns, (unsigned long long) admitted);
+
+	Policy::set_rule (PERF_API_DEDUP, TA_POLICY_RULE ());
+	Policy::set_rule (PERF_API_SAMPLE, TA_POLICY_RULE ());
+	Policy::set_rule (PERF_API_RATE, TA_POLICY_RULE ());
+	Policy::flush ();
+
+	for (auto& counts : PERF_reported)
+		{
+		for (auto& count : counts)
+			{
+			count = 0;
+			}
+		}
+
+	//
+	// The checks. The rules are set again, so that the main thread's state starts afresh for each
+	//
+
+	rule = TA_POLICY_RULE ();
+	rule.dedup = 3;
+	Policy::set_rule (PERF_API_DEDUP, rule);
+	rule = TA_POLICY_RULE ();
+	rule.sample = 7;
+	Policy::set_rule (PERF_API_SAMPLE, rule);
+	rule = TA_POLICY_RULE ();
+	rule.rate = PERF_RATE;
+	rule.burst = PERF_BURST;
+
+	ok = check_parse () && ok;
+	ok = check_dedup () && ok;
+	ok = check_sample () && ok;
+
+	std::this_thread::sleep_for (std::chrono::milliseconds (PERF_BURST * 1000 / PERF_RATE + 10));	// Let the bucket fill
+	Policy::set_rule (PERF_API_RATE, rule);
+	ok = check_rate () && ok;
+
+	Policy::stop ();
+
+	if (admit_file_call (PERF_API_SAMPLE, PERF_path, 1) != true || admit_file_call (PERF_API_SAMPLE, PERF_path, 1) != true)
+		{
+		printf ("polperf: a call was skipped after stop\n");
+		ok = false;
+		}
+
+	printf ("polperf: %s\n", ok ? "policies verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
@@ -0,0 +1,400 @@
+//
+// FACILITY:	statperf - Test and measure the per-API call counters
+//
+// DESCRIPTION:	This program runs the statistics runtime (Stats.cpp) on Linux. Waves of threads make simulated calls to a number of
+//				APIs, each of which spins for a different time, counting them the way a generated intercept does in statistics
+//				mode. While they run, the main thread adds up the counters over and over, as a request for the provider's state
+//				would. The program checks that:
+//
+//					- The counts read while the threads run never go down, and every call is in the final counts exactly once,
+//					  including the calls of the threads that have exited
+//					- Each API's histogram adds up to its calls, and the APIs that take longer have longer median times
+//					- The threads of later waves reuse the counter blocks of the threads that exited
+//
+//				It also prints the time per call that counting adds. The times are thread CPU time.
+//
+//				Usage: statperf [-t:threads] [-n:calls] [-a:apis] [-w:waves] [-v]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Stats.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_WORK_NSEC			500						// Time API n takes: n times this
+#define	PERF_TIMING_CALLS		1000000					// Calls timed for the overhead
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		threads;							// Threads in each wave
+	unsigned		calls;								// Simulated calls per thread
+	unsigned		apis;								// Simulated APIs
+	unsigned		waves;								// Waves of threads
+	bool			verbose;							// Print each API's counters
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS	PERF_options = {8, 20000, 4, 4, false};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'t', &PERF_options.threads},
+	{'n', &PERF_options.calls},
+	{'a', &PERF_options.apis},
+	{'w', &PERF_options.waves},
+	{'v', nullptr, nullptr, &PERF_options.verbose}
+	};
+
+static uint64_t		PERF_spin_count = 0;				// Iterations of simulated_api's loop that take PERF_WORK_NSEC
+
+
+
+__attribute__ ((noinline))
+static
+void
+simulated_api											// Stand in for the real API
+	(
+	unsigned		Api									// API number
+	)
+
+//
+// DESCRIPTION:		Spin for Api times PERF_WORK_NSEC, using the loop count calibrated by main
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	for (volatile uint64_t i = 0; i < Api * PERF_spin_count; i++)
+		{
+		}
+}							// End simulated_api
+
+
+static
+inline
+void
+counted_call											// Make one simulated call, counted as in statistics mode
+	(
+	unsigned		Api									// API number
+	)
+
+//
+// DESCRIPTION:		The statistics branch of a generated intercept
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint64_t	begin;
+
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		simulated_api (Api);
+		Stats::call_end (Api, begin);
+		}
+	else
+		{
+		simulated_api (Api);
+		}
+}							// End counted_call
+
+
+static
+bool
+read_while_running										// Add up the counters while the threads count calls
+	(
+	std::atomic<unsigned>&	Running,					// Threads still running
+	std::vector<uint64_t>&	Last_calls					// Calls of each API at the last read (updated)
+	)
+
+//
+// DESCRIPTION:		Call Stats::get for every API until the threads are done, and check that no API's count goes down
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The counts never went down
+//		false							One did; the reason is printed
+//
+
+{
+TA_API_STATS	stats;
+bool			done;
+
+
+	do
+		{
+		done = Running.load () == 0;
+
+		for (unsigned api = 0; api < PERF_options.apis; api++)
+			{
+			Stats::get (api, stats);
+
+			if (stats.calls < Last_calls [api])
+				{
+				printf ("statperf: API %u went from %llu calls to %llu\n", api, (unsigned long long) Last_calls [api],
+					(unsigned long long) stats.calls);
+				return false;
+				}
+
+			Last_calls [api] = stats.calls;
+			}
+
+		std::this_thread::yield ();
+		}
+	while (!done);
+
+	return true;
+}							// End read_while_running
+
+
+int
+main													// Test and measure the per-API call counters
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, time the counting, then run the waves of threads and check the counters
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								The counters were correct
+//		1								They were not, or the options were bad
+//
+
+{
+std::vector<uint64_t>	last_calls;
+std::vector<uint64_t>	expected;
+TA_API_STATS			stats;
+uint64_t				previous_median = 0;
+uint64_t				start;
+double					direct_ns;
+double					counted_ns;
+bool					ok = true;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: statperf [-t:threads] [-n:calls] [-a:apis] [-w:waves] [-v]\n");
+		return 1;
+		}
+
+	if (PERF_options.threads == 0 || PERF_options.calls == 0 || PERF_options.apis == 0 || PERF_options.waves == 0)
+		{
+		printf ("statperf: -t, -n, -a and -w must be at least 1\n");
+		return 1;
+		}
+
+	printf ("statperf: %u waves of %u threads x %u calls, %u APIs taking 0 to %u ns\n", PERF_options.waves,
+		PERF_options.threads, PERF_options.calls, PERF_options.apis, (PERF_options.apis - 1) * PERF_WORK_NSEC);
+
+	//
+	// Calibrate the simulated APIs
+	//
+
+	PERF_spin_count = 10000000;
+	start = ~0ULL;
+
+	for (int i = 0; i < 5; i++)
+		{
+		uint64_t	begin = thread_nsec ();
+
+		simulated_api (1);
+		start = std::min (start, thread_nsec () - begin);
+		}
+
+	PERF_spin_count = std::max<uint64_t> (1, (uint64_t) ((double) PERF_spin_count * PERF_WORK_NSEC / (double) start));
+
+	//
+	// The time counting adds to a call of API 0, which does nothing
+	//
+
+	if (!Stats::start (PERF_options.apis))
+		{
+		printf ("statperf: cannot start counting\n");
+		return 1;
+		}
+
+	Stats::stop ();
+	start = thread_nsec ();
+
+	for (unsigned i = 0; i < PERF_TIMING_CALLS; i++)
+		{
+		counted_call (0);
+		}
+
+	direct_ns = (double) (thread_nsec () - start) / PERF_TIMING_CALLS;
+	Stats::start (PERF_options.apis);
+	start = thread_nsec ();
+
+	for (unsigned i = 0; i < PERF_TIMING_CALLS; i++)
+		{
+		counted_call (0);
+		}
+
+	counted_ns = (double) (thread_nsec () - start) / PERF_TIMING_CALLS;
+	printf ("  direct:      %7.1f ns/call\n", direct_ns);
+	printf ("  counted:     %7.1f ns/call, %7.1f ns over direct\n", counted_ns, counted_ns - direct_ns);
+
+	//
+	// The waves. The main thread's calls above are in the counts too
+	//
+
+	expected.assign (PERF_options.apis, 0);
+	expected [0] = PERF_TIMING_CALLS;
+	last_calls.assign (PERF_options.apis, 0);
+
+	for (unsigned wave = 0; ok && wave < PERF_options.waves; wave++)
+		{
+		std::vector<std::thread>	threads;
+		std::atomic<unsigned>		running (PERF_options.threads);
+
+		for (unsigned t = 0; t < PERF_options.threads; t++)
+			{
+			threads.emplace_back ([&, t] ()
+				{
+				for (unsigned i = 0; i < PERF_options.calls; i++)
+					{
+					counted_call ((t + i) % PERF_options.apis);
+					}
+
+				running--;
+				});
+			}
+
+		for (unsigned t = 0; t < PERF_options.threads; t++)
+			{
+			for (unsigned i = 0; i < PERF_options.calls; i++)
+				{
+				expected [(t + i) % PERF_options.apis]++;
+				}
+			}
+
+		ok = read_while_running (running, last_calls);
+
+		for (auto& thread : threads)
+			{
+			thread.join ();
+			}
+		}
+
+	Stats::stop ();
+
+	//
+	// Check the final counts
+	//
+
+	for (unsigned api = 0; ok && api < PERF_options.apis; api++)
+		{
+		uint64_t	histogram = 0;
+		uint64_t	median;
+
+		Stats::get (api, stats);
+		median = Stats::percentile (stats, 50);
+
+		for (uint64_t bucket : stats.buckets)
+			{
+			histogram += bucket;
+			}
+
+		if (PERF_options.verbose || api == PERF_options.apis - 1)
+			{
+			printf ("  API %u:       %llu calls, mean %.0f ns, median <= %llu ns, 99%% <= %llu ns, max %llu ns\n", api,
+				(unsigned long long) stats.calls, (double) stats.ticks / (double) stats.calls, (unsigned long long) median,
+				(unsigned long long) Stats::percentile (stats, 99), (unsigned long long) stats.max_ticks);
+			}
+
+		if (stats.calls != expected [api] || histogram != stats.calls)
+			{
+			printf ("statperf: API %u has %llu calls and %llu in its histogram, not %llu\n", api, (unsigned long long) stats.calls,
+				(unsigned long long) histogram, (unsigned long long) expected [api]);
+			ok = false;
+			}
+		else if (median < previous_median)
+			{
+			printf ("statperf: API %u has a shorter median time than API %u\n", api, api - 1);
+			ok = false;
+			}
+
+		previous_median = median;
+		}
+
+	if (ok && Stats::blocks () != PERF_options.threads + 1)
+		{
+		printf ("statperf: %u counter blocks for %u threads at a time\n", Stats::blocks (), PERF_options.threads + 1);
+		ok = false;
+		}
+
+	printf ("  %u counter blocks for %u threads\n", Stats::blocks (), PERF_options.threads * PERF_options.waves + 1);
+	printf ("statperf: %s\n", ok ? "counters verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
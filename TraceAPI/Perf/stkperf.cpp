@@ -0,0 +1,931 @@
+//
+// FACILITY:	stkperf - Test and measure the stack table
+//
+// DESCRIPTION:	This program runs the stack table (StackTable.cpp) on Linux. It checks that:
+//
+//					- A stack gets the same ID each time it is interned, and different stacks (including stacks that differ
+//					  only in their outermost frame, and a stack and its prefix) get different IDs
+//					- The same holds when several threads intern the same stacks at once, and flush returns each stack exactly
+//					  once, with its frames
+//					- When the table is full, intern returns 0 instead of waiting or failing
+//					- In a capture to a file, each call site gets one stack ID, and TraceReader finds a TA_REC_STACK record that
+//					  defines each ID. The sites are in one routine, which is called from one place, so the stacks must differ
+//					  in their first frame and, when more than one frame is captured, have the same second frame
+//
+//				It also prints the time intern takes for a stack that is already in the table, on one thread and on several,
+//				and the time an intercept takes to capture its stack at depth 1 (the return address only) and at the depth
+//				given by -d. The times are thread CPU time.
+//
+//				Usage: stkperf [-t:threads] [-n:calls] [-e:table entries] [-s:stacks] [-d:depth] [-o:file]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Capture.h"
+#include "../StackTable.h"
+#include "../TraceReader.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_SITES				3						// Call sites in the capture check
+#define	PERF_SITE_CALLS			20000					// Calls from each site, on each thread
+#define	PERF_FULL_ENTRIES		64						// Size of the table in the full check
+#define	PERF_HOT_STACKS			16						// Stacks interned by the threads in the timing
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		threads;							// Threads in the checks and timing
+	unsigned		calls;								// Calls per measurement, and per thread
+	unsigned		entries;							// Size of the table
+	unsigned		stacks;								// Unique stacks interned
+	unsigned		depth;								// Depth timed and captured
+	const char		*file_name;							// Trace file written by the capture check
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+typedef struct _PERF_STACK								// A stack in the pool
+	{
+	uint32_t		depth;								// Frames used
+	uint64_t		frames [TA_STACK_MAX_FRAMES];		// Return addresses
+	} PERF_STACK, *PPERF_STACK;
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS				PERF_options = {4, 1000000, 4096, 1000, 8, "stkperf.cap"};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'t', &PERF_options.threads},
+	{'n', &PERF_options.calls},
+	{'e', &PERF_options.entries},
+	{'s', &PERF_options.stacks},
+	{'d', &PERF_options.depth},
+	{'o', nullptr, &PERF_options.file_name}
+	};
+
+static std::vector<PERF_STACK>	PERF_pool;				// The unique stacks
+static std::atomic<uint64_t>	PERF_site_calls (0);	// Keeps the call sites from being tail calls
+
+static const TA_PARAM_SCHEMA	PERF_params [] =		// Parameters of the simulated API, as perf_intercept captures them
+	{
+	{"Site", TA_PT_SCALAR},
+	{nullptr, TA_PT_END},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_API_SCHEMA	PERF_schema [] =			// Schema of the simulated API
+	{
+	{"CreateFileW", PERF_params}
+	};
+
+
+
+static
+void
+build_pool												// Build the unique stacks
+	(
+	unsigned	Count									// Number of stacks
+	)
+
+//
+// DESCRIPTION:		Every third stack is random, with 2 to 16 frames. The next is the same with its outermost frame changed, and
+//					the one after that is the random one without its outermost frame, so that the table must compare every
+//					frame, and the depth
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint64_t	state = 12345;
+
+
+	PERF_pool.assign (Count, PERF_STACK ());
+
+	for (unsigned k = 0; k < Count; k++)
+		{
+		PERF_STACK&	stack = PERF_pool [k];
+
+		switch (k % 3)
+			{
+			case 0:
+				{
+				stack.depth = 2 + (uint32_t) (mix (state) % (TA_STACK_MAX_FRAMES - 1));
+
+				for (uint32_t i = 0; i < stack.depth; i++)
+					{
+					stack.frames [i] = 0x7FF000000000ull + (mix (state) & 0xFFFFFFF0ull);
+					}
+				}
+				break;
+
+			case 1:
+				{
+				stack = PERF_pool [k - 1];
+				stack.frames [stack.depth - 1] += 0x10;
+				}
+				break;
+
+			default:
+				{
+				stack = PERF_pool [k - 2];
+				stack.depth--;
+				}
+				break;
+			}
+		}
+}							// End build_pool
+
+
+static
+bool
+start_table												// Start the stack table
+	(
+	uint32_t	Depth,									// Frames captured
+	uint32_t	Entries									// Size of the table
+	)
+
+//
+// DESCRIPTION:		Start the table, and report if it could not be
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The table could not be started; the reason is printed
+//
+
+{
+TA_STACK_CONFIG	config = {Depth, Entries};
+
+
+	if (!StackTable::start (config))
+		{
+		printf ("stkperf: cannot start a table of %u stacks\n", Entries);
+		return false;
+		}
+
+	return true;
+}							// End start_table
+
+
+static
+bool
+check_flush												// Check that flush returns each stack once
+	(
+	const std::vector<uint32_t>&	Ids					// ID of each stack in the pool (0 if it has none)
+	)
+
+//
+// DESCRIPTION:		Flush the table, and check that each ID in Ids is returned exactly once, with its stack's frames, and
+//					nothing else is
+//
+// ASSUMPTIONS:		Nothing is being interned
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Every stack was flushed correctly
+//		false							One was not; the reason is printed
+//
+
+{
+std::map<uint32_t, size_t>	stack_of;
+std::vector<TA_RECORD>		records (64);
+std::set<uint32_t>			flushed;
+uint32_t					count;
+
+
+	for (size_t k = 0; k < Ids.size (); k++)
+		{
+		if (Ids [k] != 0)
+			{
+			stack_of [Ids [k]] = k;
+			}
+		}
+
+	while ((count = StackTable::flush (records.data (), (uint32_t) records.size ())) != 0)
+		{
+		for (uint32_t i = 0; i < count; i++)
+			{
+			const TA_RECORD&	rec = records [i];
+			auto				found = stack_of.find (rec.stack_id);
+
+			if (rec.kind != TA_REC_STACK || found == stack_of.end () || !flushed.insert (rec.stack_id).second)
+				{
+				printf ("stkperf: flush returned stack %u, which is unknown or was already flushed\n", rec.stack_id);
+				return false;
+				}
+
+			const PERF_STACK&	stack = PERF_pool [found->second];
+
+			if (rec.arg_count != stack.depth || memcmp (rec.args, stack.frames, stack.depth * sizeof (stack.frames [0])) != 0)
+				{
+				printf ("stkperf: flush returned the wrong frames for stack %u\n", rec.stack_id);
+				return false;
+				}
+			}
+		}
+
+	if (flushed.size () != stack_of.size ())
+		{
+		printf ("stkperf: flush returned %zu stacks, not %zu\n", flushed.size (), stack_of.size ());
+		return false;
+		}
+
+	return true;
+}							// End check_flush
+
+
+static
+bool
+check_intern											// Check interning on one thread
+	(
+	)
+
+//
+// DESCRIPTION:		Intern the pool twice. Every stack must get an ID the first time, the same ID the second time, and no two
+//					stacks the same ID
+//
+// ASSUMPTIONS:		The pool has at most half as many stacks as the table
+//
+// SIDE EFFECTS:	Restarts the table
+//
+// RETURN VALUES:
+//
+//		true							Every stack got the right ID
+//		false							One did not; the reason is printed
+//
+
+{
+std::vector<uint32_t>	ids (PERF_pool.size ());
+std::set<uint32_t>		unique;
+uint32_t				id;
+
+
+	if (!start_table (PERF_options.depth, PERF_options.entries))
+		{
+		return false;
+		}
+
+	for (int round = 0; round < 2; round++)
+		{
+		for (size_t k = 0; k < PERF_pool.size (); k++)
+			{
+			id = StackTable::intern (PERF_pool [k].frames, PERF_pool [k].depth);
+
+			if (id == 0 || (round == 1 && id != ids [k]))
+				{
+				printf ("stkperf: stack %zu got ID %u, not %u\n", k, id, ids [k]);
+				return false;
+				}
+
+			ids [k] = id;
+			}
+		}
+
+	unique.insert (ids.begin (), ids.end ());
+
+	if (unique.size () != ids.size ())
+		{
+		printf ("stkperf: %zu stacks got only %zu different IDs\n", ids.size (), unique.size ());
+		return false;
+		}
+
+	return check_flush (ids);
+}							// End check_intern
+
+
+static
+bool
+check_threads											// Check interning on several threads at once
+	(
+	)
+
+//
+// DESCRIPTION:		Each thread interns the pool several times, starting at a different stack. All threads must get the same ID
+//					for each stack. A call may get 0 only if its stack's slot was being filled by another thread (it is counted
+//					as busy)
+//
+// ASSUMPTIONS:		The pool has at most half as many stacks as the table
+//
+// SIDE EFFECTS:	Restarts the table
+//
+// RETURN VALUES:
+//
+//		true							Every thread got the same IDs
+//		false							They did not; the reason is printed
+//
+
+{
+std::vector<std::vector<uint32_t>>	ids (PERF_options.threads, std::vector<uint32_t> (PERF_pool.size ()));
+std::vector<std::thread>			threads;
+std::atomic<uint64_t>				zeros (0);
+std::atomic<bool>					go (false);
+std::set<uint32_t>					unique;
+TA_STACK_STATS						stats;
+unsigned							rounds = PERF_options.calls / (unsigned) PERF_pool.size () / PERF_options.threads + 2;
+
+
+	if (!start_table (PERF_options.depth, PERF_options.entries))
+		{
+		return false;
+		}
+
+	for (unsigned t = 0; t < PERF_options.threads; t++)
+		{
+		threads.emplace_back ([&, t] ()
+			{
+			std::vector<uint32_t>&	mine = ids [t];
+			size_t					count = PERF_pool.size ();
+			size_t					k = t * count / PERF_options.threads;
+			uint32_t				id;
+
+			while (!go.load ())
+				{
+				}
+
+			for (size_t i = 0; i < rounds * count; i++, k = (k + 1) % count)
+				{
+				id = StackTable::intern (PERF_pool [k].frames, PERF_pool [k].depth);
+
+				if (id == 0)
+					{
+					zeros++;
+					}
+				else if (mine [k] == 0)
+					{
+					mine [k] = id;
+					}
+				else if (mine [k] != id)
+					{
+					mine [k] = UINT32_MAX;
+					}
+				}
+			});
+		}
+
+	go = true;
+
+	for (auto& thread : threads)
+		{
+		thread.join ();
+		}
+
+	StackTable::get_stats (stats);
+
+	for (size_t k = 0; k < PERF_pool.size (); k++)
+		{
+		for (unsigned t = 1; t < PERF_options.threads; t++)
+			{
+			if (ids [t][k] != ids [0][k] || ids [0][k] == 0 || ids [0][k] == UINT32_MAX)
+				{
+				printf ("stkperf: threads 0 and %u got IDs %u and %u for stack %zu\n", t, ids [0][k], ids [t][k], k);
+				return false;
+				}
+			}
+
+		unique.insert (ids [0][k]);
+		}
+
+	if (unique.size () != PERF_pool.size () || stats.stacks != PERF_pool.size () || zeros != stats.busy || stats.full != 0)
+		{
+		printf ("stkperf: %zu stacks got %zu different IDs, the table holds %u, and %llu calls got no ID (%llu busy, %llu full)\n",
+			PERF_pool.size (), unique.size (), stats.stacks, (unsigned long long) zeros.load (), (unsigned long long) stats.busy,
+			(unsigned long long) stats.full);
+		return false;
+		}
+
+	printf ("  %u threads interned %zu stacks %u times: %llu calls found a slot busy\n", PERF_options.threads, PERF_pool.size (),
+		rounds, (unsigned long long) stats.busy);
+	return check_flush (ids [0]);
+}							// End check_threads
+
+
+static
+bool
+check_full												// Check a table that is too small
+	(
+	)
+
+//
+// DESCRIPTION:		Intern the pool into a table of PERF_FULL_ENTRIES. The stacks that fit must get different IDs, the others 0,
+//					and each that did not fit must be counted
+//
+// ASSUMPTIONS:		The pool has more stacks than PERF_FULL_ENTRIES
+//
+// SIDE EFFECTS:	Restarts the table
+//
+// RETURN VALUES:
+//
+//		true							The table filled up as expected
+//		false							It did not; the reason is printed
+//
+
+{
+std::vector<uint32_t>	ids (PERF_pool.size ());
+std::set<uint32_t>		unique;
+TA_STACK_STATS			stats;
+uint64_t				zeros = 0;
+
+
+	if (!start_table (PERF_options.depth, PERF_FULL_ENTRIES))
+		{
+		return false;
+		}
+
+	for (size_t k = 0; k < PERF_pool.size (); k++)
+		{
+		if ((ids [k] = StackTable::intern (PERF_pool [k].frames, PERF_pool [k].depth)) == 0)
+			{
+			zeros++;
+			}
+		else
+			{
+			unique.insert (ids [k]);
+			}
+		}
+
+	StackTable::get_stats (stats);
+
+	if (unique.size () != PERF_pool.size () - zeros || unique.size () > PERF_FULL_ENTRIES || stats.full != zeros ||
+		stats.stacks != unique.size ())
+		{
+		printf ("stkperf: a table of %u held %zu of %zu stacks, and counted %llu of %llu that did not fit\n", PERF_FULL_ENTRIES,
+			unique.size (), PERF_pool.size (), (unsigned long long) stats.full, (unsigned long long) zeros);
+		return false;
+		}
+
+	return check_flush (ids);
+}							// End check_full
+
+
+__attribute__ ((noinline))
+static
+void
+perf_intercept											// Capture a call, as a generated intercept does
+	(
+	uint64_t	Site									// Call site
+	)
+
+//
+// DESCRIPTION:		Write a pre-call record with the caller's stack
+//
+// ASSUMPTIONS:		Capture is running
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_RECORD	*rec;
+
+
+	if ((rec = Capture::begin_record (TA_REC_PRE, 0)) != nullptr)
+		{
+		Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+		Capture::add_arg (rec, Site);
+		Capture::commit_record (rec);
+		}
+}							// End perf_intercept
+
+
+__attribute__ ((noinline))
+static
+void
+perf_site												// Call the intercept from one of PERF_SITES places
+	(
+	unsigned	Site									// Which place
+	)
+
+//
+// DESCRIPTION:		Each case is a different call site, so its calls have a different return address
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	switch (Site)
+		{
+		case 0:		perf_intercept (0);		break;
+		case 1:		perf_intercept (1);		break;
+		default:	perf_intercept (2);		break;
+		}
+
+	PERF_site_calls.fetch_add (1, std::memory_order_relaxed);
+}							// End perf_site
+
+
+static
+bool
+check_trace												// Check the stacks in a trace file
+	(
+	)
+
+//
+// DESCRIPTION:		Capture calls from PERF_SITES call sites on several threads into a file, then read it back. The calls from
+//					each site must have one stack ID, different from the other sites', and the file must define each ID
+//					exactly once, with at most the configured depth. The first frames of the stacks are the sites' return
+//					addresses, which differ; when the depth is more than 1, the second is where perf_site was called from,
+//					which is the same
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Restarts the table, and writes PERF_options.file_name
+//
+// RETURN VALUES:
+//
+//		true							The trace's stacks are correct
+//		false							They are not; the reason is printed
+//
+
+{
+TA_CAPTURE_CONFIG			config = {};
+TA_CAPTURE_STATS			stats;
+TA_STACK_STATS				stack_stats;
+std::vector<std::thread>	threads;
+TraceReader					reader;
+TA_TRACE_EVENT				event;
+std::set<uint32_t>			site_ids [PERF_SITES];
+std::set<uint32_t>			defined;
+std::set<uint32_t>			used;
+uint64_t					calls = 0;
+uint64_t					zeros = 0;
+
+
+	if (!start_table (PERF_options.depth, PERF_options.entries))
+		{
+		return false;
+		}
+
+	if (!Capture::open_file_sink (PERF_options.file_name, PERF_schema, 1, config.sink))
+		{
+		printf ("stkperf: cannot create %s\n", PERF_options.file_name);
+		return false;
+		}
+
+	config.ring_records = 65536;
+	config.drain_period_ms = 1;
+
+	if (!Capture::start (config))
+		{
+		printf ("stkperf: cannot start capturing\n");
+		return false;
+		}
+
+	for (unsigned t = 0; t < PERF_options.threads; t++)
+		{
+		threads.emplace_back ([] ()
+			{
+			for (unsigned i = 0; i < PERF_SITES * PERF_SITE_CALLS; i++)
+				{
+				perf_site (i % PERF_SITES);
+				}
+			});
+		}
+
+	for (auto& thread : threads)
+		{
+		thread.join ();
+		}
+
+	Capture::stop (true);
+	StackTable::stop ();
+	Capture::get_stats (stats);
+	StackTable::get_stats (stack_stats);
+
+	if (!reader.open (PERF_options.file_name))
+		{
+		printf ("stkperf: cannot read %s\n", PERF_options.file_name);
+		return false;
+		}
+
+	while (reader.next (event))
+		{
+		if (event.kind == TA_REC_STACK)
+			{
+			if (!defined.insert (event.stack_id).second || event.arg_count == 0 || event.arg_count > PERF_options.depth ||
+				(PERF_options.depth > 1 && event.arg_count == 1))
+				{
+				printf ("stkperf: stack %u is defined twice, or has %u frames\n", event.stack_id, event.arg_count);
+				return false;
+				}
+			}
+		else if (event.kind == TA_REC_PRE && event.arg_count == 1 && event.args [0] < PERF_SITES)
+			{
+			calls++;
+
+			if (event.stack_id == 0)
+				{
+				zeros++;
+				}
+			else
+				{
+				site_ids [event.args [0]].insert (event.stack_id);
+				used.insert (event.stack_id);
+				}
+			}
+		else
+			{
+			printf ("stkperf: unexpected record of kind %u\n", event.kind);
+			return false;
+			}
+		}
+
+	if (reader.failed () || calls + stats.overflows != (uint64_t) PERF_options.threads * PERF_SITES * PERF_SITE_CALLS)
+		{
+		printf ("stkperf: read %llu calls, with %llu overflows, from a damaged or incomplete trace\n", (unsigned long long) calls,
+			(unsigned long long) stats.overflows);
+		return false;
+		}
+
+	for (unsigned site = 0; site < PERF_SITES; site++)
+		{
+		if (site_ids [site].size () != 1)
+			{
+			printf ("stkperf: the calls from site %u have %zu stack IDs, not 1\n", site, site_ids [site].size ());
+			return false;
+			}
+		}
+
+	if (used.size () != PERF_SITES || defined != used || zeros != stack_stats.busy)
+		{
+		printf ("stkperf: %zu stack IDs were used, %zu were defined, and %llu calls got none (%llu busy)\n", used.size (),
+			defined.size (), (unsigned long long) zeros, (unsigned long long) stack_stats.busy);
+		return false;
+		}
+
+	for (uint32_t id : used)
+		{
+		const std::vector<uint64_t>	*frames = reader.stack (id);
+		const std::vector<uint64_t>	*first = reader.stack (*used.begin ());
+
+		if (frames == nullptr)
+			{
+			printf ("stkperf: the reader did not keep stack %u\n", id);
+			return false;
+			}
+
+		if ((id != *used.begin () && (*frames) [0] == (*first) [0]) ||
+			(PERF_options.depth > 1 && (frames->size () < 2 || (*frames) [1] != (*first) [1])))
+			{
+			printf ("stkperf: stack %u does not start with its site's return address and perf_site's caller\n", id);
+			return false;
+			}
+		}
+
+	printf ("  trace: %llu calls from %u sites, %zu stacks of up to %u frames (%llu overflows, %llu busy)\n",
+		(unsigned long long) calls, PERF_SITES, used.size (), PERF_options.depth, (unsigned long long) stats.overflows,
+		(unsigned long long) stack_stats.busy);
+	return true;
+}							// End check_trace
+
+
+__attribute__ ((noinline))
+static
+uint32_t
+perf_capture											// Capture the caller's stack, as an intercept does
+	(
+	)
+
+//
+// DESCRIPTION:		Call StackTable::capture with this routine's return address
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Stack ID
+//
+
+{
+	return StackTable::capture (TA_RETURN_ADDRESS ());
+}							// End perf_capture
+
+
+static
+double
+time_capture											// Time capturing the stack at a depth
+	(
+	uint32_t	Depth									// Frames captured
+	)
+
+//
+// DESCRIPTION:		Start the table at the depth, then capture the same stack PERF_options.calls times
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Restarts the table
+//
+// RETURN VALUES:
+//
+//		Nanoseconds per call, or -1 if the stack got no ID
+//
+
+{
+uint64_t	start;
+uint32_t	id = 0;
+bool		ok = true;
+
+
+	if (!start_table (Depth, PERF_options.entries))
+		{
+		return -1;
+		}
+
+	start = thread_nsec ();
+
+	for (unsigned i = 0; i < PERF_options.calls; i++)
+		{
+		ok &= (id = perf_capture ()) != 0;
+		}
+
+	return ok ? (double) (thread_nsec () - start) / PERF_options.calls : -1;
+}							// End time_capture
+
+
+static
+double
+time_intern												// Time interning stacks that are in the table
+	(
+	unsigned	Threads,								// Threads interning at once
+	unsigned	Stacks									// Stacks each interns, in turn
+	)
+
+//
+// DESCRIPTION:		Intern the first Stacks of the pool once, then have each thread intern them PERF_options.calls times
+//
+// ASSUMPTIONS:		Stacks is at most the size of the pool
+//
+// SIDE EFFECTS:	Restarts the table
+//
+// RETURN VALUES:
+//
+//		Average nanoseconds per call
+//
+
+{
+std::vector<std::thread>	threads;
+std::atomic<uint64_t>		nsec (0);
+
+
+	if (!start_table (PERF_options.depth, PERF_options.entries))
+		{
+		return -1;
+		}
+
+	for (unsigned k = 0; k < Stacks; k++)
+		{
+		StackTable::intern (PERF_pool [k].frames, PERF_pool [k].depth);
+		}
+
+	for (unsigned t = 0; t < Threads; t++)
+		{
+		threads.emplace_back ([&] ()
+			{
+			uint64_t	start = thread_nsec ();
+			uint32_t	sum = 0;
+			unsigned	k = 0;
+
+			for (unsigned i = 0; i < PERF_options.calls; i++)
+				{
+				sum += StackTable::intern (PERF_pool [k].frames, PERF_pool [k].depth);
+				k = k + 1 < Stacks ? k + 1 : 0;
+				}
+
+			nsec += thread_nsec () - start + (sum == 0);
+			});
+		}
+
+	for (auto& thread : threads)
+		{
+		thread.join ();
+		}
+
+	return (double) nsec / ((double) PERF_options.calls * Threads);
+}							// End time_intern
+
+
+int
+main													// Test and measure the stack table
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, run the checks, then time intern and capture
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								Every check passed
+//		1								One did not, or the options were bad
+//
+
+{
+bool	ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: stkperf [-t:threads] [-n:calls] [-e:table entries] [-s:stacks] [-d:depth] [-o:file]\n");
+		return 1;
+		}
+
+	if (PERF_options.threads == 0 || PERF_options.calls == 0 || PERF_options.depth == 0 ||
+		PERF_options.depth > TA_STACK_MAX_FRAMES || PERF_options.entries < TA_STACK_MIN_ENTRIES ||
+		PERF_options.entries > TA_STACK_MAX_ENTRIES || PERF_options.stacks <= PERF_FULL_ENTRIES ||
+		PERF_options.stacks > PERF_options.entries / 2)
+		{
+		printf ("stkperf: -t, -n and -d must be at least 1, -d at most %u, -e from %u to %u, and -s more than %u and at most "
+			"half of -e\n", TA_STACK_MAX_FRAMES, TA_STACK_MIN_ENTRIES, TA_STACK_MAX_ENTRIES, PERF_FULL_ENTRIES);
+		return 1;
+		}
+
+	printf ("stkperf: %u threads, %u calls, %u stacks in a table of %u, depth %u\n", PERF_options.threads, PERF_options.calls,
+		PERF_options.stacks, PERF_options.entries, PERF_options.depth);
+
+	build_pool (PERF_options.stacks);
+	ok = check_intern () && check_threads () && check_full () && check_trace ();
+
+	if (ok)
+		{
+		printf ("  intern, 1 stack:      %6.1f ns/call\n", time_intern (1, 1));
+		printf ("  intern, %4u stacks:  %6.1f ns/call\n", PERF_options.stacks, time_intern (1, PERF_options.stacks));
+		printf ("  intern, %u threads:   %6.1f ns/call\n", PERF_options.threads, time_intern (PERF_options.threads, PERF_HOT_STACKS));
+		printf ("  capture, depth  1:    %6.1f ns/call\n", time_capture (1));
+		printf ("  capture, depth %2u:    %6.1f ns/call\n", PERF_options.depth, time_capture (PERF_options.depth));
+		}
+
+	StackTable::stop ();
+	printf ("stkperf: %s\n", ok ? "stack table verified" : "FAILED");
+	return ok ? 0 : 1;
+}							// End main
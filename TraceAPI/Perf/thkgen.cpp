@@ -0,0 +1,364 @@
+//
+// FACILITY:	thkgen - The simulated APIs of thkperf, expanded or compact
+//
+// DESCRIPTION:	Compiled with PERF_EXPANDED, this module defines an intercept for each simulated API, shaped like the ones
+//				Detours.stg expands (TraceLoggingWrite is replaced by perf_trace_fields). Compiled with PERF_COMPACT, it defines
+//				what AutoGen generates with /COMPACT: the table of real APIs, the TA_THUNK_INFO records, and a Thunk::entry for
+//				each API. Both write the same events: every argument as a raw value, the first string as text, and the return
+//				value and last error status after the call. The GNUmakefile compares the sizes of the two objects. Like the
+//				generated intercepts, only the expanded ones store a stack ID; thkperf does not start the stack table, so it is 0
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			The expanded intercepts store the caller's stack ID, as Detours.stg now does
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// Project includes
+//
+
+#include "../StackTable.h"
+#include "../Thunk.h"
+#include "thkperf.h"
+
+using namespace FDI;
+
+//
+// MACROS:
+//
+
+//
+// Apply M to every API number, as two hexadecimal digits
+//
+
+#define	PERF_ROW(M, a)			M (a, 0) M (a, 1) M (a, 2) M (a, 3) M (a, 4) M (a, 5) M (a, 6) M (a, 7) \
+								M (a, 8) M (a, 9) M (a, A) M (a, B) M (a, C) M (a, D) M (a, E) M (a, F)
+#define	PERF_ALL(M)				PERF_ROW (M, 0) PERF_ROW (M, 1) PERF_ROW (M, 2) PERF_ROW (M, 3) \
+								PERF_ROW (M, 4) PERF_ROW (M, 5) PERF_ROW (M, 6) PERF_ROW (M, 7) \
+								PERF_ROW (M, 8) PERF_ROW (M, 9) PERF_ROW (M, A) PERF_ROW (M, B) \
+								PERF_ROW (M, C) PERF_ROW (M, D) PERF_ROW (M, E) PERF_ROW (M, F)
+
+//
+// Shape of an API, from the last digit of its number
+//
+
+#define	PERF_SHAPE_OF_0			0
+#define	PERF_SHAPE_OF_1			1
+#define	PERF_SHAPE_OF_2			2
+#define	PERF_SHAPE_OF_3			3
+#define	PERF_SHAPE_OF_4			0
+#define	PERF_SHAPE_OF_5			1
+#define	PERF_SHAPE_OF_6			2
+#define	PERF_SHAPE_OF_7			3
+#define	PERF_SHAPE_OF_8			0
+#define	PERF_SHAPE_OF_9			1
+#define	PERF_SHAPE_OF_A			2
+#define	PERF_SHAPE_OF_B			3
+#define	PERF_SHAPE_OF_C			0
+#define	PERF_SHAPE_OF_D			1
+#define	PERF_SHAPE_OF_E			2
+#define	PERF_SHAPE_OF_F			3
+
+#define	PERF_PASTE(x, y)		x##y
+#define	PERF_CAT(x, y)			PERF_PASTE (x, y)				// Expands x and y first
+#define	PERF_SHAPE(b)			PERF_PASTE (PERF_SHAPE_OF_, b)
+#define	PERF_DISPATCH(M, a, b)	PERF_CAT (M, PERF_SHAPE (b)) (a, b)
+
+#ifdef PERF_EXPANDED
+
+//
+// The expanded intercepts, one body per shape, with the same steps as the detour template in Detours.stg
+//
+
+#define	PERF_PRE_BEGIN(n)																		\
+	if (Capture::enabled ())																	\
+		{																						\
+		if ((rec = Capture::begin_record (TA_REC_PRE, n)) != nullptr)							\
+			{																					\
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+
+#define	PERF_PRE_END(n)																			\
+			Capture::commit_record (rec);														\
+			}																					\
+		}																						\
+	else																						\
+		{
+
+#define	PERF_POST(n)																			\
+	status = TA_THUNK_LAST_ERROR ();															\
+																								\
+	if (Capture::enabled ())																	\
+		{																						\
+		if ((rec = Capture::begin_record (TA_REC_POST, n)) != nullptr)							\
+			{																					\
+			Capture::add_arg (rec, ret_value);													\
+			Capture::add_arg (rec, status);														\
+			Capture::commit_record (rec);														\
+			}																					\
+		}																						\
+	else																						\
+		{																						\
+		perf_trace_fields (TA_REC_POST, n, 2, (uint64_t) ret_value, (uint64_t) status);			\
+		}																						\
+																								\
+	Intercept::leave ();																		\
+	return ret_value;
+
+#define	PERF_EXPANDED_0(a, b)																	\
+PERF_SHAPE_0		real_api_##a##b = perf_real_0;												\
+																								\
+static BOOL my_api_##a##b (HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead,	\
+	LPVOID lpOverlapped)																		\
+{																								\
+uint32_t	status;																				\
+BOOL		ret_value;																			\
+TA_RECORD	*rec;																				\
+uint64_t	begin;																				\
+																								\
+	if (!Intercept::enter (0x##a##b))															\
+		{																						\
+		return real_api_##a##b (hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);	\
+		}																						\
+																								\
+	if (Stats::enabled ())																		\
+		{																						\
+		begin = Stats::call_begin ();															\
+		ret_value = real_api_##a##b (hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);	\
+		Stats::call_end (0x##a##b, begin);														\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	if (!Policy::admit (0x##a##b, hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped))	\
+		{																						\
+		ret_value = real_api_##a##b (hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);	\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	PERF_PRE_BEGIN (0x##a##b)																	\
+			Capture::add_arg (rec, hFile);														\
+			Capture::add_arg (rec, lpBuffer);													\
+			Capture::add_arg (rec, nNumberOfBytesToRead);										\
+			Capture::add_arg (rec, lpNumberOfBytesRead);										\
+			Capture::add_arg (rec, lpOverlapped);												\
+	PERF_PRE_END (0x##a##b)																		\
+		perf_trace_fields (TA_REC_PRE, 0x##a##b, 5, (uint64_t) hFile, (uint64_t) lpBuffer,		\
+			(uint64_t) nNumberOfBytesToRead, (uint64_t) lpNumberOfBytesRead, (uint64_t) lpOverlapped);	\
+		}																						\
+																								\
+	ret_value = real_api_##a##b (hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);	\
+	PERF_POST (0x##a##b)																		\
+}
+
+#define	PERF_EXPANDED_1(a, b)																	\
+PERF_SHAPE_1		real_api_##a##b = perf_real_1;												\
+																								\
+static HANDLE my_api_##a##b (LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPVOID lpSecurityAttributes,	\
+	DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)				\
+{																								\
+uint32_t	status;																				\
+HANDLE		ret_value;																			\
+TA_RECORD	*rec;																				\
+uint64_t	begin;																				\
+																								\
+	if (!Intercept::enter (0x##a##b))															\
+		{																						\
+		return real_api_##a##b (lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes,	\
+			dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);						\
+		}																						\
+																								\
+	if (Stats::enabled ())																		\
+		{																						\
+		begin = Stats::call_begin ();															\
+		ret_value = real_api_##a##b (lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes,	\
+			dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);						\
+		Stats::call_end (0x##a##b, begin);														\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	if (!Policy::admit (0x##a##b, lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes,	\
+		dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile))							\
+		{																						\
+		ret_value = real_api_##a##b (lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes,	\
+			dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);						\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	PERF_PRE_BEGIN (0x##a##b)																	\
+			Capture::add_arg (rec, lpFileName);													\
+			Capture::set_text (rec, lpFileName);												\
+			Capture::add_arg (rec, dwDesiredAccess);											\
+			Capture::add_arg (rec, dwShareMode);												\
+			Capture::add_arg (rec, lpSecurityAttributes);										\
+			Capture::add_arg (rec, dwCreationDisposition);										\
+			Capture::add_arg (rec, dwFlagsAndAttributes);										\
+			Capture::add_arg (rec, hTemplateFile);												\
+	PERF_PRE_END (0x##a##b)																		\
+		perf_trace_fields (TA_REC_PRE, 0x##a##b, 7, (uint64_t) lpFileName, (uint64_t) dwDesiredAccess,	\
+			(uint64_t) dwShareMode, (uint64_t) lpSecurityAttributes, (uint64_t) dwCreationDisposition,	\
+			(uint64_t) dwFlagsAndAttributes, (uint64_t) hTemplateFile);							\
+		}																						\
+																								\
+	ret_value = real_api_##a##b (lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes,	\
+		dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);							\
+	PERF_POST (0x##a##b)																		\
+}
+
+#define	PERF_EXPANDED_2(a, b)																	\
+PERF_SHAPE_2		real_api_##a##b = perf_real_2;												\
+																								\
+static BOOL my_api_##a##b (HANDLE hFile)														\
+{																								\
+uint32_t	status;																				\
+BOOL		ret_value;																			\
+TA_RECORD	*rec;																				\
+uint64_t	begin;																				\
+																								\
+	if (!Intercept::enter (0x##a##b))															\
+		{																						\
+		return real_api_##a##b (hFile);															\
+		}																						\
+																								\
+	if (Stats::enabled ())																		\
+		{																						\
+		begin = Stats::call_begin ();															\
+		ret_value = real_api_##a##b (hFile);													\
+		Stats::call_end (0x##a##b, begin);														\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	if (!Policy::admit (0x##a##b, hFile))														\
+		{																						\
+		ret_value = real_api_##a##b (hFile);													\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	PERF_PRE_BEGIN (0x##a##b)																	\
+			Capture::add_arg (rec, hFile);														\
+	PERF_PRE_END (0x##a##b)																		\
+		perf_trace_fields (TA_REC_PRE, 0x##a##b, 1, (uint64_t) hFile);							\
+		}																						\
+																								\
+	ret_value = real_api_##a##b (hFile);														\
+	PERF_POST (0x##a##b)																		\
+}
+
+#define	PERF_EXPANDED_3(a, b)																	\
+PERF_SHAPE_3		real_api_##a##b = perf_real_3;												\
+																								\
+static DWORD my_api_##a##b (LPCWSTR lpFileName, DWORD nBufferLength, LPWSTR lpBuffer, LPWSTR *lpFilePart)	\
+{																								\
+uint32_t	status;																				\
+DWORD		ret_value;																			\
+TA_RECORD	*rec;																				\
+uint64_t	begin;																				\
+																								\
+	if (!Intercept::enter (0x##a##b))															\
+		{																						\
+		return real_api_##a##b (lpFileName, nBufferLength, lpBuffer, lpFilePart);				\
+		}																						\
+																								\
+	if (Stats::enabled ())																		\
+		{																						\
+		begin = Stats::call_begin ();															\
+		ret_value = real_api_##a##b (lpFileName, nBufferLength, lpBuffer, lpFilePart);			\
+		Stats::call_end (0x##a##b, begin);														\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	if (!Policy::admit (0x##a##b, lpFileName, nBufferLength, lpBuffer, lpFilePart))			\
+		{																						\
+		ret_value = real_api_##a##b (lpFileName, nBufferLength, lpBuffer, lpFilePart);			\
+		Intercept::leave ();																	\
+		return ret_value;																		\
+		}																						\
+																								\
+	PERF_PRE_BEGIN (0x##a##b)																	\
+			Capture::add_arg (rec, lpFileName);													\
+			Capture::set_text (rec, lpFileName);												\
+			Capture::add_arg (rec, nBufferLength);												\
+			Capture::add_arg (rec, lpBuffer);													\
+			Capture::add_arg (rec, lpFilePart);													\
+	PERF_PRE_END (0x##a##b)																		\
+		perf_trace_fields (TA_REC_PRE, 0x##a##b, 4, (uint64_t) lpFileName, (uint64_t) nBufferLength,	\
+			(uint64_t) lpBuffer, (uint64_t) lpFilePart);										\
+		}																						\
+																								\
+	ret_value = real_api_##a##b (lpFileName, nBufferLength, lpBuffer, lpFilePart);				\
+	PERF_POST (0x##a##b)																		\
+}
+
+#define	PERF_DEFINE(a, b)		PERF_DISPATCH (PERF_EXPANDED_, a, b)
+#define	PERF_ENTRY(a, b)		(void *) my_api_##a##b,
+
+namespace expanded
+{
+
+PERF_ALL (PERF_DEFINE)
+
+void * const	PERF_intercepts [PERF_APIS] =
+	{
+	PERF_ALL (PERF_ENTRY)
+	};
+
+}	// End namespace expanded
+
+#endif
+
+#ifdef PERF_COMPACT
+
+//
+// What AutoGen generates with /COMPACT: the real APIs, a record for each API, and a Thunk::entry for each API
+//
+
+#define	PERF_REAL(a, b)			(void *) PERF_CAT (perf_real_, PERF_SHAPE (b)),
+
+#define	PERF_INFO_0(a, b)		{0x##a##b, 5, TA_PT_SCALAR, {TA_PT_POINTER, TA_PT_POINTER, TA_PT_SCALAR, TA_PT_POINTER, TA_PT_POINTER}},
+#define	PERF_INFO_1(a, b)		{0x##a##b, 7, TA_PT_POINTER, {TA_PT_WSTRZ, TA_PT_SCALAR, TA_PT_SCALAR, TA_PT_POINTER, TA_PT_SCALAR, TA_PT_SCALAR, TA_PT_POINTER}},
+#define	PERF_INFO_2(a, b)		{0x##a##b, 1, TA_PT_SCALAR, {TA_PT_POINTER}},
+#define	PERF_INFO_3(a, b)		{0x##a##b, 4, TA_PT_SCALAR, {TA_PT_WSTRZ, TA_PT_SCALAR, TA_PT_POINTER, TA_PT_POINTER}},
+#define	PERF_INFO(a, b)			PERF_DISPATCH (PERF_INFO_, a, b)
+
+#define	PERF_THUNK(a, b)		(void *) Thunk::entry_of<0x##a##b> (PERF_CAT (perf_real_, PERF_SHAPE (b))),
+
+void	*TA_thunk_real [PERF_APIS] =
+	{
+	PERF_ALL (PERF_REAL)
+	};
+
+const TA_THUNK_INFO		TA_thunk_info [PERF_APIS] =
+	{
+	PERF_ALL (PERF_INFO)
+	};
+
+namespace compact
+{
+
+void * const	PERF_intercepts [PERF_APIS] =
+	{
+	PERF_ALL (PERF_THUNK)
+	};
+
+}	// End namespace compact
+
+#endif
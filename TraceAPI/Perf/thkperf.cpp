@@ -0,0 +1,650 @@
+//
+// FACILITY:	thkperf - Compare expanded intercepts with table-driven thunks
+//
+// DESCRIPTION:	This program calls the PERF_APIS simulated APIs of thkgen.cpp through their expanded intercepts, and through
+//				the thunks that AutoGen generates with /COMPACT, using the real Intercept, Stats, Policy and Capture runtimes.
+//				It checks that, for every API, both write the same events to the stand-in for TraceLoggingWrite and the same
+//				records to the capture rings. Then it times both:
+//
+//					- With events disabled, when the intercept goes straight to the real API
+//					- Writing events to the stand-in for TraceLoggingWrite, which only counts them
+//					- In capture mode, with a sink that discards the records
+//
+//				each calling one API over and over, and calling every API in turn, which spreads the calls over the code of
+//				all the intercepts, as a process calling many APIs does. The times are thread CPU time, the best of several
+//				runs. The GNUmakefile prints the sizes of the two builds of thkgen.cpp.
+//
+//				Usage: thkperf [-n:calls]
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Use the thread clock, generator and option parser in perf.h
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "../Thunk.h"
+#include "thkperf.h"
+#include "perf.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_RUNS				5						// Runs of each measurement; the fastest is reported
+#define	PERF_MAX_VALUES			8						// Values of an event
+
+//
+// TYPES:
+//
+
+typedef struct _PERF_OPTIONS
+	{
+	unsigned		calls;								// Calls per run
+	} PERF_OPTIONS, *PPERF_OPTIONS;
+
+//
+// An event written to one of the stand-ins for TraceLoggingWrite
+//
+
+typedef struct _PERF_EVENT
+	{
+	uint8_t			kind;								// TA_REC_PRE or TA_REC_POST
+	uint32_t		api;								// API number
+	uint32_t		count;								// Values used
+	uint64_t		values [PERF_MAX_VALUES];			// Arguments, or return value and last error status
+	} PERF_EVENT, *PPERF_EVENT;
+
+//
+// Mode of a measurement
+//
+
+enum PERF_MODES
+	{
+	PERF_DISABLED = 0,									// Events disabled
+	PERF_TRACED,										// Events written to the stand-in
+	PERF_CAPTURED,										// Capture mode
+	PERF_MODE_COUNT
+	};
+
+//
+// DECLARATIONS:
+//
+
+static PERF_OPTIONS				PERF_options = {1000000};
+
+static const PERF_OPTION		PERF_option_table [] =		// Command line options
+	{
+	{'n', &PERF_options.calls}
+	};
+
+static const wchar_t			PERF_file_name [] = L"C:\\Users\\Public\\Documents\\thkperf.txt";
+static bool						PERF_recording = false;			// The stand-ins and the capture sink keep what they get
+static std::vector<PERF_EVENT>	PERF_events;					// Events kept by the stand-ins
+static uint64_t					PERF_event_count = 0;			// Events written to the stand-ins
+static std::mutex				PERF_records_lock;				// Protects PERF_records
+static std::vector<TA_RECORD>	PERF_records;					// Records kept by the capture sink
+static const char				*PERF_mode_names [PERF_MODE_COUNT] = {"disabled", "traced", "captured"};
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+void
+record_event											// Keep or count an event written to a stand-in
+	(
+	const PERF_EVENT&	Event							// Event
+	);
+
+
+
+__attribute__ ((noinline))
+BOOL
+perf_real_0												// The real API of shape 0 (ReadFile)
+	(
+	HANDLE			hFile,
+	LPVOID			lpBuffer,
+	DWORD			nNumberOfBytesToRead,
+	LPDWORD			lpNumberOfBytesRead,
+	LPVOID			lpOverlapped
+	)
+{
+	if (lpNumberOfBytesRead != nullptr)
+		{
+		*lpNumberOfBytesRead = nNumberOfBytesToRead;
+		}
+
+	errno = hFile == nullptr ? EBADF : 0;
+	return hFile != nullptr;
+}							// End perf_real_0
+
+
+__attribute__ ((noinline))
+HANDLE
+perf_real_1												// The real API of shape 1 (CreateFileW)
+	(
+	LPCWSTR			lpFileName,
+	DWORD			dwDesiredAccess,
+	DWORD			dwShareMode,
+	LPVOID			lpSecurityAttributes,
+	DWORD			dwCreationDisposition,
+	DWORD			dwFlagsAndAttributes,
+	HANDLE			hTemplateFile
+	)
+{
+	errno = ENOENT;
+	return (HANDLE) (uintptr_t) (dwDesiredAccess + dwCreationDisposition);
+}							// End perf_real_1
+
+
+__attribute__ ((noinline))
+BOOL
+perf_real_2												// The real API of shape 2 (SetEndOfFile)
+	(
+	HANDLE			hFile
+	)
+{
+	errno = EINVAL;
+	return hFile == nullptr;
+}							// End perf_real_2
+
+
+__attribute__ ((noinline))
+DWORD
+perf_real_3												// The real API of shape 3 (GetFullPathNameW)
+	(
+	LPCWSTR			lpFileName,
+	DWORD			nBufferLength,
+	LPWSTR			lpBuffer,
+	LPWSTR			*lpFilePart
+	)
+{
+	errno = 0;
+	return (DWORD) wcslen (lpFileName);
+}							// End perf_real_3
+
+
+void
+perf_trace_fields										// Stand-in for TraceLoggingWrite, for the expanded intercepts
+	(
+	uint8_t			Kind,								// TA_REC_PRE or TA_REC_POST
+	uint32_t		Api,								// API number
+	uint32_t		Count,								// Number of fields
+	...													// Fields, as uint64_t
+	)
+
+//
+// DESCRIPTION:		Collect the fields into an event
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+PERF_EVENT	event = {Kind, Api, Count, {0}};
+va_list		fields;
+
+
+	va_start (fields, Count);
+
+	for (uint32_t i = 0; i < Count && i < PERF_MAX_VALUES; i++)
+		{
+		event.values [i] = va_arg (fields, uint64_t);
+		}
+
+	va_end (fields);
+	record_event (event);
+}							// End perf_trace_fields
+
+
+void
+TA_thunk_trace											// Stand-in for the generated TA_thunk_trace
+	(
+	uint8_t				Kind,							// TA_REC_PRE or TA_REC_POST
+	uint32_t			Api,							// API number
+	const uint64_t		*Values,						// Arguments, or the return value and last error status
+	uint32_t			Count							// Number of values
+	)
+
+//
+// DESCRIPTION:		Copy the values into an event
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+PERF_EVENT	event = {Kind, Api, Count, {0}};
+
+
+	memcpy (event.values, Values, std::min<uint32_t> (Count, PERF_MAX_VALUES) * sizeof (uint64_t));
+	record_event (event);
+}							// End TA_thunk_trace
+
+
+static
+void
+record_event											// Keep or count an event written to a stand-in
+	(
+	const PERF_EVENT&	Event							// Event
+	)
+
+//
+// DESCRIPTION:		Keep the event while the checks run; otherwise, only count it
+//
+// ASSUMPTIONS:		Called only by the main thread
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	if (PERF_recording)
+		{
+		PERF_events.push_back (Event);
+		}
+
+	PERF_event_count++;
+}							// End record_event
+
+
+static
+bool
+capture_sink_write										// Capture sink that keeps or discards the records
+	(
+	void				*Context,						// Not used
+	const TA_RECORD		*Records,						// Records to write
+	size_t				Count							// Number of records
+	)
+
+//
+// DESCRIPTION:		Keep the records while the checks run
+//
+// ASSUMPTIONS:		Called from the drain thread
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Always
+//
+
+{
+	if (PERF_recording)
+		{
+		std::lock_guard<std::mutex>	lock (PERF_records_lock);
+
+		PERF_records.insert (PERF_records.end (), Records, Records + Count);
+		}
+
+	return true;
+}							// End capture_sink_write
+
+
+static
+inline
+uint64_t
+call_api												// Call an API through an intercept
+	(
+	void * const	*Intercepts,						// expanded::PERF_intercepts or compact::PERF_intercepts
+	uint32_t		Api,								// API number
+	uint32_t		Call								// Call number, which the arguments are made from
+	)
+
+//
+// DESCRIPTION:		Call the intercept with arguments of the API's shape
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Value returned by the API
+//
+
+{
+static wchar_t	*file_part;
+DWORD			read;
+
+
+	switch (Api % PERF_SHAPES)
+		{
+		case 0:
+			{
+			return (uint64_t) ((PERF_SHAPE_0) Intercepts [Api]) ((HANDLE) (uintptr_t) (0x1000 + Call), (LPVOID) PERF_file_name, Call,
+				&read, nullptr);
+			}
+
+		case 1:
+			{
+			return (uint64_t) ((PERF_SHAPE_1) Intercepts [Api]) (PERF_file_name, 0x80000000, Call, nullptr, 3, 0x80, nullptr);
+			}
+
+		case 2:
+			{
+			return (uint64_t) ((PERF_SHAPE_2) Intercepts [Api]) ((HANDLE) (uintptr_t) Call);
+			}
+
+		default:
+			{
+			return (uint64_t) ((PERF_SHAPE_3) Intercepts [Api]) (PERF_file_name + Call % 8, 260, nullptr, &file_part);
+			}
+		}
+}							// End call_api
+
+
+static
+bool
+check_events											// Check that both intercepts of every API write the same events
+	(
+	)
+
+//
+// DESCRIPTION:		Call each API through its expanded intercept and its thunk, writing events to the stand-ins for
+//					TraceLoggingWrite, and compare the events. The return values must also match
+//
+// ASSUMPTIONS:		Events are enabled, and capture has been stopped
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							The events match
+//		false							They do not; the first difference is printed
+//
+
+{
+PERF_EVENT	*expanded_event;
+PERF_EVENT	*compact_event;
+bool		ok = true;
+
+
+	PERF_recording = true;
+
+	//
+	// Each call writes a pre-call and a post-call event
+	//
+
+	for (uint32_t api = 0; api < PERF_APIS; api++)
+		{
+		if (call_api (expanded::PERF_intercepts, api, api + 7) != call_api (compact::PERF_intercepts, api, api + 7))
+			{
+			printf ("thkperf: API %u returned different values\n", api);
+			ok = false;
+			}
+		}
+
+	if (PERF_events.size () != 4 * PERF_APIS)
+		{
+		printf ("thkperf: %zu events were written, %u expected\n", PERF_events.size (), 4 * PERF_APIS);
+		return false;
+		}
+
+	for (size_t i = 0; ok && i < PERF_events.size (); i += 4)
+		{
+		for (size_t j = 0; j < 2; j++)
+			{
+			expanded_event = &PERF_events [i + j];
+			compact_event = &PERF_events [i + 2 + j];
+
+			if (expanded_event->kind != compact_event->kind || expanded_event->api != compact_event->api ||
+				expanded_event->count != compact_event->count ||
+				memcmp (expanded_event->values, compact_event->values, sizeof (expanded_event->values)) != 0)
+				{
+				printf ("thkperf: API %u: the %s events differ\n", expanded_event->api, j == 0 ? "pre-call" : "post-call");
+				ok = false;
+				}
+			}
+		}
+
+	PERF_recording = false;
+	return ok;
+}							// End check_events
+
+
+static
+bool
+check_records											// Check that both intercepts of every API capture the same records
+	(
+	)
+
+//
+// DESCRIPTION:		Call each API through its expanded intercept and its thunk in capture mode, stop capture so that every record
+//					is drained, and compare the records (all but the timestamp)
+//
+// ASSUMPTIONS:		Events are enabled, and capture has been started
+//
+// SIDE EFFECTS:	Stops capture
+//
+// RETURN VALUES:
+//
+//		true							The records match
+//		false							They do not; the first difference is printed
+//
+
+{
+TA_RECORD	*expanded_rec;
+TA_RECORD	*compact_rec;
+bool		ok = true;
+
+
+	PERF_recording = true;
+
+	for (uint32_t api = 0; api < PERF_APIS; api++)
+		{
+		call_api (expanded::PERF_intercepts, api, api + 11);
+		call_api (compact::PERF_intercepts, api, api + 11);
+		}
+
+	Capture::stop (true);
+	PERF_recording = false;
+
+	if (PERF_records.size () != 4 * PERF_APIS)
+		{
+		printf ("thkperf: %zu records were captured, %u expected\n", PERF_records.size (), 4 * PERF_APIS);
+		return false;
+		}
+
+	for (size_t i = 0; ok && i < PERF_records.size (); i += 4)
+		{
+		for (size_t j = 0; j < 2; j++)
+			{
+			expanded_rec = &PERF_records [i + j];
+			compact_rec = &PERF_records [i + 2 + j];
+			compact_rec->timestamp = expanded_rec->timestamp;
+
+			if (memcmp (expanded_rec, compact_rec, sizeof (TA_RECORD)) != 0)
+				{
+				printf ("thkperf: API %u: the %s records differ\n", expanded_rec->api, j == 0 ? "pre-call" : "post-call");
+				ok = false;
+				}
+			}
+		}
+
+	return ok;
+}							// End check_records
+
+
+static
+double
+time_calls												// Time calls through one set of intercepts
+	(
+	void * const	*Intercepts,						// expanded::PERF_intercepts or compact::PERF_intercepts
+	bool			All									// Call every API in turn (otherwise, only API 0)
+	)
+
+//
+// DESCRIPTION:		Make PERF_options.calls calls, PERF_RUNS times, and return the fastest
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Nanoseconds per call
+//
+
+{
+uint64_t	best = UINT64_MAX;
+uint64_t	begin;
+uint64_t	sum = 0;
+
+
+	for (unsigned run = 0; run < PERF_RUNS; run++)
+		{
+		begin = thread_nsec ();
+
+		for (uint32_t call = 0; call < PERF_options.calls; call++)
+			{
+			sum += call_api (Intercepts, All ? call % PERF_APIS : 0, call);
+			}
+
+		best = std::min (best, thread_nsec () - begin);
+		}
+
+	__asm__ volatile ("" : : "r" (sum));
+	return (double) best / PERF_options.calls;
+}							// End time_calls
+
+
+int
+main													// Compare expanded intercepts with table-driven thunks
+	(
+	int		argc,										// Number of arguments
+	char	**argv										// Arguments
+	)
+
+//
+// DESCRIPTION:		Parse the options, check the events and records, then time both kinds of intercept in each mode
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		0								The events and records match
+//		1								They do not, or the options were bad
+//
+
+{
+TA_CAPTURE_CONFIG	config = {};
+double				expanded_ns;
+double				compact_ns;
+bool				ok;
+
+
+	if (!perf_parse_options (argc, argv, PERF_option_table, sizeof (PERF_option_table) / sizeof (PERF_option_table [0])))
+		{
+		printf ("Usage: thkperf [-n:calls]\n");
+		return 1;
+		}
+
+	if (PERF_options.calls == 0)
+		{
+		printf ("thkperf: -n must be at least 1\n");
+		return 1;
+		}
+
+	printf ("thkperf: %u APIs in %u shapes, %u calls per measurement\n", PERF_APIS, PERF_SHAPES, PERF_options.calls);
+
+	config.ring_records = 65536;
+	config.drain_period_ms = 10;
+	config.sink.write = capture_sink_write;
+
+	Intercept::set_api_enabled (TA_ALL_APIS, true);
+	Intercept::set_events_enabled (true);
+
+	if (!Capture::start (config))
+		{
+		printf ("thkperf: cannot start capture\n");
+		return 1;
+		}
+
+	ok = check_records () && check_events ();
+
+	if (!ok)
+		{
+		printf ("thkperf: FAILED\n");
+		return 1;
+		}
+
+	//
+	// Time each mode
+	//
+
+	printf ("  %-10s %-10s %12s %12s\n", "mode", "APIs", "expanded", "compact");
+
+	for (int mode = PERF_DISABLED; mode < PERF_MODE_COUNT; mode++)
+		{
+		Intercept::set_events_enabled (mode != PERF_DISABLED);
+
+		if (mode == PERF_CAPTURED && !Capture::start (config))
+			{
+			printf ("thkperf: cannot start capture\n");
+			return 1;
+			}
+
+		for (int all = 0; all < 2; all++)
+			{
+			expanded_ns = time_calls (expanded::PERF_intercepts, all != 0);
+			compact_ns = time_calls (compact::PERF_intercepts, all != 0);
+			printf ("  %-10s %-10s %9.1f ns %9.1f ns\n", PERF_mode_names [mode], all != 0 ? "all" : "one", expanded_ns,
+				compact_ns);
+			}
+		}
+
+	Capture::stop (true);
+	printf ("thkperf: thunks verified\n");
+	return 0;
+}							// End main
@@ -0,0 +1,94 @@
+//
+// FACILITY:	thkperf - Compare expanded intercepts with table-driven thunks
+//
+// DESCRIPTION:	Declarations shared by thkperf.cpp and thkgen.cpp. thkgen.cpp defines PERF_APIS simulated APIs, in four shapes
+//				taken from TraceAPI's APIs. It is compiled twice: with PERF_EXPANDED, each API has an intercept like the ones
+//				Detours.stg expands; with PERF_COMPACT, each API has a TA_THUNK_INFO record and a Thunk::entry, as AutoGen generates
+//				with /COMPACT. Each build puts its intercepts in a table in its own namespace
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstdint>
+
+//
+// CONSTANTS:
+//
+
+#define	PERF_APIS				256						// Simulated APIs (API numbers 0x00 to 0xFF)
+#define	PERF_SHAPES				4						// Shapes; API n has shape n % PERF_SHAPES
+
+//
+// TYPES:
+//
+
+//
+// Stand-ins for the Windows types of the shapes
+//
+
+typedef int				BOOL;
+typedef uint32_t		DWORD;
+typedef void			*HANDLE;
+typedef void			*LPVOID;
+typedef DWORD			*LPDWORD;
+typedef const wchar_t	*LPCWSTR;
+typedef wchar_t			*LPWSTR;
+
+//
+// The shapes: ReadFile, CreateFileW, SetEndOfFile and GetFullPathNameW
+//
+
+typedef BOOL	(*PERF_SHAPE_0) (HANDLE, LPVOID, DWORD, LPDWORD, LPVOID);
+typedef HANDLE	(*PERF_SHAPE_1) (LPCWSTR, DWORD, DWORD, LPVOID, DWORD, DWORD, HANDLE);
+typedef BOOL	(*PERF_SHAPE_2) (HANDLE);
+typedef DWORD	(*PERF_SHAPE_3) (LPCWSTR, DWORD, LPWSTR, LPWSTR *);
+
+//
+// DECLARATIONS:
+//
+
+//
+// The real APIs, one for each shape (defined in thkperf.cpp)
+//
+
+BOOL perf_real_0 (HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPVOID lpOverlapped);
+HANDLE perf_real_1 (LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPVOID lpSecurityAttributes,
+	DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+BOOL perf_real_2 (HANDLE hFile);
+DWORD perf_real_3 (LPCWSTR lpFileName, DWORD nBufferLength, LPWSTR lpBuffer, LPWSTR *lpFilePart);
+
+//
+// Stand-in for TraceLoggingWrite in the expanded intercepts: each field is passed separately, as TraceLoggingWrite
+// builds a descriptor for each field where it is called (defined in thkperf.cpp)
+//
+
+void perf_trace_fields (uint8_t Kind, uint32_t Api, uint32_t Count, ...);
+
+namespace expanded
+{
+extern void * const		PERF_intercepts [PERF_APIS];	// Intercept of each API
+}
+
+namespace compact
+{
+extern void * const		PERF_intercepts [PERF_APIS];	// Intercept of each API
+}
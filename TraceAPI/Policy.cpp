@@ -0,0 +1,645 @@
+//
+// FACILITY:	Policy - Sampling and rate limiting of the intercepted calls
+//
+// DESCRIPTION:	This module contains the implementation of the Policy class. The rules are in a table indexed by API number,
+//				which is allocated by start and only changed by set_rule. Each thread that calls an intercept with a rule gets
+//				its own table of rule state (one TA_POLICY_STATE per API) the first time it does, and frees it when it exits.
+//
+//				The rate limit is a token bucket, kept as the time at which the bucket will next be full (the generic cell rate
+//				algorithm), so it takes one value per API per thread and no timer: a call is logged if the bucket is full or
+//				no more than burst - 1 calls' worth of time ahead of now, and each logged call moves that time one interval on.
+//
+//				This module uses only standard C++, so that it can be built and tested on Linux. It does not use WPP;
+//				DLLMain.cpp logs the rules and reports the skipped calls
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cwctype>
+#include <mutex>
+#include <new>
+
+//
+// Project includes
+//
+
+#include "Policy.h"
+#include "Capture.h"
+
+using namespace FDI;
+
+//
+// TYPES:
+//
+
+//
+// A rule, as the intercepts apply it. The fields are atomic because set_rule may change them while intercepts read them
+//
+
+typedef struct _TA_POLICY_ENTRY
+	{
+	std::atomic<uint32_t>	dedup;						// Consecutive calls with the same arguments logged
+	std::atomic<uint32_t>	sample;						// Log one call in this many
+	std::atomic<uint64_t>	interval;					// Ticks per logged call (0 = no rate limit)
+	std::atomic<uint64_t>	tolerance;					// Ticks the bucket may be ahead of now: (burst - 1) intervals
+	} TA_POLICY_ENTRY, *PTA_POLICY_ENTRY;
+
+//
+// A thread's state for the rule of one API
+//
+
+typedef struct _TA_POLICY_STATE
+	{
+	uint64_t		full_at;							// Time at which the token bucket is full
+	uint64_t		last_hash;							// Hash of the previous call's arguments
+	uint32_t		repeats;							// Consecutive calls with those arguments
+	uint32_t		sample_count;						// Calls since the last sampled one
+	uint64_t		skipped [TA_POLICY_REASON_COUNT];	// Calls skipped since the last report
+	} TA_POLICY_STATE, *PTA_POLICY_STATE;
+
+//
+// Reports and frees the calling thread's state when the thread exits
+//
+
+struct TA_POLICY_OWNER
+	{
+	TA_POLICY_STATE	*state = nullptr;
+
+	~TA_POLICY_OWNER ();
+	};
+
+//
+// DECLARATIONS:
+//
+
+std::atomic<uint32_t>	Policy::active [TA_MAX_APIS / 32];
+std::atomic<uint32_t>	Policy::dedup [TA_MAX_APIS / 32];
+
+static std::mutex						TA_policy_lock;					// Serializes start and set_rule
+static TA_POLICY_ENTRY					*TA_policy_entries = nullptr;	// Rules, per API
+static std::atomic<uint32_t>			TA_policy_api_count (0);		// Entries in TA_policy_entries (fixed by the first start)
+static std::atomic<TA_POLICY_REPORT>	TA_policy_report (nullptr);		// Reports the skipped calls
+
+static thread_local TA_POLICY_OWNER		TA_policy_owner;				// The calling thread's state
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+bool
+parse_number											// Parse the value of a key
+	(
+	const wchar_t	*Text,								// Value
+	size_t			Length,								// Its length
+	uint32_t&		Value								// Number
+	);
+
+static
+bool
+same_key												// Compare a key with a name, ignoring case
+	(
+	const wchar_t	*Text,								// Key
+	size_t			Length,								// Its length
+	const char		*Name								// Lowercase name
+	);
+
+
+
+bool
+Policy::start											// Allocate the rules of each API
+	(
+	_In_	uint32_t			Api_count,				// Number of APIs (API numbers are 0 to Api_count - 1)
+	_In_	TA_POLICY_REPORT	Report					// Routine that reports the skipped calls (or nullptr)
+	)
+
+//
+// DESCRIPTION:		Allocate the rule table, with no rules, and set the report routine. The number of APIs is fixed by the first
+//					call; the rules are kept across stop and start
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							Api_count is 0, too large, differs from the first call's, or memory could not be
+//										allocated
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_policy_lock);
+
+
+	if (Api_count == 0 || Api_count > TA_MAX_APIS || (TA_policy_api_count != 0 && Api_count != TA_policy_api_count))
+		{
+		return false;
+		}
+
+	if (TA_policy_entries == nullptr)
+		{
+		if ((TA_policy_entries = new (std::nothrow) TA_POLICY_ENTRY [Api_count] ()) == nullptr)
+			{
+			return false;
+			}
+
+		TA_policy_api_count = Api_count;
+		}
+
+	TA_policy_report.store (Report);
+	return true;
+}							// End routine Policy::start
+
+
+void
+Policy::stop											// Stop applying the rules, and stop reporting
+	(
+	)
+
+//
+// DESCRIPTION:		Clear the active bits, so every call is logged, and forget the report routine, so that threads that exit
+//					later do not call it. The rule table and the threads' state are not freed, because intercepts may still be
+//					using them
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_policy_lock);
+
+
+	for (uint32_t i = 0; i < TA_MAX_APIS / 32; i++)
+		{
+		active [i].store (0);
+		dedup [i].store (0);
+		}
+
+	TA_policy_report.store (nullptr);
+}							// End routine Policy::stop
+
+
+bool
+Policy::parse_rule										// Parse the text of a rule
+	(
+	_In_z_	const wchar_t		*Text,					// "Name key=value ..."
+	_Out_	std::wstring&		Api_name,				// Name
+	_Out_	TA_POLICY_RULE&		Rule					// Rule
+	)
+
+//
+// DESCRIPTION:		Split the text at white space. The first word is the API name (or *, for every API), and each of the others
+//					is dedup=K, sample=N, rate=R or burst=B, where the value is a decimal number greater than 0. The keys are not
+//					case-sensitive
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The text has no name or no keys, or a key is unknown or has a bad value
+//
+
+{
+const wchar_t	*word;
+const wchar_t	*equals;
+size_t			length;
+uint32_t		value;
+uint32_t		*field;
+
+
+	Api_name.clear ();
+	Rule = TA_POLICY_RULE ();
+
+	while (*Text != L'\0')
+		{
+		if (iswspace (*Text))
+			{
+			Text++;
+			continue;
+			}
+
+		for (word = Text; *Text != L'\0' && !iswspace (*Text); Text++)
+			{
+			}
+
+		if (Api_name.empty ())
+			{
+			Api_name.assign (word, Text);
+			continue;
+			}
+
+		for (equals = word; equals < Text && *equals != L'='; equals++)
+			{
+			}
+
+		length = (size_t) (equals - word);
+
+		if (same_key (word, length, "dedup"))
+			{
+			field = &Rule.dedup;
+			}
+		else if (same_key (word, length, "sample"))
+			{
+			field = &Rule.sample;
+			}
+		else if (same_key (word, length, "rate"))
+			{
+			field = &Rule.rate;
+			}
+		else if (same_key (word, length, "burst"))
+			{
+			field = &Rule.burst;
+			}
+		else
+			{
+			return false;
+			}
+
+		if (equals == Text || !parse_number (equals + 1, (size_t) (Text - equals - 1), value))
+			{
+			return false;
+			}
+
+		*field = value;
+		}
+
+	return !Api_name.empty () && (Rule.dedup != 0 || Rule.sample != 0 || Rule.rate != 0);
+}							// End routine Policy::parse_rule
+
+
+bool
+Policy::set_rule										// Set the rule of an API
+	(
+	_In_	uint32_t				Api,				// API number, or TA_ALL_APIS
+	_In_	const TA_POLICY_RULE&	Rule				// Rule (all 0 removes the rule)
+	)
+
+//
+// DESCRIPTION:		Convert the rule to ticks, store it in the API's entry (or every entry), and set the bits that admit reads. A
+//					burst without a rate is ignored. Intercepts that are applying the old rule may see a mixture of the two
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							start has not been called, or the API number is out of range
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_policy_lock);
+uint32_t					first = Api;
+uint32_t					last = Api;
+uint64_t					interval = 0;
+uint64_t					tolerance = 0;
+uint32_t					bit;
+
+
+	if (TA_policy_entries == nullptr || (Api != TA_ALL_APIS && Api >= TA_policy_api_count))
+		{
+		return false;
+		}
+
+	if (Api == TA_ALL_APIS)
+		{
+		first = 0;
+		last = TA_policy_api_count - 1;
+		}
+
+	if (Rule.rate != 0)
+		{
+		interval = Capture::tick_frequency () / Rule.rate;
+		interval = interval != 0 ? interval : 1;
+		tolerance = interval * ((Rule.burst != 0 ? Rule.burst : Rule.rate) - 1);
+		}
+
+	for (uint32_t api = first; api <= last; api++)
+		{
+		TA_POLICY_ENTRY	*entry = &TA_policy_entries [api];
+
+		bit = 1u << (api & 31);
+		entry->dedup.store (Rule.dedup, std::memory_order_relaxed);
+		entry->sample.store (Rule.sample, std::memory_order_relaxed);
+		entry->interval.store (interval, std::memory_order_relaxed);
+		entry->tolerance.store (tolerance, std::memory_order_relaxed);
+
+		if (Rule.dedup != 0)
+			{
+			dedup [api >> 5].fetch_or (bit);
+			}
+		else
+			{
+			dedup [api >> 5].fetch_and (~bit);
+			}
+
+		if (Rule.dedup != 0 || Rule.sample > 1 || Rule.rate != 0)
+			{
+			active [api >> 5].fetch_or (bit, std::memory_order_release);
+			}
+		else
+			{
+			active [api >> 5].fetch_and (~bit);
+			}
+		}
+
+	return true;
+}							// End routine Policy::set_rule
+
+
+void
+Policy::flush											// Report the calls the calling thread has skipped
+	(
+	)
+
+//
+// DESCRIPTION:		Pass the calling thread's skipped counts of each API that has any to the report routine, and clear them
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_POLICY_STATE		*state = TA_policy_owner.state;
+TA_POLICY_REPORT	report = TA_policy_report.load ();
+
+
+	if (state == nullptr)
+		{
+		return;
+		}
+
+	for (uint32_t api = 0; api < TA_policy_api_count; api++)
+		{
+		uint64_t	*skipped = state [api].skipped;
+
+		if (skipped [TA_POLICY_DEDUP] != 0 || skipped [TA_POLICY_SAMPLE] != 0 || skipped [TA_POLICY_RATE] != 0)
+			{
+			if (report != nullptr)
+				{
+				report (api, skipped);
+				}
+
+			skipped [TA_POLICY_DEDUP] = skipped [TA_POLICY_SAMPLE] = skipped [TA_POLICY_RATE] = 0;
+			}
+		}
+}							// End routine Policy::flush
+
+
+bool
+Policy::decide											// Apply the API's rule, given the hash of the arguments
+	(
+	_In_	uint32_t		Api,						// API number
+	_In_	uint64_t		Hash						// Hash of the arguments (0 if the rule has no dedup)
+	)
+
+//
+// DESCRIPTION:		Apply the dedup, sample and rate parts of the rule in turn, using the calling thread's state. The first part
+//					that rejects the call counts it as skipped. A call that is logged first reports the calls of the API that
+//					were skipped before it
+//
+// ASSUMPTIONS:		Called by admit, from an intercept
+//
+// SIDE EFFECTS:	Allocates the thread's state on its first call. If that fails, every call is logged
+//
+// RETURN VALUES:
+//
+//		true							Log the call
+//		false							Skip it
+//
+
+{
+TA_POLICY_STATE		*states = TA_policy_owner.state;
+TA_POLICY_STATE		*state;
+TA_POLICY_ENTRY		*entry;
+TA_POLICY_REPORT	report;
+uint32_t			count = TA_policy_api_count.load (std::memory_order_relaxed);
+uint32_t			limit;
+uint64_t			interval;
+uint64_t			now;
+uint64_t			full_at;
+int					reason = TA_POLICY_REASON_COUNT;
+
+
+	if (Api >= count)
+		{
+		return true;
+		}
+
+	if (states == nullptr)
+		{
+		if ((states = new (std::nothrow) TA_POLICY_STATE [count] ()) == nullptr)
+			{
+			return true;
+			}
+
+		TA_policy_owner.state = states;
+		}
+
+	entry = &TA_policy_entries [Api];
+	state = &states [Api];
+
+	if ((limit = entry->dedup.load (std::memory_order_relaxed)) != 0)
+		{
+		if (state->repeats == 0 || Hash != state->last_hash)
+			{
+			state->last_hash = Hash;
+			state->repeats = 1;
+			}
+		else if (state->repeats < limit)
+			{
+			state->repeats++;
+			}
+		else
+			{
+			reason = TA_POLICY_DEDUP;
+			}
+		}
+
+	if (reason == TA_POLICY_REASON_COUNT && (limit = entry->sample.load (std::memory_order_relaxed)) > 1)
+		{
+		if (state->sample_count++ != 0)
+			{
+			reason = TA_POLICY_SAMPLE;
+			}
+
+		if (state->sample_count >= limit)
+			{
+			state->sample_count = 0;
+			}
+		}
+
+	if (reason == TA_POLICY_REASON_COUNT && (interval = entry->interval.load (std::memory_order_relaxed)) != 0)
+		{
+		now = Capture::timestamp ();
+		full_at = state->full_at > now ? state->full_at : now;
+
+		if (full_at - now > entry->tolerance.load (std::memory_order_relaxed))
+			{
+			reason = TA_POLICY_RATE;
+			}
+		else
+			{
+			state->full_at = full_at + interval;
+			}
+		}
+
+	if (reason != TA_POLICY_REASON_COUNT)
+		{
+		state->skipped [reason]++;
+		return false;
+		}
+
+	if (state->skipped [TA_POLICY_DEDUP] != 0 || state->skipped [TA_POLICY_SAMPLE] != 0 || state->skipped [TA_POLICY_RATE] != 0)
+		{
+		if ((report = TA_policy_report.load (std::memory_order_relaxed)) != nullptr)
+			{
+			report (Api, state->skipped);
+			}
+
+		state->skipped [TA_POLICY_DEDUP] = state->skipped [TA_POLICY_SAMPLE] = state->skipped [TA_POLICY_RATE] = 0;
+		}
+
+	return true;
+}							// End routine Policy::decide
+
+
+TA_POLICY_OWNER::~TA_POLICY_OWNER						// Called when the thread exits
+	(
+	)
+
+//
+// DESCRIPTION:		Report the calls the thread skipped since its last report, and free its state. Intercepts called by the report
+//					routine go straight to the real API
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	if (state == nullptr)
+		{
+		return;
+		}
+
+	Intercept::exclude_thread ();
+	Policy::flush ();
+	delete [] state;
+	state = nullptr;
+}							// End routine TA_POLICY_OWNER::~TA_POLICY_OWNER
+
+
+static
+bool
+parse_number											// Parse the value of a key
+	(
+	const wchar_t	*Text,								// Value
+	size_t			Length,								// Its length
+	uint32_t&		Value								// Number
+	)
+
+//
+// DESCRIPTION:		Convert a decimal number of 1 to UINT32_MAX
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The text is empty, not a number, 0, or too large
+//
+
+{
+uint64_t	number = 0;
+
+
+	if (Length == 0)
+		{
+		return false;
+		}
+
+	for (size_t i = 0; i < Length; i++)
+		{
+		if (Text [i] < L'0' || Text [i] > L'9' || (number = number * 10 + (uint64_t) (Text [i] - L'0')) > UINT32_MAX)
+			{
+			return false;
+			}
+		}
+
+	Value = (uint32_t) number;
+	return number != 0;
+}							// End routine parse_number
+
+
+static
+bool
+same_key												// Compare a key with a name, ignoring case
+	(
+	const wchar_t	*Text,								// Key
+	size_t			Length,								// Its length
+	const char		*Name								// Lowercase name
+	)
+
+//
+// DESCRIPTION:		Determine whether the key is the name, in any case
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							They are the same
+//		false							They are not
+//
+
+{
+	for (size_t i = 0; i < Length; i++)
+		{
+		if (Name [i] == '\0' || (wchar_t) towlower (Text [i]) != (wchar_t) Name [i])
+			{
+			return false;
+			}
+		}
+
+	return Name [Length] == '\0';
+}							// End routine same_key
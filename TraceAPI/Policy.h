@@ -0,0 +1,267 @@
+//
+// FACILITY:	Policy - Sampling and rate limiting of the intercepted calls
+//
+// DESCRIPTION:	An API that is called in a tight loop can produce more events than an ETW session can take, and the session drops
+//				them at random. A policy limits the calls of an API that produce events, in the intercept, before any event is
+//				built. A policy rule has up to three parts, applied in this order:
+//
+//					- dedup=K		Log the first K consecutive calls with the same arguments, and skip the repeats after them
+//					- sample=N		Log one call in N
+//					- rate=R		Log at most R calls per second, with bursts of up to burst=B calls (default R)
+//
+//				Strings passed as wide or ANSI strings are compared by their contents; every other argument by its value. The
+//				state of each rule (the last arguments, the sample count, the token bucket) is kept per thread, so applying
+//				a rule takes no lock and writes no shared memory, and the limits apply to each thread separately. Skipped calls
+//				are counted, and the counts are passed to the report routine before the API's next logged call on the thread,
+//				or when the thread exits.
+//
+//				Rules are written as text, one per API:
+//
+//					GetFileAttributesW dedup=3 rate=100
+//					ReadFile sample=10
+//
+//				Like Capture, this module uses only standard C++, so that it can be tested on Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//
+// Project includes
+//
+
+#include "Intercept.h"
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux test build
+#define	_In_z_
+#define	_Out_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_POLICY_MAX_TEXT		1024					// Characters of a string argument compared by dedup
+
+//
+// TYPES:
+//
+
+//
+// Why a call was skipped. Indexes the counts passed to the report routine
+//
+
+typedef enum _TA_POLICY_REASONS
+	{
+	TA_POLICY_DEDUP = 0,								// Repeated the previous call's arguments
+	TA_POLICY_SAMPLE,									// Not the one call in N
+	TA_POLICY_RATE,										// Over the rate limit
+	TA_POLICY_REASON_COUNT
+	} TA_POLICY_REASONS;
+
+//
+// A rule, in the units it is written in. A field of 0 is not applied
+//
+
+typedef struct _TA_POLICY_RULE
+	{
+	uint32_t		dedup;								// Consecutive calls with the same arguments logged
+	uint32_t		sample;								// Log one call in this many
+	uint32_t		rate;								// Calls logged per second
+	uint32_t		burst;								// Calls that may be logged at once (0 = rate)
+	} TA_POLICY_RULE, *PTA_POLICY_RULE;
+
+//
+// Called with the number of calls of an API that a thread skipped, for each reason, since its previous report. It runs on
+// the thread that skipped them, inside an intercept or as the thread exits
+//
+
+typedef void (*TA_POLICY_REPORT) (uint32_t Api, const uint64_t Skipped [TA_POLICY_REASON_COUNT]);
+
+//
+// DECLARATIONS:
+//
+
+class Policy
+{
+public:
+
+	//
+	// Public methods
+	//
+
+	static
+	bool
+	start												// Allocate the rules of each API
+		(
+		_In_	uint32_t			Api_count,			// Number of APIs (API numbers are 0 to Api_count - 1)
+		_In_	TA_POLICY_REPORT	Report				// Routine that reports the skipped calls (or nullptr)
+		);
+
+	static
+	void
+	stop												// Stop applying the rules, and stop reporting
+		(
+		);
+
+	static
+	bool
+	parse_rule											// Parse the text of a rule
+		(
+		_In_z_	const wchar_t		*Text,				// "Name key=value ..."
+		_Out_	std::wstring&		Api_name,			// Name
+		_Out_	TA_POLICY_RULE&		Rule				// Rule
+		);
+
+	static
+	bool
+	set_rule											// Set the rule of an API
+		(
+		_In_	uint32_t				Api,			// API number, or TA_ALL_APIS
+		_In_	const TA_POLICY_RULE&	Rule			// Rule (all 0 removes the rule)
+		);
+
+	template <typename... T>
+	static
+	inline
+	bool
+	admit												// Apply the API's rule to a call
+		(
+		_In_	uint32_t		Api,					// API number
+		_In_	const T&...		Args					// The call's arguments
+		)
+		{
+		uint32_t	bit = 1u << (Api & 31);
+
+
+		if ((active [Api >> 5].load (std::memory_order_relaxed) & bit) == 0)
+			{
+			return true;
+			}
+
+		return decide (Api, (dedup [Api >> 5].load (std::memory_order_relaxed) & bit) != 0 ? hash_args (Args...) : 0);
+		}
+
+	static
+	void
+	flush												// Report the calls the calling thread has skipped
+		(
+		);
+
+private:
+
+	static
+	bool
+	decide												// Apply the API's rule, given the hash of the arguments
+		(
+		_In_	uint32_t		Api,					// API number
+		_In_	uint64_t		Hash					// Hash of the arguments (0 if the rule has no dedup)
+		);
+
+	template <typename... T>
+	static
+	inline
+	uint64_t
+	hash_args											// Hash a call's arguments
+		(
+		_In_	const T&...		Args					// Arguments
+		)
+		{
+		uint64_t	hash = 0xCBF29CE484222325ULL;
+		int			unused [] = {0, (hash = hash_arg (hash, Args), 0)...};
+
+
+		(void) unused;
+		return hash;
+		}
+
+	template <typename T>
+	static
+	inline
+	uint64_t
+	hash_arg											// Add an argument's value to a hash (FNV-1a)
+		(
+		_In_	uint64_t		Hash,					// Hash so far
+		_In_	const T&		Value					// Argument
+		)
+		{
+		const uint8_t	*bytes = (const uint8_t *) &Value;
+
+
+		for (size_t i = 0; i < sizeof (T); i++)
+			{
+			Hash = (Hash ^ bytes [i]) * 0x100000001B3ULL;
+			}
+
+		return Hash;
+		}
+
+	static
+	inline
+	uint64_t
+	hash_arg											// Add the contents of an ANSI string to a hash
+		(
+		_In_	uint64_t		Hash,					// Hash so far
+		_In_z_	const char		*Text					// String (may be nullptr)
+		)
+		{
+		for (size_t i = 0; Text != nullptr && i < TA_POLICY_MAX_TEXT && Text [i] != '\0'; i++)
+			{
+			Hash = (Hash ^ (uint8_t) Text [i]) * 0x100000001B3ULL;
+			}
+
+		return hash_arg (Hash, Text == nullptr);
+		}
+
+	static
+	inline
+	uint64_t
+	hash_arg											// Add the contents of a wide string to a hash
+		(
+		_In_	uint64_t		Hash,					// Hash so far
+		_In_z_	const wchar_t	*Text					// String (may be nullptr)
+		)
+		{
+		for (size_t i = 0; Text != nullptr && i < TA_POLICY_MAX_TEXT && Text [i] != L'\0'; i++)
+			{
+			Hash = (Hash ^ (uint32_t) Text [i]) * 0x100000001B3ULL;
+			}
+
+		return hash_arg (Hash, Text == nullptr);
+		}
+
+	static std::atomic<uint32_t>	active [TA_MAX_APIS / 32];	// Per-API bits: the API has a rule
+	static std::atomic<uint32_t>	dedup [TA_MAX_APIS / 32];	// Per-API bits: its rule has dedup, so admit hashes the arguments
+
+};	// End class Policy
+
+}	// End of namespace FDI
@@ -0,0 +1,487 @@
+//
+// FACILITY:	StackTable - Call stacks of captured calls, each stored once
+//
+// DESCRIPTION:	This module contains the implementation of the StackTable class. The table is an array of TA_STACK_ENTRYs,
+//				indexed by the hash of a stack, with linear probing. A slot is empty while its hash is 0; a thread adding a stack
+//				claims the slot by swapping its hash in, fills in the frames, and then sets ready. A thread looking for the same
+//				stack compares the frames only once ready is set. Slots are never emptied while the table is in use, so a stack's
+//				ID (its slot number plus 1) never changes.
+//
+//				Each new stack also takes the next entry of the order list, in which it stores its ID once it is ready. flush
+//				walks the list from the first entry it has not sent, and stops at the first entry that is still 0, so it sends
+//				each stack exactly once, and only after its frames are complete
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <execinfo.h>
+#endif
+
+#include <cstring>
+#include <new>
+
+//
+// Project includes
+//
+
+#include "StackTable.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	STK_MAX_PROBES			32						// Slots looked at before a stack is counted as not fitting
+#define	STK_MAX_SPINS			64						// Times a lookup checks a slot that another thread is filling
+#define	STK_WALK_SLACK			4						// Frames the stack walk may return below the intercept's return address
+
+//
+// TYPES:
+//
+
+typedef struct _TA_STACK_ENTRY
+	{
+	std::atomic<uint64_t>	hash;						// Hash of the frames; 0 while the slot is empty
+	std::atomic<uint32_t>	ready;						// The frames have been written
+	uint32_t				depth;						// Frames used
+	uint64_t				frames [TA_STACK_MAX_FRAMES];	// Return addresses, innermost first
+	} TA_STACK_ENTRY, *PTA_STACK_ENTRY;
+
+typedef struct _TA_STACK_TABLE
+	{
+	uint32_t				mask;						// Number of entries - 1
+	std::atomic<uint32_t>	next;						// Next entry of order to take
+	uint32_t				flushed;					// Entries of order already flushed (used only by flush)
+	std::atomic<uint64_t>	full;						// Stacks that did not fit
+	std::atomic<uint64_t>	busy;						// Lookups that gave up waiting for a slot
+	std::atomic<uint32_t>	*order;						// IDs of the stacks, in the order they were added
+	TA_STACK_ENTRY			*entries;					// The table
+	} TA_STACK_TABLE, *PTA_STACK_TABLE;
+
+//
+// DECLARATIONS:
+//
+
+std::atomic<uint32_t>		StackTable::stack_depth (0);
+
+static std::atomic<TA_STACK_TABLE *>	TA_stack_table (nullptr);	// Current table (never freed; see stop)
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+inline
+uint64_t
+stack_hash												// Hash the frames of a stack
+	(
+	const uint64_t	*Frames,							// Return addresses
+	uint32_t		Count								// Number of frames
+	);
+
+
+
+bool
+StackTable::start										// Empty the table and start capturing stacks
+	(
+	_In_	const TA_STACK_CONFIG&	Config				// Depth and table size
+	)
+
+//
+// DESCRIPTION:		Allocate the table, or empty the one from an earlier start if it is the same size, then let the intercepts
+//					capture stacks. Each capture session starts with an empty table, so that every stack ID in a trace is defined
+//					by a TA_REC_STACK record in the same trace. A table of another size replaces the old one, which is not freed
+//
+// ASSUMPTIONS:		Stacks are not being captured, and the drain thread is not running
+//
+// SIDE EFFECTS:	On Linux, loads the unwinder used by backtrace, so that the first intercept does not
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The depth is 0, or there is not enough memory
+//
+
+{
+TA_STACK_TABLE	*table = TA_stack_table.load (std::memory_order_acquire);
+uint32_t		entries = TA_STACK_MIN_ENTRIES;
+
+
+	if (Config.depth == 0)
+		{
+		return false;
+		}
+
+	//
+	// Round the size up to a power of 2, so that a hash is masked to a slot number
+	//
+
+	while (entries < Config.entries && entries < TA_STACK_MAX_ENTRIES)
+		{
+		entries <<= 1;
+		}
+
+	if (table == nullptr || table->mask != entries - 1)
+		{
+		if ((table = new (std::nothrow) TA_STACK_TABLE ()) == nullptr)
+			{
+			return false;
+			}
+
+		table->order = new (std::nothrow) std::atomic<uint32_t> [entries] ();
+		table->entries = new (std::nothrow) TA_STACK_ENTRY [entries] ();
+
+		if (table->order == nullptr || table->entries == nullptr)
+			{
+			delete [] table->order;
+			delete [] table->entries;
+			delete table;
+			return false;
+			}
+
+		table->mask = entries - 1;
+		}
+	else
+		{
+		for (uint32_t i = 0; i < entries; i++)
+			{
+			table->entries [i].hash.store (0, std::memory_order_relaxed);
+			table->entries [i].ready.store (0, std::memory_order_relaxed);
+			table->order [i].store (0, std::memory_order_relaxed);
+			}
+
+		table->next.store (0, std::memory_order_relaxed);
+		table->flushed = 0;
+		table->full.store (0, std::memory_order_relaxed);
+		table->busy.store (0, std::memory_order_relaxed);
+		}
+
+#ifndef _WIN32
+	{
+	void	*frame;
+
+	backtrace (&frame, 1);
+	}
+#endif
+
+	TA_stack_table.store (table, std::memory_order_release);
+	stack_depth.store (Config.depth < TA_STACK_MAX_FRAMES ? Config.depth : TA_STACK_MAX_FRAMES, std::memory_order_release);
+	return true;
+}							// End routine StackTable::start
+
+
+void
+StackTable::stop										// Stop capturing stacks
+	(
+	)
+
+//
+// DESCRIPTION:		Stop the intercepts from capturing stacks. The table is kept: intercepts that are running on other threads
+//					may still be using it, and the drain thread flushes the stacks they add
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	stack_depth.store (0, std::memory_order_release);
+}							// End routine StackTable::stop
+
+
+uint32_t
+StackTable::intern										// Find or add a stack
+	(
+	_In_	const uint64_t	*Frames,					// Return addresses, innermost first
+	_In_	uint32_t		Count						// Number of frames (at most TA_STACK_MAX_FRAMES are used)
+	)
+
+//
+// DESCRIPTION:		Look for the stack, starting at the slot its hash selects. If an empty slot is reached first, claim it and
+//					add the stack. A stack is the same as another only if all of its frames are
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Stack ID						Normal, successful completion
+//		0								There is no table, the stack did not fit in STK_MAX_PROBES slots, or its slot was
+//										still being filled by another thread
+//
+
+{
+TA_STACK_TABLE	*table = TA_stack_table.load (std::memory_order_acquire);
+TA_STACK_ENTRY	*entry;
+uint64_t		hash;
+uint64_t		current;
+uint32_t		index;
+
+
+	if (table == nullptr || Count == 0)
+		{
+		return 0;
+		}
+
+	if (Count > TA_STACK_MAX_FRAMES)
+		{
+		Count = TA_STACK_MAX_FRAMES;
+		}
+
+	hash = stack_hash (Frames, Count);
+	index = (uint32_t) hash & table->mask;
+
+	for (uint32_t probe = 0; probe < STK_MAX_PROBES; probe++, index = (index + 1) & table->mask)
+		{
+		entry = &table->entries [index];
+		current = entry->hash.load (std::memory_order_acquire);
+
+		if (current == 0)
+			{
+			if (entry->hash.compare_exchange_strong (current, hash, std::memory_order_acq_rel))
+				{
+				entry->depth = Count;
+				memcpy (entry->frames, Frames, Count * sizeof (Frames [0]));
+				entry->ready.store (1, std::memory_order_release);
+
+				//
+				// Each slot is claimed once, so there is an entry of order for every stack
+				//
+
+				table->order [table->next.fetch_add (1, std::memory_order_relaxed)].store (index + 1, std::memory_order_release);
+				return index + 1;
+				}
+
+			//
+			// Another thread claimed the slot first; current is now the hash of its stack, which may be this one
+			//
+			}
+
+		if (current == hash)
+			{
+			for (uint32_t spin = 0; entry->ready.load (std::memory_order_acquire) == 0; spin++)
+				{
+				if (spin == STK_MAX_SPINS)
+					{
+					table->busy.fetch_add (1, std::memory_order_relaxed);
+					return 0;
+					}
+				}
+
+			if (entry->depth == Count && memcmp (entry->frames, Frames, Count * sizeof (Frames [0])) == 0)
+				{
+				return index + 1;
+				}
+			}
+		}
+
+	table->full.fetch_add (1, std::memory_order_relaxed);
+	return 0;
+}							// End routine StackTable::intern
+
+
+uint32_t
+StackTable::flush										// Build the records of the stacks not yet flushed
+	(
+	_Out_	TA_RECORD	*Records,						// Where to put them
+	_In_	uint32_t	Max								// Most records to build
+	)
+
+//
+// DESCRIPTION:		Build a TA_REC_STACK record for each stack added since the last call, in the order they were added, up to the
+//					first one that is not ready. The record's stack_id is the stack's ID, and its arguments are the frames. The
+//					caller fills in the timestamp and thread ID
+//
+// ASSUMPTIONS:		Called only from the drain thread, or with the drain lock held
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Number of records built
+//
+
+{
+TA_STACK_TABLE	*table = TA_stack_table.load (std::memory_order_acquire);
+TA_STACK_ENTRY	*entry;
+TA_RECORD		*record;
+uint32_t		count = 0;
+uint32_t		id;
+
+
+	if (table == nullptr)
+		{
+		return 0;
+		}
+
+	while (count < Max && table->flushed <= table->mask &&
+		(id = table->order [table->flushed].load (std::memory_order_acquire)) != 0)
+		{
+		entry = &table->entries [id - 1];
+		record = &Records [count++];
+		record->timestamp = 0;
+		record->thread_id = 0;
+		record->api = 0;
+		record->kind = TA_REC_STACK;
+		record->arg_count = (uint8_t) entry->depth;
+		record->text_length = 0;
+		record->reserved = 0;
+		record->stack_id = id;
+		memcpy (record->args, entry->frames, entry->depth * sizeof (entry->frames [0]));
+		table->flushed++;
+		}
+
+	return count;
+}							// End routine StackTable::flush
+
+
+void
+StackTable::get_stats									// Get the table's statistics
+	(
+	_Out_	TA_STACK_STATS&	Stats						// Statistics
+	)
+
+//
+// DESCRIPTION:		Return the statistics of the current table (all 0 if there is none)
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+TA_STACK_TABLE	*table = TA_stack_table.load (std::memory_order_acquire);
+uint32_t		next;
+
+
+	Stats = TA_STACK_STATS ();
+
+	if (table != nullptr)
+		{
+		next = table->next.load (std::memory_order_relaxed);
+		Stats.entries = table->mask + 1;
+		Stats.stacks = next < Stats.entries ? next : Stats.entries;
+		Stats.flushed = table->flushed;
+		Stats.full = table->full.load (std::memory_order_relaxed);
+		Stats.busy = table->busy.load (std::memory_order_relaxed);
+		}
+}							// End routine StackTable::get_stats
+
+
+uint32_t
+StackTable::capture_stack								// Walk the stack and intern it
+	(
+	_In_	void		*Return_address,				// Innermost frame
+	_In_	uint32_t	Depth							// Frames to capture
+	)
+
+//
+// DESCRIPTION:		The first frame is the intercept's return address. For a deeper stack, walk the stack and take the frames above
+//					the one that matches the return address, so that the frames of this routine and the intercept are left out
+//					however the compiler arranged them. If the return address is not found, the stack is the return address alone
+//
+// ASSUMPTIONS:		Depth is 1 to TA_STACK_MAX_FRAMES
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Stack ID, or 0 (see intern)
+//
+
+{
+uint64_t	frames [TA_STACK_MAX_FRAMES];
+void		*walk [TA_STACK_MAX_FRAMES + STK_WALK_SLACK];
+uint32_t	count = 1;
+uint32_t	walked;
+uint32_t	i;
+
+
+	frames [0] = (uint64_t) (uintptr_t) Return_address;
+
+	if (Depth > 1)
+		{
+#ifdef _WIN32
+		walked = RtlCaptureStackBackTrace (0, Depth + STK_WALK_SLACK, walk, nullptr);
+#else
+		walked = (uint32_t) backtrace (walk, (int) (Depth + STK_WALK_SLACK));
+#endif
+
+		for (i = 0; i < walked && walk [i] != Return_address; i++)
+			{
+			}
+
+		for (i++; i < walked && count < Depth; i++)
+			{
+			frames [count++] = (uint64_t) (uintptr_t) walk [i];
+			}
+		}
+
+	return intern (frames, count);
+}							// End routine StackTable::capture_stack
+
+
+static
+inline
+uint64_t
+stack_hash												// Hash the frames of a stack
+	(
+	const uint64_t	*Frames,							// Return addresses
+	uint32_t		Count								// Number of frames
+	)
+
+//
+// DESCRIPTION:		Mix each frame into the hash with a multiply and a shift, so that stacks that differ only in their outer frames
+//					still land in different slots
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Hash, never 0 (which marks an empty slot)
+//
+
+{
+uint64_t	hash = 0x9E3779B97F4A7C15ull ^ Count;
+
+
+	for (uint32_t i = 0; i < Count; i++)
+		{
+		hash = (hash ^ Frames [i]) * 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 32;
+		}
+
+	return hash != 0 ? hash : 1;
+}							// End routine stack_hash
@@ -0,0 +1,186 @@
+//
+// FACILITY:	StackTable - Call stacks of captured calls, each stored once
+//
+// DESCRIPTION:	In capture mode, an intercept can record where its API was called from. It captures the return address (and,
+//				when the configured depth is more than 1, the frames above it), and interns the stack in a table shared by all
+//				threads. The table returns a 32-bit stack ID, which is stored in the call's TA_RECORD, so a stack costs each
+//				event 1 to 5 bytes in the trace file instead of 8 bytes per frame.
+//
+//				The table is a lock-free open-addressing hash table: a new stack claims an empty slot with a compare-and-swap,
+//				and a stack that is already in the table is found without writing anything. New stacks are also appended to a
+//				list in the order they were added, and the drain thread sends the ones it has not sent yet (flush) to the sink
+//				as TA_REC_STACK records before each pass over the rings. A reader should resolve stack IDs once it has read the
+//				whole trace, as a stack's record can follow the first records that use it by one drain pass.
+//
+//				When the table is full, or a stack's slot is still being filled by another thread, the call gets stack ID 0
+//				(no stack) and is counted; the intercept never waits.
+//
+//				This module uses only standard C++ (plus the Windows or glibc stack walk), so that it can be built and tested on
+//				Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+
+//
+// Project includes
+//
+
+#include "Capture.h"
+
+//
+// MACROS:
+//
+
+#ifdef _WIN32											// Return address of the routine that uses it
+#define	TA_RETURN_ADDRESS()		_ReturnAddress ()
+#define	TA_STACK_NOINLINE		__declspec (noinline)
+#else
+#define	TA_RETURN_ADDRESS()		__builtin_return_address (0)
+#define	TA_STACK_NOINLINE		__attribute__ ((noinline))
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_STACK_MAX_FRAMES		TA_CAPTURE_MAX_ARGS		// Most frames in a stack (a TA_REC_STACK record holds them as arguments)
+#define	TA_STACK_MIN_ENTRIES	64						// Smallest table
+#define	TA_STACK_MAX_ENTRIES	(1 << 20)				// Largest table (144MB)
+#define	TA_STACK_ENTRIES		4096					// Default size
+
+//
+// TYPES:
+//
+
+typedef struct _TA_STACK_CONFIG
+	{
+	uint32_t		depth;								// Frames captured for each call: 1 is the return address only
+	uint32_t		entries;							// Unique stacks the table holds (rounded up to a power of 2)
+	} TA_STACK_CONFIG, *PTA_STACK_CONFIG;
+
+typedef struct _TA_STACK_STATS
+	{
+	uint32_t		stacks;								// Unique stacks in the table
+	uint32_t		flushed;							// Stacks passed to the sink
+	uint32_t		entries;							// Size of the table
+	uint64_t		full;								// Calls that got no stack ID because the table was full
+	uint64_t		busy;								// Calls that got no stack ID because their stack's slot was being filled
+	} TA_STACK_STATS, *PTA_STACK_STATS;
+
+//
+// DECLARATIONS:
+//
+
+class StackTable
+{
+public:
+
+	//
+	// Public methods
+	//
+
+	static
+	bool
+	start												// Empty the table and start capturing stacks
+		(
+		_In_	const TA_STACK_CONFIG&	Config			// Depth and table size
+		);
+
+	static
+	void
+	stop												// Stop capturing stacks
+		(
+		);
+
+	static
+	inline
+	uint32_t
+	depth												// Frames captured for each call (0 when stacks are off)
+		(
+		)
+		{
+		return stack_depth.load (std::memory_order_acquire);
+		}
+
+	static
+	inline
+	uint32_t
+	capture												// Capture and intern the caller's stack
+		(
+		_In_	void	*Return_address					// Return address of the intercept (TA_RETURN_ADDRESS)
+		)
+		{
+		uint32_t	frames = depth ();
+
+
+		return frames == 0 ? 0 : capture_stack (Return_address, frames);
+		}
+
+	static
+	uint32_t
+	intern												// Find or add a stack
+		(
+		_In_	const uint64_t	*Frames,				// Return addresses, innermost first
+		_In_	uint32_t		Count					// Number of frames (at most TA_STACK_MAX_FRAMES are used)
+		);
+
+	static
+	uint32_t
+	flush												// Build the records of the stacks not yet flushed
+		(
+		_Out_	TA_RECORD	*Records,					// Where to put them
+		_In_	uint32_t	Max							// Most records to build
+		);
+
+	static
+	void
+	get_stats											// Get the table's statistics
+		(
+		_Out_	TA_STACK_STATS&	Stats					// Statistics
+		);
+
+private:
+
+	static
+	TA_STACK_NOINLINE
+	uint32_t
+	capture_stack										// Walk the stack and intern it
+		(
+		_In_	void		*Return_address,			// Innermost frame
+		_In_	uint32_t	Depth						// Frames to capture
+		);
+
+	static std::atomic<uint32_t>	stack_depth;		// Read by every intercept; 0 when stacks are off
+
+};	// End class StackTable
+
+}	// End of namespace FDI
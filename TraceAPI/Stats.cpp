@@ -0,0 +1,574 @@
+//
+// FACILITY:	Stats - Per-API call counters and latency histograms
+//
+// DESCRIPTION:	This module contains the implementation of the Stats class. Each thread that calls an intercept gets a block of
+//				counters (one TA_API_COUNTERS per API) the first time it counts a call. Only the owning thread writes its counters,
+//				so it updates them with plain relaxed loads and stores instead of interlocked operations, and get can read them at
+//				any time. The blocks are on a singly linked list that only grows. When a thread exits, its counters are added to
+//				the retired totals and cleared, and the block is marked free, so the next new thread reuses it instead of
+//				allocating one; the lock that protects the retired totals makes that atomic with respect to get.
+//
+//				This module uses only standard C++ (plus the Windows last error status), so that it can be built and tested on
+//				Linux. It does not use WPP; DLLMain.cpp logs the counters
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <cstring>
+#include <mutex>
+#include <new>
+
+//
+// Project includes
+//
+
+#include "Stats.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	STATS_CACHE_LINE		64						// Keeps each thread's counters on their own cache lines
+
+//
+// TYPES:
+//
+
+//
+// The counters of one API in one thread. They take whole cache lines
+//
+
+typedef struct _TA_API_COUNTERS
+	{
+	std::atomic<uint64_t>	calls;						// Calls timed
+	std::atomic<uint64_t>	ticks;						// Total time in the real API
+	std::atomic<uint64_t>	max_ticks;					// Longest call
+	std::atomic<uint64_t>	buckets [TA_STATS_BUCKETS];	// Histogram of the call times
+	char					pad [STATS_CACHE_LINE - (3 + TA_STATS_BUCKETS) * sizeof (uint64_t) % STATS_CACHE_LINE];
+	} TA_API_COUNTERS, *PTA_API_COUNTERS;
+
+static_assert (sizeof (TA_API_COUNTERS) % STATS_CACHE_LINE == 0, "TA_API_COUNTERS must fill whole cache lines");
+
+//
+// A thread's counters. The header is only written when the block is claimed or released, so it may share a cache line
+// with anything; counters is aligned to a cache line within the allocation
+//
+
+typedef struct _TA_STATS_BLOCK
+	{
+	std::atomic<bool>		owned;						// A thread is using the block
+	void					*memory;					// Allocation that holds counters
+	TA_API_COUNTERS			*counters;					// One per API
+	struct _TA_STATS_BLOCK	*next;						// Next block on the list
+	} TA_STATS_BLOCK, *PTA_STATS_BLOCK;
+
+//
+// Releases the calling thread's block when the thread exits
+//
+
+struct TA_STATS_OWNER
+	{
+	TA_STATS_BLOCK	*block = nullptr;
+
+	~TA_STATS_OWNER ();
+	};
+
+//
+// DECLARATIONS:
+//
+
+std::atomic<bool>			Stats::stats_enabled (false);
+
+static std::atomic<TA_STATS_BLOCK *>	TA_stats_blocks (nullptr);		// All the blocks
+static std::atomic<uint32_t>			TA_stats_blocks_allocated (0);	// Blocks on the list
+static std::atomic<uint32_t>			TA_stats_api_count (0);			// Counters in each block (fixed by the first start)
+
+static std::mutex						TA_stats_lock;					// Protects the retired totals, and releasing a block
+static TA_API_STATS						*TA_stats_retired = nullptr;	// Counters of the threads that have exited, per API
+
+static thread_local TA_STATS_OWNER		TA_stats_owner;					// The calling thread's block
+
+//
+// FORWARD ROUTINES:
+//
+
+static
+TA_STATS_BLOCK *
+block_claim												// Get a block for the calling thread
+	(
+	);
+
+static
+inline
+uint32_t
+bucket_of												// Find the histogram bucket of a call time
+	(
+	uint64_t	Ticks									// Call time
+	);
+
+static
+inline
+void
+bump													// Add to a counter that only the calling thread writes
+	(
+	std::atomic<uint64_t>&	Counter,					// Counter
+	uint64_t				Value						// Amount to add
+	);
+
+
+
+bool
+Stats::start											// Start counting calls
+	(
+	_In_	uint32_t	Api_count						// Number of APIs (API numbers are 0 to Api_count - 1)
+	)
+
+//
+// DESCRIPTION:		Allocate the retired totals, and enable counting. The number of APIs is fixed by the first call; the counts are
+//					kept across stop and start
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							Api_count is 0, differs from the first call's, or memory could not be allocated
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_stats_lock);
+
+
+	if (Api_count == 0 || (TA_stats_api_count != 0 && Api_count != TA_stats_api_count))
+		{
+		return false;
+		}
+
+	if (TA_stats_retired == nullptr)
+		{
+		if ((TA_stats_retired = new (std::nothrow) TA_API_STATS [Api_count] ()) == nullptr)
+			{
+			return false;
+			}
+
+		TA_stats_api_count = Api_count;
+		}
+
+	stats_enabled.store (true);
+	return true;
+}							// End routine Stats::start
+
+
+void
+Stats::stop												// Stop counting calls (the counts are kept)
+	(
+	)
+
+//
+// DESCRIPTION:		Disable counting. An intercept that has already checked enabled still counts its call. The blocks are not
+//					freed, because intercepts may still be using them
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	stats_enabled.store (false);
+}							// End routine Stats::stop
+
+
+void
+Stats::call_end											// Count a call to the real API
+	(
+	_In_	uint32_t	Api,							// API number
+	_In_	uint64_t	Begin							// Value returned by call_begin
+	)
+
+//
+// DESCRIPTION:		Add the call, and the time since Begin, to the calling thread's counters for the API. The call is not counted
+//					if the thread has no block and one cannot be allocated
+//
+// ASSUMPTIONS:		Called from an intercept, right after the real API returns
+//
+// SIDE EFFECTS:	Allocates or reuses a block on the thread's first call. Preserves the thread's last error status
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+uint64_t			ticks = Capture::timestamp () - Begin;
+TA_STATS_BLOCK		*block = TA_stats_owner.block;
+TA_API_COUNTERS		*counters;
+
+
+	if (Api >= TA_stats_api_count.load (std::memory_order_relaxed) || (block == nullptr && (block = block_claim ()) == nullptr))
+		{
+		return;
+		}
+
+	counters = &block->counters [Api];
+	bump (counters->calls, 1);
+	bump (counters->ticks, ticks);
+	bump (counters->buckets [bucket_of (ticks)], 1);
+
+	if (ticks > counters->max_ticks.load (std::memory_order_relaxed))
+		{
+		counters->max_ticks.store (ticks, std::memory_order_relaxed);
+		}
+}							// End routine Stats::call_end
+
+
+bool
+Stats::get												// Add up the counters of an API over the threads
+	(
+	_In_	uint32_t		Api,						// API number
+	_Out_	TA_API_STATS&	Api_stats					// Counters
+	)
+
+//
+// DESCRIPTION:		Add the retired totals and every block's counters for the API. The threads keep counting while this runs, so
+//					the fields may be a few calls apart, but no call is counted twice or lost
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The API number is out of range, or start has not been called
+//
+
+{
+std::lock_guard<std::mutex>	lock (TA_stats_lock);
+
+
+	memset (&Api_stats, 0, sizeof (Api_stats));
+
+	if (Api >= TA_stats_api_count)
+		{
+		return false;
+		}
+
+	Api_stats = TA_stats_retired [Api];
+
+	for (TA_STATS_BLOCK *block = TA_stats_blocks.load (std::memory_order_acquire); block != nullptr; block = block->next)
+		{
+		const TA_API_COUNTERS	*counters = &block->counters [Api];
+		uint64_t				max_ticks = counters->max_ticks.load (std::memory_order_relaxed);
+
+		Api_stats.calls += counters->calls.load (std::memory_order_relaxed);
+		Api_stats.ticks += counters->ticks.load (std::memory_order_relaxed);
+
+		for (uint32_t b = 0; b < TA_STATS_BUCKETS; b++)
+			{
+			Api_stats.buckets [b] += counters->buckets [b].load (std::memory_order_relaxed);
+			}
+
+		if (max_ticks > Api_stats.max_ticks)
+			{
+			Api_stats.max_ticks = max_ticks;
+			}
+		}
+
+	return true;
+}							// End routine Stats::get
+
+
+uint64_t
+Stats::percentile										// Estimate a percentile of the call times
+	(
+	_In_	const TA_API_STATS&	Api_stats,				// Counters returned by get
+	_In_	uint32_t			Percent					// 1 to 100
+	)
+
+//
+// DESCRIPTION:		Find the bucket that holds the call at the percentile, and return the longest time in the bucket (or the
+//					longest call, if that is less). The estimate is at most twice the real value
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Ticks (0 if there were no calls)
+//
+
+{
+uint64_t	rank;
+uint64_t	count = 0;
+uint64_t	limit;
+
+
+	if (Api_stats.calls == 0)
+		{
+		return 0;
+		}
+
+	rank = (Api_stats.calls * (Percent > 100 ? 100 : Percent) + 99) / 100;
+
+	for (uint32_t b = 0; b < TA_STATS_BUCKETS - 1; b++)
+		{
+		count += Api_stats.buckets [b];
+
+		if (count >= rank && count != 0)
+			{
+			limit = b == 0 ? 0 : (1ULL << b) - 1;
+			return limit < Api_stats.max_ticks ? limit : Api_stats.max_ticks;
+			}
+		}
+
+	return Api_stats.max_ticks;
+}							// End routine Stats::percentile
+
+
+uint32_t
+Stats::blocks											// Number of per-thread counter blocks allocated
+	(
+	)
+
+//
+// DESCRIPTION:		Return the number of blocks on the list. Blocks are reused, so this is the largest number of threads that
+//					have counted calls at the same time
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Blocks
+//
+
+{
+	return TA_stats_blocks_allocated.load ();
+}							// End routine Stats::blocks
+
+
+TA_STATS_OWNER::~TA_STATS_OWNER							// Called when the thread exits
+	(
+	)
+
+//
+// DESCRIPTION:		Add the thread's counters to the retired totals, clear them, and free the block for another thread
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	if (block == nullptr)
+		{
+		return;
+		}
+
+	std::lock_guard<std::mutex>	lock (TA_stats_lock);
+
+	for (uint32_t api = 0; api < TA_stats_api_count; api++)
+		{
+		TA_API_COUNTERS	*counters = &block->counters [api];
+		TA_API_STATS	*retired = &TA_stats_retired [api];
+		uint64_t		max_ticks = counters->max_ticks.load (std::memory_order_relaxed);
+
+		retired->calls += counters->calls.load (std::memory_order_relaxed);
+		retired->ticks += counters->ticks.load (std::memory_order_relaxed);
+		counters->calls.store (0, std::memory_order_relaxed);
+		counters->ticks.store (0, std::memory_order_relaxed);
+		counters->max_ticks.store (0, std::memory_order_relaxed);
+
+		for (uint32_t b = 0; b < TA_STATS_BUCKETS; b++)
+			{
+			retired->buckets [b] += counters->buckets [b].load (std::memory_order_relaxed);
+			counters->buckets [b].store (0, std::memory_order_relaxed);
+			}
+
+		if (max_ticks > retired->max_ticks)
+			{
+			retired->max_ticks = max_ticks;
+			}
+		}
+
+	block->owned.store (false, std::memory_order_release);
+	block = nullptr;
+}							// End routine TA_STATS_OWNER::~TA_STATS_OWNER
+
+
+static
+TA_STATS_BLOCK *
+block_claim												// Get a block for the calling thread
+	(
+	)
+
+//
+// DESCRIPTION:		Take a block that a thread has released, or allocate one and push it onto the front of the list
+//
+// ASSUMPTIONS:		The thread does not have a block, and start has been called
+//
+// SIDE EFFECTS:	Preserves the thread's last error status, because this is called right after the real API
+//
+// RETURN VALUES:
+//
+//		Block							Normal, successful completion
+//		nullptr							Out of memory
+//
+
+{
+#ifdef _WIN32
+DWORD			last_error = GetLastError ();
+#endif
+TA_STATS_BLOCK	*block;
+TA_STATS_BLOCK	*first;
+uintptr_t		address;
+
+
+	for (block = TA_stats_blocks.load (std::memory_order_acquire); block != nullptr; block = block->next)
+		{
+		bool	owned = false;
+
+		if (!block->owned.load (std::memory_order_relaxed) &&
+			block->owned.compare_exchange_strong (owned, true, std::memory_order_acquire))
+			{
+			break;
+			}
+		}
+
+	if (block == nullptr && (block = new (std::nothrow) TA_STATS_BLOCK) != nullptr)
+		{
+		if ((block->memory = ::operator new (TA_stats_api_count * sizeof (TA_API_COUNTERS) + STATS_CACHE_LINE, std::nothrow)) == nullptr)
+			{
+			delete block;
+			block = nullptr;
+			}
+		else
+			{
+			address = ((uintptr_t) block->memory + STATS_CACHE_LINE - 1) & ~(uintptr_t) (STATS_CACHE_LINE - 1);
+			block->counters = (TA_API_COUNTERS *) address;
+
+			for (uint32_t api = 0; api < TA_stats_api_count; api++)
+				{
+				new (&block->counters [api]) TA_API_COUNTERS ();
+				}
+
+			block->owned.store (true, std::memory_order_relaxed);
+			TA_stats_blocks_allocated++;
+			first = TA_stats_blocks.load (std::memory_order_relaxed);
+
+			do
+				{
+				block->next = first;
+				}
+			while (!TA_stats_blocks.compare_exchange_weak (first, block, std::memory_order_release, std::memory_order_relaxed));
+			}
+		}
+
+	TA_stats_owner.block = block;
+
+#ifdef _WIN32
+	SetLastError (last_error);
+#endif
+	return block;
+}							// End routine block_claim
+
+
+static
+inline
+uint32_t
+bucket_of												// Find the histogram bucket of a call time
+	(
+	uint64_t	Ticks									// Call time
+	)
+
+//
+// DESCRIPTION:		Return the number of significant bits in Ticks (0 for 0), limited to the last bucket. This is a binary search
+//					rather than a bit-scan intrinsic, so that it is the same on every compiler and platform
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Bucket number
+//
+
+{
+uint32_t	bits = 0;
+
+
+	for (uint32_t shift = 32; shift != 0; shift >>= 1)
+		{
+		if (Ticks >> shift)
+			{
+			Ticks >>= shift;
+			bits += shift;
+			}
+		}
+
+	bits += (uint32_t) Ticks;
+	return bits < TA_STATS_BUCKETS ? bits : TA_STATS_BUCKETS - 1;
+}							// End routine bucket_of
+
+
+static
+inline
+void
+bump													// Add to a counter that only the calling thread writes
+	(
+	std::atomic<uint64_t>&	Counter,					// Counter
+	uint64_t				Value						// Amount to add
+	)
+
+//
+// DESCRIPTION:		A relaxed load and store, which compiles to a plain add. No interlocked operation is needed, because the
+//					owning thread is the only writer; readers see either the old or the new value
+//
+// ASSUMPTIONS:		Called by the thread that owns the counter
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	Counter.store (Counter.load (std::memory_order_relaxed) + Value, std::memory_order_relaxed);
+}							// End routine bump
@@ -0,0 +1,150 @@
+//
+// FACILITY:	Stats - Per-API call counters and latency histograms
+//
+// DESCRIPTION:	In statistics mode, an intercept writes no events. It times the call to the real API, and adds the call to its
+//				thread's counters for the API: the number of calls, the total and longest times, and a histogram of the times with
+//				one bucket per power of 2 ticks. Each thread has its own counters, and each API's counters take whole cache lines,
+//				so the intercepts never share a cache line or take a lock. Stats::get adds up the threads' counters for an API
+//				whenever it is called; the counters of a thread that has exited are folded into a total that get also adds.
+//
+//				Like Capture, this module uses only standard C++, so that it can be tested on Linux
+//
+// VERSION:		1.0
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <atomic>
+#include <cstdint>
+
+//
+// Project includes
+//
+
+#include "Capture.h"
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_STATS_BUCKETS		32						// Histogram buckets. Bucket 0 counts calls of 0 ticks, bucket b (b > 0)
+														// calls of 2^(b-1) to 2^b - 1 ticks, and the last bucket everything longer
+
+//
+// TYPES:
+//
+
+//
+// The counters of one API, added up over the threads
+//
+
+typedef struct _TA_API_STATS
+	{
+	uint64_t		calls;								// Calls timed
+	uint64_t		ticks;								// Total time in the real API (see Capture::tick_frequency)
+	uint64_t		max_ticks;							// Longest call
+	uint64_t		buckets [TA_STATS_BUCKETS];			// Histogram of the call times
+	} TA_API_STATS, *PTA_API_STATS;
+
+//
+// DECLARATIONS:
+//
+
+class Stats
+{
+public:
+
+	//
+	// Public methods
+	//
+
+	static
+	bool
+	start												// Start counting calls
+		(
+		_In_	uint32_t	Api_count					// Number of APIs (API numbers are 0 to Api_count - 1)
+		);
+
+	static
+	void
+	stop												// Stop counting calls (the counts are kept)
+		(
+		);
+
+	static
+	inline
+	bool
+	enabled												// Determine whether intercepts should count their calls
+		(
+		)
+		{
+		return stats_enabled.load (std::memory_order_relaxed);
+		}
+
+	static
+	inline
+	uint64_t
+	call_begin											// Read the clock before calling the real API
+		(
+		)
+		{
+		return Capture::timestamp ();
+		}
+
+	static
+	void
+	call_end											// Count a call to the real API
+		(
+		_In_	uint32_t	Api,						// API number
+		_In_	uint64_t	Begin						// Value returned by call_begin
+		);
+
+	static
+	bool
+	get													// Add up the counters of an API over the threads
+		(
+		_In_	uint32_t		Api,					// API number
+		_Out_	TA_API_STATS&	Api_stats				// Counters
+		);
+
+	static
+	uint64_t
+	percentile											// Estimate a percentile of the call times
+		(
+		_In_	const TA_API_STATS&	Api_stats,			// Counters returned by get
+		_In_	uint32_t			Percent				// 1 to 100
+		);
+
+	static
+	uint32_t
+	blocks												// Number of per-thread counter blocks allocated
+		(
+		);
+
+private:
+
+	static std::atomic<bool>	stats_enabled;			// Read by every intercept
+
+};	// End class Stats
+
+}	// End of namespace FDI
@@ -0,0 +1,400 @@
+//
+// FACILITY:	Thunk - Table-driven generic intercepts
+//
+// DESCRIPTION:	By default, AutoGen expands a complete intercept (my_<Api>) for every API, so the size of the DLL, and the
+//				instruction cache it takes, grow with the number of APIs. With /COMPACT, AutoGen instead generates a small record
+//				for each API (TA_THUNK_INFO: the number and types of its arguments, and its name), and a table of pointers to the
+//				real APIs (TA_thunk_real), and points each Detour at Thunk::entry. entry is instantiated for each API, but does
+//				nothing except add the API number to the arguments and call Thunk::call, which is instantiated once for each
+//				signature shape (return type and argument types) and does what the expanded intercept does. The code that builds
+//				the events (write_pre and write_post) is the same for every shape, and reads the API's record for the types; it
+//				is inlined into each call, as calling it costs more per call than the few hundred bytes it saves.
+//
+//				Compared with the expanded intercepts, an API's events differ in that:
+//
+//					- The pre-call event holds every argument as a raw value (TA_thunk_trace formats them as an array), and the
+//					  first string argument as text
+//					- The post-call event holds only the return value and the last error status: no output parameters or
+//					  buffer snapshots
+//					- In capture mode, the pre-call record has no stack ID (see StackTable.h): the thunk would have to pass the
+//					  caller's return address from entry to call, which costs every call an argument
+//
+//				Like Capture, this header uses only standard C++, so that it can be tested on Linux. The tables and
+//				TA_thunk_trace are generated; nothing here is used unless they are
+//
+// VERSION:		1.1
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Note that thunks capture no stacks
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstdint>
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#endif
+
+//
+// Project includes
+//
+
+#include "Capture.h"
+#include "Intercept.h"
+#include "Policy.h"
+#include "Stats.h"
+#include "TraceFormat.h"
+
+//
+// MACROS:
+//
+
+#ifdef _WIN32
+#define	TA_THUNK_API			WINAPI					// Calling convention of the APIs
+#define	TA_THUNK_NOINLINE		__declspec (noinline)	// Keep a routine out of its callers
+#define	TA_THUNK_INLINE			__forceinline			// Put a routine in each of its callers
+#define	TA_THUNK_LAST_ERROR()	((uint32_t) GetLastError ())
+#else
+#define	TA_THUNK_API
+#define	TA_THUNK_NOINLINE		__attribute__ ((noinline))
+#define	TA_THUNK_INLINE			inline __attribute__ ((always_inline))
+#define	TA_THUNK_LAST_ERROR()	((uint32_t) errno)
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_THUNK_MAX_ARGS		12						// Arguments whose types a TA_THUNK_INFO holds (more are captured untyped)
+
+//
+// TYPES:
+//
+
+//
+// The record AutoGen generates for each API, indexed by API number
+//
+
+typedef struct _TA_THUNK_INFO
+	{
+	uint16_t			name_id;						// Index of the API's name in TA_api_schema
+	uint8_t				arg_count;						// Number of arguments
+	TA_PARAM_TYPES		ret_type;						// TA_PT_xxx of the return value (TA_PT_END if it returns nothing)
+	TA_PARAM_TYPES		arg_types [TA_THUNK_MAX_ARGS];	// TA_PT_xxx of each argument, classified as in the schema
+	} TA_THUNK_INFO, *PTA_THUNK_INFO;
+
+static_assert (sizeof (TA_THUNK_INFO) == 16, "TA_THUNK_INFO is 16 bytes, so four fit in a cache line");
+
+}	// End of namespace FDI
+
+//
+// DECLARATIONS:
+//
+
+extern void						*TA_thunk_real [];		// The real APIs, indexed by API number; Detours points them at the trampolines (generated)
+extern const FDI::TA_THUNK_INFO	TA_thunk_info [];		// Arguments of the APIs, indexed by API number (generated)
+
+extern
+void
+TA_thunk_trace											// Write an event of an API to ETW (generated)
+	(
+	uint8_t				Kind,							// TA_REC_PRE or TA_REC_POST
+	uint32_t			Api,							// API number
+	const uint64_t		*Values,						// Arguments, or the return value and last error status
+	uint32_t			Count							// Number of values
+	);
+
+namespace FDI		// Five Directions Inc
+{
+
+class Thunk
+{
+public:
+
+	//
+	// Public methods
+	//
+
+	template <uint32_t Api, typename R, typename... A>
+	static
+	R
+	TA_THUNK_API
+	entry												// Intercept of an API that returns a value (the Detour points here)
+		(
+		A...	Args									// The call's arguments
+		)
+		{
+		return call<R, A...> (Args..., Api);
+		}
+
+	template <uint32_t Api, typename... A>
+	static
+	void
+	TA_THUNK_API
+	entry_void											// Intercept of an API that returns nothing
+		(
+		A...	Args									// The call's arguments
+		)
+		{
+		call_void<A...> (Args..., Api);
+		}
+
+	//
+	// The generated code points an API's Detour at entry_of<n> (&Api), so that the argument and return types are the API's
+	// own declaration, and AutoGen does not have to spell them out
+	//
+
+	template <uint32_t Api, typename R, typename... A>
+	static
+	constexpr
+	auto
+	entry_of											// The entry of an API that returns a value
+		(
+		R	(TA_THUNK_API *) (A...)						// The API (only its type is used)
+		) -> R (TA_THUNK_API *) (A...)
+		{
+		return entry<Api, R, A...>;
+		}
+
+	template <uint32_t Api, typename... A>
+	static
+	constexpr
+	auto
+	entry_of											// The entry of an API that returns nothing
+		(
+		void	(TA_THUNK_API *) (A...)					// The API (only its type is used)
+		) -> void (TA_THUNK_API *) (A...)
+		{
+		return entry_void<Api, A...>;
+		}
+
+	template <typename R, typename... A>
+	static
+	TA_THUNK_NOINLINE
+	R
+	call												// Body of the intercepts of every API of one shape
+		(
+		A...		Args,								// The call's arguments
+		uint32_t	Api									// API number
+		)
+		{
+		typedef R (TA_THUNK_API *REAL_API) (A...);
+
+		REAL_API	real_api = (REAL_API) TA_thunk_real [Api];
+		uint64_t	post [2];
+		uint64_t	begin;
+		R			ret_value;
+
+
+		//
+		// The same steps as the expanded intercept: nested calls and disabled APIs, statistics mode, and the API's policy go
+		// straight to the real API
+		//
+
+		if (!Intercept::enter (Api))
+			{
+			return real_api (Args...);
+			}
+
+		if (Stats::enabled ())
+			{
+			begin = Stats::call_begin ();
+			ret_value = real_api (Args...);
+			Stats::call_end (Api, begin);
+			Intercept::leave ();
+			return ret_value;
+			}
+
+		if (!Policy::admit (Api, Args...))
+			{
+			ret_value = real_api (Args...);
+			Intercept::leave ();
+			return ret_value;
+			}
+
+		//
+		// Only now are the arguments copied into an array, for write_pre, which is shared by every API
+		//
+
+		{
+		uint64_t	values [sizeof... (A) + 1] = {raw (Args)...};
+
+		write_pre (Api, values, sizeof... (A));
+		}
+
+		ret_value = real_api (Args...);
+		post [1] = TA_THUNK_LAST_ERROR ();
+		post [0] = raw (ret_value);
+		write_post (Api, post, 2);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	template <typename... A>
+	static
+	TA_THUNK_NOINLINE
+	void
+	call_void											// Body of the intercepts of every API of one shape that returns nothing
+		(
+		A...		Args,								// The call's arguments
+		uint32_t	Api									// API number
+		)
+		{
+		typedef void (TA_THUNK_API *REAL_API) (A...);
+
+		REAL_API	real_api = (REAL_API) TA_thunk_real [Api];
+		uint64_t	begin;
+
+
+		if (!Intercept::enter (Api))
+			{
+			real_api (Args...);
+			return;
+			}
+
+		if (Stats::enabled ())
+			{
+			begin = Stats::call_begin ();
+			real_api (Args...);
+			Stats::call_end (Api, begin);
+			}
+		else if (!Policy::admit (Api, Args...))
+			{
+			real_api (Args...);
+			}
+		else
+			{
+			uint64_t	values [sizeof... (A) + 1] = {raw (Args)...};
+
+			write_pre (Api, values, sizeof... (A));
+			real_api (Args...);
+			write_post (Api, values, 0);
+			}
+
+		Intercept::leave ();
+		}
+
+private:
+
+	template <typename T>
+	static
+	inline
+	uint64_t
+	raw													// Raw value of an argument (at most 8 bytes of it), as Capture::add_arg stores it
+		(
+		const T&	Value								// Argument
+		)
+		{
+		uint64_t	value = 0;
+
+
+		memcpy (&value, &Value, sizeof (T) < sizeof (value) ? sizeof (T) : sizeof (value));
+		return value;
+		}
+
+	static
+	TA_THUNK_INLINE
+	void
+	write_pre											// Write the pre-call event of any API
+		(
+		uint32_t			Api,						// API number
+		const uint64_t		*Values,					// Arguments
+		uint32_t			Count						// Number of arguments
+		)
+		{
+		const TA_THUNK_INFO	*info = &TA_thunk_info [Api];
+		TA_RECORD			*rec;
+		uint32_t			i;
+
+
+		if (!Capture::enabled ())
+			{
+			TA_thunk_trace (TA_REC_PRE, Api, Values, Count);
+			return;
+			}
+
+		if ((rec = Capture::begin_record (TA_REC_PRE, (uint16_t) Api)) == nullptr)
+			{
+			return;
+			}
+
+		for (i = 0; i < Count; i++)
+			{
+			Capture::add_arg (rec, Values [i]);
+			}
+
+		//
+		// The first string argument is also stored as text
+		//
+
+		for (i = 0; i < Count && i < TA_THUNK_MAX_ARGS; i++)
+			{
+			if (info->arg_types [i] == TA_PT_WSTRZ)
+				{
+				Capture::set_text (rec, (const wchar_t *) (uintptr_t) Values [i]);
+				break;
+				}
+
+			if (info->arg_types [i] == TA_PT_ASCIZ)
+				{
+				Capture::set_text (rec, (const char *) (uintptr_t) Values [i]);
+				break;
+				}
+			}
+
+		Capture::commit_record (rec);
+		}
+
+	static
+	TA_THUNK_INLINE
+	void
+	write_post											// Write the post-call event of any API
+		(
+		uint32_t			Api,						// API number
+		const uint64_t		*Values,					// Return value and last error status
+		uint32_t			Count						// 2, or 0 if the API returns nothing
+		)
+		{
+		TA_RECORD			*rec;
+
+
+		if (!Capture::enabled ())
+			{
+			TA_thunk_trace (TA_REC_POST, Api, Values, Count);
+			}
+		else if ((rec = Capture::begin_record (TA_REC_POST, (uint16_t) Api)) != nullptr)
+			{
+			for (uint32_t i = 0; i < Count; i++)
+				{
+				Capture::add_arg (rec, Values [i]);
+				}
+
+			Capture::commit_record (rec);
+			}
+		}
+
+};	// End class Thunk
+
+}	// End of namespace FDI
@@ -27,7 +27,7 @@
 //					SetEndOfFile
 //					WriteFile
 //
-// VERSION:		1.1
+// VERSION:		1.11
 //
 // AUTHOR:		Brian Catlin
 //
@@ -35,6 +35,42 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.11	2026-10-17	Brian Catlin
+//			Add all the threads of the process, not only the calling thread, to each Detours transaction, because
+//			staged attach and the control channel attach and detach APIs while the program is running
+//
+//	1.10	2026-10-17	Brian Catlin
+//			In capture mode, store the ID of the caller's stack (see StackTable.h) in the pre-call record
+//
+//	1.9		2026-10-17	Brian Catlin
+//			With /COMPACT, point each Detour at a table-driven thunk (see Thunk.h) instead of generating an intercept for each
+//			API, and generate the tables that the thunks read (TA_thunk_real and TA_thunk_info) and TA_thunk_trace
+//
+//	1.8		2026-10-17	Brian Catlin
+//			Replace the lists of ATTACH and DETACH lines with a table of the Detours (TA_detours), indexed by API number, so
+//			that staged attach (see Attach.h) can attach and detach any list of APIs
+//
+//	1.7		2026-10-17	Brian Catlin
+//			Capture the first bytes of the buffer parameters that have a capture rule (see capture_rules in Code_Gen.cs): copied into
+//			the ring in capture mode, and passed to TraceLoggingBinary otherwise
+//
+//	1.6		2026-10-17	Brian Catlin
+//			Apply the API's sampling and rate limiting policy (see Policy.h) before building any event
+//
+//	1.5		2026-10-17	Brian Catlin
+//			In statistics mode (see Stats.h), time the real API and count the call instead of writing events
+//
+//	1.4		2026-10-17	Brian Catlin
+//			Identify each capture record by API number, and generate the schema (TA_api_schema) that the capture file sink writes
+//			at the start of a trace file
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Guard each intercept with Intercept::enter, so that nested calls and disabled APIs go straight to the real API
+//
+//	1.2		2026-10-17	Brian Catlin
+//			In capture mode (see Capture.h), write the pre-call and post-call entries to the calling thread's ring buffer instead of
+//			calling TraceLoggingWrite
+//
 //	1.1		2020-04-19	Brian Catlin
 //			Support new heuristics that detect parameter data type with appropriate TraceLoggingXxx macro invocations in the trace_input_params and
 //			trace_output_params string templates
@@ -57,9 +93,11 @@
 #include <ntstatus.h>
 #include <TraceLoggingProvider.h>
 #include <evntprov.h>
+#include <TlHelp32.h>
 
 #include <string>
 #include <list>
+#include <vector>
 
 //
 // Includes for APIs being Detoured
@@ -74,6 +112,11 @@
 #include "detours.h"
 
 #include "TraceAPI.h"
+#include "Capture.h"
+#include "Intercept.h"
+#include "Stats.h"
+#include "Policy.h"
+#include "StackTable.h"
 #include "..\Global\Utils.h"
 #include "..\Global\WPP_Tracing.h"
 #include "Version.h"
@@ -94,8 +137,7 @@ using namespace FDI;
 // MACROS:
 //
 
-#define ATTACH(x)       det_attach (&(PVOID&) real_##x, my_##x, #x)
-#define DETACH(x)       det_detach (&(PVOID&) real_##x, my_##x, #x)
+#define DETOUR(x)       {&(PVOID&) real_##x, (PVOID) my_##x, #x}
 
 //
 // DEFINITIONS:
@@ -211,18 +253,169 @@ BOOL
 
 }	// extern "C"
 
+//
+// Parameters of each intercepted API: the pre-call parameters, then the post-call return value, last error status, and
+// output parameters, in the order that the intercept captures them
+//
+
+static const TA_PARAM_SCHEMA	TA_CreateFileW_params [] =
+	{
+	{"lpFileName", TA_PT_WSTRZ},
+	{"dwDesiredAccess", TA_PT_SCALAR},
+	{"dwShareMode", TA_PT_SCALAR},
+	{"lpSecurityAttributes", TA_PT_POINTER},
+	{"dwCreationDisposition", TA_PT_SCALAR},
+	{"dwFlagsAndAttributes", TA_PT_SCALAR},
+	{"hTemplateFile", TA_PT_SCALAR},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_DeleteFileW_params [] =
+	{
+	{"lpFileName", TA_PT_WSTRZ},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_FindClose_params [] =
+	{
+	{"hFindFile", TA_PT_SCALAR},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_FindFirstFileW_params [] =
+	{
+	{"lpFileName", TA_PT_WSTRZ},
+	{"lpFindFileData", TA_PT_POINTER},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_GetFileAttributesExW_params [] =
+	{
+	{"lpFileName", TA_PT_WSTRZ},
+	{"fInfoLevelId", TA_PT_ENUM},
+	{"lpFileInformation", TA_PT_POINTER},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_GetFileAttributesW_params [] =
+	{
+	{"lpFileName", TA_PT_WSTRZ},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_GetFileInformationByHandle_params [] =
+	{
+	{"hFile", TA_PT_SCALAR},
+	{"lpFileInformation", TA_PT_POINTER},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_GetFullPathNameW_params [] =
+	{
+	{"lpFileName", TA_PT_WSTRZ},
+	{"nBufferLength", TA_PT_SCALAR},
+	{"lpBuffer", TA_PT_WSTRZ},
+	{"lpFilePart", TA_PT_POINTER},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_ReadFile_params [] =
+	{
+	{"hFile", TA_PT_SCALAR},
+	{"lpBuffer", TA_PT_POINTER},
+	{"nNumberOfBytesToRead", TA_PT_SCALAR},
+	{"lpNumberOfBytesRead", TA_PT_POINTER},
+	{"lpOverlapped", TA_PT_POINTER},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_SetEndOfFile_params [] =
+	{
+	{"hFile", TA_PT_SCALAR},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+static const TA_PARAM_SCHEMA	TA_WriteFile_params [] =
+	{
+	{"hFile", TA_PT_SCALAR},
+	{"lpBuffer", TA_PT_POINTER},
+	{"nNumberOfBytesToWrite", TA_PT_SCALAR},
+	{"lpNumberOfBytesWritten", TA_PT_POINTER},
+	{"lpOverlapped", TA_PT_POINTER},
+	{nullptr, TA_PT_END},
+	{"Return value", TA_PT_SCALAR},
+	{"Last error status", TA_PT_SCALAR},
+	{nullptr, TA_PT_END}
+	};
+
+//
+// Schema of the intercepted APIs, indexed by the API number that each intercept passes to Intercept::enter and
+// Capture::begin_record
+//
+
+extern const TA_API_SCHEMA	TA_api_schema [] =
+	{
+	{"CreateFileW", TA_CreateFileW_params},
+	{"DeleteFileW", TA_DeleteFileW_params},
+	{"FindClose", TA_FindClose_params},
+	{"FindFirstFileW", TA_FindFirstFileW_params},
+	{"GetFileAttributesExW", TA_GetFileAttributesExW_params},
+	{"GetFileAttributesW", TA_GetFileAttributesW_params},
+	{"GetFileInformationByHandle", TA_GetFileInformationByHandle_params},
+	{"GetFullPathNameW", TA_GetFullPathNameW_params},
+	{"ReadFile", TA_ReadFile_params},
+	{"SetEndOfFile", TA_SetEndOfFile_params},
+	{"WriteFile", TA_WriteFile_params}
+	};
+
+extern const ULONG	TA_api_count = ARRAYSIZE (TA_api_schema);
+
 //
 // FORWARD ROUTINES:
 //
 
 NTSTATUS 
-attach_detours										// Intercept the APIs
+attach_detours										// Intercept a list of APIs
 	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
 	);
 
 NTSTATUS
-detach_detours										// Stop intercepting the APIs
+detach_detours										// Stop intercepting a list of APIs
 	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
 	);
 
 //
@@ -326,16 +519,126 @@ my_WriteFile
 	 LPOVERLAPPED  lpOverlapped
 	);
 
-NTSTATUS 
-attach_detours										// Intercept the APIs
+//
+// The Detours, indexed by API number. Detours changes each real_ pointer to point at the trampoline
+//
+
+static const TA_DETOUR	TA_detours [] =
+	{
+	DETOUR (CreateFileW),
+	DETOUR (DeleteFileW),
+	DETOUR (FindClose),
+	DETOUR (FindFirstFileW),
+	DETOUR (GetFileAttributesExW),
+	DETOUR (GetFileAttributesW),
+	DETOUR (GetFileInformationByHandle),
+	DETOUR (GetFullPathNameW),
+	DETOUR (ReadFile),
+	DETOUR (SetEndOfFile),
+	DETOUR (WriteFile)
+	};
+
+
+static void
+update_threads										// Add the process's threads to a Detours transaction
 	(
+	_Inout_	std::vector<HANDLE>&	Threads			// Handles of the threads, for close_threads
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Add every thread of the process other than the calling one to the transaction, so that Detours suspends
+//					them and moves any instruction pointer that is in the code being patched. The worker thread of staged
+//					attach and the control channel's thread run transactions while the program's threads are running
+//
+// ASSUMPTIONS:		User mode. A Detours transaction has been begun
+//
+// SIDE EFFECTS:	The threads are suspended until the transaction is committed
+//
+// RETURN VALUES:	None
+//
+
+{
+HANDLE			snapshot;
+HANDLE			thread;
+THREADENTRY32	entry;
+DWORD			process_id = GetCurrentProcessId ();
+DWORD			thread_id = GetCurrentThreadId ();
+BOOL			more;
+
+
+	DetourUpdateThread (GetCurrentThread ());
+
+	if ((snapshot = CreateToolhelp32Snapshot (TH32CS_SNAPTHREAD, 0)) == INVALID_HANDLE_VALUE)
+		{
+		TRACE_WARN (TRACEAPI, "Error taking a snapshot of the threads, error = %lu", GetLastError ());
+		return;
+		}
+
+	entry.dwSize = sizeof (entry);
+
+	for (more = Thread32First (snapshot, &entry); more; more = Thread32Next (snapshot, &entry))
+		{
+		//
+		// Skip the threads of other processes, and this one. A thread that has exited since the snapshot cannot be opened
+		//
+
+		if (entry.th32OwnerProcessID != process_id || entry.th32ThreadID == thread_id)
+			{
+			continue;
+			}
+
+		if ((thread = OpenThread (THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT, FALSE, entry.th32ThreadID)) == NULL)
+			{
+			continue;
+			}
+
+		Threads.push_back (thread);
+		DetourUpdateThread (thread);
+		}
+
+	CloseHandle (snapshot);
+}							// End update_threads
+
+
+static void
+close_threads										// Close the handles of the threads added to a Detours transaction
+	(
+	_Inout_	std::vector<HANDLE>&	Threads			// Handles from update_threads
+	)
+
+//
+// DESCRIPTION:		Close the handles, after the transaction has been committed and Detours has resumed the threads
 //
 // ASSUMPTIONS:		User mode
 //
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:	None
+//
+
+{
+	for (HANDLE thread : Threads)
+		{
+		CloseHandle (thread);
+		}
+
+	Threads.clear ();
+}							// End close_threads
+
+
+NTSTATUS 
+attach_detours										// Intercept a list of APIs
+	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
+	)
+
+//
+// DESCRIPTION:		Attach the Detours of the APIs, in one Detours transaction. Staged attach (see Attach.h) calls this for the
+//					core set of APIs, and for each later batch
+//
+// ASSUMPTIONS:		User mode. Not called by two threads at once
+//
 // SIDE EFFECTS:
 //
 // RETURN VALUES:
@@ -344,40 +647,45 @@ attach_detours										// Intercept the APIs
 
 {
 NTSTATUS	status;
+DETOUR_COMMIT_STATS	stats;
+std::vector<HANDLE>	threads;
+uint32_t	i;
 
 
 	TRACE_ENTER ();
 
 	//
 	// Tell Detours that we're starting a transaction to update the list of detours
+	// as a bulk commit, which changes the page protection once per range of pages
+	// rather than once per detour
+	// and suspends all the other threads of the process
 	//
 
+	DetourSetBulkCommit (TRUE);
 	DetourTransactionBegin ();
-	DetourUpdateThread (GetCurrentThread ());
+	update_threads (threads);
 
 	//
-	// List all the Detours to install
-	//
-	// NOTE: This list MUST match the list in detach_detours
+	// Attach the Detours of the listed APIs
 	//
 
-	ATTACH (CreateFileW);
-	ATTACH (DeleteFileW);
-	ATTACH (FindClose);
-	ATTACH (FindFirstFileW);
-	ATTACH (GetFileAttributesExW);
-	ATTACH (GetFileAttributesW);
-	ATTACH (GetFileInformationByHandle);
-	ATTACH (GetFullPathNameW);
-	ATTACH (ReadFile);
-	ATTACH (SetEndOfFile);
-	ATTACH (WriteFile);
+	for (i = 0; i < Count; i++)
+		{
+		det_attach (TA_detours [Apis [i]].real_api, TA_detours [Apis [i]].my_api, TA_detours [Apis [i]].name);
+		}
 
 	//
 	// Tell Detours that we're done updating detours
 	//
 
 	status = DetourTransactionCommit ();
+	close_threads (threads);
+
+	if (DetourGetCommitStats (&stats))
+		{
+		TRACE_INFO (TRACEAPI, "Attach: %lu detours, %lu page ranges, %lu protection calls, %lu usec, status = %d",
+			stats.cOperations, stats.cRanges, stats.cProtectCalls, stats.cMicroseconds, status);
+		}
 
 	TRACE_EXIT ();
 	return status;
@@ -385,14 +693,17 @@ NTSTATUS	status;
 
 
 NTSTATUS
-detach_detours										// Stop intercepting the APIs
+detach_detours										// Stop intercepting a list of APIs
 	(
+	_In_	const uint32_t	*Apis,					// API numbers
+	_In_	uint32_t		Count					// Number of APIs
 	)
 
 //
-// DESCRIPTION:		
+// DESCRIPTION:		Detach the Detours of the APIs, in one Detours transaction. The list is the APIs that staged attach
+//					attached (Attach::attached)
 //
-// ASSUMPTIONS:		User mode
+// ASSUMPTIONS:		User mode. Staged attach has been stopped
 //
 // SIDE EFFECTS:
 //
@@ -402,40 +713,43 @@ detach_detours										// Stop intercepting the APIs
 
 {
 NTSTATUS	status;
+DETOUR_COMMIT_STATS	stats;
+std::vector<HANDLE>	threads;
+uint32_t	i;
 
 
 	TRACE_ENTER ();
 
 	//
-	// Tell Detours that we're starting a transaction to update the list of detours
+	// Tell Detours that we're starting a transaction to update the list of detours,
+	// which suspends all the other threads of the process
 	//
 
+	DetourSetBulkCommit (TRUE);
 	DetourTransactionBegin ();
-	DetourUpdateThread (GetCurrentThread ());
+	update_threads (threads);
 
 	//
-	// List all the detours to remove
-	//
-	// NOTE: This list MUST match the list in attach_detours
+	// Remove the Detours of the listed APIs
 	//
 
-	DETACH (CreateFileW);
-	DETACH (DeleteFileW);
-	DETACH (FindClose);
-	DETACH (FindFirstFileW);
-	DETACH (GetFileAttributesExW);
-	DETACH (GetFileAttributesW);
-	DETACH (GetFileInformationByHandle);
-	DETACH (GetFullPathNameW);
-	DETACH (ReadFile);
-	DETACH (SetEndOfFile);
-	DETACH (WriteFile);
+	for (i = 0; i < Count; i++)
+		{
+		det_detach (TA_detours [Apis [i]].real_api, TA_detours [Apis [i]].my_api, TA_detours [Apis [i]].name);
+		}
 
 	//
 	// Tell Detours that we're done updating detours
 	//
 
 	status = DetourTransactionCommit ();
+	close_threads (threads);
+
+	if (DetourGetCommitStats (&stats))
+		{
+		TRACE_INFO (TRACEAPI, "Detach: %lu detours, %lu page ranges, %lu protection calls, %lu usec, status = %d",
+			stats.cOperations, stats.cRanges, stats.cProtectCalls, stats.cMicroseconds, status);
+		}
 
 	TRACE_EXIT ();
 	return status;
@@ -456,23 +770,80 @@ my_CreateFileW
 {
 NTSTATUS	status;
 HANDLE		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("CreateFileW", "API"),
-		TraceLoggingWideString (lpFileName, "lpFileName"),
-		TraceLoggingValue (dwDesiredAccess, "dwDesiredAccess"),
-		TraceLoggingValue (dwShareMode, "dwShareMode"),
-		TraceLoggingPointer ((LPCVOID) lpSecurityAttributes, "lpSecurityAttributes"),
-		TraceLoggingValue (dwCreationDisposition, "dwCreationDisposition"),
-		TraceLoggingValue (dwFlagsAndAttributes, "dwFlagsAndAttributes"),
-		TraceLoggingValue (hTemplateFile, "hTemplateFile")
-		);
+	if (!Intercept::enter (0))
+		{
+		return real_CreateFileW (lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_CreateFileW (lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+		Stats::call_end (0, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (0, lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile))
+		{
+		ret_value = real_CreateFileW (lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 0)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, lpFileName);
+			Capture::set_text (rec, lpFileName);
+			Capture::add_arg (rec, dwDesiredAccess);
+			Capture::add_arg (rec, dwShareMode);
+			Capture::add_arg (rec, lpSecurityAttributes);
+			Capture::add_arg (rec, dwCreationDisposition);
+			Capture::add_arg (rec, dwFlagsAndAttributes);
+			Capture::add_arg (rec, hTemplateFile);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("CreateFileW", "API"),
+			TraceLoggingWideString (lpFileName, "lpFileName"),
+			TraceLoggingValue (dwDesiredAccess, "dwDesiredAccess"),
+			TraceLoggingValue (dwShareMode, "dwShareMode"),
+			TraceLoggingPointer ((LPCVOID) lpSecurityAttributes, "lpSecurityAttributes"),
+			TraceLoggingValue (dwCreationDisposition, "dwCreationDisposition"),
+			TraceLoggingValue (dwFlagsAndAttributes, "dwFlagsAndAttributes"),
+			TraceLoggingValue (hTemplateFile, "hTemplateFile")
+			);
+		}
 
 	//
 	// Call the real API
@@ -493,13 +864,26 @@ HANDLE		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("CreateFileW", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 0)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("CreateFileW", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_CreateFileW
 
@@ -513,17 +897,68 @@ my_DeleteFileW
 {
 NTSTATUS	status;
 BOOL		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("DeleteFileW", "API"),
-		TraceLoggingWideString (lpFileName, "lpFileName")
-		);
+	if (!Intercept::enter (1))
+		{
+		return real_DeleteFileW (lpFileName);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_DeleteFileW (lpFileName);
+		Stats::call_end (1, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (1, lpFileName))
+		{
+		ret_value = real_DeleteFileW (lpFileName);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 1)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, lpFileName);
+			Capture::set_text (rec, lpFileName);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("DeleteFileW", "API"),
+			TraceLoggingWideString (lpFileName, "lpFileName")
+			);
+		}
 
 	//
 	// Call the real API
@@ -538,13 +973,26 @@ BOOL		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("DeleteFileW", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 1)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("DeleteFileW", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_DeleteFileW
 
@@ -558,17 +1006,67 @@ my_FindClose
 {
 NTSTATUS	status;
 BOOL		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("FindClose", "API"),
-		TraceLoggingValue (hFindFile, "hFindFile")
-		);
+	if (!Intercept::enter (2))
+		{
+		return real_FindClose (hFindFile);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_FindClose (hFindFile);
+		Stats::call_end (2, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (2, hFindFile))
+		{
+		ret_value = real_FindClose (hFindFile);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 2)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, hFindFile);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("FindClose", "API"),
+			TraceLoggingValue (hFindFile, "hFindFile")
+			);
+		}
 
 	//
 	// Call the real API
@@ -583,13 +1081,26 @@ BOOL		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("FindClose", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 2)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("FindClose", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_FindClose
 
@@ -604,18 +1115,70 @@ my_FindFirstFileW
 {
 NTSTATUS	status;
 HANDLE		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("FindFirstFileW", "API"),
-		TraceLoggingWideString (lpFileName, "lpFileName"),
-		TraceLoggingPointer ((LPCVOID) lpFindFileData, "lpFindFileData")
-		);
+	if (!Intercept::enter (3))
+		{
+		return real_FindFirstFileW (lpFileName, lpFindFileData);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_FindFirstFileW (lpFileName, lpFindFileData);
+		Stats::call_end (3, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (3, lpFileName, lpFindFileData))
+		{
+		ret_value = real_FindFirstFileW (lpFileName, lpFindFileData);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 3)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, lpFileName);
+			Capture::set_text (rec, lpFileName);
+			Capture::add_arg (rec, lpFindFileData);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("FindFirstFileW", "API"),
+			TraceLoggingWideString (lpFileName, "lpFileName"),
+			TraceLoggingPointer ((LPCVOID) lpFindFileData, "lpFindFileData")
+			);
+		}
 
 	//
 	// Call the real API
@@ -631,13 +1194,28 @@ HANDLE		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("FindFirstFileW", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 3)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::add_data (rec, 1, lpFindFileData, ret_value != INVALID_HANDLE_VALUE ? sizeof (*lpFindFileData) : 0, sizeof (WIN32_FIND_DATAW));
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("FindFirstFileW", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status"),
+			TraceLoggingBinary (lpFindFileData, Capture::data_length (lpFindFileData, ret_value != INVALID_HANDLE_VALUE ? sizeof (*lpFindFileData) : 0, sizeof (WIN32_FIND_DATAW)), "lpFindFileData data")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_FindFirstFileW
 
@@ -653,19 +1231,72 @@ my_GetFileAttributesExW
 {
 NTSTATUS	status;
 BOOL		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("GetFileAttributesExW", "API"),
-		TraceLoggingWideString (lpFileName, "lpFileName"),
-		TraceLoggingValue ((UINT32) fInfoLevelId, "fInfoLevelId"),
-		TraceLoggingPointer ((LPCVOID) lpFileInformation, "lpFileInformation")
-		);
+	if (!Intercept::enter (4))
+		{
+		return real_GetFileAttributesExW (lpFileName, fInfoLevelId, lpFileInformation);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_GetFileAttributesExW (lpFileName, fInfoLevelId, lpFileInformation);
+		Stats::call_end (4, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (4, lpFileName, fInfoLevelId, lpFileInformation))
+		{
+		ret_value = real_GetFileAttributesExW (lpFileName, fInfoLevelId, lpFileInformation);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 4)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, lpFileName);
+			Capture::set_text (rec, lpFileName);
+			Capture::add_arg (rec, fInfoLevelId);
+			Capture::add_arg (rec, lpFileInformation);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("GetFileAttributesExW", "API"),
+			TraceLoggingWideString (lpFileName, "lpFileName"),
+			TraceLoggingValue ((UINT32) fInfoLevelId, "fInfoLevelId"),
+			TraceLoggingPointer ((LPCVOID) lpFileInformation, "lpFileInformation")
+			);
+		}
 
 	//
 	// Call the real API
@@ -682,13 +1313,28 @@ BOOL		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("GetFileAttributesExW", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 4)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::add_data (rec, 2, lpFileInformation, ret_value && fInfoLevelId == GetFileExInfoStandard ? sizeof (WIN32_FILE_ATTRIBUTE_DATA) : 0, sizeof (WIN32_FILE_ATTRIBUTE_DATA));
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("GetFileAttributesExW", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status"),
+			TraceLoggingBinary (lpFileInformation, Capture::data_length (lpFileInformation, ret_value && fInfoLevelId == GetFileExInfoStandard ? sizeof (WIN32_FILE_ATTRIBUTE_DATA) : 0, sizeof (WIN32_FILE_ATTRIBUTE_DATA)), "lpFileInformation data")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_GetFileAttributesExW
 
@@ -702,17 +1348,68 @@ my_GetFileAttributesW
 {
 NTSTATUS	status;
 DWORD		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("GetFileAttributesW", "API"),
-		TraceLoggingWideString (lpFileName, "lpFileName")
-		);
+	if (!Intercept::enter (5))
+		{
+		return real_GetFileAttributesW (lpFileName);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_GetFileAttributesW (lpFileName);
+		Stats::call_end (5, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (5, lpFileName))
+		{
+		ret_value = real_GetFileAttributesW (lpFileName);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 5)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, lpFileName);
+			Capture::set_text (rec, lpFileName);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("GetFileAttributesW", "API"),
+			TraceLoggingWideString (lpFileName, "lpFileName")
+			);
+		}
 
 	//
 	// Call the real API
@@ -727,13 +1424,26 @@ DWORD		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("GetFileAttributesW", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 5)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("GetFileAttributesW", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_GetFileAttributesW
 
@@ -748,18 +1458,69 @@ my_GetFileInformationByHandle
 {
 NTSTATUS	status;
 BOOL		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("GetFileInformationByHandle", "API"),
-		TraceLoggingValue (hFile, "hFile"),
-		TraceLoggingPointer ((LPCVOID) lpFileInformation, "lpFileInformation")
-		);
+	if (!Intercept::enter (6))
+		{
+		return real_GetFileInformationByHandle (hFile, lpFileInformation);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_GetFileInformationByHandle (hFile, lpFileInformation);
+		Stats::call_end (6, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (6, hFile, lpFileInformation))
+		{
+		ret_value = real_GetFileInformationByHandle (hFile, lpFileInformation);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 6)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, hFile);
+			Capture::add_arg (rec, lpFileInformation);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("GetFileInformationByHandle", "API"),
+			TraceLoggingValue (hFile, "hFile"),
+			TraceLoggingPointer ((LPCVOID) lpFileInformation, "lpFileInformation")
+			);
+		}
 
 	//
 	// Call the real API
@@ -775,13 +1536,28 @@ BOOL		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("GetFileInformationByHandle", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 6)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::add_data (rec, 1, lpFileInformation, ret_value ? sizeof (*lpFileInformation) : 0, sizeof (BY_HANDLE_FILE_INFORMATION));
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("GetFileInformationByHandle", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status"),
+			TraceLoggingBinary (lpFileInformation, Capture::data_length (lpFileInformation, ret_value ? sizeof (*lpFileInformation) : 0, sizeof (BY_HANDLE_FILE_INFORMATION)), "lpFileInformation data")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_GetFileInformationByHandle
 
@@ -798,20 +1574,75 @@ my_GetFullPathNameW
 {
 NTSTATUS	status;
 DWORD		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("GetFullPathNameW", "API"),
-		TraceLoggingWideString (lpFileName, "lpFileName"),
-		TraceLoggingValue (nBufferLength, "nBufferLength"),
-		TraceLoggingWideString (lpBuffer, "lpBuffer"),
-		TraceLoggingPointer ((LPCVOID) lpFilePart, "lpFilePart")
-		);
+	if (!Intercept::enter (7))
+		{
+		return real_GetFullPathNameW (lpFileName, nBufferLength, lpBuffer, lpFilePart);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_GetFullPathNameW (lpFileName, nBufferLength, lpBuffer, lpFilePart);
+		Stats::call_end (7, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (7, lpFileName, nBufferLength, lpBuffer, lpFilePart))
+		{
+		ret_value = real_GetFullPathNameW (lpFileName, nBufferLength, lpBuffer, lpFilePart);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 7)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, lpFileName);
+			Capture::set_text (rec, lpFileName);
+			Capture::add_arg (rec, nBufferLength);
+			Capture::add_arg (rec, lpBuffer);
+			Capture::set_text (rec, lpBuffer);
+			Capture::add_arg (rec, lpFilePart);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("GetFullPathNameW", "API"),
+			TraceLoggingWideString (lpFileName, "lpFileName"),
+			TraceLoggingValue (nBufferLength, "nBufferLength"),
+			TraceLoggingWideString (lpBuffer, "lpBuffer"),
+			TraceLoggingPointer ((LPCVOID) lpFilePart, "lpFilePart")
+			);
+		}
 
 	//
 	// Call the real API
@@ -829,13 +1660,26 @@ DWORD		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("GetFullPathNameW", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 7)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("GetFullPathNameW", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_GetFullPathNameW
 
@@ -853,21 +1697,75 @@ my_ReadFile
 {
 NTSTATUS	status;
 BOOL		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("ReadFile", "API"),
-		TraceLoggingValue (hFile, "hFile"),
-		TraceLoggingPointer ((LPCVOID) lpBuffer, "lpBuffer"),
-		TraceLoggingValue (nNumberOfBytesToRead, "nNumberOfBytesToRead"),
-		TraceLoggingPointer ((LPCVOID) lpNumberOfBytesRead, "lpNumberOfBytesRead"),
-		TraceLoggingPointer ((LPCVOID) lpOverlapped, "lpOverlapped")
-		);
+	if (!Intercept::enter (8))
+		{
+		return real_ReadFile (hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_ReadFile (hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+		Stats::call_end (8, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (8, hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped))
+		{
+		ret_value = real_ReadFile (hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 8)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, hFile);
+			Capture::add_arg (rec, lpBuffer);
+			Capture::add_arg (rec, nNumberOfBytesToRead);
+			Capture::add_arg (rec, lpNumberOfBytesRead);
+			Capture::add_arg (rec, lpOverlapped);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("ReadFile", "API"),
+			TraceLoggingValue (hFile, "hFile"),
+			TraceLoggingPointer ((LPCVOID) lpBuffer, "lpBuffer"),
+			TraceLoggingValue (nNumberOfBytesToRead, "nNumberOfBytesToRead"),
+			TraceLoggingPointer ((LPCVOID) lpNumberOfBytesRead, "lpNumberOfBytesRead"),
+			TraceLoggingPointer ((LPCVOID) lpOverlapped, "lpOverlapped")
+			);
+		}
 
 	//
 	// Call the real API
@@ -886,13 +1784,28 @@ BOOL		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("ReadFile", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 8)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::add_data (rec, 1, lpBuffer, ret_value && lpNumberOfBytesRead != nullptr ? *lpNumberOfBytesRead : 0, 256);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("ReadFile", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status"),
+			TraceLoggingBinary (lpBuffer, Capture::data_length (lpBuffer, ret_value && lpNumberOfBytesRead != nullptr ? *lpNumberOfBytesRead : 0, 256), "lpBuffer data")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_ReadFile
 
@@ -906,17 +1819,67 @@ my_SetEndOfFile
 {
 NTSTATUS	status;
 BOOL		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("SetEndOfFile", "API"),
-		TraceLoggingValue (hFile, "hFile")
-		);
+	if (!Intercept::enter (9))
+		{
+		return real_SetEndOfFile (hFile);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_SetEndOfFile (hFile);
+		Stats::call_end (9, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (9, hFile))
+		{
+		ret_value = real_SetEndOfFile (hFile);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 9)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, hFile);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("SetEndOfFile", "API"),
+			TraceLoggingValue (hFile, "hFile")
+			);
+		}
 
 	//
 	// Call the real API
@@ -931,13 +1894,26 @@ BOOL		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("SetEndOfFile", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 9)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("SetEndOfFile", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_SetEndOfFile
 
@@ -955,21 +1931,77 @@ my_WriteFile
 {
 NTSTATUS	status;
 BOOL		ret_value;
+TA_RECORD	*rec;
+ULONGLONG	begin;
 
 
 	//
-	// Write a pre-call entry to the log with all of the parameters
+	// Nested calls (the logging path, or the real API, called an API that is detoured) and APIs whose events are disabled go
+	// straight to the real API, without building any events
 	//
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_PRE), 
-		TraceLoggingString ("WriteFile", "API"),
-		TraceLoggingValue (hFile, "hFile"),
-		TraceLoggingPointer ((LPCVOID) lpBuffer, "lpBuffer"),
-		TraceLoggingValue (nNumberOfBytesToWrite, "nNumberOfBytesToWrite"),
-		TraceLoggingPointer ((LPCVOID) lpNumberOfBytesWritten, "lpNumberOfBytesWritten"),
-		TraceLoggingPointer ((LPCVOID) lpOverlapped, "lpOverlapped")
-		);
+	if (!Intercept::enter (10))
+		{
+		return real_WriteFile (hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped);
+		}
+
+	//
+	// In statistics mode, time the real API and count the call, without writing any events
+	//
+
+	if (Stats::enabled ())
+		{
+		begin = Stats::call_begin ();
+		ret_value = real_WriteFile (hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped);
+		Stats::call_end (10, begin);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Apply the API's sampling and rate limiting policy (see Policy.h) before building any event. A call that the policy
+	// skips goes straight to the real API
+	//
+
+	if (!Policy::admit (10, hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped))
+		{
+		ret_value = real_WriteFile (hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped);
+		Intercept::leave ();
+		return ret_value;
+		}
+
+	//
+	// Write a pre-call entry to the log with all of the parameters. In capture mode, the entry goes to this thread's ring
+	// instead, with the caller's stack when stacks are captured, and the drain thread writes it to the sink
+	//
+
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_PRE, 10)) != nullptr)
+			{
+			Capture::set_stack (rec, StackTable::capture (TA_RETURN_ADDRESS ()));
+			Capture::add_arg (rec, hFile);
+			Capture::add_arg (rec, lpBuffer);
+			Capture::add_arg (rec, nNumberOfBytesToWrite);
+			Capture::add_arg (rec, lpNumberOfBytesWritten);
+			Capture::add_arg (rec, lpOverlapped);
+			Capture::add_data (rec, 1, lpBuffer, nNumberOfBytesToWrite, 256);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-PRECALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_PRE), 
+			TraceLoggingString ("WriteFile", "API"),
+			TraceLoggingValue (hFile, "hFile"),
+			TraceLoggingPointer ((LPCVOID) lpBuffer, "lpBuffer"),
+			TraceLoggingValue (nNumberOfBytesToWrite, "nNumberOfBytesToWrite"),
+			TraceLoggingPointer ((LPCVOID) lpNumberOfBytesWritten, "lpNumberOfBytesWritten"),
+			TraceLoggingPointer ((LPCVOID) lpOverlapped, "lpOverlapped"),
+			TraceLoggingBinary (lpBuffer, Capture::data_length (lpBuffer, nNumberOfBytesToWrite, 256), "lpBuffer data")
+			);
+		}
 
 	//
 	// Call the real API
@@ -988,12 +2020,25 @@ BOOL		ret_value;
 
 	status = GetLastError ();
 
-	TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
-		TraceLoggingKeyword (TL_KW_TRACE_POST), 
-		TraceLoggingString ("WriteFile", "API"),
-		TraceLoggingValue (ret_value, "Return value"),
-		TraceLoggingUInt32 (status, "Last error status")
-		);
-
+	if (Capture::enabled ())
+		{
+		if ((rec = Capture::begin_record (TA_REC_POST, 10)) != nullptr)
+			{
+			Capture::add_arg (rec, ret_value);
+			Capture::add_arg (rec, status);
+			Capture::commit_record (rec);
+			}
+		}
+	else
+		{
+		TraceLoggingWrite (TA_tlg, "API-Trace-POSTCALL", TraceLoggingOpcode (TL_OPC_TRACE), TraceLoggingLevel (TRACE_LEVEL_INFORMATION),
+			TraceLoggingKeyword (TL_KW_TRACE_POST), 
+			TraceLoggingString ("WriteFile", "API"),
+			TraceLoggingValue (ret_value, "Return value"),
+			TraceLoggingUInt32 (status, "Last error status")
+			);
+		}
+
+	Intercept::leave ();
 	return ret_value;
 }							// End my_WriteFile
\ No newline at end of file
@@ -3,7 +3,7 @@
 //
 // DESCRIPTION:	This DLL is injected into a process by InjectDLL. Its purpose is to intercept specific APIs and log their parameters using ETW
 //
-// VERSION:		1.0
+// VERSION:		1.1
 //
 // AUTHOR:		Brian Catlin
 //
@@ -11,6 +11,9 @@
 //
 // MODIFICATION HISTORY:
 //
+//	1.1		2026-10-17	Brian Catlin
+//			attach_detours and detach_detours take a list of API numbers, and look them up in the generated table of Detours
+//
 //	1.0		2019-11-15	Brian Catlin
 //			Original version
 //
@@ -27,6 +30,8 @@
 // Project includes
 //
 
+#include "TraceFormat.h"
+
 //
 // CONSTANTS:
 //
@@ -52,14 +57,37 @@ enum TL_KEYWORDS : ULONGLONG
 	TL_KW_DLL = 0x0000000000000001,	// Events about DLL loading and unloading
 	TL_KW_TRACE_PRE = 0x0000000000000002,	// Pre-call API traces
 	TL_KW_TRACE_POST = 0x0000000000000004,	// Post-call API traces
+	TL_KW_STATS = 0x0000000000000008,	// API call counters (statistics mode)
 	};
 
 #define TRACE_LEVEL_ALWAYS		0
 
+//
+// Values of the CaptureMode registry parameter
+//
+
+enum TA_CAPTURE_MODES : ULONG
+	{
+	TA_CAPTURE_OFF = 0,						// Each intercept writes its events to ETW itself
+	TA_CAPTURE_ETW,							// Intercepts capture to per-thread rings, and the drain thread writes the events to ETW
+	TA_CAPTURE_FILE,						// Intercepts capture to per-thread rings, and the drain thread writes them to %TEMP%\TraceAPI-<pid>.tac
+	};
+
 //
 // TYPES:
 //
 
+//
+// An entry in the generated table of Detours (TA_detours), indexed by API number
+//
+
+typedef struct _TA_DETOUR
+	{
+	PVOID				*real_api;						// Pointer to the real API (Detours points it at the trampoline)
+	PVOID				my_api;							// Intercept
+	PCCH				name;							// API name
+	} TA_DETOUR, *PTA_DETOUR;
+
 //
 // MACROS:
 //
@@ -75,20 +103,27 @@ enum TL_KEYWORDS : ULONGLONG
 // DECLARATIONS:
 //
 
+extern const FDI::TA_API_SCHEMA	TA_api_schema [];		// Names and parameters of the intercepted APIs, indexed by API number (generated)
+extern const ULONG	TA_api_count;						// Number of intercepted APIs (generated)
+
 //
 // EXTERNAL ROUTINES:
 //
 
 extern
 NTSTATUS
-attach_detours											// Intercept the APIs
+attach_detours											// Intercept a list of APIs
 	(
+	_In_	const uint32_t	*Apis,						// API numbers
+	_In_	uint32_t		Count						// Number of APIs
 	);
 
 extern
 NTSTATUS
-detach_detours											// Stop intercepting the APIs
+detach_detours											// Stop intercepting a list of APIs
 	(
+	_In_	const uint32_t	*Apis,						// API numbers
+	_In_	uint32_t		Count						// Number of APIs
 	);
 
 extern
@@ -0,0 +1,211 @@
+//
+// FACILITY:	TraceFormat - Layout of a TraceAPI trace file
+//
+// DESCRIPTION:	A trace file holds the records of one capture session (see Capture.h) in a compact form. It is written by the
+//				capture file sink and read by TraceReader. The file is:
+//
+//					TA_TRACE_HEADER
+//					Schema			For each of the header's api_count APIs, in API number order:
+//										varint			Length of the API name
+//										char []			API name
+//										Two parameter lists (pre-call, then post-call), each:
+//											uint8_t			Number of parameters
+//											For each parameter:
+//												uint8_t			TA_PT_xxx
+//												varint			Length of the parameter name
+//												char []			Parameter name
+//					Records			Until the end of the file, each:
+//										uint8_t			TA_REC_xxx, plus TA_TRF_xxx flags
+//										varint			API number (16 bits)
+//										varint			Timestamp, zigzag-encoded difference from the previous record's (or
+//														the header's start_timestamp)
+//										varint			Thread ID, if TA_TRF_THREAD is set (otherwise it is the previous
+//														record's)
+//										varint			Stack ID, if TA_TRF_STACK is set (otherwise the call has no stack)
+//										uint8_t			Number of arguments
+//										varint []		Arguments, in the order of the API's parameter list. Each is the raw
+//														value, zero-extended to 64 bits; strings are captured as pointers
+//										varint			Length of the text, in bytes, if TA_TRF_TEXT is set
+//										char []			Text (the first string argument, truncated), UTF-8
+//
+//									A TA_REC_DATA record holds part of the contents of a buffer parameter, from the call of the
+//									TA_REC_PRE or TA_REC_POST record before it. It has the same first four fields, then:
+//										uint8_t			Parameter number (its index in the API's pre-call list)
+//										varint			Offset of these bytes in the buffer
+//										varint			Size of the buffer, before the capture limits were applied
+//										varint			Number of bytes
+//										uint8_t []		Bytes
+//
+//									A TA_REC_STACK record defines a stack ID. It is laid out like a TA_REC_PRE record of API
+//									0 with TA_TRF_STACK set: the stack ID is the one it defines, and the arguments are the
+//									return addresses, innermost first. It is written before, or soon after, the first record
+//									that uses the ID
+//
+//				A varint is the LEB128 encoding of an unsigned value: 7 bits per byte, least significant first, with the high bit
+//				set on every byte but the last. Small values (handles, sizes, statuses, and the differences between timestamps)
+//				take one or two bytes, so a typical record is 15 to 30 bytes, plus its text
+//
+//				This header uses only standard C++, so the reader can be built on any platform
+//
+// VERSION:		1.2
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Version 3 of the file adds stack IDs and the TA_REC_STACK records that define them. The flags moved up a bit to
+//			make room for the new kind
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Version 2 of the file adds TA_REC_DATA records, which hold the contents of buffer parameters
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstddef>
+#include <cstdint>
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_TRACE_MAGIC			"TATRACE"				// First bytes of a trace file
+#define	TA_TRACE_VERSION		3						// Version of the layout described above
+#define	TA_TRACE_MIN_VERSION	1						// Oldest version TraceReader reads (1 has no TA_REC_DATA records, and 1
+														// and 2 have no stacks)
+#define	TA_TRACE_MAX_ARGS		16						// Most arguments in a record
+#define	TA_TRACE_MAX_TEXT		52						// Most UTF-16 characters of text captured for a record
+#define	TA_TRACE_MAX_VARINT		10						// Longest varint (a 64-bit value)
+#define	TA_TRACE_MAX_DATA		232						// Most bytes of a buffer in one TA_REC_DATA record
+
+//
+// Kinds of records, in the low bits of a record's first byte
+//
+
+enum TA_RECORD_KINDS : uint8_t
+	{
+	TA_REC_PRE = 1,										// Pre-call event; args are the parameters
+	TA_REC_POST,										// Post-call event; args are the return value, last error and output parameters
+	TA_REC_DATA,										// Part of a buffer parameter of the event before it
+	TA_REC_STACK,										// Frames of a stack ID; args are the return addresses
+	};
+
+#define	TA_TRF_KIND_MASK		0x07					// Bits of the first byte that hold the TA_REC_xxx value
+#define	TA_TRF_THREAD			0x08					// The thread ID follows the timestamp
+#define	TA_TRF_TEXT				0x10					// The text follows the arguments
+#define	TA_TRF_STACK			0x20					// The stack ID follows the thread ID
+
+//
+// Parameter types, as classified by AutoGen (see trace_input_params and trace_output_params in Detours.stg)
+//
+
+enum TA_PARAM_TYPES : uint8_t
+	{
+	TA_PT_END = 0,										// Ends a parameter list in a TA_API_SCHEMA
+	TA_PT_SCALAR,										// Integer
+	TA_PT_ENUM,											// Enumeration
+	TA_PT_POINTER,										// Pointer or handle
+	TA_PT_WSTRZ,										// Pointer to a null-terminated wide string
+	TA_PT_ASCIZ,										// Pointer to a null-terminated ANSI string
+	TA_PT_CUSTOM,										// Structure passed by value (its first 8 bytes)
+	};
+
+//
+// TYPES:
+//
+
+//
+// The header at the start of a trace file, followed by the schema and the records
+//
+
+typedef struct _TA_TRACE_HEADER
+	{
+	char		magic [8];								// TA_TRACE_MAGIC
+	uint32_t	header_size;							// sizeof (TA_TRACE_HEADER)
+	uint32_t	version;								// TA_TRACE_VERSION
+	uint64_t	tick_frequency;							// Timestamp ticks per second
+	uint64_t	start_timestamp;						// Timestamp when the file was created
+	uint32_t	process_id;								// Process that was traced
+	uint32_t	api_count;								// APIs in the schema
+	} TA_TRACE_HEADER, *PTA_TRACE_HEADER;
+
+//
+// The schema of an API, in the form the generated code declares it. params is the pre-call parameter list, ended by
+// TA_PT_END, followed by the post-call list, also ended by TA_PT_END
+//
+
+typedef struct _TA_PARAM_SCHEMA
+	{
+	const char			*name;							// Parameter name
+	TA_PARAM_TYPES		type;							// TA_PT_xxx
+	} TA_PARAM_SCHEMA, *PTA_PARAM_SCHEMA;
+
+typedef struct _TA_API_SCHEMA
+	{
+	const char				*name;						// API name
+	const TA_PARAM_SCHEMA	*params;					// Pre-call, then post-call parameters
+	} TA_API_SCHEMA, *PTA_API_SCHEMA;
+
+//
+// DECLARATIONS:
+//
+
+static
+inline
+uint8_t *
+ta_put_varint											// Append a varint
+	(
+	uint8_t		*Buffer,								// Where to put it (at least TA_TRACE_MAX_VARINT bytes)
+	uint64_t	Value									// Value to encode
+	)
+	{
+	while (Value >= 0x80)
+		{
+		*Buffer++ = (uint8_t) (Value | 0x80);
+		Value >>= 7;
+		}
+
+	*Buffer++ = (uint8_t) Value;
+	return Buffer;
+	}
+
+static
+inline
+uint64_t
+ta_zigzag												// Map a signed difference to an unsigned value, small magnitudes first
+	(
+	int64_t		Value									// Difference
+	)
+	{
+	return ((uint64_t) Value << 1) ^ (uint64_t) (Value >> 63);
+	}
+
+static
+inline
+int64_t
+ta_unzigzag												// Reverse ta_zigzag
+	(
+	uint64_t	Value									// Encoded difference
+	)
+	{
+	return (int64_t) (Value >> 1) ^ -(int64_t) (Value & 1);
+	}
+
+}	// End of namespace FDI
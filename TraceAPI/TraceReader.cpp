@@ -0,0 +1,593 @@
+//
+// FACILITY:	TraceReader - Read a TraceAPI trace file
+//
+// DESCRIPTION:	This module contains the implementation of the TraceReader class
+//
+// VERSION:		1.3
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Read the file through a MappedFile. The bytes are decoded where they are mapped, and only strings and buffer
+//			snapshots are copied
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Read version 3 files, their stack IDs and TA_REC_STACK records. The flags of older files are moved to where
+//			version 3 has them
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Read version 2 files, and their TA_REC_DATA records
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstring>
+
+//
+// Project includes
+//
+
+#include "TraceReader.h"
+
+using namespace FDI;
+
+//
+// CONSTANTS:
+//
+
+#define	TA_READER_MAX_NAME		1024					// Longest API or parameter name accepted
+#define	TA_READER_MAX_APIS		65536					// Most APIs a schema can have (API numbers are 16 bits)
+
+
+
+TraceReader::TraceReader								// Constructor
+	(
+	)
+	: file_header (), window (nullptr), window_offset (0), position (0), length (0), last_timestamp (0), last_thread (0),
+	  record_count (0), bad (false)
+{
+	unknown.name = "?";
+}							// End routine TraceReader::TraceReader
+
+
+TraceReader::~TraceReader								// Destructor
+	(
+	)
+{
+	close ();
+}							// End routine TraceReader::~TraceReader
+
+
+bool
+TraceReader::open										// Open a trace file and read its schema
+	(
+	_In_z_	const char		*File_name					// File to read
+	)
+
+//
+// DESCRIPTION:		Open the file for a sequential scan, check its header, and read the name and parameter lists of each API
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	Closes the file that was open, if any
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file could not be opened, or is not a trace file of a version this reads
+//
+
+{
+uint8_t		count;
+uint8_t		type;
+
+
+	close ();
+	bad = false;
+	record_count = 0;
+	window = nullptr;
+	window_offset = 0;
+	position = 0;
+	length = 0;
+
+	if (!file.open (File_name, MAPPED_FILE_SEQUENTIAL, TA_READER_WINDOW))
+		{
+		return false;
+		}
+
+	if (!get_bytes (&file_header, sizeof (file_header)) ||
+		memcmp (file_header.magic, TA_TRACE_MAGIC, sizeof (file_header.magic)) != 0 ||
+		file_header.header_size != sizeof (file_header) || file_header.version < TA_TRACE_MIN_VERSION || file_header.version > TA_TRACE_VERSION ||
+		file_header.api_count > TA_READER_MAX_APIS)
+		{
+		close ();
+		return false;
+		}
+
+	apis.resize (file_header.api_count);
+
+	for (TA_TRACE_API& api : apis)
+		{
+		if (!get_string (api.name, TA_READER_MAX_NAME))
+			{
+			close ();
+			return false;
+			}
+
+		for (std::vector<TA_TRACE_PARAM> *list : {&api.pre, &api.post})
+			{
+			if (!get_byte (count))
+				{
+				close ();
+				return false;
+				}
+
+			list->resize (count);
+
+			for (TA_TRACE_PARAM& param : *list)
+				{
+				if (!get_byte (type) || !get_string (param.name, TA_READER_MAX_NAME))
+					{
+					close ();
+					return false;
+					}
+
+				param.type = (TA_PARAM_TYPES) type;
+				}
+			}
+		}
+
+	last_timestamp = file_header.start_timestamp;
+	last_thread = 0;
+	return true;
+}							// End routine TraceReader::open
+
+
+void
+TraceReader::close										// Close the file
+	(
+	)
+
+//
+// DESCRIPTION:		Unmap and close the file, and forget its schema
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		None
+//
+
+{
+	file.close ();
+	window = nullptr;
+	apis.clear ();
+	stacks.clear ();
+}							// End routine TraceReader::close
+
+
+bool
+TraceReader::next										// Read the next record
+	(
+	_Out_	TA_TRACE_EVENT&	Event						// Decoded record
+	)
+
+//
+// DESCRIPTION:		Decode the next record. The end of the file must fall between records; if it does not, or a record is
+//					malformed, failed returns true. The frames of a TA_REC_STACK record are also kept for stack
+//
+// ASSUMPTIONS:		open succeeded
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							No more records (the end of the file, or a damaged record)
+//
+
+{
+uint8_t		flags;
+uint64_t	value;
+
+
+	if (!file.is_open () || bad)
+		{
+		return false;
+		}
+
+	if (!get_byte (flags))
+		{
+		return false;									// The end of the file
+		}
+
+	bad = true;
+
+	//
+	// Before version 3, the kind was 2 bits, followed by the thread and text flags
+	//
+
+	if (file_header.version < 3)
+		{
+		if ((flags & ~0x0F) != 0)
+			{
+			return false;
+			}
+
+		flags = (flags & 0x03) | ((flags & 0x0C) << 1);
+		}
+
+	if ((flags & ~(TA_TRF_KIND_MASK | TA_TRF_THREAD | TA_TRF_TEXT | TA_TRF_STACK)) != 0 || (flags & TA_TRF_KIND_MASK) == 0 ||
+		(flags & TA_TRF_KIND_MASK) > TA_REC_STACK ||
+		((flags & TA_TRF_KIND_MASK) == TA_REC_DATA && ((flags & (TA_TRF_TEXT | TA_TRF_STACK)) || file_header.version < 2)) ||
+		((flags & TA_TRF_KIND_MASK) == TA_REC_STACK && ((flags & TA_TRF_TEXT) || !(flags & TA_TRF_STACK))))
+		{
+		return false;
+		}
+
+	Event.kind = flags & TA_TRF_KIND_MASK;
+
+	if (!get_varint (value) || value > UINT16_MAX)
+		{
+		return false;
+		}
+
+	Event.api = (uint16_t) value;
+
+	if (!get_varint (value))
+		{
+		return false;
+		}
+
+	last_timestamp += (uint64_t) ta_unzigzag (value);
+	Event.timestamp = last_timestamp;
+
+	if (flags & TA_TRF_THREAD)
+		{
+		if (!get_varint (value) || value > UINT32_MAX)
+			{
+			return false;
+			}
+
+		last_thread = (uint32_t) value;
+		}
+
+	Event.thread_id = last_thread;
+	Event.stack_id = 0;
+
+	if (flags & TA_TRF_STACK)
+		{
+		if (!get_varint (value) || value == 0 || value > UINT32_MAX)
+			{
+			return false;
+			}
+
+		Event.stack_id = (uint32_t) value;
+		}
+
+	if (Event.kind == TA_REC_DATA)
+		{
+		Event.arg_count = 0;
+		Event.text.clear ();
+
+		if (!get_byte (Event.param) || !get_varint (value) || value > UINT32_MAX)
+			{
+			return false;
+			}
+
+		Event.data_offset = (uint32_t) value;
+
+		if (!get_varint (value) || value > UINT32_MAX)
+			{
+			return false;
+			}
+
+		Event.data_size = (uint32_t) value;
+
+		if (!get_varint (value) || value > TA_TRACE_MAX_DATA)
+			{
+			return false;
+			}
+
+		Event.data.resize ((size_t) value);
+
+		if (value != 0 && !get_bytes (Event.data.data (), Event.data.size ()))
+			{
+			return false;
+			}
+
+		bad = false;
+		record_count++;
+		return true;
+		}
+
+	Event.data.clear ();
+
+	if (!get_byte (Event.arg_count) || Event.arg_count > TA_TRACE_MAX_ARGS)
+		{
+		return false;
+		}
+
+	for (uint8_t arg = 0; arg < Event.arg_count; arg++)
+		{
+		if (!get_varint (Event.args [arg]))
+			{
+			return false;
+			}
+		}
+
+	Event.text.clear ();
+
+	if ((flags & TA_TRF_TEXT) && !get_string (Event.text, TA_TRACE_MAX_TEXT * 3))
+		{
+		return false;
+		}
+
+	if (Event.kind == TA_REC_STACK)
+		{
+		stacks [Event.stack_id].assign (Event.args, Event.args + Event.arg_count);
+		}
+
+	bad = false;
+	record_count++;
+	return true;
+}							// End routine TraceReader::next
+
+
+const TA_TRACE_API&
+TraceReader::api										// Get the schema of an API
+	(
+	_In_	uint16_t		Api							// API number (from TA_TRACE_EVENT.api)
+	) const
+
+//
+// DESCRIPTION:		Return the API's entry in the schema. A number that is not in the schema (the process was traced with
+//					a different schema than it wrote) gets an entry named "?" with no parameters
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Schema of the API
+//
+
+{
+	return Api < apis.size () ? apis [Api] : unknown;
+}							// End routine TraceReader::api
+
+
+const std::vector<uint64_t> *
+TraceReader::stack										// Get the frames of a stack
+	(
+	_In_	uint32_t		Stack_id					// Stack ID (from TA_TRACE_EVENT.stack_id)
+	) const
+
+//
+// DESCRIPTION:		Return the frames of a stack whose TA_REC_STACK record has been read
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		Frames							Return addresses, innermost first
+//		nullptr							No record defining the stack ID has been read (yet)
+//
+
+{
+auto	found = stacks.find (Stack_id);
+
+
+	return found != stacks.end () ? &found->second : nullptr;
+}							// End routine TraceReader::stack
+
+
+bool
+TraceReader::fill										// Map the next part of the file
+	(
+	)
+
+//
+// DESCRIPTION:		Move the window to the part of the file after the one that has been decoded. Each window starts at a
+//					multiple of TA_READER_WINDOW, so it is mapped exactly
+//
+// ASSUMPTIONS:		All of the window has been decoded
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The end of the file, or it could not be mapped
+//
+
+{
+uint64_t	offset = window_offset + length;
+
+
+	if (offset >= file.size ())
+		{
+		return false;
+		}
+
+	length = file.size () - offset < TA_READER_WINDOW ? (size_t) (file.size () - offset) : TA_READER_WINDOW;
+
+	if ((window = file.view (offset, length)) == nullptr)
+		{
+		length = 0;
+		return false;
+		}
+
+	window_offset = offset;
+	position = 0;
+	return true;
+}							// End routine TraceReader::fill
+
+
+bool
+TraceReader::get_byte									// Read one byte
+	(
+	_Out_	uint8_t&		Byte						// Byte read
+	)
+
+//
+// DESCRIPTION:		Return the next byte of the file
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The end of the file
+//
+
+{
+	if (position == length && !fill ())
+		{
+		return false;
+		}
+
+	Byte = window [position++];
+	return true;
+}							// End routine TraceReader::get_byte
+
+
+bool
+TraceReader::get_bytes									// Read a number of bytes
+	(
+	_Out_	void			*Buffer,					// Where to put them
+	_In_	size_t			Length						// Number of bytes
+	)
+
+//
+// DESCRIPTION:		Copy the next bytes of the file, moving the window as needed
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file ended first
+//
+
+{
+uint8_t		*out = (uint8_t *) Buffer;
+size_t		count;
+
+
+	while (Length != 0)
+		{
+		if (position == length && !fill ())
+			{
+			return false;
+			}
+
+		count = length - position < Length ? length - position : Length;
+		memcpy (out, window + position, count);
+		position += count;
+		out += count;
+		Length -= count;
+		}
+
+	return true;
+}							// End routine TraceReader::get_bytes
+
+
+bool
+TraceReader::get_varint									// Read a varint
+	(
+	_Out_	uint64_t&		Value						// Value read
+	)
+
+//
+// DESCRIPTION:		Decode a varint of at most TA_TRACE_MAX_VARINT bytes
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file ended first, or the varint is too long
+//
+
+{
+uint8_t		byte;
+
+
+	Value = 0;
+
+	for (unsigned shift = 0; shift < 7 * TA_TRACE_MAX_VARINT; shift += 7)
+		{
+		if (!get_byte (byte))
+			{
+			return false;
+			}
+
+		Value |= (uint64_t) (byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+			{
+			return true;
+			}
+		}
+
+	return false;
+}							// End routine TraceReader::get_varint
+
+
+bool
+TraceReader::get_string									// Read a length-prefixed string
+	(
+	_Out_	std::string&	String,						// String read
+	_In_	size_t			Max_length					// Longest string accepted
+	)
+
+//
+// DESCRIPTION:		Decode a varint length, then that many characters
+//
+// ASSUMPTIONS:		None
+//
+// SIDE EFFECTS:	None
+//
+// RETURN VALUES:
+//
+//		true							Normal, successful completion
+//		false							The file ended first, or the string is too long
+//
+
+{
+uint64_t	size;
+
+
+	if (!get_varint (size) || size > Max_length)
+		{
+		return false;
+		}
+
+	String.resize ((size_t) size);
+	return size == 0 || get_bytes (&String [0], (size_t) size);
+}							// End routine TraceReader::get_string
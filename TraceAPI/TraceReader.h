@@ -0,0 +1,256 @@
+//
+// FACILITY:	TraceReader - Read a TraceAPI trace file
+//
+// DESCRIPTION:	The TraceReader class decodes a trace file written by the capture file sink (see TraceFormat.h). open reads the
+//				header and the schema, then each call to next returns one record, with its timestamp and thread ID restored and
+//				its arguments matched to the API's parameter list. The file is mapped (see MappedFile.h) and decoded in place, a
+//				window at a time, so traces of any length can be read in constant address space. A snapshot of a buffer
+//				parameter is returned as one or more TA_REC_DATA events after the event of its call.
+//
+//				An event's stack_id identifies its call's stack, which is defined by a TA_REC_STACK event somewhere in the same
+//				file. The reader keeps the stacks it has read, so once the whole file has been read, stack returns the frames of
+//				every stack ID in it
+//
+//				Example:
+//
+//					TraceReader		reader;
+//					TA_TRACE_EVENT	event;
+//
+//					if (reader.open ("TraceAPI-1234.tac"))
+//						{
+//						while (reader.next (event))
+//							{
+//							const TA_TRACE_API&	api = reader.api (event.api);
+//							...
+//							}
+//						}
+//
+//				This class uses only standard C++, so it can be used on any platform
+//
+// VERSION:		1.3
+//
+// AUTHOR:		Brian Catlin
+//
+// CREATED:		2026-10-17
+//
+// MODIFICATION HISTORY:
+//
+//	1.3		2026-10-17	Brian Catlin
+//			Decode the file in place through a MappedFile, instead of copying it into a buffer with fread
+//
+//	1.2		2026-10-17	Brian Catlin
+//			Read version 3 files: stack IDs, and the TA_REC_STACK records that define them. Added stack
+//
+//	1.1		2026-10-17	Brian Catlin
+//			Read version 2 files, and their TA_REC_DATA records
+//
+//	1.0		2026-10-17	Brian Catlin
+//			Original version
+//
+
+#pragma once
+
+//
+// INCLUDE FILES:
+//
+
+//
+// System includes
+//
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//
+// Project includes
+//
+
+#include "TraceFormat.h"
+#include "../Global/MappedFile.h"
+
+//
+// MACROS:
+//
+
+#ifndef _WIN32											// Annotations used below, for the Linux build
+#define	_In_
+#define	_In_z_
+#define	_Out_
+#endif
+
+namespace FDI		// Five Directions Inc
+{
+
+//
+// CONSTANTS:
+//
+
+#define	TA_READER_WINDOW		(16 * 1024 * 1024)		// Bytes of the file mapped at a time
+
+//
+// TYPES:
+//
+
+typedef struct _TA_TRACE_PARAM
+	{
+	std::string			name;							// Parameter name
+	TA_PARAM_TYPES		type;							// TA_PT_xxx
+	} TA_TRACE_PARAM, *PTA_TRACE_PARAM;
+
+typedef struct _TA_TRACE_API
+	{
+	std::string					name;					// API name
+	std::vector<TA_TRACE_PARAM>	pre;					// Arguments of a pre-call record
+	std::vector<TA_TRACE_PARAM>	post;					// Arguments of a post-call record
+	} TA_TRACE_API, *PTA_TRACE_API;
+
+typedef struct _TA_TRACE_EVENT
+	{
+	uint64_t			timestamp;						// Ticks; see TA_TRACE_HEADER.tick_frequency
+	uint32_t			thread_id;						// Thread that made the call
+	uint32_t			stack_id;						// Call's stack (0 if none); TA_REC_STACK: the ID it defines
+	uint16_t			api;							// API number
+	uint8_t				kind;							// TA_REC_xxx
+	uint8_t				arg_count;						// Entries used in args
+	uint64_t			args [TA_TRACE_MAX_ARGS];		// Argument values, in the order of the API's parameter list (TA_REC_STACK:
+														// the return addresses, innermost first)
+	std::string			text;							// First string argument (truncated), UTF-8; empty if none
+	uint8_t				param;							// TA_REC_DATA: parameter number (index in the API's pre list)
+	uint32_t			data_offset;					// TA_REC_DATA: offset of data in the buffer
+	uint32_t			data_size;						// TA_REC_DATA: size of the buffer, before the capture limits
+	std::vector<uint8_t>	data;						// TA_REC_DATA: bytes of the buffer
+	} TA_TRACE_EVENT, *PTA_TRACE_EVENT;
+
+//
+// DECLARATIONS:
+//
+
+class TraceReader
+{
+public:
+
+	//
+	// Class constructors and destructor
+	//
+
+	TraceReader ();
+
+	~TraceReader ();
+
+	//
+	// Public methods
+	//
+
+	bool
+	open												// Open a trace file and read its schema
+		(
+		_In_z_	const char		*File_name				// File to read
+		);
+
+	void
+	close												// Close the file
+		(
+		);
+
+	bool
+	next												// Read the next record
+		(
+		_Out_	TA_TRACE_EVENT&	Event					// Decoded record
+		);
+
+	bool
+	failed												// Determine whether reading stopped because the file is damaged
+		(
+		) const
+		{
+		return bad;
+		}
+
+	const TA_TRACE_HEADER&
+	header												// Get the file's header
+		(
+		) const
+		{
+		return file_header;
+		}
+
+	uint32_t
+	api_count											// Number of APIs in the schema
+		(
+		) const
+		{
+		return (uint32_t) apis.size ();
+		}
+
+	const TA_TRACE_API&
+	api													// Get the schema of an API
+		(
+		_In_	uint16_t		Api						// API number (from TA_TRACE_EVENT.api)
+		) const;
+
+	const std::vector<uint64_t> *
+	stack												// Get the frames of a stack
+		(
+		_In_	uint32_t		Stack_id				// Stack ID (from TA_TRACE_EVENT.stack_id)
+		) const;
+
+	uint64_t
+	records												// Number of records read so far
+		(
+		) const
+		{
+		return record_count;
+		}
+
+private:
+
+	bool
+	fill												// Map the next part of the file
+		(
+		);
+
+	bool
+	get_byte											// Read one byte
+		(
+		_Out_	uint8_t&		Byte					// Byte read
+		);
+
+	bool
+	get_bytes											// Read a number of bytes
+		(
+		_Out_	void			*Buffer,				// Where to put them
+		_In_	size_t			Length					// Number of bytes
+		);
+
+	bool
+	get_varint											// Read a varint
+		(
+		_Out_	uint64_t&		Value					// Value read
+		);
+
+	bool
+	get_string											// Read a length-prefixed string
+		(
+		_Out_	std::string&	String,					// String read
+		_In_	size_t			Max_length				// Longest string accepted
+		);
+
+	MappedFile					file;					// Trace file
+	TA_TRACE_HEADER				file_header;			// Its header
+	std::vector<TA_TRACE_API>	apis;					// Its schema
+	std::unordered_map<uint32_t, std::vector<uint64_t>>	stacks;	// Stacks read so far, by ID
+	TA_TRACE_API				unknown;				// Returned by api for a number not in the schema
+	const uint8_t				*window;				// Part of the file being decoded
+	uint64_t					window_offset;			// Offset of the window in the file
+	size_t						position;				// Next byte to decode in window
+	size_t						length;					// Bytes in window
+	uint64_t					last_timestamp;			// Timestamp of the previous record
+	uint32_t					last_thread;			// Thread of the previous record
+	uint64_t					record_count;			// Records decoded
+	bool						bad;					// The file is damaged
+
+};	// End class TraceReader
+
+}	// End of namespace FDI